@@ -0,0 +1,874 @@
+// buffercache.cc
+//	Routines to manage the cache of disk sectors used by the file
+//	system.  A sector is looked up through a hash table on its sector
+//	number; on a miss, a buffer nobody is using is recycled using the
+//	CLOCK algorithm, writing its old contents back first if they
+//	were changed.
+//
+//	Use a lock to make each cache operation atomic.  The lock is
+//	released while a buffer is read in from disk; the buffer stays
+//	in the hash table marked busy, so two threads never load the same
+//	sector into two buffers, and other sectors can be found meanwhile.
+//	It is released while dirty buffers are written back too; they stay
+//	in use, marked writing, until the copy of them sent is on disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "buffercache.h"
+#include "main.h"
+#include "threadpool.h"
+
+//----------------------------------------------------------------------
+// BufferSector, HashSector
+// 	Helper functions for the hash table from sector numbers to buffers.
+//----------------------------------------------------------------------
+
+static int
+BufferSector(CacheBuffer *buffer)
+{
+    return buffer->sector;
+}
+
+static unsigned
+HashSector(int sector)
+{
+    return (unsigned) sector;
+}
+
+//----------------------------------------------------------------------
+// CacheBuffer::CacheBuffer
+// 	Initialize an unused buffer.
+//----------------------------------------------------------------------
+
+CacheBuffer::CacheBuffer()
+{
+    sector = -1;
+    refCount = 0;
+    dirty = FALSE;
+    referenced = FALSE;
+    busy = FALSE;
+    pinned = FALSE;
+    writing = FALSE;
+    transient = FALSE;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::BufferCache
+// 	Initialize an empty cache in front of a synchronous disk.
+//
+//	"disk" -- the disk the cached sectors belong to
+//	"numBuffers" -- how many sectors the cache can hold
+//	"flushInterval" -- ticks after a clean cache is changed that it is
+//		flushed behind
+//	"dirtyPercent" -- percentage of the buffers dirty that gets it
+//		flushed behind at once
+//----------------------------------------------------------------------
+
+BufferCache::BufferCache(SynchDisk *disk, int numBuffers, int flushInterval,
+                         int dirtyPercent)
+{
+    ASSERT((numBuffers > 0) && (flushInterval > 0));
+
+    synchDisk = disk;
+    this->numBuffers = numBuffers;
+    buffers = new CacheBuffer[numBuffers];
+    hand = 0;
+    table = new OpenHashTable<int, CacheBuffer *>(BufferSector, HashSector);
+    lock = new Lock("buffer cache lock");
+    ioDone = new Condition("buffer cache I/O done");
+    readAheadQueue = new List<int>;
+    numQueued = 0;
+    numTransient = 0;
+    numDirty = numWriting = 0;
+    this->flushInterval = flushInterval;
+    dirtyLimit = max(1, numBuffers * dirtyPercent / 100);
+    flushCursor = 0;
+    flusher = NULL;
+    flushWake = new Semaphore("buffer cache flush", 0);
+    flushWanted = timerSet = FALSE;
+    journal = NULL;
+    checksums = NULL;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::~BufferCache
+// 	De-allocate the cache.  Anything still dirty is lost, so Flush
+//	must be called first.  Sectors still queued for read ahead are
+//	not read; Nachos is shutting down.
+//----------------------------------------------------------------------
+
+BufferCache::~BufferCache()
+{
+    for (int i = 0; i < numBuffers; i++) {
+        if (buffers[i].sector != -1) {
+            table->Remove(buffers[i].sector);
+        }
+    }
+    delete checksums;
+    delete readAheadQueue;
+    delete flushWake;
+    delete ioDone;
+    delete lock;
+    delete table;
+    delete [] buffers;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadSector
+// 	Copy the contents of a disk sector into "data", reading it from
+//	disk only if it is not already in the cache.
+//
+//	"sectorNumber" -- the disk sector to read
+//	"data" -- the buffer to hold the contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadSector(int sectorNumber, char *data)
+{
+    CacheBuffer *buffer = GetBuffer(sectorNumber, TRUE);
+
+    bcopy(buffer->data, data, SectorSize);
+    ReleaseBuffer(buffer, FALSE);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteSector
+// 	Replace the contents of a disk sector.  The new contents are only
+//	kept in the cache; they reach the disk later.
+//
+//	"sectorNumber" -- the disk sector to be written
+//	"data" -- the new contents of the disk sector
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteSector(int sectorNumber, char *data)
+{
+    CacheBuffer *buffer = GetBuffer(sectorNumber, FALSE);
+
+    bcopy(data, buffer->data, SectorSize);
+    ReleaseBuffer(buffer, TRUE);
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffer
+// 	Return the buffer caching a disk sector, loading the sector into
+//	the cache if needed.  The buffer will not be replaced until the
+//	caller gives it back with ReleaseBuffer.
+//
+//	"sectorNumber" -- the disk sector wanted
+//	"readIn" -- FALSE if the caller is going to overwrite the whole
+//		sector, in which case there is no need to read it on a miss
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::GetBuffer(int sectorNumber, bool readIn)
+{
+    CacheBuffer *buffer;
+
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+
+    lock->Acquire();
+    buffer = Lookup(sectorNumber, readIn, TRUE);
+    buffer->refCount++;
+    buffer->referenced = TRUE;
+    SetTransient(buffer, FALSE);
+    lock->Release();
+    return buffer;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::GetBuffers
+// 	Return the buffers caching a run of consecutive disk sectors, as
+//	GetBuffer would one by one.  Each run of the sectors that are not
+//	in the cache is read in with a single disk request, scattered
+//	straight into the buffers recycled for it.
+//
+//	So as not to tie up the whole cache, at most MaxRunSectors (and
+//	at most a quarter of the cache) are gotten at once; the number
+//	actually gotten is returned, and the caller asks again for the
+//	rest.
+//
+//	"firstSector" -- the first disk sector wanted
+//	"count" -- how many consecutive sectors are wanted
+//	"buffers" -- where to return the buffers, one per sector
+//----------------------------------------------------------------------
+
+int
+BufferCache::GetBuffers(int firstSector, int count, CacheBuffer **buffers)
+{
+    char *data[MaxRunSectors];
+    int i, j;
+
+    ASSERT(count > 0);
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+    count = min(count, min(MaxRunSectors, max(numBuffers / 4, 1)));
+
+    lock->Acquire();
+    for (i = 0; i < count; i = j) {
+        if (table->IsInTable(firstSector + i)) {
+            buffers[i] = Lookup(firstSector + i, TRUE, TRUE);
+            buffers[i]->refCount++;
+            buffers[i]->referenced = TRUE;
+            SetTransient(buffers[i], FALSE);
+            j = i + 1;
+            continue;
+        }
+
+        // claim buffers for every missing sector from here on, then
+        // read them all in at once
+        for (j = i; (j < count) && !table->IsInTable(firstSector + j); j++) {
+            CacheBuffer *buffer = FindVictim();
+
+            kernel->stats->numCacheMisses++;
+            if (buffer->sector != -1) {
+                table->Remove(buffer->sector);
+            }
+            buffer->sector = firstSector + j;
+            buffer->dirty = FALSE;
+            buffer->busy = TRUE;
+            buffer->refCount++;
+            buffer->referenced = TRUE;
+            table->Insert(buffer);
+            buffers[j] = buffer;
+            data[j - i] = buffer->data;
+        }
+        lock->Release();
+        synchDisk->ReadSectors(firstSector + i, j - i, data);
+        lock->Acquire();
+        for (int k = i; k < j; k++) {
+            Verify(buffers[k]);
+            buffers[k]->busy = FALSE;
+        }
+        ioDone->Broadcast(lock);
+    }
+    lock->Release();
+    return count;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReleaseBuffer
+// 	Give back a buffer obtained with GetBuffer.  If it was changed,
+//	the journal may log the change, in which case the buffer is pinned
+//	until the journal commits it.
+//
+//	A transient buffer is replaced before any other, and is not given
+//	a second chance.
+//
+//	"buffer" -- the buffer
+//	"changed" -- TRUE if the caller modified its contents
+//	"transient" -- TRUE if the caller will not want it again soon
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReleaseBuffer(CacheBuffer *buffer, bool changed, bool transient)
+{
+    lock->Acquire();
+    ASSERT(buffer->refCount > 0);
+    buffer->refCount--;
+    if (transient) {
+        SetTransient(buffer, TRUE);
+        buffer->referenced = FALSE;
+    }
+    if (changed) {
+        if (!buffer->dirty) {
+            buffer->dirty = TRUE;
+            Changed(buffer);
+        }
+        if (!buffer->pinned && (journal != NULL) &&
+            journal->Log(buffer->sector)) {
+            buffer->pinned = TRUE;
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Changed
+// 	A clean buffer has just been made dirty: count it, and see to it
+//	that the flusher gets to it -- at once, if enough buffers are
+//	dirty, or else once the flush interval is up.  The flusher thread
+//	is forked the first time.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Changed(CacheBuffer *buffer)
+{
+    numDirty++;
+    if (flusher == NULL) {
+        flusher = new Thread("buffer cache flusher", 1);
+        flusher->Fork(BufferCache::Flusher, this);
+    }
+    if (!timerSet) {
+        timerSet = TRUE;
+        kernel->alarm->CallAfter(flushInterval, this);
+    }
+    if (!flushWanted && (numDirty >= dirtyLimit)) {
+        flushWanted = TRUE;
+        flushWake->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteThrough
+// 	Replace the contents of a run of consecutive sectors, writing
+//	them from "data" to the disk with one request.  Sectors that are
+//	cached get the new contents too, and are clean afterwards; the
+//	others are not brought into the cache.  Used for bulk writes,
+//	which would otherwise push everything else out of the cache.
+//
+//	During a journaled operation the sectors go through the cache one
+//	by one instead, so that they are logged.
+//
+//	"firstSector" -- the first disk sector to be written
+//	"count" -- how many sectors
+//	"data" -- count * SectorSize bytes of new contents
+//----------------------------------------------------------------------
+
+void
+BufferCache::WriteThrough(int firstSector, int count, char *data)
+{
+    CacheBuffer *buffer;
+
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    if ((journal != NULL) && journal->InOperation()) {
+        for (int i = 0; i < count; i++) {
+            WriteSector(firstSector + i, &data[i * SectorSize]);
+        }
+        return;
+    }
+    lock->Acquire();
+    for (int i = 0; i < count; i++) {
+        while (table->Find(firstSector + i, &buffer) &&
+               (buffer->busy || buffer->writing)) {
+            ioDone->Wait(lock); // don't let a read in land on top, or
+                                // an older write back
+        }
+        if (table->Find(firstSector + i, &buffer)) {
+            bcopy(&data[i * SectorSize], buffer->data, SectorSize);
+            if (buffer->dirty) {
+                numDirty--;
+            }
+            buffer->dirty = FALSE;
+        }
+        if (checksums != NULL) {
+            checksums->Update(firstSector + i, &data[i * SectorSize]);
+        }
+    }
+    synchDisk->WriteSectors(firstSector, count, data);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAhead
+// 	Queue a sector to be loaded into the cache by a task run in the
+//	kernel's thread pool, and return right away.  This is only a hint: nothing
+//	happens if the sector is already cached, or if too many sectors
+//	are already queued (at most a quarter of the cache, so that
+//	read ahead can never tie up every buffer).
+//
+//	A transient sector is queued as -(sector + 1), and is marked
+//	transient once it is loaded.
+//
+//	"sectorNumber" -- the disk sector that will probably be read soon
+//	"transient" -- TRUE if it will be read only the once
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadAhead(int sectorNumber, bool transient)
+{
+    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+
+    lock->Acquire();
+    if ((numQueued < numBuffers / 4) && !table->IsInTable(sectorNumber)) {
+        numQueued++;
+        readAheadQueue->Append(transient ? -(sectorNumber + 1) : sectorNumber);
+        kernel->threadPool->Submit(BufferCache::ReadAheadTask, this);
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::ReadAheadTask
+// 	Run by the kernel's thread pool, once per sector queued: take the
+//	next queued sector and load it into the cache, unless someone
+//	else already has.  Sectors read here are not counted as hits or
+//	misses.
+//
+//	"data" -- the buffer cache
+//----------------------------------------------------------------------
+
+void
+BufferCache::ReadAheadTask(void *data)
+{
+    BufferCache *cache = (BufferCache *)data;
+    CacheBuffer *buffer;
+    int sector;
+    bool transient;
+
+    cache->lock->Acquire();
+    sector = cache->readAheadQueue->RemoveFront();
+    transient = (sector < 0);
+    if (transient) {
+        sector = -(sector + 1);
+    }
+    if (!cache->table->IsInTable(sector)) {
+        DEBUG(dbgFile, "Reading ahead sector " << sector);
+        kernel->stats->numReadAheads++;
+        buffer = cache->Lookup(sector, TRUE, FALSE);
+        buffer->referenced = !transient;
+        cache->SetTransient(buffer, transient);
+    }
+    cache->numQueued--;
+    cache->lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flusher
+// 	Body of the flusher thread: each time it is woken, write the dirty
+//	buffers back (flush behind), so that they are clean by the time
+//	they are chosen for replacement.  One sweep goes up the disk from
+//	where the last stopped, and round to it again, FlushBatch sectors
+//	at a time; the cache is unlocked while each batch is on its way.
+//
+//	"data" -- the buffer cache
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flusher(void *data)
+{
+    BufferCache *cache = (BufferCache *)data;
+
+    for (;;) {
+        int start, first, written = 0, n;
+
+        cache->flushWake->P();
+        cache->lock->Acquire();
+        cache->flushWanted = FALSE;
+        DEBUG(dbgFile, "Flushing the buffer cache behind, " << cache->numDirty
+              << " buffers dirty");
+        start = first = cache->flushCursor;
+        while ((n = cache->WriteBack(&first, NumSectors, FlushBatch)) > 0) {
+            written += n;
+            cache->flushCursor = first;
+        }
+        first = 0;
+        while ((n = cache->WriteBack(&first, start, FlushBatch)) > 0) {
+            written += n;
+            cache->flushCursor = first;
+        }
+        if (written > 0) {
+            if (cache->checksums != NULL) {
+                cache->checksums->WriteBack(); // after the sectors
+            }
+            kernel->stats->numFlushBehinds++;
+            kernel->stats->numSectorsFlushed += written;
+        }
+        cache->lock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::CallBack
+// 	Interrupt handler for the flush interval: wake the flusher.
+//	Interrupts are off, so "timerSet" can be changed without the lock.
+//----------------------------------------------------------------------
+
+void
+BufferCache::CallBack()
+{
+    timerSet = FALSE;
+    if (!flushWanted) {
+        flushWanted = TRUE;
+        flushWake->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Demote
+// 	A run of sectors will not be used again soon: mark the buffers of
+//	those that are cached transient, so that they are the next to be
+//	replaced.  Dirty ones are written back then, as usual.
+//
+//	"firstSector" -- the first sector of the run
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void
+BufferCache::Demote(int firstSector, int count)
+{
+    CacheBuffer *buffer;
+
+    lock->Acquire();
+    for (int i = 0; i < count; i++) {
+        if (table->Find(firstSector + i, &buffer)) {
+            buffer->referenced = FALSE;
+            SetTransient(buffer, TRUE);
+        }
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::SetTransient
+// 	Mark a buffer transient, or not, keeping count of how many are.
+//	The lock must be held.
+//----------------------------------------------------------------------
+
+void
+BufferCache::SetTransient(CacheBuffer *buffer, bool transient)
+{
+    if (buffer->transient != transient) {
+        buffer->transient = transient;
+        numTransient += transient ? 1 : -1;
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Unpin
+// 	The journal has committed a sector to its log: its buffer may now
+//	be written back and replaced like any other.
+//
+//	"sectorNumber" -- the sector committed
+//----------------------------------------------------------------------
+
+void
+BufferCache::Unpin(int sectorNumber)
+{
+    CacheBuffer *buffer;
+
+    lock->Acquire();
+    if (table->Find(sectorNumber, &buffer)) {
+        buffer->pinned = FALSE;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Flush, BufferCache::FlushRange
+// 	Write every dirty buffer back to the disk (or those of the run of
+//	sectors from "firstSector"), except those pinned by the journal,
+//	and return once they are there.  The buffers stay in the cache,
+//	now clean.  Buffers the flusher is writing back are waited for,
+//	and written again if they have been changed since.  The checksums
+//	of the sectors written are written last.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Flush()
+{
+    FlushRange(0, NumSectors);
+}
+
+void
+BufferCache::FlushRange(int firstSector, int count)
+{
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    lock->Acquire();
+    for (;;) {
+        int first = firstSector;
+
+        while (WriteBack(&first, firstSector + count, FlushBatch) > 0) {
+            continue;
+        }
+        if (numWriting == 0) {
+            break;
+        }
+        ioDone->Wait(lock);     // for the flusher
+    }
+    if (checksums != NULL) {
+        checksums->WriteBack(); // after the sectors they describe
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::WriteBack
+// 	Write back the lowest-numbered dirty buffers of a run of sectors,
+//	up to "maxSectors" of them, except those pinned, or being written
+//	already.  They are marked clean, and copied, so that they can be
+//	changed again while the copy is on its way; then the lock is let
+//	go while the copy is written, each run of consecutive sectors (up
+//	to MaxRunSectors) in one disk request, all submitted before any
+//	is waited for.  Meanwhile the buffers are held, and marked
+//	writing, so that they are not replaced, nor read in again from
+//	under the write.  The lock must be held.
+//
+//	"first" -- the first sector to look at; moved past the last one
+//		written
+//	"end" -- the sector after the last one to look at
+//	"maxSectors" -- at most FlushBatch
+//
+// Returns:
+//	The number of sectors written.
+//----------------------------------------------------------------------
+
+int
+BufferCache::WriteBack(int *first, int end, int maxSectors)
+{
+    int sectors[FlushBatch];
+    CacheBuffer *held[FlushBatch];
+    List<DiskRequest *> *pending;
+    char *copy, **data;
+    int n = 0;
+
+    ASSERT(maxSectors <= FlushBatch);
+
+    // the lowest dirty sectors, in order
+    for (int i = 0; i < numBuffers; i++) {
+        CacheBuffer *buffer = &buffers[i];
+        int j;
+
+        if (!buffer->dirty || buffer->pinned || buffer->writing ||
+            (buffer->sector < *first) || (buffer->sector >= end)) {
+            continue;
+        }
+        if (n < maxSectors) {
+            j = n++;
+        } else if (buffer->sector < sectors[maxSectors - 1]) {
+            j = maxSectors - 1;
+        } else {
+            continue;
+        }
+        for (; (j > 0) && (sectors[j - 1] > buffer->sector); j--) {
+            sectors[j] = sectors[j - 1];
+        }
+        sectors[j] = buffer->sector;
+    }
+    if (n == 0) {
+        return 0;
+    }
+
+    copy = new char[n * SectorSize];
+    data = new char *[n];
+    for (int i = 0; i < n; i++) {
+        table->Find(sectors[i], &held[i]);
+        bcopy(held[i]->data, &copy[i * SectorSize], SectorSize);
+        data[i] = &copy[i * SectorSize];
+        held[i]->dirty = FALSE;
+        held[i]->writing = TRUE;
+        held[i]->refCount++;
+        if (checksums != NULL) {
+            checksums->Update(sectors[i], held[i]->data);
+        }
+    }
+    numDirty -= n;
+    numWriting += n;
+    lock->Release();
+
+    pending = new List<DiskRequest *>;
+    for (int i = 0, run; i < n; i += run) {
+        DiskRequest *request;
+
+        for (run = 1; (i + run < n) && (run < MaxRunSectors) &&
+                 (sectors[i + run] == sectors[i] + run); run++) {
+            continue;
+        }
+        request = new DiskRequest(sectors[i], run, &data[i], TRUE, NULL);
+        synchDisk->Submit(request);
+        pending->Append(request);
+    }
+    while (!pending->IsEmpty()) {
+        DiskRequest *request = pending->RemoveFront();
+
+        synchDisk->Wait(request);
+        delete request;
+    }
+    delete pending;
+    delete [] data;
+    delete [] copy;
+
+    lock->Acquire();
+    for (int i = 0; i < n; i++) {
+        held[i]->writing = FALSE;
+        held[i]->refCount--;
+    }
+    numWriting -= n;
+    ioDone->Broadcast(lock);
+    *first = sectors[n - 1] + 1;
+    return n;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Discard
+// 	The file system has freed a run of sectors: drop them from the
+//	cache without writing them back, and tell the disk their contents
+//	are no longer needed.  A buffer someone is still holding stays
+//	cached, but is no longer dirty.  The journal revokes them, and
+//	their checksums are dropped.
+//
+//	"firstSector" -- the first sector freed
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void
+BufferCache::Discard(int firstSector, int count)
+{
+    lock->Acquire();
+    for (int i = 0; i < numBuffers; i++) {
+        CacheBuffer *buffer = &buffers[i];
+
+        if ((buffer->sector < firstSector) ||
+            (buffer->sector >= firstSector + count)) {
+            continue;
+        }
+        if (buffer->dirty) {
+            numDirty--;
+        }
+        buffer->dirty = FALSE;
+        buffer->pinned = FALSE;
+        if ((buffer->refCount == 0) && !buffer->busy) {
+            table->Remove(buffer->sector);
+            buffer->sector = -1;
+            buffer->referenced = FALSE;
+        }
+    }
+    if (journal != NULL) {
+        journal->Revoke(firstSector, count);
+    }
+    if (checksums != NULL) {
+        checksums->Forget(firstSector, count);
+    }
+    synchDisk->Discard(firstSector, count);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// BufferCache::IsDirty
+// 	Return TRUE if a sector is in the cache, changed since it was last
+//	written back, and free to be written back now.  The lock must be
+//	held.
+//----------------------------------------------------------------------
+
+bool
+BufferCache::IsDirty(int sectorNumber)
+{
+    CacheBuffer *buffer;
+
+    return table->Find(sectorNumber, &buffer) && buffer->dirty &&
+           !buffer->pinned;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Verify
+// 	Check a buffer just read in from disk against its sector's
+//	checksum, if the disk keeps them.  Damage is reported, and
+//	counted; the data is handed out anyway, since there is no better
+//	copy to be had.  The lock must be held.
+//----------------------------------------------------------------------
+
+void
+BufferCache::Verify(CacheBuffer *buffer)
+{
+    if ((checksums != NULL) && !checksums->Verify(buffer->sector, buffer->data)) {
+        cerr << "Buffer cache: sector " << buffer->sector
+             << " does not match its checksum\n";
+    }
+}
+
+//----------------------------------------------------------------------
+// BufferCache::Lookup
+// 	Return the buffer caching a disk sector, loading the sector into
+//	a recycled buffer on a miss.  The lock must be held; it is let go
+//	while waiting for the disk, with the buffer marked busy so nobody
+//	uses or replaces it until its contents are valid.
+//
+//	"sectorNumber" -- the disk sector wanted
+//	"readIn" -- FALSE if its old contents are not needed
+//	"demand" -- TRUE if someone is waiting for the sector, in which
+//		case the access is counted as a hit or a miss
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::Lookup(int sectorNumber, bool readIn, bool demand)
+{
+    CacheBuffer *buffer;
+
+    while (table->Find(sectorNumber, &buffer)) {
+        if (!buffer->busy) {
+            if (demand) {
+                kernel->stats->numCacheHits++;
+            }
+            return buffer;
+        }
+        ioDone->Wait(lock); // being read in; it may be gone afterwards
+    }
+
+    if (demand) {
+        kernel->stats->numCacheMisses++;
+    }
+    buffer = FindVictim();
+    if (buffer->sector != -1) {
+        table->Remove(buffer->sector);
+    }
+    buffer->sector = sectorNumber;
+    buffer->dirty = FALSE;
+    table->Insert(buffer);
+    if (readIn) {
+        buffer->busy = TRUE;
+        buffer->refCount++;
+        lock->Release();
+        synchDisk->ReadSector(sectorNumber, buffer->data);
+        lock->Acquire();
+        Verify(buffer);
+        buffer->busy = FALSE;
+        buffer->refCount--;
+        ioDone->Broadcast(lock);
+    }
+    return buffer;
+}
+
+//----------------------------------------------------------------------
+// BufferCache::FindVictim
+// 	Choose a buffer to hold a new sector, using the CLOCK algorithm:
+//	sweep around the buffers, skipping ones in use or pinned and
+//	giving recently referenced ones a second chance.  A transient
+//	buffer that is not in use is taken before any of that.  If the
+//	victim is dirty, write it back first.  The lock must be held.
+//----------------------------------------------------------------------
+
+CacheBuffer *
+BufferCache::FindVictim()
+{
+    CacheBuffer *victim = NULL;
+
+    for (int i = 0; (numTransient > 0) && (i < numBuffers); i++) {
+        if (buffers[i].transient && (buffers[i].refCount == 0) &&
+            !buffers[i].pinned) {
+            victim = &buffers[i];
+            break;
+        }
+    }
+
+    // one full sweep clears every reference bit, so the second finds
+    // a victim unless every buffer is in use
+    for (int i = 0; (victim == NULL) && (i < 2 * numBuffers); i++) {
+        CacheBuffer *buffer = &buffers[hand];
+        hand = (hand + 1) % numBuffers;
+        if ((buffer->refCount > 0) || buffer->pinned) {
+            continue;
+        }
+        if (buffer->referenced) {
+            buffer->referenced = FALSE;
+            continue;
+        }
+        victim = buffer;
+    }
+    ASSERT(victim != NULL); // else every buffer is in use: the cache is
+                            // too small
+    if (victim->dirty) {
+        DEBUG(dbgFile, "Buffer cache writes back sector " << victim->sector);
+        if (checksums != NULL) {
+            checksums->Update(victim->sector, victim->data);
+        }
+        synchDisk->WriteSector(victim->sector, victim->data);
+        victim->dirty = FALSE;
+        numDirty--;
+    }
+    SetTransient(victim, FALSE);
+    return victim;
+}
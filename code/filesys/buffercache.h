@@ -0,0 +1,207 @@
+// buffercache.h
+//	Data structures for a cache of disk sectors kept in memory,
+//	shared by every part of the file system.
+//
+//	All file system disk traffic -- file headers, index sectors,
+//	directories, the free map and file data -- goes through the
+//	cache instead of straight to the synchronous disk, so that
+//	sectors used over and over (the root directory, for instance)
+//	are only read once.
+//
+//	Writes are not sent to the disk right away: a modified buffer is
+//	only marked dirty, and is written back when it is chosen for
+//	replacement or when the cache is flushed (at the latest, when
+//	Nachos halts).  A flusher thread writes dirty buffers back in the
+//	background (flush behind): "flushInterval" ticks after a clean
+//	cache is first changed, or as soon as "dirtyPercent" of the
+//	buffers are dirty.  It writes them in sector order, FlushBatch
+//	sectors at a time, from a copy, with the cache unlocked: writers
+//	carry on changing buffers meanwhile, and only wait for the disk
+//	when they ask to (Flush, FlushRange).
+//
+//	Buffers are replaced with the CLOCK algorithm.  A buffer that
+//	is in use (its reference count is not zero) is never replaced.
+//	Buffers marked transient -- read by a scan that will not come
+//	back to them, or given up with a hint (see OpenFile::Advise) --
+//	are replaced before any other, so that a long scan recycles its
+//	own buffers instead of pushing out the directories and headers
+//	every lookup needs.
+//
+//	Sectors can also be read ahead: ReadAhead queues a sector for
+//	a task in the kernel's thread pool to load into the cache, so
+//	that the thread asking for it keeps running while the disk works.
+//
+//	Runs of consecutive sectors are read in (GetBuffers) and flushed
+//	out with a single multi-sector disk request each.
+//
+//	When a journal is attached, the buffer of a sector changed during
+//	a file system operation is pinned: it stays in the cache and is
+//	not written back until the journal has committed it to its log.
+//
+//	When the disk has a table of checksums (see checksum.h), every
+//	sector written back has its checksum updated, and every sector
+//	read in is checked against it.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef BUFFERCACHE_H
+#define BUFFERCACHE_H
+
+#include "disk.h"
+#include "synch.h"
+#include "synchdisk.h"
+#include "openhash.h"
+#include "list.h"
+#include "journal.h"
+#include "checksum.h"
+#include "callback.h"
+
+// Default number of sectors kept in the cache; can be changed
+// with the "-bc" flag.
+#define NumCacheSectors 64
+
+// Most sectors moved between the cache and the disk in one request.
+#define MaxRunSectors 16
+
+// Defaults for the flusher; can be changed with the "-bf" flag.
+#define FlushInterval 20000 // ticks a clean cache may be changed
+                            // for before it is flushed behind
+#define DirtyPercent 25     // buffers dirty, in percent, that start
+                            // a flush behind at once
+
+// Most sectors written back in one go, with the cache unlocked.
+#define FlushBatch 32
+
+// The following class defines one buffer of the cache, holding the
+// contents of one disk sector.
+
+class CacheBuffer
+{
+public:
+    CacheBuffer();
+
+    int sector;            // the disk sector cached here, or -1
+    int refCount;          // number of users holding this buffer
+    bool dirty;            // changed since it was read or written back
+    bool referenced;       // used since the clock hand last went by
+    bool busy;             // being read in from disk; contents not valid
+    bool pinned;           // logged but not yet committed by the journal;
+                           // must not be written back or replaced
+    bool writing;          // being written back; held, so not replaced
+    bool transient;        // not wanted again soon: replaced first
+    char data[SectorSize]; // the contents of the sector
+};
+
+// The following class defines the buffer cache.  Users either copy
+// whole sectors in and out with ReadSector/WriteSector (the same
+// interface as SynchDisk), or hold on to a buffer with GetBuffer and
+// work on its data in place until they call ReleaseBuffer.
+
+class BufferCache : public CallBackObj
+{
+public:
+    BufferCache(SynchDisk *disk, int numBuffers,
+                int flushInterval = FlushInterval,
+                int dirtyPercent = DirtyPercent); // create an empty cache
+    ~BufferCache();                               // the cache must be
+                                                  // flushed before this
+
+    void ReadSector(int sectorNumber, char *data);  // copy a sector out
+    void WriteSector(int sectorNumber, char *data); // replace a sector
+
+    CacheBuffer *GetBuffer(int sectorNumber, bool readIn);
+    // Return the buffer for a sector,
+    // holding it until ReleaseBuffer.
+    // If "readIn" is FALSE the caller will
+    // overwrite the whole sector, so its
+    // old contents need not be read.
+    int GetBuffers(int firstSector, int count, CacheBuffer **buffers);
+    // Like GetBuffer on consecutive sectors,
+    // reading the missing ones in as few
+    // disk requests as possible.  Returns
+    // how many were gotten (at least one).
+    void ReleaseBuffer(CacheBuffer *buffer, bool changed,
+                       bool transient = FALSE);
+    // Done with a buffer; "changed" if
+    // its data was modified, "transient"
+    // if it will not be wanted again soon
+    void WriteThrough(int firstSector, int count, char *data);
+    // Write consecutive sectors straight
+    // to disk in one request, updating
+    // any cached copies but caching
+    // nothing new
+
+    void ReadAhead(int sectorNumber, bool transient = FALSE);
+    // start loading a sector in the
+    // background, if there is room
+    void Demote(int firstSector, int count);
+    // A run of sectors will not be used
+    // again soon: replace them first
+
+    void SetJournal(Journal *j) { journal = j; } // log changes from now on
+    void Unpin(int sectorNumber); // the journal has committed a sector
+    void SetChecksums(SectorChecksums *c) { checksums = c; }
+    // keep sectors' checksums from now on
+    bool Checksummed() { return checksums != NULL; }
+
+    void Flush(); // write every dirty, unpinned buffer back to disk
+    void FlushRange(int firstSector, int count);
+    // The same for a run of sectors; both
+    // return once they are on disk
+    void Discard(int firstSector, int count);
+    // Forget a run of sectors that are
+    // no longer in use, without writing
+    // them back, and discard them on disk
+
+    static void ReadAheadTask(void *data);
+    // Background task: load the next
+    // sector queued by ReadAhead
+    static void Flusher(void *data);
+    // Body of the flusher thread
+    void CallBack(); // the flush interval has gone by
+
+private:
+    CacheBuffer *Lookup(int sectorNumber, bool readIn, bool demand);
+    // Find or load a sector; lock held
+    CacheBuffer *FindVictim(); // pick an unused buffer to replace
+    bool IsDirty(int sectorNumber); // cached and changed; lock held
+    void Verify(CacheBuffer *buffer); // check a buffer just read in;
+                                      // lock held
+    void Changed(CacheBuffer *buffer); // a buffer has just been made
+                                       // dirty; lock held
+    void SetTransient(CacheBuffer *buffer, bool transient);
+    // mark a buffer, or not; lock held
+    int WriteBack(int *first, int end, int maxSectors);
+    // Write back up to "maxSectors" dirty
+    // buffers from "first" on; lock held
+
+    SynchDisk *synchDisk;   // where the sectors really live
+    int numBuffers;         // capacity of the cache
+    CacheBuffer *buffers;   // the buffers themselves
+    int hand;               // position of the clock hand
+    OpenHashTable<int, CacheBuffer *> *table; // sector # -> buffer holding it
+    Lock *lock;             // one cache operation at a time
+    Condition *ioDone;      // signalled when a busy buffer is filled
+    Journal *journal;       // told about every change, or NULL
+    SectorChecksums *checksums; // checksums of the sectors, or NULL
+
+    List<int> *readAheadQueue; // sectors waiting to be read ahead
+    int numQueued;          // sectors queued or being read ahead
+    int numTransient;       // buffers marked transient
+    int numDirty;           // buffers dirty now
+    int numWriting;         // buffers being written back
+    int flushInterval;      // ticks before a changed cache is flushed
+    int dirtyLimit;         // buffers dirty that start a flush at once
+    int flushCursor;        // sector the next flush behind starts at
+    Thread *flusher;        // writes dirty buffers in the background,
+                            // NULL until something is changed
+    Semaphore *flushWake;   // V'd to wake it
+    bool flushWanted;       // it has been woken, and not yet run
+    bool timerSet;          // a flush interval is being timed
+};
+
+#endif // BUFFERCACHE_H
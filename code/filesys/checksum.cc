@@ -0,0 +1,232 @@
+// checksum.cc
+//	Routines to keep the checksums of the sectors on disk.  See
+//	checksum.h.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "checksum.h"
+#include "crc32c.h"
+#include "main.h"
+
+const unsigned ChecksumMagic = 0x4352434b;
+
+// The first sector of the table.
+
+class ChecksumSuper
+{
+public:
+    unsigned magic;
+    unsigned check; // ~magic, so that stray data is not taken for it
+    unsigned stamp;
+};
+
+//----------------------------------------------------------------------
+// SectorSum
+// 	Return the checksum of a sector's contents, never NoChecksum.
+//----------------------------------------------------------------------
+
+static unsigned
+SectorSum(char *data)
+{
+    unsigned sum = Crc32c(data, SectorSize);
+
+    return (sum == NoChecksum) ? 1 : sum;
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::SectorChecksums
+// 	Get ready to use the table of checksums on "disk".  Nothing is
+//	read but its first sector.  When formatting, the table is started
+//	over with a new stamp, so that whatever the rest of it holds no
+//	longer counts.
+//
+//	"disk" -- where the table is
+//	"format" -- TRUE if the disk is being formatted
+//----------------------------------------------------------------------
+
+SectorChecksums::SectorChecksums(SynchDisk *disk, bool format)
+{
+    char buf[SectorSize];
+    ChecksumSuper *super = (ChecksumSuper *)buf;
+
+    synchDisk = disk;
+    synchDisk->ReadSector(ChecksumStart, buf);
+    if (format)
+    {
+        unsigned old = Present(disk) ? super->stamp : 0;
+
+        bzero(buf, SectorSize);
+        super->magic = ChecksumMagic;
+        super->check = ~ChecksumMagic;
+        super->stamp = (unsigned)kernel->stats->hostStartTime;
+        if ((super->stamp == old) || (super->stamp == 0))
+            super->stamp = old + 1;
+        synchDisk->WriteSector(ChecksumStart, buf);
+    }
+    ASSERT(super->magic == ChecksumMagic);
+    stamp = super->stamp;
+    DEBUG(dbgFile, "Sector checksums on, stamp " << stamp);
+
+    table = new char *[ChecksumSectors];
+    dirty = new bool[ChecksumSectors];
+    for (int i = 0; i < ChecksumSectors; i++)
+    {
+        table[i] = NULL;
+        dirty[i] = FALSE;
+    }
+}
+
+SectorChecksums::~SectorChecksums()
+{
+    for (int i = 0; i < ChecksumSectors; i++)
+        delete[] table[i];
+    delete[] table;
+    delete[] dirty;
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Present
+// 	Return TRUE if "disk" was formatted with a table of checksums.
+//----------------------------------------------------------------------
+
+bool SectorChecksums::Present(SynchDisk *disk)
+{
+    char buf[SectorSize];
+    ChecksumSuper *super = (ChecksumSuper *)buf;
+
+    disk->ReadSector(ChecksumStart, buf);
+    return (super->magic == ChecksumMagic) && (super->check == ~ChecksumMagic);
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Remove
+// 	The disk is being formatted without a table: make sure one left
+//	from before is not found, since its sectors may now hold files.
+//----------------------------------------------------------------------
+
+void SectorChecksums::Remove(SynchDisk *disk)
+{
+    char buf[SectorSize];
+
+    if (Present(disk))
+    {
+        bzero(buf, SectorSize);
+        disk->WriteSector(ChecksumStart, buf);
+    }
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Entry
+// 	Return where the checksum of "sector" is kept in memory, reading
+//	its sector of the table in if this is the first time it is
+//	needed.  A sector of the table with another stamp holds nothing.
+//----------------------------------------------------------------------
+
+unsigned *
+SectorChecksums::Entry(int sector)
+{
+    int which = sector / ChecksumsPerSector;
+    unsigned *sums;
+
+    ASSERT((sector >= 0) && (sector < ChecksumStart));
+    if (table[which] == NULL)
+    {
+        table[which] = new char[SectorSize];
+        synchDisk->ReadSector(ChecksumStart + 1 + which, table[which]);
+        sums = (unsigned *)table[which];
+        if (sums[0] != stamp)
+        {
+            bzero(table[which], SectorSize);
+            sums[0] = stamp;
+        }
+    }
+    sums = (unsigned *)table[which];
+    return &sums[1 + sector % ChecksumsPerSector];
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Update
+// 	Remember the checksum of what is being written to a sector.
+//----------------------------------------------------------------------
+
+void SectorChecksums::Update(int sector, char *data)
+{
+    unsigned *entry = Entry(sector);
+    unsigned sum = SectorSum(data);
+
+    if (*entry != sum)
+    {
+        *entry = sum;
+        dirty[sector / ChecksumsPerSector] = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Verify
+// 	Check what was just read from a sector against its checksum, if
+//	it has one.  Return FALSE if they do not match.
+//----------------------------------------------------------------------
+
+bool SectorChecksums::Verify(int sector, char *data)
+{
+    unsigned *entry = Entry(sector);
+
+    if (*entry == NoChecksum)
+        return TRUE;
+    kernel->stats->numChecksumsVerified++;
+    if (*entry == SectorSum(data))
+        return TRUE;
+    kernel->stats->numChecksumErrors++;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::Forget
+// 	A run of sectors was freed: their contents no longer matter, so
+//	drop their checksums.
+//----------------------------------------------------------------------
+
+void SectorChecksums::Forget(int firstSector, int count)
+{
+    for (int i = firstSector; i < firstSector + count; i++)
+    {
+        if (i >= ChecksumStart)
+            break;
+        unsigned *entry = Entry(i);
+
+        if (*entry != NoChecksum)
+        {
+            *entry = NoChecksum;
+            dirty[i / ChecksumsPerSector] = TRUE;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// SectorChecksums::WriteBack
+// 	Write the changed sectors of the table to disk, each run of
+//	consecutive ones with one request.
+//----------------------------------------------------------------------
+
+void SectorChecksums::WriteBack()
+{
+    for (int i = 0; i < ChecksumSectors; i++)
+    {
+        int count = 0;
+
+        while ((i + count < ChecksumSectors) && dirty[i + count])
+        {
+            dirty[i + count] = FALSE;
+            count++;
+        }
+        if (count > 0)
+        {
+            DEBUG(dbgFile, "Writing " << count << " checksum sectors from " << i);
+            synchDisk->WriteSectors(ChecksumStart + 1 + i, count, &table[i]);
+            i += count;
+        }
+    }
+}
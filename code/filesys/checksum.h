@@ -0,0 +1,80 @@
+// checksum.h
+//	Data structures for keeping a checksum of every sector the file
+//	system uses, so that a sector damaged on the disk (or in its UNIX
+//	file) is noticed when it is read, instead of being believed.
+//
+//	The checksums are CRC-32Cs (see crc32c.h), kept in a table on
+//	disk, just below the swap area, when the disk is formatted with
+//	the "-ck" flag.  The buffer cache computes a sector's checksum
+//	each time it writes the sector back, and checks it each time it
+//	reads the sector in.  A checksum of zero means none is known: the
+//	sector was freed, or never written since the disk was formatted.
+//
+//	The table's first sector says it is there, and holds a stamp
+//	chosen when the disk was formatted.  Each of the other sectors
+//	holds the stamp too, followed by ChecksumsPerSector checksums;
+//	one with an older stamp is left over from before, and is taken
+//	as all zero, so that formatting need not clear the whole table.
+//
+//	Sectors of the table are read in when first needed, and kept in
+//	memory; those changed are written back when the cache is flushed,
+//	after the sectors they describe.  File data is not journaled, so
+//	if Nachos stops in between, the data written last may be reported
+//	as damaged the next time it is read.
+//
+//	The swap area, the journal's log and the table itself do not go
+//	through the cache, and have no checksums.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "disk.h"
+#include "synchdisk.h"
+#include "swapspace.h"
+
+#define ChecksumsPerSector ((int)(SectorSize / sizeof(unsigned)) - 1)
+#define ChecksumSectors (1 + divRoundUp(NumSectors, ChecksumsPerSector))
+#define ChecksumStart (SwapStart - ChecksumSectors)
+
+#define NoChecksum 0 // no checksum known for the sector
+
+// The following class defines the table of checksums.  The caller
+// provides mutual exclusion (the buffer cache's lock).
+
+class SectorChecksums
+{
+public:
+    SectorChecksums(SynchDisk *disk, bool format);
+    // Use the table on "disk", starting
+    // an empty one if "format"
+    ~SectorChecksums(); // changes not written back are lost
+
+    static bool Present(SynchDisk *disk); // was the disk formatted
+                                          // with a table?
+    static void Remove(SynchDisk *disk);  // say it has none
+
+    void Update(int sector, char *data); // "data" is being written
+                                         // to "sector"
+    bool Verify(int sector, char *data); // was just read from it;
+                                         // FALSE if it was damaged
+    void Forget(int firstSector, int count); // sectors were freed
+    void WriteBack(); // write the changed sectors of the table
+
+private:
+    unsigned *Entry(int sector); // where the checksum of "sector"
+                                 // is, reading it in if need be
+
+    SynchDisk *synchDisk;
+    unsigned stamp;   // chosen when the disk was formatted
+    char **table;     // each sector of the table, or NULL if not
+                      // yet read in
+    bool *dirty;      // which of them must be written back
+};
+
+#endif // CHECKSUM_H
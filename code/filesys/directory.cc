@@ -1,19 +1,30 @@
 // directory.cc
 //	Routines to manage a directory of file names.
 //
-//	The directory is a table of fixed length entries; each
-//	entry represents a single file, and contains the file name,
-//	and the location of the file header on disk.  The fixed size
-//	of each directory entry means that we have the restriction
-//	of a fixed maximum size for file names.
+//	The directory is a table of records; each record represents a
+//	single file, and contains the file name, its length and hash,
+//	and the location of the file header on disk.  A record takes
+//	only the room its name needs, but names are still limited to
+//	FileNameMaxLen characters.
 //
 //	The constructor initializes an empty directory of a certain size;
 //	we use ReadFrom/WriteBack to fetch the contents of the directory
 //	from disk, and to write back any modifications back to disk.
 //
-//	Also, this implementation has the restriction that the size
-//	of the directory cannot expand.  In other words, once all the
-//	entries in the directory are used, no more files can be created.
+//	A directory fetched from disk is not read into memory as a whole:
+//	Find, Add and Remove read and write only the entries (and index
+//	blocks) they touch, so changes reach the directory file as they
+//	are made, and WriteBack just writes the directory header.
+//
+//	When no free record is long enough for a new name, the table
+//	grows by at least NumDirEntries records' worth.  The first time it
+//	grows, the directory gets a hash index: a separate file of buckets
+//	holding <hash of name, record offset> pairs, so that looking up a
+//	name costs one index sector plus the entries whose hash matches.
+//	The index doubles its number of buckets whenever they hold
+//	DirLoadFactor names on average.  New files still take the first
+//	free record that fits, so listing the directory shows files in
+//	much the same order as before.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -24,6 +35,93 @@
 #include "filehdr.h"
 #include "filesys.h"
 #include "directory.h"
+#include "inodetable.h"
+#include "buffercache.h"
+#include "fsck.h"
+#include "main.h"
+#include "slab.h"
+
+// Where offset "i" of the table lives within the directory file.
+#define TableOffset(i) ((int)sizeof(DirectoryHeader) + (i))
+
+// Bytes in the table of a new directory.
+#define NewTableSize (NumDirEntries * DirRecordSpace)
+
+//----------------------------------------------------------------------
+// HashName
+// 	Hash a file name (FNV-1a) for the directory index.
+//----------------------------------------------------------------------
+
+static unsigned
+HashName(char *name)
+{
+    unsigned hash = 2166136261u;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+//----------------------------------------------------------------------
+// FormatFree
+// 	Fill "length" bytes of table with free records, none longer than
+//	MaxRecordLength or shorter than MinRecordLength.
+//----------------------------------------------------------------------
+
+static void
+FormatFree(char *area, int length)
+{
+    ASSERT(length % 4 == 0 && length >= MinRecordLength);
+    while (length > 0)
+    {
+        DirectoryRecord *record = (DirectoryRecord *)area;
+        int chunk = min(length, MaxRecordLength);
+
+        if (length - chunk > 0 && length - chunk < MinRecordLength)
+            chunk -= MinRecordLength; // leave room for one more
+        memset(record, 0, sizeof(DirectoryRecord));
+        record->length = chunk;
+        area += chunk;
+        length -= chunk;
+    }
+}
+
+//----------------------------------------------------------------------
+// FormatTable
+// 	Make a new directory's table all free records: how the tables in
+//	tableCache are kept while not in use.
+//----------------------------------------------------------------------
+
+static void
+FormatTable(void *table)
+{
+    memset(table, 0, NewTableSize);
+    FormatFree((char *)table, NewTableSize);
+}
+
+// Directories, and the tables of new ones, come from slab caches:
+// nearly every Directory made is fetched from disk at once, and its
+// empty table given back untouched, so it need not be formatted again.
+static SlabCache directoryCache("directories", sizeof(Directory));
+static SlabCache tableCache("directory tables", NewTableSize, SlabObjects,
+                            FormatTable);
+
+//----------------------------------------------------------------------
+// Directory::operator new, Directory::operator delete
+// 	Take a directory from its slab cache, and give it back.
+//----------------------------------------------------------------------
+
+void *Directory::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Directory));
+    return directoryCache.Alloc();
+}
+
+void Directory::operator delete(void *p)
+{
+    directoryCache.Free(p);
+}
 
 //----------------------------------------------------------------------
 // Directory::Directory
@@ -32,19 +130,29 @@
 //	is all we need, but otherwise, we need to call FetchFrom in order
 //	to initialize it from disk.
 //
-//	"size" is the number of entries in the directory
+//	"size" is the number of entries the directory has room for
 //----------------------------------------------------------------------
 
 Directory::Directory(int size)
 {
-    table = new DirectoryEntry[size];
+    tableSize = size * DirRecordSpace;
+    if (tableSize == NewTableSize)
+        table = (char *)tableCache.Alloc(); // formatted already
+    else
+    {
+        table = new char[tableSize];
 
-    // MP4 mod tag
-    memset(table, 0, sizeof(DirectoryEntry) * size); // dummy operation to keep valgrind happy
+        // MP4 mod tag
+        memset(table, 0, tableSize); // dummy operation to keep valgrind happy
+        FormatFree(table, tableSize);
+    }
+    tableFormatted = TRUE;
 
-    tableSize = size;
-    for (int i = 0; i < tableSize; i++)
-        table[i].inUse = FALSE;
+    header.indexSector = -1;
+    header.firstFree = 0;
+    file = NULL;
+    indexFile = NULL;
+    memset(&index, 0, sizeof(index));
 }
 
 //----------------------------------------------------------------------
@@ -54,46 +162,207 @@ Directory::Directory(int size)
 
 Directory::~Directory()
 {
-    delete[] table;
+    FreeTable();
+    delete indexFile;
+}
+
+//----------------------------------------------------------------------
+// Directory::FreeTable
+// 	Let go of the in-core table.  One of a new directory's size goes
+//	back to tableCache, formatted again if it has been changed.
+//----------------------------------------------------------------------
+
+void Directory::FreeTable()
+{
+    if (table == NULL)
+        return;
+    if (tableSize != NewTableSize)
+        delete[] table;
+    else
+    {
+        if (!tableFormatted)
+            FormatTable(table);
+        tableCache.Free(table);
+    }
+    table = NULL;
 }
 
 //----------------------------------------------------------------------
 // Directory::FetchFrom
-// 	Read the contents of the directory from disk.
+// 	Attach to the directory stored in "file".  Only the directory
+//	header (and that of its index) is read now.
 //
 //	"file" -- file containing the directory contents
 //----------------------------------------------------------------------
 
 void Directory::FetchFrom(OpenFile *file)
 {
-    (void)file->ReadAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    FreeTable();
+    delete indexFile;
+    indexFile = NULL;
+
+    this->file = file;
+    (void)file->ReadAt((char *)&header, sizeof(DirectoryHeader), 0);
+    tableSize = file->Length() - sizeof(DirectoryHeader);
+    if (header.indexSector != -1)
+    {
+        indexFile = new OpenFile(header.indexSector);
+        (void)indexFile->ReadAt((char *)&index, sizeof(IndexHeader), 0);
+    }
 }
 
 //----------------------------------------------------------------------
 // Directory::WriteBack
-// 	Write any modifications to the directory back to disk
+// 	Write any modifications to the directory back to disk.  A new
+//	directory is written out whole; one fetched from disk already
+//	has its changed entries there, so only the header is written.
 //
 //	"file" -- file to contain the new directory contents
 //----------------------------------------------------------------------
 
 void Directory::WriteBack(OpenFile *file)
 {
-    (void)file->WriteAt((char *)table, tableSize * sizeof(DirectoryEntry), 0);
+    if (this->file == NULL)
+    {
+        (void)file->WriteAt((char *)&header, sizeof(DirectoryHeader), 0);
+        (void)file->WriteAt(table, tableSize, TableOffset(0));
+        return;
+    }
+    ASSERT(file == this->file);
+    WriteHeader();
+}
+
+//----------------------------------------------------------------------
+// Directory::LoadTable
+// 	Read every record of a directory fetched from disk into memory, so
+//	that it can be scanned cheaply.  Later changes keep the in-core
+//	copy up to date.
+//----------------------------------------------------------------------
+
+void Directory::LoadTable()
+{
+    if (table != NULL)
+        return;
+    if (tableSize == NewTableSize)
+        table = (char *)tableCache.Alloc();
+    else
+        table = new char[tableSize];
+    tableFormatted = FALSE;
+    (void)file->ReadAt(table, tableSize, TableOffset(0));
+}
+
+//----------------------------------------------------------------------
+// Directory::ReadRecord/WriteRecord/WriteHeader
+// 	Copy one record, or the directory header, in from or out to the
+//	directory file (and the in-core table, if loaded).  A record and
+//	its name are read with a single ReadAt.
+//
+//	"offset" -- where the record is in the table
+//	"record" -- where to copy it to/from
+//	"name" -- where to copy its name to ('\0' terminated) or from;
+//		NULL to leave the name alone
+//----------------------------------------------------------------------
+
+void Directory::ReadRecord(int offset, DirectoryRecord *record, char *name)
+{
+    char buf[sizeof(DirectoryRecord) + FileNameMaxLen];
+    char *from;
+
+    ASSERT(offset >= 0 && offset + MinRecordLength <= tableSize);
+    if (table != NULL)
+        from = table + offset;
+    else
+    {
+        (void)file->ReadAt(buf, min((int)sizeof(buf), tableSize - offset), TableOffset(offset));
+        from = buf;
+    }
+    memcpy(record, from, sizeof(DirectoryRecord));
+    ASSERT(record->length >= MinRecordLength && offset + record->length <= tableSize);
+    ASSERT(record->nameLength <= FileNameMaxLen);
+    if (name != NULL)
+    {
+        memcpy(name, from + sizeof(DirectoryRecord), record->nameLength);
+        name[record->nameLength] = '\0';
+    }
+}
+
+void Directory::WriteRecord(int offset, DirectoryRecord *record, char *name)
+{
+    char buf[sizeof(DirectoryRecord) + FileNameMaxLen];
+    int length = sizeof(DirectoryRecord);
+
+    ASSERT(offset >= 0 && offset + record->length <= tableSize);
+    memcpy(buf, record, sizeof(DirectoryRecord));
+    if (name != NULL)
+    {
+        memcpy(buf + length, name, record->nameLength);
+        length += record->nameLength;
+    }
+    if (table != NULL)
+    {
+        memcpy(table + offset, buf, length);
+        tableFormatted = FALSE;
+    }
+    if (file != NULL)
+        (void)file->WriteAt(buf, length, TableOffset(offset));
+}
+
+void Directory::WriteHeader()
+{
+    if (file != NULL)
+        (void)file->WriteAt((char *)&header, sizeof(DirectoryHeader), 0);
 }
 
 //----------------------------------------------------------------------
 // Directory::FindIndex
-// 	Look up file name in directory, and return its location in the table of
-//	directory entries.  Return -1 if the name isn't in the directory.
+// 	Look up file name in directory, and return the offset of its
+//	record in the table, copying the record to "record".  Return -1
+//	if the name isn't in the directory.
+//
+//	Without an index the directory is small, so we scan the table;
+//	otherwise we only look at the entries in the name's bucket whose
+//	hash matches.  Either way, the name is only compared with those
+//	of the same length and hash.
 //
 //	"name" -- the file name to look up
+//	"record" -- where to copy its record
 //----------------------------------------------------------------------
 
-int Directory::FindIndex(char *name)
+int Directory::FindIndex(char *name, DirectoryRecord *record)
 {
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse && !strncmp(table[i].name, name, FileNameMaxLen))
-            return i;
+    unsigned hash = HashName(name);
+    int nameLength = strnlen(name, FileNameMaxLen);
+    char found[FileNameMaxLen + 1];
+
+    if (indexFile == NULL)
+    {
+        LoadTable();
+        for (int offset = 0; offset < tableSize; offset += record->length)
+        {
+            ReadRecord(offset, record, NULL);
+            if ((record->flags & RecordInUse) && record->hash == hash &&
+                record->nameLength == nameLength &&
+                !memcmp(table + offset + sizeof(DirectoryRecord), name, nameLength))
+                return offset;
+        }
+        return -1; // name not in directory
+    }
+
+    DirectoryBucket bucket;
+
+    for (int block = 1 + hash % index.numBuckets; block != -1; block = bucket.next)
+    {
+        (void)indexFile->ReadAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+        for (int i = 0; i < bucket.count; i++)
+        {
+            if (bucket.items[i].hash != hash)
+                continue;
+            ReadRecord(bucket.items[i].slot, record, found);
+            if ((record->flags & RecordInUse) && record->nameLength == nameLength &&
+                !memcmp(found, name, nameLength))
+                return bucket.items[i].slot;
+        }
+    }
     return -1; // name not in directory
 }
 
@@ -108,63 +377,409 @@ int Directory::FindIndex(char *name)
 
 int Directory::Find(char *name)
 {
-    int i = FindIndex(name);
+    bool isDirectory;
 
-    if (i != -1)
-        return table[i].sector;
-    return -1;
+    return Find(name, &isDirectory);
+}
+
+int Directory::Find(char *name, bool *isDirectory)
+{
+    DirectoryRecord record;
+
+    if (FindIndex(name, &record) == -1)
+        return -1;
+    *isDirectory = (record.flags & RecordSubdir) != 0;
+    return record.sector;
 }
 
 //----------------------------------------------------------------------
 // Directory::Add
 // 	Add a file into the directory.  Return TRUE if successful;
 //	return FALSE if the file name is already in the directory, or if
-//	the directory is completely full, and has no more space for
-//	additional file names.
+//	the directory is full and the disk has no room to grow it.
 //
 //	"name" -- the name of the file being added
 //	"newSector" -- the disk sector containing the added file's header
+//	"isDirectory" -- is the file a subdirectory?
+//	"freeMap" -- where to allocate space if the directory must grow
 //----------------------------------------------------------------------
 
-bool Directory::Add(char *name, int newSector) {
-    return Add(name, newSector, FALSE);
+bool Directory::Add(char *name, int newSector, PersistentBitmap *freeMap)
+{
+    return Add(name, newSector, FALSE, freeMap);
 }
 
-bool Directory::Add(char *name, int newSector, bool isDirectory)
+bool Directory::Add(char *name, int newSector, bool isDirectory,
+                    PersistentBitmap *freeMap)
 {
-    if (FindIndex(name) != -1)
+    DirectoryRecord record;
+    int nameLength = strnlen(name, FileNameMaxLen);
+    int offset;
+
+    if (FindIndex(name, &record) != -1)
         return FALSE;
 
-    for (int i = 0; i < tableSize; i++)
-        if (!table[i].inUse)
-        {
-            table[i].inUse = TRUE;
-            strncpy(table[i].name, name, FileNameMaxLen);
-            table[i].sector = newSector;
-            table[i].isSubdir = isDirectory;
-            return TRUE;
-        }
-    return FALSE; // no space.  Fix when we have extensible files.
+    offset = FindFreeRecord(RecordSize(nameLength), freeMap);
+    if (offset == -1)
+        return FALSE; // no space, and no room to grow
+
+    ReadRecord(offset, &record, NULL);
+    if (record.length - RecordSize(nameLength) >= MinRecordLength)
+    { // split off the rest, as a free record
+        DirectoryRecord rest;
+
+        memset(&rest, 0, sizeof(DirectoryRecord));
+        rest.length = record.length - RecordSize(nameLength);
+        WriteRecord(offset + RecordSize(nameLength), &rest, NULL);
+        record.length = RecordSize(nameLength);
+    }
+    record.flags = RecordInUse | (isDirectory ? RecordSubdir : 0);
+    record.sector = newSector;
+    record.hash = HashName(name);
+    record.nameLength = nameLength;
+    WriteRecord(offset, &record, name);
+
+    if (indexFile != NULL && !IndexAdd(record.hash, offset, freeMap))
+    {
+        record.flags = 0; // no room for the index entry
+        WriteRecord(offset, &record, NULL);
+        header.firstFree = min(header.firstFree, offset);
+        WriteHeader();
+        return FALSE;
+    }
+    WriteHeader();
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // Directory::Remove
 // 	Remove a file name from the directory.  Return TRUE if successful;
-//	return FALSE if the file isn't in the directory.
+//	return FALSE if the file isn't in the directory.  Its record
+//	becomes free space.
 //
 //	"name" -- the file name to be removed
 //----------------------------------------------------------------------
 
 bool Directory::Remove(char *name)
 {
-    int i = FindIndex(name);
+    DirectoryRecord record;
+    int offset = FindIndex(name, &record);
+
+    if (offset == -1)
+        return FALSE; // name not in directory
+    record.flags = 0;
+    WriteRecord(offset, &record, NULL);
+    if (indexFile != NULL)
+        IndexRemove(record.hash, offset);
+    header.firstFree = min(header.firstFree, offset);
+    WriteHeader();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::Replace
+// 	Point a name already in the directory at another file header,
+//	rewriting its record in place.  Return FALSE if the name isn't in
+//	the directory.
+//
+//	"name" -- the file name
+//	"newSector" -- the disk sector of the header it now stands for
+//----------------------------------------------------------------------
+
+bool Directory::Replace(char *name, int newSector)
+{
+    DirectoryRecord record;
+    int offset = FindIndex(name, &record);
 
-    if (i == -1)
+    if (offset == -1)
         return FALSE; // name not in directory
-    table[i].inUse = FALSE;
+    record.sector = newSector;
+    WriteRecord(offset, &record, NULL);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::FindFreeRecord
+// 	Return the offset of the first free record at least "length" bytes
+//	long, growing the table if there is none.  Return -1 if the disk
+//	has no room to grow it.  header.firstFree is moved up past the
+//	records in use ahead of the first free one.
+//
+//	"length" -- bytes the new record needs
+//----------------------------------------------------------------------
+
+int Directory::FindFreeRecord(int length, PersistentBitmap *freeMap)
+{
+    DirectoryRecord record;
+    bool passedFree = FALSE; // skipped a free record, too short
+    int offset;
+
+    for (offset = header.firstFree; offset < tableSize; offset += record.length)
+    {
+        ReadRecord(offset, &record, NULL);
+        if (record.flags & RecordInUse)
+        {
+            if (!passedFree)
+                header.firstFree = offset + record.length;
+            continue;
+        }
+        if (record.length >= length)
+        {
+            if (!passedFree)
+                header.firstFree = offset;
+            return offset;
+        }
+        passedFree = TRUE;
+    }
+    if (!Grow(length, freeMap))
+        return -1;
+    if (!passedFree)
+        header.firstFree = offset;
+    return offset;
+}
+
+//----------------------------------------------------------------------
+// Directory::Grow
+// 	Add free records at the end of the table -- half again as many
+//	bytes as it has, but at least NumDirEntries records' worth, and
+//	at least "length" -- and give the directory a hash index if it has
+//	none yet.  Return FALSE if the disk is full.
+//
+//	A directory without an index still works, by scanning, so failing
+//	to build the index is not an error.
+//----------------------------------------------------------------------
+
+bool Directory::Grow(int length, PersistentBitmap *freeMap)
+{
+    int numNew = max(max(tableSize / 2, NumDirEntries * DirRecordSpace), length);
+    char *empty;
+
+    numNew = divRoundUp(numNew, 4) * 4;
+    if (file == NULL)
+        return FALSE; // only a directory on disk can grow
+    if (!file->Extend(freeMap, TableOffset(tableSize + numNew)))
+        return FALSE;
+    DEBUG(dbgFile, "Grow directory from " << tableSize << " to " << tableSize + numNew << " bytes");
+
+    empty = new char[numNew];
+    memset(empty, 0, numNew);
+    FormatFree(empty, numNew);
+    (void)file->WriteAt(empty, numNew, TableOffset(tableSize));
+    if (table != NULL)
+    {
+        char *bigger = new char[tableSize + numNew];
+        memcpy(bigger, table, tableSize);
+        memcpy(&bigger[tableSize], empty, numNew);
+        FreeTable();
+        table = bigger;
+    }
+    delete[] empty;
+    tableSize += numNew;
+
+    if (indexFile == NULL)
+        (void)CreateIndex(freeMap);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::CreateIndex
+// 	Give the directory a hash index, built from the entries it holds.
+//	Return FALSE (leaving the directory without one) if the disk is full.
+//----------------------------------------------------------------------
+
+bool Directory::CreateIndex(PersistentBitmap *freeMap)
+{
+    FileHeader *hdr = new FileHeader;
+    int sector = freeMap->FindAndSet(file->HeaderSector());
+
+    if (sector == -1)
+    {
+        delete hdr;
+        return FALSE;
+    }
+    if (!hdr->Allocate(freeMap, SectorSize, sector))
+    {
+        freeMap->Clear(sector);
+        delete hdr;
+        return FALSE;
+    }
+    hdr->WriteBack(sector);
+
+    indexFile = new OpenFile(sector);
+    if (!BuildIndex(freeMap, divRoundUp(tableSize / DirRecordSpace, DirLoadFactor)))
+    {
+        Inode *inode = kernel->inodeTable->Get(sector); // it may have grown
+
+        delete indexFile;
+        indexFile = NULL;
+        inode->hdr->Deallocate(freeMap);
+        freeMap->Clear(sector);
+        kernel->inodeTable->Forget(sector);
+        kernel->inodeTable->Put(inode);
+        delete hdr;
+        return FALSE;
+    }
+    delete hdr;
+    DEBUG(dbgFile, "Directory index created in sector #" << sector);
+
+    header.indexSector = sector;
+    WriteHeader();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::BuildIndex
+// 	Rewrite the whole hash index with "numBuckets" buckets, from the
+//	entries in the table.  Nothing on disk changes if there is no room
+//	for the new index, in which case return FALSE.
+//
+//	This costs a pass over the table, but happens only when the number
+//	of names doubles, so adding a name is still constant time on average.
+//----------------------------------------------------------------------
+
+bool Directory::BuildIndex(PersistentBitmap *freeMap, int numBuckets)
+{
+    int *tail = new int[numBuckets];
+    int numEntries = 0, numBlocks, nextBlock;
+    DirectoryBucket *blocks;
+    DirectoryRecord record;
+
+    ASSERT(sizeof(DirectoryBucket) == SectorSize);
+    ASSERT(numBuckets > 0);
+    LoadTable();
+
+    // count the names in each bucket, to know how many blocks we need
+    for (int b = 0; b < numBuckets; b++)
+        tail[b] = 0;
+    for (int offset = 0; offset < tableSize; offset += record.length)
+    {
+        ReadRecord(offset, &record, NULL);
+        if (!(record.flags & RecordInUse))
+            continue;
+        tail[record.hash % numBuckets]++;
+        numEntries++;
+    }
+    numBlocks = 1 + numBuckets;
+    for (int b = 0; b < numBuckets; b++)
+        if (tail[b] > DirHashEntries)
+            numBlocks += divRoundUp(tail[b], DirHashEntries) - 1;
+
+    if (!indexFile->Extend(freeMap, numBlocks * SectorSize))
+    {
+        delete[] tail;
+        return FALSE;
+    }
+
+    blocks = new DirectoryBucket[numBlocks];
+    memset(blocks, 0, numBlocks * sizeof(DirectoryBucket));
+    for (int b = 0; b < numBlocks; b++)
+        blocks[b].next = -1;
+    for (int b = 0; b < numBuckets; b++)
+        tail[b] = 1 + b;
+    nextBlock = 1 + numBuckets;
+    for (int offset = 0; offset < tableSize; offset += record.length)
+    {
+        ReadRecord(offset, &record, NULL);
+        if (!(record.flags & RecordInUse))
+            continue;
+        int b = record.hash % numBuckets;
+        DirectoryBucket *bucket = &blocks[tail[b]];
+        if (bucket->count == DirHashEntries)
+        { // chain on an overflow block
+            bucket->next = nextBlock;
+            tail[b] = nextBlock++;
+            bucket = &blocks[tail[b]];
+        }
+        bucket->items[bucket->count].hash = record.hash;
+        bucket->items[bucket->count].slot = offset;
+        bucket->count++;
+    }
+    ASSERT(nextBlock == numBlocks);
+
+    index.numEntries = numEntries;
+    index.numBuckets = numBuckets;
+    index.numBlocks = numBlocks;
+    memcpy(&blocks[0], &index, sizeof(IndexHeader));
+    (void)indexFile->WriteAt((char *)blocks, numBlocks * SectorSize, 0);
+    DEBUG(dbgFile, "Directory index rebuilt: " << numEntries << " names, " << numBuckets << " buckets, " << numBlocks << " blocks");
+
+    delete[] blocks;
+    delete[] tail;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Directory::IndexAdd
+// 	Record in the index that the name with hash "hash" is in the
+//	record at offset "slot" of the table,
+//	chaining a new overflow block on its bucket if that is full, and
+//	doubling the number of buckets if they are getting crowded.
+//	Return FALSE if the disk has no room for the overflow block.
+//----------------------------------------------------------------------
+
+bool Directory::IndexAdd(unsigned hash, int slot, PersistentBitmap *freeMap)
+{
+    DirectoryBucket bucket;
+    int block = 1 + hash % index.numBuckets;
+
+    for (;;)
+    {
+        (void)indexFile->ReadAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+        if (bucket.count < DirHashEntries)
+            break;
+        if (bucket.next == -1)
+        {
+            if (!indexFile->Extend(freeMap, (index.numBlocks + 1) * SectorSize))
+                return FALSE;
+            bucket.next = index.numBlocks++;
+            (void)indexFile->WriteAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+            block = bucket.next;
+            memset(&bucket, 0, sizeof(DirectoryBucket));
+            bucket.next = -1;
+            break;
+        }
+        block = bucket.next;
+    }
+    bucket.items[bucket.count].hash = hash;
+    bucket.items[bucket.count].slot = slot;
+    bucket.count++;
+    (void)indexFile->WriteAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+
+    index.numEntries++;
+    if (index.numEntries <= index.numBuckets * DirLoadFactor ||
+        !BuildIndex(freeMap, 2 * index.numBuckets))
+        (void)indexFile->WriteAt((char *)&index, sizeof(IndexHeader), 0);
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Directory::IndexRemove
+// 	Drop the index entry saying the name with hash "hash" is in the
+//	record at offset "slot".
+//	Its place in the bucket is taken by the last entry of the block.
+//----------------------------------------------------------------------
+
+void Directory::IndexRemove(unsigned hash, int slot)
+{
+    DirectoryBucket bucket;
+
+    for (int block = 1 + hash % index.numBuckets; block != -1; block = bucket.next)
+    {
+        (void)indexFile->ReadAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+        for (int i = 0; i < bucket.count; i++)
+        {
+            if (bucket.items[i].slot != slot)
+                continue;
+            bucket.items[i] = bucket.items[--bucket.count];
+            (void)indexFile->WriteAt((char *)&bucket, sizeof(DirectoryBucket), block * SectorSize);
+            index.numEntries--;
+            (void)indexFile->WriteAt((char *)&index, sizeof(IndexHeader), 0);
+            return;
+        }
+    }
+    ASSERTNOTREACHED(); // the index is missing a name
+}
+
 //----------------------------------------------------------------------
 // Directory::List
 // 	List all the file names in the directory.
@@ -172,40 +787,137 @@ bool Directory::Remove(char *name)
 
 void Directory::List()
 {
-    DEBUG(dbgFile, "===== DEBUG =====");
-    for (int i = 0; i < tableSize; i++) {
-        if (table[i].inUse) {
-            DEBUG(dbgFile, table[i].sector);
-        }
+    DirectoryEntry entry;
+
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+    {
+        DEBUG(dbgFile, "Entry " << entry.name << " has its header in sector #" << entry.sector);
+        printf("%s\n", entry.name);
     }
-    DEBUG(dbgFile, "===== DEBUG =====");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
-            printf("%s\n", table[i].name);
-}
-
-void Directory::ListRecursively(PersistentBitmap *freeMap, int depth) {
-    char *tab = new char[depth+1];
-    memset(tab, '\t', depth * sizeof(char));
-    tab[depth] = '\0';
-
-    for (int i = 0; i < tableSize; i++) {
-        if (table[i].inUse) {
-            if (table[i].isSubdir) {
-                Directory *directory = new Directory(NumDirEntries);
-                
-                OpenFile *file = new OpenFile(table[i].sector);
-                printf("%s[D] %s\n", tab, table[i].name);
-
-                directory->FetchFrom(file);
-                directory->ListRecursively(freeMap, depth + 1);
-                delete file;
-                delete directory;
-            } else {
-                printf("%s[F] %s\n", tab, table[i].name + sizeof(char));
-            }
+}
+
+//----------------------------------------------------------------------
+// Directory::NextEntry
+// 	Find the first entry in use in the record at "offset" or after,
+//	and return the offset of the record after it, where the next call
+//	should start; or -1 if there is none.  Entries are read one at a
+//	time (through the buffer cache) rather than the whole table at
+//	once, so walking a directory of any size takes the same memory.
+//
+//	"offset" -- where to start looking; 0 for the first entry
+//	"entry" -- where to copy the entry found
+//----------------------------------------------------------------------
+
+int Directory::NextEntry(int offset, DirectoryEntry *entry)
+{
+    DirectoryRecord record;
+
+    while (offset < tableSize)
+    {
+        ReadRecord(offset, &record, entry->name);
+        offset += record.length;
+        if (record.flags & RecordInUse)
+        {
+            entry->inUse = TRUE;
+            entry->sector = record.sector;
+            entry->isSubdir = (record.flags & RecordSubdir) != 0;
+            return offset;
         }
     }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Directory::Check
+// 	For fsck: check the directory's index file, then every file in
+//	the directory.  The headers of all of them are queued for read
+//	ahead first, so the disk fetches them while the earlier ones are
+//	being checked.
+//
+//	"check" -- the check in progress
+//	"path" -- the path of this directory, for reports
+//----------------------------------------------------------------------
+
+void Directory::Check(FileSystemCheck *check, char *path)
+{
+    DirectoryEntry entry;
+    int length = strlen(path);
+    char *name = new char[length + FileNameMaxLen + 16];
+
+    if (header.indexSector != -1)
+    {
+        sprintf(name, "%s (index)", path);
+        check->CheckFile(header.indexSector, FALSE, name);
+    }
+
+    LoadTable();
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+        if (entry.sector >= 0 && entry.sector < NumSectors)
+            kernel->bufferCache->ReadAhead(entry.sector);
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+    {
+        char *base = (entry.name[0] == '/') ? entry.name + 1 : entry.name;
+
+        sprintf(name, "%s%s%.*s", path, (path[length - 1] == '/') ? "" : "/",
+                FileNameMaxLen, base);
+        check->CheckFile(entry.sector, entry.isSubdir, name);
+    }
+    delete[] name;
+}
+
+//----------------------------------------------------------------------
+// Directory::RemoveAll
+// 	For a recursive remove: free every file in the directory, each
+//	subdirectory after everything under it, then the directory's
+//	index file.  The entries themselves are left as they are, since
+//	the directory is about to be freed too.  As in Check, the headers
+//	are queued for read ahead first.
+//
+//	"fileSystem" -- frees each file, into its in-core free map
+//----------------------------------------------------------------------
+
+void Directory::RemoveAll(FileSystem *fileSystem)
+{
+    DirectoryEntry entry;
+
+    LoadTable();
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+        kernel->bufferCache->ReadAhead(entry.sector);
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+        fileSystem->RemoveTree(entry.sector, entry.isSubdir);
+    if (header.indexSector != -1)
+        fileSystem->RemoveTree(header.indexSector, FALSE);
+}
+
+//----------------------------------------------------------------------
+// Directory::Prefetch
+// 	For a walk of the tree about to go through this directory: load
+//	the table, queue the headers of all the subdirectories for read
+//	ahead, then, as each header comes in, the first DirPrefetchSectors
+//	sectors of that subdirectory.  A level of the tree is thus read in
+//	two batches of disk requests, instead of two round trips for each
+//	subdirectory as the walk steps into it.
+//----------------------------------------------------------------------
+
+void Directory::Prefetch()
+{
+    DirectoryEntry entry;
+
+    LoadTable();
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+        if (entry.isSubdir)
+            kernel->bufferCache->ReadAhead(entry.sector);
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+    {
+        if (!entry.isSubdir)
+            continue;
+        Inode *inode = kernel->inodeTable->Get(entry.sector);
+        int numSectors = divRoundUp(inode->hdr->FileLength(), SectorSize);
+
+        for (int i = 0; i < min(numSectors, DirPrefetchSectors); i++)
+            kernel->bufferCache->ReadAhead(inode->hdr->ByteToSector(i * SectorSize));
+        kernel->inodeTable->Put(inode);
+    }
 }
 
 //----------------------------------------------------------------------
@@ -216,16 +928,17 @@ void Directory::ListRecursively(PersistentBitmap *freeMap, int depth) {
 
 void Directory::Print()
 {
-    FileHeader *hdr = new FileHeader;
+    DirectoryEntry entry;
 
+    LoadTable();
     printf("Directory contents:\n");
-    for (int i = 0; i < tableSize; i++)
-        if (table[i].inUse)
-        {
-            printf("Name: %s, Sector: %d\n", table[i].name, table[i].sector);
-            hdr->FetchFrom(table[i].sector);
-            hdr->Print();
-        }
+    for (int next = NextEntry(0, &entry); next != -1; next = NextEntry(next, &entry))
+    {
+        Inode *inode = kernel->inodeTable->Get(entry.sector);
+
+        printf("Name: %s, Sector: %d\n", entry.name, entry.sector);
+        inode->hdr->Print();
+        kernel->inodeTable->Put(inode);
+    }
     printf("\n");
-    delete hdr;
 }
@@ -6,6 +6,16 @@
 //	where to find its file header (the data structure describing
 //	where to find the file's data blocks) on disk.
 //
+//	On disk, each pair is a record just long enough for its name,
+//	with the name's length and hash, so that a directory of short
+//	names takes a sector or two, and names are only compared when
+//	their hashes match.
+//
+//	The table grows as files are added.  Once it outgrows its
+//	initial NumDirEntries slots, the directory also gets a hash
+//	index, kept in a file of its own, so that finding a name reads
+//	one index sector and one entry instead of the whole table.
+//
 //      We assume mutual exclusion is provided by the caller.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
@@ -20,13 +30,26 @@
 
 #include "openfile.h"
 
+class FileSystemCheck;
+class FileSystem;
+
 #define FileNameMaxLen 64 // for simplicity, we assume \
                          // file names are <= 9 characters long
-#define NumDirEntries 10
+#define NumDirEntries 10  // entries a new directory has room for; the
+                          // table grows by at least this many at a time
+#define DirRecordSpace 20 // bytes of table per entry, enough for most
+                          // names (cf. RecordSize)
+
+#define DirHashEntries 15 // index entries in one index bucket sector
+#define DirLoadFactor 8   // average entries per bucket before the
+                          // index doubles its number of buckets
+#define DirPrefetchSectors 4 // sectors of a subdirectory Prefetch
+                             // reads ahead
 
 // The following class defines a "directory entry", representing a file
 // in the directory.  Each entry gives the name of the file, and where
-// the file's header is to be found on disk.
+// the file's header is to be found on disk.  This is how an entry is
+// handed out; on disk, it is kept as a DirectoryRecord.
 //
 // Internal data structures kept public so that Directory operations can
 // access them directly.
@@ -42,15 +65,79 @@ public:
                                    // the trailing '\0'
 };
 
+// How an entry is stored in the directory file: this, then the name
+// (without its '\0'), padded to a multiple of 4 bytes.  The records
+// follow one another through the table; one not in use is free space,
+// for a name that fits in it.  A free record is split when a shorter
+// name is put in it, but records are never merged, so a place where
+// one record ends stays a place where another starts (ReadDir keeps
+// one between calls).
+
+#define RecordInUse 0x1
+#define RecordSubdir 0x2
+
+class DirectoryRecord
+{
+public:
+    int sector;               // as in DirectoryEntry
+    unsigned hash;            // of the name
+    unsigned short length;    // bytes in the record, name included
+    unsigned char nameLength;
+    unsigned char flags;      // RecordInUse, RecordSubdir
+};
+
+#define RecordSize(nameLength) ((int)sizeof(DirectoryRecord) + divRoundUp(nameLength, 4) * 4)
+#define MinRecordLength RecordSize(1)
+#define MaxRecordLength 32768 // most bytes a free record spans
+
+// The start of a directory file, ahead of its table of entries.
+
+class DirectoryHeader
+{
+public:
+    int indexSector; // FileHeader of the hash index, or -1 if none
+    int firstFree;   // no free record starts before this offset
+};
+
+// One sector of the hash index: some of the entries hashing to one
+// bucket -- the hash of the name, so that most other names can be
+// skipped without reading their entry, and the offset of its record
+// in the table --
+// and the index block continuing the bucket, if it overflowed.
+//
+// The index file starts with an IndexHeader block; block b + 1 is the
+// first block of bucket b, and overflow blocks follow the buckets.
+
+class DirectoryBucket
+{
+public:
+    int next;  // index block continuing this bucket, or -1
+    int count; // items in use
+    struct {
+        unsigned hash;
+        int slot;
+    } items[DirHashEntries];
+};
+
+class IndexHeader
+{
+public:
+    int numEntries; // names in the directory
+    int numBuckets;
+    int numBlocks;  // index blocks in use, header included
+};
+
 // The following class defines a UNIX-like "directory".  Each entry in
 // the directory describes a file, and where to find it on disk.
 //
 // The directory data structure can be stored in memory, or on disk.
 // When it is on disk, it is stored as a regular Nachos file.
 //
-// The constructor initializes a directory structure in memory; the
-// FetchFrom/WriteBack operations shuffle the directory information
-// from/to disk.
+// The constructor initializes an empty directory in memory, which
+// WriteBack stores into a fresh directory file.  FetchFrom attaches
+// the object to a directory already on disk; only its header is read,
+// and Find, Add and Remove then read and write just the entries and
+// index blocks they need.
 
 class Directory
 {
@@ -59,21 +146,42 @@ public:
                          // with space for "size" files
     ~Directory();        // De-allocate the directory
 
+    void *operator new(size_t size); // from a slab cache (see slab.h)
+    void operator delete(void *p);
+
     void FetchFrom(OpenFile *file); // Init directory contents from disk
     void WriteBack(OpenFile *file); // Write modifications to
                                     // directory contents back to disk
 
     int Find(char *name); // Find the sector number of the
                           // FileHeader for file: "name"
+    int Find(char *name, bool *isDirectory);
+                          // ...and whether it is a subdirectory
 
-    bool Add(char *name, int newSector); // Add a file name into the directory
-    bool Add(char *name, int newSector, bool isDirectory);
+    bool Add(char *name, int newSector, PersistentBitmap *freeMap);
+    bool Add(char *name, int newSector, bool isDirectory,
+             PersistentBitmap *freeMap);
+    // Add a file name into the directory,
+    // growing it from "freeMap" if full
 
     bool Remove(char *name); // Remove a file from the directory
+    bool Replace(char *name, int newSector); // Point a name at another
+                             // file, in place
+
+    int NextEntry(int offset, DirectoryEntry *entry);
+                  // The first entry in use from "offset"
+                  // on, and where the next one may be;
+                  // -1 if none
 
     void List();  // Print the names of all the files
                   //  in the directory
-    void ListRecursively(PersistentBitmap *freeMap, int depth);
+    void Check(FileSystemCheck *check, char *path);
+                  // fsck everything in the directory
+    void RemoveAll(FileSystem *fileSystem);
+                  // Free every file in the directory,
+                  // and everything under its subdirectories
+    void Prefetch(); // Read the table in, and start reading the
+                     // headers and tables of the subdirectories
     void Print(); // Verbose print of the contents
                   //  of the directory -- all the file
                   //  names and their contents.
@@ -82,16 +190,40 @@ private:
     /*
 		MP4 Hint:
 		Directory is actually a "file", be careful of how it works with OpenFile and FileHdr.
-		Disk part: table
-		In-core part: tableSize
+		Disk part: header, table, and the index file
+		In-core part: everything else
 	*/
 
-    int tableSize;         // Number of directory entries
-    DirectoryEntry *table; // Table of pairs:
-                           // <file name, file header location>
-
-    int FindIndex(char *name); // Find the index into the directory
-                               //  table corresponding to "name"
+    DirectoryHeader header; // Start of the directory file
+    int tableSize;         // Bytes of records in the table
+    char *table;           // Table of records, one per pair
+                           // <file name, file header location>;
+                           // in-core only for a new directory,
+                           // or after LoadTable
+    bool tableFormatted;   // "table" is still all free records
+
+    OpenFile *file;        // The directory file, once fetched
+    OpenFile *indexFile;   // Its hash index, if it has one
+    IndexHeader index;
+
+    int FindIndex(char *name, DirectoryRecord *record);
+                               // Find the offset in the directory
+                               //  table of the record for "name"
+
+    void LoadTable();          // read the whole table into memory
+    void FreeTable();          // and let go of it
+    void ReadRecord(int offset, DirectoryRecord *record, char *name);
+    void WriteRecord(int offset, DirectoryRecord *record, char *name);
+    void WriteHeader();
+
+    int FindFreeRecord(int length, PersistentBitmap *freeMap);
+                               // -1 if the disk is full
+    bool Grow(int length, PersistentBitmap *freeMap);
+
+    bool CreateIndex(PersistentBitmap *freeMap);
+    bool BuildIndex(PersistentBitmap *freeMap, int numBuckets);
+    bool IndexAdd(unsigned hash, int slot, PersistentBitmap *freeMap);
+    void IndexRemove(unsigned hash, int slot);
 };
 
 #endif // DIRECTORY_H
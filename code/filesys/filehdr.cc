@@ -3,12 +3,15 @@
 //	would be called the i-node).
 //
 //	The file header is used to locate where on disk the
-//	file's data is stored.  We implement this as a fixed size
-//	table of pointers -- each entry in the table points to the
-//	disk sector containing that portion of the file data
-//	(in other words, there are no indirect or doubly indirect
-//	blocks). The table size is chosen so that the file header
-//	will be just big enough to fit in one disk sector,
+//	file's data is stored.  We implement this as a list of extents
+//	-- each entry gives the first disk sector and the length of a
+//	run of contiguous sectors holding that portion of the file data.
+//	The first few extents are kept in the file header itself, which
+//	is just big enough to fit in one disk sector; any further ones
+//	go to a chain of index sectors.  A file small enough is kept in
+//	the header sector whole, with no extents.  A compressed file's
+//	extents hold its packed image, which is expanded a chunk at a
+//	time as it is read.
 //
 //      Unlike in a real system, we do not keep track of file permissions,
 //	ownership, last modification date, etc., in the file header.
@@ -26,111 +29,601 @@
 
 #include "filehdr.h"
 #include "debug.h"
-#include "synchdisk.h"
+#include "buffercache.h"
+#include "fsck.h"
+#include "compress.h"
 #include "main.h"
+#include "slab.h"
+
+//----------------------------------------------------------------------
+// LinkedDataSector::FetchFromSector/WriteBackSector
+// 	Read/write one index sector of a file's extent chain.
+//
+//	"sector" is the disk sector holding the index sector
+//----------------------------------------------------------------------
 
 void LinkedDataSector::FetchFromSector(int sector) {
 	char buf[SectorSize];
-	kernel->synchDisk->ReadSector(sector, buf);
+	kernel->bufferCache->ReadSector(sector, buf);
 
 	memcpy(&linkSector, buf, sizeof(int));
-	memcpy(&dataSectors, buf + sizeof(int), LinkedDirect * sizeof(int));
-	//DEBUG(dbgFile, "Read linked list from sector #" << sector << ", while next item is at sector #" << linkSector << " (-1 = end).");
+	memcpy(&numExtents, buf + sizeof(int), sizeof(int));
+	memcpy(extents, buf + 2 * sizeof(int), LinkedExtents * sizeof(Extent));
+	ASSERT(numExtents >= 0 && numExtents <= LinkedExtents);
 }
 
 void LinkedDataSector::WriteBackSector(int sector) {
 	char buf[SectorSize];
 	memcpy(buf, &linkSector, sizeof(int));
-	memcpy(buf + sizeof(int), &dataSectors, LinkedDirect * sizeof(int));
-	
-	kernel->synchDisk->WriteSector(sector, buf);
-	DEBUG(dbgFile, "Write linked list to sector #" << sector << ", while next item is at sector #" << linkSector << " (-1 = end)");
+	memcpy(buf + sizeof(int), &numExtents, sizeof(int));
+	memcpy(buf + 2 * sizeof(int), extents, LinkedExtents * sizeof(Extent));
+
+	kernel->bufferCache->WriteSector(sector, buf);
+	DEBUG(dbgFile, "Write " << numExtents << " extents to index sector #" << sector << ", while next item is at sector #" << linkSector << " (-1 = end)");
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::SeqDataSectors/~SeqDataSectors
+// 	Start with an empty extent list; free the in-core copy of it.
+//----------------------------------------------------------------------
+
+SeqDataSectors::SeqDataSectors() {
+	extents = NULL;
+	firstIndex = NULL;
+	indexSectors = NULL;
+	Reset();
+}
+
+SeqDataSectors::~SeqDataSectors() {
+	delete [] extents;
+	delete [] firstIndex;
+	delete [] indexSectors;
+}
+
+void SeqDataSectors::Reset() {
+	delete [] extents;
+	delete [] firstIndex;
+	delete [] indexSectors;
+	front = -1;
+	numExtents = 0;
+	numLoaded = 0;
+	numIndexLoaded = 0;
+	maxExtents = NumInlineExtents;
+	extents = new Extent[maxExtents];
+	firstIndex = new int[maxExtents];
+	indexSectors = NULL;
+	lastHit = 0;
 }
 
-void LinkedDataSector::Debug()  {
-	if (next == NULL) {
-		cout << "{ " << dataSectors[0] << ", " << dataSectors[1] << "... }" << " -> end\n";
-	} 
-	else {
-		cout << "{ " << dataSectors[0] << " ~ " << dataSectors[LinkedDirect - 1] << " }" << " -- " << linkSector << " -> ";
-		next->Debug();
+//----------------------------------------------------------------------
+// SeqDataSectors::AddExtent
+// 	Append a run of sectors to the end of the file, merging it into the
+//	last extent when it directly follows it on disk.
+//----------------------------------------------------------------------
+
+void SeqDataSectors::AddExtent(int start, int length) {
+	if (numExtents > 0) {
+		Extent *last = &extents[numExtents - 1];
+		if (last->start + last->length == start) {
+			last->length += length;
+			return;
+		}
+	}
+	if (numExtents == maxExtents) {
+		Extent *bigger = new Extent[maxExtents * 2];
+		int *biggerIndex = new int[maxExtents * 2];
+		memcpy(bigger, extents, numExtents * sizeof(Extent));
+		memcpy(biggerIndex, firstIndex, numExtents * sizeof(int));
+		delete [] extents;
+		delete [] firstIndex;
+		extents = bigger;
+		firstIndex = biggerIndex;
+		maxExtents *= 2;
 	}
+	extents[numExtents].start = start;
+	extents[numExtents].length = length;
+	firstIndex[numExtents] = (numExtents == 0) ? 0 :
+		firstIndex[numExtents - 1] + extents[numExtents - 1].length;
+	numExtents++;
+	numLoaded = numExtents;
 }
 
-bool SeqDataSectors::Allocate(PersistentBitmap *freeMap, int fileSize) {
+//----------------------------------------------------------------------
+// SeqDataSectors::Allocate
+// 	Allocate the data sectors for a file of "fileSize" bytes, as few
+//	extents as possible: in one run if the disk has a big enough hole,
+//	otherwise by taking free runs in disk order.  Then allocate the
+//	index sectors needed for extents that do not fit in the header.
+//	Return FALSE (allocating nothing) if the disk is too full.
+//
+//	"near" is the sector of the file header; both data and index are
+//	placed after it if there is room nearby.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::Allocate(PersistentBitmap *freeMap, int fileSize, int near) {
 	int numSectors = divRoundUp(fileSize, SectorSize);
 	if (freeMap->NumClear() < numSectors) {
 		cerr << "Not enough space!\n";
 		return FALSE; // not enough space
 	}
 
-	LinkedDataSector *curr = NULL;
-	int assigned = 0;
-	while (assigned < numSectors) {
-		if (front == -1) {
-			front = freeMap->FindAndSet();
-			ASSERT(front >= 0);
-			curr = list = new LinkedDataSector;
-			DEBUG(dbgFile, "Set front of the linked list, stored in sector #" << front << ".");
-		} else {
-			int sector = freeMap->FindAndSet();
-			ASSERT(sector >= 0);
-			curr = curr->Push(sector);
-			DEBUG(dbgFile, "Add new item into linked list, stored in sector #" << sector << ".");
+	if (!AddSectors(freeMap, numSectors, near) ||
+			!AllocateIndex(freeMap, 0, near)) { // no room left
+		Deallocate(freeMap);
+		Reset();
+		cerr << "Not enough space!\n";
+		return FALSE;
+	}
+	if (debug->IsEnabled('f')) Debug();
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::Extend
+// 	Add "count" data sectors to the end of the file, preferably right
+//	after its last extent on disk, then any index sectors the longer
+//	extent list needs.  Return FALSE (leaving the file as it was) if
+//	the disk is too full.
+//
+//	"near" is the sector of the file header, next to which the index
+//	goes, and the data too if the file has none yet.
+//
+//	The data is in whole clusters (cf. PersistentBitmap), so the last
+//	extent grows a cluster at a time.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::Extend(PersistentBitmap *freeMap, int count, int near) {
+	int cluster = freeMap->ClusterSize();
+
+	if (freeMap->NumClear() < count) {
+		return FALSE; // not enough space
+	}
+	LoadAll();
+
+	int oldExtents = numExtents, oldIndex = NumIndexSectors();
+	int oldLastLength = (numExtents > 0) ? extents[numExtents - 1].length : 0;
+	int goal = near;
+
+	if (numExtents > 0) { // grow the last extent in place while we can
+		Extent *last = &extents[numExtents - 1];
+		while (count > 0 && last->start + last->length + cluster <= NumSectors
+				&& freeMap->MarkClusterIfClear(last->start + last->length)) {
+			last->length += cluster;
+			count -= cluster;
+		}
+		if (last->start + last->length < NumSectors) {
+			goal = last->start + last->length;
+		}
+	}
+	if (!AddSectors(freeMap, count, goal) ||
+			!AllocateIndex(freeMap, oldIndex, near)) { // give back what we took
+		for (int i = max(oldExtents - 1, 0); i < numExtents; i++) {
+			int keep = (i == oldExtents - 1) ? oldLastLength : 0;
+			for (int j = keep; j < extents[i].length; j++) {
+				freeMap->Clear(extents[i].start + j);
+			}
 		}
-		for (int idx = 0; idx < LinkedDirect && assigned < numSectors; idx++, assigned++) {
-			int sector = freeMap->FindAndSet();
-			ASSERT(sector >= 0);
-			curr->AssignSector(idx, sector);
-			DEBUG(dbgFile, "Assign sector #" << sector << " to #" << idx << " item.");
+		numExtents = numLoaded = oldExtents;
+		if (oldExtents > 0) {
+			extents[oldExtents - 1].length = oldLastLength;
 		}
+		return FALSE;
 	}
 	if (debug->IsEnabled('f')) Debug();
 	return TRUE;
 }
 
-void SeqDataSectors::Deallocate(PersistentBitmap *freeMap) {
-	if (front == -1) return;
+//----------------------------------------------------------------------
+// SeqDataSectors::AddSectors
+// 	Allocate "count" more data sectors, as few extents as possible: in
+//	one run if the disk has a big enough hole, otherwise by taking free
+//	runs in disk order.  The sectors are taken in whole clusters, each
+//	starting on a cluster boundary, so "count" must be a whole number
+//	of them.  The caller has checked there are enough free sectors,
+//	but they may not all be in whole clusters: return FALSE if the
+//	clusters ran out, keeping what was added for the caller to give
+//	back.
+//
+//	"near" is where on disk to start looking; each extent after the
+//	first is looked for right after the one before.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::AddSectors(PersistentBitmap *freeMap, int count, int near) {
+	int cluster = freeMap->ClusterSize();
+	int remaining = count;
+	bool tryContiguous = TRUE;
+	ASSERT(count % cluster == 0);
+	while (remaining > 0) {
+		int start = -1, length = remaining;
+		if (tryContiguous) {
+			start = freeMap->FindAndSetClusters(length, near);
+			tryContiguous = FALSE; // later holes would be smaller still
+		}
+		if (start == -1) {
+			start = freeMap->FindAndSetClusters(cluster, near);
+			if (start == -1) {
+				return FALSE; // no whole cluster is free
+			}
+			for (length = cluster; length < remaining && start + length + cluster <= NumSectors
+					&& freeMap->MarkClusterIfClear(start + length); length += cluster) {
+			}
+		}
+		DEBUG(dbgFile, "Assign extent of " << length << " sectors from sector #" << start << ".");
+		AddExtent(start, length);
+		remaining -= length;
+		if (start + length < NumSectors) {
+			near = start + length;
+		}
+	}
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::AllocateIndex
+// 	Allocate the index sectors needed for the extents that do not fit
+//	in the header, beyond the "numOld" the file already has, close
+//	after sector "near".  Return FALSE (allocating none of them) if
+//	the disk is full.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::AllocateIndex(PersistentBitmap *freeMap, int numOld, int near) {
+	int numIndex = NumIndexSectors();
+	if (numIndex <= numOld) {
+		return TRUE;
+	}
+
+	int *sectors = new int[numIndex];
+	for (int i = 0; i < numIndex; i++) {
+		if (i < numOld) {
+			sectors[i] = indexSectors[i];
+			continue;
+		}
+		sectors[i] = freeMap->FindAndSet(near);
+		if (sectors[i] == -1) {
+			for (int j = numOld; j < i; j++) {
+				freeMap->Clear(sectors[j]);
+			}
+			delete [] sectors;
+			return FALSE;
+		}
+		DEBUG(dbgFile, "Add index sector #" << sectors[i] << ".");
+	}
+	delete [] indexSectors;
+	indexSectors = sectors;
+	front = indexSectors[0];
+	numIndexLoaded = numIndex;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::Deallocate
+// 	Return the data sectors and index sectors of the file to the free
+//	map, discarding their contents from the buffer cache and the disk.
+//	If the data may be "shared", a cluster other files still use is
+//	only counted as used by one fewer.
+//----------------------------------------------------------------------
 
-	int targetSector = front;
-	LinkedDataSector *curr = list;
-	do {
-		for (int i = 0; i < LinkedDirect && curr->Data(i) != -1; i++) {
-			freeMap->Clear(curr->Data(i));
+void SeqDataSectors::Deallocate(PersistentBitmap *freeMap, bool shared) {
+	int cluster = freeMap->ClusterSize();
+
+	LoadAll();
+	for (int i = 0; i < numExtents; i++) {
+		for (int s = extents[i].start; s < extents[i].start + extents[i].length; s += cluster) {
+			if (shared && freeMap->Unshare(s)) {
+				continue;			// still another file's
+			}
+			kernel->bufferCache->Discard(s, cluster);
+			for (int j = 0; j < cluster; j++) {
+				freeMap->Clear(s + j);
+			}
 		}
-		freeMap->Clear(targetSector);
-		targetSector = curr->Link();
-		curr = curr->Next();
-	} while (targetSector != -1);
+	}
+	for (int i = 0; i < NumIndexSectors() && indexSectors != NULL; i++) {
+		kernel->bufferCache->Discard(indexSectors[i], 1);
+		freeMap->Clear(indexSectors[i]);
+	}
 }
 
+//----------------------------------------------------------------------
+// SeqDataSectors::Share
+// 	Make this empty list a copy of "other"'s, counting each of its
+//	clusters as shared by one more file, and allocate index sectors
+//	of its own.  Return FALSE, sharing nothing, if a cluster is shared
+//	by too many files already, or the disk is full.
+//
+//	"near" is the sector of the file header, next to which the index
+//	goes.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::Share(PersistentBitmap *freeMap, SeqDataSectors *other, int near) {
+	int clusterBytes = freeMap->ClusterSize() * SectorSize;
+	int numBytes = 0, done;
+
+	other->LoadAll();
+	Reset();
+	for (int i = 0; i < other->numExtents; i++) {
+		AddExtent(other->extents[i].start, other->extents[i].length);
+		numBytes += other->extents[i].length * SectorSize;
+	}
+	for (done = 0; done < numBytes; done += clusterBytes) {
+		if (!freeMap->Share(GetSector(done))) {
+			break;
+		}
+	}
+	if (done == numBytes && AllocateIndex(freeMap, 0, near)) {
+		kernel->stats->numClustersShared += numBytes / clusterBytes;
+		if (debug->IsEnabled('f')) Debug();
+		return TRUE;
+	}
+	while ((done -= clusterBytes) >= 0) {
+		(void) freeMap->Unshare(GetSector(done));
+	}
+	Reset();
+	return FALSE;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::Unshare
+// 	Give the file a copy of its own of the cluster beginning at file
+//	sector "index", which it shares, so that it can be written: a new
+//	cluster close to the old one is allocated, the data is copied to
+//	it, and it takes the old one's place in the extent list, which
+//	may split an extent in three.  The old cluster is shared by one
+//	file fewer, or freed if the others have let it go meanwhile.
+//	Return FALSE, leaving the file as it was, if the disk is full.
+//
+//	"near" is the sector of the file header, next to which any new
+//	index sector goes.
+//----------------------------------------------------------------------
+
+bool SeqDataSectors::Unshare(PersistentBitmap *freeMap, int index, int near) {
+	int cluster = freeMap->ClusterSize();
+	int old = GetSector(index * SectorSize);
+	int oldIndex = NumIndexSectors();
+	int copy = freeMap->FindAndSetClusters(cluster, old);
+	char *data;
+
+	ASSERT(index % cluster == 0);
+	if (copy == -1) {
+		return FALSE;
+	}
+	Remap(index, copy, cluster);
+	if (!AllocateIndex(freeMap, oldIndex, near)) {
+		Remap(index, old, cluster);
+		for (int j = 0; j < cluster; j++) {
+			freeMap->Clear(copy + j);
+		}
+		return FALSE;
+	}
+	for (int i = NumIndexSectors(); i < oldIndex; i++) { // merged away
+		kernel->bufferCache->Discard(indexSectors[i], 1);
+		freeMap->Clear(indexSectors[i]);
+	}
+	if (NumIndexSectors() == 0) {
+		front = -1;
+	}
+
+	data = new char[cluster * SectorSize];
+	for (int j = 0; j < cluster; j++) {
+		kernel->bufferCache->ReadSector(old + j, &data[j * SectorSize]);
+	}
+	kernel->bufferCache->WriteThrough(copy, cluster, data);
+	delete [] data;
+	if (!freeMap->Unshare(old)) {	// nobody else uses it now
+		kernel->bufferCache->Discard(old, cluster);
+		for (int j = 0; j < cluster; j++) {
+			freeMap->Clear(old + j);
+		}
+	}
+	DEBUG(dbgFile, "Copy shared cluster #" << old << " to #" << copy << ".");
+	kernel->stats->numClustersCopied++;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::Remap
+// 	Make the "length" file sectors from "index" on, which lie in one
+//	extent, the disk sectors from "start" on instead, rebuilding the
+//	extent list around them, merging what is adjacent.
+//----------------------------------------------------------------------
+
+void SeqDataSectors::Remap(int index, int start, int length) {
+	int count = numExtents;
+	Extent *old = new Extent[count];
+
+	LoadAll();
+	memcpy(old, extents, count * sizeof(Extent));
+	numExtents = 0;
+	for (int i = 0, first = 0; i < count; first += old[i++].length) {
+		int before = index - first;
+		int after = first + old[i].length - (index + length);
+
+		if (before < 0 || after < 0) {	// not this extent
+			AddExtent(old[i].start, old[i].length);
+			continue;
+		}
+		if (before > 0) {
+			AddExtent(old[i].start, before);
+		}
+		AddExtent(start, length);
+		if (after > 0) {
+			AddExtent(old[i].start + old[i].length - after, after);
+		}
+	}
+	numLoaded = numExtents;
+	lastHit = 0;
+	delete [] old;
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::FetchFrom/WriteBack
+// 	Copy the extent list out of/into the file header sector "buf",
+//	and read/write the chain of index sectors holding the rest of it.
+//
+//	FetchFrom only takes the extents stored in the header itself; index
+//	sectors are read later, one at a time, when GetSector first needs
+//	an extent in them (see LoadNextIndex).  So opening a big file costs
+//	a single disk read no matter how fragmented it is.
+//----------------------------------------------------------------------
+
 void SeqDataSectors::FetchFrom(char *buf) {
+	int count;
+
+	Reset();
 	memcpy(&front, buf, sizeof(int));
-	LinkedDataSector *curr = list = new LinkedDataSector;
-	curr->FetchFromSector(front);
-	
-	if (front == -1) return;
+	memcpy(&count, buf + sizeof(int), sizeof(int));
+	ASSERT(count >= 0);
+
+	if (count > maxExtents) {
+		delete [] extents;
+		delete [] firstIndex;
+		maxExtents = count;
+		extents = new Extent[maxExtents];
+		firstIndex = new int[maxExtents];
+	}
+	numExtents = count;
+	numLoaded = min(count, NumInlineExtents);
+	memcpy(extents, buf + 2 * sizeof(int), numLoaded * sizeof(Extent));
+	for (int i = 0, index = 0; i < numLoaded; i++) {
+		firstIndex[i] = index;
+		index += extents[i].length;
+	}
 
-	int link;
-	while ((link = curr->Link()) != -1) {
-		curr = curr->Push(link);
-		curr->FetchFromSector(link);
+	int numIndex = NumIndexSectors();
+	if (numIndex > 0) {
+		indexSectors = new int[numIndex];
 	}
 }
 
+//----------------------------------------------------------------------
+// SeqDataSectors::TakeFrom
+// 	Replace this extent list, whose sectors have been deallocated, by
+//	"other"'s, leaving "other" empty.
+//----------------------------------------------------------------------
+
+void SeqDataSectors::TakeFrom(SeqDataSectors *other) {
+	delete [] extents;
+	delete [] firstIndex;
+	delete [] indexSectors;
+	*this = *other;
+	other->extents = NULL;
+	other->firstIndex = NULL;
+	other->indexSectors = NULL;
+	other->Reset();
+}
+
 void SeqDataSectors::WriteBack(char *buf) {
+	LoadAll();
 	memcpy(buf, &front, sizeof(int));
+	memcpy(buf + sizeof(int), &numExtents, sizeof(int));
+	memset(buf + 2 * sizeof(int), -1, NumInlineExtents * sizeof(Extent));
+	memcpy(buf + 2 * sizeof(int), extents,
+		min(numExtents, NumInlineExtents) * sizeof(Extent));
 
-	if (front == -1) return;
-	
-	LinkedDataSector *curr = list;
-	curr->WriteBackSector(front);
-	
-	int link;
-	while ((link = curr->Link()) != -1) {
-		curr = curr->Next();
-		curr->WriteBackSector(link);
+	int numIndex = NumIndexSectors();
+	for (int i = 0, next = NumInlineExtents; i < numIndex; i++) {
+		LinkedDataSector index;
+		index.linkSector = (i + 1 < numIndex) ? indexSectors[i + 1] : -1;
+		index.numExtents = min(numExtents - next, LinkedExtents);
+		memset(index.extents, -1, sizeof(index.extents));
+		memcpy(index.extents, &extents[next], index.numExtents * sizeof(Extent));
+		index.WriteBackSector(indexSectors[i]);
+		next += index.numExtents;
+	}
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::LoadNextIndex
+// 	Read the first index sector not yet in memory, and add its extents
+//	to the in-core extent list.
+//----------------------------------------------------------------------
+
+void SeqDataSectors::LoadNextIndex() {
+	ASSERT(numLoaded < numExtents && numIndexLoaded < NumIndexSectors());
+
+	int sector = (numIndexLoaded == 0) ? front : nextIndexSector;
+	LinkedDataSector index;
+
+	ASSERT(sector != -1);
+	index.FetchFromSector(sector);
+	ASSERT(numLoaded + index.numExtents <= numExtents);
+	DEBUG(dbgFile, "Load " << index.numExtents << " extents from index sector #" << sector << ".");
+
+	indexSectors[numIndexLoaded++] = sector;
+	nextIndexSector = index.linkSector;
+	for (int i = 0; i < index.numExtents; i++, numLoaded++) {
+		extents[numLoaded] = index.extents[i];
+		firstIndex[numLoaded] = firstIndex[numLoaded - 1] +
+			extents[numLoaded - 1].length;
+	}
+}
+
+void SeqDataSectors::LoadAll() {
+	while (numLoaded < numExtents) {
+		LoadNextIndex();
+	}
+}
+
+//----------------------------------------------------------------------
+// SeqDataSectors::Check
+// 	For fsck: claim every index sector and data sector of the extent
+//	list just fetched, for the file whose header is at "owner".  Index
+//	sectors are read straight from the cache and checked before use,
+//	since a damaged one must not stop the check.  Return FALSE if the
+//	list does not describe exactly "numSectors" sectors of the disk.
+//	Data that may be "shared" may have been claimed by a clone.
+//----------------------------------------------------------------------
+
+static bool
+CheckExtents(Extent *extents, int count, FileSystemCheck *check,
+			 int owner, int *total, bool shared)
+{
+	for (int i = 0; i < count; i++) {
+		if (extents[i].length <= 0 || extents[i].start < 0 ||
+			extents[i].start > NumSectors - extents[i].length)
+			return FALSE;
+		for (int s = extents[i].start; s < extents[i].start + extents[i].length; s++)
+			(void)(shared ? check->ClaimShared(s, owner)
+						  : check->Claim(s, owner));	// a duplicate is counted there
+		*total += extents[i].length;
+	}
+	return TRUE;
+}
+
+bool SeqDataSectors::Check(FileSystemCheck *check, int owner, int numSectors, bool shared) {
+	int total = 0, found = numLoaded;
+	int sector = front;
+
+	if (!CheckExtents(extents, numLoaded, check, owner, &total, shared))
+		return FALSE;
+	for (int k = 0; k < NumIndexSectors(); k++) {
+		char buf[SectorSize];
+		LinkedDataSector index;
+
+		if (!check->Claim(sector, owner))
+			return FALSE;	// missing, or looping back into the chain
+		kernel->bufferCache->ReadSector(sector, buf);
+		memcpy(&index.linkSector, buf, sizeof(int));
+		memcpy(&index.numExtents, buf + sizeof(int), sizeof(int));
+		if (index.numExtents < 0 || index.numExtents > LinkedExtents ||
+			found + index.numExtents > numExtents)
+			return FALSE;
+		memcpy(index.extents, buf + 2 * sizeof(int), index.numExtents * sizeof(Extent));
+		if (!CheckExtents(index.extents, index.numExtents, check, owner, &total, shared))
+			return FALSE;
+		found += index.numExtents;
+		sector = index.linkSector;
+	}
+	return found == numExtents && total == numSectors;
+}
+
+void SeqDataSectors::Debug() {
+	LoadAll();
+	cout << numExtents << " extents, index at " << front << ":";
+	for (int i = 0; i < numExtents; i++) {
+		cout << " [" << extents[i].start << ", +" << extents[i].length << ")";
 	}
+	cout << "\n";
 }
 
 //----------------------------------------------------------------------
@@ -144,17 +637,54 @@ FileHeader::FileHeader()
 {
 	numBytes = -1;
 	numSectors = -1;
+	flags = 0;
+	memset(inlineData, 0, MaxInlineBytes);
+	chunkEnds = NULL;
 }
 
 //----------------------------------------------------------------------
 // MP4 mod tag
 // FileHeader::~FileHeader
-//	Currently, there is not need to do anything in destructor function.
-//	However, if you decide to add some "in-core" data in header
-//	Always remember to deallocate their space or you will leak memory
+//	Free the in-core chunk index, if it was read.
 //----------------------------------------------------------------------
 FileHeader::~FileHeader()
 {
+	delete [] chunkEnds;
+}
+
+// In-core file headers, made and freed for each file looked at.
+static SlabCache fileHeaderCache("file headers", sizeof(FileHeader));
+
+//----------------------------------------------------------------------
+// FileHeader::operator new, FileHeader::operator delete
+// 	Take a file header from its slab cache, and give it back.
+//----------------------------------------------------------------------
+
+void *
+FileHeader::operator new(size_t size)
+{
+	ASSERT(size == sizeof(FileHeader));
+	return fileHeaderCache.Alloc();
+}
+
+void
+FileHeader::operator delete(void *p)
+{
+	fileHeaderCache.Free(p);
+}
+
+//----------------------------------------------------------------------
+// ClusterRound
+// 	Round a number of data sectors up to a whole number of the free
+//	map's clusters.
+//----------------------------------------------------------------------
+
+static int
+ClusterRound(PersistentBitmap *freeMap, int sectors)
+{
+	int cluster = freeMap->ClusterSize();
+
+	return divRoundUp(sectors, cluster) * cluster;
 }
 
 //----------------------------------------------------------------------
@@ -162,16 +692,98 @@ FileHeader::~FileHeader()
 // 	Initialize a fresh file header for a newly created file.
 //	Allocate data blocks for the file out of the map of free disk blocks.
 //	Return FALSE if there are not enough free blocks to accomodate
-//	the new file.
+//	the new file.  A file of at most MaxInlineBytes gets no blocks;
+//	its data is kept in the header.
 //
 //	"freeMap" is the bit map of free disk sectors
 //	"fileSize" is the bit map of free disk sectors
+//	"sector" is where the header will be stored; the data is put
+//	  close to it
 //----------------------------------------------------------------------
 
-bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
+bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize, int sector)
 {
 	numBytes = fileSize;
-	dataSectorList.Allocate(freeMap, fileSize);
+	flags = 0;
+	if (fileSize <= MaxInlineBytes) {
+		numSectors = 0;
+		memset(inlineData, 0, MaxInlineBytes);
+		return TRUE;
+	}
+	numSectors = ClusterRound(freeMap, divRoundUp(fileSize, SectorSize));
+	return dataSectorList.Allocate(freeMap, numSectors * SectorSize, sector);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Extend
+// 	Make the file "fileSize" bytes long, allocating more data blocks if
+//	it now needs them.  Return FALSE, leaving the file unchanged, if
+//	there is not enough free space.  The caller writes the header back.
+//
+//	Blocks are allocated in batches: a file that runs out grows by
+//	as many blocks as it has, between MinGrowSectors and
+//	MaxGrowSectors, or only by what it needs if the disk is too full.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"fileSize" is the new length of the file, in bytes
+//	"sector" is where the header is stored
+//----------------------------------------------------------------------
+
+bool FileHeader::Extend(PersistentBitmap *freeMap, int fileSize, int sector)
+{
+	int newSectors = divRoundUp(fileSize, SectorSize);
+
+	if (fileSize <= numBytes)
+		return TRUE;
+	if (!(IsInline() && fileSize <= MaxInlineBytes) && newSectors > numSectors) {
+		int batch = min(max(numSectors, MinGrowSectors), MaxGrowSectors);
+		int goal = max(newSectors, numSectors + batch);
+
+		if (!Reserve(freeMap, goal * SectorSize, sector) &&
+			!Reserve(freeMap, fileSize, sector))
+			return FALSE;
+	}
+	numBytes = fileSize;
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Reserve
+// 	Make sure the file has the data blocks to hold "size" bytes,
+//	leaving its length as it is.  Return FALSE, leaving the file
+//	unchanged, if there is not enough free space.  The caller writes
+//	the header back.
+//
+//	A file kept in its header that needs blocks is given them, and
+//	what it held is copied to the first of them.  A compressed file
+//	is given none: it is expanded before it is written.
+//
+//	"freeMap" is the bit map of free disk sectors
+//	"size" is how many bytes the file should have room for
+//	"sector" is where the header is stored
+//----------------------------------------------------------------------
+
+bool FileHeader::Reserve(PersistentBitmap *freeMap, int size, int sector)
+{
+	int count = ClusterRound(freeMap, divRoundUp(size, SectorSize));
+
+	if (count <= numSectors || (IsInline() && size <= MaxInlineBytes) ||
+		IsCompressed())
+		return TRUE;
+	if (!IsInline()) {
+		if (!dataSectorList.Extend(freeMap, count - numSectors, sector))
+			return FALSE;
+	} else {
+		char buf[SectorSize];
+
+		if (!dataSectorList.Allocate(freeMap, count * SectorSize, sector))
+			return FALSE;
+		memset(buf, 0, SectorSize);
+		memcpy(buf, inlineData, numBytes);
+		kernel->bufferCache->WriteSector(dataSectorList.GetSector(0), buf);
+		DEBUG(dbgFile, "Move " << numBytes << " bytes out of header #" << sector);
+	}
+	numSectors = count;
 	return TRUE;
 }
 
@@ -179,12 +791,15 @@ bool FileHeader::Allocate(PersistentBitmap *freeMap, int fileSize)
 // FileHeader::Deallocate
 // 	De-allocate all the space allocated for data blocks for this file.
 //
+//	Clusters shared with clones are left to them.
+//
 //	"freeMap" is the bit map of free disk sectors
 //----------------------------------------------------------------------
 
 void FileHeader::Deallocate(PersistentBitmap *freeMap)
 {
-	dataSectorList.Deallocate(freeMap);
+	if (!IsInline())
+		dataSectorList.Deallocate(freeMap, IsShared());
 }
 
 //----------------------------------------------------------------------
@@ -197,15 +812,54 @@ void FileHeader::Deallocate(PersistentBitmap *freeMap)
 void FileHeader::FetchFrom(int sector)
 {
 	char buf[SectorSize];
-	kernel->synchDisk->ReadSector(sector, buf);
+	kernel->bufferCache->ReadSector(sector, buf);
 	
 	int offset = 0;
 	memcpy(&numBytes, buf, sizeof(int));
 	offset += sizeof(numBytes);
 	memcpy(&numSectors, buf + offset, sizeof(int));
 	offset += sizeof(numSectors);
+	memcpy(&flags, buf + offset, sizeof(int));
+	offset += sizeof(flags);
+	delete [] chunkEnds;
+	chunkEnds = NULL;
+
+	if (IsInline())
+		memcpy(inlineData, buf + offset, MaxInlineBytes);
+	else
+		dataSectorList.FetchFrom(buf + offset);
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Check
+// 	Fetch the file header at "sector" for fsck, and claim the sectors
+//	it leads to.  Unlike FetchFrom, a damaged header is not trusted:
+//	return FALSE if it makes no sense.
+//
+//	"sector" is the disk sector containing the file header
+//	"check" is the check in progress
+//----------------------------------------------------------------------
+
+bool FileHeader::Check(int sector, FileSystemCheck *check)
+{
+	char buf[SectorSize];
+	int count;
+
+	kernel->bufferCache->ReadSector(sector, buf);
+	memcpy(&numBytes, buf, sizeof(int));
+	memcpy(&numSectors, buf + sizeof(int), sizeof(int));
+	memcpy(&flags, buf + 2 * sizeof(int), sizeof(int));
+	if ((flags & ~(HdrCompressed | HdrShared)) != 0)
+		return FALSE;
+	if (numSectors == 0)
+		return numBytes >= 0 && numBytes <= MaxInlineBytes && !IsCompressed();
+	memcpy(&count, buf + 4 * sizeof(int), sizeof(int));
+	if (numBytes < 0 || numSectors > NumSectors || count < 0 || count > numSectors ||
+		(!IsCompressed() && numSectors < divRoundUp(numBytes, SectorSize)))
+		return FALSE;
 
-	dataSectorList.FetchFrom(buf + offset);
+	dataSectorList.FetchFrom(buf + 3 * sizeof(int));
+	return dataSectorList.Check(check, sector, numSectors, IsShared());
 }
 
 //----------------------------------------------------------------------
@@ -224,10 +878,14 @@ void FileHeader::WriteBack(int sector)
 	offset += sizeof(numBytes);
 	memcpy(buf + offset, &numSectors, sizeof(int));
 	offset += sizeof(numSectors);
-	//memcpy(buf + offset, &dataSectorListFront, sizeof(int));
-	dataSectorList.WriteBack(buf + offset);
+	memcpy(buf + offset, &flags, sizeof(int));
+	offset += sizeof(flags);
+	if (IsInline())
+		memcpy(buf + offset, inlineData, MaxInlineBytes);
+	else
+		dataSectorList.WriteBack(buf + offset);
 
-    kernel->synchDisk->WriteSector(sector, buf);
+    kernel->bufferCache->WriteSector(sector, buf);
 }
 
 //----------------------------------------------------------------------
@@ -238,23 +896,69 @@ void FileHeader::WriteBack(int sector)
 //	data at the offset is stored).
 //
 //	"offset" is the location within the file of the byte in question
+//
+//	The in-core table of where each extent begins within the file lets
+//	us binary search for the extent holding "offset"; since most access
+//	is sequential, we first try the extent used by the previous lookup
+//	and the one after it, which makes the common case constant time.
 //----------------------------------------------------------------------
 
 int SeqDataSectors::GetSector(int offset) {
-	int numSectors = offset / SectorSize;
-	LinkedDataSector *target = list;
-	for (int i = 0; i < numSectors / LinkedDirect; i++) {
-		target = target->Next();
-		ASSERT(target != NULL);
+	int index = offset / SectorSize;
+	int i = lastHit;
+
+	while (numLoaded < numExtents && index >= firstIndex[numLoaded - 1] +
+			extents[numLoaded - 1].length) {
+		LoadNextIndex();		// not in any extent we have read yet
+	}
+	if (!Covers(i, index)) {
+		if (Covers(i + 1, index)) {
+			i++;
+		} else {
+			int low = 0, high = numLoaded - 1;
+			while (low < high) {	// last extent starting at or before index
+				int mid = (low + high + 1) / 2;
+				if (firstIndex[mid] <= index) low = mid;
+				else high = mid - 1;
+			}
+			i = low;
+			ASSERT(Covers(i, index));
+		}
+		lastHit = i;
 	}
-	return target->Data(numSectors % LinkedDirect);
+	return extents[i].start + (index - firstIndex[i]);
 }
 
 int FileHeader::ByteToSector(int offset)
 {
+	ASSERT(!IsInline());
 	return dataSectorList.GetSector(offset);
 }
 
+//----------------------------------------------------------------------
+// FileHeader::ReadInline/WriteInline
+// 	Copy bytes out of/into the data of a file kept in its header.
+//	The caller has checked they lie within the file, and marks the
+//	header dirty after writing.
+//
+//	"into" -- the buffer to copy the data to
+//	"from" -- the buffer holding the data to write
+//	"numBytes" -- the number of bytes to copy
+//	"position" -- the offset within the file of the first byte
+//----------------------------------------------------------------------
+
+void FileHeader::ReadInline(char *into, int numBytes, int position)
+{
+	ASSERT(IsInline() && position + numBytes <= this->numBytes);
+	bcopy(&inlineData[position], into, numBytes);
+}
+
+void FileHeader::WriteInline(char *from, int numBytes, int position)
+{
+	ASSERT(IsInline() && position + numBytes <= this->numBytes);
+	bcopy(from, &inlineData[position], numBytes);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::FileLength
 // 	Return the number of bytes in the file.
@@ -265,24 +969,253 @@ int FileHeader::FileLength()
 	return numBytes;
 }
 
+//----------------------------------------------------------------------
+// FileHeader::SpaceAllocated
+// 	Return how long the file can grow without allocating anything:
+//	to the end of its last data sector, or of the header itself for a
+//	file kept there.  A compressed file cannot grow in place at all.
+//----------------------------------------------------------------------
+
+int FileHeader::SpaceAllocated()
+{
+	if (IsCompressed())
+		return numBytes;
+	return IsInline() ? MaxInlineBytes : numSectors * SectorSize;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Pack
+// 	Return the packed image of a compressed file holding "numBytes"
+//	of "data", in a new buffer of whole sectors, and set
+//	"packedBytes" to its length.  Return NULL if it would take as
+//	many sectors as the data itself.
+//
+//	Each chunk is compressed on its own, and stored as it is if it
+//	does not shrink.  The image is never small enough to be kept in
+//	a header: a compressed file always has data sectors.
+//----------------------------------------------------------------------
+
+char *FileHeader::Pack(char *data, int numBytes, int *packedBytes)
+{
+	int numChunks = divRoundUp(numBytes, ChunkBytes);
+	int indexBytes = numChunks * sizeof(int);
+	int size = divRoundUp(indexBytes + numBytes, SectorSize) * SectorSize;
+	char *image = new char[size];
+	int *ends = new int[numChunks];
+	int at = indexBytes;
+
+	memset(image, 0, size);
+	for (int c = 0; c < numChunks; c++) {
+		char *chunk = &data[c * ChunkBytes];
+		int length = min(ChunkBytes, numBytes - c * ChunkBytes);
+		int n = Compress(chunk, length, &image[at], length - 1);
+
+		if (n < 0) {			// does not shrink
+			bcopy(chunk, &image[at], length);
+			n = length;
+		}
+		at += n;
+		ends[c] = at;
+	}
+	bcopy((char *) ends, image, indexBytes);
+	delete [] ends;
+	if (divRoundUp(at, SectorSize) >= divRoundUp(numBytes, SectorSize)) {
+		delete [] image;
+		return NULL;
+	}
+	*packedBytes = max(at, MaxInlineBytes + 1);
+	return image;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadChunk
+// 	Expand chunk "chunk" of a compressed file into "into", which has
+//	room for ChunkBytes, reading the chunk index first if it has not
+//	been.  Return the length of the chunk, less than ChunkBytes only
+//	for the last one.  The packed bytes come through the buffer cache.
+//----------------------------------------------------------------------
+
+int FileHeader::ReadChunk(int chunk, char *into)
+{
+	int length = min(ChunkBytes, numBytes - chunk * ChunkBytes);
+	int start, end;
+
+	ASSERT(IsCompressed() && chunk >= 0 && chunk < NumChunks());
+	if (chunkEnds == NULL) {
+		chunkEnds = new int[NumChunks()];
+		ReadPacked((char *) chunkEnds, NumChunks() * sizeof(int), 0);
+	}
+	start = (chunk == 0) ? NumChunks() * sizeof(int) : chunkEnds[chunk - 1];
+	end = chunkEnds[chunk];
+	DEBUG(dbgFile, "Expand chunk " << chunk << " from " << end - start << " bytes");
+	if (end - start == length) {	// stored as it is
+		ReadPacked(into, length, start);
+	} else {
+		char *packed = new char[end - start];
+		int expanded;
+
+		ReadPacked(packed, end - start, start);
+		expanded = Decompress(packed, end - start, into, length);
+		ASSERT(expanded == length);
+		delete [] packed;
+		kernel->stats->numChunksExpanded++;
+	}
+	return length;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::ReadPacked
+// 	Copy bytes of the packed image of a compressed file out of its
+//	data sectors, a run of consecutive disk sectors at a time, as
+//	OpenFile::ReadAt does.
+//
+//	"into" -- the buffer to copy the data to
+//	"numBytes" -- the number of bytes to copy
+//	"position" -- the offset within the image of the first byte
+//----------------------------------------------------------------------
+
+void FileHeader::ReadPacked(char *into, int numBytes, int position)
+{
+	int last = divRoundDown(position + numBytes - 1, SectorSize);
+	CacheBuffer *buffers[MaxRunSectors];
+	int sector, run, got;
+
+	for (int i = divRoundDown(position, SectorSize); i <= last; i += got) {
+		sector = ByteToSector(i * SectorSize);
+		for (run = 1; (i + run <= last) && (run < MaxRunSectors) &&
+				 (ByteToSector((i + run) * SectorSize) == sector + run); run++)
+			;
+		got = kernel->bufferCache->GetBuffers(sector, run, buffers);
+		for (int k = 0; k < got; k++) {
+			int start = max(position, (i + k) * SectorSize);
+			int end = min(position + numBytes, (i + k + 1) * SectorSize);
+
+			bcopy(&buffers[k]->data[start - (i + k) * SectorSize],
+				  &into[start - position], end - start);
+			kernel->bufferCache->ReleaseBuffer(buffers[k], FALSE);
+		}
+	}
+}
+
+//----------------------------------------------------------------------
+// FileHeader::WriteData
+// 	Write all "numBytes" of the contents of a header just allocated,
+//	before anything points to it: into the header itself, or straight
+//	through to its data sectors, a run at a time.  "from" holds whole
+//	sectors.
+//----------------------------------------------------------------------
+
+void FileHeader::WriteData(char *from, int numBytes)
+{
+	int count = divRoundUp(numBytes, SectorSize);
+	int sector, run;
+
+	if (IsInline()) {
+		WriteInline(from, numBytes, 0);
+		return;
+	}
+	for (int i = 0; i < count; i += run) {
+		sector = ByteToSector(i * SectorSize);
+		for (run = 1; (i + run < count) && (run < MaxRunSectors) &&
+				 (ByteToSector((i + run) * SectorSize) == sector + run); run++)
+			;
+		kernel->bufferCache->WriteThrough(sector, run, &from[i * SectorSize]);
+	}
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Adopt
+// 	Make the data of "other", a header allocated and written with
+//	WriteData, the data of this file, compressed or not; this file's
+//	own sectors have been deallocated.  The length stays the same.
+//	"other" is left with nothing.  The caller writes the header back.
+//----------------------------------------------------------------------
+
+void FileHeader::Adopt(FileHeader *other, bool compressed)
+{
+	numSectors = other->numSectors;
+	dataSectorList.TakeFrom(&other->dataSectorList);
+	bcopy(other->inlineData, inlineData, MaxInlineBytes);
+	if (compressed)
+		flags |= HdrCompressed;
+	else
+		flags &= ~HdrCompressed;
+	delete [] chunkEnds;
+	chunkEnds = NULL;
+	other->numSectors = 0;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Share
+// 	Make this header, that of a file just created and still empty, a
+//	clone of "other": the same length and data, its data clusters
+//	shared, both headers marked as sharing them.  A file kept in its
+//	header is simply copied.  Return FALSE, leaving this file empty,
+//	if a cluster has too many sharers already, the disk has no room
+//	for the share counts, or no room for the clone's index.  The
+//	caller writes both headers back.
+//
+//	"sector" is where this header is stored
+//----------------------------------------------------------------------
+
+bool FileHeader::Share(PersistentBitmap *freeMap, FileHeader *other, int sector)
+{
+	ASSERT(IsInline() && numBytes == 0);
+	if (!other->IsInline()) {
+		if (!dataSectorList.Share(freeMap, &other->dataSectorList, sector))
+			return FALSE;
+		other->flags |= HdrShared;
+	}
+	numBytes = other->numBytes;
+	numSectors = other->numSectors;
+	flags = other->flags;
+	bcopy(other->inlineData, inlineData, MaxInlineBytes);
+	return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileHeader::Shares/Unshare
+// 	Say whether the data cluster holding byte "position" of the file
+//	is shared with a clone; and give the file a copy of it of its own,
+//	before it is written.  Unshare returns FALSE if the disk is full.
+//	The caller holds the header's lock, and writes it back.
+//
+//	"sector" is where the header is stored
+//----------------------------------------------------------------------
+
+bool FileHeader::Shares(PersistentBitmap *freeMap, int position)
+{
+	return IsShared() && !IsInline() && (position < numSectors * SectorSize) &&
+		(freeMap->Shares(ByteToSector(position)) > 0);
+}
+
+bool FileHeader::Unshare(PersistentBitmap *freeMap, int position, int sector)
+{
+	int cluster = freeMap->ClusterSize();
+
+	ASSERT(!IsCompressed());
+	return dataSectorList.Unshare(freeMap,
+		divRoundDown(position / SectorSize, cluster) * cluster, sector);
+}
+
 //----------------------------------------------------------------------
 // FileHeader::Print
 // 	Print the contents of the file header, and the contents of all
 //	the data blocks pointed to by the file header.
 //----------------------------------------------------------------------
 
-void LinkedDataSector::Print(int numBytes) {
+void SeqDataSectors::Print(int numBytes) {
 	int i, j, k;
 	char *data = new char[SectorSize];
-	numBytes = numBytes < LinkedDirect * SectorSize ? numBytes : LinkedDirect * SectorSize;
-	int numSectors = divRoundUp(numBytes, SectorSize);
 
-	for (i = 0; i < numSectors; i++)
-		printf("%d ", dataSectors[i]);
+	LoadAll();
+	for (i = 0; i < numExtents; i++)
+		for (j = 0; j < extents[i].length; j++)
+			printf("%d ", extents[i].start + j);
 	printf("\nFile contents:\n");
-	for (i = k = 0; i < numSectors; i++)
+	for (i = k = 0; k < numBytes; i++)
 	{
-		kernel->synchDisk->ReadSector(dataSectors[i], data);
+		kernel->bufferCache->ReadSector(GetSector(i * SectorSize), data);
 		for (j = 0; (j < SectorSize) && (k < numBytes); j++, k++)
 		{
 			if ('\040' <= data[j] && data[j] <= '\176') // isprint(data[j])
@@ -293,11 +1226,26 @@ void LinkedDataSector::Print(int numBytes) {
 		printf("\n");
 	}
 	delete[] data;
-	if (numBytes > LinkedDirect) next->Print(numBytes - LinkedDirect * SectorSize);
 }
 
 void FileHeader::Print()
 {
+	if (IsInline()) {
+		printf("FileHeader contents.  File size: %d.  Kept in the header.\nFile contents:\n", numBytes);
+		for (int k = 0; k < numBytes; k++) {
+			if ('\040' <= inlineData[k] && inlineData[k] <= '\176') // isprint
+				printf("%c", inlineData[k]);
+			else
+				printf("\\%x", (unsigned char)inlineData[k]);
+		}
+		printf("\n");
+		return;
+	}
+	if (IsCompressed()) {
+		printf("FileHeader contents.  File size: %d, compressed.  File blocks:\n", numBytes);
+		dataSectorList.Print(numSectors * SectorSize);
+		return;
+	}
 	printf("FileHeader contents.  File size: %d.  File blocks:\n", numBytes);
 	dataSectorList.Print(numBytes);
 }
@@ -18,65 +18,138 @@
 #include "pbitmap.h"
 #include "list.h"
 
+class FileSystemCheck;
+
 #define NumDirect ((SectorSize - 2 * sizeof(int)) / sizeof(int))
-#define LinkedDirect ((SectorSize - sizeof(int)) / sizeof(int))
 
-class LinkedDataSector {
-public:
-	LinkedDataSector(int sector): linkSector(sector), next(NULL) {
-		for (int i = 0; i < LinkedDirect; i++) dataSectors[i] = -1;
-	}
-	LinkedDataSector(): linkSector(-1), next(NULL) {
-		for (int i = 0; i < LinkedDirect; i++) dataSectors[i] = -1;
-	}
-	~LinkedDataSector() { delete next; }
+// A run of "length" consecutive disk sectors, beginning at "start".
+// File data is described by a list of these, in file order.
+typedef struct {
+	int start;
+	int length;
+} Extent;
 
-	int Link() { return linkSector; }
-	
-	int Data(int idx) { return dataSectors[idx]; }
-	void AssignSector(int idx, int sector) { dataSectors[idx] = sector; }
-	
-	LinkedDataSector *Next() { return next; }
-	LinkedDataSector *Push(int sector) { linkSector = sector; next = new LinkedDataSector; return next; }
+// Extents that fit in the file header sector itself, after numBytes,
+// numSectors, flags and the two SeqDataSectors fields; and extents
+// that fit in each chained index sector, after its link and count.
+#define NumInlineExtents ((int)((SectorSize - 5 * sizeof(int)) / sizeof(Extent)))
+#define LinkedExtents ((int)((SectorSize - 2 * sizeof(int)) / sizeof(Extent)))
 
-	void Debug();
-	void Print(int numBytes);
+// Bytes of data a small file can keep in its header sector, in place
+// of the extent list, after numBytes, numSectors and flags.
+#define MaxInlineBytes ((int)(SectorSize - 3 * sizeof(int)))
+
+// Bits of the header's flags.
+#define HdrCompressed 0x1	// the data is compressed, in chunks
+#define HdrShared 0x2		// some data clusters may be shared with
+							//  clones (see PersistentBitmap::Share)
+
+// Bytes of a compressed file that are compressed together: reading
+// any of them expands the whole chunk, but only that chunk.
+#define ChunkBytes (16 * SectorSize)
+
+// Fewest and most data sectors a file grows by when it is extended
+// past the sectors it has: as many as it has already, between the
+// two, so that a file appended to a little at a time allocates
+// rarely, and in long runs.
+#define MinGrowSectors 8
+#define MaxGrowSectors 128
+
+// One sector of the chain of index sectors holding the extents of a
+// file that do not fit in its header.  This is purely an on-disk
+// format; the extents are copied in and out of SeqDataSectors.
+class LinkedDataSector {
+public:
+	LinkedDataSector(): linkSector(-1), numExtents(0) {}
 
 	void FetchFromSector(int sector);
 	void WriteBackSector(int sector);
 
-private:
-	int linkSector;					// Both stored in disk
-	int dataSectors[LinkedDirect];
-	LinkedDataSector *next; // In-core member, was NULL
+	int linkSector;					// next index sector, -1 = end
+	int numExtents;					// entries of extents[] in use
+	Extent extents[LinkedExtents];
 };
 
+// The list of extents making up the data of a file.  The first
+// NumInlineExtents extents live in the file header; the rest are
+// chained through index sectors starting at "front".
 class SeqDataSectors {
 public:
-	SeqDataSectors(): front(-1), list(NULL) {}
-	~SeqDataSectors() { delete list; }
-	bool Allocate(PersistentBitmap *freeMap, int fileSize);
-	void Deallocate(PersistentBitmap *freeMap);
+	SeqDataSectors();
+	~SeqDataSectors();
+	bool Allocate(PersistentBitmap *freeMap, int fileSize, int near);
+	bool Extend(PersistentBitmap *freeMap, int count, int near); // add sectors at the end
+	void Deallocate(PersistentBitmap *freeMap, bool shared = FALSE);
+	bool Share(PersistentBitmap *freeMap, SeqDataSectors *other, int near); // use another's data
+	bool Unshare(PersistentBitmap *freeMap, int index, int near); // copy one cluster of it
 	void FetchFrom(char *buf);
 	void WriteBack(char *buf);
+	void TakeFrom(SeqDataSectors *other); // move another list's extents here
 	int GetSector(int offset);
-	void Debug() { cout << front << " -> "; list->Debug(); }
-	void Print(int numBytes) { list->Print(numBytes); }
+	bool Check(FileSystemCheck *check, int owner, int numSectors, bool shared);
+	void Debug();
+	void Print(int numBytes);
 private:
-	int front;
-	LinkedDataSector *list;
+	void Reset();					// forget all extents
+	void AddExtent(int start, int length); // append, merging if adjacent
+	void Remap(int index, int start, int length); // move file sectors
+	bool AddSectors(PersistentBitmap *freeMap, int count, int near); // allocate data
+	bool AllocateIndex(PersistentBitmap *freeMap, int numOld, int near); // and index
+	void LoadNextIndex();			// read one more index sector
+	void LoadAll();					// read the whole index
+	bool Covers(int i, int index) {	// is sector "index" of the file in extent i?
+		return i < numLoaded && firstIndex[i] <= index &&
+			index < firstIndex[i] + extents[i].length;
+	}
+	int NumIndexSectors() {			// index sectors needed for the extents
+		return (numExtents <= NumInlineExtents) ? 0 :
+			divRoundUp(numExtents - NumInlineExtents, LinkedExtents);
+	}
+
+	int front;						// Both stored in disk
+	int numExtents;
+	Extent *extents;				// In-core: every extent of the file,
+	int maxExtents;					//  the inline ones first
+	int *firstIndex;				// In-core: file sector # where each
+									//  extent begins
+	int lastHit;					// In-core: extent of the last lookup
+	int numLoaded;					// In-core: extents read so far; index
+	int numIndexLoaded;				//  sectors are read only when needed
+	int nextIndexSector;			// In-core: next index sector to read
+	int *indexSectors;				// In-core: the chain of index sectors
 };
 
 // The following class defines the Nachos "file header" (in UNIX terms,
 // the "i-node"), describing where on disk to find all of the data in the file.
-// The file header is organized as a simple table of pointers to
-// data blocks.
+// The file header is organized as a list of extents -- runs of
+// contiguous data blocks.
 //
 // The file header data structure can be stored in memory or on disk.
 // When it is on disk, it is stored in a single sector -- this means
 // that we assume the size of this data structure to be the same
-// as one disk sector.  Without indirect addressing, this
-// limits the maximum file length to just under 4K bytes.
+// as one disk sector.  Extents that do not fit are kept in a chain of
+// index sectors, so the maximum file length is limited only by the disk.
+//
+// A file may have more data sectors than its length needs, allocated
+// ahead of the writes that will fill them.
+//
+// A file of at most MaxInlineBytes has no data sectors at all: its
+// data is kept in the header sector, where the extent list would be
+// (numSectors is then 0).  Reading it takes the one read of the
+// header.  When it grows past that, its data moves to a data sector.
+//
+// A clone (see FileSystem::Clone) starts out with the same data
+// clusters as the file it was cloned from, each counted as shared in
+// the free map, and its own index sectors.  A cluster is copied the
+// first time either file writes to it, and freed with the last file
+// using it.
+//
+// A compressed file (see FileSystem::Compress) keeps its data in
+// chunks of ChunkBytes, each compressed on its own and packed one
+// after another, behind an index of where each chunk ends.  Its
+// sectors hold this packed image, not the bytes of the file;
+// numBytes is still the length of the file.  The index is read into
+// the header the first time a chunk is read.
 //
 // There is no constructor; rather the file header can be initialized
 // by allocating blocks for the file (if it is a new file), or by
@@ -89,9 +162,18 @@ public:
 	FileHeader(); // dummy constructor to keep valgrind happy
 	~FileHeader();
 
-	bool Allocate(PersistentBitmap *bitMap, int fileSize); // Initialize a file header,
+	void *operator new(size_t size); // from a slab cache (see slab.h)
+	void operator delete(void *p);
+
+	bool Allocate(PersistentBitmap *bitMap, int fileSize, int sector); // Initialize a file header,
 														   //  including allocating space
-														   //  on disk for the file data
+														   //  on disk for the file data,
+														   //  near the header's "sector"
+	bool Extend(PersistentBitmap *bitMap, int fileSize, int sector); // Make the file longer,
+														   //  allocating more blocks
+	bool Reserve(PersistentBitmap *bitMap, int size, int sector); // Allocate blocks for
+														   //  the file to grow to "size"
+														   //  into, without growing it
 	void Deallocate(PersistentBitmap *bitMap);			   // De-allocate this file's
 														   //  data blocks
 
@@ -103,8 +185,46 @@ public:
 								  // to the disk sector containing
 								  // the byte
 
+	bool IsInline() { return numSectors == 0; }
+								  // Is the data in the header itself?
+	bool IsCompressed() { return (flags & HdrCompressed) != 0; }
+								  // Is it compressed?
+	bool IsShared() { return (flags & HdrShared) != 0; }
+								  // May it share data with clones?
+	void ReadInline(char *into, int numBytes, int position);
+	void WriteInline(char *from, int numBytes, int position);
+								  // Copy data out of/into the header
+								  // of such a file
+
+	static char *Pack(char *data, int numBytes, int *packedBytes);
+								  // Compress the contents of a file;
+								  // NULL if that saves no sectors
+	int ReadChunk(int chunk, char *into); // Expand one chunk of a
+								  // compressed file into "into"
+	void WriteData(char *from, int numBytes); // Write the contents of
+								  // a header just allocated
+	void Adopt(FileHeader *other, bool compressed); // Take the data
+								  // of "other", its new contents
+	bool Share(PersistentBitmap *freeMap, FileHeader *other, int sector);
+								  // Become a clone of "other",
+								  // sharing its data clusters
+	bool Shares(PersistentBitmap *freeMap, int position);
+								  // Is the cluster holding byte
+								  // "position" shared?
+	bool Unshare(PersistentBitmap *freeMap, int position, int sector);
+								  // Copy it, to be written to
+
 	int FileLength(); // Return the length of the file
 					  // in bytes
+	int SpaceAllocated(); // Bytes it can grow to without
+					  // allocating more
+	int DataSectors() { return numSectors; } // Data sectors
+					  // allocated, counted in the header
+
+	bool Check(int sector, FileSystemCheck *check); // Read the header at
+									  // "sector", claiming its index
+									  // and data sectors for fsck;
+									  // FALSE if it makes no sense
 
 	void Print(); // Print the contents of the file.
 
@@ -118,15 +238,28 @@ private:
 		In order to implement a data structure, you will need to add some "in-core" data
 		to maintain data structure.
 		
-		Disk Part - numBytes, numSectors, dataSectors occupy exactly 128 bytes and will be
-		written to a sector on disk.
-		In-core part - none
+		Disk Part - numBytes, numSectors, flags and the header part of dataSectorList
+		(front, numExtents, the inline extents) occupy exactly 128 bytes and
+		will be written to a sector on disk.  A small file has inlineData
+		there instead of the extents.
+		In-core part - the complete extent list and index sector numbers
+		kept by dataSectorList, and the chunk index of a compressed file.
 		
 	*/
 
 	int numBytes;				// Number of bytes in the file
-	int numSectors;				// Number of data sectors in the file
-	SeqDataSectors dataSectorList;	// Disk sector numbers for each data block in the file
+	int numSectors;				// Number of data sectors allocated to the
+								//  file; may be more than numBytes needs
+	int flags;					// HdrCompressed, HdrShared, or 0
+	SeqDataSectors dataSectorList;	// Extents holding the data blocks of the file
+	char inlineData[MaxInlineBytes]; // Or the data itself, if numSectors is 0
+	int *chunkEnds;				// In-core: where each chunk of a
+								//  compressed file ends in its packed
+								//  image, or NULL until read
+
+	int NumChunks() { return divRoundUp(numBytes, ChunkBytes); }
+	void ReadPacked(char *into, int numBytes, int position);
+								// Read bytes of the packed image
 };
 
 #endif // FILEHDR_H
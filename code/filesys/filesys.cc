@@ -28,16 +28,30 @@
 //	modified part of the directory and/or bitmap, we simply discard
 //	the changed version, without writing it back to disk.
 //
+//	Each directory has a reader-writer lock, kept with its header in
+//	the inode table: looking a name up in a directory holds it shared,
+//	so lookups in the same directory go on together, and adding or
+//	removing a name holds it exclusive.  Only one directory is locked
+//	at a time.  The free map is locked in groups of tracks, so that
+//	threads allocating at once mostly take different locks, and each
+//	header in the inode table has a lock of its own (cf. pbitmap.h,
+//	inodetable.h).
+//
 // 	Our implementation at this point has the following restrictions:
 //
-//	   there is no synchronization for concurrent accesses
 //	   files have a fixed size, set when the file is created
 //	   files cannot be bigger than about 3KB in size
 //	   there is no hierarchical directory structure, and only a limited
 //	     number of files can be added to the system
-//	   there is no attempt to make the system robust to failures
-//	    (if Nachos exits in the middle of an operation that modifies
-//	    the file system, it may corrupt the disk)
+//
+//	Space is placed in those groups as in the UNIX fast file system:
+//	a new directory goes in the group with the most free space, a
+//	file's header in its directory's group, and its data and index
+//	after its header, so that related sectors are close on disk.
+//
+//	Create, Remove and creating directories are made atomic by the
+//	journal (cf. journal.h): if Nachos exits in the middle of one, the
+//	next mount finishes it or undoes it.  File data is not journaled.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -51,6 +65,17 @@
 #include "directory.h"
 #include "filehdr.h"
 #include "filesys.h"
+#include "namecache.h"
+#include "inodetable.h"
+#include "buffercache.h"
+#include "journal.h"
+#include "checksum.h"
+#include "swapspace.h"
+#include "fsck.h"
+#include "execcache.h"
+#include "remotefs.h"
+#include "syscall.h"
+#include "main.h"
 
 // Sectors containing the file headers for the bitmap of free sectors,
 // and the directory of files.  These file headers are placed in well-known
@@ -58,11 +83,19 @@
 #define FreeMapSector 0
 #define DirectorySector 1
 
-// Initial file sizes for the bitmap and directory; until the file system
-// supports extensible files, the directory size sets the maximum number
-// of files that can be loaded onto the disk.
-#define FreeMapFileSize (NumSectors / BitsInByte)
-#define DirectoryFileSize (sizeof(DirectoryEntry) * NumDirEntries)
+const int SuperMagic = 0x4e535550;
+const int FileSystemVersion = 1;
+
+// Initial file sizes for the bitmap and directory; directories grow
+// beyond this as files are added to them.  The bitmap file ends with
+// the cluster size, and the share count of each cluster (see
+// PersistentBitmap).
+#define FreeMapFileSize (NumSectors / BitsInByte + sizeof(int) + \
+                         NumSectors / kernel->clusterSectors)
+#define DirectoryFileSize (sizeof(DirectoryHeader) + DirRecordSpace * NumDirEntries)
+
+#define MaxListDepth 32 // most directories ListRecursively keeps open
+#define ListBufferSize 4096 // bytes of listing printed at once
 
 //----------------------------------------------------------------------
 // FileSystem::FileSystem
@@ -72,7 +105,13 @@
 //	not all of the sectors marked as free).
 //
 //	If format = FALSE, we just have to open the files
-//	representing the bitmap and the directory.
+//	representing the bitmap and the directory.  If the superblock
+//	says the disk was unmounted cleanly, the journal need not be
+//	replayed, and the free sectors in each group need not be counted.
+//
+//	Either way, the bitmap of free sectors is kept in memory for as
+//	long as Nachos runs; operations update it in place and write
+//	back only the parts of it they changed.
 //
 //	"format" -- should we initialize the disk?
 //----------------------------------------------------------------------
@@ -80,25 +119,58 @@
 FileSystem::FileSystem(bool format)
 {
     DEBUG(dbgFile, "Initializing the file system.");
+    for (int i = 0; i < MaxOpenFiles; i++)
+    {
+        openFileTable[i] = NULL;
+        openFileRefs[i] = 0;
+        dirCursor[i] = -1;
+        remoteTable[i] = NULL;
+    }
+    remote = NULL;
+    nameCache = new NameCache(NumNameCacheEntries);
     if (format)
     {
-        PersistentBitmap *freeMap = new PersistentBitmap(NumSectors);
+        freeMap = new PersistentBitmap(NumSectors);
         Directory *directory = new Directory(NumDirEntries);
         FileHeader *mapHdr = new FileHeader;
         FileHeader *dirHdr = new FileHeader;
 
         DEBUG(dbgFile, "Formatting the file system.");
 
+        // Discard the old contents of the whole disk.  Then only the
+        // sectors the new file system uses take up space in the UNIX
+        // file; the rest of the bitmap, being zeroes, is never stored.
+        kernel->bufferCache->Discard(0, NumSectors);
+        freeMap->SetClusterSize(kernel->clusterSectors);
+
         // First, allocate space for FileHeaders for the directory and bitmap
         // (make sure no one else grabs these!)
         freeMap->Mark(FreeMapSector);
         freeMap->Mark(DirectorySector);
+        freeMap->Mark(SuperSector);
+        hasSuper = TRUE;
+
+        // The swap area and the journal's log take the end of the disk.
+        for (int i = SwapStart; i < NumSectors; i++)
+            freeMap->Mark(i);
+        kernel->journal->Format();
+
+        // Below them, the table of checksums, if there is to be one.
+        if (kernel->checksumDisk)
+        {
+            for (int i = ChecksumStart; i < SwapStart; i++)
+                freeMap->Mark(i);
+            kernel->bufferCache->SetChecksums(
+                new SectorChecksums(kernel->synchDisk, TRUE));
+        }
+        else
+            SectorChecksums::Remove(kernel->synchDisk);
 
         // Second, allocate space for the data blocks containing the contents
         // of the directory and bitmap files.  There better be enough space!
 
-        ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize));
-        ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
+        ASSERT(mapHdr->Allocate(freeMap, FreeMapFileSize, FreeMapSector));
+        ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize, DirectorySector));
 
         // Flush the bitmap and directory FileHeaders back to disk
         // We need to do this before we can "Open" the file, since open
@@ -131,17 +203,35 @@ FileSystem::FileSystem(bool format)
             freeMap->Print();
             directory->Print();
         }
-        delete freeMap;
         delete directory;
         delete mapHdr;
         delete dirHdr;
+        WriteSuper(FALSE);
     }
     else
     {
-        // if we are not formatting the disk, just open the files representing
-        // the bitmap and directory; these are left open while Nachos is running
+        // if we are not formatting the disk, first finish whatever the
+        // journal says was committed, then just open the files representing
+        // the bitmap and directory; these are left open while Nachos is running.
+        // The sectors replayed get their checksums, if the disk keeps them.
+        SuperBlock super;
+        bool clean;
+
+        if (SectorChecksums::Present(kernel->synchDisk))
+            kernel->bufferCache->SetChecksums(
+                new SectorChecksums(kernel->synchDisk, FALSE));
+        hasSuper = ReadSuper(&super);
+        clean = hasSuper && super.clean;
+        if (clean)
+            kernel->journal->Resume(super.journalSeq);
+        else
+            kernel->journal->Recover();
         freeMapFile = new OpenFile(FreeMapSector);
         directoryFile = new OpenFile(DirectorySector);
+        freeMap = new PersistentBitmap(freeMapFile, NumSectors,
+                                       clean ? super.groupFree : NULL);
+        if (hasSuper)
+            WriteSuper(FALSE); // in use until unmounted
     }
 }
 
@@ -151,7 +241,14 @@ FileSystem::FileSystem(bool format)
 //----------------------------------------------------------------------
 FileSystem::~FileSystem()
 {
-    delete openedFile;
+    for (int i = 0; i < MaxOpenFiles; i++)
+    {
+        delete openFileTable[i];
+        delete remoteTable[i];
+    }
+    delete remote;
+    delete nameCache;
+    delete freeMap;
     delete freeMapFile;
     delete directoryFile;
 }
@@ -200,14 +297,15 @@ Path FileSystem::DescribePath(char *path) {
 //----------------------------------------------------------------------
 // FileSystem::Create
 // 	Create a file in the Nachos file system (similar to UNIX create).
-//	Since we can't increase the size of files dynamically, we have
-//	to give Create the initial size of the file.
+//	Create is given the initial size of the file; it can grow later,
+//	by writing past its end.
 //
 //	The steps to create a file are:
 //	  Make sure the file doesn't already exist
 //        Allocate a sector for the file header
 // 	  Allocate space on disk for the data blocks for the file
-//	  Add the name to the directory
+//	  Add the name to the directory (the directory file is updated
+//	    right away, so this is done last)
 //	  Store the new file header on disk
 //	  Flush the changes to the bitmap and the directory back to disk
 //
@@ -219,8 +317,7 @@ Path FileSystem::DescribePath(char *path) {
 //	 	no free entry for file in directory
 //	 	no free space for data blocks for the file
 //
-// 	Note that this implementation assumes there is no concurrent access
-//	to the file system!
+//	The directory is locked exclusive from the lookup on.
 //
 //	"name" -- name of file to be created
 //	"initialSize" -- size of file to be created
@@ -229,18 +326,26 @@ Path FileSystem::DescribePath(char *path) {
 bool FileSystem::Create(char *name, int initialSize)
 {
     Directory *directory;
+    Inode *dirInode;
     OpenFile *dirFile;
-    PersistentBitmap *freeMap;
     FileHeader *hdr;
     int sector;
     bool success;
 
     char filename[FileNameMaxLen+1];
 
+    if (RemoteName(name) != NULL)
+        return remote->Create(RemoteName(name), initialSize);
+
     Path path = DescribePath(name);
     ASSERT(path.dirSector >= 0);
     DEBUG(dbgFile, "Split path " << name << " into dir sector = " << path.dirSector << " and filename " << path.name << ".");
 
+    if (nameCache->Lookup(path.dirSector, path.name, &sector) && sector != -1)
+        return FALSE; // file is already in directory
+
+    kernel->journal->Begin();
+    dirInode = LockDirectory(path.dirSector, TRUE);
     directory = new Directory(NumDirEntries);
     if (path.dirSector == DirectorySector) {
         dirFile = directoryFile;
@@ -252,17 +357,24 @@ bool FileSystem::Create(char *name, int initialSize)
     if (directory->Find(path.name) != -1)
         success = FALSE; // file is already in directory
     else {
-        freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-        sector = freeMap->FindAndSet(); // find a sector to hold the file header
+        sector = freeMap->FindAndSet(path.dirSector); // find a sector to hold the file header,
+                                                      // in its directory's group
         if (sector == -1)
             success = FALSE; // no free block for file header
-        else if (!directory->Add(path.name, sector))
-            success = FALSE; // no space in directory
         else
         {
             hdr = new FileHeader;
-            if (!hdr->Allocate(freeMap, initialSize))
+            if (!hdr->Allocate(freeMap, initialSize, sector))
+            {
                 success = FALSE; // no space on disk for data
+                freeMap->Clear(sector);
+            }
+            else if (!directory->Add(path.name, sector, freeMap))
+            {
+                success = FALSE; // no space to grow the directory
+                hdr->Deallocate(freeMap);
+                freeMap->Clear(sector);
+            }
             else
             {
                 success = TRUE;
@@ -270,17 +382,61 @@ bool FileSystem::Create(char *name, int initialSize)
                 hdr->WriteBack(sector);
                 directory->WriteBack(dirFile);
                 freeMap->WriteBack(freeMapFile);
+                nameCache->Enter(path.dirSector, path.name, sector);
             }
             delete hdr;
         }
-        delete freeMap;
     }
     delete directory;
     if (dirFile != directoryFile) delete dirFile;
+    UnlockDirectory(dirInode, TRUE);
+    kernel->journal->End();
     return success;
 }
 
-// It will go thru every directory of the path, create one if it's not found.
+//----------------------------------------------------------------------
+// FileSystem::LockDirectory
+// 	Lock a directory, shared to look names up in it or exclusive to
+//	change it, and return its entry in the inode table, which holds
+//	the lock; UnlockDirectory gives both back.
+//
+//	"sector" -- the directory's header sector
+//	"exclusive" -- TRUE to hold the lock exclusive
+//----------------------------------------------------------------------
+
+Inode *FileSystem::LockDirectory(int sector, bool exclusive)
+{
+    Inode *inode = kernel->inodeTable->Get(sector);
+
+    if (exclusive)
+        inode->lock->AcquireWrite();
+    else
+        inode->lock->AcquireRead();
+    return inode;
+}
+
+void FileSystem::UnlockDirectory(Inode *inode, bool exclusive)
+{
+    if (exclusive)
+        inode->lock->ReleaseWrite();
+    else
+        inode->lock->ReleaseRead();
+    kernel->inodeTable->Put(inode);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::TraverseDirectory
+// 	Go through every directory of "path", creating the ones that are
+//	not found, and return the header sector of the last one.
+//
+//	Each step is looked up in the name cache first; a directory is
+//	only read from disk when the cache does not know the next name
+//	in it, holding the directory shared, or exclusive to add the
+//	next one.
+//
+//	"path" -- an absolute directory path, like "/t0/aa"
+//----------------------------------------------------------------------
+
 int FileSystem::TraverseDirectory(char *path)
 {
     char dirname[FileNameMaxLen + 1];
@@ -289,9 +445,10 @@ int FileSystem::TraverseDirectory(char *path)
     ASSERT(path[0] == '/'); // Invalid directory format
     
     int curr = 1, idx = 0;
+    kernel->journal->Begin(); // directories made on the way are one operation
     Directory *currDir = new Directory(NumDirEntries);
-    OpenFile *currDirFile = directoryFile;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    OpenFile *currDirFile;
+    int currSector = DirectorySector;
     int subdirSector;
     Directory emptyDir(NumDirEntries);  // Use an empty directory instance
                                         // as a template so that sectors of every
@@ -299,42 +456,64 @@ int FileSystem::TraverseDirectory(char *path)
 
     while (true) {
         if (path[curr] == '/' || path[curr] == '\0') {
-            if (dirname[0] == '\0' && path[curr] == '\0') { // Root directory
-                DEBUG(dbgFile, "The directory /" << dirname << " is root directory, which is in sector #" << subdirSector);
-                delete freeMap;
-                delete currDir; // Note that do not delete the currDirFile
-                                // Because in root dir, the curr dir is directoryFile in fileSystem
-                return DirectorySector;
+            if (dirname[0] == '\0' && path[curr] == '\0') { // Root directory, or trailing '/'
+                DEBUG(dbgFile, "The directory /" << dirname << " is in sector #" << currSector);
+                delete currDir;
+                kernel->journal->End();
+                return currSector;
             }
-            DEBUG(dbgFile, "Create directory /" << dirname);
-
-            currDir->FetchFrom(currDirFile);
-            subdirSector = currDir->Find(dirname);
-
-            // Subdir not found or corrupted (if invalid), must create one.
-            if (subdirSector == -1) { 
-                subdirSector = freeMap->FindAndSet(); // Find a sector to store dir header
-                ASSERT(subdirSector >= 0);
-
-                FileHeader *dirHdr = new FileHeader;
-                ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize));
 
-                freeMap->Mark(subdirSector);
-                currDir->Add(dirname, subdirSector, TRUE);
-
-                dirHdr->WriteBack(subdirSector);
-                currDir->WriteBack(currDirFile);
-                freeMap->WriteBack(freeMapFile);
-                DEBUG(dbgFile, "Create directory /" << dirname << " with data stored in sector #" << subdirSector);
-                
-                delete dirHdr;
-
-                currDirFile = new OpenFile(subdirSector); // Overwrite the subdir sector as an empty directory
-                emptyDir.WriteBack(currDirFile);
-            } else {
-                currDirFile = new OpenFile(subdirSector);
-                DEBUG(dbgFile, "Successfully find directory /" << dirname << " with data stored in sector #" << subdirSector);
+            if (!nameCache->Lookup(currSector, dirname, &subdirSector) || subdirSector == -1) {
+                bool exclusive = FALSE;
+                Inode *dirInode = LockDirectory(currSector, FALSE);
+
+                currDirFile = (currSector == DirectorySector) ? directoryFile
+                                                              : new OpenFile(currSector);
+                currDir->FetchFrom(currDirFile);
+                subdirSector = currDir->Find(dirname);
+                if (subdirSector == -1) {
+                    exclusive = TRUE;
+                    if (!dirInode->lock->Upgrade()) {
+                        // another thread is upgrading; it may add
+                        // the same name before we get the lock
+                        dirInode->lock->ReleaseRead();
+                        dirInode->lock->AcquireWrite();
+                        currDir->FetchFrom(currDirFile);
+                        subdirSector = currDir->Find(dirname);
+                    }
+                }
+
+                // Subdir not found or corrupted (if invalid), must create one.
+                if (subdirSector == -1) { 
+                    DEBUG(dbgFile, "Create directory /" << dirname);
+                    // Find a sector to store dir header, in the emptiest group
+                    subdirSector = freeMap->FindAndSet(freeMap->EmptiestGroup());
+                    ASSERT(subdirSector >= 0);
+
+                    FileHeader *dirHdr = new FileHeader;
+                    ASSERT(dirHdr->Allocate(freeMap, DirectoryFileSize, subdirSector));
+
+                    freeMap->Mark(subdirSector);
+                    ASSERT(currDir->Add(dirname, subdirSector, TRUE, freeMap));
+
+                    dirHdr->WriteBack(subdirSector);
+                    currDir->WriteBack(currDirFile);
+                    freeMap->WriteBack(freeMapFile);
+                    DEBUG(dbgFile, "Create directory /" << dirname << " with data stored in sector #" << subdirSector);
+                    
+                    delete dirHdr;
+
+                    OpenFile *subdirFile = new OpenFile(subdirSector); // Overwrite the subdir sector as an empty directory
+                    emptyDir.WriteBack(subdirFile);
+                    delete subdirFile;
+                } else {
+                    DEBUG(dbgFile, "Successfully find directory /" << dirname << " with data stored in sector #" << subdirSector);
+                }
+                nameCache->Enter(currSector, dirname, subdirSector);
+                if (currDirFile != directoryFile) delete currDirFile;
+                UnlockDirectory(dirInode, exclusive);
             }
+            currSector = subdirSector;
 
             // After creating / routing to the subdirectory,
             // the dirname should be reset.
@@ -349,9 +528,8 @@ int FileSystem::TraverseDirectory(char *path)
     }
 
     delete currDir;
-    delete currDirFile;
-    delete freeMap;
-    return subdirSector;
+    kernel->journal->End();
+    return currSector;
 }
 
 //----------------------------------------------------------------------
@@ -359,56 +537,697 @@ int FileSystem::TraverseDirectory(char *path)
 // 	Open a file for reading and writing.
 //	To open a file:
 //	  Find the location of the file's header, using the directory
+//	    (locked shared, if it is read)
 //	  Bring the header into memory
 //
+//	A remote file cannot be opened this way (see OpenAndStore).
+//
 //	"name" -- the text name of the file to be opened
 //----------------------------------------------------------------------
 
 OpenFile * FileSystem::Open(char *name)
 {
-    Directory *directory = new Directory(NumDirEntries);
-    OpenFile *dirFile;
+    if (RemoteName(name) != NULL)
+        return NULL;
+
     Path path = DescribePath(name);
+    int fileSector;
     ASSERT(path.dirSector >= 0);
 
-    dirFile = new OpenFile(path.dirSector);
-    directory->FetchFrom(dirFile);
+    if (!nameCache->Lookup(path.dirSector, path.name, &fileSector)) {
+        Inode *dirInode = LockDirectory(path.dirSector, FALSE);
+        Directory *directory = new Directory(NumDirEntries);
+        OpenFile *dirFile = new OpenFile(path.dirSector);
 
-    int fileSector = directory->Find(path.name);
+        directory->FetchFrom(dirFile);
+        fileSector = directory->Find(path.name);
+        nameCache->Enter(path.dirSector, path.name, fileSector);
+        delete directory;
+        delete dirFile;
+        UnlockDirectory(dirInode, FALSE);
+    }
     if (fileSector == -1) {
         DEBUG(dbgFile, "File " << name << " does not exist!");
         return NULL;
     }
 
     DEBUG(dbgFile, "Opening file " << path.name << " in sector #" << fileSector);
-    OpenFile *openFile = new OpenFile(fileSector); // name was found in directory
+    return new OpenFile(fileSector); // name was found in directory
+}
+
+//----------------------------------------------------------------------
+// FileSystem::OpenAndStore
+// 	Open a file for a user program, putting it in a free entry of the
+//	system-wide open file table, with one reference.  Return the
+//	entry, or -1 if the file does not exist or the table is full.
+//
+//	The entry is taken before the file is opened, which may wait for
+//	the disk, so that another program opening a file meanwhile does
+//	not pick the same one.  A file under the mount is looked up on
+//	the server, and its entry has no OpenFile.
+//
+//	"name" -- the text name of the file to be opened
+//----------------------------------------------------------------------
+
+int FileSystem::OpenAndStore(char *name)
+{
+    int fileIndex;
+
+    for (fileIndex = 0; fileIndex < MaxOpenFiles; fileIndex++)
+        if (openFileTable[fileIndex] == NULL && openFileRefs[fileIndex] == 0)
+            break;
+    if (fileIndex == MaxOpenFiles)
+        return -1; // too many open files
+
+    openFileRefs[fileIndex] = 1; // taken, though not usable yet
+    dirCursor[fileIndex] = -1;
+    if (RemoteName(name) != NULL)
+    {
+        remoteTable[fileIndex] = remote->Open(RemoteName(name));
+        if (remoteTable[fileIndex] == NULL)
+        {
+            openFileRefs[fileIndex] = 0;
+            return -1;
+        }
+        return fileIndex;
+    }
+    openFileTable[fileIndex] = Open(name);
+    if (openFileTable[fileIndex] == NULL)
+    {
+        int sector = FindDirectory(name);
+
+        if (sector == -1)
+        {
+            openFileRefs[fileIndex] = 0;
+            return -1; // Failed to open the file
+        }
+        openFileTable[fileIndex] = new OpenFile(sector);
+        dirCursor[fileIndex] = 0; // for ReadDir
+    }
+    return fileIndex;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::FindDirectory
+// 	Return the header sector of the directory "name", or -1 if there
+//	is no such directory.  Subdirectories are entered without the
+//	leading '/' that file names have (cf. TraverseDirectory).
+//
+//	"name" -- an absolute path, like "/t0/aa", or "/"
+//----------------------------------------------------------------------
+
+int FileSystem::FindDirectory(char *name)
+{
+    int sector;
+    bool isDirectory = TRUE;
+
+    if (strcmp(name, "/") == 0)
+        return DirectorySector;
+
+    Path path = DescribePath(name);
+    ASSERT(path.dirSector >= 0);
+    if (!nameCache->Lookup(path.dirSector, path.name + 1, &sector)) {
+        Inode *dirInode = LockDirectory(path.dirSector, FALSE);
+        Directory *directory = new Directory(NumDirEntries);
+        OpenFile *dirFile = new OpenFile(path.dirSector);
+
+        directory->FetchFrom(dirFile);
+        sector = directory->Find(path.name + 1, &isDirectory);
+        if (isDirectory)
+            nameCache->Enter(path.dirSector, path.name + 1, sector);
+        delete directory;
+        delete dirFile;
+        UnlockDirectory(dirInode, FALSE);
+    }
+    return isDirectory ? sector : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Read/Write
+// 	Read/write an open file table entry at its current position.
+//	Return the number of bytes transferred, or -1 if the entry is
+//	not in use.  A remote file is read or written by its server.
+//----------------------------------------------------------------------
+
+int FileSystem::Read(char *buf, int size, int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles)
+        return -1;
+    if (remoteTable[fileIndex] != NULL)
+        return remoteTable[fileIndex]->Read(buf, size);
+    if (openFileTable[fileIndex] == NULL)
+        return -1;
+    return openFileTable[fileIndex]->Read(buf, size);
+}
+
+int FileSystem::Write(char *buf, int size, int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles)
+        return -1;
+    if (remoteTable[fileIndex] != NULL)
+        return remoteTable[fileIndex]->Write(buf, size);
+    if (openFileTable[fileIndex] == NULL)
+        return -1;
+    return openFileTable[fileIndex]->Write(buf, size);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ReadAt/WriteAt
+// 	Read/write an open file table entry at byte "position", leaving
+//	its current position as it is.  Return the number of bytes
+//	transferred, or -1 if the entry is not in use.
+//----------------------------------------------------------------------
+
+int FileSystem::ReadAt(char *buf, int size, int position, int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles)
+        return -1;
+    if (remoteTable[fileIndex] != NULL)
+        return remoteTable[fileIndex]->ReadAt(buf, size, position);
+    if (openFileTable[fileIndex] == NULL)
+        return -1;
+    return openFileTable[fileIndex]->ReadAt(buf, size, position);
+}
+
+int FileSystem::WriteAt(char *buf, int size, int position, int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles)
+        return -1;
+    if (remoteTable[fileIndex] != NULL)
+        return remoteTable[fileIndex]->WriteAt(buf, size, position);
+    if (openFileTable[fileIndex] == NULL)
+        return -1;
+    return openFileTable[fileIndex]->WriteAt(buf, size, position);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Extend
+// 	Make an open file "numBytes" long, allocating the disk space for
+//	it, because something is being written past its end.  The free map
+//	is written back; the file header is, when the file is closed.  One
+//	journaled operation.  Return FALSE, leaving the file as it was, if
+//	the disk is full.
+//
+//	"file" -- the file to make longer
+//	"numBytes" -- its new length
+//----------------------------------------------------------------------
+
+bool FileSystem::Extend(OpenFile *file, int numBytes)
+{
+    bool extended;
+
+    kernel->journal->Begin();
+    extended = file->Extend(freeMap, numBytes);
+    if (extended)
+        freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    return extended;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Reserve
+// 	Allocate the disk space for an open file table entry's file to
+//	grow to "numBytes", without making it longer, so that a program
+//	about to append that much gets it in as few runs as possible, and
+//	no allocation on each write.  Return 1, or -1 if the entry is not
+//	in use or the disk is full.
+//----------------------------------------------------------------------
+
+int FileSystem::Reserve(int numBytes, int fileIndex)
+{
+    bool reserved;
+
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles || openFileTable[fileIndex] == NULL)
+        return -1;
+    kernel->journal->Begin();
+    reserved = openFileTable[fileIndex]->Reserve(freeMap, numBytes);
+    if (reserved)
+        freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    return reserved ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Unshare
+// 	Give an open file copies of its own of the data clusters it
+//	shares with clones, among those holding the "numBytes" bytes from
+//	"position" on, before they are written (see FileHeader::Unshare).
+//	Each cluster copied is one journaled operation.  Return FALSE if
+//	the disk is full; the clusters copied until then stay copied.
+//----------------------------------------------------------------------
+
+bool FileSystem::Unshare(OpenFile *file, int position, int numBytes)
+{
+    int clusterBytes = freeMap->ClusterSize() * SectorSize;
+    bool unshared = TRUE;
+
+    for (int at = divRoundDown(position, clusterBytes) * clusterBytes;
+         unshared && (at < position + numBytes); at += clusterBytes) {
+        kernel->journal->Begin();
+        unshared = file->Unshare(freeMap, at);
+        freeMap->WriteBack(freeMapFile);
+        kernel->journal->End();
+    }
+    return unshared;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Compress
+// 	Compress the file "name" in place, so that it takes fewer
+//	sectors; it reads back the same.  Return FALSE if it does not
+//	exist, is compressed already, does not shrink, or the disk is too
+//	full to hold both copies for a moment.
+//----------------------------------------------------------------------
+
+bool FileSystem::Compress(char *name)
+{
+    OpenFile *file = Open(name);
+    bool compressed;
+
+    if (file == NULL)
+        return FALSE;
+    compressed = !file->IsCompressed() && Repack(file, TRUE);
+    delete file;
+    DEBUG(dbgFile, "Compress " << name << (compressed ? "" : ": not compressed"));
+    return compressed;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Repack
+// 	Rewrite the whole of an open file, compressed in chunks (see
+//	FileHeader::Pack) if "compress", otherwise expanded back, for it
+//	to be written to.  The new copy is written to newly allocated
+//	sectors before the file is switched over to them, so that the
+//	file is never half rewritten:
+//
+//	    one operation allocates the sectors, in a header of their own
+//	    the data is written to them, unjournaled
+//	    another frees the old sectors, and hands the new to the file
+//
+//	A crash in between leaves the new sectors allocated to nobody;
+//	fsck -fsckr frees them.  Return FALSE, leaving the file as it
+//	was, if compressing saves nothing, or the disk is full.
+//----------------------------------------------------------------------
+
+bool FileSystem::Repack(OpenFile *file, bool compress)
+{
+    int length = file->Length();
+    int size = divRoundUp(length, SectorSize) * SectorSize;
+    char *data = new char[max(size, 1)];
+    char *image = data;
+    int imageBytes = length;
+    FileHeader *packed = new FileHeader;
+    bool allocated = FALSE;
+
+    memset(data, 0, size);
+    file->ReadAt(data, length, 0);
+    if (compress)
+        image = FileHeader::Pack(data, length, &imageBytes);
+    if (image != NULL) {
+        kernel->journal->Begin();
+        allocated = packed->Allocate(freeMap, imageBytes, file->HeaderSector());
+        if (allocated)
+            freeMap->WriteBack(freeMapFile);
+        kernel->journal->End();
+    }
+    if (allocated) {
+        packed->WriteData(image, imageBytes);
+        kernel->journal->Begin();
+        file->Replace(freeMap, packed, compress);
+        freeMap->WriteBack(freeMapFile);
+        kernel->journal->End();
+        if (compress) {
+            kernel->stats->numFilesCompressed++;
+            kernel->stats->numSectorsSaved += divRoundUp(length, SectorSize) -
+                divRoundUp(imageBytes, SectorSize);
+        }
+    }
+    if (image != data)
+        delete [] image;
+    delete [] data;
+    delete packed;
+    return allocated;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Duplicate
+// 	Add a reference to an open file table entry, for a descriptor
+//	copied into another program, which shares the file's position.
+//	Return the entry, or -1 if it is not in use.
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+// FileSystem::ReadDir
+// 	Pack the entries of an open directory into "buf", as DirEnts (cf.
+//	syscall.h), from where the last ReadDir of the entry stopped, for
+//	as many as fit.  The directory is locked shared meanwhile.  Return
+//	the number of bytes filled in, 0 at the end of the directory, or
+//	-1 if the entry is not a directory, or "buf" cannot hold even the
+//	next entry.
+//
+//	"buf" -- where to put the entries
+//	"size" -- how big "buf" is
+//	"fileIndex" -- the open file table entry of the directory
+//----------------------------------------------------------------------
+
+int FileSystem::ReadDir(char *buf, int size, int fileIndex)
+{
+    Directory *directory;
+    Inode *dirInode;
+    DirectoryEntry entry;
+    int next, filled = 0;
+
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles || openFileTable[fileIndex] == NULL ||
+        dirCursor[fileIndex] < 0)
+        return -1;
+
+    dirInode = LockDirectory(openFileTable[fileIndex]->HeaderSector(), FALSE);
+    directory = new Directory(NumDirEntries);
+    directory->FetchFrom(openFileTable[fileIndex]);
+    while ((next = directory->NextEntry(dirCursor[fileIndex], &entry)) != -1)
+    {
+        char *name = (entry.name[0] == '/') ? entry.name + 1 : entry.name;
+        int length = strnlen(name, FileNameMaxLen);
+        DirEnt *dirEnt = (DirEnt *)(buf + filled);
+
+        if (filled + DirEntSize(length) > size)
+            break; // no room for this one
+        memset(dirEnt, 0, DirEntSize(length));
+        dirEnt->length = DirEntSize(length);
+        dirEnt->isDirectory = entry.isSubdir ? 1 : 0;
+        memcpy(dirEnt->name, name, length);
+        filled += dirEnt->length;
+        dirCursor[fileIndex] = next;
+    }
     delete directory;
-    delete dirFile;
-    return openFile; // return NULL if not found
+    UnlockDirectory(dirInode, FALSE);
+
+    if (filled == 0 && next != -1)
+        return -1; // "buf" is too small for the next entry
+    return filled;
 }
 
-OpenFileId FileSystem::OpenAndStore(char *name) {
-    openedFile = Open(name);
-    if (openedFile == NULL) {
-        return 0; // Failed to open the file
+//----------------------------------------------------------------------
+// FileSystem::Stat
+// 	Describe the file or directory "name" in "stat", without opening
+//	it.  The name is looked up as Open and OpenAndStore do it, through
+//	the name cache first; only the header sector is read, if it is
+//	not in the inode table already.  Return FALSE if there is no such
+//	file or directory.
+//
+//	"name" -- the text name of the file or directory
+//	"stat" -- where to describe it
+//----------------------------------------------------------------------
+
+bool FileSystem::Stat(char *name, FileStat *stat)
+{
+    if (RemoteName(name) != NULL)
+    {
+        RemoteFile *file = remote->Open(RemoteName(name));
+
+        if (file == NULL)
+            return FALSE;
+        stat->size = file->Length();
+        stat->isDirectory = 0;
+        stat->numSectors = divRoundUp(stat->size, SectorSize);
+        delete file;
+        return TRUE;
+    }
+
+    Path path = DescribePath(name);
+    int sector;
+    bool isDirectory = FALSE;
+    ASSERT(path.dirSector >= 0);
+
+    if (!nameCache->Lookup(path.dirSector, path.name, &sector)) {
+        Inode *dirInode = LockDirectory(path.dirSector, FALSE);
+        Directory *directory = new Directory(NumDirEntries);
+        OpenFile *dirFile = new OpenFile(path.dirSector);
+
+        directory->FetchFrom(dirFile);
+        sector = directory->Find(path.name);
+        nameCache->Enter(path.dirSector, path.name, sector);
+        delete directory;
+        delete dirFile;
+        UnlockDirectory(dirInode, FALSE);
+    }
+    if (sector == -1) {
+        sector = FindDirectory(name);
+        if (sector == -1)
+            return FALSE;
+        isDirectory = TRUE;
+    }
+    StatSector(sector, isDirectory, stat);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Fstat
+// 	Describe the file or directory of an open file table entry in
+//	"stat".  Return FALSE if the entry is not in use.
+//----------------------------------------------------------------------
+
+bool FileSystem::Fstat(int fileIndex, FileStat *stat)
+{
+    if (fileIndex >= 0 && fileIndex < MaxOpenFiles && remoteTable[fileIndex] != NULL)
+    {
+        stat->size = remoteTable[fileIndex]->Length();
+        stat->isDirectory = 0;
+        stat->numSectors = divRoundUp(stat->size, SectorSize);
+        return stat->size >= 0;
+    }
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles || openFileTable[fileIndex] == NULL)
+        return FALSE;
+    StatSector(openFileTable[fileIndex]->HeaderSector(), dirCursor[fileIndex] >= 0, stat);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::StatSector
+// 	Fill in "stat" from the header in "sector", through the inode
+//	table.  Its index is not read.  Bytes appended to an open file
+//	and still kept in memory count in its size, as in OpenFile::Length.
+//----------------------------------------------------------------------
+
+void FileSystem::StatSector(int sector, bool isDirectory, FileStat *stat)
+{
+    Inode *inode = kernel->inodeTable->Get(sector);
+
+    inode->hdrLock->Acquire();
+    stat->size = inode->hdr->FileLength() + inode->numDelayed;
+    stat->isDirectory = isDirectory ? 1 : 0;
+    stat->numSectors = inode->hdr->DataSectors();
+    inode->hdrLock->Release();
+    kernel->inodeTable->Put(inode);
+}
+
+int FileSystem::Duplicate(int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles ||
+        (openFileTable[fileIndex] == NULL && remoteTable[fileIndex] == NULL))
+        return -1;
+    openFileRefs[fileIndex]++;
+    return fileIndex;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Close
+// 	Drop one reference to an open file table entry; the file is closed
+//	when the last one goes.  Return 1, or -1 if the entry is not in use.
+//----------------------------------------------------------------------
+
+int FileSystem::Close(int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles ||
+        (openFileTable[fileIndex] == NULL && remoteTable[fileIndex] == NULL))
+        return -1;
+    if (--openFileRefs[fileIndex] == 0)
+    {
+        delete openFileTable[fileIndex];
+        openFileTable[fileIndex] = NULL;
+        delete remoteTable[fileIndex];
+        remoteTable[fileIndex] = NULL;
     }
     return 1;
 }
 
-int FileSystem::Read(char *buf, int size, OpenFileId id) {
-    return openedFile->Read(buf, size);
+//----------------------------------------------------------------------
+// FileSystem::Unmount
+// 	Nachos is halting: put everything on disk, empty the journal's
+//	log, and mark the superblock clean, so that the next mount can
+//	skip recovery.
+//----------------------------------------------------------------------
+
+void FileSystem::Unmount()
+{
+    WriteDelayed();
+    kernel->journal->Checkpoint();
+    if (hasSuper)
+        WriteSuper(TRUE);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Mount
+// 	Mount another machine's file system under RemoteMountPoint: from
+//	now on, names there are looked up on it, and the files opened are
+//	read and written through it (see remotefs.h).  Only files can be
+//	created, opened, removed and described there.
+//
+//	"remote" -- the client for it; the file system owns it now
+//----------------------------------------------------------------------
+
+void FileSystem::Mount(RemoteFileSystem *remote)
+{
+    ASSERT(this->remote == NULL);
+    this->remote = remote;
 }
 
-int FileSystem::Write(char *buf, int size, OpenFileId id) {
-    return openedFile->Write(buf, size);
+//----------------------------------------------------------------------
+// FileSystem::RemoteName
+// 	Return the name a file under the mount has on the server, or NULL
+//	if "name" is not under it, or nothing is mounted.
+//----------------------------------------------------------------------
+
+char *FileSystem::RemoteName(char *name)
+{
+    int length = strlen(RemoteMountPoint);
+
+    if ((remote == NULL) || (strncmp(name, RemoteMountPoint, length) != 0) ||
+        (name[length] != '/'))
+        return NULL;
+    return name + length;
 }
 
-int FileSystem::Close(OpenFileId id) {
-    openedFile = NULL;
+//----------------------------------------------------------------------
+// FileSystem::ReadSuper
+// 	Read the superblock into "super".  Return FALSE if the disk has
+//	none, having been formatted before there was one; sector
+//	SuperSector is then just one of its sectors.  A superblock for
+//	another layout of the disk cannot be mounted.
+//----------------------------------------------------------------------
+
+bool FileSystem::ReadSuper(SuperBlock *super)
+{
+    char buf[SectorSize];
+
+    kernel->bufferCache->ReadSector(SuperSector, buf);
+    bcopy(buf, super, sizeof(SuperBlock));
+    if (super->magic != SuperMagic)
+    {
+        DEBUG(dbgFile, "No superblock on disk.");
+        return FALSE;
+    }
+    ASSERT(super->version == FileSystemVersion);
+    ASSERT(super->numSectors == NumSectors);
+    ASSERT(super->journalStart == JournalStart &&
+           super->journalSectors == JournalSectors);
+    ASSERT(super->numGroups <= NumAllocGroups);
+    DEBUG(dbgFile, "Superblock: " << (super->clean ? "clean" : "not clean")
+                                  << ", " << super->numFree << " sectors free");
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteSuper
+// 	Write the superblock straight to disk, and wait until it is on the
+//	platter.  When "clean", everything else must be on disk already,
+//	and the journal's log empty.
+//----------------------------------------------------------------------
+
+void FileSystem::WriteSuper(bool clean)
+{
+    char buf[SectorSize];
+    SuperBlock *super = (SuperBlock *)buf;
+
+    bzero(buf, SectorSize);
+    super->magic = SuperMagic;
+    super->version = FileSystemVersion;
+    super->clean = clean;
+    super->numSectors = NumSectors;
+    super->journalStart = JournalStart;
+    super->journalSectors = JournalSectors;
+    super->journalSeq = kernel->journal->NextSeq();
+    super->numFree = freeMap->NumClear();
+    super->numGroups = freeMap->NumGroups();
+    for (int g = 0; g < super->numGroups; g++)
+        super->groupFree[g] = freeMap->GroupFree(g);
+    kernel->bufferCache->WriteThrough(SuperSector, 1, buf);
+    kernel->bufferCache->Flush(); // the checksums, if there are any
+    kernel->synchDisk->FlushCache();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::WriteDelayed
+// 	Give every open file's appends still kept in memory their disk
+//	space, and write them (see OpenFile::Delay).  Done as Nachos
+//	halts, for the files nobody closed.
+//----------------------------------------------------------------------
+
+void FileSystem::WriteDelayed()
+{
+    for (int i = 0; i < MaxOpenFiles; i++)
+        if (openFileTable[i] != NULL)
+            openFileTable[i]->WriteDelayed();
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Fsync
+// 	Make an open file table entry's file durable: write its data home
+//	first, then commit the journal, which holds its metadata, and
+//	flush the disk's write cache.  The writes of a remote file already
+//	went through to its server.  Return 1, or -1 if the entry is not
+//	in use.
+//----------------------------------------------------------------------
+
+int FileSystem::Fsync(int fileIndex)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles ||
+        (openFileTable[fileIndex] == NULL && remoteTable[fileIndex] == NULL))
+        return -1;
+    if (openFileTable[fileIndex] != NULL)
+    {
+        openFileTable[fileIndex]->Flush();
+        kernel->journal->Force();
+        kernel->synchDisk->FlushCache();
+    }
+    kernel->stats->numSyncs++;
     return 1;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Advise
+// 	Pass a hint about how an open file table entry's file will be
+//	used on to the file (see OpenFile::Advise).  A remote file takes
+//	no hints.  Return 1, or -1 if the entry is not in use or the hint
+//	is not understood.
+//----------------------------------------------------------------------
 
+int FileSystem::Advise(int fileIndex, int offset, int length, int hint)
+{
+    if (fileIndex < 0 || fileIndex >= MaxOpenFiles ||
+        (openFileTable[fileIndex] == NULL && remoteTable[fileIndex] == NULL))
+        return -1;
+    if (openFileTable[fileIndex] == NULL)
+        return 1;
+    return openFileTable[fileIndex]->Advise(offset, length, hint) ? 1 : -1;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Sync
+// 	Make everything done so far durable: write out what the open files
+//	have appended, commit the journal, write every dirty buffer home
+//	and flush the disk's write cache.  Unlike Unmount, the log is not
+//	emptied.
+//----------------------------------------------------------------------
+
+void FileSystem::Sync()
+{
+    WriteDelayed();
+    kernel->journal->Force();
+    kernel->bufferCache->Flush();
+    kernel->synchDisk->FlushCache();
+    kernel->stats->numSyncs++;
+}
 
 //----------------------------------------------------------------------
 // FileSystem::Remove
@@ -417,45 +1236,351 @@ int FileSystem::Close(OpenFileId id) {
 //	    Delete the space for its header
 //	    Delete the space for its data blocks
 //	    Write changes to directory, bitmap back to disk
+//	all with the directory locked exclusive.
+//
+//	A directory is only removed if "recursive", along with everything
+//	under it.  However many files that is, they are all freed in the
+//	in-core free map, and the free map and the parent directory are
+//	written back once, at the end, as one journaled operation.
 //
 //	Return TRUE if the file was deleted, FALSE if the file wasn't
-//	in the file system.
+//	in the file system, or is a directory and not "recursive".
 //
 //	"name" -- the text name of the file to be removed
+//	"recursive" -- TRUE to remove a directory and all under it
 //----------------------------------------------------------------------
 
-bool FileSystem::Remove(char *name)
+bool FileSystem::Remove(char *name, bool recursive)
 {
     Directory *directory;
-    PersistentBitmap *freeMap;
-    FileHeader *fileHdr;
+    Inode *dirInode;
+    OpenFile *dirFile;
     int sector;
+    bool isDirectory;
+
+    if (RemoteName(name) != NULL)
+        return remote->Remove(RemoteName(name));
 
+    Path path = DescribePath(name);
+    ASSERT(path.dirSector >= 0);
+    char *entryName = path.name;
+
+    kernel->journal->Begin();
+    dirInode = LockDirectory(path.dirSector, TRUE);
     directory = new Directory(NumDirEntries);
-    directory->FetchFrom(directoryFile);
-    sector = directory->Find(name);
-    if (sector == -1)
+    if (path.dirSector == DirectorySector) {
+        dirFile = directoryFile;
+    } else {
+        dirFile = new OpenFile(path.dirSector);
+    }
+    directory->FetchFrom(dirFile);
+    sector = directory->Find(entryName, &isDirectory);
+    if (sector == -1 && recursive)
+    {   // directories are entered without the leading '/'
+        entryName = path.name + 1;
+        sector = directory->Find(entryName, &isDirectory);
+    }
+    if (sector == -1 || (isDirectory && !recursive))
     {
         delete directory;
-        return FALSE; // file not found
+        if (dirFile != directoryFile) delete dirFile;
+        UnlockDirectory(dirInode, TRUE);
+        kernel->journal->End();
+        return FALSE; // file not found, or a directory
     }
-    fileHdr = new FileHeader;
-    fileHdr->FetchFrom(sector);
-
-    freeMap = new PersistentBitmap(freeMapFile, NumSectors);
 
-    fileHdr->Deallocate(freeMap); // remove data blocks
-    freeMap->Clear(sector);       // remove header block
-    directory->Remove(name);
+    RemoveTree(sector, isDirectory);
+    directory->Remove(entryName);
+    nameCache->Enter(path.dirSector, entryName, -1);
 
     freeMap->WriteBack(freeMapFile);     // flush to disk
-    directory->WriteBack(directoryFile); // flush to disk
-    delete fileHdr;
+    directory->WriteBack(dirFile);       // flush to disk
     delete directory;
-    delete freeMap;
+    if (dirFile != directoryFile) delete dirFile;
+    UnlockDirectory(dirInode, TRUE);
+    kernel->journal->End();
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Rename
+// 	Give a file, or a directory, another name, possibly in another
+//	directory.  Only the directory entries change -- a record in each
+//	of the two directories -- and the file's header and data stay
+//	where they are.  If "to" already names a file, its entry is
+//	pointed at the file being renamed, in place, and the old file is
+//	then removed; the whole is one journaled operation, so anyone
+//	looking "to" up finds either the old file or the new one, even
+//	after a crash.  This is how a file is written under a temporary
+//	name and then published.
+//
+//	The two directories are locked exclusive, the one whose header
+//	has the lower sector first, so that two renames in opposite
+//	directions cannot deadlock.
+//
+//	Return TRUE if the file was renamed; FALSE if "from" doesn't
+//	exist, "to" is a directory, a directory would replace a file or
+//	move under itself, or "to"'s directory has no room to grow.
+//
+//	"from" -- the current name of the file or directory
+//	"to" -- its new name; directories on the way are made, as for
+//		Create
+//----------------------------------------------------------------------
+
+bool FileSystem::Rename(char *from, char *to)
+{
+    int fromLength = strlen(from);
+    Directory *fromDir, *toDir;
+    OpenFile *fromFile, *toFile;
+    Inode *firstInode, *secondInode = NULL;
+    char *fromName, *toName;
+    int sector, oldSector;
+    bool isDirectory, oldIsDirectory;
+    bool success = TRUE;
+
+    if ((strncmp(to, from, fromLength) == 0) && (to[fromLength] == '/'))
+        return FALSE; // would be under itself
+    if ((RemoteName(from) != NULL) || (RemoteName(to) != NULL))
+        return FALSE; // not across machines, nor on another
+
+    Path fromPath = DescribePath(from);
+    Path toPath = DescribePath(to);
+    ASSERT(fromPath.dirSector >= 0 && toPath.dirSector >= 0);
+
+    kernel->journal->Begin();
+    firstInode = LockDirectory(min(fromPath.dirSector, toPath.dirSector), TRUE);
+    if (fromPath.dirSector != toPath.dirSector)
+        secondInode = LockDirectory(max(fromPath.dirSector, toPath.dirSector), TRUE);
+
+    fromDir = new Directory(NumDirEntries);
+    fromFile = (fromPath.dirSector == DirectorySector) ? directoryFile
+                                                       : new OpenFile(fromPath.dirSector);
+    fromDir->FetchFrom(fromFile);
+    if (fromPath.dirSector == toPath.dirSector)
+    {
+        toDir = fromDir;
+        toFile = fromFile;
+    }
+    else
+    {
+        toDir = new Directory(NumDirEntries);
+        toFile = (toPath.dirSector == DirectorySector) ? directoryFile
+                                                       : new OpenFile(toPath.dirSector);
+        toDir->FetchFrom(toFile);
+    }
+
+    fromName = fromPath.name;
+    sector = fromDir->Find(fromName, &isDirectory);
+    if (sector == -1)
+    {   // directories are entered without the leading '/'
+        fromName = fromPath.name + 1;
+        sector = fromDir->Find(fromName, &isDirectory);
+    }
+    toName = isDirectory ? toPath.name + 1 : toPath.name;
+    oldSector = (sector == -1) ? -1 : toDir->Find(toName, &oldIsDirectory);
+
+    if (sector == -1)
+        success = FALSE; // nothing to rename
+    else if (oldSector == sector)
+        success = TRUE; // renamed to itself
+    else if (oldSector != -1)
+    {
+        if (isDirectory || oldIsDirectory)
+            success = FALSE;
+        else
+        {
+            toDir->Replace(toName, sector);
+            fromDir->Remove(fromName);
+            RemoveTree(oldSector, FALSE);
+        }
+    }
+    else if (toDir->Add(toName, sector, isDirectory, freeMap))
+        fromDir->Remove(fromName);
+    else
+        success = FALSE; // no room to grow the directory
+
+    if (success && (oldSector != sector))
+    {
+        DEBUG(dbgFile, "Renamed " << from << " to " << to);
+        nameCache->Enter(fromPath.dirSector, fromName, -1);
+        nameCache->Enter(toPath.dirSector, toName, sector);
+        freeMap->WriteBack(freeMapFile); // if a directory grew, or
+                                         // a file was replaced
+        toDir->WriteBack(toFile);
+        if (fromDir != toDir)
+            fromDir->WriteBack(fromFile);
+    }
+
+    if (toDir != fromDir)
+    {
+        delete toDir;
+        if (toFile != directoryFile) delete toFile;
+    }
+    delete fromDir;
+    if (fromFile != directoryFile) delete fromFile;
+    if (secondInode != NULL)
+        UnlockDirectory(secondInode, TRUE);
+    UnlockDirectory(firstInode, TRUE);
+    kernel->journal->End();
+    return success;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::Clone
+// 	Make "to" a copy-on-write clone of the file or directory "from".
+//	A file's clone shares its data clusters (see FileHeader::Share)
+//	until one of the two writes to them, so only a header and any
+//	index sectors are written, however long it is.  A directory is
+//	made anew, and everything in it cloned into it in turn.  Each file
+//	is cloned as one journaled operation.
+//
+//	Return TRUE if everything was cloned; FALSE if "from" does not
+//	exist, "to" does, "to" would be under "from", or a file could not
+//	be cloned -- the disk is full, was formatted without room for
+//	share counts, or a cluster already has MaxShares clones.  What was
+//	cloned before then is kept.
+//
+//	"from" -- the file or directory to clone
+//	"to" -- the name of the clone; directories on the way are made,
+//		as for Create
+//----------------------------------------------------------------------
+
+bool FileSystem::Clone(char *from, char *to)
+{
+    int fromLength = strlen(from);
+    OpenFile *existing;
+    int sector;
+
+    if ((strncmp(to, from, fromLength) == 0) &&
+        ((to[fromLength] == '/') || (to[fromLength] == '\0')))
+        return FALSE; // would be under itself, or is itself
+    if ((strcmp(from, "/") == 0) || (RemoteName(from) != NULL) ||
+        (RemoteName(to) != NULL))
+        return FALSE;
+    existing = Open(to);
+    if ((existing != NULL) || (FindDirectory(to) != -1))
+    {
+        delete existing;
+        return FALSE; // "to" is taken
+    }
+    sector = FindDirectory(from);
+    if (sector != -1)
+        return CloneDirectory(sector, from, to);
+    return CloneFile(from, to);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CloneFile
+// 	Clone the file "from" as "to", which does not exist yet: create
+//	it empty, then share the data of "from" with it, as one journaled
+//	operation.  Return FALSE, leaving no "to", if that cannot be done.
+//----------------------------------------------------------------------
+
+bool FileSystem::CloneFile(char *from, char *to)
+{
+    OpenFile *source = Open(from);
+    OpenFile *copy;
+    bool cloned = FALSE;
+
+    if (source == NULL)
+        return FALSE;
+    kernel->journal->Begin();
+    if (Create(to, 0))
+    {
+        copy = Open(to);
+        cloned = copy->Share(freeMap, source);
+        delete copy;
+        if (cloned)
+        {
+            freeMap->WriteBack(freeMapFile);
+            kernel->stats->numFilesCloned++;
+        }
+        else
+            Remove(to);
+    }
+    kernel->journal->End();
+    delete source;
+    DEBUG(dbgFile, "Clone " << from << " to " << to << (cloned ? "" : ": failed"));
+    return cloned;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::CloneDirectory
+// 	Clone the directory "from", whose header is at "sector", as "to":
+//	make "to", then clone each file and directory in "from" into it.
+//	"from" is only held shared while its entries are read; what is
+//	added to it later may or may not be cloned.  Stop at the first
+//	one that cannot be, returning FALSE.
+//----------------------------------------------------------------------
+
+bool FileSystem::CloneDirectory(int sector, char *from, char *to)
+{
+    Inode *dirInode = LockDirectory(sector, FALSE);
+    OpenFile *dirFile = new OpenFile(sector);
+    Directory *directory = new Directory(NumDirEntries);
+    char *fromPath = new char[strlen(from) + FileNameMaxLen + 2];
+    char *toPath = new char[strlen(to) + FileNameMaxLen + 2];
+    DirectoryEntry entry;
+    bool cloned = TRUE;
+    int next = 0;
+
+    directory->FetchFrom(dirFile);
+    delete dirFile;
+    UnlockDirectory(dirInode, FALSE);
+
+    (void) TraverseDirectory(to);
+    while (cloned && (next = directory->NextEntry(next, &entry)) != -1)
+    {
+        char *name = entry.isSubdir ? entry.name : entry.name + 1;
+
+        sprintf(fromPath, "%s/%s", from, name);
+        sprintf(toPath, "%s/%s", to, name);
+        cloned = Clone(fromPath, toPath);
+    }
+    delete [] fromPath;
+    delete [] toPath;
+    delete directory;
+    return cloned;
+}
+
+//----------------------------------------------------------------------
+// FileSystem::RemoveTree
+// 	Free the header and data of a file in the in-core free map, and
+//	drop them from the caches.  For a directory, first free everything
+//	under it, post-order, with it locked exclusive.  Nothing is written
+//	back here: that is left to Remove, once the whole tree is freed.
+//
+//	"sector" -- where the file header is
+//	"isDirectory" -- TRUE if the file is a directory
+//----------------------------------------------------------------------
+
+void FileSystem::RemoveTree(int sector, bool isDirectory)
+{
+    Inode *inode;
+
+    if (isDirectory)
+    {
+        Inode *dirInode = LockDirectory(sector, TRUE);
+        OpenFile *file = new OpenFile(sector);
+        Directory *directory = new Directory(NumDirEntries);
+
+        directory->FetchFrom(file);
+        directory->RemoveAll(this);
+        delete directory;
+        delete file;
+        UnlockDirectory(dirInode, TRUE);
+        nameCache->Purge(sector);
+    }
+
+    kernel->execCache->Invalidate(sector); // while its data is there
+    inode = kernel->inodeTable->Get(sector);
+    inode->hdr->Deallocate(freeMap); // remove data blocks
+    kernel->bufferCache->Discard(sector, 1);
+    freeMap->Clear(sector);          // remove header block
+    kernel->inodeTable->Forget(sector);
+    kernel->inodeTable->Put(inode);
+}
+
 //----------------------------------------------------------------------
 // FileSystem::List
 // 	List all the files in the file system directory.
@@ -470,13 +1595,124 @@ void FileSystem::List()
     delete directory;
 }
 
-void FileSystem::ListRecursively() {
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
-    Directory *directory = new Directory(NumDirEntries);
+//----------------------------------------------------------------------
+// MatchName
+// 	Return TRUE if "name" matches "pattern", in which '*' stands for
+//	any run of characters and '?' for any one.
+//----------------------------------------------------------------------
 
-    directory->FetchFrom(directoryFile);
-    directory->ListRecursively(freeMap, 0);
-    delete directory;
+static bool MatchName(char *pattern, char *name)
+{
+    if (*pattern == '\0')
+        return *name == '\0';
+    if (*pattern == '*')
+        return MatchName(pattern + 1, name) ||
+               ((*name != '\0') && MatchName(pattern, name + 1));
+    if ((*name == '\0') || ((*pattern != '?') && (*pattern != *name)))
+        return FALSE;
+    return MatchName(pattern + 1, name + 1);
+}
+
+//----------------------------------------------------------------------
+// ListLine
+// 	Add a line of a listing to "out", which holds "*used" bytes,
+//	printing what it holds first if there is no room for it.
+//----------------------------------------------------------------------
+
+static void ListLine(char *out, int *used, int depth, const char *kind,
+                     char *name)
+{
+    if (*used + MaxListDepth + FileNameMaxLen + 8 > ListBufferSize)
+    {
+        fwrite(out, 1, *used, stdout);
+        *used = 0;
+    }
+    for (int i = 0; i < depth; i++)
+        out[(*used)++] = '\t';
+    *used += sprintf(out + *used, "%s %s\n", kind, name);
+}
+
+//----------------------------------------------------------------------
+// FileSystem::ListRecursively
+// 	List every file under the directory "name", each directory
+//	followed by what is in it, indented.  The walk keeps a stack of
+//	the directories open on the way down, each with where it is in
+//	it, instead of recursing.
+//
+//	Each directory opened is prefetched whole (see
+//	Directory::Prefetch): its table, and the headers and tables of its
+//	subdirectories, so the disk reads a level at a time, rather than a
+//	sector at a time as the walk steps in.  The table of each
+//	directory on the stack is kept in memory.  The listing is
+//	gathered in a buffer and printed ListBufferSize bytes at a time.
+//
+//	"name" -- the directory to list; "/" for the whole file system
+//	"maxDepth" -- how many levels of subdirectories to open under it;
+//		-1 for all.  Deeper than MaxListDepth, directories are
+//		listed but never opened.
+//	"filter" -- list only the files whose names match this (see
+//		MatchName); NULL for all.  Directories are always listed.
+//----------------------------------------------------------------------
+
+void FileSystem::ListRecursively(char *name, int maxDepth, char *filter)
+{
+    struct {
+        OpenFile *file;
+        Directory *directory;
+        int next; // where to look next (cf. Directory::NextEntry)
+    } stack[MaxListDepth];
+    DirectoryEntry entry;
+    char *out = new char[ListBufferSize];
+    int used = 0, depth = 0;
+    int sector = FindDirectory(name); // through the name cache
+
+    if (sector < 0)
+    {
+        printf("%s is not a directory\n", name);
+        delete[] out;
+        return;
+    }
+    if ((maxDepth < 0) || (maxDepth >= MaxListDepth))
+        maxDepth = MaxListDepth - 1;
+
+    stack[0].file = (sector == DirectorySector) ? directoryFile
+                                                : new OpenFile(sector);
+    stack[0].directory = new Directory(NumDirEntries);
+    stack[0].directory->FetchFrom(stack[0].file);
+    stack[0].directory->Prefetch();
+    stack[0].next = 0;
+    while (depth >= 0)
+    {
+        int next = stack[depth].directory->NextEntry(stack[depth].next, &entry);
+
+        if (next == -1)
+        { // done with this directory
+            delete stack[depth].directory;
+            if (stack[depth].file != directoryFile)
+                delete stack[depth].file;
+            depth--;
+            continue;
+        }
+        stack[depth].next = next;
+
+        if (!entry.isSubdir)
+        {
+            if ((filter == NULL) || MatchName(filter, entry.name + 1))
+                ListLine(out, &used, depth, "[F]", entry.name + 1);
+            continue;
+        }
+        ListLine(out, &used, depth, "[D]", entry.name);
+        if (depth == maxDepth)
+            continue; // too deep to open
+        depth++;
+        stack[depth].file = new OpenFile(entry.sector);
+        stack[depth].directory = new Directory(NumDirEntries);
+        stack[depth].directory->FetchFrom(stack[depth].file);
+        stack[depth].directory->Prefetch();
+        stack[depth].next = 0;
+    }
+    fwrite(out, 1, used, stdout);
+    delete[] out;
 }
 
 //----------------------------------------------------------------------
@@ -491,28 +1727,49 @@ void FileSystem::ListRecursively() {
 
 void FileSystem::Print()
 {
-    FileHeader *bitHdr = new FileHeader;
-    FileHeader *dirHdr = new FileHeader;
-    PersistentBitmap *freeMap = new PersistentBitmap(freeMapFile, NumSectors);
+    Inode *bitInode = kernel->inodeTable->Get(FreeMapSector);
+    Inode *dirInode = kernel->inodeTable->Get(DirectorySector);
     Directory *directory = new Directory(NumDirEntries);
 
     printf("Bit map file header:\n");
-    bitHdr->FetchFrom(FreeMapSector);
-    bitHdr->Print();
+    bitInode->hdr->Print();
 
     printf("Directory file header:\n");
-    dirHdr->FetchFrom(DirectorySector);
-    dirHdr->Print();
+    dirInode->hdr->Print();
 
     freeMap->Print();
 
     directory->FetchFrom(directoryFile);
     directory->Print();
 
-    delete bitHdr;
-    delete dirHdr;
-    delete freeMap;
+    kernel->inodeTable->Put(bitInode);
+    kernel->inodeTable->Put(dirInode);
     delete directory;
 }
 
+//----------------------------------------------------------------------
+// FileSystem::Check
+// 	Check that the free map marks exactly the sectors that the files
+//	and directories use.  If "repair", fix the free map, as one
+//	journaled operation.  Return the number of problems found.
+//
+//	"repair" -- TRUE if the free map should be fixed
+//----------------------------------------------------------------------
+
+int FileSystem::Check(bool repair)
+{
+    FileSystemCheck *check = new FileSystemCheck(freeMap, hasSuper);
+    int problems;
+
+    kernel->journal->Begin();
+    check->CheckFile(FreeMapSector, FALSE, "(free map)");
+    check->CheckFile(DirectorySector, TRUE, "/");
+    problems = check->Finish(repair);
+    if (repair && (problems > 0))
+        freeMap->WriteBack(freeMapFile);
+    kernel->journal->End();
+    delete check;
+    return problems;
+}
+
 #endif // FILESYS_STUB
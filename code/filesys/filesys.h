@@ -37,9 +37,12 @@
 #include "sysdep.h"
 #include "openfile.h"
 #include "directory.h"
+#include "pbitmap.h"
 
 typedef int OpenFileId;
 
+#define MaxOpenFiles 20 // files open at once, in all programs together
+
 typedef struct {
 	int dirSector;
 	char name[FileNameMaxLen];
@@ -78,10 +81,46 @@ public:
 
 	bool Remove(char *name) { return Unlink(name) == 0; }
 
+	bool Rename(char *from, char *to) { return RenameFile(from, to); }
+
 	OpenFile *fileDescriptorTable[20];
 };
 
 #else // FILESYS
+class NameCache;
+class Inode;
+struct FileStat;
+class RemoteFileSystem;
+class RemoteFile;
+
+// Sector of the superblock, after the headers of the free map and of
+// the root directory.
+#define SuperSector 2
+
+// The superblock describes the file system as a whole.  It is read
+// once when the disk is mounted, and written when it is unmounted,
+// marked clean, with the journal's next transaction and the clear
+// bits in each group of the free map: a disk unmounted cleanly needs
+// neither its log replayed nor its free map counted.  Once mounted it
+// is marked not clean at once, so that a crash is noticed next time.
+// Disks formatted before there was one have none, and are mounted as
+// they always were.
+
+class SuperBlock
+{
+public:
+	int magic;
+	int version;			// of the layout of the disk
+	int clean;				// unmounted cleanly
+	int numSectors;
+	int journalStart;		// where the journal's log is
+	int journalSectors;
+	int journalSeq;			// its next transaction, if clean
+	int numFree;			// clear bits in the free map
+	int numGroups;			// and in each of its groups
+	int groupFree[NumAllocGroups];
+};
+
 class FileSystem
 {
 public:
@@ -103,29 +142,135 @@ public:
 
 	OpenFile *Open(char *name); // Open a file (UNIX open)
 
-	OpenFileId OpenAndStore(char *name);
+	int OpenAndStore(char *name); // Open a file into the open file
+								  // table; return its entry, or -1
+
+	int Read(char *buf, int size, int fileIndex); // Use an open file
+	int Write(char *buf, int size, int fileIndex); // table entry
+	int ReadAt(char *buf, int size, int position, int fileIndex);
+	int WriteAt(char *buf, int size, int position, int fileIndex);
+					// at "position", not moving its seek
+					// position
+
+	bool Extend(OpenFile *file, int numBytes); // Make an open file
+					// "numBytes" long, for a write past
+					// its end; FALSE if the disk is full
+	int Reserve(int numBytes, int fileIndex); // Allocate room for an
+					// entry's file to grow to "numBytes"
+
+	bool Unshare(OpenFile *file, int position, int numBytes);
+					// Copy the data clusters an open file
+					// shares with clones, that a write is
+					// about to change; FALSE if the disk
+					// is full
+
+	bool Compress(char *name); // Keep a file compressed
+	bool Repack(OpenFile *file, bool compress); // Compress an open
+					// file, or expand it back; FALSE if
+					// it does not shrink, or the disk is
+					// full
+
+	int ReadDir(char *buf, int size, int fileIndex); // Pack the next
+					// entries of an entry's directory
+					// into "buf" (cf. DirEnt in syscall.h)
 
-	int Read(char *buf, int size, OpenFileId id);
+	bool Stat(char *name, FileStat *stat); // Describe a file or
+	bool Fstat(int fileIndex, FileStat *stat); // directory, by its
+					// name or an entry (cf. FileStat in
+					// syscall.h); FALSE if there is none
 
-	int Write(char *buf, int size, OpenFileId id);
+	int Duplicate(int fileIndex); // Add a reference to an entry
 
-	int Close(OpenFileId id);
+	int Close(int fileIndex); // Drop a reference to an entry
 
-	bool Remove(char *name); // Delete a file (UNIX unlink)
+	void WriteDelayed(); // Write out what the open files have
+					// appended and kept in memory
+
+	int Fsync(int fileIndex); // Put an entry's file on disk, data
+					// and metadata; 1, or -1 if the entry
+					// is not in use
+	void Sync();	// Put everything changed so far on disk
+
+	int Advise(int fileIndex, int offset, int length, int hint);
+					// Say how an entry's file will be used
+					// (cf. Fadvise in syscall.h)
+
+	bool Remove(char *name, bool recursive = FALSE);
+					// Delete a file (UNIX unlink), or
+					// a directory and all under it (rm -r)
+
+	bool Rename(char *from, char *to); // Move a file or directory
+					// to another name, replacing any
+					// file already there (UNIX rename)
+
+	bool Clone(char *from, char *to); // Copy a file or directory,
+					// sharing the data until it is
+					// written
+
+	void RemoveTree(int sector, bool isDirectory);
+					// Free a file, and for a directory
+					// all under it, in the free map
 
 	void List(); // List all the files in the file system
 
-	void ListRecursively(); // List all the files and all files under the subdirectories
+	void ListRecursively(char *name, int maxDepth = -1,
+						 char *filter = NULL);
+					// List the files under a directory,
+					// and under its subdirectories, to
+					// "maxDepth" levels (-1 for all);
+					// only files matching "filter", if
+					// given ('*' and '?' as wildcards)
 
 	void Print(); // List all the files and their contents
 
+	int Check(bool repair); // Check the free map against the files
+							// (fsck), fixing it if "repair"; return
+							// the number of problems found
+
+	void Unmount(); // Put everything on disk, so that the next
+					// mount need not recover
+	void Mount(RemoteFileSystem *remote); // Have names under
+					// RemoteMountPoint (see remotefs.h)
+					// go to another machine's file system
+
 private:
-	OpenFile *openedFile;
+	int FindDirectory(char *name); // Header sector of a directory
+								   // by its path, or -1
+
+	Inode *LockDirectory(int sector, bool exclusive);
+	void UnlockDirectory(Inode *inode, bool exclusive);
+	// Lock a directory shared or exclusive,
+	// and unlock it
+
+	bool CloneFile(char *from, char *to);
+	bool CloneDirectory(int sector, char *from, char *to);
+	// Clone one file, or everything in a
+	// directory
+
+	void StatSector(int sector, bool isDirectory, FileStat *stat);
+	// Fill in "stat" from a header
+
+	bool ReadSuper(SuperBlock *super); // FALSE if the disk has none
+	void WriteSuper(bool clean); // straight to disk
+
+	OpenFile *openFileTable[MaxOpenFiles]; // Files open by any program,
+	int openFileRefs[MaxOpenFiles];		   // and the descriptors using each
+	int dirCursor[MaxOpenFiles];		   // for a directory, where ReadDir
+										   // carries on; else -1
+	RemoteFile *remoteTable[MaxOpenFiles]; // for a remote file, the
+										   // file; else NULL
+	RemoteFileSystem *remote; // Mounted, or NULL
+	char *RemoteName(char *name); // Its name on the server, or
+								  // NULL if not under the mount
 
 	OpenFile *freeMapFile;	 // Bit map of free disk blocks,
 							 // represented as a file
+	PersistentBitmap *freeMap; // In-memory copy of the bit map,
+							 // kept for as long as Nachos runs
 	OpenFile *directoryFile; // "Root" directory -- list of
 							 // file names, represented as a file
+	NameCache *nameCache;	 // Recent <directory, name> lookups
+	bool hasSuper;			 // Is there a superblock to keep up?
 };
 
 #endif // FILESYS
@@ -0,0 +1,209 @@
+// freeextents.cc
+//	Routines to keep the free extents of a bitmap in B-trees.  See
+//	freeextents.h.
+//
+//	Setting bits in the middle of an extent splits it in two;
+//	clearing a bit next to an extent, or between two, joins them.  So
+//	the extents are always maximal, and there are never two next to
+//	each other.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "freeextents.h"
+
+//----------------------------------------------------------------------
+// CompareStart, CompareLength
+// 	Order extents by where they start; or by length, and among those
+//	as long, by where they start, so that no two compare equal.
+//----------------------------------------------------------------------
+
+static int
+CompareStart(FreeExtent x, FreeExtent y)
+{
+    if (x.start < y.start) return -1;
+    else if (x.start == y.start) return 0;
+    else return 1;
+}
+
+static int
+CompareLength(FreeExtent x, FreeExtent y)
+{
+    if (x.length < y.length) return -1;
+    else if (x.length > y.length) return 1;
+    else return CompareStart(x, y);
+}
+
+//----------------------------------------------------------------------
+// MakeExtent
+// 	Return the extent of "length" bits from "start" on; as a key to
+//	look extents up by, "length" may be 0.
+//----------------------------------------------------------------------
+
+static FreeExtent
+MakeExtent(int start, int length)
+{
+    FreeExtent extent;
+
+    extent.start = start;
+    extent.length = length;
+    return extent;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::FreeExtents, FreeExtents::~FreeExtents
+// 	Initialize an empty index; de-allocate it.
+//----------------------------------------------------------------------
+
+FreeExtents::FreeExtents()
+{
+    byStart = new BTree<FreeExtent>(CompareStart);
+    byLength = new BTree<FreeExtent>(CompareLength);
+    numFree = 0;
+}
+
+FreeExtents::~FreeExtents()
+{
+    delete byStart;
+    delete byLength;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Rebuild
+// 	Throw the extents away, and index the runs of clear bits of "map"
+//	instead, after the whole map changed.
+//
+//	"numBits" -- how many bits the map has
+//----------------------------------------------------------------------
+
+void
+FreeExtents::Rebuild(Bitmap *map, int numBits)
+{
+    delete byStart;
+    delete byLength;
+    byStart = new BTree<FreeExtent>(CompareStart);
+    byLength = new BTree<FreeExtent>(CompareLength);
+    numFree = 0;
+    for (int i = 0; i < numBits; i++) {
+	if (map->Test(i)) {
+	    continue;
+	}
+	int start = i;
+
+	while ((i < numBits) && !map->Test(i)) {
+	    i++;
+	}
+	Add(start, i - start);
+    }
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Take
+// 	The "count" bits from "first" on have been set.  They were clear,
+//	so they lie in a single extent: cut them out of it, leaving what
+//	is on either side.
+//----------------------------------------------------------------------
+
+void
+FreeExtents::Take(int first, int count)
+{
+    FreeExtent extent;
+    int end;
+    bool found = byStart->Floor(MakeExtent(first, 0), &extent);
+
+    ASSERT(found);
+    end = extent.start + extent.length;
+    ASSERT(first + count <= end);
+    Delete(extent);
+    if (first > extent.start) {
+	Add(extent.start, first - extent.start);
+    }
+    if (first + count < end) {
+	Add(first + count, end - (first + count));
+    }
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Give
+// 	Bit "which" has been cleared: make it an extent of its own, or
+//	add it to the extent ending just before it, or starting just
+//	after it, or both.
+//----------------------------------------------------------------------
+
+void
+FreeExtents::Give(int which)
+{
+    FreeExtent before, after;
+    int start = which, length = 1;
+
+    if (byStart->Floor(MakeExtent(which, 0), &before) &&
+	(before.start + before.length == which)) {
+	Delete(before);
+	start = before.start;
+	length += before.length;
+    }
+    if (byStart->Ceiling(MakeExtent(which + 1, 0), &after) &&
+	(after.start == which + 1)) {
+	Delete(after);
+	length += after.length;
+    }
+    Add(start, length);
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::BestFit
+// 	Return where a run of "count" clear bits starting on a multiple
+//	of "align" can be found in the smallest extent that holds one, the
+//	first such extent on the map if several are as small; or -1 if
+//	none does.  Nothing is taken; the caller sets the bits, then calls
+//	Take.
+//
+//	Without alignment, the first extent at least "count" long will do.
+//	With it, one may be long enough but start too late to hold an
+//	aligned run; the next is tried then, until one of at least
+//	count + align - 1 bits, which always holds one.
+//----------------------------------------------------------------------
+
+int
+FreeExtents::BestFit(int count, int align)
+{
+    FreeExtent extent = MakeExtent(-1, count);
+
+    while (byLength->Ceiling(extent, &extent)) {
+	int first = divRoundUp(extent.start, align) * align;
+
+	if (first + count <= extent.start + extent.length) {
+	    return first;
+	}
+	extent.start++;			// the next one along
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// FreeExtents::Add, FreeExtents::Delete
+// 	Put an extent into both trees, or take it out of both.
+//----------------------------------------------------------------------
+
+void
+FreeExtents::Add(int start, int length)
+{
+    FreeExtent extent = MakeExtent(start, length);
+
+    ASSERT(length > 0);
+    byStart->Insert(extent);
+    byLength->Insert(extent);
+    numFree += length;
+}
+
+void
+FreeExtents::Delete(FreeExtent extent)
+{
+    bool inStart = byStart->Remove(extent);
+    bool inLength = byLength->Remove(extent);
+
+    ASSERT(inStart && inLength);
+    numFree -= extent.length;
+}
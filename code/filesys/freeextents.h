@@ -0,0 +1,67 @@
+// freeextents.h
+//	Data structures to keep the free space of a bitmap as a set of
+//	extents -- maximal runs of clear bits -- so that a run of a given
+//	length can be found without scanning the map.
+//
+//	The extents are kept in two B-trees: one ordered by where they
+//	start, to find the extents next to a bit that changes, and one
+//	ordered by length, to find the smallest extent that is long
+//	enough (best fit).  Each takes O(log n) time, n being the number
+//	of extents.
+//
+//	The extents are only an index: the bitmap is what is stored on
+//	disk, and the extents are rebuilt from it when it is read in.
+//	The owner of the bitmap tells the index about every bit it sets
+//	or clears.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FREEEXTENTS_H
+#define FREEEXTENTS_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "btree.h"
+
+// The following class defines a run of clear bits.
+
+class FreeExtent {
+  public:
+    int start;			// first clear bit
+    int length;			// how many
+};
+
+// The following class defines the index of the free extents of a
+// bitmap.  Mutual exclusion must be provided by the caller.
+
+class FreeExtents {
+  public:
+    FreeExtents();		// initialize an empty index
+    ~FreeExtents();		// de-allocate it
+
+    void Rebuild(Bitmap *map, int numBits);
+				// index the clear runs of "map"
+    void Take(int first, int count); // the "count" bits from "first"
+				// on, all clear, have been set
+    void Give(int which);	// bit "which" has been cleared
+    int BestFit(int count, int align);
+				// first bit of a run of "count" clear
+				// bits starting on a multiple of
+				// "align", in the smallest extent that
+				// holds one; -1 if none does
+
+    int NumFree() { return numFree; } // clear bits indexed
+    int NumExtents() { return byStart->NumInTree(); }
+
+  private:
+    BTree<FreeExtent> *byStart;	// the extents, by where they start
+    BTree<FreeExtent> *byLength; // by length, then where they start
+    int numFree;		// total length of the extents
+
+    void Add(int start, int length); // index a new extent
+    void Delete(FreeExtent extent);  // drop one
+};
+
+#endif // FREEEXTENTS_H
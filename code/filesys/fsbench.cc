@@ -0,0 +1,246 @@
+// fsbench.cc
+//	Routines to time the file system.  See fsbench.h.
+//
+//	A test that changes the file system ends with a checkpoint, so
+//	its time includes getting the changes to disk, not just into the
+//	buffer cache.  Reads follow the writes of the same file, so they
+//	show what the cache and read-ahead make of them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fsbench.h"
+#include "filesys.h"
+#include "openfile.h"
+#include "journal.h"
+#include "main.h"
+
+static const int BenchSizes[] = {SectorSize, 4 * 1024, 64 * 1024};
+static const int NumBenchSizes = sizeof(BenchSizes) / sizeof(int);
+
+//----------------------------------------------------------------------
+// FileSystemBench::FileSystemBench
+// 	Get ready to run the benchmark, writing the report to
+//	"reportName", or to stdout if it is "-".
+//----------------------------------------------------------------------
+
+FileSystemBench::FileSystemBench(char *reportName)
+{
+    if (strcmp(reportName, "-") == 0)
+        report = stdout;
+    else if ((report = fopen(reportName, "w")) == NULL)
+    {
+        printf("Bench: couldn't write report %s\n", reportName);
+        report = stdout;
+    }
+    seed = 1;
+    buffer = new char[max(BenchChunk, SectorSize)];
+    for (int i = 0; i < max(BenchChunk, SectorSize); i++)
+        buffer[i] = (char)i;
+}
+
+FileSystemBench::~FileSystemBench()
+{
+    if (report != stdout)
+        fclose(report);
+    else
+        fflush(report);
+    delete[] buffer;
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Run
+// 	Run every test, in the same order each time.
+//----------------------------------------------------------------------
+
+void FileSystemBench::Run()
+{
+    fprintf(report, "test,size,ops,bytes,ticks,ticks_per_op,host_us,"
+                    "host_us_per_op\n");
+    NameTests();
+    for (int i = 0; i < NumBenchSizes; i++)
+        SequentialTests(BenchSizes[i]);
+    for (int i = 0; i < NumBenchSizes; i++)
+        RandomTests(BenchSizes[i]);
+    DeepPathTest();
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Start, FileSystemBench::Finish
+// 	Time a test: note the clocks as it starts, then write its line.
+//
+//	"test" -- the name of the test
+//	"size" -- the size of the files it uses
+//	"ops", "bytes" -- what it did
+//----------------------------------------------------------------------
+
+void FileSystemBench::Start()
+{
+    startTicks = kernel->stats->totalTicks;
+    startHost = HostTime();
+}
+
+void FileSystemBench::Finish(const char *test, int size, int ops, int bytes)
+{
+    int ticks = kernel->stats->totalTicks - startTicks;
+    double host = HostTime() - startHost;
+
+    fprintf(report, "%s,%d,%d,%d,%d,%.1f,%.0f,%.2f\n", test, size, ops,
+            bytes, ticks, (double)ticks / ops, host, host / ops);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::Random
+// 	Return the next number of a pseudo-random sequence of its own,
+//	which starts the same every run whatever -rs says.
+//----------------------------------------------------------------------
+
+unsigned int FileSystemBench::Random()
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 0x7fff;
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::NameTests
+// 	Create BenchFiles empty files in the root directory, open and
+//	close each, then remove them.
+//----------------------------------------------------------------------
+
+void FileSystemBench::NameTests()
+{
+    char name[FileNameMaxLen + 1];
+    OpenFile *openFile;
+
+    Start();
+    for (int i = 0; i < BenchFiles; i++)
+    {
+        sprintf(name, "/f%d", i);
+        ASSERT(kernel->fileSystem->Create(name, 0));
+    }
+    kernel->journal->Checkpoint();
+    Finish("create", 0, BenchFiles, 0);
+
+    Start();
+    for (int i = 0; i < BenchFiles; i++)
+    {
+        sprintf(name, "/f%d", i);
+        openFile = kernel->fileSystem->Open(name);
+        ASSERT(openFile != NULL);
+        delete openFile;
+    }
+    Finish("open", 0, BenchFiles, 0);
+
+    Start();
+    for (int i = 0; i < BenchFiles; i++)
+    {
+        sprintf(name, "/f%d", i);
+        ASSERT(kernel->fileSystem->Remove(name));
+    }
+    kernel->journal->Checkpoint();
+    Finish("remove", 0, BenchFiles, 0);
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::SequentialTests
+// 	Write a new file of "size" bytes from start to end, BenchChunk
+//	bytes at a time, growing it as it goes; then read it back the
+//	same way.
+//----------------------------------------------------------------------
+
+void FileSystemBench::SequentialTests(int size)
+{
+    int ops = divRoundUp(size, BenchChunk);
+    OpenFile *openFile;
+
+    ASSERT(kernel->fileSystem->Create("/seq", 0));
+    openFile = kernel->fileSystem->Open("/seq");
+    ASSERT(openFile != NULL);
+
+    Start();
+    for (int done = 0; done < size; done += BenchChunk)
+        ASSERT(openFile->Write(buffer, min(BenchChunk, size - done)) > 0);
+    kernel->journal->Checkpoint();
+    Finish("seqwrite", size, ops, size);
+
+    openFile->Seek(0);
+    Start();
+    for (int done = 0; done < size; done += BenchChunk)
+        ASSERT(openFile->Read(buffer, min(BenchChunk, size - done)) > 0);
+    Finish("seqread", size, ops, size);
+
+    delete openFile;
+    ASSERT(kernel->fileSystem->Remove("/seq"));
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::RandomTests
+// 	Write BenchRandomOps sectors picked at random from a file of
+//	"size" bytes, made at that size; then read as many.
+//----------------------------------------------------------------------
+
+void FileSystemBench::RandomTests(int size)
+{
+    int numSectors = divRoundUp(size, SectorSize);
+    OpenFile *openFile;
+
+    ASSERT(kernel->fileSystem->Create("/rand", size));
+    openFile = kernel->fileSystem->Open("/rand");
+    ASSERT(openFile != NULL);
+
+    Start();
+    for (int i = 0; i < BenchRandomOps; i++)
+    {
+        int at = (Random() % numSectors) * SectorSize;
+
+        ASSERT(openFile->WriteAt(buffer, SectorSize, at) == SectorSize);
+    }
+    kernel->journal->Checkpoint();
+    Finish("randwrite", size, BenchRandomOps, BenchRandomOps * SectorSize);
+
+    Start();
+    for (int i = 0; i < BenchRandomOps; i++)
+    {
+        int at = (Random() % numSectors) * SectorSize;
+
+        ASSERT(openFile->ReadAt(buffer, SectorSize, at) == SectorSize);
+    }
+    Finish("randread", size, BenchRandomOps, BenchRandomOps * SectorSize);
+
+    delete openFile;
+    ASSERT(kernel->fileSystem->Remove("/rand"));
+}
+
+//----------------------------------------------------------------------
+// FileSystemBench::DeepPathTest
+// 	Make a file BenchDepth directories down, under "/bench", timing
+//	that, then open it BenchLookups times.  Each open looks up every
+//	directory on the path.
+//----------------------------------------------------------------------
+
+void FileSystemBench::DeepPathTest()
+{
+    char path[BenchDepth * 8 + 16];
+    OpenFile *openFile;
+
+    strcpy(path, "/bench");
+    for (int i = 1; i < BenchDepth; i++)
+        sprintf(path + strlen(path), "/d%d", i);
+    strcat(path, "/file");
+
+    Start();
+    ASSERT(kernel->fileSystem->Create(path, 0));
+    kernel->journal->Checkpoint();
+    Finish("deepcreate", 0, 1, 0);
+
+    Start();
+    for (int i = 0; i < BenchLookups; i++)
+    {
+        openFile = kernel->fileSystem->Open(path);
+        ASSERT(openFile != NULL);
+        delete openFile;
+    }
+    Finish("deeplookup", 0, BenchLookups, 0);
+}
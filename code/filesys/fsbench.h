@@ -0,0 +1,66 @@
+// fsbench.h
+//	Data structures for a micro-benchmark of the file system: how
+//	fast files are created, opened and removed, read and written in
+//	order and at random at several sizes, and found at the end of a
+//	long path.
+//
+//	Each test is timed both in simulated ticks, which only change
+//	when the file system does, and in host time, which shows what
+//	Nachos costs to run.  The report is CSV, one line per test, always
+//	the same tests in the same order, so that the reports of two
+//	builds can be compared line by line:
+//
+//	    test,size,ops,bytes,ticks,ticks_per_op,host_us,host_us_per_op
+//
+//	The tests make files in the root directory and under "/bench",
+//	so they should be run on a freshly formatted disk (see the
+//	"bench" target in build.linux/Makefile).
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSBENCH_H
+#define FSBENCH_H
+
+#include "utility.h"
+#include <stdio.h>
+
+#define BenchFiles 32      // files made by the name tests
+#define BenchRandomOps 64  // reads or writes by each random test
+#define BenchLookups 100   // opens by the deep path test
+#define BenchDepth 8       // directories in the deep path
+#define BenchChunk 512     // bytes per sequential read or write
+
+// The following class defines one run of the benchmark.
+
+class FileSystemBench
+{
+public:
+    FileSystemBench(char *reportName); // report to this file, or
+                                       // stdout if "-"
+    ~FileSystemBench();
+
+    void Run(); // Run every test
+
+private:
+    FILE *report;      // where the lines go
+    int startTicks;    // when the test running started
+    double startHost;
+    unsigned int seed; // for the random tests; the same every run
+    char *buffer;      // data read and written
+
+    void Start();            // start timing a test
+    void Finish(const char *test, int size, int ops, int bytes);
+                             // and write its line
+    unsigned int Random();   // next pseudo-random number
+
+    void NameTests();            // create, open, remove
+    void SequentialTests(int size); // write, then read, a whole file
+    void RandomTests(int size);  // write, then read, sectors at random
+    void DeepPathTest();         // open a file BenchDepth levels down
+};
+
+#endif // FSBENCH_H
@@ -0,0 +1,220 @@
+// fsck.cc
+//	Routines to check the free map against the sectors the file
+//	system really uses, and to repair it.
+//
+//	Every sector is claimed for the file header it belongs to; the
+//	journal's log, the swap area, the table of checksums and the
+//	superblock are claimed for no file at all.  A header or index
+//	sector that is already claimed is not walked again, so a
+//	directory or index chain that loops back on itself cannot make
+//	the walk go on forever.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fsck.h"
+#include "filehdr.h"
+#include "filesys.h"
+#include "directory.h"
+#include "journal.h"
+#include "swapspace.h"
+#include "checksum.h"
+#include "buffercache.h"
+#include "main.h"
+
+#define NoOwner (-1)      // sector not claimed
+#define JournalOwner (-2) // sector of the journal's log
+#define SwapOwner (-3)    // sector of the swap area
+#define ChecksumOwner (-4) // sector of the table of checksums
+#define SuperOwner (-5)   // the superblock
+
+//----------------------------------------------------------------------
+// FileSystemCheck::FileSystemCheck
+// 	Get ready to check the file system using "freeMap".  Only the
+//	journal's log, the swap area, the table of checksums and the
+//	superblock, if the disk has one, are claimed so far.
+//----------------------------------------------------------------------
+
+FileSystemCheck::FileSystemCheck(PersistentBitmap *freeMap, bool hasSuper)
+{
+    this->freeMap = freeMap;
+    owner = new int[NumSectors];
+    for (int i = 0; i < NumSectors; i++)
+        owner[i] = NoOwner;
+    numFiles = numDirectories = numClaimed = 0;
+    numDuplicates = numLeaked = numUnmarked = numBad = numMiscounted = 0;
+    numReported = 0;
+    for (int i = SwapStart; i < JournalStart; i++)
+        Claim(i, SwapOwner);
+    for (int i = JournalStart; i < NumSectors; i++)
+        Claim(i, JournalOwner);
+    if (hasSuper)
+        Claim(SuperSector, SuperOwner);
+    if (kernel->bufferCache->Checksummed())
+        for (int i = ChecksumStart; i < SwapStart; i++)
+            Claim(i, ChecksumOwner);
+}
+
+FileSystemCheck::~FileSystemCheck()
+{
+    delete[] owner;
+}
+
+//----------------------------------------------------------------------
+// FileSystemCheck::Finish
+// 	Once every file has been checked, compare what was claimed with
+//	the free map, and print a summary.  If "repair", leaked sectors
+//	are freed and unmarked ones marked in the in-core free map; the
+//	caller writes it back.
+//
+//	Return the number of problems found.
+//----------------------------------------------------------------------
+
+int FileSystemCheck::Finish(bool repair)
+{
+    for (int i = 0; i < NumSectors; i++)
+    {
+        bool marked = freeMap->Test(i);
+
+        if ((owner[i] != NoOwner) && !marked)
+        {
+            numUnmarked++;
+            if (ShouldReport())
+                printf("fsck: sector %d of header %d is marked free\n", i, owner[i]);
+            if (repair)
+                freeMap->Mark(i);
+        }
+        else if ((owner[i] == NoOwner) && marked)
+        {
+            numLeaked++;
+            if (ShouldReport())
+                printf("fsck: sector %d is marked in use but belongs to no file\n", i);
+            if (repair)
+                freeMap->Clear(i);
+        }
+    }
+    if (numReported > MaxReportedSectors)
+        printf("fsck: %d more problems not listed\n", numReported - MaxReportedSectors);
+    if (!freeMap->CheckCounts())
+    {
+        numMiscounted++;
+        printf("fsck: free map counts %d sectors free, but %d are%s\n",
+               freeMap->NumClear(), freeMap->CountClear(),
+               repair ? " (recounted)" : "");
+        if (repair)
+            freeMap->Recount();
+    }
+
+    printf("fsck: %d files, %d directories, %d sectors in use\n",
+           numFiles, numDirectories, numClaimed);
+    printf("fsck: %d bad headers, %d doubly allocated, %d leaked, %d marked free%s\n",
+           numBad, numDuplicates, numLeaked, numUnmarked,
+           (repair && (numLeaked + numUnmarked > 0)) ? " (free map repaired)" : "");
+    return numBad + numDuplicates + numLeaked + numUnmarked + numMiscounted;
+}
+
+//----------------------------------------------------------------------
+// FileSystemCheck::Claim
+// 	Record that "sector" belongs to the file whose header is at
+//	"owner".  Return FALSE if the sector does not exist, or already
+//	belongs to some file, in which case it is doubly allocated.
+//----------------------------------------------------------------------
+
+bool FileSystemCheck::Claim(int sector, int owner)
+{
+    if ((sector < 0) || (sector >= NumSectors))
+        return FALSE;
+    if (this->owner[sector] != NoOwner)
+    {
+        numDuplicates++;
+        if (ShouldReport())
+            printf("fsck: sector %d is used by headers %d and %d\n",
+                   sector, this->owner[sector], owner);
+        return FALSE;
+    }
+    this->owner[sector] = owner;
+    numClaimed++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FileSystemCheck::ClaimShared
+// 	Claim a data sector of a file that may share clusters with its
+//	clones (see FileHeader::Share).  A sector claimed already is not
+//	doubly allocated if the free map counts its cluster as shared;
+//	whether the count is exactly right is not checked.
+//----------------------------------------------------------------------
+
+bool FileSystemCheck::ClaimShared(int sector, int owner)
+{
+    if ((sector >= 0) && (sector < NumSectors) &&
+        (this->owner[sector] != NoOwner) && (freeMap->Shares(sector) > 0))
+        return TRUE;
+    return Claim(sector, owner);
+}
+
+//----------------------------------------------------------------------
+// FileSystemCheck::CheckFile
+// 	Claim the header of a file and every sector it leads to.  For a
+//	directory, go on to check its index and every file in it.
+//
+//	"sector" -- where the file header is
+//	"isDirectory" -- TRUE if the file is a directory
+//	"name" -- its path, for reports
+//----------------------------------------------------------------------
+
+void FileSystemCheck::CheckFile(int sector, bool isDirectory, char *name)
+{
+    FileHeader *hdr;
+    bool ok;
+
+    if (!Claim(sector, sector))
+    {
+        if ((sector < 0) || (sector >= NumSectors))
+        {
+            numBad++;
+            if (ShouldReport())
+                printf("fsck: %s has header sector %d, off the disk\n", name, sector);
+        }
+        return; // someone else's, and reported; don't walk it twice
+    }
+
+    hdr = new FileHeader;
+    ok = hdr->Check(sector, this);
+    delete hdr;
+    if (!ok)
+    {
+        numBad++;
+        if (ShouldReport())
+            printf("fsck: %s has a bad header in sector %d\n", name, sector);
+        return;
+    }
+    DEBUG(dbgFile, "Checked file " << name << " with header in sector #" << sector);
+
+    if (isDirectory)
+    {
+        OpenFile *file = new OpenFile(sector);
+        Directory *directory = new Directory(NumDirEntries);
+
+        numDirectories++;
+        directory->FetchFrom(file);
+        directory->Check(this, name);
+        delete directory;
+        delete file;
+    }
+    else
+        numFiles++;
+}
+
+//----------------------------------------------------------------------
+// FileSystemCheck::ShouldReport
+// 	Count a problem; return TRUE if it is still among the first
+//	MaxReportedSectors, which are listed one by one.
+//----------------------------------------------------------------------
+
+bool FileSystemCheck::ShouldReport()
+{
+    return ++numReported <= MaxReportedSectors;
+}
@@ -0,0 +1,76 @@
+// fsck.h
+//	Data structures for checking that the free map agrees with what
+//	the file system actually uses.
+//
+//	The check walks every directory from the root, and every file
+//	header, index sector and extent they lead to, claiming each sector
+//	for the header it belongs to.  File data is never read: only
+//	headers, index sectors and directories are, through the buffer
+//	cache, so the time taken depends on the amount of metadata rather
+//	than the size of the disk.  Then the claims are compared with the
+//	free map:
+//
+//	   a sector claimed twice is doubly allocated, unless it is in a
+//	   cluster the free map counts as shared by clones;
+//	   a sector marked in use but never claimed has leaked;
+//	   a sector claimed but not marked in use could be given out again.
+//
+//	The last two can be repaired by fixing the free map.  A doubly
+//	allocated sector is only reported: which file really owns it
+//	cannot be known.
+//
+//      We assume mutual exclusion is provided by the caller.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef FSCK_H
+#define FSCK_H
+
+#include "pbitmap.h"
+
+#define MaxReportedSectors 20 // problems listed one by one; the rest
+                              // are only counted
+
+// The following class defines one run of the check over the file
+// system described by a free map.
+
+class FileSystemCheck
+{
+public:
+    FileSystemCheck(PersistentBitmap *freeMap, bool hasSuper);
+                                // only the journal, swap and
+                                // superblock claimed
+    ~FileSystemCheck();
+
+    bool Claim(int sector, int owner);
+    // Claim a sector for the file whose header
+    // is at "owner"; FALSE if it is out of
+    // range or claimed already
+    bool ClaimShared(int sector, int owner);
+    // The same, for a data sector of a file
+    // that may share clusters with clones
+    void CheckFile(int sector, bool isDirectory, char *name);
+    // Check the file whose header is at
+    // "sector", and for a directory,
+    // everything in it
+    int Finish(bool repair);
+    // Compare the claims with the free map,
+    // fixing it if "repair"; return the
+    // number of problems found
+
+private:
+    bool ShouldReport(); // count a problem; TRUE if it is to be listed
+
+    PersistentBitmap *freeMap; // the map being checked
+    int *owner;                // header claiming each sector, or -1
+    int numFiles, numDirectories, numClaimed;
+    int numDuplicates, numLeaked, numUnmarked, numBad;
+    int numMiscounted;         // 1 if the free map's counts were off
+    int numReported;
+};
+
+#endif // FSCK_H
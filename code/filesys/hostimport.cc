@@ -0,0 +1,297 @@
+// hostimport.cc
+//	Routines to copy a host directory tree into the Nachos file
+//	system.  See hostimport.h.
+//
+//	Files are created at the size they had when the tree was walked;
+//	one that has grown since is cut short, one that has shrunk is
+//	padded with zeroes.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "hostimport.h"
+#include "filesys.h"
+#include "openfile.h"
+#include "directory.h"
+#include "journal.h"
+#include "sysdep.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// JoinName
+// 	Return a new copy of the path "dir", with "name" under it.
+//----------------------------------------------------------------------
+
+static char *JoinName(char *dir, char *name)
+{
+    char *path = new char[strlen(dir) + strlen(name) + 2];
+
+    if (strcmp(dir, "/") == 0)
+        sprintf(path, "/%s", name);
+    else
+        sprintf(path, "%s/%s", dir, name);
+    return path;
+}
+
+//----------------------------------------------------------------------
+// NewGroup
+// 	Return an empty group of files going into the Nachos directory
+//	"dir".
+//----------------------------------------------------------------------
+
+static ImportGroup *NewGroup(char *dir)
+{
+    ImportGroup *group = new ImportGroup;
+
+    group->dir = new char[strlen(dir) + 1];
+    strcpy(group->dir, dir);
+    group->count = 0;
+    group->read = NULL;
+    return group;
+}
+
+//----------------------------------------------------------------------
+// HostImport::HostImport
+// 	Get ready to copy the host directory "from", and everything under
+//	it, to the Nachos directory "to".
+//----------------------------------------------------------------------
+
+HostImport::HostImport(char *from, char *to)
+{
+    this->from = from;
+    this->to = to;
+    walked = new List<ImportGroup *>;
+    reading = new List<ImportGroup *>;
+    numReading = 0;
+    numFiles = numDirectories = numBytes = 0;
+}
+
+HostImport::~HostImport()
+{
+    delete walked;
+    delete reading;
+}
+
+//----------------------------------------------------------------------
+// HostImport::Run
+// 	Walk the host tree, then create and write each group of files in
+//	turn, the host files of the next ImportWindow groups being read
+//	meanwhile.
+//----------------------------------------------------------------------
+
+void HostImport::Run()
+{
+    bool isDirectory;
+
+    if ((HostFileSize(from, &isDirectory) < 0) || !isDirectory)
+    {
+        printf("Import: %s is not a directory\n", from);
+        return;
+    }
+    if (to[0] != '/')
+    {
+        printf("Import: %s is not an absolute path\n", to);
+        return;
+    }
+    Walk(from, to, 0);
+    StartReads();
+    while (!reading->IsEmpty())
+    {
+        ImportGroup *group = reading->RemoveFront();
+
+        numReading--;
+        StartReads();
+        Write(group);
+    }
+    printf("Import: %d files, %d directories, %d bytes\n", numFiles,
+           numDirectories, numBytes);
+}
+
+//----------------------------------------------------------------------
+// HostImport::Walk
+// 	Group the files in the host directory "hostDir", which go into
+//	the Nachos directory "dir", then walk its subdirectories.  The
+//	directory gets a group even with no files in it, so that it is
+//	made.  Names too long for a Nachos directory are skipped.
+//
+//	"depth" -- how many directories down from "from" this one is
+//----------------------------------------------------------------------
+
+void HostImport::Walk(char *hostDir, char *dir, int depth)
+{
+    List<char *> *subdirs;
+    ImportGroup *group;
+    void *hostEntries;
+    char *name;
+
+    if (depth > MaxImportDepth)
+    {
+        printf("Import: %s is too deep, skipped\n", hostDir);
+        return;
+    }
+    if ((hostEntries = OpenHostDirectory(hostDir)) == NULL)
+    {
+        printf("Import: couldn't read directory %s\n", hostDir);
+        return;
+    }
+    numDirectories++;
+    subdirs = new List<char *>;
+    group = NewGroup(dir);
+    walked->Append(group);
+    while ((name = NextHostEntry(hostEntries)) != NULL)
+    {
+        char *hostName = JoinName(hostDir, name);
+        bool isDirectory;
+        int size;
+
+        // files are entered with a '/' in front of their name
+        if (strlen(name) > FileNameMaxLen - 2)
+        {
+            printf("Import: name too long, skipped: %s\n", hostName);
+            delete[] hostName;
+            continue;
+        }
+        if ((size = HostFileSize(hostName, &isDirectory)) < 0)
+        {
+            delete[] hostName;
+            continue;
+        }
+        if (isDirectory)
+        {
+            subdirs->Append(hostName);
+            continue;
+        }
+        if (group->count == ImportBatch)
+        {
+            group = NewGroup(dir);
+            walked->Append(group);
+        }
+        ImportFile *file = new ImportFile;
+        file->hostName = hostName;
+        file->name = JoinName(dir, name);
+        file->size = size;
+        file->data = NULL;
+        group->files[group->count++] = file;
+    }
+    CloseHostDirectory(hostEntries);
+
+    while (!subdirs->IsEmpty())
+    {
+        char *hostName = subdirs->RemoveFront();
+        char *child = JoinName(dir, strrchr(hostName, '/') + 1);
+
+        Walk(hostName, child, depth + 1);
+        delete[] hostName;
+        delete[] child;
+    }
+    delete subdirs;
+}
+
+//----------------------------------------------------------------------
+// HostImport::StartReads
+// 	Hand the reads of the next groups walked to the kernel's thread
+//	pool, until ImportWindow groups are being read.
+//----------------------------------------------------------------------
+
+void HostImport::StartReads()
+{
+    void *args[ImportBatch];
+
+    while ((numReading < ImportWindow) && !walked->IsEmpty())
+    {
+        ImportGroup *group = walked->RemoveFront();
+
+        group->read = new TaskGroup("import read");
+        for (int i = 0; i < group->count; i++)
+            args[i] = group->files[i];
+        if (group->count > 0)
+            kernel->threadPool->SubmitBatch(ReadHostFile, args, group->count,
+                                            group->read);
+        reading->Append(group);
+        numReading++;
+    }
+}
+
+//----------------------------------------------------------------------
+// HostImport::ReadHostFile
+// 	Task run by the thread pool: read a host file whole, into a
+//	buffer of the size it was walked at.  Leave its data NULL if it
+//	cannot be opened.
+//
+//	"arg" -- the ImportFile
+//----------------------------------------------------------------------
+
+void HostImport::ReadHostFile(void *arg)
+{
+    ImportFile *file = (ImportFile *)arg;
+    int fd = OpenForRead(file->hostName, FALSE);
+    int done = 0, amountRead;
+
+    if (fd < 0)
+        return;
+    file->data = new char[file->size + 1];
+    memset(file->data, 0, file->size);
+    while ((done < file->size) &&
+           (amountRead = ReadPartial(fd, file->data + done,
+                                     file->size - done)) > 0)
+        done += amountRead;
+    Close(fd);
+}
+
+//----------------------------------------------------------------------
+// HostImport::Write
+// 	Make the group's directory, and create its files, as one
+//	journaled operation, while their host files are being read; then,
+//	once they have been, write each file's data and free the group.
+//	A file that cannot be created, or whose host file cannot be read,
+//	is skipped.
+//----------------------------------------------------------------------
+
+void HostImport::Write(ImportGroup *group)
+{
+    FileSystem *fileSystem = kernel->fileSystem;
+    bool created[ImportBatch];
+
+    kernel->journal->Begin();
+    (void) fileSystem->TraverseDirectory(group->dir);
+    for (int i = 0; i < group->count; i++)
+    {
+        ImportFile *file = group->files[i];
+
+        created[i] = fileSystem->Create(file->name, file->size);
+        if (!created[i])
+            printf("Import: couldn't create %s\n", file->name);
+    }
+    kernel->journal->End();
+
+    group->read->Wait();
+    for (int i = 0; i < group->count; i++)
+    {
+        ImportFile *file = group->files[i];
+
+        if (created[i] && (file->data == NULL))
+        {
+            printf("Import: couldn't read %s\n", file->hostName);
+            fileSystem->Remove(file->name);
+        }
+        else if (created[i])
+        {
+            OpenFile *openFile = fileSystem->Open(file->name);
+
+            ASSERT(openFile != NULL);
+            openFile->WriteAt(file->data, file->size, 0);
+            delete openFile;
+            numFiles++;
+            numBytes += file->size;
+        }
+        delete[] file->data;
+        delete[] file->hostName;
+        delete[] file->name;
+        delete file;
+    }
+    delete group->read;
+    delete[] group->dir;
+    delete group;
+}
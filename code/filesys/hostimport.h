@@ -0,0 +1,81 @@
+// hostimport.h
+//	Data structures for copying a whole directory tree from the host
+//	into the Nachos file system, the way "-cp" copies one file.
+//
+//	The tree is walked first, and its files grouped, ImportBatch at a
+//	time, by the directory they go into.  Each group is then created
+//	as one journaled operation, so that the directory and the free
+//	map are written back once for the group rather than once a file,
+//	and its data written after.
+//
+//	The host files are read by the kernel's thread pool, up to
+//	ImportWindow groups ahead of the one being written, so the reads
+//	are done while the writer waits on the disk.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef HOSTIMPORT_H
+#define HOSTIMPORT_H
+
+#include "utility.h"
+#include "list.h"
+#include "threadpool.h"
+
+#define ImportBatch 32     // files created in one operation
+#define ImportWindow 2     // groups read ahead of the one written
+#define MaxImportDepth 32  // directories deep the walk goes
+
+// The following class defines one host file to be copied.
+
+class ImportFile
+{
+public:
+    char *hostName; // where it is on the host
+    char *name;     // and where it goes in Nachos
+    int size;       // bytes, when the tree was walked
+    char *data;     // the bytes, once read; NULL if it could not be
+};
+
+// The following class defines a group of files going into one
+// directory.
+
+class ImportGroup
+{
+public:
+    char *dir;                  // the Nachos directory
+    ImportFile *files[ImportBatch];
+    int count;                  // how many of "files" there are
+    TaskGroup *read;            // the reads of them, once submitted
+};
+
+// The following class defines one copy of a host tree.
+
+class HostImport
+{
+public:
+    HostImport(char *from, char *to); // copy the host directory
+                                      // "from" to the Nachos "to"
+    ~HostImport();
+
+    void Run(); // Copy it, and print what was copied
+
+private:
+    char *from, *to;
+    List<ImportGroup *> *walked; // groups not yet read
+    List<ImportGroup *> *reading; // and read, or being read
+    int numReading;              // how many are in "reading"
+    int numFiles, numDirectories, numBytes; // copied so far
+
+    void Walk(char *hostDir, char *dir, int depth);
+                                 // group the files under "hostDir"
+    void StartReads();           // submit reads up to the window
+    void Write(ImportGroup *group); // create its files, and fill them
+
+    static void ReadHostFile(void *arg); // task: read one file
+};
+
+#endif // HOSTIMPORT_H
@@ -0,0 +1,279 @@
+// inodetable.cc
+//	Routines to manage the table of in-core file headers.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "inodetable.h"
+#include "debug.h"
+#include "main.h"
+#include "execcache.h"
+
+//----------------------------------------------------------------------
+// InodeSector, HashSector
+// 	Helper functions for the hash table from sector numbers to inodes.
+//----------------------------------------------------------------------
+
+static int
+InodeSector(Inode *inode)
+{
+    return inode->sector;
+}
+
+static unsigned
+HashSector(int sector)
+{
+    return (unsigned)sector;
+}
+
+//----------------------------------------------------------------------
+// UnusedLink
+// 	Helper function for the list of unused inodes.
+//----------------------------------------------------------------------
+
+static DListLink<Inode *> *
+UnusedLink(Inode *inode)
+{
+    return &inode->unusedLink;
+}
+
+//----------------------------------------------------------------------
+// WriteBackIfDirty
+// 	Write a header back if it changed since it was last written,
+//	unless its sector was forgotten meanwhile.
+//----------------------------------------------------------------------
+
+static void
+WriteBackIfDirty(Inode *inode)
+{
+    inode->hdrLock->Acquire();
+    if (inode->dirty && !inode->detached)
+    {
+        inode->hdr->WriteBack(inode->sector);
+        inode->dirty = FALSE;
+    }
+    inode->hdrLock->Release();
+}
+
+//----------------------------------------------------------------------
+// Inode::Inode/~Inode
+// 	Set up the entry for the file header in "sector"; de-allocate it.
+//	The header itself is read in by InodeTable::Get.
+//----------------------------------------------------------------------
+
+Inode::Inode(int sector)
+{
+    this->sector = sector;
+    hdr = new FileHeader;
+    refCount = 0;
+    dirty = FALSE;
+    detached = FALSE;
+    loaded = FALSE;
+    hdrLock = new Lock("inode lock");
+    lock = new RWLock("directory lock");
+    delayed = NULL;
+    numDelayed = 0;
+    chunk = NULL;
+    chunkNumber = -1;
+}
+
+Inode::~Inode()
+{
+    delete [] delayed;
+    delete [] chunk;
+    delete lock;
+    delete hdrLock;
+    delete hdr;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::InodeTable
+// 	Initialize an empty table.
+//
+//	"maxUnused" -- how many headers no one has open to keep around
+//----------------------------------------------------------------------
+
+InodeTable::InodeTable(int maxUnused)
+{
+    table = new OpenHashTable<int, Inode *>(InodeSector, HashSector);
+    unused = new DList<Inode *>(UnusedLink);
+    this->maxUnused = maxUnused;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::~InodeTable
+// 	De-allocate the table and the unused headers.  Headers still in
+//	use belong to OpenFiles nobody closed; they are left to them.
+//----------------------------------------------------------------------
+
+InodeTable::~InodeTable()
+{
+    while (!unused->IsEmpty())
+    {
+        Inode *inode = unused->RemoveFront();
+        table->Remove(inode->sector);
+        delete inode;
+    }
+    while (!table->IsEmpty())
+    {
+        OpenHashIterator<int, Inode *> iter(table);
+        Inode *inode = iter.Item();
+
+        table->Remove(inode->sector);
+        inode->detached = TRUE;
+    }
+    delete unused;
+    delete table;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Get
+// 	Return the shared header of the file whose header is in "sector",
+//	reading it from disk only if it is not in the table.  The caller
+//	must give it back with Put.
+//
+//	The entry goes into the table before the header is read, so that
+//	a thread asking for the same header while the disk is busy (two
+//	programs being loaded from the same file, say) finds it, and
+//	waits on the header's lock for the read to finish.
+//----------------------------------------------------------------------
+
+Inode *
+InodeTable::Get(int sector)
+{
+    Inode *inode;
+
+    if (table->Find(sector, &inode))
+    {
+        DEBUG(dbgFile, "Inode table hit for sector #" << sector);
+        if (inode->refCount == 0)
+            unused->Remove(inode);
+    }
+    else
+    {
+        inode = new Inode(sector);
+        table->Insert(inode);
+    }
+    inode->refCount++;
+
+    if (!inode->loaded)
+    {
+        inode->hdrLock->Acquire();
+        if (!inode->loaded)
+        {
+            inode->hdr->FetchFrom(sector);
+            inode->loaded = TRUE;
+        }
+        inode->hdrLock->Release();
+    }
+    return inode;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Put
+// 	Give back a header obtained with Get.  When its last user is
+//	done, write it back if it changed, and keep it as unused, making
+//	room by dropping the oldest unused header if there are too many.
+//
+//	The header is written back before the reference is dropped, so
+//	that it cannot be dropped from the table while the disk is busy;
+//	if someone takes it meanwhile, it is theirs to write back later.
+//----------------------------------------------------------------------
+
+void InodeTable::Put(Inode *inode)
+{
+    ASSERT(inode->refCount > 0);
+    if (inode->refCount == 1)
+        WriteBackIfDirty(inode);
+    if (--inode->refCount > 0)
+        return;
+
+    if (inode->detached)
+    {
+        delete inode; // its sector belongs to someone else now
+        return;
+    }
+    unused->Append(inode);
+    if (unused->NumInList() > (unsigned)maxUnused)
+    {
+        Inode *oldest = unused->RemoveFront();
+        table->Remove(oldest->sector);
+        delete oldest;
+    }
+}
+
+//----------------------------------------------------------------------
+// InodeTable::MarkDirty
+// 	Note that a header was changed, so that it is written back later.
+//----------------------------------------------------------------------
+
+void InodeTable::MarkDirty(Inode *inode)
+{
+    inode->dirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Forget
+// 	Drop the header of "sector" from the table: the sector has been
+//	freed, or is about to get a new header written straight to it.
+//	If someone still has the old header, they keep their copy, but it
+//	is no longer written back or handed out.  A program image read
+//	from the file goes too.
+//----------------------------------------------------------------------
+
+void InodeTable::Forget(int sector)
+{
+    Inode *inode;
+
+    kernel->execCache->Invalidate(sector);
+    if (!table->Find(sector, &inode))
+        return;
+    table->Remove(sector);
+    if (inode->refCount == 0)
+    {
+        unused->Remove(inode);
+        delete inode;
+    }
+    else
+    { // wait for any write back in progress to finish
+        inode->hdrLock->Acquire();
+        inode->detached = TRUE;
+        inode->hdrLock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// InodeTable::Flush
+// 	Write every dirty header back.  Writing waits for the disk, and
+//	the table may change meanwhile, so the dirty headers are gathered
+//	first, each held with a reference until it has been written.
+//----------------------------------------------------------------------
+
+void InodeTable::Flush()
+{
+    List<Inode *> *dirty = new List<Inode *>;
+    OpenHashIterator<int, Inode *> iter(table);
+
+    for (; !iter.IsDone(); iter.Next())
+    {
+        Inode *inode = iter.Item();
+
+        if (inode->dirty)
+        {
+            if (inode->refCount == 0)
+                unused->Remove(inode);
+            inode->refCount++;
+            dirty->Append(inode);
+        }
+    }
+    while (!dirty->IsEmpty())
+    {
+        Inode *inode = dirty->RemoveFront();
+
+        WriteBackIfDirty(inode);
+        Put(inode);
+    }
+    delete dirty;
+}
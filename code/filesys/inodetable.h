@@ -0,0 +1,91 @@
+// inodetable.h
+//	Data structures for the table of file headers (in UNIX terms,
+//	i-nodes) kept in memory.
+//
+//	Every OpenFile of the same file shares one in-core FileHeader,
+//	fetched from disk when the file is first opened.  A header
+//	nobody has open any more stays in the table for a while, so
+//	files opened over and over -- directories above all -- do not
+//	read their header (and index sectors) every time.
+//
+//	A changed header is only marked dirty; it is written back when
+//	its last user lets go of it, or when the table is flushed.
+//
+//	Threads share the table without a lock of its own: looking a
+//	header up, and taking or dropping a reference, never wait.  Each
+//	header has a lock, held while it is read in or written back, so
+//	that a header being read by one thread is not read a second time
+//	by another, and one being written back is not freed meanwhile.
+//	A thread changing a header must have the file to itself -- for a
+//	directory, by holding its lock exclusive.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef INODETABLE_H
+#define INODETABLE_H
+
+#include "filehdr.h"
+#include "openhash.h"
+#include "list.h"
+#include "dlist.h"
+#include "synch.h"
+
+// Default number of headers no one has open that the table keeps.
+#define NumCachedInodes 32
+
+// One file header in the table.
+
+class Inode
+{
+public:
+    Inode(int sector);
+    ~Inode();
+
+    int sector;       // where the header lives on disk
+    FileHeader *hdr;  // the shared in-core copy
+    int refCount;     // number of users holding it
+    bool dirty;       // changed since it was fetched or written back
+    bool detached;    // forgotten by the table while still in use
+    bool loaded;      // "hdr" has been read in from disk
+    Lock *hdrLock;    // held while "hdr" is read in or written back
+    RWLock *lock;     // of a directory: held shared to look names up
+                      // in it, exclusive to add or remove them
+    char *delayed;    // bytes appended past "hdr" that have no disk
+                      // space yet (see OpenFile::WriteAt), or NULL
+    int numDelayed;   // how many
+    char *chunk;      // of a compressed file: the last chunk expanded
+                      // (see OpenFile::ReadChunks), or NULL
+    int chunkNumber;  // which one it is, or -1
+    DListLink<Inode *> unusedLink; // on the unused list, while
+                                   // no one holds it
+};
+
+// The following class defines the table.
+
+class InodeTable
+{
+public:
+    InodeTable(int maxUnused); // Initialize an empty table, keeping
+                               // up to "maxUnused" unused headers
+    ~InodeTable();             // Flush must be called first
+
+    Inode *Get(int sector);    // Return the shared header for a file,
+                               // fetching it if needed
+    void Put(Inode *inode);    // Done with a header
+    void MarkDirty(Inode *inode); // The header was changed
+
+    void Forget(int sector);   // The header sector was freed or is
+                               // about to be rewritten directly
+    void Flush();              // Write back every dirty header
+
+private:
+    OpenHashTable<int, Inode *> *table; // sector # -> inode
+    DList<Inode *> *unused;    // inodes no one holds, oldest first
+    int maxUnused;
+};
+
+#endif // INODETABLE_H
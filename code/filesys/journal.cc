@@ -0,0 +1,446 @@
+// journal.cc
+//	Routines to log file system metadata changes ahead of writing
+//	them in place, and to replay the log after a crash.
+//
+//	The on-disk log, starting at JournalStart:
+//
+//	   superblock | header | more entries | contents | header | ...
+//
+//	A transaction is written in two disk requests: first its extra
+//	entry sectors and the contents of its sectors, in one multi-sector
+//	write, then its header.  The header is what commits it, so a
+//	transaction cut short by a crash is never replayed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "journal.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "main.h"
+
+const int JournalMagic = 0x4a524e4c;
+const int MaxEntries = HeaderEntries + MaxEntrySectors * MoreEntries;
+
+//----------------------------------------------------------------------
+// Journal::Journal
+// 	Initialize a journal with no operation in progress.  Format or
+//	Recover must be called before it is used.
+//
+//	"maxPinned" -- the most buffers a transaction may keep pinned in
+//		the buffer cache; changes past that are not journaled
+//----------------------------------------------------------------------
+
+Journal::Journal(int maxPinned)
+{
+    depth = 0;
+    idleLock = new Lock("journal idle");
+    idle = new Condition("journal idle");
+    maxBlocks = max(1, min(maxPinned, JournalSectors - 2 - MaxEntrySectors));
+    groupSize = max(1, maxBlocks / 2);
+    entries = new int[MaxEntries];
+    numEntries = numBlocks = 0;
+    overflowed = mustReset = FALSE;
+    nextSeq = firstSeq = 1;
+    position = 0;
+    inLog = new Bitmap(NumSectors);
+}
+
+Journal::~Journal()
+{
+    delete[] entries;
+    delete inLog;
+    delete idle;
+    delete idleLock;
+}
+
+//----------------------------------------------------------------------
+// Journal::Format
+// 	Write an empty log on a newly formatted disk.
+//----------------------------------------------------------------------
+
+void Journal::Format()
+{
+    nextSeq = 1;
+    ResetLog();
+}
+
+//----------------------------------------------------------------------
+// Journal::Resume
+// 	Take up the log of a disk that was unmounted cleanly, without
+//	reading it: it is empty, and its next transaction is "seq", as
+//	the file system's superblock says.
+//----------------------------------------------------------------------
+
+void Journal::Resume(int seq)
+{
+    DEBUG(dbgFile, "Journal clean; resuming at transaction " << seq);
+    nextSeq = firstSeq = seq;
+    position = 0;
+    mustReset = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::ReadTransaction
+// 	Read the header (and extra entry sectors) of the transaction that
+//	should be at log position "pos" with number "seq" into "list".
+//	Return the number of entries, or -1 if there is no such committed
+//	transaction there -- the end of the log.
+//----------------------------------------------------------------------
+
+int Journal::ReadTransaction(int pos, int seq, int *list)
+{
+    TransactionHeader header;
+    int numMore;
+
+    if (pos >= JournalSectors - 1)
+        return -1;
+    kernel->synchDisk->ReadSector(JournalStart + 1 + pos, (char *)&header);
+    if ((header.magic != JournalMagic) || (header.seq != seq) ||
+        (header.numEntries < 0) || (header.numEntries > MaxEntries))
+        return -1;
+
+    numMore = divRoundUp(max(header.numEntries - HeaderEntries, 0), MoreEntries);
+    bcopy(header.entries, list, min(header.numEntries, HeaderEntries) * sizeof(int));
+    if (numMore > 0)
+    {
+        int *more = new int[numMore * MoreEntries];
+
+        kernel->synchDisk->ReadSectors(JournalStart + 2 + pos, numMore, (char *)more);
+        bcopy(more, &list[HeaderEntries], (header.numEntries - HeaderEntries) * sizeof(int));
+        delete[] more;
+    }
+    return header.numEntries;
+}
+
+//----------------------------------------------------------------------
+// Journal::Recover
+// 	Replay every committed transaction in the log, oldest first, then
+//	start the log over.  A logged sector is not replayed if a later
+//	transaction revoked it.  A disk without a journal gets an empty one.
+//----------------------------------------------------------------------
+
+void Journal::Recover()
+{
+    JournalSuper super;
+    char buf[SectorSize];
+    int *list = new int[MaxEntries];
+    int *revokedSector, *revokedSeq;
+    int numRevoked = 0, totalEntries = 0;
+    int pos, seq, n, lastSeq;
+
+    kernel->synchDisk->ReadSector(JournalStart, buf);
+    bcopy(buf, &super, sizeof(super));
+    if (super.magic != JournalMagic)
+    {
+        DEBUG(dbgFile, "No journal on disk; starting one.");
+        delete[] list;
+        Format();
+        return;
+    }
+
+    // find the end of the log, and collect its revoked sectors
+    for (pos = 0, seq = super.firstSeq; (n = ReadTransaction(pos, seq, list)) >= 0; seq++)
+    {
+        int numLogged = 0;
+
+        for (int i = 0; i < n; i++)
+            if (list[i] >= 0)
+                numLogged++;
+        totalEntries += n;
+        pos += 1 + divRoundUp(max(n - HeaderEntries, 0), MoreEntries) + numLogged;
+    }
+    lastSeq = seq;
+    revokedSector = new int[totalEntries + 1];
+    revokedSeq = new int[totalEntries + 1];
+    for (pos = 0, seq = super.firstSeq; seq < lastSeq; seq++)
+    {
+        int numLogged = 0;
+
+        n = ReadTransaction(pos, seq, list);
+        for (int i = 0; i < n; i++)
+        {
+            if (list[i] >= 0)
+                numLogged++;
+            else
+            {
+                revokedSector[numRevoked] = -list[i] - 1;
+                revokedSeq[numRevoked++] = seq;
+            }
+        }
+        pos += 1 + divRoundUp(max(n - HeaderEntries, 0), MoreEntries) + numLogged;
+    }
+
+    // replay
+    for (pos = 0, seq = super.firstSeq; seq < lastSeq; seq++)
+    {
+        int block;
+
+        n = ReadTransaction(pos, seq, list);
+        DEBUG(dbgFile, "Replaying journal transaction " << seq << " at log sector " << pos);
+        block = pos + 1 + divRoundUp(max(n - HeaderEntries, 0), MoreEntries);
+        for (int i = 0; i < n; i++)
+        {
+            bool revoked = FALSE;
+
+            if (list[i] < 0)
+                continue;
+            for (int r = 0; r < numRevoked && !revoked; r++)
+                revoked = (revokedSector[r] == list[i]) && (revokedSeq[r] > seq);
+            if (!revoked)
+            {
+                kernel->synchDisk->ReadSector(JournalStart + 1 + block, buf);
+                kernel->bufferCache->WriteSector(list[i], buf);
+            }
+            block++;
+        }
+        pos = block;
+        kernel->stats->numJournalReplays++;
+    }
+    kernel->bufferCache->Flush();
+
+    nextSeq = lastSeq;
+    ResetLog();
+    delete[] revokedSector;
+    delete[] revokedSeq;
+    delete[] list;
+}
+
+//----------------------------------------------------------------------
+// Journal::Begin/End
+// 	Bracket a file system operation.  Operations may nest; when the
+//	outermost one ends, the file headers it changed are written
+//	(still inside the operation, so they are logged too), and the
+//	transaction is committed if enough has been logged to make a
+//	group, or if it could not hold everything.
+//----------------------------------------------------------------------
+
+void Journal::Begin()
+{
+    depth++;
+}
+
+void Journal::End()
+{
+    ASSERT(depth > 0);
+    if (depth == 1)
+        kernel->inodeTable->Flush();
+    depth--;
+    if ((depth == 0) && ((numBlocks >= groupSize) || overflowed || mustReset))
+        Commit();
+    if (depth == 0)
+    {
+        idleLock->Acquire();
+        idle->Broadcast(idleLock);
+        idleLock->Release();
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::Force
+// 	Commit the open transaction, however small, so that every
+//	operation ended so far survives a crash.  Operations other threads
+//	have in progress are waited for first; the caller must not be in
+//	one itself.
+//----------------------------------------------------------------------
+
+void Journal::Force()
+{
+    idleLock->Acquire();
+    while (depth > 0)
+        idle->Wait(idleLock);
+    Commit();
+    idleLock->Release();
+}
+
+//----------------------------------------------------------------------
+// Journal::Log
+// 	Called by the buffer cache when a sector is changed.  Inside an
+//	operation, add the sector to the open transaction, and return TRUE:
+//	its buffer must stay in the cache, unwritten, until Commit.
+//	Return FALSE if the change is not journaled: there is no operation
+//	in progress, or the transaction is full.
+//
+//	"sector" -- the sector changed
+//----------------------------------------------------------------------
+
+bool Journal::Log(int sector)
+{
+    if ((depth == 0) || (sector >= JournalStart))
+        return FALSE;
+    if ((numBlocks >= maxBlocks) || (numEntries >= MaxEntries))
+    {
+        overflowed = TRUE; // the rest of it will not be atomic
+        return FALSE;
+    }
+    for (int i = 0; i < numEntries; i++)
+        if (entries[i] == -(sector + 1))
+        {
+            RemoveEntry(i); // freed and reused in this transaction
+            break;
+        }
+    entries[numEntries++] = sector;
+    numBlocks++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Revoke
+// 	Called by the buffer cache when a run of sectors is freed.  They
+//	are dropped from the open transaction (the cache unpins them), and
+//	those the log still holds an older copy of are revoked.  If there
+//	is no room to record that, the log is emptied before the
+//	transaction is committed, which does just as well.
+//
+//	"firstSector" -- the first sector freed
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void Journal::Revoke(int firstSector, int count)
+{
+    for (int i = numEntries - 1; i >= 0; i--)
+        if ((entries[i] >= firstSector) && (entries[i] < firstSector + count))
+        {
+            RemoveEntry(i);
+            numBlocks--;
+        }
+    for (int s = firstSector; s < firstSector + count && s < JournalStart; s++)
+    {
+        if (!inLog->Test(s))
+            continue;
+        if (numEntries < MaxEntries)
+            entries[numEntries++] = -(s + 1);
+        else
+            mustReset = TRUE;
+        inLog->Clear(s);
+    }
+}
+
+//----------------------------------------------------------------------
+// Journal::Commit
+// 	Write the open transaction to the log, and let the buffers of its
+//	sectors go home.  If the log has no room for it, checkpoint first:
+//	flush the buffer cache, which writes home every sector of the
+//	earlier transactions, and start the log over.
+//----------------------------------------------------------------------
+
+void Journal::Commit()
+{
+    TransactionHeader header;
+    int numMore, need, block;
+    char *buf;
+
+    ASSERT(depth == 0);
+    if (numEntries == 0 && !mustReset)
+        return;
+
+    numMore = divRoundUp(max(numEntries - HeaderEntries, 0), MoreEntries);
+    need = 1 + numMore + numBlocks;
+    if (mustReset || (position + need > JournalSectors - 1))
+    {
+        kernel->bufferCache->Flush(); // pinned buffers are left alone
+        ResetLog();
+    }
+    else if (overflowed)
+    {
+        // changes that did not fit must be home before the rest of
+        // their operations is committed
+        kernel->bufferCache->Flush();
+        kernel->synchDisk->FlushCache();
+    }
+
+    // the extra entries and the sector contents, in one request
+    if (need > 1)
+    {
+        buf = new char[(need - 1) * SectorSize];
+        bzero(buf, numMore * SectorSize);
+        if (numEntries > HeaderEntries)
+            bcopy(&entries[HeaderEntries], buf, (numEntries - HeaderEntries) * sizeof(int));
+        block = numMore;
+        for (int i = 0; i < numEntries; i++)
+            if (entries[i] >= 0)
+                kernel->bufferCache->ReadSector(entries[i], &buf[SectorSize * block++]);
+        kernel->synchDisk->WriteSectors(JournalStart + 2 + position, need - 1, buf);
+        delete[] buf;
+        kernel->synchDisk->FlushCache(); // on the platter before the header
+    }
+
+    // then the header, which commits it
+    bzero(&header, sizeof(header));
+    header.magic = JournalMagic;
+    header.seq = nextSeq;
+    header.numEntries = numEntries;
+    bcopy(entries, header.entries, min(numEntries, HeaderEntries) * sizeof(int));
+    kernel->synchDisk->WriteSector(JournalStart + 1 + position, (char *)&header);
+    kernel->synchDisk->FlushCache(); // and before any of it goes home
+    DEBUG(dbgFile, "Committed journal transaction " << nextSeq << " of " << numBlocks << " sectors");
+
+    for (int i = 0; i < numEntries; i++)
+        if (entries[i] >= 0)
+        {
+            inLog->Mark(entries[i]);
+            kernel->bufferCache->Unpin(entries[i]);
+        }
+    kernel->stats->numJournalCommits++;
+    kernel->stats->numJournalBlocks += numBlocks;
+    position += need;
+    nextSeq++;
+    numEntries = numBlocks = 0;
+    overflowed = FALSE;
+}
+
+//----------------------------------------------------------------------
+// Journal::Checkpoint
+// 	Commit, then write everything home and empty the log, so that
+//	nothing needs replaying.  Done when Nachos halts.
+//----------------------------------------------------------------------
+
+void Journal::Checkpoint()
+{
+    ASSERT(depth == 0);
+    Commit();
+    kernel->inodeTable->Flush();
+    kernel->bufferCache->Flush();
+    kernel->synchDisk->FlushCache();
+    if (nextSeq != firstSeq)
+        ResetLog(); // else the log is empty already
+}
+
+//----------------------------------------------------------------------
+// Journal::ResetLog
+// 	Start the log over, at the next transaction number.  Everything
+//	in it must already be home.
+//----------------------------------------------------------------------
+
+void Journal::ResetLog()
+{
+    char buf[SectorSize];
+    JournalSuper *super = (JournalSuper *)buf;
+
+    firstSeq = nextSeq;
+    position = 0;
+    mustReset = FALSE;
+    delete inLog;
+    inLog = new Bitmap(NumSectors);
+
+    bzero(buf, SectorSize);
+    super->magic = JournalMagic;
+    super->firstSeq = firstSeq;
+    kernel->synchDisk->FlushCache(); // home, before the log is forgotten
+    kernel->synchDisk->WriteSector(JournalStart, buf);
+    kernel->synchDisk->FlushCache(); // reset, before the log is reused
+}
+
+//----------------------------------------------------------------------
+// Journal::RemoveEntry
+// 	Take entry "i" out of the open transaction.
+//----------------------------------------------------------------------
+
+void Journal::RemoveEntry(int i)
+{
+    for (; i < numEntries - 1; i++)
+        entries[i] = entries[i + 1];
+    numEntries--;
+}
@@ -0,0 +1,135 @@
+// journal.h
+//	Data structures for a write-ahead journal of file system metadata.
+//
+//	Create, Remove and making directories each change several
+//	sectors -- file headers, directory entries, the directory index,
+//	the free map.  If Nachos stops half way through, the disk is left
+//	inconsistent.  The journal makes these operations atomic.
+//
+//	Every sector changed (through the buffer cache) while an operation
+//	is in progress is logged: its buffer is pinned in the cache, so it
+//	cannot reach its place on disk yet.  Several operations are folded
+//	into one transaction, which is committed by writing the new
+//	contents of all its sectors to the log, one after another, and
+//	then a header sector describing them.  The buffers are then
+//	unpinned, and get written home whenever the cache gets to them.
+//	Only when the log is full is everything in it written home
+//	(a checkpoint) and the log started over.
+//
+//	When the file system is mounted, the committed transactions still
+//	in the log are replayed, in order, onto the disk.  A transaction
+//	whose header was never written is ignored, as if none of its
+//	operations had happened.
+//
+//	A sector that is freed while the log holds an old copy of it is
+//	"revoked", so that replaying the log cannot overwrite whatever
+//	the sector is used for next.
+//
+//	The log lives in the last JournalSectors sectors of the disk,
+//	which are marked in use when the disk is formatted.  File data
+//	is not journaled.
+//
+//      We assume mutual exclusion is provided by the caller.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "disk.h"
+#include "bitmap.h"
+#include "synch.h"
+
+#define JournalSectors 1024 // size of the log, superblock included
+#define JournalStart (NumSectors - JournalSectors)
+
+#define HeaderEntries 29    // entries in a transaction header sector
+#define MoreEntries 32      // entries in each sector continuing it
+#define MaxEntrySectors 7   // most sectors continuing a header
+
+// The first sector of the log.  The log holds the transactions
+// numbered firstSeq, firstSeq + 1, ..., one after another from the
+// sector after this one, up to the first header with another number.
+
+class JournalSuper
+{
+public:
+    int magic;
+    int firstSeq;
+};
+
+// The sector describing (and committing) one transaction.  Each entry
+// is either a sector logged in the transaction, whose new contents
+// are in the log in the same order as the entries, or a revoked
+// sector, stored as -(sector + 1).  Entries that do not fit here are
+// in the sectors that follow the header, ahead of the contents.
+
+class TransactionHeader
+{
+public:
+    int magic;
+    int seq;
+    int numEntries;
+    int entries[HeaderEntries];
+};
+
+// The following class defines the journal.  The file system brackets
+// each operation with Begin and End; the buffer cache calls Log for
+// every sector changed in between, and Revoke for sectors freed.
+
+class Journal
+{
+public:
+    Journal(int maxPinned); // "maxPinned" -- most buffers one
+                            // transaction may keep in the cache
+    ~Journal();
+
+    void Format();  // start an empty log on a new disk
+    void Recover(); // replay the committed transactions in the log
+    void Resume(int seq); // the log is known to be empty, and to
+                          // go on at transaction "seq"
+    int NextSeq() { return nextSeq; }
+
+    void Begin(); // start a file system operation
+    void End();   // finish it; commit if the transaction is big enough
+    bool InOperation() { return depth > 0; }
+
+    bool Log(int sector); // a sector was changed; TRUE if its buffer
+                          // must now be pinned until Commit
+    void Revoke(int firstSector, int count); // sectors were freed
+
+    void Commit();     // write the transaction to the log
+    void Force();      // commit it once no operation is in
+                       // progress, so what has been done is durable
+    void Checkpoint(); // commit, write everything home, empty the log
+
+private:
+    void ResetLog();   // start the log over, once all of it is home
+    void RemoveEntry(int i);
+    int ReadTransaction(int pos, int seq, int *list);
+    // entries of a committed transaction,
+    // or -1 if there is none at "pos"
+
+    int depth;         // operations in progress (they may nest)
+    Lock *idleLock;    // for waiting until there are none
+    Condition *idle;   // signalled when the last one ends
+    int maxBlocks;     // most sectors logged in one transaction
+    int groupSize;     // commit once this many sectors are logged
+
+    int *entries;      // the open transaction, encoded as on disk
+    int numEntries;
+    int numBlocks;     // entries that are logged sectors
+    bool overflowed;   // some change could not be logged
+    bool mustReset;    // some revoke could not be recorded
+
+    int nextSeq;       // number of the next transaction
+    int firstSeq;      // number of the first one in the log
+    int position;      // next free log sector, after the superblock
+    Bitmap *inLog;     // sectors the log holds a copy of
+};
+
+#endif // JOURNAL_H
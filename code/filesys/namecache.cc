@@ -0,0 +1,157 @@
+// namecache.cc
+//	Routines to manage the cache of path name lookups.
+//
+//	Entries live in a fixed array and are found through a hash table
+//	of chains threaded through the array.  A new lookup replaces the
+//	oldest entry.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "namecache.h"
+#include "debug.h"
+
+//----------------------------------------------------------------------
+// NameCache::NameCache
+// 	Initialize an empty name cache.
+//
+//	"size" -- the number of lookups the cache can hold
+//----------------------------------------------------------------------
+
+NameCache::NameCache(int size)
+{
+    ASSERT(size > 0);
+    numEntries = size;
+    entries = new NameCacheEntry[size];
+    memset(entries, 0, size * sizeof(NameCacheEntry)); // keep valgrind happy
+    for (int i = 0; i < size; i++)
+        entries[i].valid = FALSE;
+    for (int b = 0; b < NumNameCacheBuckets; b++)
+        buckets[b] = -1;
+    hand = 0;
+}
+
+//----------------------------------------------------------------------
+// NameCache::~NameCache
+// 	De-allocate the name cache.
+//----------------------------------------------------------------------
+
+NameCache::~NameCache()
+{
+    delete[] entries;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Lookup
+// 	Return TRUE if the result of looking up "name" in the directory
+//	whose header is in "dirSector" is cached, and the result in
+//	"*sector": the header sector of the file, or -1 if the directory
+//	has no such name.
+//----------------------------------------------------------------------
+
+bool NameCache::Lookup(int dirSector, char *name, int *sector)
+{
+    int i = FindEntry(dirSector, name);
+
+    if (i == -1)
+        return FALSE;
+    DEBUG(dbgFile, "Name cache hit: " << name << " in sector #" << dirSector << " is " << entries[i].sector);
+    *sector = entries[i].sector;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Enter
+// 	Remember that looking up "name" in the directory whose header is
+//	in "dirSector" gives "sector" (-1 if the name is not there),
+//	replacing what was cached about that name before.
+//----------------------------------------------------------------------
+
+void NameCache::Enter(int dirSector, char *name, int sector)
+{
+    int i = FindEntry(dirSector, name);
+
+    if (i == -1)
+    {
+        i = hand;
+        hand = (hand + 1) % numEntries;
+        if (entries[i].valid)
+            Unlink(i);
+
+        int b = Hash(dirSector, name);
+        entries[i].valid = TRUE;
+        entries[i].dirSector = dirSector;
+        strncpy(entries[i].name, name, FileNameMaxLen);
+        entries[i].name[FileNameMaxLen] = '\0';
+        entries[i].next = buckets[b];
+        buckets[b] = i;
+    }
+    entries[i].sector = sector;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Purge
+// 	Forget every lookup made in the directory whose header is in
+//	"dirSector", and every lookup that found it; the sector is about
+//	to be reused.
+//----------------------------------------------------------------------
+
+void NameCache::Purge(int dirSector)
+{
+    for (int i = 0; i < numEntries; i++)
+    {
+        if (entries[i].valid &&
+            (entries[i].dirSector == dirSector || entries[i].sector == dirSector))
+        {
+            Unlink(i);
+            entries[i].valid = FALSE;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// NameCache::Hash
+// 	Which chain a lookup belongs on.
+//----------------------------------------------------------------------
+
+int NameCache::Hash(int dirSector, char *name)
+{
+    unsigned hash = (unsigned)dirSector;
+
+    for (int i = 0; i < FileNameMaxLen && name[i] != '\0'; i++)
+        hash = hash * 31 + (unsigned char)name[i];
+    return hash % NumNameCacheBuckets;
+}
+
+//----------------------------------------------------------------------
+// NameCache::FindEntry
+// 	Return the entry caching "name" in "dirSector", or -1.
+//----------------------------------------------------------------------
+
+int NameCache::FindEntry(int dirSector, char *name)
+{
+    for (int i = buckets[Hash(dirSector, name)]; i != -1; i = entries[i].next)
+        if (entries[i].dirSector == dirSector &&
+            !strncmp(entries[i].name, name, FileNameMaxLen))
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// NameCache::Unlink
+// 	Take entry "i" out of its hash chain.
+//----------------------------------------------------------------------
+
+void NameCache::Unlink(int i)
+{
+    int *link = &buckets[Hash(entries[i].dirSector, entries[i].name)];
+
+    while (*link != i)
+    {
+        ASSERT(*link != -1);
+        link = &entries[*link].next;
+    }
+    *link = entries[i].next;
+}
@@ -0,0 +1,72 @@
+// namecache.h
+//	Data structures for a cache of path name lookups, so that
+//	walking a path like "/t0/aa/f1" does not have to read every
+//	directory along the way each time.
+//
+//	The cache maps <directory header sector, name> to the header
+//	sector of the file or subdirectory with that name.  It also
+//	remembers names known NOT to be in a directory (negative
+//	entries), so failed lookups are cheap too.
+//
+//	The file system keeps the cache up to date as it creates and
+//	removes files; the cache itself never touches the disk.  When
+//	it is full, entries are recycled in the order they were made.
+//
+//      We assume mutual exclusion is provided by the caller.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#ifndef NAMECACHE_H
+#define NAMECACHE_H
+
+#include "directory.h"
+
+#define NumNameCacheEntries 256
+#define NumNameCacheBuckets 64
+
+// One cached lookup.
+
+class NameCacheEntry
+{
+public:
+    bool valid;                    // does this entry hold a lookup?
+    int dirSector;                 // the directory that was searched
+    char name[FileNameMaxLen + 1]; // the name looked up
+    int sector;                    // what it found; -1 = not there
+    int next;                      // next entry in the hash chain, or -1
+};
+
+// The following class defines the name cache.
+
+class NameCache
+{
+public:
+    NameCache(int size); // Initialize an empty cache of "size" entries
+    ~NameCache();
+
+    bool Lookup(int dirSector, char *name, int *sector);
+    // TRUE if the lookup of "name" in
+    // "dirSector" is cached, with its
+    // result (maybe -1) in "*sector"
+    void Enter(int dirSector, char *name, int sector);
+    // Remember a lookup; "sector" is
+    // -1 if the name is not there
+    void Purge(int dirSector); // Forget everything about a
+                               // directory that is going away
+
+private:
+    int Hash(int dirSector, char *name);
+    int FindEntry(int dirSector, char *name); // -1 if not cached
+    void Unlink(int i);        // take entry "i" out of its chain
+
+    int numEntries;
+    NameCacheEntry *entries;
+    int buckets[NumNameCacheBuckets]; // first entry of each chain
+    int hand;                  // next entry to recycle
+};
+
+#endif // NAMECACHE_H
@@ -5,7 +5,8 @@
 //	the OpenFile data structure).
 //
 //	Also as in UNIX, for convenience, we keep the file header in
-//	memory while the file is open.
+//	memory while the file is open; all the OpenFiles of one file
+//	share the same copy, from the inode table.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,31 +17,61 @@
 #include "main.h"
 #include "filehdr.h"
 #include "openfile.h"
-#include "synchdisk.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "journal.h"
+#include "execcache.h"
+#include "syscall.h"
+#include "slab.h"
+
+// Open files, one made and freed for each file opened.
+static SlabCache openFileCache("open files", sizeof(OpenFile));
 
 //----------------------------------------------------------------------
 // OpenFile::OpenFile
 // 	Open a Nachos file for reading and writing.  Bring the file header
-//	into memory while the file is open.
+//	into memory while the file is open, unless it is already there.
 //
 //	"sector" -- the location on disk of the file header for this file
 //----------------------------------------------------------------------
 
 OpenFile::OpenFile(int sector)
 {
-    hdr = new FileHeader;
-    hdr->FetchFrom(sector);
+    inode = kernel->inodeTable->Get(sector);
+    hdr = inode->hdr;
     seekPosition = 0;
+    lastReadSector = -1;
+    readAheadWindow = 0;
+    readAheadNext = 0;
+    advice = AdviseNormal;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::~OpenFile
 // 	Close a Nachos file, de-allocating any in-memory data structures.
+//	What was appended to it and is still in memory is written out.
 //----------------------------------------------------------------------
 
 OpenFile::~OpenFile()
 {
-    delete hdr;
+    WriteDelayed();
+    kernel->inodeTable->Put(inode);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::operator new, OpenFile::operator delete
+// 	Take an open file from its slab cache, and give it back.
+//----------------------------------------------------------------------
+
+void *OpenFile::operator new(size_t size)
+{
+    ASSERT(size == sizeof(OpenFile));
+    return openFileCache.Alloc();
+}
+
+void OpenFile::operator delete(void *p)
+{
+    openFileCache.Free(p);
 }
 
 //----------------------------------------------------------------------
@@ -72,6 +103,9 @@ void OpenFile::Seek(int position)
 int OpenFile::Read(char *into, int numBytes)
 {
     int result = ReadAt(into, numBytes, seekPosition);
+    if (result > 0 && !hdr->IsInline() && !hdr->IsCompressed())
+        ReadAhead(divRoundDown(seekPosition, SectorSize),
+                  divRoundDown(seekPosition + result - 1, SectorSize));
     seekPosition += result;
     return result;
 }
@@ -91,16 +125,42 @@ int OpenFile::Write(char *into, int numBytes)
 //
 //	There is no guarantee the request starts or ends on an even disk sector
 //	boundary; however the disk only knows how to read/write a whole disk
-//	sector at a time.  Thus:
+//	sector at a time.  Thus each sector of the request is worked on in
+//	place, in its buffer cache buffer:
 //
 //	For ReadAt:
-//	   We read in all of the full or partial sectors that are part of the
-//	   request, but we only copy the part we are interested in.
+//	   We copy out only the part of each sector we are interested in.
+//	   Sectors that are consecutive on disk are gotten from the cache
+//	   together, so that a run missing from it is read in one request.
 //	For WriteAt:
-//	   We must first read in any sectors that will be partially written,
-//	   so that we don't overwrite the unmodified portion.  We then copy
-//	   in the data that will be modified, and write back all the full
-//	   or partial sectors that are part of the request.
+//	   We copy in the bytes being changed and mark the buffer dirty.
+//	   A sector that is only partially written is read in first, so
+//	   that we don't overwrite the unmodified portion; one that is
+//	   entirely overwritten is not read at all.  A big write of whole
+//	   sectors that are consecutive on disk is written through to the
+//	   disk a run at a time, without displacing the cache.
+//
+//	Because the cache is write-back, many small writes to the same
+//	sector (appending to a log a few bytes at a time, say) reach the
+//	disk as a single write, when the buffer is replaced or flushed.
+//
+//	WriteAt past the end of the file makes the file longer first (see
+//	FileSystem::Extend); a gap left between the old end and "position"
+//	reads back as zeros.  If the disk is full, the write stops at the
+//	end of the file, as it did before.
+//
+//	Allocation is delayed, though, for bytes appended past the space
+//	the file already has: they are kept in memory with the file's
+//	header (see Delay), up to MaxDelayedBytes, and only given disk
+//	space when they are written out -- all at once, so in one run of
+//	sectors.  Any other access to the file writes them out first.
+//
+//	A small file kept in its header has no sectors of its own: its
+//	bytes are copied straight out of/into the header, which is then
+//	written back like any other changed header.
+//
+//	A compressed file is read a chunk at a time (see ReadChunks).
+//	Writing to it expands it back first (see FileSystem::Repack).
 //
 //	"into" -- the buffer to contain the data to be read from disk
 //	"from" -- the buffer containing the data to be written to disk
@@ -111,82 +171,523 @@ int OpenFile::Write(char *into, int numBytes)
 
 int OpenFile::ReadAt(char *into, int numBytes, int position)
 {
-    int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    char *buf;
+    int fileLength;
+    int i, k, firstSector, lastSector, start, end;
+    int sector, run, got;
+    CacheBuffer *buffers[MaxRunSectors];
+
+    WriteDelayed();
+    fileLength = hdr->FileLength();
 
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
     if ((position + numBytes) > fileLength)
         numBytes = fileLength - position;
     DEBUG(dbgFile, "Reading " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    if (hdr->IsInline()) {
+        hdr->ReadInline(into, numBytes, position);
+        return numBytes;
+    }
+    if (hdr->IsCompressed())
+        return ReadChunks(into, numBytes, position);
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    // read in all the full and partial sectors that we need
-    buf = new char[numSectors * SectorSize];
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->ReadSector(hdr->ByteToSector(i * SectorSize),
-                                      &buf[(i - firstSector) * SectorSize]);
-
-    // copy the part we want
-    bcopy(&buf[position - (firstSector * SectorSize)], into, numBytes);
-    delete[] buf;
+    // get the sectors a run of consecutive disk sectors at a time, so
+    // that those not cached are read with one request, and copy the
+    // part we want out of each
+    for (i = firstSector; i <= lastSector; i += got) {
+        sector = hdr->ByteToSector(i * SectorSize);
+        for (run = 1; (i + run <= lastSector) && (run < MaxRunSectors) &&
+                 (hdr->ByteToSector((i + run) * SectorSize) == sector + run); run++)
+            ;
+        got = kernel->bufferCache->GetBuffers(sector, run, buffers);
+        for (k = 0; k < got; k++) {
+            start = max(position, (i + k) * SectorSize);
+            end = min(position + numBytes, (i + k + 1) * SectorSize);
+            bcopy(&buffers[k]->data[start - (i + k) * SectorSize], &into[start - position], end - start);
+            kernel->bufferCache->ReleaseBuffer(buffers[k], FALSE, Transient());
+        }
+    }
     return numBytes;
 }
 
 int OpenFile::WriteAt(char *from, int numBytes, int position)
+{
+    kernel->execCache->Invalidate(inode->sector);   // if it is a program
+    if (Delay(from, numBytes, position))
+        return numBytes;
+    WriteDelayed();             // then try again with room for more
+    if (Delay(from, numBytes, position))
+        return numBytes;
+    return WriteOut(from, numBytes, position);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ReadChunks
+// 	Read from a compressed file, as ReadAt does, by expanding each
+//	chunk the bytes lie in.  The last chunk expanded is kept with
+//	the file's header, so that reading on through it, a little at a
+//	time, expands it only once.  The header's lock is held meanwhile,
+//	since everyone sharing the header shares the chunk too.
+//----------------------------------------------------------------------
+
+int OpenFile::ReadChunks(char *into, int numBytes, int position)
+{
+    int chunk, start, end;
+
+    inode->hdrLock->Acquire();
+    if (inode->chunk == NULL)
+        inode->chunk = new char[ChunkBytes];
+    for (chunk = position / ChunkBytes; chunk * ChunkBytes < position + numBytes; chunk++) {
+        if (inode->chunkNumber != chunk) {
+            hdr->ReadChunk(chunk, inode->chunk);
+            inode->chunkNumber = chunk;
+        }
+        start = max(position, chunk * ChunkBytes);
+        end = min(position + numBytes, (chunk + 1) * ChunkBytes);
+        bcopy(&inode->chunk[start - chunk * ChunkBytes], &into[start - position], end - start);
+    }
+    inode->hdrLock->Release();
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Delay
+// 	Keep bytes being appended in memory instead of allocating disk
+//	space for them now, so that a program appending a little at a
+//	time gets the space in one run when they are written out, and
+//	data that is deleted in the meantime never takes any.  Return
+//	FALSE, doing nothing, unless the write starts at the end of the
+//	file, past the space it already has, and fits with what is kept
+//	already.
+//
+//	Writes made during a journaled operation (to directories, or the
+//	free map) are never delayed: they must be logged with the rest
+//	of it.
+//----------------------------------------------------------------------
+
+bool OpenFile::Delay(char *from, int numBytes, int position)
 {
     int fileLength = hdr->FileLength();
-    int i, firstSector, lastSector, numSectors;
-    bool firstAligned, lastAligned;
-    char *buf;
 
+    if ((numBytes <= 0) || kernel->journal->InOperation() ||
+        (position != fileLength + inode->numDelayed) ||
+        (fileLength < hdr->SpaceAllocated()) ||
+        (inode->numDelayed + numBytes > MaxDelayedBytes))
+        return FALSE;
+    if (inode->delayed == NULL)
+        inode->delayed = new char[MaxDelayedBytes];
+    bcopy(from, &inode->delayed[inode->numDelayed], numBytes);
+    inode->numDelayed += numBytes;
+    DEBUG(dbgFile, "Delaying " << numBytes << " bytes at " << position);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteDelayed
+// 	Write out what Delay kept, allocating its disk space now.  The
+//	bytes are taken from the header before they are written, so that
+//	appends made while the disk is busy are kept afresh.  Nothing is
+//	written for a file removed in the meantime.
+//
+//	As with a write that finds the disk full, what does not fit is
+//	lost; the file ends where the space ran out.
+//----------------------------------------------------------------------
+
+void OpenFile::WriteDelayed()
+{
+    char *data = inode->delayed;
+    int numBytes = inode->numDelayed;
+
+    if (numBytes == 0)
+        return;
+    inode->delayed = NULL;
+    inode->numDelayed = 0;
+    if (!inode->detached)
+        WriteOut(data, numBytes, hdr->FileLength());
+    delete [] data;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Flush
+// 	Write back the file's data sectors that are dirty in the buffer
+//	cache, each run of consecutive sectors at once, and return once
+//	they are on disk; bytes appended and kept in memory are written
+//	out first.  The header and index, being metadata, are left to the
+//	journal.  A small file kept in its header has no data sectors; the
+//	chunks of a compressed one are not known here, so the whole cache
+//	is flushed for it.
+//----------------------------------------------------------------------
+
+void OpenFile::Flush()
+{
+    int numSectors, sector, run;
+
+    WriteDelayed();
+    if (hdr->IsInline())
+        return;
+    if (hdr->IsCompressed()) {
+        kernel->bufferCache->Flush();
+        return;
+    }
+    numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    for (int i = 0; i < numSectors; i += run) {
+        sector = hdr->ByteToSector(i * SectorSize);
+        for (run = 1; (i + run < numSectors) &&
+                 (hdr->ByteToSector((i + run) * SectorSize) == sector + run); run++)
+            ;
+        kernel->bufferCache->FlushRange(sector, run);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenFile::WriteOut
+// 	Write to the file as described for WriteAt, without delaying.  A
+//	compressed file is expanded first, and the clusters written to
+//	that are shared with clones are copied; if the disk is too full
+//	for that, nothing is written.
+//----------------------------------------------------------------------
+
+int OpenFile::WriteOut(char *from, int numBytes, int position)
+{
+    int fileLength;
+    int i, firstSector, lastSector, start, end;
+    int sector, run;
+    CacheBuffer *buffer;
+
+    if ((numBytes > 0) && hdr->IsCompressed() &&
+        !kernel->fileSystem->Repack(this, FALSE))
+        return 0;
+    fileLength = hdr->FileLength();
+    if ((numBytes > 0) && (position + numBytes > fileLength) &&
+        kernel->fileSystem->Extend(this, position + numBytes)) {
+        if (position > fileLength)
+            ZeroFill(fileLength, position);
+        fileLength = hdr->FileLength();
+    }
     if ((numBytes <= 0) || (position >= fileLength))
         return 0; // check request
     if ((position + numBytes) > fileLength)
         numBytes = fileLength - position;
     DEBUG(dbgFile, "Writing " << numBytes << " bytes at " << position << " from file of length " << fileLength);
+    if (hdr->IsShared() && !kernel->fileSystem->Unshare(this, position, numBytes))
+        return 0;
+    if (hdr->IsInline()) {
+        inode->hdrLock->Acquire();
+        hdr->WriteInline(from, numBytes, position);
+        kernel->inodeTable->MarkDirty(inode);
+        inode->hdrLock->Release();
+        return numBytes;
+    }
 
     firstSector = divRoundDown(position, SectorSize);
     lastSector = divRoundDown(position + numBytes - 1, SectorSize);
-    numSectors = 1 + lastSector - firstSector;
 
-    buf = new char[numSectors * SectorSize];
+    // copy in the bytes we want to change, reading in the sectors
+    // that are to be partially modified; runs of whole sectors that
+    // are consecutive on disk go straight to it instead
+    for (i = firstSector; i <= lastSector; i += run) {
+        start = max(position, i * SectorSize);
+        end = min(position + numBytes, (i + 1) * SectorSize);
+        sector = hdr->ByteToSector(i * SectorSize);
+        run = 1;
+        if (start == i * SectorSize) {
+            while ((run < MaxRunSectors) &&
+                   ((i + run + 1) * SectorSize <= position + numBytes) &&
+                   (hdr->ByteToSector((i + run) * SectorSize) == sector + run))
+                run++;
+        }
+        if (run > 1) {
+            kernel->bufferCache->WriteThrough(sector, run, &from[start - position]);
+            continue;
+        }
+        buffer = kernel->bufferCache->GetBuffer(sector, (end - start) < SectorSize);
+        bcopy(&from[start - position], &buffer->data[start - i * SectorSize], end - start);
+        kernel->bufferCache->ReleaseBuffer(buffer, TRUE);
+    }
+    return numBytes;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::ZeroFill
+// 	Write zeros over the bytes of the file from "from" up to "to",
+//	which a write past the old end of the file skipped over.
+//----------------------------------------------------------------------
 
-    memset(buf, 0, sizeof(char) * numSectors * SectorSize); // dummy operation to keep valgrind happy
+void OpenFile::ZeroFill(int from, int to)
+{
+    char zeros[SectorSize];
 
-    firstAligned = (position == (firstSector * SectorSize));
-    lastAligned = ((position + numBytes) == ((lastSector + 1) * SectorSize));
+    memset(zeros, 0, SectorSize);
+    while (from < to) {
+        int numBytes = min(to - from, SectorSize - from % SectorSize);
 
-    // read in first and last sector, if they are to be partially modified
-    if (!firstAligned)
-        ReadAt(buf, SectorSize, firstSector * SectorSize);
-    if (!lastAligned && ((firstSector != lastSector) || firstAligned))
-        ReadAt(&buf[(lastSector - firstSector) * SectorSize],
-               SectorSize, lastSector * SectorSize);
+        from += WriteOut(zeros, numBytes, from);
+    }
+}
 
-    // copy in the bytes we want to change
-    bcopy(from, &buf[position - (firstSector * SectorSize)], numBytes);
+//----------------------------------------------------------------------
+// OpenFile::ReadAhead
+// 	Called by Read after reading the file sectors "firstSector"
+//	through "lastSector".  If the read starts where the previous one left off
+//	(or at the beginning of the file), the file is being read
+//	sequentially, and the sectors that follow are handed to the
+//	buffer cache to load in the background.
+//
+//	The window starts out as big as the read itself and doubles on
+//	each sequential read that moves into a new sector, up to
+//	MaxReadAhead; any other access turns read ahead off again.  Reads
+//	that stay inside the last sector (reading a byte at a time, say)
+//	leave the window alone.
+//
+//	A file advised to be read in order gets a window of
+//	SequentialReadAhead whatever it does; one advised to be read at
+//	random, none.
+//----------------------------------------------------------------------
 
-    // write modified sectors back
-    for (i = firstSector; i <= lastSector; i++)
-        kernel->synchDisk->WriteSector(hdr->ByteToSector(i * SectorSize),
-                                       &buf[(i - firstSector) * SectorSize]);
-    delete[] buf;
-    return numBytes;
+void OpenFile::ReadAhead(int firstSector, int lastSector)
+{
+    int numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    int stride = 1 + lastSector - firstSector;
+    int i, last;
+
+    if (advice == AdviseRandom)
+        return;
+    if ((firstSector == lastReadSector) && (lastSector == lastReadSector))
+        return; // still in the same sector
+    if (advice == AdviseSequential) {
+        readAheadWindow = SequentialReadAhead;
+        if ((firstSector != lastReadSector) && (firstSector != lastReadSector + 1))
+            readAheadNext = 0;
+    } else if ((firstSector == lastReadSector) || (firstSector == lastReadSector + 1)) {
+        readAheadWindow = min(max(2 * readAheadWindow, stride), MaxReadAhead);
+    } else {
+        readAheadWindow = 0;
+        readAheadNext = 0;
+    }
+    lastReadSector = lastSector;
+    if (readAheadWindow == 0)
+        return;
+
+    last = min(lastSector + readAheadWindow, numSectors - 1);
+    for (i = max(readAheadNext, lastSector + 1); i <= last; i++)
+        kernel->bufferCache->ReadAhead(hdr->ByteToSector(i * SectorSize),
+                                       Transient());
+    readAheadNext = max(readAheadNext, last + 1);
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Transient
+// 	Return TRUE if the file is being read once through, so that the
+//	buffer cache need not keep its sectors once they are read: it has
+//	been advised to be read in order, or, without advice, read ahead
+//	has grown to its largest, as in a long scan.
+//----------------------------------------------------------------------
+
+bool OpenFile::Transient()
+{
+    return (advice == AdviseSequential) ||
+           ((advice == AdviseNormal) && (readAheadWindow == MaxReadAhead));
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Advise
+// 	Take a hint about how the file will be used.  AdviseNormal,
+//	AdviseSequential and AdviseRandom are about the whole file, and
+//	set how it is read ahead and cached from now on.  AdviseWillNeed
+//	starts the sectors of the range being read in now, as far as the
+//	buffer cache will queue them; AdviseDontNeed has those of them it
+//	holds replaced first.  Return FALSE if "hint" is none of these,
+//	or the range is negative.
+//
+//	"offset", "length" -- the range the hint is about; a length of 0
+//		runs to the end of the file
+//	"hint" -- one of the Advise constants in syscall.h
+//----------------------------------------------------------------------
+
+bool OpenFile::Advise(int offset, int length, int hint)
+{
+    int numSectors, first, last, sector;
+
+    if ((offset < 0) || (length < 0))
+        return FALSE;
+    switch (hint) {
+    case AdviseNormal:
+    case AdviseSequential:
+    case AdviseRandom:
+        advice = hint;
+        readAheadWindow = readAheadNext = 0;
+        return TRUE;
+    case AdviseWillNeed:
+    case AdviseDontNeed:
+        break;
+    default:
+        return FALSE;
+    }
+
+    WriteDelayed();
+    if (hdr->IsInline() || hdr->IsCompressed())
+        return TRUE; // no sectors of the file's own to go by
+    numSectors = divRoundUp(hdr->FileLength(), SectorSize);
+    first = divRoundDown(offset, SectorSize);
+    last = numSectors - 1;
+    if (length > 0)
+        last = min(last, divRoundDown(offset + length - 1, SectorSize));
+    for (int i = first; i <= last; i++) {
+        sector = hdr->ByteToSector(i * SectorSize);
+        if (hint == AdviseWillNeed)
+            kernel->bufferCache->ReadAhead(sector);
+        else
+            kernel->bufferCache->Demote(sector, 1);
+    }
+    return TRUE;
 }
 
 //----------------------------------------------------------------------
 // OpenFile::Length
-// 	Return the number of bytes in the file.
+// 	Return the number of bytes in the file, counting those appended
+//	but not yet written out.
 //----------------------------------------------------------------------
 
 int OpenFile::Length()
 {
-    return hdr->FileLength();
+    return hdr->FileLength() + inode->numDelayed;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::HeaderSector
+// 	Return the sector of the file's header, which tells the file
+//	apart from every other file for as long as it exists.
+//----------------------------------------------------------------------
+
+int OpenFile::HeaderSector()
+{
+    return inode->sector;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::IsCompressed
+// 	Return whether the file's data is kept compressed.
+//----------------------------------------------------------------------
+
+bool OpenFile::IsCompressed()
+{
+    return hdr->IsCompressed();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Replace
+// 	Free the file's data sectors, to "freeMap", and make the data of
+//	"packed" -- allocated and written for the purpose -- its data
+//	instead, compressed or not (see FileSystem::Repack).  The chunk
+//	kept from the old data is dropped.  The caller writes back the
+//	free map.
+//----------------------------------------------------------------------
+
+void OpenFile::Replace(PersistentBitmap *freeMap, FileHeader *packed, bool compressed)
+{
+    inode->hdrLock->Acquire();
+    hdr->Deallocate(freeMap);
+    hdr->Adopt(packed, compressed);
+    inode->chunkNumber = -1;
+    kernel->inodeTable->MarkDirty(inode);
+    inode->hdrLock->Release();
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Share
+// 	Make this file, just created and empty, a clone of "source",
+//	sharing its data clusters (see FileHeader::Share), and mark both
+//	headers to be written back.  The caller writes back the free map.
+//	Return FALSE, leaving the file empty, if they cannot be shared.
+//----------------------------------------------------------------------
+
+bool OpenFile::Share(PersistentBitmap *freeMap, OpenFile *source)
+{
+    bool shared;
+
+    source->WriteDelayed();
+    source->inode->hdrLock->Acquire();
+    inode->hdrLock->Acquire();
+    shared = hdr->Share(freeMap, source->hdr, inode->sector);
+    if (shared) {
+        kernel->inodeTable->MarkDirty(inode);
+        kernel->inodeTable->MarkDirty(source->inode);
+    }
+    inode->hdrLock->Release();
+    source->inode->hdrLock->Release();
+    return shared;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Unshare
+// 	Give the file a copy of its own of the data cluster holding byte
+//	"position", out of "freeMap", if it shares it with a clone, so
+//	that it can be written.  The caller writes back the free map.
+//	Return FALSE, leaving the file as it was, if the disk is full.
+//----------------------------------------------------------------------
+
+bool OpenFile::Unshare(PersistentBitmap *freeMap, int position)
+{
+    bool unshared = TRUE;
+
+    inode->hdrLock->Acquire();
+    if (hdr->Shares(freeMap, position)) {
+        unshared = hdr->Unshare(freeMap, position, inode->sector);
+        if (unshared)
+            kernel->inodeTable->MarkDirty(inode);
+    }
+    inode->hdrLock->Release();
+    return unshared;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Extend
+// 	Make the file "numBytes" long, allocating disk space for it out of
+//	"freeMap".  The new file header is written back when the file is
+//	closed; the caller writes back the free map.  Return FALSE, leaving the file as it was, if
+//	the disk is full.
+//
+//	The new bytes hold whatever the disk had there before; the caller
+//	is expected to overwrite them.
+//
+//	The header's lock is held throughout, so that nobody else sharing
+//	it writes it back half changed.
+//----------------------------------------------------------------------
+
+bool OpenFile::Extend(PersistentBitmap *freeMap, int numBytes)
+{
+    bool extended;
+
+    inode->hdrLock->Acquire();
+    extended = hdr->Extend(freeMap, numBytes, inode->sector);
+    if (extended)
+        kernel->inodeTable->MarkDirty(inode);
+    inode->hdrLock->Release();
+    return extended;
+}
+
+//----------------------------------------------------------------------
+// OpenFile::Reserve
+// 	Allocate the disk space for the file to grow to "numBytes", out of
+//	"freeMap", without making it longer: a hint from a program that
+//	means to append that much, so that it gets the space in one run.
+//	The caller writes back the free map.  Return FALSE, leaving the
+//	file as it was, if the disk is full.
+//----------------------------------------------------------------------
+
+bool OpenFile::Reserve(PersistentBitmap *freeMap, int numBytes)
+{
+    bool reserved;
+
+    inode->hdrLock->Acquire();
+    reserved = hdr->Reserve(freeMap, numBytes, inode->sector);
+    if (reserved)
+        kernel->inodeTable->MarkDirty(inode);
+    inode->hdrLock->Release();
+    return reserved;
 }
 
 #endif //FILESYS_STUB
@@ -74,6 +74,17 @@ private:
 
 #else // FILESYS
 class FileHeader;
+class Inode;
+class PersistentBitmap;
+
+// Largest number of sectors read ahead of a sequential reader, and
+// of one that has said it will read the file in order (see Advise).
+#define MaxReadAhead 16
+#define SequentialReadAhead (2 * MaxReadAhead)
+
+// Most bytes appended to a file that are kept in memory before they
+// are given disk space.
+#define MaxDelayedBytes (16 * SectorSize)
 
 class OpenFile
 {
@@ -82,6 +93,9 @@ public:
 						  // at "sector" on the disk
 	~OpenFile();		  // Close the file
 
+	void *operator new(size_t size); // from a slab cache (see slab.h)
+	void operator delete(void *p);
+
 	void Seek(int position); // Set the position from which to
 							 // start reading/writing -- UNIX lseek
 
@@ -101,9 +115,61 @@ public:
 				  // than the UNIX idiom -- lseek to
 				  // end of file, tell, lseek back
 
+	bool Extend(PersistentBitmap *freeMap, int numBytes);
+	// Make the file "numBytes" long;
+	// FALSE if the disk is full
+	bool Reserve(PersistentBitmap *freeMap, int numBytes);
+	// Allocate room for the file to grow
+	// to "numBytes"; FALSE if the disk is full
+
+	int HeaderSector(); // Where the file's header is, which
+						// identifies the file
+
+	bool IsCompressed(); // Is the file kept compressed?
+	void Replace(PersistentBitmap *freeMap, FileHeader *packed, bool compressed);
+	// Give the file new contents, written
+	// to the sectors of "packed"
+	bool Share(PersistentBitmap *freeMap, OpenFile *source);
+	// Make this new, empty file a clone of
+	// "source"; FALSE if it cannot share
+	bool Unshare(PersistentBitmap *freeMap, int position);
+	// Copy the cluster holding "position" if
+	// it is shared; FALSE if the disk is full
+
+	void WriteDelayed(); // Give the bytes appended but not yet
+						 // on disk their space, and write them
+	void Flush(); // Write the file's data from the buffer
+				  // cache to disk, and wait for it
+	bool Advise(int offset, int length, int hint);
+	// Say how the file, or a range of it,
+	// will be used (cf. Fadvise in
+	// syscall.h); FALSE if "hint" is not
+	// one of the Advise constants
+
 private:
-	FileHeader *hdr;  // Header for this file
+	bool Delay(char *from, int numBytes, int position);
+	// Keep an append in memory, if we can
+	int WriteOut(char *from, int numBytes, int position);
+	// Write to the file's disk space,
+	// allocating what it needs
+	void ZeroFill(int from, int to); // Write zeros over a gap
+	int ReadChunks(char *into, int numBytes, int position);
+	// Read from a compressed file
+	void ReadAhead(int firstSector, int lastSector);
+	// Note which sectors were just read,
+	// and prefetch what comes next if
+	// the file is read sequentially
+	bool Transient(); // Is it being read once through, so
+					  // that its sectors need not be kept?
+
+	Inode *inode;	  // Entry in the inode table for this file
+	FileHeader *hdr;  // Header for this file, shared through "inode"
 	int seekPosition; // Current position within the file
+
+	int lastReadSector;	 // Last file sector read, or -1
+	int readAheadWindow; // How far ahead to read; 0 if not sequential
+	int readAheadNext;	 // First sector not yet read ahead
+	int advice;			 // How the file is to be read, by Advise
 };
 
 #endif // FILESYS
@@ -8,6 +8,15 @@
 
 #include "copyright.h"
 #include "pbitmap.h"
+#include "disk.h"
+#include "synch.h"
+#include "main.h"
+
+// Number of bits of the map stored in one sector of the bitmap file
+static const int BitsInSector = SectorSize * BitsInByte;
+
+// What is known of each sector of the share counts
+enum { ShareUnread, ShareRead, ShareChanged };
 
 //----------------------------------------------------------------------
 // PersistentBitmap::PersistentBitmap(int)
@@ -16,11 +25,22 @@
 //
 //	"numItems" is the number of bits in the bitmap.
 //
-//      This constructor does not initialize the bitmap from a disk file
+//      This constructor does not initialize the bitmap from a disk file,
+//      so every sector of it is considered changed until the first
+//      WriteBack.
 //----------------------------------------------------------------------
 
 PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 {
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numMapSectors];
+    SetAllDirty(TRUE);
+    InitGroups();
+    CountFree();
+    clusterSize = 1;
+    clusterDirty = TRUE;
+    shareFile = NULL; // nothing is shared on a new disk
+    shareRoom = TRUE;
 }
 
 //----------------------------------------------------------------------
@@ -31,16 +51,22 @@ PersistentBitmap::PersistentBitmap(int numItems) : Bitmap(numItems)
 //	"numItems" is the number of bits in the bitmap.
 //      "file" refers to an open file containing the bitmap (written
 //        by a previous call to PersistentBitmap::WriteBack
+//	"groupCounts" -- the clear bits in each group, or NULL if they
+//	  must be counted
 //
 //      This constructor initializes the bitmap from a disk file
 //----------------------------------------------------------------------
 
-PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numItems)
+PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems,
+                                   int *groupCounts) : Bitmap(numItems)
 {
     // map has already been initialized by the BitMap constructor,
     // but we will just overwrite that with the contents of the
     // map found in the file
-    file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    numMapSectors = divRoundUp(numWords * sizeof(unsigned), SectorSize);
+    dirty = new bool[numMapSectors];
+    InitGroups();
+    FetchFrom(file, groupCounts);
 }
 
 //----------------------------------------------------------------------
@@ -50,28 +76,603 @@ PersistentBitmap::PersistentBitmap(OpenFile *file, int numItems) : Bitmap(numIte
 
 PersistentBitmap::~PersistentBitmap()
 {
+    for (int i = 0; i < numGroups; i++) {
+        delete groupLock[i];
+    }
+    delete extentLock;
+    delete extents;
+    delete[] dirty;
+    delete shareLock;
+    delete[] shares;
+    delete[] shareState;
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::FetchFrom
 // 	Initialize the contents of a persistent bitmap from a Nachos file.
+//	The counts of clear bits in each group are taken from
+//	"groupCounts" if they add up to the bits found clear, and counted
+//	otherwise.  The free extents are indexed when first needed.
+//
+//	The share counts are not read until one is needed.
 //
 //	"file" is the place to read the bitmap from
+//	"groupCounts" -- the clear bits in each group, or NULL
 //----------------------------------------------------------------------
 
-void PersistentBitmap::FetchFrom(OpenFile *file)
+void PersistentBitmap::FetchFrom(OpenFile *file, int *groupCounts)
 {
+    int total = 0;
+
     file->ReadAt((char *)map, numWords * sizeof(unsigned), 0);
+    clusterSize = 1; // if the file has none, from before clusters
+    file->ReadAt((char *)&clusterSize, sizeof(int), numWords * sizeof(unsigned));
+    ASSERT(clusterSize > 0 && clusterSize <= MaxClusterSectors);
+    clusterDirty = FALSE;
+    RebuildSummary();
+    for (int g = 0; (groupCounts != NULL) && (g < numGroups); g++) {
+        total += groupCounts[g];
+    }
+    if ((groupCounts != NULL) && (total == NumClear())) {
+        for (int g = 0; g < numGroups; g++) {
+            groupFree[g] = groupCounts[g];
+        }
+    } else {
+        CountFree();
+    }
+    delete extents;
+    extents = new FreeExtents;
+    extentsBuilt = FALSE;
+    SetAllDirty(FALSE);
+    delete[] shares;
+    delete[] shareState;
+    shares = NULL;
+    shareFile = file;
+    shareRoom = file->Length() >= (int)(numWords * sizeof(unsigned) + sizeof(int))
+                                  + divRoundUp(numBits, clusterSize);
 }
 
 //----------------------------------------------------------------------
 // PersistentBitmap::WriteBack
 // 	Store the contents of a persistent bitmap to a Nachos file.
+//	Only the sectors of the bitmap that changed since it was last
+//	fetched or written are stored; runs of adjacent changed sectors
+//	are written with a single request.  So are the sectors of the
+//	share counts that changed.
 //
 //	"file" is the place to write the bitmap to
 //----------------------------------------------------------------------
 
 void PersistentBitmap::WriteBack(OpenFile *file)
 {
-    file->WriteAt((char *)map, numWords * sizeof(unsigned), 0);
+    int mapBytes = numWords * sizeof(unsigned);
+    int i = 0;
+
+    while (i < numMapSectors) {
+        if (!dirty[i]) {
+            i++;
+            continue;
+        }
+        int first = i;
+        while (i < numMapSectors && dirty[i]) {
+            dirty[i++] = FALSE;
+        }
+        int offset = first * SectorSize;
+        int numBytes = min(i * SectorSize, mapBytes) - offset;
+        file->WriteAt((char *)map + offset, numBytes, offset);
+    }
+    if (clusterDirty) {
+        file->WriteAt((char *)&clusterSize, sizeof(int), mapBytes);
+        clusterDirty = FALSE;
+    }
+    if (shares == NULL) {
+        return;
+    }
+    shareLock->Acquire();
+    for (i = 0; i < numShareSectors; i++) {
+        if (shareState[i] == ShareChanged) {
+            int offset = i * SectorSize;
+            int numBytes = min(SectorSize, divRoundUp(numBits, clusterSize) - offset);
+
+            file->WriteAt((char *)shares + offset, numBytes, mapBytes + sizeof(int) + offset);
+            shareState[i] = ShareRead;
+        }
+    }
+    shareLock->Release();
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetClusterSize
+// 	Allocate file data in clusters of "sectors" sectors from now on;
+//	only when the disk is being formatted.  A power of two, and a
+//	divisor of the group size, so that no cluster spans two groups.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::SetClusterSize(int sectors)
+{
+    ASSERT(sectors > 0 && sectors <= MaxClusterSectors);
+    ASSERT((sectors & (sectors - 1)) == 0 && groupSize % sectors == 0);
+    clusterSize = sectors;
+    clusterDirty = TRUE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Mark, PersistentBitmap::Clear
+// 	Same as the Bitmap versions, but holding the lock of the bit's
+//	group, and also noting which sector of the bitmap file holds the
+//	bit that changed.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Mark(int which)
+{
+    Lock *lock = GroupLock(which);
+
+    lock->Acquire();
+    if (!Test(which)) {
+        Bitmap::Mark(which);
+        Taken(which, 1);
+    }
+    lock->Release();
+}
+
+void PersistentBitmap::Clear(int which)
+{
+    Lock *lock = GroupLock(which);
+
+    lock->Acquire();
+    if (Test(which)) {
+        groupFree[which / groupSize]++;
+        Bitmap::Clear(which);
+        extentLock->Acquire();
+        if (extentsBuilt) {
+            extents->Give(which);
+        }
+        extentLock->Release();
+    }
+    SetDirty(which);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::MarkIfClear
+// 	Set bit "which" if it is clear, testing and setting it under one
+//	hold of its group's lock.  Return whether it was clear, so that
+//	the caller now owns it.
+//----------------------------------------------------------------------
+
+bool PersistentBitmap::MarkIfClear(int which)
+{
+    Lock *lock = GroupLock(which);
+    bool wasClear;
+
+    lock->Acquire();
+    wasClear = !Test(which);
+    if (wasClear) {
+        Bitmap::Mark(which);
+        Taken(which, 1);
+    }
+    lock->Release();
+    return wasClear;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSet
+// 	Allocate a clear bit, as close after "near" as possible: first
+//	in the group holding "near", then in the groups after it in turn,
+//	each under its own lock.  Return -1 if every bit is set.
+//
+//	Without "near", the search starts from a group that depends on
+//	the current thread, so that threads allocating at the same time
+//	do not all wait for the same lock.
+//
+//	"near" -- the bit to start looking from
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindAndSet()
+{
+    return FindAndSet((kernel->currentThread->getID() % numGroups) * groupSize);
+}
+
+int PersistentBitmap::FindAndSet(int near)
+{
+    ASSERT(near >= 0 && near < numBits);
+
+    int first = near / groupSize;
+
+    for (int i = 0; i < numGroups; i++) {
+        int group = (first + i) % numGroups;
+        int start = group * groupSize;
+        int from = (i == 0) ? near : start;
+        int which;
+
+        groupLock[group]->Acquire();
+        which = Bitmap::FindAndSet(from, min(start + groupSize, numBits));
+        if (which == -1 && from > start) { // wrap around in the group
+            which = Bitmap::FindAndSet(start, from);
+        }
+        if (which != -1) {
+            Taken(which, 1);
+        }
+        groupLock[group]->Release();
+        if (which != -1) {
+            return which;
+        }
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetRun
+// 	Allocate a run of "count" clear bits.  With "near", the run is
+//	first looked for after "near" in its group, then anywhere in that
+//	group, under the group's lock alone.  Failing that, the run is
+//	taken from the smallest free extent on the whole map that holds
+//	it (best fit), as the extent index finds it: a run may cross from
+//	one group into the next, so every group is locked then, always in
+//	the same order.
+//
+//	"count" -- the length of the run wanted
+//	"near" -- the bit to start looking from
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindAndSetRun(int count)
+{
+    return FindAndSetAnywhere(count, 1);
+}
+
+int PersistentBitmap::FindAndSetAnywhere(int count, int align)
+{
+    int first;
+
+    for (int i = 0; i < numGroups; i++) {
+        groupLock[i]->Acquire();
+    }
+    extentLock->Acquire();
+    BuildExtents();
+    first = extents->BestFit(count, align);
+    extentLock->Release();
+    if (first != -1) {
+        for (int i = first; i < first + count; i++) {
+            Bitmap::Mark(i);
+        }
+        Taken(first, count);
+    }
+    for (int i = numGroups - 1; i >= 0; i--) {
+        groupLock[i]->Release();
+    }
+    return first;
+}
+
+int PersistentBitmap::FindAndSetRun(int count, int near)
+{
+    return FindAndSetRun(count, near, 1);
+}
+
+int PersistentBitmap::FindAndSetRun(int count, int near, int align)
+{
+    ASSERT(near >= 0 && near < numBits);
+
+    int group = near / groupSize;
+    int start = group * groupSize;
+    int end = min(start + groupSize, numBits);
+    int first = -1;
+
+    if (count <= end - start && count <= groupFree[group]) {
+        groupLock[group]->Acquire();
+        if (count <= end - near) {
+            first = Bitmap::FindAndSetRun(count, near, end, align);
+        }
+        if (first == -1 && near > start) {
+            first = Bitmap::FindAndSetRun(count, start, end, align);
+        }
+        if (first != -1) {
+            Taken(first, count);
+        }
+        groupLock[group]->Release();
+    }
+    if (first == -1) {
+        first = FindAndSetAnywhere(count, align);
+    }
+    return first;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::FindAndSetClusters
+// 	Allocate a run of "count" bits, a whole number of clusters, that
+//	starts on a cluster boundary; as FindAndSetRun, close after "near"
+//	if it can be.  Return -1 if there is no such run.
+//----------------------------------------------------------------------
+
+int PersistentBitmap::FindAndSetClusters(int count, int near)
+{
+    ASSERT(count % clusterSize == 0);
+    return FindAndSetRun(count, near, clusterSize);
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::MarkClusterIfClear
+// 	Set the bits of the cluster starting at "first" if all of them are
+//	clear, under one hold of its group's lock, and return whether they
+//	were, so that the caller now owns the cluster.
+//----------------------------------------------------------------------
+
+bool PersistentBitmap::MarkClusterIfClear(int first)
+{
+    Lock *lock = GroupLock(first);
+    bool allClear = TRUE;
+
+    ASSERT(first % clusterSize == 0 && first + clusterSize <= numBits);
+    lock->Acquire();
+    for (int i = first; i < first + clusterSize && allClear; i++) {
+        allClear = !Test(i);
+    }
+    if (allClear) {
+        for (int i = first; i < first + clusterSize; i++) {
+            Bitmap::Mark(i);
+        }
+        Taken(first, clusterSize);
+    }
+    lock->Release();
+    return allClear;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Shares, PersistentBitmap::Share,
+// PersistentBitmap::Unshare
+// 	Return how many files beyond the first use the cluster holding
+//	sector "which"; or count one more of them, unless it has
+//	MaxShares already or the disk has no room for the counts; or one
+//	fewer, returning FALSE if there were
+//	none -- the cluster is the caller's alone, to free or write to.
+//	The caller writes back the changed counts, with the map.
+//----------------------------------------------------------------------
+
+int PersistentBitmap::Shares(int which)
+{
+    int count;
+
+    shareLock->Acquire();
+    count = *ShareCount(which);
+    shareLock->Release();
+    return count;
+}
+
+bool PersistentBitmap::Share(int which)
+{
+    unsigned char *count;
+    bool shared = FALSE;
+
+    shareLock->Acquire();
+    count = ShareCount(which);
+    if (shareRoom && *count < MaxShares) {
+        (*count)++;
+        shareState[(count - shares) / SectorSize] = ShareChanged;
+        shared = TRUE;
+    }
+    shareLock->Release();
+    return shared;
+}
+
+bool PersistentBitmap::Unshare(int which)
+{
+    unsigned char *count;
+    bool wasShared = FALSE;
+
+    shareLock->Acquire();
+    count = ShareCount(which);
+    if (*count > 0) {
+        (*count)--;
+        shareState[(count - shares) / SectorSize] = ShareChanged;
+        wasShared = TRUE;
+    }
+    shareLock->Release();
+    return wasShared;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::ShareCount
+// 	Return where the share count of the cluster holding sector
+//	"which" is kept, reading in the sector of the counts holding it
+//	if that has not been done.  On a disk just formatted, or one
+//	without room for the counts, they all start at zero.  The share
+//	lock must be held.
+//----------------------------------------------------------------------
+
+unsigned char *PersistentBitmap::ShareCount(int which)
+{
+    int numClusters = divRoundUp(numBits, clusterSize);
+    int cluster = which / clusterSize;
+    int sector = cluster / SectorSize;
+
+    ASSERT(which >= 0 && which < numBits);
+    if (shares == NULL) {
+        numShareSectors = divRoundUp(numClusters, SectorSize);
+        shares = new unsigned char[numShareSectors * SectorSize];
+        shareState = new char[numShareSectors];
+        memset(shares, 0, numShareSectors * SectorSize);
+        for (int i = 0; i < numShareSectors; i++) {
+            shareState[i] = (shareFile == NULL || !shareRoom) ? ShareRead
+                                                              : ShareUnread;
+        }
+    }
+    if (shareState[sector] == ShareUnread) {
+        int offset = sector * SectorSize;
+
+        shareFile->ReadAt((char *)shares + offset,
+                          min(SectorSize, numClusters - offset),
+                          numWords * sizeof(unsigned) + sizeof(int) + offset);
+        shareState[sector] = ShareRead;
+    }
+    return &shares[cluster];
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::EmptiestGroup
+// 	Return the first bit of the group with the most clear bits, where
+//	a new directory should go, so that directories spread over the
+//	disk and leave room next to them for their files.  The counts are
+//	read without the locks; they only steer placement.
+//----------------------------------------------------------------------
+
+int PersistentBitmap::EmptiestGroup()
+{
+    int best = 0;
+
+    for (int i = 1; i < numGroups; i++) {
+        if (groupFree[i] > groupFree[best]) {
+            best = i;
+        }
+    }
+    return best * groupSize;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::Taken
+// 	Note that the "count" bits from "first" on have just been set:
+//	the sectors of the bitmap file holding them must be written back,
+//	their groups have that many fewer clear bits, and they are no
+//	longer in a free extent.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::Taken(int first, int count)
+{
+    int last = first + count - 1;
+
+    extentLock->Acquire();
+    if (extentsBuilt) {
+        extents->Take(first, count);
+    }
+    extentLock->Release();
+
+    for (int i = first; i <= last; i += BitsInSector) {
+        SetDirty(i);
+    }
+    SetDirty(last);
+    for (int g = first / groupSize; g <= last / groupSize; g++) {
+        groupFree[g] -= min(last + 1, (g + 1) * groupSize)
+                        - max(first, g * groupSize);
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetDirty
+// 	Remember that the sector of the bitmap file holding bit "which"
+//	has to be written back.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::SetDirty(int which)
+{
+    dirty[which / BitsInSector] = TRUE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::SetAllDirty
+// 	Mark every sector of the bitmap file as changed (or unchanged).
+//----------------------------------------------------------------------
+
+void PersistentBitmap::SetAllDirty(bool flag)
+{
+    for (int i = 0; i < numMapSectors; i++) {
+        dirty[i] = flag;
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::InitGroups
+// 	Split the bits into at most NumAllocGroups groups, each a whole
+//	number of summary words long, and give each group its lock.
+//	A summary word covers as many sectors as a track of the simulated
+//	disk holds, so each group is a run of whole tracks.  Also make
+//	the index of free extents, empty until it is built.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::InitGroups()
+{
+    const int BitsInSummaryWord = BitsInWord * BitsInWord;
+
+    groupSize = divRoundUp(divRoundUp(numBits, NumAllocGroups),
+                           BitsInSummaryWord) * BitsInSummaryWord;
+    numGroups = divRoundUp(numBits, groupSize);
+    for (int i = 0; i < numGroups; i++) {
+        groupLock[i] = new Lock("free map group");
+    }
+    extents = new FreeExtents;
+    extentsBuilt = FALSE;
+    extentLock = new Lock("free extents");
+    shares = NULL;
+    shareState = NULL;
+    shareLock = new Lock("share counts");
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::CheckCounts, PersistentBitmap::Recount
+// 	Count the clear bits again, a word at a time, and compare what
+//	is found with the running counts, in all and in each group, and
+//	with the free extents; or set the running counts to what is
+//	found, and index the extents again.  For fsck.
+//----------------------------------------------------------------------
+
+bool PersistentBitmap::CheckCounts()
+{
+    int kept[NumAllocGroups];
+    int numClear = CountClear();
+    bool same;
+
+    extentLock->Acquire();
+    BuildExtents();
+    extentLock->Release();
+    same = (NumClear() == numClear) && (extents->NumFree() == numClear);
+
+    for (int g = 0; g < numGroups; g++) {
+        kept[g] = groupFree[g];
+    }
+    CountFree();
+    for (int g = 0; g < numGroups; g++) {
+        same = same && (kept[g] == groupFree[g]);
+        groupFree[g] = kept[g];
+    }
+    return same;
+}
+
+void PersistentBitmap::Recount()
+{
+    Bitmap::Recount();
+    CountFree();
+    extents->Rebuild(this, numBits);
+    extentsBuilt = TRUE;
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::BuildExtents
+// 	Index the free extents, scanning the whole map, unless that was
+//	done already.  Until then, allocations that stay in one group do
+//	not need them.  The extent lock must be held, and the map must
+//	not change meanwhile.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::BuildExtents()
+{
+    if (!extentsBuilt) {
+        DEBUG(dbgFile, "Indexing the free extents of the free map");
+        extents->Rebuild(this, numBits);
+        extentsBuilt = TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// PersistentBitmap::CountFree
+// 	Count the clear bits in each group, after the whole map changed.
+//----------------------------------------------------------------------
+
+void PersistentBitmap::CountFree()
+{
+    for (int g = 0; g < numGroups; g++) {
+        int start = g * groupSize;
+        int end = min(start + groupSize, numBits);
+
+        groupFree[g] = end - start;
+        for (int w = start / BitsInWord; w < divRoundUp(end, BitsInWord); w++) {
+            groupFree[g] -= __builtin_popcount(map[w]);
+        }
+    }
 }
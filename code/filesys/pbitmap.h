@@ -6,6 +6,41 @@
 //    when it is created, or it can be initialized later using
 //    the FetchFrom method
 //
+//    The bits are split into allocation groups -- in the free map, a
+//    run of whole tracks each, like the cylinder groups of the UNIX
+//    fast file system -- with a lock of their own, so that several
+//    threads can allocate at once.  A group is a whole number of
+//    summary words (cf. bitmap.h), so no two groups share one.
+//
+//    The data of files can be allocated in clusters: runs of a fixed
+//    number of sectors, chosen when the disk is formatted, each starting
+//    on a multiple of that number.  The cluster size is stored in the
+//    bitmap file, after the map.  The map itself still has a bit per
+//    sector, since file headers, index sectors and the like take one
+//    sector each.
+//
+//    Allocation can ask for bits "near" a given one: they are taken
+//    from the same group if it has room, so that a file's header,
+//    index and data, and the files of a directory, end up close to
+//    one another on disk, and the disk head has less far to move.
+//
+//    A run too long for that group is looked up in an index of the
+//    free extents (see freeextents.h), which finds the smallest hole
+//    that holds it without scanning the whole map.  The index is only
+//    built the first time it is needed, since that does scan the map.
+//
+//    Clusters can be shared by several files, cloned from one another
+//    (see FileSystem::Clone): after the cluster size, the bitmap file
+//    keeps a byte for each cluster, counting the files beyond the first
+//    that use it.  A cluster is only freed once none of them does.  The
+//    counts are read a sector at a time, when first needed, and only
+//    changed sectors are written back; a disk formatted without room
+//    for them cannot share clusters.
+//
+//    When the file system was unmounted cleanly, the counts of clear
+//    bits in each group are kept in its superblock, and are given to
+//    the bitmap when it is read in, instead of being counted again.
+//
 // Copyright (c) 1992,1993,1995 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -16,6 +51,18 @@
 #include "copyright.h"
 #include "bitmap.h"
 #include "openfile.h"
+#include "freeextents.h"
+
+class Lock;
+
+// Most groups the bits are split into for allocation.
+#define NumAllocGroups 16
+
+// Largest cluster of sectors file data can be allocated in.
+#define MaxClusterSectors 32
+
+// Most files beyond the first that can share one cluster.
+#define MaxShares 255
 
 // The following class defines a persistent bitmap.  It inherits all
 // the behavior of a bitmap (see bitmap.h), adding the ability to
@@ -24,13 +71,82 @@
 class PersistentBitmap : public Bitmap
 {
 public:
-    PersistentBitmap(OpenFile *file, int numItems); //initialize bitmap from disk
+    PersistentBitmap(OpenFile *file, int numItems, int *groupCounts = NULL);
+                           // initialize bitmap from disk, and the
+                           // clear bits in each group from
+                           // "groupCounts", if they are known
     PersistentBitmap(int numItems);                 // or don't...
 
     ~PersistentBitmap(); // deallocate bitmap
 
-    void FetchFrom(OpenFile *file); // read bitmap from the disk
-    void WriteBack(OpenFile *file); // write bitmap contents to disk
+    void FetchFrom(OpenFile *file, int *groupCounts = NULL);
+                                    // read bitmap from the disk
+    void WriteBack(OpenFile *file); // write changed parts of the bitmap
+                                    // back to disk
+
+    void Mark(int which);  // Set the "nth" bit, and remember
+                           // that its sector needs writing back
+    void Clear(int which); // Clear the "nth" bit, ditto
+    int FindAndSet();      // Allocate a bit, ditto
+    int FindAndSet(int near); // Allocate a bit close after "near"
+    int FindAndSetRun(int count); // Allocate a run of bits, ditto
+    int FindAndSetRun(int count, int near); // a run close after "near"
+    int FindAndSetClusters(int count, int near); // a run of whole clusters
+    bool MarkClusterIfClear(int first); // Set the bits of the cluster
+                           // starting at "first" if all are clear
+    int ClusterSize() { return clusterSize; } // sectors in a cluster
+    void SetClusterSize(int sectors); // when formatting
+    int NumGroups() { return numGroups; }
+    int GroupFree(int group) { return groupFree[group]; }
+                           // clear bits in a group
+    int EmptiestGroup();   // first bit of the group with the most
+                           // clear bits, to place a new directory in
+    bool MarkIfClear(int which); // Set the "nth" bit if it is clear;
+                           // return whether it was
+    bool CanShare() { return shareRoom; } // room for share counts?
+    int Shares(int which); // Files beyond the first using the cluster
+                           // holding sector "which"
+    bool Share(int which); // One more; FALSE if it has MaxShares
+    bool Unshare(int which); // One fewer; FALSE if there were none,
+                           // so that the caller now owns the cluster
+    bool CheckCounts();    // Do the running counts of clear bits, in
+                           // all and in each group, match the map?
+    void Recount();        // Make them match
+
+private:
+    void SetDirty(int which);   // the sector holding bit "which" has
+                                // changed since the last WriteBack
+    void SetAllDirty(bool flag); // mark every sector (un)changed
+    void InitGroups();          // split the bits into groups
+    void CountFree();           // recount the clear bits in each
+    void BuildExtents();        // index the free extents, if not yet
+    void Taken(int first, int count); // a run of bits was just set
+    int FindAndSetRun(int count, int near, int align);
+    int FindAndSetAnywhere(int count, int align); // a run, all locked
+    Lock *GroupLock(int which) { return groupLock[which / groupSize]; }
+                                // lock of the group holding "which"
+    unsigned char *ShareCount(int which); // the count of the cluster
+                                // holding "which", read in if need be
+
+    int numMapSectors; // number of sectors used to store the bitmap
+    bool *dirty;       // which of those sectors must be written back
+    int groupSize;     // bits in each allocation group
+    int numGroups;     // how many groups there are
+    Lock *groupLock[NumAllocGroups]; // one for each group
+    int groupFree[NumAllocGroups]; // clear bits in each group
+    int clusterSize;   // sectors file data is allocated in
+    bool clusterDirty; // clusterSize must be written back
+    FreeExtents *extents; // the runs of clear bits
+    bool extentsBuilt; // have they been indexed yet?
+    Lock *extentLock;  // held while they are used or changed, after
+                       // any group locks
+    OpenFile *shareFile; // where the share counts are read from
+    bool shareRoom;    // does the bitmap file have room for them?
+    int numShareSectors; // sectors of the file they take
+    unsigned char *shares; // the counts, NULL until one is needed
+    char *shareState;  // for each of their sectors: unread, read,
+                       // or changed since the last WriteBack
+    Lock *shareLock;   // protects the counts
 };
 
 #endif // PBITMAP_H
@@ -0,0 +1,813 @@
+// remotefs.cc
+//	Routines for the file server, which serves the remote procedure
+//	calls of clients on other machines, and for the client, which
+//	makes them and caches what it is told.
+//
+//	The server's handlers are run by its pool of workers, several at
+//	once; none holds the server's lock while it reads or writes the
+//	disk, or waits for leases to run out.  The client's lock is not
+//	held while it calls the server either: whatever the cache holds
+//	is looked up again once the reply is in.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "remotefs.h"
+#include "main.h"
+#include "filesys.h"
+
+//----------------------------------------------------------------------
+// Answer
+// 	Put a reply header at the front of a reply, and return its length
+//	with "count" bytes of data after it.
+//----------------------------------------------------------------------
+
+static int
+Answer(FsReply *rep, char *reply, int count)
+{
+    bcopy((char *)rep, reply, sizeof(FsReply));
+    return sizeof(FsReply) + count;
+}
+
+//----------------------------------------------------------------------
+// RequestName
+// 	Return the file name following a request header, which must end
+//	in a null.
+//----------------------------------------------------------------------
+
+static char *
+RequestName(char *request, int length)
+{
+    ASSERT((length > (int)sizeof(FsRequest)) && (request[length - 1] == '\0'));
+    return request + sizeof(FsRequest);
+}
+
+//----------------------------------------------------------------------
+// FileServer::FileServer
+// 	Export this machine's file system, with no files looked up yet.
+//----------------------------------------------------------------------
+
+FileServer::FileServer()
+{
+    lock = new Lock("file server");
+    exports = new List<ExportedFile *>;
+    server = new RpcServer(FileServerBox);
+    server->Register(FsLookup, FileServer::Lookup, this);
+    server->Register(FsGetAttr, FileServer::GetAttr, this);
+    server->Register(FsRead, FileServer::Read, this);
+    server->Register(FsWrite, FileServer::Write, this);
+    server->Register(FsCreate, FileServer::Create, this);
+    server->Register(FsRemove, FileServer::Remove, this);
+}
+
+//----------------------------------------------------------------------
+// FileServer::Get
+// 	Find the file with a handle, and count one more user of it, so
+//	that it stays open until Put.  "lock" is held.  Return NULL if no
+//	client has looked it up, or it has been removed.
+//----------------------------------------------------------------------
+
+ExportedFile *
+FileServer::Get(int handle)
+{
+    ListIterator<ExportedFile *> iter(exports);
+
+    for (; !iter.IsDone(); iter.Next())
+    {
+        ExportedFile *exported = iter.Item();
+
+        if ((exported->handle == handle) && !exported->removed)
+        {
+            exported->users++;
+            return exported;
+        }
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// FileServer::Add
+// 	Get the file just opened, adding it if no client has looked it up
+//	yet; otherwise it is open already, and "file" is closed.  "lock"
+//	is held.
+//----------------------------------------------------------------------
+
+ExportedFile *
+FileServer::Add(OpenFile *file)
+{
+    ExportedFile *exported = Get(file->HeaderSector());
+
+    if (exported != NULL)
+    {
+        delete file;
+        return exported;
+    }
+    exported = new ExportedFile;
+    exported->handle = file->HeaderSector();
+    exported->file = file;
+    exported->version = 0;
+    for (int i = 0; i < MaxHosts; i++)
+        exported->leaseUntil[i] = 0;
+    exported->writesPending = 0;
+    exported->users = 1;
+    exported->removed = FALSE;
+    exports->Append(exported);
+    return exported;
+}
+
+//----------------------------------------------------------------------
+// FileServer::Put
+// 	A request is done with a file; close it if it has been removed
+//	and this was its last user.  "lock" is held.
+//----------------------------------------------------------------------
+
+void
+FileServer::Put(ExportedFile *exported)
+{
+    ASSERT(exported->users > 0);
+    if ((--exported->users == 0) && exported->removed)
+    {
+        exports->Remove(exported);
+        delete exported->file;
+        delete exported;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileServer::Grant
+// 	Tell a client the length and version of a file, and give it a
+//	lease on them, unless a write is waiting for leases to run out.
+//	"lock" is held.
+//
+//	"host" -- the client
+//	"reply" -- where to put what it is told
+//----------------------------------------------------------------------
+
+void
+FileServer::Grant(ExportedFile *exported, int host, FsReply *reply)
+{
+    reply->length = exported->file->Length();
+    reply->version = exported->version;
+    reply->lease = 0;
+    if ((exported->writesPending == 0) && (host >= 0) && (host < MaxHosts))
+    {
+        reply->lease = LeaseTime;
+        exported->leaseUntil[host] = kernel->stats->totalTicks + LeaseTime;
+    }
+}
+
+//----------------------------------------------------------------------
+// FileServer::Lookup
+// 	Handler for FsLookup: open a file by name, and reply with its
+//	handle and length, or -1 if there is no such file.
+//----------------------------------------------------------------------
+
+int
+FileServer::Lookup(void *arg, char *request, int length, char *reply)
+{
+    FileServer *server = (FileServer *)arg;
+    OpenFile *file = kernel->fileSystem->Open(RequestName(request, length));
+    FsRequest req;
+    FsReply rep;
+
+    bcopy(request, (char *)&req, sizeof(FsRequest));
+    rep.result = -1;
+    rep.length = rep.version = rep.lease = 0;
+    if (file != NULL)
+    {
+        server->lock->Acquire();
+        ExportedFile *exported = server->Add(file);
+
+        rep.result = exported->handle;
+        server->Grant(exported, req.host, &rep);
+        server->Put(exported);
+        server->lock->Release();
+    }
+    return Answer(&rep, reply, 0);
+}
+
+//----------------------------------------------------------------------
+// FileServer::GetAttr
+// 	Handler for FsGetAttr: reply with the length of a file looked up,
+//	renewing the client's lease, or -1 if it has been removed.
+//----------------------------------------------------------------------
+
+int
+FileServer::GetAttr(void *arg, char *request, int length, char *reply)
+{
+    FileServer *server = (FileServer *)arg;
+    ExportedFile *exported;
+    FsRequest req;
+    FsReply rep;
+
+    ASSERT(length == sizeof(FsRequest));
+    bcopy(request, (char *)&req, sizeof(FsRequest));
+    rep.result = -1;
+    rep.length = rep.version = rep.lease = 0;
+    server->lock->Acquire();
+    exported = server->Get(req.handle);
+    if (exported != NULL)
+    {
+        rep.result = req.handle;
+        server->Grant(exported, req.host, &rep);
+        server->Put(exported);
+    }
+    server->lock->Release();
+    return Answer(&rep, reply, 0);
+}
+
+//----------------------------------------------------------------------
+// FileServer::Read
+// 	Handler for FsRead: reply with the bytes read, and the data.
+//
+//	The lease is granted, and the version taken, before the data is
+//	read.  A write that comes meanwhile waits for the lease; one
+//	already under way has stopped any lease being granted, and bumps
+//	the version the client was told, so the data is not trusted past
+//	this request.
+//----------------------------------------------------------------------
+
+int
+FileServer::Read(void *arg, char *request, int length, char *reply)
+{
+    FileServer *server = (FileServer *)arg;
+    ExportedFile *exported;
+    FsRequest req;
+    FsReply rep;
+
+    ASSERT(length == sizeof(FsRequest));
+    bcopy(request, (char *)&req, sizeof(FsRequest));
+    rep.result = -1;
+    rep.length = rep.version = rep.lease = 0;
+    server->lock->Acquire();
+    exported = server->Get(req.handle);
+    if (exported != NULL)
+        server->Grant(exported, req.host, &rep);
+    server->lock->Release();
+    if (exported == NULL)
+        return Answer(&rep, reply, 0);
+
+    rep.result = exported->file->ReadAt(reply + sizeof(FsReply),
+                        min(req.size, (int)(MaxRpcSize - sizeof(FsReply))),
+                        req.offset);
+    server->lock->Acquire();
+    server->Put(exported);
+    server->lock->Release();
+    return Answer(&rep, reply, rep.result);
+}
+
+//----------------------------------------------------------------------
+// FileServer::Write
+// 	Handler for FsWrite: wait until no other client has a lease on
+//	the file, write the data after the request, and reply with the
+//	bytes written and the file's new length and version.
+//----------------------------------------------------------------------
+
+int
+FileServer::Write(void *arg, char *request, int length, char *reply)
+{
+    FileServer *server = (FileServer *)arg;
+    ExportedFile *exported;
+    FsRequest req;
+    FsReply rep;
+
+    bcopy(request, (char *)&req, sizeof(FsRequest));
+    ASSERT(length == (int)sizeof(FsRequest) + req.size);
+    rep.result = -1;
+    rep.length = rep.version = rep.lease = 0;
+    server->lock->Acquire();
+    exported = server->Get(req.handle);
+    if (exported == NULL)
+    {
+        server->lock->Release();
+        return Answer(&rep, reply, 0);
+    }
+    exported->writesPending++;
+    for (;;)
+    {
+        int wait = 0;
+
+        for (int i = 0; i < MaxHosts; i++)
+            if (i != req.host)
+                wait = max(wait, exported->leaseUntil[i] - kernel->stats->totalTicks);
+        if (wait <= 0)
+            break;
+        kernel->stats->numLeaseWaits++;
+        server->lock->Release();
+        kernel->alarm->WaitUntil(wait);
+        server->lock->Acquire();
+    }
+    server->lock->Release();
+
+    rep.result = exported->file->WriteAt(request + sizeof(FsRequest),
+                                         req.size, req.offset);
+    server->lock->Acquire();
+    exported->version++;
+    exported->writesPending--;
+    server->Grant(exported, req.host, &rep);
+    server->Put(exported);
+    server->lock->Release();
+    return Answer(&rep, reply, 0);
+}
+
+//----------------------------------------------------------------------
+// FileServer::Create
+// 	Handler for FsCreate: create a file by name, of "size" bytes, and
+//	reply with 1, or 0 if it could not be.
+//----------------------------------------------------------------------
+
+int
+FileServer::Create(void *arg, char *request, int length, char *reply)
+{
+    FsRequest req;
+    FsReply rep;
+
+    bcopy(request, (char *)&req, sizeof(FsRequest));
+    rep.length = rep.version = rep.lease = 0;
+    rep.result = kernel->fileSystem->Create(RequestName(request, length),
+                                            req.size) ? 1 : 0;
+    return Answer(&rep, reply, 0);
+}
+
+//----------------------------------------------------------------------
+// FileServer::Remove
+// 	Handler for FsRemove: remove a file by name, and reply with 1, or
+//	0 if there is no such file.  If clients have looked it up, it is
+//	closed once no request is using it; its handle is no longer good.
+//----------------------------------------------------------------------
+
+int
+FileServer::Remove(void *arg, char *request, int length, char *reply)
+{
+    FileServer *server = (FileServer *)arg;
+    char *name = RequestName(request, length);
+    OpenFile *file = kernel->fileSystem->Open(name);
+    int handle = -1;
+    FsReply rep;
+
+    if (file != NULL)
+    {
+        handle = file->HeaderSector();
+        delete file;
+    }
+    rep.length = rep.version = rep.lease = 0;
+    rep.result = kernel->fileSystem->Remove(name) ? 1 : 0;
+    if ((rep.result == 1) && (handle != -1))
+    {
+        server->lock->Acquire();
+        ExportedFile *exported = server->Get(handle);
+
+        if (exported != NULL)
+        {
+            exported->removed = TRUE;
+            server->Put(exported);
+        }
+        server->lock->Release();
+    }
+    return Answer(&rep, reply, 0);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::RemoteFileSystem
+// 	Mount the file system of another machine, with nothing cached.
+//
+//	"serverHost" -- the machine serving it
+//----------------------------------------------------------------------
+
+RemoteFileSystem::RemoteFileSystem(NetworkAddress serverHost)
+{
+    client = new RpcClient(FileClientBox, serverHost, FileServerBox);
+    lock = new Lock("remote file cache");
+    attrs = new List<RemoteAttr *>;
+    blocks = new List<RemoteBlock *>;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::~RemoteFileSystem
+// 	Forget what is cached.  The RPC client lasts until Nachos halts.
+//----------------------------------------------------------------------
+
+RemoteFileSystem::~RemoteFileSystem()
+{
+    while (!attrs->IsEmpty())
+        delete attrs->RemoveFront();
+    while (!blocks->IsEmpty())
+        delete blocks->RemoveFront();
+    delete attrs;
+    delete blocks;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Call
+// 	Call the server, and wait for the reply.  "lock" must not be
+//	held.
+//
+//	"proc" -- the procedure
+//	"request" -- what to ask for; "host" is filled in
+//	"data", "length" -- a name or data to go after it
+//	"reply" -- where to put the reply header
+//	"result" -- where to put any data after it, or NULL
+//
+// Returns:
+//	The bytes of data after the reply header.
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::Call(int proc, FsRequest *request, char *data, int length,
+                       FsReply *reply, char *result)
+{
+    char *buffer = new char[MaxRpcSize];
+    int count;
+
+    ASSERT(sizeof(FsRequest) + length <= MaxRpcSize);
+    request->host = kernel->hostName;
+    bcopy((char *)request, buffer, sizeof(FsRequest));
+    if (length > 0)
+        bcopy(data, buffer + sizeof(FsRequest), length);
+    count = client->Call(proc, buffer, sizeof(FsRequest) + length, buffer);
+    ASSERT(count >= (int)sizeof(FsReply));
+    bcopy(buffer, (char *)reply, sizeof(FsReply));
+    count -= sizeof(FsReply);
+    if ((result != NULL) && (count > 0))
+        bcopy(buffer + sizeof(FsReply), result, count);
+    delete [] buffer;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::FindAttr, RemoteFileSystem::FindBlock
+// 	Find what is known of a file, or a block of it in the cache.
+//	Return NULL if there is none.  "lock" is held.
+//----------------------------------------------------------------------
+
+RemoteAttr *
+RemoteFileSystem::FindAttr(int handle)
+{
+    ListIterator<RemoteAttr *> iter(attrs);
+
+    for (; !iter.IsDone(); iter.Next())
+        if (iter.Item()->handle == handle)
+            return iter.Item();
+    return NULL;
+}
+
+RemoteBlock *
+RemoteFileSystem::FindBlock(int handle, int block)
+{
+    ListIterator<RemoteBlock *> iter(blocks);
+
+    for (; !iter.IsDone(); iter.Next())
+        if ((iter.Item()->handle == handle) && (iter.Item()->block == block))
+            return iter.Item();
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Update
+// 	Take what the server said of a file: its length, and a lease from
+//	"sentAt", when the request was sent.  If its version is not the
+//	one of the blocks cached, they are out of date.  "lock" is held.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Update(int handle, FsReply *reply, int sentAt)
+{
+    RemoteAttr *attr = FindAttr(handle);
+
+    if (attr == NULL)
+    {
+        attr = new RemoteAttr;
+        attr->handle = handle;
+        attr->version = reply->version;
+        attrs->Append(attr);
+    }
+    if (attr->version != reply->version)
+        Drop(handle);
+    attr->length = reply->length;
+    attr->version = reply->version;
+    attr->leaseUntil = sentAt + reply->lease;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Drop
+// 	Forget the cached blocks of a file.  "lock" is held.
+//----------------------------------------------------------------------
+
+void
+RemoteFileSystem::Drop(int handle)
+{
+    List<RemoteBlock *> *kept = new List<RemoteBlock *>;
+
+    while (!blocks->IsEmpty())
+    {
+        RemoteBlock *block = blocks->RemoveFront();
+
+        if (block->handle == handle)
+            delete block;
+        else
+            kept->Append(block);
+    }
+    delete blocks;
+    blocks = kept;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Fresh
+// 	Return what is known of a file, asking the server again if the
+//	lease has run out.  "lock" is held, but let go while the server
+//	is asked.  Return NULL if the file has been removed.
+//----------------------------------------------------------------------
+
+RemoteAttr *
+RemoteFileSystem::Fresh(int handle)
+{
+    RemoteAttr *attr = FindAttr(handle);
+    int sentAt = kernel->stats->totalTicks;
+    FsRequest req;
+    FsReply rep;
+
+    if ((attr != NULL) && (sentAt < attr->leaseUntil))
+        return attr;
+    req.handle = handle;
+    req.offset = req.size = 0;
+    kernel->stats->numRemoteAttrFetches++;
+    lock->Release();
+    Call(FsGetAttr, &req, NULL, 0, &rep, NULL);
+    lock->Acquire();
+    if (rep.result < 0)
+    {
+        Drop(handle);
+        return NULL;
+    }
+    Update(handle, &rep, sentAt);
+    return FindAttr(handle);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Open
+// 	Look up a file on the server.  Return NULL if there is no such
+//	file.
+//
+//	"name" -- its name there
+//----------------------------------------------------------------------
+
+RemoteFile *
+RemoteFileSystem::Open(char *name)
+{
+    int sentAt = kernel->stats->totalTicks;
+    FsRequest req;
+    FsReply rep;
+
+    req.handle = -1;
+    req.offset = req.size = 0;
+    Call(FsLookup, &req, name, strlen(name) + 1, &rep, NULL);
+    if (rep.result < 0)
+        return NULL;
+    lock->Acquire();
+    Update(rep.result, &rep, sentAt);
+    lock->Release();
+    return new RemoteFile(this, rep.result);
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::Create, RemoteFileSystem::Remove
+// 	Create a file of "initialSize" bytes on the server, or remove
+//	one.  Return FALSE if it could not be done.
+//
+//	"name" -- its name there
+//----------------------------------------------------------------------
+
+bool
+RemoteFileSystem::Create(char *name, int initialSize)
+{
+    FsRequest req;
+    FsReply rep;
+
+    req.handle = -1;
+    req.offset = 0;
+    req.size = initialSize;
+    Call(FsCreate, &req, name, strlen(name) + 1, &rep, NULL);
+    return rep.result == 1;
+}
+
+bool
+RemoteFileSystem::Remove(char *name)
+{
+    FsRequest req;
+    FsReply rep;
+
+    req.handle = -1;
+    req.offset = req.size = 0;
+    Call(FsRemove, &req, name, strlen(name) + 1, &rep, NULL);
+    return rep.result == 1;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::ReadAt
+// 	Read from a remote file, a block at a time, from the cache if the
+//	block is there and the lease has not run out; otherwise the block
+//	is read from the server into the cache, making room by dropping
+//	the one least recently used.  Return the bytes read, or -1 if the
+//	file has been removed.
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::ReadAt(int handle, char *into, int numBytes, int position)
+{
+    RemoteAttr *attr;
+    int done = 0;
+
+    lock->Acquire();
+    attr = Fresh(handle);
+    if (attr == NULL)
+    {
+        lock->Release();
+        return -1;
+    }
+    numBytes = min(numBytes, attr->length - position);
+    while (done < numBytes)
+    {
+        int number = (position + done) / RemoteBlockSize;
+        int offset = (position + done) % RemoteBlockSize;
+        RemoteBlock *block = FindBlock(handle, number);
+        int count;
+
+        if (block != NULL)
+        {
+            kernel->stats->numRemoteHits++;
+            blocks->Remove(block);
+        }
+        else
+        {
+            int sentAt = kernel->stats->totalTicks;
+            FsRequest req;
+            FsReply rep;
+
+            kernel->stats->numRemoteMisses++;
+            block = new RemoteBlock;
+            block->handle = handle;
+            block->block = number;
+            req.handle = handle;
+            req.offset = number * RemoteBlockSize;
+            req.size = RemoteBlockSize;
+            lock->Release();
+            Call(FsRead, &req, NULL, 0, &rep, block->data);
+            lock->Acquire();
+            if (rep.result < 0)
+            {
+                delete block;
+                Drop(handle);
+                break;
+            }
+            block->count = rep.result;
+            Update(handle, &rep, sentAt);
+            RemoteBlock *old = FindBlock(handle, number);
+
+            if (old != NULL) // read meanwhile by another thread
+            {
+                blocks->Remove(old);
+                delete old;
+            }
+            if (blocks->NumInList() >= RemoteCacheBlocks)
+                delete blocks->RemoveFront();
+        }
+        blocks->Append(block); // most recently used
+
+        count = min(numBytes - done, block->count - offset);
+        if (count <= 0)
+            break;
+        bcopy(block->data + offset, into + done, count);
+        done += count;
+    }
+    lock->Release();
+    return done;
+}
+
+//----------------------------------------------------------------------
+// RemoteFileSystem::WriteAt
+// 	Write to a remote file, through to the server, a block at a time.
+//	A block cached is changed to match, unless someone else wrote to
+//	the file meanwhile, when the file's blocks are dropped instead.
+//	Return the bytes written, or -1 if the file has been removed.
+//----------------------------------------------------------------------
+
+int
+RemoteFileSystem::WriteAt(int handle, char *from, int numBytes, int position)
+{
+    int done = 0;
+
+    while (done < numBytes)
+    {
+        int number = (position + done) / RemoteBlockSize;
+        int offset = (position + done) % RemoteBlockSize;
+        int sentAt = kernel->stats->totalTicks;
+        FsRequest req;
+        FsReply rep;
+
+        req.handle = handle;
+        req.offset = position + done;
+        req.size = min(numBytes - done, RemoteBlockSize - offset);
+        kernel->stats->numRemoteWrites++;
+        Call(FsWrite, &req, from + done, req.size, &rep, NULL);
+        if (rep.result < 0)
+            return (done > 0) ? done : -1;
+
+        lock->Acquire();
+        RemoteAttr *attr = FindAttr(handle);
+        RemoteBlock *block = FindBlock(handle, number);
+
+        if ((attr != NULL) && (rep.version == attr->version + 1))
+        {
+            attr->version = rep.version; // only ours
+            if ((block != NULL) && (rep.result > 0))
+            {
+                if (offset > block->count)
+                    bzero(block->data + block->count, offset - block->count);
+                bcopy(from + done, block->data + offset, rep.result);
+                block->count = max(block->count, offset + rep.result);
+            }
+        }
+        Update(handle, &rep, sentAt);
+        lock->Release();
+
+        done += rep.result;
+        if (rep.result < req.size) // the server's disk is full
+            break;
+    }
+    return done;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::RemoteFile
+// 	A remote file opened, with its seek position at the start.
+//
+//	"fs" -- the file system it is in
+//	"handle" -- the server's handle for it
+//----------------------------------------------------------------------
+
+RemoteFile::RemoteFile(RemoteFileSystem *fs, int handle)
+{
+    this->fs = fs;
+    this->handle = handle;
+    seekPosition = 0;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::Read, RemoteFile::Write
+// 	Read or write at the seek position, and move it on past what was
+//	read or written.
+//----------------------------------------------------------------------
+
+int
+RemoteFile::Read(char *into, int numBytes)
+{
+    int moved = ReadAt(into, numBytes, seekPosition);
+
+    if (moved > 0)
+        seekPosition += moved;
+    return moved;
+}
+
+int
+RemoteFile::Write(char *from, int numBytes)
+{
+    int moved = WriteAt(from, numBytes, seekPosition);
+
+    if (moved > 0)
+        seekPosition += moved;
+    return moved;
+}
+
+//----------------------------------------------------------------------
+// RemoteFile::ReadAt, RemoteFile::WriteAt, RemoteFile::Length
+// 	Read or write at "position", leaving the seek position as it is,
+//	or return the length of the file, as far as the client knows.
+//----------------------------------------------------------------------
+
+int
+RemoteFile::ReadAt(char *into, int numBytes, int position)
+{
+    return fs->ReadAt(handle, into, numBytes, position);
+}
+
+int
+RemoteFile::WriteAt(char *from, int numBytes, int position)
+{
+    return fs->WriteAt(handle, from, numBytes, position);
+}
+
+int
+RemoteFile::Length()
+{
+    RemoteAttr *attr;
+    int length;
+
+    fs->lock->Acquire();
+    attr = fs->Fresh(handle);
+    length = (attr != NULL) ? attr->length : -1;
+    fs->lock->Release();
+    return length;
+}
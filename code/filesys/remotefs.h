@@ -0,0 +1,200 @@
+// remotefs.h
+//	Data structures for reaching the file system of another machine
+//	over the network, in the manner of NFS.
+//
+//	A file server exports this machine's file system: it serves
+//	remote procedure calls (see network/rpc.h) to look files up by
+//	name, read and write them, create and remove them.  A client,
+//	on another machine, mounts it under RemoteMountPoint: the
+//	FileSystem hands it every name there (see filesys.h), and a user
+//	program opens, reads and writes those files as its own.
+//
+//	A remote file is known by a handle, the sector of its header on
+//	the server; the server needs no record of who has it open.  The
+//	client caches blocks of the files it reads, and their lengths,
+//	and uses them while it holds a lease from the server: for
+//	LeaseTime after each reply.  Writes go through to the server at
+//	once.  The server puts a write off until every other client's
+//	lease on the file has run out, granting no new ones meanwhile,
+//	so that no client can read stale data from its cache; each write
+//	bumps the file's version, and a client whose lease ran out drops
+//	its blocks of a file whose version has changed.
+//
+//	Leases are timed on each machine's own clock: the client counts
+//	from when it sent the request, before the server granted it, so
+//	its lease runs out first.  Programs cannot be run from a remote
+//	file, nor can remote directories be listed.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef REMOTEFS_H
+#define REMOTEFS_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "list.h"
+#include "stats.h"
+#include "openfile.h"
+#include "rpc.h"
+#include "synch.h"
+
+#define RemoteMountPoint "/net"	// where a client mounts the server
+
+const MailBoxAddress FileServerBox = 8;	// where the server serves
+const MailBoxAddress FileClientBox = 9;	// where a client's replies come
+
+const int RemoteBlockSize = 1024;	// bytes read into the cache at once
+const int RemoteCacheBlocks = 64;	// blocks a client keeps
+const int LeaseTime = 10000;		// how long its cache may be used
+					// without asking the server
+
+// The procedures a file server serves.
+
+enum { FsLookup, FsGetAttr, FsRead, FsWrite, FsCreate, FsRemove };
+
+// The following class defines the front of each request: a file
+// name, ending in a null, or the data to be written, follows it.
+
+class FsRequest {
+  public:
+    int host;			// the client, for its lease
+    int handle;			// the file, or -1 for one named
+    int offset;			// where to read or write
+    int size;			// bytes to read or write; the size of
+				// a file created
+};
+
+// The following class defines the front of each reply: data read
+// follows it.
+
+class FsReply {
+  public:
+    int result;			// the handle, bytes moved, 1 for done;
+				// -1 for no such file, 0 for failed
+    int length;			// of the file, after a write
+    int version;		// changes with each write
+    int lease;			// ticks the client may cache it for
+};
+
+// The following class defines a file of the server's file system
+// that clients have looked up.
+
+class ExportedFile {
+  public:
+    int handle;			// the sector of its header
+    OpenFile *file;		// open on the server
+    int version;		// writes to it so far
+    int leaseUntil[MaxHosts];	// when each client's lease runs out
+    int writesPending;		// writes waiting for leases to run out
+    int users;			// requests using "file" now
+    bool removed;		// delete it once it has no users
+};
+
+// The following class defines the server.
+
+class FileServer {
+  public:
+    FileServer();		// export this machine's file system
+
+  private:
+    RpcServer *server;		// serves the requests
+    Lock *lock;			// protects "exports"
+    List<ExportedFile *> *exports;	// files looked up
+
+    ExportedFile *Get(int handle);	// find a file, and use it
+    ExportedFile *Add(OpenFile *file);	// the same, for one opened
+    void Put(ExportedFile *exported);	// done with it
+    void Grant(ExportedFile *exported, int host, FsReply *reply);
+				// fill in "reply", giving a lease
+
+    static int Lookup(void *arg, char *request, int length, char *reply);
+    static int GetAttr(void *arg, char *request, int length, char *reply);
+    static int Read(void *arg, char *request, int length, char *reply);
+    static int Write(void *arg, char *request, int length, char *reply);
+    static int Create(void *arg, char *request, int length, char *reply);
+    static int Remove(void *arg, char *request, int length, char *reply);
+};
+
+// The following class defines what a client knows of a remote file:
+// its length, and for how long it may trust that, and its blocks.
+
+class RemoteAttr {
+  public:
+    int handle;
+    int length;			// bytes in the file
+    int version;		// of the blocks cached
+    int leaseUntil;		// when the lease runs out
+};
+
+// The following class defines a block of a remote file in a client's
+// cache.
+
+class RemoteBlock {
+  public:
+    int handle;			// the file
+    int block;			// which block of it
+    int count;			// bytes of it in the file
+    char data[RemoteBlockSize];
+};
+
+class RemoteFileSystem;
+
+// The following class defines a remote file opened by a client.
+
+class RemoteFile {
+  public:
+    RemoteFile(RemoteFileSystem *fs, int handle);
+
+    int Read(char *into, int numBytes);	// at the seek position,
+    int Write(char *from, int numBytes);	// moving it on
+    int ReadAt(char *into, int numBytes, int position);
+    int WriteAt(char *from, int numBytes, int position);
+    int Length();		// bytes in the file, or -1 if it has
+				// been removed
+
+  private:
+    RemoteFileSystem *fs;	// its server
+    int handle;			// there
+    int seekPosition;		// where Read and Write go on from
+};
+
+// The following class defines a client: the server's file system,
+// mounted on this machine.
+
+class RemoteFileSystem {
+  public:
+    RemoteFileSystem(NetworkAddress serverHost);
+				// mount the file system of "serverHost"
+    ~RemoteFileSystem();
+
+    RemoteFile *Open(char *name);	// NULL if there is no such file
+    bool Create(char *name, int initialSize);
+    bool Remove(char *name);
+
+  private:
+    friend class RemoteFile;
+
+    RpcClient *client;		// calls the server
+    Lock *lock;			// protects the cache
+    List<RemoteAttr *> *attrs;	// of files opened
+    List<RemoteBlock *> *blocks;	// blocks cached, least recently
+					// used first
+
+    int Call(int proc, FsRequest *request, char *data, int length,
+	     FsReply *reply, char *result);
+				// call the server, with "length" bytes
+				// of "data" after the request; return
+				// the bytes put in "result"
+    RemoteAttr *FindAttr(int handle);	// NULL if not known
+    RemoteBlock *FindBlock(int handle, int block);	// if cached
+    RemoteAttr *Fresh(int handle);	// attributes within a lease
+    void Update(int handle, FsReply *reply, int sentAt);
+				// take what the server said of a file
+    void Drop(int handle);	// forget its blocks
+    int ReadAt(int handle, char *into, int numBytes, int position);
+    int WriteAt(int handle, char *from, int numBytes, int position);
+};
+
+#endif // REMOTEFS_H
@@ -7,8 +7,8 @@
 //
 //	Use a semaphore to synchronize the interrupt handlers with the
 //	pending requests.  And, because the physical disk can only
-//	handle one operation at a time, use a lock to enforce mutual
-//	exclusion.
+//	handle one operation at a time, requests made while it is busy
+//	wait in a queue; the interrupt handler starts the next one.
 //
 // Copyright (c) 1992-1993 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
@@ -16,19 +16,94 @@
 
 #include "copyright.h"
 #include "synchdisk.h"
+#include "main.h"
+
+static const char *policyNames[] = {"FCFS", "SSTF", "SCAN", "C-LOOK"};
+
+//----------------------------------------------------------------------
+// DiskRequest::DiskRequest
+// 	Describe a transfer of the "num" sectors starting at "first", to
+//	or from a buffer per sector.
+//
+//	"toCall" -- if not NULL, its CallBack is invoked, at interrupt
+//		time, when the transfer has been done
+//----------------------------------------------------------------------
+
+DiskRequest::DiskRequest(int first, int num, char **buffers, bool isWrite,
+                         CallBackObj *toCall)
+{
+    firstSector = first;
+    count = num;
+    data = buffers;
+    writing = isWrite;
+    callWhenDone = toCall;
+    queuedAt = 0;
+    owner = NULL;
+    finished = FALSE;
+    done = new Semaphore("disk request", 0);
+}
+
+DiskRequest::~DiskRequest()
+{
+    delete done;
+}
+
+//----------------------------------------------------------------------
+// DiskRequest::CallBack
+// 	Called, at interrupt time, when a device that takes several
+//	requests at once has done this one.
+//----------------------------------------------------------------------
+
+void DiskRequest::CallBack()
+{
+    owner->Finish(this);
+}
 
 //----------------------------------------------------------------------
 // SynchDisk::SynchDisk
 // 	Initialize the synchronous interface to the physical disk, in turn
-//	initializing the physical disk.
+//	initializing the physical disk -- or the flash disk, with -flash,
+//	or a volume of several disks, with -raid.
 //
+//	"policyName" -- how to order waiting requests: "fcfs", "sstf",
+//		"scan" or "clook"; NULL for the default, fcfs
 //----------------------------------------------------------------------
 
-SynchDisk::SynchDisk()
+SynchDisk::SynchDisk(char *policyName)
 {
-    semaphore = new Semaphore("synch disk", 0);
-    lock = new Lock("synch disk lock");
-    disk = new Disk(this);
+    policy = DiskFCFS;
+    if (policyName == NULL || strcmp(policyName, "fcfs") == 0)
+        policy = DiskFCFS;
+    else if (strcmp(policyName, "sstf") == 0)
+        policy = DiskSSTF;
+    else if (strcmp(policyName, "scan") == 0)
+        policy = DiskSCAN;
+    else if (strcmp(policyName, "clook") == 0)
+        policy = DiskCLOOK;
+    else
+        ASSERTNOTREACHED(); // unknown disk scheduling policy
+
+    kernel->stats->diskPolicy = policyNames[policy];
+    queue = new List<DiskRequest *>;
+    active = NULL;
+    direction = 1;
+    numStarted = 0;
+    coalesceCount = max(kernel->diskCoalesceCount, 1);
+    coalesceTicks = kernel->diskCoalesceTicks;
+    completed = new List<DiskRequest *>;
+    batchEpoch = 0;
+    signalling = FALSE;
+    disk = NULL;
+    device = NULL;
+    if (kernel->flashChannels > 0)
+        device = new FlashDisk(kernel->flashChannels, kernel->flashQueueDepth);
+    else if (kernel->raidMembers > 0)
+        device = new RaidVolume((RaidLevel)kernel->raidLevel, kernel->raidMembers,
+                                kernel->stripeSectors);
+    else
+        disk = new Disk(this);
+    if ((disk != NULL) && (coalesceCount > 1))
+        disk->QueueCompletions();
 }
 
 //----------------------------------------------------------------------
@@ -40,8 +115,9 @@ SynchDisk::SynchDisk()
 SynchDisk::~SynchDisk()
 {
     delete disk;
-    delete lock;
-    delete semaphore;
+    delete device;
+    delete queue;
+    delete completed;
 }
 
 //----------------------------------------------------------------------
@@ -55,10 +131,7 @@ SynchDisk::~SynchDisk()
 
 void SynchDisk::ReadSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->ReadRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    ReadSectors(sectorNumber, 1, &data);
 }
 
 //----------------------------------------------------------------------
@@ -72,19 +145,342 @@ void SynchDisk::ReadSector(int sectorNumber, char *data)
 
 void SynchDisk::WriteSector(int sectorNumber, char *data)
 {
-    lock->Acquire(); // only one disk I/O at a time
-    disk->WriteRequest(sectorNumber, data);
-    semaphore->P(); // wait for interrupt
-    lock->Release();
+    WriteSectors(sectorNumber, 1, &data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::ReadSectors/WriteSectors
+// 	Read/write a run of consecutive disk sectors with one disk
+//	request.  Return only after all of them have been transferred.
+//
+//	"firstSector" -- the first disk sector of the run
+//	"count" -- the number of sectors
+//	"data" -- either count * SectorSize contiguous bytes, or an
+//		array of "count" buffers of SectorSize bytes, one per sector
+//----------------------------------------------------------------------
+
+void SynchDisk::ReadSectors(int firstSector, int count, char *data)
+{
+    char **buffers = new char *[count];
+
+    for (int i = 0; i < count; i++)
+        buffers[i] = &data[i * SectorSize];
+    ReadSectors(firstSector, count, buffers);
+    delete[] buffers;
+}
+
+void SynchDisk::WriteSectors(int firstSector, int count, char *data)
+{
+    char **buffers = new char *[count];
+
+    for (int i = 0; i < count; i++)
+        buffers[i] = &data[i * SectorSize];
+    WriteSectors(firstSector, count, buffers);
+    delete[] buffers;
+}
+
+void SynchDisk::ReadSectors(int firstSector, int count, char **data)
+{
+    DiskRequest request(firstSector, count, data, FALSE, NULL);
+
+    Submit(&request);
+    Wait(&request);
+}
+
+void SynchDisk::WriteSectors(int firstSector, int count, char **data)
+{
+    DiskRequest request(firstSector, count, data, TRUE, NULL);
+
+    Submit(&request);
+    Wait(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Discard
+// 	Tell the disk the contents of a run of sectors are no longer
+//	needed.  This happens at once; a request for those sectors that
+//	is still queued reads zeroes or writes them afresh.
+//----------------------------------------------------------------------
+
+void SynchDisk::Discard(int firstSector, int count)
+{
+    if (device != NULL)
+        device->Discard(firstSector, count);
+    else
+        disk->Discard(firstSector, count);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::FlushCache
+// 	Write what the disk holds in its write cache to the platter, and
+//	return only once it is there.  Queued requests are served first,
+//	and later ones after, so that what was written before the flush
+//	is on the platter before anything written after it.  A disk
+//	without a write cache, or another device, has nothing to flush.
+//----------------------------------------------------------------------
+
+void SynchDisk::FlushCache()
+{
+    if ((disk == NULL) || !disk->HasWriteCache())
+        return;
+
+    DiskRequest request(0, 0, NULL, TRUE, NULL);
+
+    Submit(&request);
+    Wait(&request);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Submit
+// 	Send a request to the disk if it can take it, otherwise queue it,
+//	and return right away.  The queue is shared with the disk interrupt
+//	handler, so interrupts are turned off while it is used.
+//
+//	"request" -- the transfer to do; it must not be touched (other
+//		than by Wait or IsDone) until it is done
+//----------------------------------------------------------------------
+
+void SynchDisk::Submit(DiskRequest *request)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    request->finished = FALSE;
+    request->queuedAt = kernel->stats->totalTicks;
+    request->owner = this;
+    kernel->currentThread->Account(request->writing ? UsageSectorsWritten
+                                   : UsageSectorsRead, request->count);
+    if (CanStart() && queue->IsEmpty())
+        Start(request);
+    else
+        queue->Append(request);
+    (void)kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Wait
+// 	Return once a submitted request has been done.  Only one thread
+//	may wait for a given request.
+//
+//	"request" -- a request given to Submit
+//----------------------------------------------------------------------
+
+void SynchDisk::Wait(DiskRequest *request)
+{
+    request->done->P(); // wait for interrupt
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Start
+// 	Hand a request to the raw disk.  Interrupts are off.  A device
+//	that takes several requests at once tells the request itself
+//	when it is done.
+//----------------------------------------------------------------------
+
+void SynchDisk::Start(DiskRequest *request)
+{
+    numStarted++;
+    if (device != NULL)
+    {
+        ASSERT(request->count > 0); // there is no cache to flush
+        if (request->writing)
+            device->WriteRequest(request->firstSector, request->count,
+                                request->data, request);
+        else
+            device->ReadRequest(request->firstSector, request->count,
+                               request->data, request);
+        return;
+    }
+    active = request;
+    if (request->count == 0)
+        disk->FlushRequest();
+    else if (request->writing)
+        disk->WriteRequest(request->firstSector, request->count, request->data);
+    else
+        disk->ReadRequest(request->firstSector, request->count, request->data);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::CanStart
+// 	Return TRUE if the disk can be given a request now: it is idle,
+//	or it takes several requests at once, and has room for another.
+//----------------------------------------------------------------------
+
+bool SynchDisk::CanStart()
+{
+    if (device != NULL)
+        return !device->IsFull();
+    return (active == NULL);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::NextRequest
+// 	Remove and return the queued request to serve next, according to
+//	the scheduling policy, or NULL if there is none.  Interrupts are off.
+//
+//	SSTF asks the disk how long each request would take from where the
+//	head is now, seek and rotational delay included.  SCAN and C-LOOK
+//	go by sector number (track, then position on the track), and turn
+//	around at the last request rather than at the edge of the disk.
+//	The flash or a volume has no one head: it is asked how long, and
+//	the sweeps go from where the last request ended.
+//
+//	No request is served before a flush queued ahead of it, nor the
+//	flush before the requests ahead of it; the policy orders only the
+//	requests ahead of the first flush.
+//----------------------------------------------------------------------
+
+DiskRequest *SynchDisk::NextRequest()
+{
+    ListIterator<DiskRequest *> iter(queue);
+    DiskRequest *best = NULL;
+    int head = (device != NULL) ? device->LastSector() : disk->HeadSector();
+    int bestKey = 0;
+
+    if (queue->IsEmpty())
+        return NULL;
+    if (policy == DiskFCFS)
+        return queue->RemoveFront();
+
+    for (; !iter.IsDone(); iter.Next())
+    {
+        DiskRequest *request = iter.Item();
+        int sector = request->firstSector;
+        int key;
+
+        if (request->count == 0)
+            break; // a flush: the rest wait for it
+
+        switch (policy)
+        {
+        case DiskSSTF:
+            if (device != NULL)
+                key = device->ComputeLatency(sector, request->writing, request->count);
+            else
+                key = disk->ComputeLatency(sector, request->writing, request->count);
+            break;
+        case DiskSCAN:
+            // requests behind the head wait for the return sweep
+            key = (sector - head) * direction;
+            if (key < 0)
+                key = NumSectors - key;
+            break;
+        case DiskCLOOK:
+            // requests behind the head wait for the next sweep
+            key = sector - head;
+            if (key < 0)
+                key += NumSectors;
+            break;
+        default:
+            ASSERTNOTREACHED();
+        }
+        if (best == NULL || key < bestKey)
+        {
+            best = request;
+            bestKey = key;
+        }
+    }
+    if (best == NULL)
+        return queue->RemoveFront(); // the flush is next
+    if (policy == DiskSCAN && bestKey >= NumSectors)
+        direction = -direction; // nothing left ahead: turn around
+    queue->Remove(best);
+    return best;
 }
 
 //----------------------------------------------------------------------
 // SynchDisk::CallBack
-// 	Disk interrupt handler.  Wake up any thread waiting for the disk
-//	request to finish.
+// 	Disk interrupt handler: the request the disk was working on is
+//	done.
 //----------------------------------------------------------------------
 
 void SynchDisk::CallBack()
 {
-    semaphore->V();
+    Finish(active);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Finish
+// 	A request is done.  Start the next queued requests, as many as the
+//	disk will take, then tell the one that finished it is done.
+//	Interrupts are off.
+//
+//	With completion batching, it is only put with the others done
+//	since the last batch was told, and the CPU is signalled once
+//	there are enough of them, or the device has nothing left to do
+//	-- or, failing that, once the first has waited coalesceTicks.
+//----------------------------------------------------------------------
+
+void SynchDisk::Finish(DiskRequest *finished)
+{
+    DiskRequest *next;
+    int latency = kernel->stats->totalTicks - finished->queuedAt;
+
+    kernel->stats->diskLatencyTicks += latency;
+    kernel->stats->diskLatency.Record(latency);
+    if (latency > kernel->stats->maxDiskLatency)
+        kernel->stats->maxDiskLatency = latency;
+
+    active = NULL;
+    numStarted--;
+    while (CanStart() && ((next = NextRequest()) != NULL))
+        Start(next);
+    if (coalesceCount == 1)
+    {
+        Complete(finished);
+        return;
+    }
+
+    completed->Append(finished);
+    if (signalling)
+        return;
+    if ((completed->NumInList() >= coalesceCount) ||
+        ((numStarted == 0) && queue->IsEmpty()))
+    {
+        signalling = TRUE;
+        kernel->interrupt->Schedule(new DiskSignal(this, batchEpoch), 1, DiskInt);
+    }
+    else if ((completed->NumInList() == 1) && (coalesceTicks > 0))
+        kernel->interrupt->Schedule(new DiskSignal(this, batchEpoch),
+                                    coalesceTicks, DiskInt);
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Complete
+// 	Wake up any thread waiting for a request that is done, and call
+//	its callback if it has one.  Interrupts are off.
+//----------------------------------------------------------------------
+
+void SynchDisk::Complete(DiskRequest *request)
+{
+    request->finished = TRUE;
+    request->done->V();
+    if (request->callWhenDone != NULL)
+        request->callWhenDone->CallBack(); // may delete the request
+}
+
+//----------------------------------------------------------------------
+// SynchDisk::Deliver
+// 	The CPU has been signalled: tell every request done since the
+//	last batch, in the order they finished.  Interrupts are off.
+//----------------------------------------------------------------------
+
+void SynchDisk::Deliver()
+{
+    batchEpoch++;
+    signalling = FALSE;
+    while (!completed->IsEmpty())
+        Complete(completed->RemoveFront());
+}
+
+//----------------------------------------------------------------------
+// DiskSignal::CallBack
+// 	Disk interrupt handler, with completion batching: tell the batch
+//	of finished requests the signal is for, unless it already was.
+//----------------------------------------------------------------------
+
+void DiskSignal::CallBack()
+{
+    if (epoch == disk->batchEpoch)
+        disk->Deliver();
+    delete this;
 }
@@ -12,8 +12,73 @@
 #define SYNCHDISK_H
 
 #include "disk.h"
+#include "flash.h"
+#include "raid.h"
 #include "synch.h"
 #include "callback.h"
+#include "list.h"
+
+// The order in which queued disk requests are served.
+
+enum DiskPolicy
+{
+    DiskFCFS,  // in the order they were made
+    DiskSSTF,  // the one the head can reach soonest (seek + rotation)
+    DiskSCAN,  // elevator: sweep up the disk, then back down
+    DiskCLOOK  // sweep up the disk only, then jump back to the lowest
+};
+
+// A read or write of a run of sectors, or, with no sectors, a flush
+// of the disk's write cache.  It is also the handle for an
+// asynchronous transfer: the caller creates it, hands it to
+// SynchDisk::Submit, and then either waits for it with SynchDisk::Wait
+// or is told it is over through "callWhenDone".  The caller owns the
+// request, and may delete it once it is done.
+
+class SynchDisk;
+
+class DiskRequest : public CallBackObj
+{
+public:
+    DiskRequest(int first, int num, char **buffers, bool isWrite,
+                CallBackObj *toCall);
+    ~DiskRequest();
+
+    bool IsDone() { return finished; }
+    void CallBack(); // the device is done with it
+
+    int firstSector; // the run of sectors to transfer
+    int count;
+    char **data;     // a buffer per sector
+    bool writing;
+    CallBackObj *callWhenDone; // if not NULL, called from the disk
+                               // interrupt handler once done
+    int queuedAt;    // when the request was made, in ticks
+    bool finished;   // the transfer is over
+    Semaphore *done; // signalled once the transfer is over
+    SynchDisk *owner; // the disk it was submitted to
+};
+
+// What the disk raises, with completion batching, to tell the CPU
+// about a batch of finished requests; it deletes itself once it has
+// gone off.  "epoch" is the batch it is for: one that was signalled
+// some other way meanwhile needs nothing more.
+
+class DiskSignal : public CallBackObj
+{
+public:
+    DiskSignal(SynchDisk *disk, int epoch)
+    {
+        this->disk = disk;
+        this->epoch = epoch;
+    }
+
+    void CallBack();
+
+private:
+    SynchDisk *disk;
+    int epoch;
+};
 
 // The following class defines a "synchronous" disk abstraction.
 // As with other I/O devices, the raw physical disk is an asynchronous device --
@@ -24,13 +89,33 @@
 //
 // This class provides the abstraction that for any individual thread
 // making a request, it waits around until the operation finishes before
-// returning.
+// returning.  Submit starts a request without waiting, so that the
+// thread can go on working until it calls Wait, or until the request's
+// callback tells it the data is there.
+//
+// Requests made while the disk is busy wait in a queue;
+// when the disk finishes one, the next is chosen by the scheduling
+// policy, so that with several threads doing I/O the head does not
+// seek back and forth across the disk.
+//
+// With the "-flash" flag, the device is a flash disk instead (see
+// machine/flash.h), and with "-raid" a volume of several disks (see
+// machine/raid.h).  These take several requests at once: requests
+// wait in the queue only while it has as many as it can take.
+//
+// With the "-dco" flag, finished requests are batched: the device
+// goes on from one request to the next by itself, and tells the CPU,
+// with one interrupt, once so many are done, or the first has waited
+// so long, or there is nothing left for it to do.  The threads waiting
+// for all of them are then woken in one go.
 
 class SynchDisk : public CallBackObj
 {
 public:
-    SynchDisk();  // Initialize a synchronous disk,
-                  // by initializing the raw Disk.
+    SynchDisk(char *policyName); // Initialize a synchronous disk,
+                                 // by initializing the raw Disk.
+                                 // "policyName" is fcfs, sstf, scan or
+                                 // clook; NULL means fcfs
     ~SynchDisk(); // De-allocate the synch disk data
 
     void ReadSector(int sectorNumber, char *data);
@@ -41,16 +126,59 @@ public:
     // then wait until the request is done.
     void WriteSector(int sectorNumber, char *data);
 
+    void ReadSectors(int firstSector, int count, char *data);
+    void WriteSectors(int firstSector, int count, char *data);
+    // Read/write "count" consecutive sectors
+    // as a single disk request, to/from
+    // count * SectorSize bytes at "data"
+    void ReadSectors(int firstSector, int count, char **data);
+    void WriteSectors(int firstSector, int count, char **data);
+    // The same, scattering to/gathering
+    // from a buffer per sector
+
+    void Discard(int firstSector, int count); // contents no longer
+                                              // needed; see Disk
+    void FlushCache(); // Return only once every write done so far
+                       // is on the platter, not just in the disk's
+                       // write cache
+
+    void Submit(DiskRequest *request); // start a transfer, and return
+                                       // before it is done
+    void Wait(DiskRequest *request);   // wait for a submitted transfer
+
     void CallBack(); // Called by the disk device interrupt
                      // handler, to signal that the
                      // current disk operation is complete.
 
 private:
-    Disk *disk;           // Raw disk device
-    Semaphore *semaphore; // To synchronize requesting thread
-                          // with the interrupt handler
-    Lock *lock;           // Only one read/write request
-                          // can be sent to the disk at a time
+    friend class DiskRequest;
+    friend class DiskSignal;
+
+    void Start(DiskRequest *request);    // send a request to the disk
+    bool CanStart();                     // would the disk take one now?
+    DiskRequest *NextRequest();          // take the next one to serve
+    void Finish(DiskRequest *request);   // the disk is done with one
+    void Complete(DiskRequest *request); // and tells its waiter
+    void Deliver();                      // tell all those done so far
+
+    Disk *disk;                 // Raw disk device, or NULL
+    QueuedDevice *device;       // a device taking several requests
+                                // at once instead, or NULL
+    DiskPolicy policy;          // how queued requests are ordered
+    List<DiskRequest *> *queue; // requests waiting for the disk
+    DiskRequest *active;        // the one the disk is working on
+                                // (a device keeps count of its own)
+    int direction;              // SCAN: 1 sweeping up, -1 down
+    int numStarted;             // requests the device is working on
+
+    int coalesceCount;               // tell the CPU once this many
+                                     // are done; 1 tells each at once
+    int coalesceTicks;               // or once the first has waited
+                                     // this long; 0 for no limit
+    List<DiskRequest *> *completed;  // done, and not yet told
+    int batchEpoch;                  // batches told so far
+    bool signalling;                 // the signal for this batch is
+                                     // on its way
 };
 
 #endif // SYNCHDISK_H
@@ -10,6 +10,9 @@
 #include "debug.h"
 #include "bitmap.h"
 
+// Index of the lowest clear bit of a word that is not completely full.
+#define LowestClearBit(word) __builtin_ctz(~(word))
+
 //----------------------------------------------------------------------
 // BitMap::BitMap
 // 	Initialize a bitmap with "numItems" bits, so that every bit is clear.
@@ -27,14 +30,13 @@ Bitmap::Bitmap(int numItems)
     numBits = numItems;
     numWords = divRoundUp(numBits, BitsInWord);
     map = new unsigned int[numWords];
+    numSummaryWords = divRoundUp(numWords, BitsInWord);
+    summary = new unsigned int[numSummaryWords];
     for (i = 0; i < numWords; i++)
     {
         map[i] = 0; // initialize map to keep Purify happy
     }
-    for (i = 0; i < numBits; i++)
-    {
-        Clear(i);
-    }
+    RebuildSummary();
 }
 
 //----------------------------------------------------------------------
@@ -45,6 +47,7 @@ Bitmap::Bitmap(int numItems)
 Bitmap::~Bitmap()
 {
     delete[] map;
+    delete[] summary;
 }
 
 //----------------------------------------------------------------------
@@ -58,7 +61,12 @@ void Bitmap::Mark(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
+    if (!Test(which))
+    {
+        numClear--;
+    }
     map[which / BitsInWord] |= 1 << (which % BitsInWord);
+    UpdateSummary(which / BitsInWord);
 
     ASSERT(Test(which));
 }
@@ -74,7 +82,12 @@ void Bitmap::Clear(int which)
 {
     ASSERT(which >= 0 && which < numBits);
 
+    if (Test(which))
+    {
+        numClear++;
+    }
     map[which / BitsInWord] &= ~(1 << (which % BitsInWord));
+    UpdateSummary(which / BitsInWord);
 
     ASSERT(!Test(which));
 }
@@ -111,37 +124,227 @@ bool Bitmap::Test(int which) const
 
 int Bitmap::FindAndSet()
 {
-    for (int i = 0; i < numBits; i++)
+    int which = FindClear(hint * BitsInWord);
+
+    if (which != -1)
+    {
+        Mark(which);
+    }
+    return which;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSet(int, int)
+// 	Return the number of the first clear bit from "from" up to (not
+//	including) "to", and set it.  If there is none, return -1.
+//
+//	"from", "to" delimit the bits to consider.
+//----------------------------------------------------------------------
+
+int Bitmap::FindAndSet(int from, int to)
+{
+    ASSERT(from >= 0 && from <= to && to <= numBits);
+
+    int which = FindClear(max(from, hint * BitsInWord));
+
+    if (which == -1 || which >= to)
     {
-        if (!Test(i))
+        return -1;
+    }
+    Mark(which);
+    return which;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::FindAndSetRun
+// 	Return the number of the first bit of a run of "count" consecutive
+//	clear bits, and set all of them.  The first run found is used.
+//
+//	If there is no such run, return -1 and leave the bitmap unchanged.
+//
+//	"count" is the length of the run wanted.
+//	"from", "to" delimit the bits the run must lie within; by default,
+//	  the whole bitmap.
+//	"align" -- the run must start on a multiple of this; by default,
+//	  anywhere
+//----------------------------------------------------------------------
+
+int Bitmap::FindAndSetRun(int count)
+{
+    return FindAndSetRun(count, 0, numBits, 1);
+}
+
+int Bitmap::FindAndSetRun(int count, int from, int to)
+{
+    return FindAndSetRun(count, from, to, 1);
+}
+
+int Bitmap::FindAndSetRun(int count, int from, int to, int align)
+{
+    ASSERT(count > 0 && align > 0);
+    ASSERT(from >= 0 && from <= to && to <= numBits);
+
+    int start = FindClear(max(from, hint * BitsInWord));
+    if (start != -1)
+        start = divRoundUp(start, align) * align;
+    while (start != -1 && start + count <= to)
+    {
+        int end = start; // run is [start, end)
+        while (end < start + count)
         {
-            Mark(i);
-            return i;
+            if (end % BitsInWord == 0 && end + BitsInWord <= start + count &&
+                map[end / BitsInWord] == 0)
+            {
+                end += BitsInWord; // a whole empty word
+            }
+            else if (!Test(end))
+            {
+                end++;
+            }
+            else
+            {
+                break;
+            }
         }
+        if (end == start + count)
+        {
+            for (int i = start; i < end; i++)
+            {
+                Mark(i);
+            }
+            return start;
+        }
+        start = FindClear(end);
+        if (start != -1)
+            start = divRoundUp(start, align) * align;
     }
     return -1;
 }
 
 //----------------------------------------------------------------------
-// Bitmap::NumClear
-// 	Return the number of clear bits in the bitmap.
-//	(In other words, how many bits are unallocated?)
+// Bitmap::FindClear
+// 	Return the number of the first clear bit at or after "from",
+//	or -1 if there is none.  Full words are skipped using the summary,
+//	so this does not look at bits one at a time.
+//
+//	"from" is the number of the first bit to consider.
 //----------------------------------------------------------------------
 
-int Bitmap::NumClear() const
+int Bitmap::FindClear(int from) const
 {
-    int count = 0;
+    if (from >= numBits)
+    {
+        return -1;
+    }
 
-    for (int i = 0; i < numBits; i++)
+    int w = from / BitsInWord;
+    unsigned int bits = map[w] | ((1u << (from % BitsInWord)) - 1);
+    if (bits != ~0u)
     {
-        if (!Test(i))
+        int which = w * BitsInWord + LowestClearBit(bits);
+        return (which < numBits) ? which : -1;
+    }
+
+    // the rest of word "w" is full; find the next word with a clear bit
+    for (w++; w < numWords; w++)
+    {
+        unsigned int full = summary[w / BitsInWord];
+        if (w % BitsInWord == 0 && full == ~0u)
         {
-            count++;
+            w += BitsInWord - 1; // BitsInWord full words in a row
+            continue;
+        }
+        if (!(full & (1u << (w % BitsInWord))))
+        {
+            int which = w * BitsInWord + LowestClearBit(map[w]);
+            return (which < numBits) ? which : -1;
         }
     }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Bitmap::UpdateSummary
+// 	Record in the summary whether "map[word]" is now full, and move the
+//	search hint back if the word has become free.
+//
+//	"word" is the index of the word of "map" that changed.
+//----------------------------------------------------------------------
+
+void Bitmap::UpdateSummary(int word)
+{
+    unsigned int mask = 1u << (word % BitsInWord);
+
+    if (map[word] == ~0u)
+    {
+        summary[word / BitsInWord] |= mask;
+        if (word == hint)
+        {
+            hint++;
+        }
+    }
+    else
+    {
+        summary[word / BitsInWord] &= ~mask;
+        if (word < hint)
+        {
+            hint = word;
+        }
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::RebuildSummary
+// 	Recompute the summary, the search hint and the number of clear
+//	bits from scratch.  Must be called whenever "map" is changed
+//	other than by Mark or Clear.
+//----------------------------------------------------------------------
+
+void Bitmap::RebuildSummary()
+{
+    int i;
+
+    Recount();
+
+    for (i = 0; i < numSummaryWords; i++)
+    {
+        summary[i] = 0;
+    }
+    hint = numWords;
+    for (i = numWords - 1; i >= 0; i--)
+    {
+        UpdateSummary(i);
+    }
+}
+
+//----------------------------------------------------------------------
+// Bitmap::CountClear
+// 	Count the clear bits in the bitmap, a word at a time, rather than
+//	trusting the running count that NumClear returns.  Bits past
+//	"numBits" in the last word are never set, so are not counted.
+//----------------------------------------------------------------------
+
+int Bitmap::CountClear() const
+{
+    int count = numBits;
+
+    for (int i = 0; i < numWords; i++)
+    {
+        count -= __builtin_popcount(map[i]);
+    }
     return count;
 }
 
+//----------------------------------------------------------------------
+// Bitmap::Recount
+// 	Set the running count of clear bits to what CountClear finds.
+//----------------------------------------------------------------------
+
+void Bitmap::Recount()
+{
+    numClear = CountClear();
+}
+
 //----------------------------------------------------------------------
 // Bitmap::Print
 // 	Print the contents of the bitmap, for debugging.
@@ -193,4 +396,18 @@ void Bitmap::SelfTest()
     {
         Clear(i);
     }
+
+    // runs, including ones that span words and skip a partial run
+    ASSERT(FindAndSetRun(3) == 0);
+    Mark(BitsInWord - 2);
+    ASSERT(FindAndSetRun(BitsInWord) == BitsInWord - 1);
+    ASSERT(Test(2 * BitsInWord - 2) && !Test(2 * BitsInWord - 1));
+    ASSERT(FindAndSet() == 3);
+    ASSERT(FindAndSetRun(numBits) == -1);
+    ASSERT(NumClear() == CountClear() && NumClear() == numBits - BitsInWord - 5);
+    for (i = 0; i < numBits; i++)
+    {
+        Clear(i);
+    }
+    ASSERT(NumClear() == numBits);
 }
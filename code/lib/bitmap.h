@@ -8,6 +8,16 @@
 //	The bitmap can be parameterized with with the number of bits being
 //	managed.
 //
+//	To keep allocation fast on large maps (e.g. the 1M-sector free map),
+//	the bitmap also maintains a summary with one bit per word of storage
+//	telling whether that word is completely full, and a hint below which
+//	every word is known to be full.  Searches skip full words a whole
+//	summary word (BitsInWord words) at a time.
+//
+//	The number of clear bits is kept up to date by Mark and Clear as
+//	well, so asking how much room is left costs nothing; Recount
+//	counts it again, a word at a time, for checking.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -43,18 +53,43 @@ public:
     int FindAndSet();           // Return the # of a clear bit, and as a side
         // effect, set the bit.
         // If no bits are clear, return -1.
-    int NumClear() const; // Return the number of clear bits
+    int FindAndSet(int from, int to); // The same, among bits "from"
+        // up to but not including "to"
+    int FindAndSetRun(int count); // Find "count" consecutive clear bits,
+        // set them, and return the # of the first.
+        // If there is no such run, return -1.
+    int FindAndSetRun(int count, int from, int to); // The same, for a
+        // run among bits "from" up to but not including "to"
+    int FindAndSetRun(int count, int from, int to, int align); // ...one
+        // that starts on a multiple of "align"
+    int NumClear() const { return numClear; }
+                          // Return the number of clear bits
+    int CountClear() const; // Count them again, a word at a time
+    void Recount();       // and make that the number of clear bits
 
     void Print() const; // Print contents of bitmap
     void SelfTest();    // Test whether bitmap is working
 
 protected:
+    void RebuildSummary(); // recompute summary and hint after "map"
+                           // was overwritten (e.g. read from disk)
+
     int numBits;       // number of bits in the bitmap
     int numWords;      // number of words of bitmap storage
                        // (rounded up if numBits is not a
                        //  multiple of the number of bits in
                        //  a word)
     unsigned int *map; // bit storage
+
+private:
+    int FindClear(int from) const; // # of the first clear bit at or
+                                   // after "from", or -1
+    void UpdateSummary(int word);  // keep summary in sync with map[word]
+
+    int numSummaryWords;   // number of words of summary storage
+    unsigned int *summary; // bit "w" set <=> map[w] has no clear bit
+    int hint;              // every word below this one is full
+    int numClear;          // number of clear bits
 };
 
 #endif // BITMAP_H
@@ -0,0 +1,511 @@
+// btree.cc
+//     	Routines to manage an ordered set of items kept as a B-tree.
+//
+//	Insertion splits every full node on the way down, so that there
+//	is always room in the parent for the middle item of a child that
+//	splits.  Removal likewise makes sure, on the way down, that each
+//	node it moves into has more than the fewest items allowed, by
+//	borrowing one from a sibling or merging with it, so that taking an
+//	item out never leaves a node too empty.  (This is the algorithm
+//	of Cormen, Leiserson and Rivest, chapter 19.)
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int MaxBTreeItems = 2 * BTreeDegree - 1;	// in a full node
+const int MinBTreeItems = BTreeDegree - 1;	// in any but the root
+
+//----------------------------------------------------------------------
+// BTree<T>::BTree
+//	Initialize an empty tree.
+//
+//	"comp" is the function that orders the items
+//----------------------------------------------------------------------
+
+template <class T>
+BTree<T>::BTree(int (*comp)(T x, T y))
+{
+    compare = comp;
+    root = NULL;
+    numInTree = 0;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::~BTree
+//	Prepare a tree for deallocation.  As with lists, the items
+//	themselves are the caller's to de-allocate.
+//----------------------------------------------------------------------
+
+template <class T>
+BTree<T>::~BTree()
+{
+    DeleteNode(root);
+}
+
+template <class T>
+void
+BTree<T>::DeleteNode(BTreeNode<T> *node)
+{
+    if (node == NULL) {
+	return;
+    }
+    if (!node->leaf) {
+	for (int i = 0; i <= node->numItems; i++) {
+	    DeleteNode(node->children[i]);
+	}
+    }
+    delete node;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::Insert
+//      Put an item into the tree.  A full root is split first, which
+//	is the only way the tree grows taller; then we go down to the
+//	leaf the item belongs in, splitting any full node on the way.
+//	An item equal to some already in the tree goes after them.
+//
+//	"item" is the thing to put in the tree
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::Insert(T item)
+{
+    BTreeNode<T> *node;
+    int i;
+
+    if (root == NULL) {
+	root = new BTreeNode<T>(TRUE);
+    }
+    if (root->numItems == MaxBTreeItems) {
+	node = new BTreeNode<T>(FALSE);
+	node->children[0] = root;
+	root = node;
+	SplitChild(root, 0);
+    }
+
+    node = root;
+    while (!node->leaf) {
+	for (i = 0; (i < node->numItems) &&
+		(compare(item, node->items[i]) >= 0); i++) {
+	}
+	if (node->children[i]->numItems == MaxBTreeItems) {
+	    SplitChild(node, i);
+	    if (compare(item, node->items[i]) >= 0) {
+		i++;
+	    }
+	}
+	node = node->children[i];
+    }
+    for (i = node->numItems; (i > 0) &&
+	    (compare(item, node->items[i - 1]) < 0); i--) {
+	node->items[i] = node->items[i - 1];
+    }
+    node->items[i] = item;
+    node->numItems++;
+    numInTree++;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::SplitChild
+//      Split the full child "i" of "node" in two, moving its middle
+//	item up into "node", which must not be full.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::SplitChild(BTreeNode<T> *node, int i)
+{
+    BTreeNode<T> *left = node->children[i];
+    BTreeNode<T> *right = new BTreeNode<T>(left->leaf);
+    int j;
+
+    ASSERT(left->numItems == MaxBTreeItems && node->numItems < MaxBTreeItems);
+    right->numItems = MinBTreeItems;
+    for (j = 0; j < MinBTreeItems; j++) {
+	right->items[j] = left->items[j + BTreeDegree];
+    }
+    if (!left->leaf) {
+	for (j = 0; j < BTreeDegree; j++) {
+	    right->children[j] = left->children[j + BTreeDegree];
+	}
+    }
+    left->numItems = MinBTreeItems;
+
+    for (j = node->numItems; j > i; j--) {
+	node->children[j + 1] = node->children[j];
+	node->items[j] = node->items[j - 1];
+    }
+    node->children[i + 1] = right;
+    node->items[i] = left->items[MinBTreeItems];
+    node->numItems++;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::Remove
+//      Take an item equal to "item" out of the tree.  Return FALSE if
+//	there is none.  A root left with no items gives way to its only
+//	child, which is the only way the tree gets shorter.
+//
+//	"item" is the thing to take out
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+BTree<T>::Remove(T item)
+{
+    bool found;
+
+    if (root == NULL) {
+	return FALSE;
+    }
+    found = RemoveFrom(root, item);
+    if (root->numItems == 0) {
+	BTreeNode<T> *old = root;
+
+	root = root->leaf ? NULL : root->children[0];
+	delete old;
+    }
+    if (found) {
+	numInTree--;
+    }
+    return found;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::RemoveFrom
+//      Take an item equal to "item" out of the subtree under "node",
+//	which has more than MinBTreeItems items unless it is the root.
+//
+//	If "node" holds the item, and is not a leaf, the item is replaced
+//	by the one before it (or after it) in a child that can spare one,
+//	which is then removed from there instead; if neither child can
+//	spare one, they are merged around the item.  Otherwise we go down
+//	into the child that would hold the item, first giving it an item
+//	more if it has only MinBTreeItems.
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+BTree<T>::RemoveFrom(BTreeNode<T> *node, T item)
+{
+    int i, j;
+
+    for (i = 0; (i < node->numItems) &&
+	    (compare(item, node->items[i]) > 0); i++) {
+    }
+
+    if ((i < node->numItems) && (compare(item, node->items[i]) == 0)) {
+	BTreeNode<T> *left, *right;
+
+	if (node->leaf) {
+	    for (j = i; j < node->numItems - 1; j++) {
+		node->items[j] = node->items[j + 1];
+	    }
+	    node->numItems--;
+	    return TRUE;
+	}
+	left = node->children[i];
+	right = node->children[i + 1];
+	if (left->numItems > MinBTreeItems) {
+	    BTreeNode<T> *last = left;	// the item just before
+
+	    while (!last->leaf) {
+		last = last->children[last->numItems];
+	    }
+	    node->items[i] = last->items[last->numItems - 1];
+	    return RemoveFrom(left, node->items[i]);
+	}
+	if (right->numItems > MinBTreeItems) {
+	    BTreeNode<T> *first = right;	// the item just after
+
+	    while (!first->leaf) {
+		first = first->children[0];
+	    }
+	    node->items[i] = first->items[0];
+	    return RemoveFrom(right, node->items[i]);
+	}
+	MergeChildren(node, i);
+	return RemoveFrom(left, item);
+    }
+
+    if (node->leaf) {
+	return FALSE;
+    }
+    if (node->children[i]->numItems == MinBTreeItems) {
+	Fill(node, i);
+	if (i > node->numItems) {	// merged with the child before
+	    i--;
+	}
+    }
+    return RemoveFrom(node->children[i], item);
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::Fill
+//      Give child "i" of "node", which has only MinBTreeItems items,
+//	one more: through "node", from a sibling that can spare one, or
+//	else by merging it with a sibling.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::Fill(BTreeNode<T> *node, int i)
+{
+    BTreeNode<T> *child = node->children[i];
+    int j;
+
+    if ((i > 0) && (node->children[i - 1]->numItems > MinBTreeItems)) {
+	BTreeNode<T> *left = node->children[i - 1];
+
+	for (j = child->numItems; j > 0; j--) {
+	    child->items[j] = child->items[j - 1];
+	}
+	if (!child->leaf) {
+	    for (j = child->numItems + 1; j > 0; j--) {
+		child->children[j] = child->children[j - 1];
+	    }
+	    child->children[0] = left->children[left->numItems];
+	}
+	child->items[0] = node->items[i - 1];
+	child->numItems++;
+	node->items[i - 1] = left->items[left->numItems - 1];
+	left->numItems--;
+    } else if ((i < node->numItems) &&
+	       (node->children[i + 1]->numItems > MinBTreeItems)) {
+	BTreeNode<T> *right = node->children[i + 1];
+
+	child->items[child->numItems] = node->items[i];
+	if (!child->leaf) {
+	    child->children[child->numItems + 1] = right->children[0];
+	}
+	child->numItems++;
+	node->items[i] = right->items[0];
+	for (j = 0; j < right->numItems - 1; j++) {
+	    right->items[j] = right->items[j + 1];
+	}
+	if (!right->leaf) {
+	    for (j = 0; j < right->numItems; j++) {
+		right->children[j] = right->children[j + 1];
+	    }
+	}
+	right->numItems--;
+    } else if (i < node->numItems) {
+	MergeChildren(node, i);
+    } else {
+	MergeChildren(node, i - 1);
+    }
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::MergeChildren
+//      Join children "i" and "i + 1" of "node", each with only
+//	MinBTreeItems items, and the item of "node" between them, into a
+//	single full node.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::MergeChildren(BTreeNode<T> *node, int i)
+{
+    BTreeNode<T> *left = node->children[i];
+    BTreeNode<T> *right = node->children[i + 1];
+    int j;
+
+    ASSERT(left->numItems == MinBTreeItems && right->numItems == MinBTreeItems);
+    left->items[MinBTreeItems] = node->items[i];
+    for (j = 0; j < MinBTreeItems; j++) {
+	left->items[j + BTreeDegree] = right->items[j];
+    }
+    if (!left->leaf) {
+	for (j = 0; j < BTreeDegree; j++) {
+	    left->children[j + BTreeDegree] = right->children[j];
+	}
+    }
+    left->numItems = MaxBTreeItems;
+    delete right;
+
+    for (j = i; j < node->numItems - 1; j++) {
+	node->items[j] = node->items[j + 1];
+	node->children[j + 1] = node->children[j + 2];
+    }
+    node->numItems--;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::Ceiling, BTree<T>::Floor
+//      Find the smallest item no smaller than "key", or the biggest
+//	no bigger.  Each node on the way down gives a closer answer than
+//	the one above it, if it has one.  Return FALSE if there is none.
+//
+//	"key" is what to compare the items with
+//	"found" is where to return the item
+//----------------------------------------------------------------------
+
+template <class T>
+bool
+BTree<T>::Ceiling(T key, T *found) const
+{
+    BTreeNode<T> *node = root;
+    bool any = FALSE;
+    int i;
+
+    while (node != NULL) {
+	for (i = 0; (i < node->numItems) &&
+		(compare(node->items[i], key) < 0); i++) {
+	}
+	if (i < node->numItems) {
+	    *found = node->items[i];
+	    any = TRUE;
+	}
+	node = node->leaf ? NULL : node->children[i];
+    }
+    return any;
+}
+
+template <class T>
+bool
+BTree<T>::Floor(T key, T *found) const
+{
+    BTreeNode<T> *node = root;
+    bool any = FALSE;
+    int i;
+
+    while (node != NULL) {
+	for (i = 0; (i < node->numItems) &&
+		(compare(node->items[i], key) <= 0); i++) {
+	}
+	if (i > 0) {
+	    *found = node->items[i - 1];
+	    any = TRUE;
+	}
+	node = node->leaf ? NULL : node->children[i];
+    }
+    return any;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::Apply
+//      Apply function to every item in the tree, smallest first.
+//
+//	"func" is the procedure to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::Apply(void (*func)(T)) const
+{
+    ApplyNode(root, func);
+}
+
+template <class T>
+void
+BTree<T>::ApplyNode(BTreeNode<T> *node, void (*func)(T)) const
+{
+    if (node == NULL) {
+	return;
+    }
+    for (int i = 0; i < node->numItems; i++) {
+	if (!node->leaf) {
+	    ApplyNode(node->children[i], func);
+	}
+	(*func)(node->items[i]);
+    }
+    if (!node->leaf) {
+	ApplyNode(node->children[node->numItems], func);
+    }
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::SanityCheck
+//      Test whether this is still a legal B-tree.
+//
+//	Test: are the items of each node in order, and between those of
+//	its parent on either side?  Does every node but the root have
+//	enough items, and is every leaf at the same depth?  Are all the
+//	items counted?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::SanityCheck() const
+{
+    int leafDepth = -1;
+
+    if (root == NULL) {
+	ASSERT(numInTree == 0);
+	return;
+    }
+    ASSERT(root->numItems > 0);
+    ASSERT(CheckNode(root, 0, &leafDepth) == numInTree);
+}
+
+template <class T>
+int
+BTree<T>::CheckNode(BTreeNode<T> *node, int depth, int *leafDepth) const
+{
+    int count = node->numItems;
+
+    ASSERT(node->numItems <= MaxBTreeItems);
+    ASSERT((node == root) || (node->numItems >= MinBTreeItems));
+    for (int i = 1; i < node->numItems; i++) {
+	ASSERT(compare(node->items[i - 1], node->items[i]) <= 0);
+    }
+    if (node->leaf) {
+	if (*leafDepth == -1) {
+	    *leafDepth = depth;
+	}
+	ASSERT(depth == *leafDepth);
+	return count;
+    }
+    for (int i = 0; i <= node->numItems; i++) {
+	BTreeNode<T> *child = node->children[i];
+
+	if (i > 0) {
+	    ASSERT(compare(node->items[i - 1], child->items[0]) <= 0);
+	}
+	if (i < node->numItems) {
+	    ASSERT(compare(child->items[child->numItems - 1],
+			   node->items[i]) <= 0);
+	}
+	count += CheckNode(child, depth + 1, leafDepth);
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// BTree<T>::SelfTest
+//      Test whether this module is working: put the items in, enough
+//	times over to make the tree three levels deep, check that each
+//	can be found, then take them all out again.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+BTree<T>::SelfTest(T *p, int numEntries)
+{
+    int i, total = numEntries * MaxBTreeItems * BTreeDegree;
+    T found;
+
+    ASSERT(IsEmpty());
+    for (i = 0; i < total; i++) {
+	Insert(p[i % numEntries]);
+	SanityCheck();
+    }
+    ASSERT(NumInTree() == total);
+
+    for (i = 0; i < numEntries; i++) {
+	ASSERT(Ceiling(p[i], &found) && (compare(found, p[i]) == 0));
+	ASSERT(Floor(p[i], &found) && (compare(found, p[i]) == 0));
+    }
+
+    for (i = 0; i < total; i++) {
+	ASSERT(Remove(p[i % numEntries]));
+	SanityCheck();
+    }
+    ASSERT(IsEmpty());
+    ASSERT(!Remove(p[0]));
+}
@@ -0,0 +1,106 @@
+// btree.h
+//	Data structures to manage an ordered set of items, kept as a
+//	B-tree in memory.
+//
+//	Like a sorted list, a B-tree keeps its items in order; but
+//	inserting, removing and finding an item each take O(log n) time,
+//	instead of the O(n) of walking a list.  Each node holds up to
+//	2 * BTreeDegree - 1 items, and every node but the root at least
+//	BTreeDegree - 1, so the tree stays shallow and well balanced.
+//
+//	Besides looking an item up, the tree can find the nearest one to
+//	a key: the smallest item no smaller than it (Ceiling), or the
+//	biggest no bigger (Floor).  That is what makes it useful for
+//	looking things up by range, as the free extents of a disk are.
+//
+//	Items that compare equal may be inserted more than once; Remove
+//	takes out one of them.  Allocation and deallocation of the items
+//	in the tree are to be done by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// Least number of children of a node other than a leaf or the root.
+#define BTreeDegree 8
+
+// The following class defines a node of the tree.  A leaf has no
+// children; any other node with "numItems" items has one more
+// child than that, the items of children[i] coming between items[i-1]
+// and items[i].
+
+template <class T>
+class BTreeNode {
+  public:
+    BTreeNode(bool isLeaf) { numItems = 0; leaf = isLeaf; }
+
+    int numItems;			// how many of "items" are in use
+    bool leaf;				// are there children?
+    T items[2 * BTreeDegree - 1];	// in order
+    BTreeNode<T> *children[2 * BTreeDegree];
+};
+
+// The following class defines a B-tree.  As with a sorted list, all
+// types to be inserted must have a "Compare" function defined:
+//	   int Compare(T x, T y)
+//		returns -1 if x < y
+//		returns 0 if x == y
+//		returns 1 if x > y
+
+template <class T>
+class BTree {
+  public:
+    BTree(int (*comp)(T x, T y));	// initialize an empty tree
+    ~BTree();			// de-allocate the tree
+
+    void Insert(T item);	// put an item into the tree
+    bool Remove(T item);	// take out an item equal to "item";
+				// FALSE if there is none
+    bool Ceiling(T key, T *found) const;
+				// the smallest item >= "key"; FALSE
+				// if every item is smaller
+    bool Floor(T key, T *found) const;
+				// the biggest item <= "key"; FALSE
+				// if every item is bigger
+
+    int NumInTree() { return numInTree; }
+    				// how many items in the tree?
+    bool IsEmpty() { return (numInTree == 0); }
+    				// is the tree empty?
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all items in the
+				// tree, in order
+
+    void SanityCheck() const;	// has this tree been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    int (*compare)(T x, T y);	// function for ordering the items
+    BTreeNode<T> *root;		// NULL if the tree is empty
+    int numInTree;		// number of items in the tree
+
+    void SplitChild(BTreeNode<T> *node, int i);
+				// split a full child in two
+    void MergeChildren(BTreeNode<T> *node, int i);
+				// join two children that are half full
+    void Fill(BTreeNode<T> *node, int i);
+				// give a half full child one more item
+    bool RemoveFrom(BTreeNode<T> *node, T item);
+    void DeleteNode(BTreeNode<T> *node);
+    void ApplyNode(BTreeNode<T> *node, void (*f)(T)) const;
+    int CheckNode(BTreeNode<T> *node, int depth, int *leafDepth) const;
+				// items under "node", checking them
+};
+
+#include "btree.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // BTREE_H
@@ -0,0 +1,184 @@
+// compress.cc
+//	Routines to compress and expand buffers.  See compress.h.
+//
+//	Matches are found through a hash table of the positions where
+//	each three-byte string last appeared, chained back to where it
+//	appeared before; at most CompressMaxTries of them are compared,
+//	so that compressing stays linear in the size of the buffer.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "compress.h"
+#include "debug.h"
+#include "utility.h"
+
+#define CompressHashSize 1024		// chains of earlier positions
+#define CompressMaxTries 32		// most of them compared per byte
+
+//----------------------------------------------------------------------
+// HashAt
+// 	Return the chain for the three bytes at "p".
+//----------------------------------------------------------------------
+
+static int
+HashAt(unsigned char *p)
+{
+    return ((p[0] << 6) ^ (p[1] << 3) ^ p[2]) % CompressHashSize;
+}
+
+//----------------------------------------------------------------------
+// Compress
+// 	Compress "numBytes" of "from" into "into", at each position
+//	taking the longest match found, or else a literal byte.  Return
+//	the number of bytes written to "into", or -1 if they would be
+//	more than "maxBytes" -- the caller passes less than "numBytes"
+//	to be told that the data does not compress.
+//----------------------------------------------------------------------
+
+int
+Compress(char *from, int numBytes, char *into, int maxBytes)
+{
+    unsigned char *in = (unsigned char *) from;
+    int head[CompressHashSize];
+    int *prev = new int[max(numBytes, 1)];	// earlier position in chain
+    int i = 0, out = 0, flagAt = 0, item = 8;
+    int k;
+
+    for (k = 0; k < CompressHashSize; k++)
+	head[k] = -1;
+    while (i < numBytes) {
+	int bestLength = 1, bestDistance = 0;
+
+	if (item == 8) {			// start a new group
+	    if (out == maxBytes)
+		break;
+	    flagAt = out++;
+	    into[flagAt] = 0;
+	    item = 0;
+	}
+	if (i + CompressMinMatch <= numBytes) {
+	    int limit = min(CompressMaxMatch, numBytes - i);
+	    int tries = 0;
+
+	    for (int j = head[HashAt(&in[i])]; (j >= 0) &&
+		     (i - j <= CompressWindow) && (tries < CompressMaxTries);
+		 j = prev[j], tries++) {
+		int length = 0;
+
+		while ((length < limit) && (in[j + length] == in[i + length]))
+		    length++;
+		if (length > bestLength) {
+		    bestLength = length;
+		    bestDistance = i - j;
+		    if (length == limit)
+			break;
+		}
+	    }
+	}
+	if (bestLength >= CompressMinMatch) {
+	    if (out + 2 > maxBytes)
+		break;
+	    into[out++] = (char) ((bestDistance - 1) >> 4);
+	    into[out++] = (char) ((((bestDistance - 1) & 0xf) << 4) |
+				  (bestLength - CompressMinMatch));
+	} else {
+	    bestLength = 1;
+	    if (out + 1 > maxBytes)
+		break;
+	    into[flagAt] |= (char) (1 << item);
+	    into[out++] = from[i];
+	}
+	item++;
+	for (k = 0; k < bestLength; k++, i++) {
+	    if (i + CompressMinMatch <= numBytes) {
+		int h = HashAt(&in[i]);
+
+		prev[i] = head[h];
+		head[h] = i;
+	    }
+	}
+    }
+    delete [] prev;
+    return (i < numBytes) ? -1 : out;
+}
+
+//----------------------------------------------------------------------
+// Decompress
+// 	Expand "numBytes" of "from", as written by Compress, into "into".
+//	Return the number of bytes that gives, or -1 if it would be more
+//	than "maxBytes", or a match reaches back before the beginning.
+//----------------------------------------------------------------------
+
+int
+Decompress(char *from, int numBytes, char *into, int maxBytes)
+{
+    unsigned char *in = (unsigned char *) from;
+    int i = 0, out = 0;
+
+    while (i < numBytes) {
+	int flags = in[i++];
+
+	for (int item = 0; (item < 8) && (i < numBytes); item++) {
+	    if (flags & (1 << item)) {
+		if (out == maxBytes)
+		    return -1;
+		into[out++] = from[i++];
+	    } else {
+		int distance, length;
+
+		if (i + 2 > numBytes)
+		    return -1;
+		distance = ((in[i] << 4) | (in[i + 1] >> 4)) + 1;
+		length = (in[i + 1] & 0xf) + CompressMinMatch;
+		i += 2;
+		if ((distance > out) || (out + length > maxBytes))
+		    return -1;
+		for (; length > 0; length--, out++)	// may overlap itself
+		    into[out] = into[out - distance];
+	    }
+	}
+    }
+    return out;
+}
+
+//----------------------------------------------------------------------
+// CompressSelfTest
+//	Compress repetitive and random-looking buffers, and check that
+//	they expand back to what they were.
+//----------------------------------------------------------------------
+
+void
+CompressSelfTest()
+{
+    const int size = 3000;
+    char *data = new char[size];
+    char *packed = new char[size];
+    char *unpacked = new char[size];
+    unsigned int seed = 1;
+    int i, n;
+
+    for (i = 0; i < size; i++)			// zero-padded numbers
+	data[i] = (i % 9 == 8) ? '\n' : '0' + (i / 9 / (1 + i % 9 % 4)) % 10;
+    n = Compress(data, size, packed, size - 1);
+    ASSERT((n > 0) && (n < size / 2));
+    ASSERT(Decompress(packed, n, unpacked, size) == size);
+    ASSERT(bcmp(data, unpacked, size) == 0);
+
+    for (i = 0; i < size; i++) {		// noise
+	seed = seed * 1103515245 + 12345;
+	data[i] = (char) (seed >> 16);
+    }
+    ASSERT(Compress(data, size, packed, size - 1) == -1);
+    n = Compress(data, size, packed, size);
+    ASSERT((n < 0) || (Decompress(packed, n, unpacked, size) == size));
+
+    ASSERT(Compress(data, 0, packed, 0) == 0);
+    ASSERT(Decompress(packed, 0, unpacked, size) == 0);
+
+    delete [] data;
+    delete [] packed;
+    delete [] unpacked;
+}
@@ -0,0 +1,39 @@
+// compress.h
+//	Routines to compress a buffer of bytes, and to expand it again,
+//	with a simple LZ77 scheme (LZSS): each run of bytes that already
+//	appeared in the last CompressWindow bytes is replaced by where it
+//	did and how long it is.  Repetitive data -- text, tables of
+//	numbers, mostly empty blocks -- shrinks a lot; random data does
+//	not shrink at all, and is left as it is by the caller.
+//
+//	The compressed bytes come in groups of up to eight items, each
+//	group after a flag byte whose bits, lowest first, say which items
+//	are literal bytes (1) and which are matches (0), two bytes each:
+//	12 bits of distance back, less one, and 4 of length, less
+//	CompressMinMatch.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COMPRESS_H
+#define COMPRESS_H
+
+#include "copyright.h"
+
+#define CompressWindow 4096		// how far back a match may be
+#define CompressMinMatch 3		// shortest run worth a match
+#define CompressMaxMatch (CompressMinMatch + 15) // and longest
+
+extern int Compress(char *from, int numBytes, char *into, int maxBytes);
+				// compress "numBytes" of "from" into at
+				// most "maxBytes" of "into"; return
+				// how many it took, or -1 if they
+				// are not enough
+extern int Decompress(char *from, int numBytes, char *into, int maxBytes);
+				// expand them again; return how many
+				// bytes that gives, or -1 if they
+				// are damaged or do not fit
+extern void CompressSelfTest();	// verify module is working
+
+#endif // COMPRESS_H
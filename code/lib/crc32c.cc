@@ -0,0 +1,169 @@
+// crc32c.cc
+//	Routines to compute CRC-32C checksums.  See crc32c.h.
+//
+//	The tables for the software version are built the first time
+//	they are needed.  Table k gives the effect on the checksum of a
+//	byte followed by k zero bytes, so that eight bytes can be folded
+//	in with eight lookups and no shifts between them.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "crc32c.h"
+#include "debug.h"
+#include "utility.h"
+
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#define CRC32C_X86
+#endif
+
+#define Crc32cPoly 0x82f63b78	// the Castagnoli polynomial, reflected
+
+static unsigned crcTable[8][256];
+static bool tablesBuilt = FALSE;
+static int useHardware = -1;	// not yet known
+
+//----------------------------------------------------------------------
+// BuildTables
+// 	Fill in the tables for the software version.
+//----------------------------------------------------------------------
+
+static void
+BuildTables()
+{
+    for (int n = 0; n < 256; n++) {
+	unsigned crc = n;
+
+	for (int bit = 0; bit < 8; bit++)
+	    crc = (crc & 1) ? (crc >> 1) ^ Crc32cPoly : crc >> 1;
+	crcTable[0][n] = crc;
+    }
+    for (int n = 0; n < 256; n++)
+	for (int k = 1; k < 8; k++)
+	    crcTable[k][n] = (crcTable[k - 1][n] >> 8) ^
+			     crcTable[0][crcTable[k - 1][n] & 0xff];
+    tablesBuilt = TRUE;
+}
+
+//----------------------------------------------------------------------
+// SoftwareCrc
+// 	Fold "numBytes" of "p" into "crc" using the tables: bytes one at
+//	a time up to an eight-byte boundary, then eight at a time.
+//----------------------------------------------------------------------
+
+static unsigned
+SoftwareCrc(unsigned crc, unsigned char *p, int numBytes)
+{
+    if (!tablesBuilt)
+	BuildTables();
+    while ((numBytes > 0) && (((unsigned long) p & 7) != 0)) {
+	crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xff];
+	numBytes--;
+    }
+    while (numBytes >= 8) {
+	unsigned lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) |
+			     ((unsigned) p[3] << 24));
+
+	crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff] ^
+	      crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24] ^
+	      crcTable[3][p[4]] ^ crcTable[2][p[5]] ^
+	      crcTable[1][p[6]] ^ crcTable[0][p[7]];
+	p += 8;
+	numBytes -= 8;
+    }
+    while (numBytes-- > 0)
+	crc = (crc >> 8) ^ crcTable[0][(crc ^ *p++) & 0xff];
+    return crc;
+}
+
+#ifdef CRC32C_X86
+//----------------------------------------------------------------------
+// HardwareCrc
+// 	Fold "numBytes" of "p" into "crc" with the crc32 instruction.
+//	Compiled for SSE4.2 whatever the rest of Nachos is compiled for;
+//	only called once the processor is known to have it.
+//----------------------------------------------------------------------
+
+__attribute__((target("sse4.2"))) static unsigned
+HardwareCrc(unsigned crc, unsigned char *p, int numBytes)
+{
+    while ((numBytes > 0) && (((unsigned long) p & 3) != 0)) {
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+	numBytes--;
+    }
+    while (numBytes >= 4) {
+	crc = __builtin_ia32_crc32si(crc, *(unsigned *) p);
+	p += 4;
+	numBytes -= 4;
+    }
+    while (numBytes-- > 0)
+	crc = __builtin_ia32_crc32qi(crc, *p++);
+    return crc;
+}
+#endif // CRC32C_X86
+
+//----------------------------------------------------------------------
+// Crc32cHardware
+// 	Return TRUE if the processor has the crc32 instruction, which
+//	is then used.  Asked of the processor the first time.
+//----------------------------------------------------------------------
+
+bool
+Crc32cHardware()
+{
+    if (useHardware < 0) {
+	useHardware = 0;
+#ifdef CRC32C_X86
+	unsigned a, b, c, d;
+
+	if (__get_cpuid(1, &a, &b, &c, &d) && (c & bit_SSE4_2))
+	    useHardware = 1;
+#endif
+	DEBUG(dbgFile, "CRC-32C computed " <<
+	      (useHardware ? "by the processor" : "with tables"));
+    }
+    return useHardware == 1;
+}
+
+//----------------------------------------------------------------------
+// Crc32c
+// 	Return the CRC-32C of "numBytes" of "data".
+//----------------------------------------------------------------------
+
+unsigned
+Crc32c(char *data, int numBytes)
+{
+    unsigned char *p = (unsigned char *) data;
+
+#ifdef CRC32C_X86
+    if (Crc32cHardware())
+	return ~HardwareCrc(~0U, p, numBytes);
+#endif
+    return ~SoftwareCrc(~0U, p, numBytes);
+}
+
+//----------------------------------------------------------------------
+// Crc32cSelfTest
+// 	Check the standard test value, and that the hardware and the
+//	software agree on buffers of every length and alignment.
+//----------------------------------------------------------------------
+
+void
+Crc32cSelfTest()
+{
+    char check[] = "123456789";
+    char buf[64];
+
+    ASSERT(Crc32c(check, 9) == 0xe3069283);
+    for (int i = 0; i < 64; i++)
+	buf[i] = (char) (i * 37 + 11);
+    for (int start = 0; start < 8; start++)
+	for (int n = 0; start + n <= 64; n++) {
+	    unsigned crc = ~SoftwareCrc(~0U, (unsigned char *) &buf[start], n);
+
+	    ASSERT(Crc32c(&buf[start], n) == crc);
+	}
+}
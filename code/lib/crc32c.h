@@ -0,0 +1,25 @@
+// crc32c.h
+//	Routines to compute the CRC-32C (Castagnoli) checksum of a
+//	buffer of bytes, as used by iSCSI, ext4 and btrfs to catch data
+//	that was damaged on its way to or from the disk.
+//
+//	On an x86 processor with SSE4.2, the checksum is computed by its
+//	crc32 instruction, four bytes at a time; elsewhere, with tables,
+//	eight bytes at a time ("slicing by eight").  Both give the same
+//	result.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include "copyright.h"
+
+extern unsigned Crc32c(char *data, int numBytes);
+				// the checksum of "numBytes" of "data"
+extern bool Crc32cHardware();	// is the crc32 instruction used?
+extern void Crc32cSelfTest();	// verify module is working
+
+#endif // CRC32C_H
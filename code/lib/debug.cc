@@ -24,22 +24,13 @@
 
 Debug::Debug(char *flagList)
 {
-    enableFlags = flagList;
-}
-
+    bool all = (flagList != NULL) && (strchr(flagList, '+') != NULL);
 
-//----------------------------------------------------------------------
-// Debug::IsEnabled
-//      Return TRUE if DEBUG messages with "flag" are to be printed.
-//----------------------------------------------------------------------
-
-bool
-Debug::IsEnabled(char flag)
-{
-    if (enableFlags != NULL) {
-	return ((strchr(enableFlags, flag) != 0) 
-		|| (strchr(enableFlags, '+') != 0));
-    } else {
-    	return FALSE;
+    for (int i = 0; i < 256 / FlagsInWord; i++) {
+	enabled[i] = all ? ~0u : 0;
+    }
+    for (char *p = flagList; (p != NULL) && (*p != '\0'); p++) {
+	unsigned int c = (unsigned char)*p;
+	enabled[c / FlagsInWord] |= 1u << (c % FlagsInWord);
     }
 }
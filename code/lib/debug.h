@@ -6,6 +6,11 @@
 //	passed to Nachos (-d).  You are encouraged to add your own
 //	debugging flags.  Please.... 
 //
+//	The flags enabled are kept as a bitmask, one bit per character,
+//	so that checking one costs a shift and a mask.  In a release build
+//	(make BUILD=release, which defines NO_DEBUG_MSGS), DEBUG statements
+//	are compiled out altogether; debug->IsEnabled still works.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -34,10 +39,17 @@ class Debug {
   public:
     Debug(char *flagList);
 
-    bool IsEnabled(char flag);
+    bool IsEnabled(char flag) {
+	unsigned int c = (unsigned char)flag;
+	return (enabled[c / FlagsInWord] >> (c % FlagsInWord)) & 1;
+    }
 
   private:
-    char *enableFlags;		// controls which DEBUG messages are printed
+    static const int FlagsInWord = sizeof(unsigned int) * 8;
+
+    unsigned int enabled[256 / FlagsInWord];
+				// bit "c" set <=> DEBUG messages with
+				// flag "c" are printed
 };
 
 extern Debug *debug;
@@ -45,12 +57,21 @@ extern Debug *debug;
 
 //----------------------------------------------------------------------
 // DEBUG
-//      If flag is enabled, print a message.
+//      If flag is enabled, print a message.  In a release build, the
+//	message is still compiled (so it cannot go stale), but never
+//	printed, and the compiler drops it.
 //----------------------------------------------------------------------
+#ifdef NO_DEBUG_MSGS
+#define DEBUG(flag,expr)                                                     \
+    if (TRUE) {} else { 						\
+        cerr << expr << "\n";   				        \
+    }
+#else
 #define DEBUG(flag,expr)                                                     \
     if (!debug->IsEnabled(flag)) {} else { 				\
         cerr << expr << "\n";   				        \
     }
+#endif
 
 
 //----------------------------------------------------------------------
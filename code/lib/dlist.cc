@@ -0,0 +1,236 @@
+// dlist.cc
+//     	Routines to manage doubly linked lists whose links are embedded
+//	in the items.
+//
+//	The list is circular through its head, a link that belongs to
+//	no item, so that putting an item on or taking one off never has
+//	to check for the ends of the list.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// DList<T>::DList
+//	Initialize a list, empty to start with.
+//	Elements can now be added to the list.
+//
+//	"getLink" -- returns the link embedded in an item
+//----------------------------------------------------------------------
+
+template <class T>
+DList<T>::DList(DListLink<T> *(*getLink)(T x))
+{
+    head.next = head.prev = &head;
+    numInList = 0;
+    link = getLink;
+}
+
+//----------------------------------------------------------------------
+// DList<T>::~DList
+//	Prepare a list for deallocation.  Any items still on it are
+//	taken off, so their links can be used again, but they are not
+//	de-allocated.
+//----------------------------------------------------------------------
+
+template <class T>
+DList<T>::~DList()
+{
+    while (!IsEmpty())
+	(void) RemoveFront();
+}
+
+//----------------------------------------------------------------------
+// DList<T>::InsertAfter
+//	Link an item into the list just after "where" -- another item's
+//	link, or the head.  The item must not be on any list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::InsertAfter(DListLink<T> *where, T item)
+{
+    DListLink<T> *l = (*link)(item);
+
+    ASSERT(!l->IsLinked());
+    l->item = item;
+    l->list = this;
+    l->prev = where;
+    l->next = where->next;
+    where->next->prev = l;
+    where->next = l;
+    numInList++;
+}
+
+//----------------------------------------------------------------------
+// DList<T>::Unlink
+//	Take an item, by its link, off the list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::Unlink(DListLink<T> *l)
+{
+    ASSERT(l->list == this);
+    l->prev->next = l->next;
+    l->next->prev = l->prev;
+    l->prev = l->next = NULL;
+    l->list = NULL;
+    numInList--;
+}
+
+//----------------------------------------------------------------------
+// DList<T>::Append, DList<T>::Prepend
+//      Put an item at the end, or the beginning, of the list.
+//
+//	"item" is the thing to put on the list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::Append(T item)
+{
+    InsertAfter(head.prev, item);
+    ASSERT(IsInList(item));
+}
+
+template <class T>
+void
+DList<T>::Prepend(T item)
+{
+    InsertAfter(&head, item);
+    ASSERT(IsInList(item));
+}
+
+//----------------------------------------------------------------------
+// DList<T>::RemoveFront, DList<T>::RemoveBack
+//      Remove the first, or last, item from the list.  The list
+//	must not be empty.
+//
+// Returns:
+//	The removed item.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+DList<T>::RemoveFront()
+{
+    T item = Front();
+
+    Unlink(head.next);
+    return item;
+}
+
+template <class T>
+T
+DList<T>::RemoveBack()
+{
+    T item = Back();
+
+    Unlink(head.prev);
+    return item;
+}
+
+//----------------------------------------------------------------------
+// DList<T>::Remove
+//      Remove a specific item from the list.  The item must be on it.
+//
+//	"item" is the thing to take off the list.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::Remove(T item)
+{
+    Unlink((*link)(item));
+    ASSERT(!IsInList(item));
+}
+
+//----------------------------------------------------------------------
+// DList<T>::Apply
+//      Apply function to every item on a list.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::Apply(void (*func)(T)) const
+{
+    for (DListLink<T> *l = head.next; l != &head; l = l->next)
+	(*func)(l->item);
+}
+
+//----------------------------------------------------------------------
+// DList<T>::SanityCheck
+//      Test whether this is still a legal list.
+//
+//	Tests: do the links agree with each other in both directions?
+//	       is each item's link the one it is found by?
+//	       does the list have the right # of items?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::SanityCheck() const
+{
+    int numFound = 0;
+
+    ASSERT(head.next->prev == &head && head.prev->next == &head);
+    for (DListLink<T> *l = head.next; l != &head; l = l->next) {
+	ASSERT(l->next->prev == l);
+	ASSERT(l->list == this);
+	ASSERT((*link)(l->item) == l);
+	numFound++;
+    }
+    ASSERT(numFound == numInList);
+}
+
+//----------------------------------------------------------------------
+// DList<T>::SelfTest
+//      Test whether this module is working.  The items (at least 3)
+//	must be on no list to start with, and are on none when we are done.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+DList<T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    DListIterator<T> *iterator = new DListIterator<T>(this);
+
+    ASSERT(numEntries >= 3);
+    SanityCheck();
+    ASSERT(IsEmpty());	// check that list is empty in various ways
+    for (; !iterator->IsDone(); iterator->Next()) {
+	ASSERTNOTREACHED();
+    }
+    delete iterator;
+
+    for (i = 0; i < numEntries; i++) {
+	Append(p[i]);
+	ASSERT(IsInList(p[i]));
+	ASSERT(!IsEmpty());
+    }
+    SanityCheck();
+
+    // should be able to get out everything we put in, from the middle
+    // and both ends
+    Remove(p[numEntries / 2]);
+    ASSERT(!IsInList(p[numEntries / 2]));
+    Prepend(p[numEntries / 2]);
+    ASSERT(Front() == p[numEntries / 2]);
+    SanityCheck();
+    ASSERT(RemoveFront() == p[numEntries / 2]);
+    ASSERT(RemoveBack() == p[numEntries - 1]);
+    for (i = 0; i < numEntries - 1; i++) {
+	if (i != numEntries / 2)
+	    Remove(p[i]);
+    }
+    ASSERT(IsEmpty());
+    SanityCheck();
+}
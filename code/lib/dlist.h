@@ -0,0 +1,128 @@
+// dlist.h
+//	Data structures to manage doubly linked lists whose links are
+//	embedded in the items themselves ("intrusive" lists).
+//
+//	A List (see list.h) keeps each item in an element of its own,
+//	so removing an item from the middle means searching for it.
+//	Here each item carries a DListLink, found from the item by a
+//	function the caller supplies, so an item can be put on a list
+//	or taken off it in constant time, with no allocation at all.
+//	This suits queues that items must leave out of turn: the ready
+//	lists, when a thread's priority changes; a cache's list of
+//	entries in the order they were last used.
+//
+//	An item can be on only one list per link it carries.
+//	Allocation and deallocation of the items on the list are to be
+//	done by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DLIST_H
+#define DLIST_H
+
+#include "copyright.h"
+#include "debug.h"
+
+template <class T> class DList;
+template <class T> class DListIterator;
+
+// The following class defines the link embedded in each item that
+// can go on a DList.  Only the list touches it.
+
+template <class T>
+class DListLink {
+  public:
+    DListLink() { prev = next = NULL; list = NULL; }
+    bool IsLinked() const { return list != NULL; }
+				// is the item on a list?
+
+  private:
+    friend class DList<T>;
+    friend class DListIterator<T>;
+
+    DListLink<T> *prev;		// the link before, or the list's head
+    DListLink<T> *next;		// the link after, or the list's head
+    DList<T> *list;		// the list the item is on, or NULL
+    T item;			// the item the link is embedded in
+};
+
+// The following class defines a doubly linked list of items, in
+// the same manner as List.
+
+template <class T>
+class DList {
+  public:
+    DList(DListLink<T> *(*getLink)(T x));
+				// initialize the list; "getLink"
+				// finds the link in an item
+    ~DList();			// de-allocate the list, taking any
+				// items still on it off
+
+    void Prepend(T item);	// Put item at the beginning of the list
+    void Append(T item);	// Put item at the end of the list
+
+    T Front() { ASSERT(!IsEmpty()); return head.next->item; }
+    				// Return first item on list
+				// without removing it
+    T Back() { ASSERT(!IsEmpty()); return head.prev->item; }
+				// Return last item on list
+				// without removing it
+    T RemoveFront();		// Take item off the front of the list
+    T RemoveBack();		// Take item off the back of the list
+    void Remove(T item);	// Remove specific item from list
+
+    bool IsInList(T item) const { return (*link)(item)->list == this; }
+				// is the item in the list?
+
+    unsigned int NumInList() { return numInList; };
+    				// how many items in the list?
+    bool IsEmpty() { return (numInList == 0); };
+    				// is the list empty?
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all elements in list
+
+    void SanityCheck() const;	// has this list been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    DListLink<T> head;		// not an item's: next is the first
+				// item's link, prev the last's
+    int numInList;		// number of items in the list
+    DListLink<T> *(*link)(T x);	// find the link in an item
+
+    void InsertAfter(DListLink<T> *where, T item);
+    void Unlink(DListLink<T> *l);
+
+    friend class DListIterator<T>;
+};
+
+// The following class can be used to step through a DList -- same
+// interface as ListIterator.  The item at the current position may
+// be removed from the list only after moving past it.
+
+template <class T>
+class DListIterator {
+  public:
+    DListIterator(DList<T> *list) { this->list = list; current = list->head.next; }
+				// initialize an iterator
+
+    bool IsDone() { return current == &list->head; };
+				// return TRUE if we are at the end
+    T Item() { ASSERT(!IsDone()); return current->item; };
+				// return current element on list
+    void Next() { current = current->next; };
+				// update iterator to point to next
+
+  private:
+    DList<T> *list;		// the list we are stepping through
+    DListLink<T> *current;	// where we are in it
+};
+
+#include "dlist.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // DLIST_H
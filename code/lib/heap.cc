@@ -0,0 +1,176 @@
+// heap.cc
+//     	Routines to manage a priority queue kept as a binary heap.
+//
+//	The heap is stored in an array: the children of items[i] are
+//	items[2i + 1] and items[2i + 2].  An item is inserted at the end
+//	and sifted up past any bigger parents; the front is removed by
+//	moving the last item there and sifting it down past any smaller
+//	children.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int InitialHeapSize = 16;	// items there is room for at first
+
+//----------------------------------------------------------------------
+// Heap<T>::Heap
+//	Initialize an empty heap.
+//
+//	"comp" is the function that orders the items
+//----------------------------------------------------------------------
+
+template <class T>
+Heap<T>::Heap(int (*comp)(T x, T y))
+{
+    compare = comp;
+    size = InitialHeapSize;
+    items = new T[size];
+    numInHeap = 0;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::~Heap
+//	Prepare a heap for deallocation.  As with lists, the items
+//	themselves are the caller's to de-allocate.
+//----------------------------------------------------------------------
+
+template <class T>
+Heap<T>::~Heap()
+{
+    delete [] items;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Insert
+//      Put an item into the heap, growing the array if there is no
+//	room: append it, then move it up while it is smaller than its
+//	parent.
+//
+//	"item" is the thing to put in the heap
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::Insert(T item)
+{
+    int i, parent;
+
+    if (numInHeap == size) {
+	T *old = items;
+
+	items = new T[2 * size];
+	for (i = 0; i < numInHeap; i++) {
+	    items[i] = old[i];
+	}
+	size *= 2;
+	delete [] old;
+    }
+    for (i = numInHeap++; i > 0; i = parent) {
+	parent = (i - 1) / 2;
+	if (compare(item, items[parent]) >= 0) {
+	    break;
+	}
+	items[i] = items[parent];
+    }
+    items[i] = item;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::RemoveFront
+//      Remove the smallest item from the heap, and return it.  Its
+//	place is taken by the last item, which moves down while it is
+//	bigger than the smaller of its children.
+//----------------------------------------------------------------------
+
+template <class T>
+T
+Heap<T>::RemoveFront()
+{
+    T front, last;
+    int i, child;
+
+    ASSERT(!IsEmpty());
+    front = items[0];
+    last = items[--numInHeap];
+    for (i = 0; (child = 2 * i + 1) < numInHeap; i = child) {
+	if ((child + 1 < numInHeap) &&
+		(compare(items[child + 1], items[child]) < 0)) {
+	    child++;
+	}
+	if (compare(last, items[child]) <= 0) {
+	    break;
+	}
+	items[i] = items[child];
+    }
+    items[i] = last;
+    return front;
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::Apply
+//      Apply function to every item in the heap, in the order they
+//	are stored, which is smallest first but otherwise arbitrary.
+//
+//	"func" is the procedure to apply
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::Apply(void (*func)(T)) const
+{
+    for (int i = 0; i < numInHeap; i++) {
+	(*func)(items[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::SanityCheck
+//      Test whether this is still a legal heap.
+//
+//	Test: is every item no smaller than its parent?
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::SanityCheck() const
+{
+    ASSERT(numInHeap >= 0 && numInHeap <= size);
+    for (int i = 1; i < numInHeap; i++) {
+	ASSERT(compare(items[(i - 1) / 2], items[i]) <= 0);
+    }
+}
+
+//----------------------------------------------------------------------
+// Heap<T>::SelfTest
+//      Test whether this module is working: put the items in, enough
+//	times over to make the array grow, and check that they come out
+//	smallest first.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+Heap<T>::SelfTest(T *p, int numEntries)
+{
+    int i, total = numEntries * InitialHeapSize;
+    T previous;
+
+    ASSERT(IsEmpty());
+    for (i = 0; i < total; i++) {
+	Insert(p[i % numEntries]);
+	SanityCheck();
+    }
+    ASSERT(NumInHeap() == total);
+
+    previous = RemoveFront();
+    for (i = 1; i < total; i++) {
+	T next = RemoveFront();
+
+	ASSERT(compare(previous, next) <= 0);
+	previous = next;
+	SanityCheck();
+    }
+    ASSERT(IsEmpty());
+}
@@ -0,0 +1,72 @@
+// heap.h
+//	Data structures to manage a priority queue, kept as a binary heap
+//	in an array.
+//
+//	Like a sorted list, a heap always gives back its smallest item
+//	first; but inserting and removing an item each take O(log n)
+//	time, instead of the O(n) of walking a list, and no storage is
+//	allocated per item -- the array just doubles when it fills up.
+//	The catch is that the items are kept in no useful order, except
+//	that the smallest is at the front.
+//
+//	Items that compare equal come out in no particular order; a
+//	caller that cares must break ties in its compare function.
+//	Allocation and deallocation of the items in the heap are to be
+//	done by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "copyright.h"
+#include "debug.h"
+
+// The following class defines a "heap" -- an array of items, arranged
+// so that each one is no bigger than the two below it, and so
+// "RemoveFront" always returns the smallest.  All types to be inserted
+// into a heap must have a "Compare" function defined:
+//	   int Compare(T x, T y)
+//		returns -1 if x < y
+//		returns 0 if x == y
+//		returns 1 if x > y
+
+template <class T>
+class Heap {
+  public:
+    Heap(int (*comp)(T x, T y));	// initialize an empty heap
+    ~Heap();			// de-allocate the heap
+
+    void Insert(T item);	// put an item into the heap
+    T Front() { ASSERT(numInHeap > 0); return items[0]; }
+    				// return the smallest item
+				// without removing it
+    T RemoveFront();		// take the smallest item out
+
+    int NumInHeap() { return numInHeap; }
+    				// how many items in the heap?
+    bool IsEmpty() { return (numInHeap == 0); }
+    				// is the heap empty?
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all items in the
+				// heap, in no particular order
+
+    void SanityCheck() const;	// has this heap been corrupted?
+    void SelfTest(T *p, int numEntries);
+				// verify module is working
+
+  private:
+    int (*compare)(T x, T y);	// function for ordering the items
+    T *items;			// the heap: items[i] is no bigger than
+				// items[2i + 1] and items[2i + 2]
+    int numInHeap;		// number of items in the heap
+    int size;			// number of items there is room for
+};
+
+#include "heap.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // HEAP_H
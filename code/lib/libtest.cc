@@ -1,6 +1,7 @@
 // libtest.cc 
 //	Driver code to call self-test routines for standard library
-//	classes -- bitmaps, lists, sorted lists, and hash tables.
+//	classes -- bitmaps, lists, sorted lists, doubly linked lists,
+//	heaps, B-trees, and hash tables -- and for compression.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -10,13 +11,19 @@
 #include "libtest.h"
 #include "bitmap.h"
 #include "list.h"
+#include "dlist.h"
+#include "heap.h"
+#include "btree.h"
 #include "hash.h"
+#include "openhash.h"
+#include "compress.h"
+#include "crc32c.h"
 #include "sysdep.h"
 
 //----------------------------------------------------------------------
 // IntCompare
 //	Compare two integers together.  Serves as the comparison
-//	function for testing SortedLists
+//	function for testing SortedLists, Heaps and BTrees
 //----------------------------------------------------------------------
 
 static int 
@@ -53,15 +60,39 @@ HashKey(char *str) {
 // Array of values to be inserted into a List or SortedList. 
 static int listTestVector[] = { 9, 5, 7 };
 
-// Array of values to be inserted into the HashTable
-// There are enough here to force a ReHash().
+// An item that can go on a DList.
+class DListTestItem {
+  public:
+    DListLink<DListTestItem *> link;
+};
+
+//----------------------------------------------------------------------
+// DListTestLink
+//	Find the link in an item.  Serves as the function to retrieve
+//	the link for testing DLists.
+//----------------------------------------------------------------------
+
+static DListLink<DListTestItem *> *
+DListTestLink(DListTestItem *item) {
+    return &item->link;
+}
+
+// Items to be put on a DList.
+static DListTestItem dlistTestItems[5];
+static DListTestItem *dlistTestVector[] = { &dlistTestItems[0],
+	&dlistTestItems[1], &dlistTestItems[2], &dlistTestItems[3],
+	&dlistTestItems[4] };
+
+// Array of values to be inserted into the hash tables
+// There are enough here to force a ReHash(), and to grow an
+// OpenHashTable twice.
 static char *hashTestVector[] = { "0", "1", "2", "3", "4", "5", "6",
 	 "7", "8", "9", "10", "11", "12", "13", "14"};
 
 //----------------------------------------------------------------------
 // LibSelfTest
-//	Run self tests on bitmaps, lists, sorted lists, and 
-//	hash tables.
+//	Run self tests on bitmaps, lists, sorted lists, doubly linked
+//	lists, heaps, B-trees, and hash tables; and on compression.
 //----------------------------------------------------------------------
 
 void
@@ -69,17 +100,35 @@ LibSelfTest () {
     Bitmap *map = new Bitmap(200);
     List<int> *list = new List<int>;
     SortedList<int> *sortList = new SortedList<int>(IntCompare);
+    DList<DListTestItem *> *dlist =
+	new DList<DListTestItem *>(DListTestLink);
+    Heap<int> *heap = new Heap<int>(IntCompare);
+    BTree<int> *btree = new BTree<int>(IntCompare);
     HashTable<int, char *> *hashTable = 
 	new HashTable<int, char *>(HashKey, HashInt);
+    OpenHashTable<int, char *> *openHashTable =
+	new OpenHashTable<int, char *>(HashKey, HashInt);
 	
 		
     map->SelfTest();
     list->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
     sortList->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
+    dlist->SelfTest(dlistTestVector,
+		    sizeof(dlistTestVector)/sizeof(DListTestItem *));
+    heap->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
+    btree->SelfTest(listTestVector, sizeof(listTestVector)/sizeof(int));
     hashTable->SelfTest(hashTestVector, sizeof(hashTestVector)/sizeof(char *));
+    openHashTable->SelfTest(hashTestVector,
+			    sizeof(hashTestVector)/sizeof(char *));
+    CompressSelfTest();
+    Crc32cSelfTest();
 
     delete map;
     delete list;
     delete sortList;
+    delete dlist;
+    delete heap;
+    delete btree;
     delete hashTable;
+    delete openHashTable;
 }
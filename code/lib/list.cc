@@ -6,7 +6,8 @@
 // 	A "ListElement" is allocated for each item to be put on the
 //	list; it is de-allocated when the item is removed. This means
 //      we don't need to keep a "next" pointer in every object we
-//      want to put on a list.
+//      want to put on a list.  The elements are recycled through a
+//	free list, so this is cheap.
 // 
 //     	NOTE: Mutual exclusion must be provided by the caller.
 //  	If you want a synchronized list, you must use the routines 
@@ -32,6 +33,49 @@ ListElement<T>::ListElement(T itm)
      next = NULL;	// always initialize to something!
 }
 
+template <class T>
+ListElement<T> *ListElement<T>::freeList = NULL;
+
+//----------------------------------------------------------------------
+// ListElement<T>::operator new, ListElement<T>::operator delete
+// 	Take a list element off the free list, refilling it first with
+//	a chunk of ListChunkSize new ones if it is empty; put an element
+//	back on the free list.  Chunks are never given back to the heap.
+//
+//	No lock is needed: nothing here can cause a context switch.
+//----------------------------------------------------------------------
+
+template <class T>
+void *
+ListElement<T>::operator new(size_t size)
+{
+    ListElement<T> *element;
+
+    ASSERT(size == sizeof(ListElement<T>));
+    if (freeList == NULL) {
+	ListElement<T> *chunk = (ListElement<T> *)
+		::operator new(ListChunkSize * sizeof(ListElement<T>));
+
+	for (int i = 0; i < ListChunkSize; i++) {
+	    chunk[i].next = freeList;
+	    freeList = &chunk[i];
+	}
+    }
+    element = freeList;
+    freeList = element->next;
+    return element;
+}
+
+template <class T>
+void
+ListElement<T>::operator delete(void *p)
+{
+    ListElement<T> *element = (ListElement<T> *)p;
+
+    element->next = freeList;
+    freeList = element;
+}
+
 
 //----------------------------------------------------------------------
 // List<T>::List
@@ -23,6 +23,14 @@
 //
 // This class is private to this module (and classes that inherit
 // from this module). Made public for notational convenience.
+//
+// Elements are allocated from a free list of their own, one for each
+// type of item, refilled ListChunkSize elements at a time; a removed
+// element goes back on it, not to the heap.  So putting things on
+// lists -- the ready list, wait queues, pending interrupts -- does no
+// heap allocation once the lists have been as long as they will be.
+
+const int ListChunkSize = 64;	// elements allocated at once
 
 template <class T>
 class ListElement {
@@ -30,6 +38,12 @@ class ListElement {
     ListElement(T itm); 	// initialize a list element
     ListElement *next;	     	// next element on list, NULL if this is last
     T item; 	   	     	// item on the list
+
+    void *operator new(size_t size);	// take one off the free list
+    void operator delete(void *p);	// put one back on it
+
+  private:
+    static ListElement *freeList; // elements on no list, linked by "next"
 };
 
 // The following class defines a "list" -- a singly linked list of
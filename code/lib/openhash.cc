@@ -0,0 +1,454 @@
+// openhash.cc
+//     	Routines to manage an open-addressing hash table of arbitrary
+//	things, which grows a few slots at a time.
+//
+//	Items go in the first free slot at or after the one their key
+//	hashes to.  Removing one moves back any items after it that
+//	belong before the hole, so a lookup can stop at the first free
+//	slot: no "deleted" markers are ever left behind.
+//
+//	While the table is growing, the old array is emptied in slot
+//	order.  Every slot before "moveFrom" is free, so the items still
+//	in the old array can be found, and removed, the same way.
+//
+//     	NOTE: Mutual exclusion must be provided by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+const int InitialSlots = 8;	// how big a table do we start with
+const int MovesPerCall = 4;	// old slots looked at per Insert, Remove
+				// (enough to empty the old array well
+				// before the new one needs to grow)
+
+#include "copyright.h"
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::OpenHashTable
+//	Initialize a hash table, empty to start with.
+//	Elements can now be added to the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x))
+{
+    numSlots = InitialSlots;
+    slots = new Slot[numSlots];
+    for (int i = 0; i < numSlots; i++)
+	slots[i].full = FALSE;
+    numItems = 0;
+    oldSlots = NULL;
+    numOldSlots = 0;
+    numOldItems = 0;
+    moveFrom = 0;
+    getKey = get;
+    hash = hFunc;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::~OpenHashTable
+//	Prepare a hash table for deallocation.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashTable<Key,T>::~OpenHashTable()
+{
+    ASSERT(IsEmpty());		// make sure table is empty
+    delete [] slots;
+    delete [] oldSlots;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Home
+//      Return the slot a key hashes to, in an array of "size" slots.
+//	The hash is scrambled first, since keys are often small integers
+//	(sector numbers, say) that would otherwise all crowd together.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+int
+OpenHashTable<Key,T>::Home(Key key, int size) const
+{
+    unsigned h = (*hash)(key) * 2654435769U;
+
+    return (int)((h ^ (h >> 16)) & (unsigned)(size - 1));
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::FindSlot
+//      Find the slot holding a key, searching from its home slot up to
+//	the first free one.
+//
+//	"array", "size" -- the slots to search
+//	"key" -- the key uniquely identifying the item
+//
+// Returns:
+//	The slot, or -1 if the key is not there.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+int
+OpenHashTable<Key,T>::FindSlot(Slot *array, int size, Key key) const
+{
+    if (array == NULL)
+	return -1;
+    for (int i = Home(key, size); array[i].full; i = (i + 1) & (size - 1)) {
+	if (array[i].key == key)
+	    return i;
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::PutSlot
+//      Put an item in the first free slot, at or after its home, of
+//	the current array.  The caller makes sure there is room.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::PutSlot(Key key, T item)
+{
+    int i = Home(key, numSlots);
+
+    while (slots[i].full)
+	i = (i + 1) & (numSlots - 1);
+    slots[i].full = TRUE;
+    slots[i].key = key;
+    slots[i].item = item;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::ClearSlot
+//      Empty a slot.  An item further on that could have gone in the
+//	emptied slot (its home is not between the two) is moved back
+//	into it, and so on, leaving no gap between any item and its home.
+//
+//	"array", "size" -- the slots
+//	"i" -- the slot to empty
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::ClearSlot(Slot *array, int size, int i)
+{
+    int mask = size - 1;
+
+    array[i].full = FALSE;
+    for (int j = (i + 1) & mask; array[j].full; j = (j + 1) & mask) {
+	int home = Home(array[j].key, size);
+
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    array[i] = array[j];
+	    array[j].full = FALSE;
+	    i = j;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::StartResize
+//      Make an array twice the size to put items in from now on.  The
+//	current one becomes the old array, to be emptied bit by bit.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::StartResize()
+{
+    ASSERT(oldSlots == NULL);
+    oldSlots = slots;
+    numOldSlots = numSlots;
+    numOldItems = numItems;
+    moveFrom = 0;
+
+    numSlots *= 2;
+    slots = new Slot[numSlots];
+    for (int i = 0; i < numSlots; i++)
+	slots[i].full = FALSE;
+    numItems = 0;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::MoveSome
+//      Move items from the old array to the new, looking at up to
+//	"count" slots.  Emptying a slot may move a later item back into
+//	it, so we only go on to the next slot once this one stays free.
+//	The old array is freed once the last item is out of it.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::MoveSome(int count)
+{
+    for (; (oldSlots != NULL) && (count > 0); count--) {
+	if (oldSlots[moveFrom].full) {
+	    PutSlot(oldSlots[moveFrom].key, oldSlots[moveFrom].item);
+	    numItems++;
+	    numOldItems--;
+	    ClearSlot(oldSlots, numOldSlots, moveFrom);
+	} else {
+	    moveFrom++;
+	}
+	if (numOldItems == 0) {
+	    delete [] oldSlots;
+	    oldSlots = NULL;
+	    numOldSlots = 0;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Insert
+//      Put an item into the hashtable.
+//
+//	Start growing the table if it would be more than 3/4 full (first
+//	finishing off the last resize, if need be).  Then put the item
+//	in the current array, and move a few old items along.
+//
+//	"item" is the thing to put in the table.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::Insert(T item)
+{
+    Key key = getKey(item);
+
+    ASSERT(!IsInTable(key));
+
+    if ((numItems + numOldItems + 1) * 4 > numSlots * 3) {
+	MoveSome(numOldSlots * 2);
+	StartResize();
+    }
+    PutSlot(key, item);
+    numItems++;
+    MoveSome(MovesPerCall);
+
+    ASSERT(IsInTable(key));
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Find
+//      Find an item from the hash table.
+//
+// Returns:
+//	Whether item is found, and if found, the item.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+bool
+OpenHashTable<Key,T>::Find(Key key, T *itemPtr) const
+{
+    int i = FindSlot(slots, numSlots, key);
+
+    if (i >= 0) {
+	*itemPtr = slots[i].item;
+	return TRUE;
+    }
+    i = FindSlot(oldSlots, numOldSlots, key);
+    if (i >= 0) {
+	*itemPtr = oldSlots[i].item;
+	return TRUE;
+    }
+    *itemPtr = NULL;
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Remove
+//      Remove an item from the hash table. The item must be in the table.
+//
+// Returns:
+//	The removed item.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+T
+OpenHashTable<Key,T>::Remove(Key key)
+{
+    int i = FindSlot(slots, numSlots, key);
+    T item;
+
+    if (i >= 0) {
+	item = slots[i].item;
+	ClearSlot(slots, numSlots, i);
+	numItems--;
+    } else {
+	i = FindSlot(oldSlots, numOldSlots, key);
+	ASSERT(i >= 0);		// item must be in table
+	item = oldSlots[i].item;
+	ClearSlot(oldSlots, numOldSlots, i);
+	numOldItems--;
+    }
+    MoveSome(MovesPerCall);
+
+    ASSERT(!IsInTable(key));
+    return item;
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::Apply
+//      Apply function to every item in the hash table.
+//
+//	"func" -- the function to apply
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashTable<Key,T>::Apply(void (*func)(T)) const
+{
+    for (int i = 0; i < numOldSlots; i++) {
+	if (oldSlots[i].full)
+	    (*func)(oldSlots[i].item);
+    }
+    for (int i = 0; i < numSlots; i++) {
+	if (slots[i].full)
+	    (*func)(slots[i].item);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::CheckArray
+//      Check one array of slots, counting the items in it: each must
+//	be found from its own key, and there must be none before "from".
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::CheckArray(Slot *array, int size, int from,
+				 int *found) const
+{
+    for (int i = 0; i < size; i++) {
+	if (array[i].full) {
+	    ASSERT(i >= from);
+	    ASSERT(array[i].key == getKey(array[i].item));
+	    ASSERT(FindSlot(array, size, array[i].key) == i);
+	    (*found)++;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SanityCheck
+//      Test whether this is still a legal hash table.
+//
+//	Tests: is every item stored under its own key?
+//	       can every item be found from its home slot?
+//	       does each array have the right # of elements?
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SanityCheck() const
+{
+    int numFound = 0;
+
+    ASSERT((numSlots & (numSlots - 1)) == 0);
+    ASSERT((numItems + numOldItems) * 4 <= numSlots * 3);
+    CheckArray(slots, numSlots, 0, &numFound);
+    ASSERT(numItems == numFound);
+
+    if (oldSlots != NULL) {
+	numFound = 0;
+	CheckArray(oldSlots, numOldSlots, moveFrom, &numFound);
+	ASSERT(numOldItems == numFound);
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashTable<Key,T>::SelfTest
+//      Test whether this module is working.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+void
+OpenHashTable<Key,T>::SelfTest(T *p, int numEntries)
+{
+    int i;
+    OpenHashIterator<Key, T> *iterator = new OpenHashIterator<Key,T>(this);
+
+    SanityCheck();
+    ASSERT(IsEmpty());	// check that table is empty in various ways
+    for (; !iterator->IsDone(); iterator->Next()) {
+	ASSERTNOTREACHED();
+    }
+    delete iterator;
+
+    for (i = 0; i < numEntries; i++) {
+        Insert(p[i]);
+        ASSERT(IsInTable(getKey(p[i])));
+        ASSERT(!IsEmpty());
+        SanityCheck();
+    }
+
+    // should step through exactly what we put in
+    iterator = new OpenHashIterator<Key,T>(this);
+    for (i = 0; !iterator->IsDone(); iterator->Next()) {
+	i++;
+    }
+    ASSERT(i == numEntries);
+    delete iterator;
+
+    // should be able to get out everything we put in
+    for (i = 0; i < numEntries; i++) {
+        ASSERT(Remove(getKey(p[i])) == p[i]);
+        SanityCheck();
+    }
+
+    ASSERT(IsEmpty());
+    SanityCheck();
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::OpenHashIterator
+//      Initialize a data structure to allow us to step through
+//	every entry in a hash table: those in the old array, if any,
+//	then those in the current one.
+//----------------------------------------------------------------------
+
+template <class Key, class T>
+OpenHashIterator<Key,T>::OpenHashIterator(OpenHashTable<Key,T> *tbl)
+{
+    table = tbl;
+    array = (table->oldSlots != NULL) ? table->oldSlots : table->slots;
+    slot = 0;
+    Advance();
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::Advance
+//      Move on to the first full slot at or after the current one,
+//	going from the old array to the current one when it runs out.
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashIterator<Key,T>::Advance()
+{
+    while (array != NULL) {
+	int size = (array == table->slots) ? table->numSlots
+					    : table->numOldSlots;
+
+	for (; slot < size; slot++) {
+	    if (array[slot].full)
+		return;
+	}
+	array = (array == table->slots) ? NULL : table->slots;
+	slot = 0;
+    }
+}
+
+//----------------------------------------------------------------------
+// OpenHashIterator<Key,T>::Next
+//      Update iterator to point to the next item in the table.
+//----------------------------------------------------------------------
+
+template <class Key,class T>
+void
+OpenHashIterator<Key,T>::Next()
+{
+    slot++;
+    Advance();
+}
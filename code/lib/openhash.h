@@ -0,0 +1,127 @@
+// openhash.h
+//	Data structures for a hash table relating keys to values, like
+//	HashTable (see hash.h), but laid out for fast lookup.
+//
+//	Items are kept in one array of slots, each holding the key and
+//	the item, rather than in a list per bucket; a key that collides
+//	goes in the next free slot after the one it hashes to (linear
+//	probing).  A lookup thus reads a few adjacent slots, and never
+//	follows a pointer or calls GetKey.
+//
+//	When the table gets too full, a new array twice the size is
+//	made, but the items are not all moved at once: each Insert and
+//	Remove moves a few more, and until they are all moved, lookups
+//	search both arrays.  No single call costs more than a few slots'
+//	work, however big the table has grown.
+//
+//	As for HashTable, the key must have a hash function defined,
+//	and the value a function to retrieve its key.  Keys must be
+//	unique, and "==" must work on them.
+//
+//	Allocation and deallocation of the items in the table are to
+//	be done by the caller.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef OPENHASH_H
+#define OPENHASH_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "debug.h"
+
+template <class Key,class T> class OpenHashIterator;
+
+// The following class defines an open-addressing hash table.
+
+template <class Key, class T>
+class OpenHashTable {
+  public:
+    OpenHashTable(Key (*get)(T x), unsigned (*hFunc)(Key x));
+    				// initialize a hash table
+    ~OpenHashTable();		// deallocate a hash table
+
+    void Insert(T item);	// Put item into hash table
+    T Remove(Key key);		// Remove item from hash table.
+
+    bool Find(Key key, T *itemPtr) const;
+    				// Find an item from its key
+    bool IsInTable(Key key) const { T dummy; return Find(key, &dummy); }
+				// Is the item in the table?
+
+    bool IsEmpty() const { return numItems + numOldItems == 0; }
+				// does the table have anything in it
+
+    void Apply(void (*f)(T)) const;
+    				// apply function to all elements in table
+
+    void SanityCheck() const;	// is this still a legal hash table?
+    void SelfTest(T *p, int numItems);
+    				// is the module working?
+
+  private:
+    class Slot {
+      public:
+	bool full;		// does the slot hold an item?
+	Key key;		// its key
+	T item;
+    };
+
+    Slot *slots;		// where items are put
+    int numSlots;		// size of "slots"; a power of 2
+    int numItems;		// the number of items in "slots"
+
+    Slot *oldSlots;		// the array being moved out of, or NULL
+    int numOldSlots;		// its size
+    int numOldItems;		// items not moved out of it yet
+    int moveFrom;		// slots before this one are all moved
+
+    Key (*getKey)(T x);		// get Key from value
+    unsigned (*hash)(Key x);	// the hash function
+
+    int Home(Key key, int size) const;
+    				// first slot to try for a key
+    int FindSlot(Slot *array, int size, Key key) const;
+    				// slot holding a key, or -1
+    void PutSlot(Key key, T item);
+    				// put into "slots"; key not there yet
+    void ClearSlot(Slot *array, int size, int i);
+    				// empty a slot, moving back those after
+    void StartResize();		// make a bigger array to move into
+    void MoveSome(int count);	// move up to "count" old slots' worth
+    void CheckArray(Slot *array, int size, int from, int *found) const;
+
+    friend class OpenHashIterator<Key,T>;
+};
+
+// The following class can be used to step through an open hash
+// table -- same interface as HashIterator.  The table must not be
+// changed while stepping through it.
+
+template <class Key,class T>
+class OpenHashIterator {
+  public:
+    OpenHashIterator(OpenHashTable<Key,T> *table);
+				// initialize an iterator
+
+    bool IsDone() { return array == NULL; };
+				// return TRUE if no more items in table
+    T Item() { ASSERT(!IsDone()); return array[slot].item; };
+				// return current item in table
+    void Next(); 		// update iterator to point to next
+
+  private:
+    OpenHashTable<Key,T> *table; // the hash table we're stepping through
+    typename OpenHashTable<Key,T>::Slot *array;
+				// the old array or the new; NULL when done
+    int slot;			// current slot in it
+
+    void Advance();		// to the next full slot, from "slot"
+};
+
+#include "openhash.cc"		// templates are really like macros
+				// so needs to be included in every
+				// file that uses the template
+#endif // OPENHASH_H
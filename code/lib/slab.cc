@@ -0,0 +1,121 @@
+// slab.cc
+//	Routines to manage a slab cache of objects of one size.  See
+//	slab.h.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "slab.h"
+#include "debug.h"
+
+SlabCache *SlabCache::caches = NULL;
+
+//----------------------------------------------------------------------
+// SlabCache::SlabCache
+// 	Make an empty cache of objects, and add it to the list of caches.
+//	No slab is carved until an object is first wanted.
+//
+//	"name" -- the kind of object, for Print
+//	"size" -- bytes in each, rounded up to keep them aligned
+//	"perSlab" -- how many to carve at once
+//	"construct" -- run on each object as it is carved, or NULL
+//----------------------------------------------------------------------
+
+SlabCache::SlabCache(const char *name, int size, int perSlab,
+		     void (*construct)(void *object))
+{
+    ASSERT(size > 0 && perSlab > 0);
+    this->name = name;
+    this->size = divRoundUp(size, sizeof(double)) * sizeof(double);
+    this->perSlab = perSlab;
+    this->construct = construct;
+    freeObjects = NULL;
+    numFree = maxFree = 0;
+    numAllocs = numSlabs = numInUse = maxInUse = 0;
+    next = caches;
+    caches = this;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Alloc
+// 	Take an object off the free list.  If it is empty, carve a new
+//	slab into objects, constructing each, and put them on it; the
+//	free list grows to hold every object carved, so Free never has to
+//	grow it.
+//----------------------------------------------------------------------
+
+void *
+SlabCache::Alloc()
+{
+    if (numFree == 0) {
+	char *slab = (char *) ::operator new(perSlab * size);
+
+	if (maxFree < (numSlabs + 1) * perSlab) {
+	    void **bigger = new void *[(numSlabs + 1) * perSlab];
+
+	    delete [] freeObjects;
+	    freeObjects = bigger;
+	    maxFree = (numSlabs + 1) * perSlab;
+	}
+	for (int i = perSlab - 1; i >= 0; i--) {
+	    if (construct != NULL)
+		(*construct)(slab + i * size);
+	    freeObjects[numFree++] = slab + i * size;
+	}
+	numSlabs++;
+    }
+    numAllocs++;
+    if (++numInUse > maxInUse)
+	maxInUse = numInUse;
+    return freeObjects[--numFree];
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Free
+// 	Put an object back on the free list.  If the cache constructs its
+//	objects, it must be in the state "construct" left it in.
+//
+//	"object" -- what Alloc gave out; NULL is ignored, like delete
+//----------------------------------------------------------------------
+
+void
+SlabCache::Free(void *object)
+{
+    if (object == NULL)
+	return;
+    ASSERT(numFree < maxFree);
+    freeObjects[numFree++] = object;
+    numInUse--;
+}
+
+//----------------------------------------------------------------------
+// SlabCache::Print, SlabCache::PrintAll
+// 	Print how much a cache was used: objects handed out, slabs
+//	carved from the heap for them, and objects in use, now and at
+//	most.  PrintAll does so for every cache that was used.
+//----------------------------------------------------------------------
+
+void
+SlabCache::Print()
+{
+    cout << name << " " << numAllocs << " (slabs " << numSlabs;
+    cout << ", in use " << numInUse << ", most " << maxInUse << ")";
+}
+
+void
+SlabCache::PrintAll()
+{
+    bool first = TRUE;
+
+    for (SlabCache *cache = caches; cache != NULL; cache = cache->next) {
+	if (cache->numAllocs == 0)
+	    continue;
+	cout << (first ? "Slab caches: " : ", ");
+	cache->Print();
+	first = FALSE;
+    }
+    if (!first)
+	cout << "\n";
+}
@@ -0,0 +1,72 @@
+// slab.h
+//	Data structures for a slab cache: a pool of objects of one size,
+//	for a kind of object the kernel allocates and frees all the time.
+//
+//	Objects are carved SlabObjects at a time out of one block from
+//	the heap (a "slab"), and a freed object goes back on the cache's
+//	free list rather than to the heap, so that once enough have been
+//	in use at once, allocating one costs a few instructions and the
+//	heap is not broken up by them.  Slabs are never given back.
+//
+//	A cache may be given a routine to construct its objects.  Each
+//	object is then constructed once, when its slab is carved; it is
+//	handed out constructed, and must be given back the same way, so
+//	work that would be undone and done again each time (clearing or
+//	formatting a buffer) is saved.  The free list is kept apart from
+//	the objects, so it does not disturb them.
+//
+//	A class gets its objects from a cache by defining operator new
+//	and operator delete to call Alloc and Free.  Each cache counts
+//	its use; PrintAll prints the counts of them all.
+//
+//	No lock is needed: nothing here can cause a context switch.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "copyright.h"
+#include "utility.h"
+
+const int SlabObjects = 16;	// objects carved out of one slab
+
+// The following class defines a cache of objects of one size.
+
+class SlabCache {
+  public:
+    SlabCache(const char *name, int size, int perSlab = SlabObjects,
+	      void (*construct)(void *object) = NULL);
+				// a cache of "size"-byte objects, called
+				// "name"; "construct", if given, is run
+				// on each once, when it is carved
+
+    void *Alloc();		// take an object off the free list,
+				// carving a new slab if it is empty
+    void Free(void *object);	// put an object back on it
+
+    int Size() { return size; }
+
+    void Print();		// print what this cache was used for
+    static void PrintAll();	// and every cache that was used
+
+  private:
+    const char *name;		// the kind of object, for Print
+    int size;			// bytes in each object
+    int perSlab;		// objects carved at once
+    void (*construct)(void *object);	// or NULL
+    void **freeObjects;		// objects not in use
+    int numFree;		// how many there are
+    int maxFree;		// room in "freeObjects"
+    int numAllocs;		// objects handed out
+    int numSlabs;		// slabs carved from the heap
+    int numInUse;		// objects handed out and not given back
+    int maxInUse;		// the most there were at once
+    SlabCache *next;		// the next cache made
+
+    static SlabCache *caches;	// every cache made
+};
+
+#endif // SLAB_H
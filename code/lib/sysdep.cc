@@ -40,6 +40,11 @@
 #include <fcntl.h>
 #endif
 
+#ifdef LINUX
+// for fallocate()
+#include <fcntl.h>
+#endif
+
 #ifdef LINUX	 // at this point, linux doesn't support mprotect 
 #define NO_MPROT     
 #endif
@@ -51,9 +56,11 @@ extern "C" {
 #include <signal.h>
 #include <sys/types.h>
 
-#ifndef NO_MPROT 
 #include <sys/mman.h>
-#endif
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <poll.h>
 
 // UNIX routines called by procedures in this file 
 
@@ -119,6 +126,18 @@ CallOnUserAbort(void (*func)(int))
     (void)signal(SIGINT, func);
 }
 
+//----------------------------------------------------------------------
+// CallOnDumpRequest
+// 	Arrange that "func" will be called when the user sends the
+//	process SIGUSR1, asking for the state of the run.
+//----------------------------------------------------------------------
+
+void 
+CallOnDumpRequest(void (*func)(int))
+{
+    (void)signal(SIGUSR1, func);
+}
+
 //----------------------------------------------------------------------
 // Delay
 // 	Put the UNIX process running Nachos to sleep for x seconds,
@@ -149,6 +168,101 @@ UDelay(unsigned int useconds)
 
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the time of day on the host, in microseconds, to measure
+//	how long the host takes to do something for Nachos.
+//----------------------------------------------------------------------
+
+double
+HostTime()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+//----------------------------------------------------------------------
+// NumHostCpus
+// 	Return how many CPUs the host has online.
+//----------------------------------------------------------------------
+
+int
+NumHostCpus()
+{
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (cpus > 0) ? cpus : 1;
+}
+
+//----------------------------------------------------------------------
+// ForkProcess
+// 	Make a copy of this host process.  Return 0 in the copy, and
+//	its process ID in the original.  Buffered output is flushed
+//	first, so that it is not written twice.
+//----------------------------------------------------------------------
+
+int
+ForkProcess()
+{
+    int pid;
+
+    cout.flush();
+    cerr.flush();
+    fflush(NULL);
+    pid = fork();
+    ASSERT(pid >= 0);
+    return pid;
+}
+
+//----------------------------------------------------------------------
+// WaitForProcess
+// 	Wait for a process made by ForkProcess to finish, and return
+//	its ID.  "exitCode" is set to what it passed to Exit, or to -1
+//	if it was killed (by a failed ASSERT, say).
+//----------------------------------------------------------------------
+
+int
+WaitForProcess(int *exitCode)
+{
+    int status;
+    int pid = wait(&status);
+
+    ASSERT(pid > 0);
+    *exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return pid;
+}
+
+//----------------------------------------------------------------------
+// MakePipe
+// 	Make a pipe: what is written to fds[1] can be read from fds[0].
+//----------------------------------------------------------------------
+
+void
+MakePipe(int *fds)
+{
+    int retVal = pipe(fds);
+
+    ASSERT(retVal == 0);
+}
+
+//----------------------------------------------------------------------
+// RedirectOutput
+// 	Send this process's standard output and standard error to an
+//	open file.
+//----------------------------------------------------------------------
+
+void
+RedirectOutput(int fd)
+{
+    cout.flush();
+    cerr.flush();
+    fflush(NULL);
+    dup2(fd, 1);
+    dup2(fd, 2);
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
@@ -296,6 +410,34 @@ PollFile(int fd)
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// WaitForFiles
+// 	Put the UNIX process running Nachos to sleep until at least one
+//	of a set of open files or sockets has characters that can be
+//	read (or has reached end of file).  Nothing is read.
+//
+//	"fds" -- the file descriptors to wait on
+//	"numFds" -- how many there are
+//----------------------------------------------------------------------
+
+void
+WaitForFiles(int *fds, int numFds)
+{
+    struct pollfd *polls = new struct pollfd[numFds];
+    int retVal;
+
+    for (int i = 0; i < numFds; i++) {
+	polls[i].fd = fds[i];
+	polls[i].events = POLLIN;
+	polls[i].revents = 0;
+    }
+    do {
+	retVal = poll(polls, numFds, -1);	// no time limit
+    } while ((retVal < 0) && (errno == EINTR));
+    ASSERT(retVal > 0);
+    delete [] polls;
+}
+
 //----------------------------------------------------------------------
 // OpenForWrite
 // 	Open a file for writing.  Create it if it doesn't exist; truncate it 
@@ -330,6 +472,23 @@ OpenForReadWrite(char *name, bool crashOnError)
     return fd;
 }
 
+//----------------------------------------------------------------------
+// OpenForRead
+// 	Open a file for reading only.
+//	Return the file descriptor, or error if it doesn't exist.
+//
+//	"name" -- file name
+//----------------------------------------------------------------------
+
+int
+OpenForRead(char *name, bool crashOnError)
+{
+    int fd = open(name, O_RDONLY, 0);
+
+    ASSERT(!crashOnError || fd >= 0);
+    return fd;
+}
+
 //----------------------------------------------------------------------
 // Read
 // 	Read characters from an open file.  Abort if read fails.
@@ -420,6 +579,128 @@ Unlink(char *name)
     return unlink(name);
 }
 
+//----------------------------------------------------------------------
+// RenameFile
+// 	Give a file another name, replacing any file already called that.
+//	Return TRUE if it worked.
+//----------------------------------------------------------------------
+
+bool
+RenameFile(char *from, char *to)
+{
+    return rename(from, to) == 0;
+}
+
+//----------------------------------------------------------------------
+// HostFileSize
+// 	Return the size in bytes of the host file "name", or -1 if there
+//	is no such file; set "*isDirectory" to whether it is a directory.
+//----------------------------------------------------------------------
+
+int
+HostFileSize(char *name, bool *isDirectory)
+{
+    struct stat info;
+
+    if (stat(name, &info) < 0)
+        return -1;
+    *isDirectory = S_ISDIR(info.st_mode);
+    return (int)info.st_size;
+}
+
+//----------------------------------------------------------------------
+// OpenHostDirectory, NextHostEntry, CloseHostDirectory
+// 	Read the names in a host directory, one at a time, "." and ".."
+//	left out.  OpenHostDirectory returns NULL if there is no such
+//	directory; NextHostEntry returns NULL after the last name, and
+//	each name only lasts until the next call.
+//----------------------------------------------------------------------
+
+void *
+OpenHostDirectory(char *name)
+{
+    return opendir(name);
+}
+
+char *
+NextHostEntry(void *dir)
+{
+    struct dirent *entry;
+
+    while ((entry = readdir((DIR *)dir)) != NULL)
+        if ((strcmp(entry->d_name, ".") != 0) &&
+            (strcmp(entry->d_name, "..") != 0))
+            return entry->d_name;
+    return NULL;
+}
+
+void
+CloseHostDirectory(void *dir)
+{
+    closedir((DIR *)dir);
+}
+
+//----------------------------------------------------------------------
+// MapFile
+// 	Map the first "size" bytes of an open file into memory, shared,
+//	so that stores to the returned memory change the file.  Abort if
+//	the mapping fails.
+//----------------------------------------------------------------------
+
+char *
+MapFile(int fd, int size)
+{
+    void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    ASSERT(addr != MAP_FAILED);
+    return (char *)addr;
+}
+
+//----------------------------------------------------------------------
+// UnmapFile
+// 	Write a mapping made by MapFile back to its file, and unmap it.
+//----------------------------------------------------------------------
+
+void
+UnmapFile(char *addr, int size)
+{
+    int retVal = msync(addr, size, MS_SYNC);
+
+    ASSERT(retVal == 0);
+    munmap(addr, size);
+}
+
+//----------------------------------------------------------------------
+// PunchHole
+// 	Free the host storage behind part of an open file, which then
+//	reads as zeroes; the file keeps its size.  Return FALSE if the
+//	host cannot do this, in which case the file is left unchanged.
+//----------------------------------------------------------------------
+
+bool
+PunchHole(int fd, int offset, int length)
+{
+#ifdef FALLOC_FL_PUNCH_HOLE
+    return fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                     offset, length) == 0;
+#else
+    return FALSE;
+#endif
+}
+
+//----------------------------------------------------------------------
+// Truncate
+// 	Cut an open file down to "length" bytes.
+//----------------------------------------------------------------------
+
+void
+Truncate(int fd, int length)
+{
+    int retVal = ftruncate(fd, length);
+
+    ASSERT(retVal == 0);
+}
+
 //----------------------------------------------------------------------
 // OpenSocket
 // 	Open an interprocess communication (IPC) connection.  For now, 
@@ -569,3 +850,104 @@ SendToSocket(int sockID, char *buffer, int packetSize, char *toName)
     // This may mask other kinds of failures, but it is the
     // right thing to do in the common case.
 }
+
+//----------------------------------------------------------------------
+// ReadFromSocketBatch
+// 	Read every fixed size packet waiting on the IPC port, up to
+//	"maxPackets" of them, into consecutive parts of "buffer", without
+//	waiting for any.  On Linux this is a single system call.
+//
+// Returns:
+//	The number of packets read.
+//----------------------------------------------------------------------
+
+int
+ReadFromSocketBatch(int sockID, char *buffer, int packetSize, int maxPackets)
+{
+#ifdef LINUX
+    struct mmsghdr *msgs = new struct mmsghdr[maxPackets];
+    struct iovec *iovs = new struct iovec[maxPackets];
+    int retVal;
+
+    for (int i = 0; i < maxPackets; i++) {
+	iovs[i].iov_base = buffer + i * packetSize;
+	iovs[i].iov_len = packetSize;
+	bzero(&msgs[i], sizeof(struct mmsghdr));
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    do {
+	retVal = recvmmsg(sockID, msgs, maxPackets, MSG_DONTWAIT, NULL);
+    } while ((retVal < 0) && (errno == EINTR));
+    if (retVal < 0) {
+	ASSERT((errno == EAGAIN) || (errno == EWOULDBLOCK));
+	retVal = 0;				// nothing was waiting
+    }
+    for (int i = 0; i < retVal; i++)
+	ASSERT(msgs[i].msg_len == (unsigned)packetSize);
+    delete [] msgs;
+    delete [] iovs;
+    return retVal;
+#else
+    int numRead = 0;
+
+    while ((numRead < maxPackets) && PollSocket(sockID)) {
+	ReadFromSocket(sockID, buffer + numRead * packetSize, packetSize);
+	numRead++;
+    }
+    return numRead;
+#endif
+}
+
+//----------------------------------------------------------------------
+// SendToSocketBatch
+// 	Transmit several fixed size packets, each to its own Nachos'
+//	IPC port.  On Linux they are handed over in one system call;
+//	a packet that cannot be sent at once is retried on its own, as
+//	in SendToSocket.
+//
+//	"buffer" -- the packets, one after another
+//	"toNames" -- where each is to go
+//----------------------------------------------------------------------
+
+void
+SendToSocketBatch(int sockID, char *buffer, int packetSize, char **toNames,
+		  int numPackets)
+{
+#ifdef LINUX
+    struct mmsghdr *msgs = new struct mmsghdr[numPackets];
+    struct iovec *iovs = new struct iovec[numPackets];
+    struct sockaddr_un *uNames = new struct sockaddr_un[numPackets];
+    int numSent = 0;
+    int retVal;
+
+    for (int i = 0; i < numPackets; i++) {
+	InitSocketName(&uNames[i], toNames[i]);
+	iovs[i].iov_base = buffer + i * packetSize;
+	iovs[i].iov_len = packetSize;
+	bzero(&msgs[i], sizeof(struct mmsghdr));
+	msgs[i].msg_hdr.msg_name = &uNames[i];
+	msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_un);
+	msgs[i].msg_hdr.msg_iov = &iovs[i];
+	msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    while (numSent < numPackets) {
+	retVal = sendmmsg(sockID, &msgs[numSent], numPackets - numSent, 0);
+	if (retVal > 0) {
+	    numSent += retVal;
+	} else {
+	    // the next packet failed: its target may not be set up yet,
+	    // or may have halted
+	    SendToSocket(sockID, buffer + numSent * packetSize, packetSize,
+			 toNames[numSent]);
+	    numSent++;
+	}
+    }
+    delete [] msgs;
+    delete [] iovs;
+    delete [] uNames;
+#else
+    for (int i = 0; i < numPackets; i++)
+	SendToSocket(sockID, buffer + i * packetSize, packetSize, toNames[i]);
+#endif
+}
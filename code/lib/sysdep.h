@@ -25,9 +25,22 @@ extern void Exit(int exitCode);
 extern void Delay(int seconds);
 extern void UDelay(unsigned int usec);// rcgood - to avoid spinners.
 
+// The host's clock, in microseconds, for timing Nachos itself
+extern double HostTime();
+
+// Host processes, for running many copies of Nachos at once
+extern int NumHostCpus();
+extern int ForkProcess();
+extern int WaitForProcess(int *exitCode);
+extern void MakePipe(int *fds);
+extern void RedirectOutput(int fd);
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(void (*cleanup)(int));
 
+// And so that "func" is called when the user asks for a dump (SIGUSR1)
+extern void CallOnDumpRequest(void (*func)(int));
+
 // Initialize the pseudo random number generator
 extern void RandomInit(unsigned seed);
 extern unsigned int RandomNumber();
@@ -41,10 +54,15 @@ extern void DeallocBoundedArray(char *p, int size);
 // If no characters in the file, return without waiting.
 extern bool PollFile(int fd);
 
+// Wait, without using the CPU, until one of the files has characters
+// to be read.
+extern void WaitForFiles(int *fds, int numFds);
+
 // File operations: open/read/write/lseek/close, and check for error
 // For simulating the disk and the console devices.
 extern int OpenForWrite(char *name);
 extern int OpenForReadWrite(char *name, bool crashOnError);
+extern int OpenForRead(char *name, bool crashOnError);
 extern void Read(int fd, char *buffer, int nBytes);
 extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
@@ -52,6 +70,24 @@ extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
 extern int Close(int fd);
 extern bool Unlink(char *name);
+extern bool RenameFile(char *from, char *to);
+
+// Look at host files and directories: the size of a file (-1 if there
+// is none), and the names in a directory, "." and ".." left out.
+extern int HostFileSize(char *name, bool *isDirectory);
+extern void *OpenHostDirectory(char *name);
+extern char *NextHostEntry(void *dir);
+extern void CloseHostDirectory(void *dir);
+
+// Map an open file into memory, and write it back and unmap it.
+extern char *MapFile(int fd, int size);
+extern void UnmapFile(char *addr, int size);
+
+// Turn part of a file into a hole, if the host can.
+extern bool PunchHole(int fd, int offset, int length);
+
+// Cut an open file down to a length.
+extern void Truncate(int fd, int length);
 
 // Other C library routines that are used by Nachos.
 // These are assumed to be portable, so we don't include a wrapper.
@@ -71,5 +107,9 @@ extern void DeAssignNameToSocket(char *socketName);
 extern bool PollSocket(int sockID);
 extern void ReadFromSocket(int sockID, char *buffer, int packetSize);
 extern void SendToSocket(int sockID, char *buffer, int packetSize,char *toName);
+extern int ReadFromSocketBatch(int sockID, char *buffer, int packetSize,
+			       int maxPackets);
+extern void SendToSocketBatch(int sockID, char *buffer, int packetSize,
+			      char **toNames, int numPackets);
 
 #endif // SYSDEP_H
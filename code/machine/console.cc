@@ -38,7 +38,7 @@ ConsoleInput::ConsoleInput(char *readFile, CallBackObj *toCall)
     disabled = false; // 2015.11.25
 
     // start polling for incoming keystrokes
-    kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
+    kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt, readFileNo);
 }
 
 //----------------------------------------------------------------------
@@ -77,7 +77,7 @@ void ConsoleInput::CallBack()
     if (!PollFile(readFileNo))
     { // nothing to be read
         // schedule the next time to poll for a packet
-        kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
+        kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt, readFileNo);
     }
     else
     {
@@ -115,7 +115,7 @@ char ConsoleInput::GetChar()
 
     if (incoming != EOF)
     { // schedule when next char will arrive
-        kernel->interrupt->Schedule(this, ConsoleTime, ConsoleReadInt);
+        kernel->interrupt->SchedulePoll(this, ConsoleTime, ConsoleReadInt, readFileNo);
     }
     incoming = EOF;
     return ch;
@@ -139,6 +139,7 @@ ConsoleOutput::ConsoleOutput(char *writeFile, CallBackObj *toCall)
 
     callWhenDone = toCall;
     putBusy = FALSE;
+    putCount = 0;
 }
 
 //----------------------------------------------------------------------
@@ -161,7 +162,7 @@ ConsoleOutput::~ConsoleOutput()
 void ConsoleOutput::CallBack()
 {
     putBusy = FALSE;
-    kernel->stats->numConsoleCharsWritten++;
+    kernel->stats->numConsoleCharsWritten += putCount;
     callWhenDone->CallBack();
 }
 
@@ -173,8 +174,34 @@ void ConsoleOutput::CallBack()
 
 void ConsoleOutput::PutChar(char ch)
 {
-    ASSERT(putBusy == FALSE);
-    WriteFile(writeFileNo, &ch, sizeof(char));
+    PutChars(&ch, 1);
+}
+
+//----------------------------------------------------------------------
+// ConsoleOutput::PutChars()
+// 	Write several characters to the simulated display, with one write
+//	to the host, and schedule an interrupt for when the line would
+//	have carried the last of them.
+//----------------------------------------------------------------------
+
+void ConsoleOutput::PutChars(char *buf, int n)
+{
+    ASSERT((putBusy == FALSE) && (n > 0));
+    WriteFile(writeFileNo, buf, n * sizeof(char));
     putBusy = TRUE;
-    kernel->interrupt->Schedule(this, ConsoleTime, ConsoleWriteInt);
+    putCount = n;
+    kernel->interrupt->Schedule(this, n * ConsoleTime, ConsoleWriteInt);
+}
+
+//----------------------------------------------------------------------
+// ConsoleOutput::PutNow()
+// 	Write characters to the display with no simulated delay and no
+//	interrupt.  Only for what is left to print when Nachos halts.
+//----------------------------------------------------------------------
+
+void ConsoleOutput::PutNow(char *buf, int n)
+{
+    if (n > 0)
+        WriteFile(writeFileNo, buf, n * sizeof(char));
+    kernel->stats->numConsoleCharsWritten += n;
 }
@@ -80,6 +80,12 @@ class ConsoleOutput : public CallBackObj {
     void PutChar(char ch);	// Write "ch" to the console display, 
 				// and return immediately.  "callWhenDone" 
 				// will called when the I/O completes. 
+    void PutChars(char *buf, int n);
+				// Write "n" characters at once; the I/O
+				// completes when the last has gone out
+    void PutNow(char *buf, int n);
+				// Write characters straight out, taking
+				// no time, when Nachos is shutting down
     void CallBack();		// Invoked when next character can be put
 				// out to the display.
 
@@ -89,6 +95,7 @@ class ConsoleOutput : public CallBackObj {
 					// the next char can be put 
     bool putBusy;    			// Is a PutChar operation in progress?
 					// If so, you can't do another one!
+    int putCount;			// Characters it is putting out
 };
 
 #endif // CONSOLE_H
@@ -0,0 +1,484 @@
+// dedup.cc
+//	Routines to keep a simulated disk's UNIX file as a deduplicated
+//	store of sectors.  See dedup.h.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "dedup.h"
+#include "disk.h"
+#include "sysdep.h"
+#include "main.h"
+
+// The store has a magic number of its own, so that it cannot be
+// mistaken for a plain disk file, or an overlay.
+
+const int DedupMagic = 0x44445550;
+const int DedupMagicSize = sizeof(int);
+
+//----------------------------------------------------------------------
+// SectorKey, BlockKey, PrintKey, HashInt, HashPrint
+// 	Helper functions for the hash tables of sectors and blocks.
+//----------------------------------------------------------------------
+
+static int
+SectorKey(DedupSector *entry)
+{
+    return entry->sector;
+}
+
+static int
+BlockKey(DedupBlock *block)
+{
+    return block->offset;
+}
+
+static unsigned int
+PrintKey(DedupBlock *block)
+{
+    return block->print;
+}
+
+static unsigned
+HashInt(int key)
+{
+    return (unsigned)key;
+}
+
+static unsigned
+HashPrint(unsigned int print)
+{
+    return print;
+}
+
+
+//----------------------------------------------------------------------
+// Fingerprint
+// 	Return a hash of the bytes of a sector (32-bit FNV-1a).  Blocks
+//	with the same one are compared byte by byte before being shared.
+//----------------------------------------------------------------------
+
+static unsigned int
+Fingerprint(char *data)
+{
+    unsigned int print = 2166136261U;
+
+    for (int i = 0; i < SectorSize; i++)
+        print = (print ^ (unsigned char)data[i]) * 16777619U;
+    return print;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::DedupStore
+// 	Open the store kept in the UNIX file "fileName", reading its log
+//	through; or make it, empty, if there is no such file.
+//----------------------------------------------------------------------
+
+DedupStore::DedupStore(char *fileName)
+{
+    int magicNum;
+
+    sectors = new OpenHashTable<int, DedupSector *>(SectorKey, HashInt);
+    blocks = new OpenHashTable<int, DedupBlock *>(BlockKey, HashInt);
+    prints = new OpenHashTable<unsigned int, DedupBlock *>(PrintKey, HashPrint);
+    freeBlocks = new List<int>;
+    end = DedupMagicSize;
+    nextSeq = 1;
+
+    file = OpenForReadWrite(fileName, FALSE);
+    if (file < 0)
+    { // a new store, with nothing in it
+        file = OpenForWrite(fileName);
+        magicNum = DedupMagic;
+        WriteFile(file, (char *)&magicNum, DedupMagicSize);
+        return;
+    }
+    ::Read(file, (char *)&magicNum, DedupMagicSize);
+    ASSERT(magicNum == DedupMagic);
+    Replay();
+    Compact();
+    DEBUG(dbgDisk, "Store " << fileName << ": " << end << " bytes");
+}
+
+//----------------------------------------------------------------------
+// DedupStore::~DedupStore
+// 	Close the store.  Everything is in the file already.
+//----------------------------------------------------------------------
+
+DedupStore::~DedupStore()
+{
+    List<DedupSector *> entries;
+    List<DedupBlock *> stored;
+
+    Close(file);
+    for (OpenHashIterator<int, DedupSector *> iter(sectors); !iter.IsDone(); iter.Next())
+        entries.Append(iter.Item());
+    for (OpenHashIterator<int, DedupBlock *> iter(blocks); !iter.IsDone(); iter.Next())
+        stored.Append(iter.Item());
+    while (!entries.IsEmpty())
+    {
+        DedupSector *entry = entries.RemoveFront();
+
+        sectors->Remove(entry->sector);
+        delete entry;
+    }
+    while (!stored.IsEmpty())
+    {
+        DedupBlock *block = stored.RemoveFront();
+        DedupBlock *indexed;
+
+        if (prints->Find(block->print, &indexed) && (indexed == block))
+            prints->Remove(block->print);
+        blocks->Remove(block->offset);
+        delete block;
+    }
+    delete sectors;
+    delete blocks;
+    delete prints;
+    delete freeBlocks;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Replay
+// 	Read the log, keeping the latest record of each sector; then
+//	count the sectors sharing each block.  Sectors whose latest
+//	record says they hold nothing are forgotten, and blocks no sector
+//	shares are free to be used again.  A record left half written at
+//	the end of the log, by a run that crashed, is ignored, and
+//	written over.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Replay()
+{
+    DedupRecord record;
+    char data[SectorSize];
+    DedupSector *entry;
+    DedupBlock *block;
+    List<DedupSector *> *latest = new List<DedupSector *>;
+    List<DedupBlock *> *stored = new List<DedupBlock *>;
+
+    while (ReadPartial(file, (char *)&record, sizeof(record)) == sizeof(record))
+    {
+        int next = end + sizeof(record);
+
+        ASSERT((record.sector >= 0) && (record.sector < NumSectors));
+        if (record.block == 0)
+        {
+            if (ReadPartial(file, data, SectorSize) != SectorSize)
+                break;
+            block = new DedupBlock;
+            block->offset = next;
+            block->print = Fingerprint(data);
+            block->refs = 0;
+            blocks->Insert(block);
+            stored->Append(block);
+            next += SectorSize;
+        }
+        if (!sectors->Find(record.sector, &entry))
+        {
+            entry = new DedupSector;
+            entry->sector = record.sector;
+            entry->seq = 0;
+            sectors->Insert(entry);
+            latest->Append(entry);
+        }
+        if (record.seq > entry->seq)
+        {
+            entry->seq = record.seq;
+            entry->block = (record.block == 0) ? end + (int)sizeof(record) : record.block;
+        }
+        nextSeq = max(nextSeq, record.seq + 1);
+        end = next;
+    }
+
+    while (!latest->IsEmpty())
+    {
+        entry = latest->RemoveFront();
+        if (entry->block == -1)
+        {
+            sectors->Remove(entry->sector);
+            delete entry;
+            continue;
+        }
+        bool found = blocks->Find(entry->block, &entry->where);
+        ASSERT(found);
+        entry->where->refs++;
+    }
+    while (!stored->IsEmpty())
+    {
+        block = stored->RemoveFront();
+        if (block->refs == 0)
+        {
+            blocks->Remove(block->offset);
+            freeBlocks->Append(block->offset);
+            delete block;
+        }
+        else if (!prints->IsInTable(block->print))
+            prints->Insert(block);
+    }
+    delete latest;
+    delete stored;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Compact
+// 	If the log is over twice as long as it needs to be, write it
+//	again from the start: for each sector holding anything, a record
+//	with the bytes of its block if they are not in the new log yet,
+//	or a record naming the block if they are.  The blocks are read
+//	into memory first, since the new log overwrites the old.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Compact()
+{
+    List<DedupSector *> entries;
+    List<DedupBlock *> stored;
+    DedupBlock *block;
+    char *bytes;
+    int needed, i;
+
+    for (OpenHashIterator<int, DedupSector *> iter(sectors); !iter.IsDone(); iter.Next())
+        entries.Append(iter.Item());
+    for (OpenHashIterator<int, DedupBlock *> iter(blocks); !iter.IsDone(); iter.Next())
+        stored.Append(iter.Item());
+    needed = DedupMagicSize + entries.NumInList() * sizeof(DedupRecord) +
+             stored.NumInList() * SectorSize;
+    if (end <= 2 * needed)
+        return;
+
+    DEBUG(dbgDisk, "Compacting store of " << end << " bytes to " << needed);
+    bytes = new char[max((int)stored.NumInList(), 1) * SectorSize];
+    for (i = 0; !stored.IsEmpty(); i++)
+    { // read each block, and mark it as not written yet
+        block = stored.RemoveFront();
+        Lseek(file, block->offset, 0);
+        ::Read(file, &bytes[i * SectorSize], SectorSize);
+        blocks->Remove(block->offset);
+        block->offset = -(i + 1);
+    }
+    while (!freeBlocks->IsEmpty())
+        freeBlocks->RemoveFront();
+    end = DedupMagicSize;
+    nextSeq = 1;
+    while (!entries.IsEmpty())
+    {
+        DedupSector *entry = entries.RemoveFront();
+
+        block = entry->where;
+        if (block->offset < 0)
+        {
+            i = -block->offset - 1;
+            block->offset = end + sizeof(DedupRecord);
+            end = block->offset + SectorSize;
+            WriteBlock(entry->sector, block->offset, &bytes[i * SectorSize]);
+            blocks->Insert(block);
+        }
+        else
+            Append(entry->sector, block->offset);
+    }
+    Truncate(file, end);
+    delete [] bytes;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Read
+// 	Read the bytes of "sector" into "data": from its block, or zeroes
+//	if it holds nothing.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Read(int sector, char *data)
+{
+    DedupSector *entry;
+
+    if (!sectors->Find(sector, &entry))
+    {
+        bzero(data, SectorSize);
+        return;
+    }
+    Lseek(file, entry->where->offset, 0);
+    ::Read(file, data, SectorSize);
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Write
+// 	Make "data" the bytes of "sector".  If a block holds them already,
+//	the sector shares it, and only a short record is logged.  If not,
+//	and the sector's block is its own, the block is written over;
+//	otherwise a new block is stored for it.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Write(int sector, char *data)
+{
+    unsigned int print = Fingerprint(data);
+    DedupSector *entry;
+    DedupBlock *block;
+    bool mapped = sectors->Find(sector, &entry);
+
+    if (prints->Find(print, &block) && Matches(block, data))
+    {
+        if (mapped && (entry->where == block))
+            return; // no change
+        if (mapped)
+            Release(entry);
+        else
+        {
+            entry = new DedupSector;
+            entry->sector = sector;
+            sectors->Insert(entry);
+        }
+        block->refs++;
+        entry->where = block;
+        Append(sector, block->offset);
+        kernel->stats->numDedupHits++;
+        return;
+    }
+    if (mapped && (entry->where->refs == 1))
+    { // its own: write over it
+        DedupBlock *indexed;
+
+        block = entry->where;
+        if (prints->Find(block->print, &indexed) && (indexed == block))
+            prints->Remove(block->print);
+        block->print = print;
+        if (!prints->IsInTable(print))
+            prints->Insert(block);
+        WriteBlock(sector, block->offset, data);
+        return;
+    }
+    if (mapped)
+        Release(entry);
+    else
+    {
+        entry = new DedupSector;
+        entry->sector = sector;
+        sectors->Insert(entry);
+    }
+    entry->where = Store(sector, data);
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Discard
+// 	Forget the bytes of "sector", logging that it holds nothing.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Discard(int sector)
+{
+    DedupSector *entry;
+
+    if (!sectors->Find(sector, &entry))
+        return;
+    Release(entry);
+    sectors->Remove(sector);
+    delete entry;
+    Append(sector, -1);
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Append
+// 	Log that the bytes of "sector" are in the block at "block", or
+//	nowhere (-1).
+//----------------------------------------------------------------------
+
+void
+DedupStore::Append(int sector, int block)
+{
+    DedupRecord record;
+
+    record.sector = sector;
+    record.seq = nextSeq++;
+    record.block = block;
+    Lseek(file, end, 0);
+    WriteFile(file, (char *)&record, sizeof(record));
+    end += sizeof(record);
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Store
+// 	Write "data" to a new block for "sector", one no longer shared if
+//	there is one, or at the end of the log; and index it.
+//----------------------------------------------------------------------
+
+DedupBlock *
+DedupStore::Store(int sector, char *data)
+{
+    DedupBlock *block = new DedupBlock;
+
+    if (!freeBlocks->IsEmpty())
+        block->offset = freeBlocks->RemoveFront();
+    else
+    {
+        block->offset = end + sizeof(DedupRecord);
+        end = block->offset + SectorSize;
+    }
+    block->print = Fingerprint(data);
+    block->refs = 1;
+    blocks->Insert(block);
+    if (!prints->IsInTable(block->print))
+        prints->Insert(block);
+    WriteBlock(sector, block->offset, data);
+    kernel->stats->numDedupBlocks++;
+    return block;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::WriteBlock
+// 	Write the bytes of a block, after a record giving them to
+//	"sector", as its latest.
+//----------------------------------------------------------------------
+
+void
+DedupStore::WriteBlock(int sector, int offset, char *data)
+{
+    DedupRecord record;
+
+    record.sector = sector;
+    record.seq = nextSeq++;
+    record.block = 0;
+    Lseek(file, offset - sizeof(record), 0);
+    WriteFile(file, (char *)&record, sizeof(record));
+    WriteFile(file, data, SectorSize);
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Release
+// 	"entry"'s sector no longer shares its block.  A block left with
+//	no one sharing it is freed, to be used again.
+//----------------------------------------------------------------------
+
+void
+DedupStore::Release(DedupSector *entry)
+{
+    DedupBlock *block = entry->where;
+    DedupBlock *indexed;
+
+    if (--block->refs > 0)
+        return;
+    if (prints->Find(block->print, &indexed) && (indexed == block))
+        prints->Remove(block->print);
+    blocks->Remove(block->offset);
+    freeBlocks->Append(block->offset);
+    delete block;
+}
+
+//----------------------------------------------------------------------
+// DedupStore::Matches
+// 	Return whether "block" holds the bytes "data", which have the
+//	same fingerprint.
+//----------------------------------------------------------------------
+
+bool
+DedupStore::Matches(DedupBlock *block, char *data)
+{
+    char stored[SectorSize];
+
+    Lseek(file, block->offset, 0);
+    ::Read(file, stored, SectorSize);
+    return bcmp(stored, data, SectorSize) == 0;
+}
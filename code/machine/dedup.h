@@ -0,0 +1,111 @@
+// dedup.h
+//	Data structures to keep the UNIX file of a simulated disk as a
+//	content-addressed store: a sector written with the same bytes as
+//	one already stored shares its copy, instead of taking a copy of
+//	its own.  Test disks holding many copies of the same files take
+//	much less host storage, and much less is written to the host.
+//
+//	The file is a log of records, each naming a disk sector, with a
+//	sequence number telling which record of a sector is the latest.
+//	A record either holds the sector's bytes (a block), or points to
+//	the block of another record with the same bytes, or says the
+//	sector holds nothing (zeroes, or discarded).  Opening the store
+//	reads the log through, keeping the latest record of each sector.
+//
+//	Each block is counted by how many sectors share it, and indexed
+//	by a fingerprint of its bytes.  A block no sector shares any more
+//	has its place in the file used again by the next new one; a
+//	block only one sector uses is written over in place.  The short
+//	records pile up, though, so a log found much longer than it need
+//	be when the store is opened is written again, compacted.
+//
+//	Only the host storage is deduplicated: the disk still takes as
+//	long to read and write every sector (cf. disk.h).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include "copyright.h"
+#include "openhash.h"
+#include "list.h"
+
+// The following class defines the front of each record of the log.
+
+class DedupRecord {
+  public:
+    int sector;			// the disk sector
+    int seq;			// larger for later records
+    int block;			// 0 if the sector's bytes follow; the
+				// offset of the block holding them; or
+				// -1 if the sector holds nothing
+};
+
+// The following class defines a block: the bytes of a sector, kept in
+// the file after a record.
+
+class DedupBlock {
+  public:
+    int offset;			// where the bytes are in the file
+    unsigned int print;		// fingerprint of them
+    int refs;			// sectors sharing them
+};
+
+// The following class defines where a sector's bytes are.
+
+class DedupSector {
+  public:
+    int sector;			// the disk sector
+    int seq;			// of its latest record, and the block
+    int block;			// it named, while the log is read
+    DedupBlock *where;		// the block holding them
+};
+
+// The following class defines the store.
+
+class DedupStore {
+  public:
+    DedupStore(char *fileName);	// Open the store in a UNIX file,
+				// making it empty if there is none
+    ~DedupStore();		// Close it
+
+    void Read(int sector, char *data);
+    void Write(int sector, char *data);
+				// Read/write a sector's bytes; the
+				// disk discards sectors written with
+				// zeroes instead
+    void Discard(int sector);	// The sector is no longer needed;
+				// it reads as zeroes from now on
+
+  private:
+    int file;			// the UNIX file
+    int end;			// where the next record goes
+    int nextSeq;		// sequence number it gets
+    OpenHashTable<int, DedupSector *> *sectors;
+				// every sector holding anything
+    OpenHashTable<int, DedupBlock *> *blocks;
+				// every block in use, by offset
+    OpenHashTable<unsigned int, DedupBlock *> *prints;
+				// blocks by fingerprint; of blocks with
+				// the same one, only the first
+    List<int> *freeBlocks;	// offsets of blocks no one shares
+
+    void Replay();		// find the latest record of each sector
+    void Compact();		// write the log again, without the
+				// records no longer needed
+    void Append(int sector, int block);
+				// log that a sector's bytes are elsewhere
+    DedupBlock *Store(int sector, char *data);
+				// write a new block for a sector
+    void WriteBlock(int sector, int offset, char *data);
+				// write a block, and its record
+    void Release(DedupSector *entry);
+				// the sector no longer shares its block
+    bool Matches(DedupBlock *block, char *data);
+				// does the block hold these bytes?
+};
+
+#endif // DEDUP_H
@@ -18,6 +18,8 @@
 #include "debug.h"
 #include "sysdep.h"
 #include "main.h"
+#include "trace.h"
+#include "dedup.h"
 
 // We put a magic number at the front of the UNIX file representing the
 // disk, to make it less likely we will accidentally treat a useful file
@@ -25,8 +27,26 @@
 
 const int MagicNumber = 0x456789ab;
 const int MagicSize = sizeof(int);
+
+// The overlay of a layered disk has a magic number of its own, so that
+// it cannot be mistaken for a whole disk, or a disk for an overlay.
+
+const int OverlayMagic = 0x4f564c59;
 const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 
+//----------------------------------------------------------------------
+// CompareSector
+// 	Order the sectors in the write cache by number.
+//----------------------------------------------------------------------
+
+static int
+CompareSector(int x, int y)
+{
+    if (x < y) return -1;
+    else if (x == y) return 0;
+    else return 1;
+}
+
 //----------------------------------------------------------------------
 // Disk::Disk()
 // 	Initialize a simulated disk.  Open the UNIX file (creating it
@@ -34,9 +54,12 @@ const int DiskSize = (MagicSize + (NumSectors * SectorSize));
 // 	ok to treat it as Nachos disk storage.
 //
 //	"toCall" -- object to call when disk read/write request completes
+//	"which" -- the number of the disk in a RAID volume, or -1; each
+//		disk of a volume has a UNIX file of its own.  The volume
+//		counts and traces the requests, not its disks.
 //----------------------------------------------------------------------
 
-Disk::Disk(CallBackObj *toCall)
+Disk::Disk(CallBackObj *toCall, int which)
 {
     int magicNum;
     int tmp = 0;
@@ -45,8 +68,48 @@ Disk::Disk(CallBackObj *toCall)
     callWhenDone = toCall;
     lastSector = 0;
     bufferInit = 0;
+    mapped = NULL;
+    active = FALSE;
+    queued = FALSE;
+    baseFile = -1;
+    overlay = NULL;
+    store = NULL;
+    member = which;
+
+    numSegments = kernel->diskSegments;
+    segmentSectors = kernel->segmentSectors;
+    segments = NULL;
+    loading = -1;
+    if (numSegments > 0)
+    {
+        ASSERT(segmentSectors > 0);
+        segments = new DiskSegment[numSegments];
+        for (int i = 0; i < numSegments; i++)
+        {
+            segments[i].count = 0;
+            segments[i].lastUsed = -1; // unused ones go first
+        }
+    }
+    writeCacheSectors = kernel->writeCacheSectors;
+    dirty = new BTree<int>(CompareSector);
 
-    sprintf(diskname, "DISK_%d", kernel->hostName);
+    if (kernel->diskBase != NULL)
+    {
+        OpenLayers(kernel->diskBase, kernel->diskOverlay);
+        return;
+    }
+
+    if (member >= 0)
+        sprintf(diskname, "DISK_%d.%d", kernel->hostName, member);
+    else
+        sprintf(diskname, "DISK_%d", kernel->hostName);
+    if (kernel->dedupDisk)
+    {
+        ASSERT(!kernel->mapDisk);
+        store = new DedupStore(diskname);
+        fileno = -1;
+        return;
+    }
     fileno = OpenForReadWrite(diskname, FALSE);
     if (fileno >= 0)
     { // file exists, check magic number
@@ -63,18 +126,107 @@ Disk::Disk(CallBackObj *toCall)
         Lseek(fileno, DiskSize - sizeof(int), 0);
         WriteFile(fileno, (char *)&tmp, sizeof(int));
     }
-    active = FALSE;
+    if (kernel->mapDisk)
+        mapped = MapFile(fileno, DiskSize);
+}
+
+//----------------------------------------------------------------------
+// OverlayKey, HashSector
+// 	Helper functions for the hash table of sectors in the overlay.
+//----------------------------------------------------------------------
+
+static int
+OverlayKey(OverlaySector *where)
+{
+    return where->sector;
+}
+
+static unsigned
+HashSector(int sector)
+{
+    return (unsigned)sector;
+}
+
+static void
+DeleteOverlaySector(OverlaySector *where)
+{
+    delete where;
+}
+
+//----------------------------------------------------------------------
+// Disk::OpenLayers
+// 	Open a layered disk: the base image, read only, and the overlay,
+//	finding the sectors already in it if it exists, or making it
+//	empty if not.  A sector left half written at the end of the log,
+//	by a run that crashed, is ignored, and written over.
+//
+//	"baseName" -- the base image, a disk file
+//	"overlayName" -- the overlay file
+//----------------------------------------------------------------------
+
+void Disk::OpenLayers(char *baseName, char *overlayName)
+{
+    int magicNum;
+    int sector;
+    char data[SectorSize];
+
+    baseFile = OpenForRead(baseName, FALSE);
+    if (baseFile < 0)
+    {
+        cerr << "Disk: couldn't open base image " << baseName << "\n";
+        Abort();
+    }
+    Read(baseFile, (char *)&magicNum, MagicSize);
+    ASSERT(magicNum == MagicNumber);
+
+    overlay = new OpenHashTable<int, OverlaySector *>(OverlayKey, HashSector);
+    overlayEnd = MagicSize;
+    fileno = OpenForReadWrite(overlayName, FALSE);
+    if (fileno < 0)
+    { // a new overlay, with nothing in it
+        fileno = OpenForWrite(overlayName);
+        magicNum = OverlayMagic;
+        WriteFile(fileno, (char *)&magicNum, MagicSize);
+        return;
+    }
+    Read(fileno, (char *)&magicNum, MagicSize);
+    ASSERT(magicNum == OverlayMagic);
+    while ((ReadPartial(fileno, (char *)&sector, sizeof(int)) == sizeof(int)) &&
+           (ReadPartial(fileno, data, SectorSize) == SectorSize))
+    {
+        OverlaySector *where = new OverlaySector;
+
+        ASSERT((sector >= 0) && (sector < NumSectors));
+        where->sector = sector;
+        where->offset = overlayEnd + sizeof(int);
+        overlay->Insert(where);
+        overlayEnd += sizeof(int) + SectorSize;
+    }
+    DEBUG(dbgDisk, "Overlay " << overlayName << " on " << baseName);
 }
 
 //----------------------------------------------------------------------
 // Disk::~Disk()
 // 	Clean up disk simulation, by closing the UNIX file representing the
-//	disk.
+//	disk (writing it back first, if it is mapped).
 //----------------------------------------------------------------------
 
 Disk::~Disk()
 {
-    Close(fileno);
+    if (mapped != NULL)
+        UnmapFile(mapped, DiskSize);
+    if (store != NULL)
+        delete store;
+    else
+        Close(fileno);
+    if (overlay != NULL)
+    {
+        Close(baseFile);
+        overlay->Apply(DeleteOverlaySector);
+        delete overlay;
+    }
+    delete[] segments;
+    delete dirty;
 }
 
 //----------------------------------------------------------------------
@@ -98,6 +250,22 @@ PrintSector(bool writing, int sector, char *data)
     cout << "\n";
 }
 
+//----------------------------------------------------------------------
+// IsZeroSector
+// 	Return TRUE if a sector's worth of data is all zeroes.
+//----------------------------------------------------------------------
+
+static bool
+IsZeroSector(char *data)
+{
+    int *p = (int *)data;
+
+    for (unsigned int i = 0; i < (SectorSize / sizeof(int)); i++)
+        if (p[i] != 0)
+            return FALSE;
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // Disk::ReadRequest/WriteRequest
 // 	Simulate a request to read/write a single disk sector
@@ -115,40 +283,239 @@ PrintSector(bool writing, int sector, char *data)
 
 void Disk::ReadRequest(int sectorNumber, char *data)
 {
-    int ticks = ComputeLatency(sectorNumber, FALSE);
+    ReadRequest(sectorNumber, 1, &data);
+}
 
-    ASSERT(!active); // only one request at a time
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+void Disk::WriteRequest(int sectorNumber, char *data)
+{
+    WriteRequest(sectorNumber, 1, &data);
+}
 
-    DEBUG(dbgDisk, "Reading from sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    Read(fileno, data, SectorSize);
-    if (debug->IsEnabled('d'))
-        PrintSector(FALSE, sectorNumber, data);
+//----------------------------------------------------------------------
+// Disk::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive sectors.
+//	The request costs a single seek plus the time for the whole run
+//	to pass under the head, and a single interrupt.
+//
+//	"firstSector" -- the first disk sector to read/write
+//	"count" -- how many sectors
+//	"data" -- data[i] is the buffer for sector firstSector + i
+//----------------------------------------------------------------------
+
+void Disk::ReadRequest(int firstSector, int count, char **data)
+{
+    int ticks = ComputeLatency(firstSector, FALSE, count, TRUE);
+
+    ASSERT(!active); // only one request at a time
+    ReadSectors(firstSector, count, data);
 
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskReads++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+    UpdateLast(firstSector + count - 1, kernel->stats->totalTicks);
+    if (member < 0)
+    {
+        kernel->stats->numDiskReads++;
+        TRACE(TraceDiskStart, 0, "read", firstSector);
+    }
+    kernel->interrupt->Schedule(this, ticks, queued ? DiskQueueInt : DiskInt);
 }
 
-void Disk::WriteRequest(int sectorNumber, char *data)
+void Disk::WriteRequest(int firstSector, int count, char **data)
 {
-    int ticks = ComputeLatency(sectorNumber, TRUE);
+    int ticks = ComputeLatency(firstSector, TRUE, count, TRUE);
 
     ASSERT(!active);
-    ASSERT((sectorNumber >= 0) && (sectorNumber < NumSectors));
+    WriteSectors(firstSector, count, data);
 
-    DEBUG(dbgDisk, "Writing to sector " << sectorNumber);
-    Lseek(fileno, SectorSize * sectorNumber + MagicSize, 0);
-    WriteFile(fileno, data, SectorSize);
+    active = TRUE;
+    if (writeCacheSectors == 0) // else the head has not moved
+        UpdateLast(firstSector + count - 1, kernel->stats->totalTicks);
+    if (member < 0)
+    {
+        kernel->stats->numDiskWrites++;
+        TRACE(TraceDiskStart, 0, "write", firstSector);
+    }
+    kernel->interrupt->Schedule(this, ticks, queued ? DiskQueueInt : DiskInt);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadSectors/WriteSectors
+// 	Read/write a run of consecutive sectors of the UNIX file, at once
+//	and taking no simulated time.  The file is positioned once, and the
+//	sectors are transferred one after another.
+//
+//	"firstSector" -- the first disk sector to read/write
+//	"count" -- how many sectors
+//	"data" -- data[i] is the buffer for sector firstSector + i
+//----------------------------------------------------------------------
+
+void Disk::ReadSectors(int firstSector, int count, char **data)
+{
+    ASSERT(count > 0);
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    DEBUG(dbgDisk, "Reading " << count << " sectors from sector " << firstSector);
+    if ((mapped == NULL) && (overlay == NULL) && (store == NULL))
+        Lseek(fileno, SectorSize * firstSector + MagicSize, 0);
+    for (int i = 0; i < count; i++)
+    {
+        if (store != NULL)
+            store->Read(firstSector + i, data[i]);
+        else if (overlay != NULL)
+            ReadLayers(firstSector + i, data[i]);
+        else if (mapped != NULL)
+            bcopy(&mapped[SectorSize * (firstSector + i) + MagicSize], data[i], SectorSize);
+        else
+            Read(fileno, data[i], SectorSize);
+        if (debug->IsEnabled('d'))
+            PrintSector(FALSE, firstSector + i, data[i]);
+    }
+}
+
+void Disk::WriteSectors(int firstSector, int count, char **data)
+{
+    int position = -1; // where the UNIX file is positioned, if known
+    int i, j, k;
+
+    ASSERT(count > 0);
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    DEBUG(dbgDisk, "Writing " << count << " sectors to sector " << firstSector);
+    // a layered disk writes every sector to the overlay, zeroes or not,
+    // since they must hide what the base has there
+    for (i = 0; (i < count) && (overlay != NULL); i++)
+        WriteLayers(firstSector + i, data[i]);
+    // a deduplicated one stores each sector that holds anything, and
+    // forgets those written with zeroes
+    for (i = 0; (i < count) && (store != NULL); i++)
+    {
+        if (IsZeroSector(data[i]))
+            store->Discard(firstSector + i);
+        else
+            store->Write(firstSector + i, data[i]);
+    }
+    // otherwise, each stretch of sectors written with zeroes becomes a
+    // hole in the UNIX file, if the host allows it; the others are written
+    for (i = 0; (i < count) && (overlay == NULL) && (store == NULL); i = j)
+    {
+        bool zero = IsZeroSector(data[i]);
+        int offset = SectorSize * (firstSector + i) + MagicSize;
+
+        for (j = i + 1; (j < count) && (IsZeroSector(data[j]) == zero); j++)
+            ;
+        if (zero && PunchHole(fileno, offset, (j - i) * SectorSize))
+            continue;
+        for (k = i; k < j; k++, offset += SectorSize)
+        {
+            if (mapped != NULL)
+            {
+                bcopy(data[k], &mapped[offset], SectorSize);
+                continue;
+            }
+            if (position != offset)
+                Lseek(fileno, offset, 0);
+            WriteFile(fileno, data[k], SectorSize);
+            position = offset + SectorSize;
+        }
+    }
     if (debug->IsEnabled('d'))
-        PrintSector(TRUE, sectorNumber, data);
+        for (i = 0; i < count; i++)
+            PrintSector(TRUE, firstSector + i, data[i]);
+}
 
+//----------------------------------------------------------------------
+// Disk::FlushRequest
+// 	Simulate a request to write everything in the write cache to the
+//	platter; the interrupt comes once it is there.  Without a write
+//	cache, or with nothing in it, there is only the command to carry
+//	out, which takes as long as a sector transfer.
+//----------------------------------------------------------------------
+
+void Disk::FlushRequest()
+{
+    int ticks = RotationTime;
+
+    ASSERT(!active);
+
+    DEBUG(dbgDisk, "Flushing " << dirty->NumInTree() << " sectors from the write cache");
+    if (!dirty->IsEmpty())
+        ticks += Destage(kernel->stats->totalTicks);
     active = TRUE;
-    UpdateLast(sectorNumber);
-    kernel->stats->numDiskWrites++;
-    kernel->interrupt->Schedule(this, ticks, DiskInt);
+    kernel->stats->numDiskFlushes++;
+    TRACE(TraceDiskStart, 0, "flush", lastSector);
+    kernel->interrupt->Schedule(this, ticks, queued ? DiskQueueInt : DiskInt);
+}
+
+//----------------------------------------------------------------------
+// Disk::ReadLayers/WriteLayers
+// 	Read or write one sector of a layered disk.  A sector is read
+//	from the overlay if it was ever written, and from the base image
+//	if not; it is written where it is in the overlay, or added to the
+//	end of it.
+//
+//	"sector" -- the disk sector to read/write
+//	"data" -- the bytes to be written, the buffer to hold the incoming bytes
+//----------------------------------------------------------------------
+
+void Disk::ReadLayers(int sector, char *data)
+{
+    OverlaySector *where;
+
+    if (overlay->Find(sector, &where))
+    {
+        Lseek(fileno, where->offset, 0);
+        Read(fileno, data, SectorSize);
+    }
+    else
+    {
+        Lseek(baseFile, SectorSize * sector + MagicSize, 0);
+        Read(baseFile, data, SectorSize);
+    }
+}
+
+void Disk::WriteLayers(int sector, char *data)
+{
+    OverlaySector *where;
+
+    if (!overlay->Find(sector, &where))
+    {
+        where = new OverlaySector;
+        where->sector = sector;
+        where->offset = overlayEnd + sizeof(int);
+        overlay->Insert(where);
+        overlayEnd += sizeof(int) + SectorSize;
+        Lseek(fileno, where->offset - sizeof(int), 0);
+        WriteFile(fileno, (char *)&sector, sizeof(int));
+    }
+    else
+        Lseek(fileno, where->offset, 0);
+    WriteFile(fileno, data, SectorSize);
+}
+
+//----------------------------------------------------------------------
+// Disk::Discard
+// 	The file system no longer needs the contents of a run of sectors
+//	(they were freed, or are about to be formatted); give the host
+//	storage behind them back.  This is done at once, and takes no
+//	simulated time: the disk need not move its head to forget data.
+//
+//	"firstSector" -- the first sector no longer needed
+//	"count" -- how many sectors
+//----------------------------------------------------------------------
+
+void Disk::Discard(int firstSector, int count)
+{
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    DEBUG(dbgDisk, "Discarding " << count << " sectors from sector " << firstSector);
+    if (overlay != NULL)
+        return; // the base cannot forget them
+    if (store != NULL)
+    {
+        for (int i = 0; i < count; i++)
+            store->Discard(firstSector + i);
+        return;
+    }
+    PunchHole(fileno, SectorSize * firstSector + MagicSize, SectorSize * count);
 }
 
 //----------------------------------------------------------------------
@@ -159,6 +526,8 @@ void Disk::WriteRequest(int sectorNumber, char *data)
 void Disk::CallBack()
 {
     active = FALSE;
+    if (member < 0)
+        TRACE(TraceDiskDone, 0, NULL, 0);
     callWhenDone->CallBack();
 }
 
@@ -171,15 +540,17 @@ void Disk::CallBack()
 //
 //   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
 //   	and rotates at one sector per RotationTime ticks
+//
+//	"when" -- the time the seek starts
 //----------------------------------------------------------------------
 
-int Disk::TimeToSeek(int newSector, int *rotation)
+int Disk::TimeToSeek(int newSector, int when, int *rotation)
 {
     int newTrack = newSector / SectorsPerTrack;
     int oldTrack = lastSector / SectorsPerTrack;
     int seek = abs(newTrack - oldTrack) * SeekTime;
     // how long will seek take?
-    int over = (kernel->stats->totalTicks + seek) % RotationTime;
+    int over = (when + seek) % RotationTime;
     // will we be in the middle of a sector when
     // we finish the seek?
 
@@ -205,8 +576,79 @@ int Disk::ModuloDiff(int to, int from)
 
 //----------------------------------------------------------------------
 // Disk::ComputeLatency()
-// 	Return how long will it take to read/write a disk sector, from
-//	the current position of the disk head.
+// 	Return how long will it take to read/write "count" consecutive
+//	disk sectors, from the current position of the disk head.
+//
+//	A write taken into the write cache costs only its transfer, unless
+//	it overflows the cache; a read found in a segment of the read
+//	cache, or all in the write cache, costs its transfer, once the
+//	sectors have come off the platter.  Everything else goes to the
+//	platter (see PlatterLatency).  A read that does loads a segment.
+//
+//	If "record" is set, this is the request the disk is about to
+//	carry out (not an estimate for the disk scheduler), so the caches
+//	are updated, and the seek distance, rotational delay and cache
+//	hits are counted.
+//----------------------------------------------------------------------
+
+int Disk::ComputeLatency(int newSector, bool writing, int count, bool record)
+{
+    int now = kernel->stats->totalTicks;
+    int ticks = count * RotationTime;
+    int hit;
+
+    if (writing && (writeCacheSectors > 0))
+    {
+        if (record)
+        {
+            for (int i = newSector; i < newSector + count; i++)
+                if (!IsDirty(i, 1))
+                    dirty->Insert(i);
+            kernel->stats->numDiskWritesCached++;
+            if (dirty->NumInTree() > writeCacheSectors)
+                ticks += Destage(now + ticks);
+        }
+        DEBUG(dbgDisk, "Request latency = " << ticks);
+        return ticks;
+    }
+    if (!writing && (writeCacheSectors > 0) && IsDirty(newSector, count))
+    {
+        if (record)
+            kernel->stats->numDiskCacheHits++;
+        DEBUG(dbgDisk, "Request latency = " << ticks);
+        return ticks;
+    }
+    if (!writing && (numSegments > 0) &&
+        ((hit = FindSegment(newSector, count)) >= 0))
+    {
+        DiskSegment *segment = &segments[hit];
+        int ready = segment->loadStart +
+            (newSector + count - segment->first) * RotationTime;
+
+        if (ready > now + ticks) // the last one is not in yet
+            ticks = ready - now;
+        if (record)
+        {
+            segment->lastUsed = now;
+            kernel->stats->numDiskCacheHits++;
+        }
+        DEBUG(dbgDisk, "Request latency = " << ticks);
+        return ticks;
+    }
+
+    if (record)
+        StopReadAhead(now);
+    ticks = PlatterLatency(newSector, writing, count, now, record);
+    if (record && !writing && (numSegments > 0))
+        LoadSegment(newSector, count, now + ticks - count * RotationTime);
+    return ticks;
+}
+
+//----------------------------------------------------------------------
+// Disk::PlatterLatency()
+// 	Return how long will it take to read/write "count" consecutive
+//	sectors of the platter, starting at time "when", from where the
+//	head is then.
 //
 //   	Latency = seek time + rotational latency + transfer time
 //   	Disk seeks at one track per SeekTime ticks (cf. stats.h)
@@ -217,47 +659,179 @@ int Disk::ModuloDiff(int to, int from)
 //   	how long it will take to rotate completely past newSector after
 //	that point.
 //
-//   	The disk also has a "track buffer"; the disk continuously reads
-//   	the contents of the current disk track into the buffer.  This allows
-//   	read requests to the current track to be satisfied more quickly.
-//   	The contents of the track buffer are discarded after every seek to
-//   	a new track.
+//   	Without a segmented cache, the disk has a "track buffer"; the disk
+//	continuously reads the contents of the current disk track into the
+//	buffer.  This allows read requests to the current track to be
+//	satisfied more quickly.  The contents of the track buffer are
+//	discarded after every seek to a new track.
+//
+//	Once the head is at newSector, the rest of a run passes under it
+//	one sector per RotationTime, plus a one-track seek each time the
+//	run crosses onto the next track.
+//
+//	If "record" is set, the seek distance, rotational delay and track
+//	buffer hit are counted.
 //----------------------------------------------------------------------
 
-int Disk::ComputeLatency(int newSector, bool writing)
+int Disk::PlatterLatency(int newSector, bool writing, int count, int when,
+                         bool record)
 {
     int rotation;
-    int seek = TimeToSeek(newSector, &rotation);
-    int timeAfter = kernel->stats->totalTicks + seek + rotation;
+    int seek = TimeToSeek(newSector, when, &rotation);
+    int timeAfter = when + seek + rotation;
+    int lastSector = newSector + count - 1;
+    int transfer = count * RotationTime +
+        (lastSector / SectorsPerTrack - newSector / SectorsPerTrack) * SeekTime;
 
 #ifndef NOTRACKBUF // turn this on if you don't want the track buffer stuff
-    // check if track buffer applies
-    if ((writing == FALSE) && (seek == 0) && (((timeAfter - bufferInit) / RotationTime) > ModuloDiff(newSector, bufferInit / RotationTime)))
+    // check if track buffer applies: the whole run is on this track
+    // and has already gone by since the buffer started loading
+    if ((writing == FALSE) && (numSegments == 0) && (seek == 0) && (lastSector / SectorsPerTrack == newSector / SectorsPerTrack) && (ModuloDiff(newSector, bufferInit / RotationTime) <= ModuloDiff(lastSector, bufferInit / RotationTime)) && (((timeAfter - bufferInit) / RotationTime) > ModuloDiff(lastSector, bufferInit / RotationTime)))
     {
-        DEBUG(dbgDisk, "Request latency = " << RotationTime);
-        return RotationTime; // time to transfer sector from the track buffer
+        DEBUG(dbgDisk, "Request latency = " << count * RotationTime);
+        if (record)
+            kernel->stats->numTrackBufferHits++;
+        return count * RotationTime; // time to transfer from the track buffer
     }
 #endif
 
     rotation += ModuloDiff(newSector, timeAfter / RotationTime) * RotationTime;
+    if (record)
+    {
+        kernel->stats->diskSeekTracks += seek / SeekTime +
+            (lastSector / SectorsPerTrack - newSector / SectorsPerTrack);
+        kernel->stats->diskRotationTicks += rotation;
+    }
+
+    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + transfer));
+    return (seek + rotation + transfer);
+}
+
+//----------------------------------------------------------------------
+// Disk::FindSegment
+// 	Return the segment of the read cache that holds all of a run of
+//	sectors (or will, once read ahead), or -1 if none does.
+//----------------------------------------------------------------------
+
+int Disk::FindSegment(int firstSector, int count)
+{
+    for (int i = 0; i < numSegments; i++)
+        if ((firstSector >= segments[i].first) &&
+            (firstSector + count <= segments[i].first + segments[i].count))
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Disk::LoadSegment
+// 	A read of "count" sectors from "firstSector" on missed the cache:
+//	load them into the least recently used segment, and read ahead
+//	after them to fill it.  The read-ahead goes on until the head is
+//	needed for something else (see StopReadAhead).
+//
+//	"when" -- the time the first sector comes off the platter
+//----------------------------------------------------------------------
 
-    DEBUG(dbgDisk, "Request latency = " << (seek + rotation + RotationTime));
-    return (seek + rotation + RotationTime);
+void Disk::LoadSegment(int firstSector, int count, int when)
+{
+    DiskSegment *segment = &segments[0];
+
+    for (int i = 1; i < numSegments; i++)
+        if (segments[i].lastUsed < segment->lastUsed)
+            segment = &segments[i];
+    segment->first = firstSector;
+    segment->needed = count;
+    segment->count = min(max(count, segmentSectors), NumSectors - firstSector);
+    segment->loadStart = when;
+    segment->lastUsed = kernel->stats->totalTicks;
+    loading = segment - segments;
+}
+
+//----------------------------------------------------------------------
+// Disk::StopReadAhead
+// 	The head is about to be used for another transfer, at time "when":
+//	the segment being read ahead into keeps only what came off the
+//	platter by then (and at least the sectors that were asked for).
+//----------------------------------------------------------------------
+
+void Disk::StopReadAhead(int when)
+{
+    DiskSegment *segment;
+    int loaded;
+
+    if (loading < 0)
+        return;
+    segment = &segments[loading];
+    loaded = (when - segment->loadStart) / RotationTime;
+    if (loaded < segment->count)
+        segment->count = max(loaded, segment->needed);
+    loading = -1;
+}
+
+//----------------------------------------------------------------------
+// Disk::IsDirty
+// 	Return TRUE if every sector of a run is in the write cache.
+//----------------------------------------------------------------------
+
+bool Disk::IsDirty(int firstSector, int count)
+{
+    int sector;
+
+    for (int i = firstSector; i < firstSector + count; i++)
+        if (!dirty->Ceiling(i, &sector) || (sector != i))
+            return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Disk::Destage
+// 	Write everything in the write cache to the platter, starting at
+//	time "when", and return how long that takes.  The runs of sectors
+//	go in one sweep up the disk from the head, then from the start of
+//	the disk up to it (C-LOOK), each run in one transfer.
+//----------------------------------------------------------------------
+
+int Disk::Destage(int when)
+{
+    int ticks = 0;
+    int first, count, latency;
+    bool found;
+
+    StopReadAhead(when);
+    while (!dirty->IsEmpty())
+    {
+        found = dirty->Ceiling(lastSector, &first);
+        if (!found)
+            found = dirty->Ceiling(0, &first);
+        ASSERT(found);
+        found = dirty->Remove(first);
+        ASSERT(found);
+        for (count = 1; dirty->Remove(first + count); count++)
+            ;
+        latency = PlatterLatency(first, TRUE, count, when + ticks, TRUE);
+        UpdateLast(first + count - 1, when + ticks);
+        ticks += latency;
+        kernel->stats->numDiskSectorsDestaged += count;
+    }
+    DEBUG(dbgDisk, "Destaged the write cache in " << ticks);
+    return ticks;
 }
 
 //----------------------------------------------------------------------
 // Disk::UpdateLast
 //   	Keep track of the most recently requested sector.  So we can know
 //	what is in the track buffer.
+//
+//	"when" -- the time the request for it starts
 //----------------------------------------------------------------------
 
-void Disk::UpdateLast(int newSector)
+void Disk::UpdateLast(int newSector, int when)
 {
     int rotate;
-    int seek = TimeToSeek(newSector, &rotate);
+    int seek = TimeToSeek(newSector, when, &rotate);
 
     if (seek != 0)
-        bufferInit = kernel->stats->totalTicks + seek + rotate;
+        bufferInit = when + seek + rotate;
     lastSector = newSector;
     DEBUG(dbgDisk, "Updating last sector = " << lastSector << " , " << bufferInit);
 }
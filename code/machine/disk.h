@@ -20,6 +20,32 @@
 #include "copyright.h"
 #include "utility.h"
 #include "callback.h"
+#include "openhash.h"
+#include "btree.h"
+
+class DedupStore;
+
+// The following class defines where a sector written to a layered
+// disk is kept in the overlay file.
+
+class OverlaySector {
+  public:
+    int sector;			// the disk sector
+    int offset;			// where its contents are in the file
+};
+
+// The following class defines a segment of the disk's read cache:
+// a run of sectors read from the platter, those asked for and those
+// read ahead after them.
+
+class DiskSegment {
+  public:
+    int first;			// first sector in the segment
+    int count;			// sectors in it, once loaded; 0 if unused
+    int needed;			// how many of them were asked for
+    int loadStart;		// when the first came off the platter
+    int lastUsed;		// when last read from, for LRU
+};
 
 // The following class defines a physical disk I/O device.  The disk
 // has a single surface, split up into "tracks", and each track split
@@ -46,6 +72,45 @@
 // disks these days now come with a track buffer.
 //
 // The track buffer simulation can be disabled by compiling with -DNOTRACKBUF
+//
+// With the "-dc" flag, the disk has a segmented cache instead, as
+// drives have now: a read that misses loads a segment with the
+// sectors asked for, and goes on reading ahead after them until the
+// segment is full or another request needs the head.  Later reads of
+// those sectors are served from the segment, on any track, at
+// transfer speed (waiting, if need be, for the sector to come off the
+// platter).  The least recently used segment is the one loaded next.
+//
+// With the "-dwc" flag, the disk also has a write cache: a write is
+// done once its data is in the cache, and the sectors go to the
+// platter later, in one sweep of the head (C-LOOK), when the cache
+// overflows -- the request that overflows it waits for that -- or
+// when a flush request asks for it.  Only the timing is simulated:
+// the UNIX file is always written at once, so a crash loses nothing.
+//
+// With the "-dm" flag, the UNIX file is mapped into memory, so that
+// a transfer is a memory copy instead of two system calls.  This only
+// makes the simulation itself faster; simulated time is not affected.
+//
+// The UNIX file is kept sparse where the host allows it: a new disk
+// is all hole, sectors written with zeroes and sectors discarded by
+// the file system become holes again, so that a disk only takes host
+// storage for the sectors actually in use.
+//
+// With the "-base" flag, the disk is layered instead: a base image (a
+// disk file made by an earlier run) is only read, never written, and
+// the sectors written go to an overlay file of this run's own, which
+// holds nothing else.  Many runs can so share one prepared base image,
+// each paying only for what it changes.  The overlay file is a log of
+// sectors, each after its number, in the order first written; where
+// each one is, is kept in a hash table, built again from the log when
+// an overlay is reopened.  Discarded sectors stay in the overlay (and
+// the base), since the disk need not forget them.
+//
+// With the "-dd" flag, the UNIX file is a deduplicated store instead
+// (see dedup.h): sectors with the same contents share one copy of
+// them in the file, so that a disk holding many copies of the same
+// files takes little more host storage than one.
 
 // MP4 Hint: DO NOT change the SectorSize, but other constants are allowed
 const int SectorSize = 128;		// number of bytes per disk sector
@@ -55,9 +120,12 @@ const int NumSectors = (SectorsPerTrack * NumTracks); // total # of sectors per
 
 class Disk : public CallBackObj {
   public:
-    Disk(CallBackObj *toCall);          // Create a simulated disk.  
+    Disk(CallBackObj *toCall, int which = -1);
+					// Create a simulated disk.  
 					// Invoke toCall->CallBack() 
 					// when each request completes.
+					// "which" is its number in a RAID
+					// volume, or -1 if it is alone
     ~Disk();				// Deallocate the disk.
     
     void ReadRequest(int sectorNumber, char* data);
@@ -67,26 +135,102 @@ class Disk : public CallBackObj {
     					// Only one request allowed at a time!
     void WriteRequest(int sectorNumber, char* data);
 
+    void ReadRequest(int firstSector, int count, char** data);
+    void WriteRequest(int firstSector, int count, char** data);
+					// Read/write "count" consecutive
+					// sectors in one request: one seek,
+					// then a contiguous transfer.
+					// data[i] is the buffer for sector
+					// firstSector + i (scatter/gather).
+    void FlushRequest();		// Write what is in the write cache
+					// to the platter.
+
+    void ReadSectors(int firstSector, int count, char** data);
+    void WriteSectors(int firstSector, int count, char** data);
+					// Transfer to/from the UNIX file at
+					// once, in no simulated time, with
+					// no interrupt; for a device that
+					// keeps its contents in the disk's
+					// file but times them its own way
+
+    bool HasWriteCache() { return (writeCacheSectors > 0); }
+
+    void QueueCompletions() { queued = TRUE; }
+					// The end of a request is the
+					// controller going on to the next,
+					// not an interrupt: the one it
+					// reports to tells the CPU, for a
+					// batch of them at once
+
+    void Discard(int firstSector, int count);
+    					// The contents of these sectors
+					// are no longer needed; they may
+					// read as zeroes from now on.
+					// Done at once, with no interrupt.
+
+    int HeadSector() { return lastSector; }
+					// Where the last request left the head
+
     void CallBack();			// Invoked when disk request 
 					// finishes. In turn calls, callWhenDone.
 
-    int ComputeLatency(int newSector, bool writing);	
+    int ComputeLatency(int newSector, bool writing, int count,
+		       bool record = FALSE);	
     					// Return how long a request to 
-					// newSector will take: 
+					// "count" sectors from newSector
+					// will take: 
 					// (seek + rotational delay + transfer)
 
   private:
     int fileno;				// UNIX file number for simulated disk 
+    int member;				// number in a RAID volume, or -1
     char diskname[32];			// name of simulated disk's file
+    char *mapped;			// the UNIX file mapped into memory,
+					// or NULL if it is read and written
+					// with system calls
+    int baseFile;			// UNIX file of the base image, or -1
+					// if the disk is not layered; then
+					// "fileno" is the overlay
+    OpenHashTable<int, OverlaySector *> *overlay;
+					// sectors in the overlay, or NULL
+    int overlayEnd;			// where the next one goes
+    DedupStore *store;			// what the UNIX file holds, if it
+					// is deduplicated, or NULL
     CallBackObj *callWhenDone;		// Invoke when any disk request finishes
     bool active;     			// Is a disk operation in progress?
+    bool queued;			// Do requests end in a "disk
+					// queue" event, not an interrupt?
     int lastSector;			// The previous disk request 
     int bufferInit;			// When the track buffer started 
 					// being loaded
+    int numSegments;			// segments in the read cache; 0 if
+					// there is only the track buffer
+    int segmentSectors;			// sectors each one holds
+    DiskSegment *segments;
+    int loading;			// segment being read ahead into, or -1
+    int writeCacheSectors;		// sectors the write cache holds; 0 if
+					// writes go straight to the platter
+    BTree<int> *dirty;			// sectors in it, not yet on the platter
 
-    int TimeToSeek(int newSector, int *rotate); // time to get to the new track
+    int TimeToSeek(int newSector, int when, int *rotate);
+					// time to get to the new track
     int ModuloDiff(int to, int from);        // # sectors between to and from
-    void UpdateLast(int newSector);
+    void UpdateLast(int newSector, int when);
+    int PlatterLatency(int newSector, bool writing, int count, int when,
+		       bool record);	// time to transfer from the platter
+    int FindSegment(int firstSector, int count);
+					// segment holding a run, or -1
+    void LoadSegment(int firstSector, int count, int when);
+    void StopReadAhead(int when);	// the head is needed elsewhere
+    bool IsDirty(int firstSector, int count);
+					// is a run all in the write cache?
+    int Destage(int when);		// write the write cache out
+
+    void OpenLayers(char *baseName, char *overlayName);
+					// open a layered disk
+    void ReadLayers(int sector, char *data);
+    void WriteLayers(int sector, char *data);
+					// transfer a sector of one
 };
 
 #endif // DISK_H
@@ -0,0 +1,182 @@
+// fabric.cc
+//	Routines to model the links between Nachos machines and the
+//	switch that connects them.  See fabric.h.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "fabric.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// Fabric::Fabric
+// 	Initialize the model of the network: every link the default,
+//	then those in the topology file, if there is one.  Abort if it
+//	cannot be read.
+//
+//	The default link carries a packet in NetworkTime, whatever the
+//	size of the packets (-mtu).
+//
+//	"topologyFile" -- the file of links, or NULL
+//----------------------------------------------------------------------
+
+Fabric::Fabric(char *topologyFile)
+{
+    Link defaultLink;
+    bool listed[MaxHosts];
+    char line[256], host[20];
+    FILE *file;
+    int i;
+
+    ASSERT((kernel->hostName >= 0) && (kernel->hostName < MaxHosts));
+    defaultLink.latency = 0;
+    defaultLink.bandwidth = kernel->wireSize * 1000 / NetworkTime;
+    defaultLink.queueLimit = 0;
+    for (i = 0; i < MaxHosts; i++) {
+	links[i] = defaultLink;
+	listed[i] = FALSE;
+	for (int g = 0; g <= MaxGroups; g++)
+	    inGroup[g][i] = FALSE;
+    }
+    downFree = 0;
+    if (topologyFile == NULL)
+	return;
+
+    file = fopen(topologyFile, "r");
+    if (file == NULL) {
+	cerr << "Cannot read topology " << topologyFile << "\n";
+	Abort();
+    }
+    while (fgets(line, sizeof(line), file) != NULL) {
+	Link link;
+	int n;
+
+	link.queueLimit = 0;
+	n = sscanf(line, "%19s %d %d %d", host, &link.latency,
+		   &link.bandwidth, &link.queueLimit);
+	if ((n <= 0) || (host[0] == '#'))
+	    continue;				// blank line, or comment
+	if (strcmp(host, "group") == 0) {
+	    char *word = strtok(line, " \t\n");	// "group"
+	    int group;
+
+	    word = strtok(NULL, " \t\n");
+	    ASSERT(word != NULL);
+	    group = atoi(word) - BroadcastAddress;
+	    ASSERT((group > 0) && (group <= MaxGroups));
+	    while ((word = strtok(NULL, " \t\n")) != NULL) {
+		i = atoi(word);
+		ASSERT((i >= 0) && (i < MaxHosts));
+		inGroup[group][i] = inGroup[0][i] = TRUE;
+	    }
+	    continue;
+	}
+	ASSERT((n >= 3) && (link.latency >= 0) && (link.bandwidth > 0) &&
+	       (link.queueLimit >= 0));
+	if (strcmp(host, "*") == 0) {
+	    for (i = 0; i < MaxHosts; i++) {
+		if (!listed[i])
+		    links[i] = link;
+	    }
+	} else {
+	    i = atoi(host);
+	    ASSERT((i >= 0) && (i < MaxHosts));
+	    links[i] = link;
+	    listed[i] = inGroup[0][i] = TRUE;
+	}
+    }
+    fclose(file);
+    DEBUG(dbgNet, "Link to the switch: latency " <<
+	  links[kernel->hostName].latency << ", bandwidth " <<
+	  links[kernel->hostName].bandwidth);
+}
+
+//----------------------------------------------------------------------
+// Fabric::PacketTime
+// 	Return how long a link takes to carry one packet: every packet
+//	is padded to the wire size.
+//----------------------------------------------------------------------
+
+int
+Fabric::PacketTime(Link *link)
+{
+    return max(divRoundUp(kernel->wireSize * 1000, link->bandwidth), 1);
+}
+
+//----------------------------------------------------------------------
+// Fabric::SendTime
+// 	Return how long this machine takes to send a packet, up its
+//	link to the switch.
+//----------------------------------------------------------------------
+
+int
+Fabric::SendTime()
+{
+    return PacketTime(&links[kernel->hostName]);
+}
+
+//----------------------------------------------------------------------
+// Fabric::Members
+// 	Return the machines a packet sent to a group is copied to: every
+//	member but this machine.
+//
+//	"group" -- the group's address
+//	"members" -- where to put them
+//----------------------------------------------------------------------
+
+int
+Fabric::Members(NetworkAddress group, NetworkAddress *members)
+{
+    int count = 0;
+
+    ASSERT(IsGroupAddress(group));
+    for (int i = 0; i < MaxHosts; i++) {
+	if (inGroup[group - BroadcastAddress][i] && (i != kernel->hostName))
+	    members[count++] = i;
+    }
+    return count;
+}
+
+//----------------------------------------------------------------------
+// Fabric::Arrive
+// 	A packet from another machine has come in.  It reaches the
+//	switch after the latency of the sender's link, waits there for
+//	those ahead of it to go down the link to this machine, then
+//	goes down itself.  If the queue at the switch is already full,
+//	it is dropped.
+//
+//	Packets must be passed in the order they came in; they then
+//	leave the switch in that order.
+//
+//	"from" -- the machine that sent the packet
+//
+// Returns:
+//	When the packet is delivered, or -1 if it is dropped.
+//----------------------------------------------------------------------
+
+int
+Fabric::Arrive(NetworkAddress from)
+{
+    Link *down = &links[kernel->hostName];
+    int packetTime = PacketTime(down);
+    int atSwitch, start, ahead;
+
+    ASSERT((from >= 0) && (from < MaxHosts));
+    atSwitch = kernel->stats->totalTicks + links[from].latency;
+    start = max(atSwitch, downFree);
+    ahead = (start - atSwitch) / packetTime;	// not counting the one
+						// going down now
+    if ((down->queueLimit > 0) && (ahead >= down->queueLimit)) {
+	DEBUG(dbgNet, "Switch dropped packet from " << from);
+	kernel->stats->hostPacketsDropped[from]++;
+	return -1;
+    }
+    kernel->stats->linkQueueTicks += start - atSwitch;
+    kernel->stats->maxLinkQueue = max(kernel->stats->maxLinkQueue, ahead + 1);
+    downFree = start + packetTime;
+    return downFree + down->latency;
+}
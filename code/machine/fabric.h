@@ -0,0 +1,99 @@
+// fabric.h
+//	Data structures to model the network connecting Nachos machines:
+//	each machine has a link of its own to one switch, and each link
+//	has its own latency, bandwidth and queue at the switch.
+//
+//	Every Nachos is a UNIX process with a clock of its own, so the
+//	switch cannot be simulated in any one place.  Instead each machine
+//	models the two halves of its own link.  Sending a packet takes as
+//	long as the link up to the switch needs to carry it.  Receiving,
+//	the machine models the switch's port for the link down to it: the
+//	queue of packets waiting there -- which is where congestion sets
+//	in, when several machines send to one -- the packets dropped when
+//	that queue is full, and the time to carry each one down.  Every
+//	machine reads the same topology, so it also knows the latency of
+//	the link a packet came up.
+//
+//	A topology file (-topo) has a line per machine:
+//
+//		<host> <latency> <bandwidth> [<queue>]
+//
+//	the latency in ticks, the bandwidth in bytes per 1000 ticks, and
+//	the queue the most packets the switch keeps waiting for the link
+//	down to the machine (0, the default, for no limit).  A line for
+//	host "*" applies to every machine not listed.  Lines starting
+//	with '#' are comments.  With no topology, every link carries one
+//	packet per NetworkTime, with no latency and no limit on queueing,
+//	as the network always did.
+//
+//	The file may also define groups of machines, a line each:
+//
+//		group <address> <host> <host> ...
+//
+//	A packet sent to a group's address goes up the sender's link
+//	once, and the switch sends a copy down to every other member.
+//	The address of the group of every machine named in the file is
+//	BroadcastAddress.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FABRIC_H
+#define FABRIC_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "network.h"
+#include "stats.h"
+
+#define MaxGroups	8	// groups a topology can define
+#define BroadcastAddress MaxHosts	// every machine named in it; the
+					// groups are numbered after it
+#define IsGroupAddress(to)	(((to) >= BroadcastAddress) && \
+				 ((to) <= BroadcastAddress + MaxGroups))
+
+// The following class defines the link between one machine and the
+// switch.  It is full duplex, with the same latency and bandwidth
+// each way.
+
+class Link {
+  public:
+    int latency;		// ticks for a packet to cross the link
+    int bandwidth;		// bytes it carries per 1000 ticks
+    int queueLimit;		// packets the switch keeps waiting for
+				// the link down, 0 for no limit
+};
+
+// The following class defines the network as seen from this machine.
+
+class Fabric {
+  public:
+    Fabric(char *topologyFile);	// Read the links from "topologyFile",
+				// or use the default if it is NULL
+
+    int SendTime();		// How long this machine takes to send
+				// one packet
+    int Arrive(NetworkAddress from);
+				// A packet from "from" has come in now;
+				// return when it is delivered, or -1
+				// if the switch drops it
+    int Members(NetworkAddress group, NetworkAddress *members);
+				// Put the other machines in "group" in
+				// "members" (MaxHosts of them), and
+				// return how many there are
+
+  private:
+    Link links[MaxHosts];	// each machine's link to the switch
+    bool inGroup[MaxGroups + 1][MaxHosts];
+				// which are in each group, by address
+				// from BroadcastAddress
+    int downFree;		// when the switch can next start a
+				// packet down to this machine
+
+    int PacketTime(Link *link);	// ticks "link" takes to carry a packet
+};
+
+#endif // FABRIC_H
@@ -0,0 +1,222 @@
+// flash.cc
+//	Routines to simulate a flash disk.  The data is read and written
+//	at once, in the physical disk's UNIX file; only the time each
+//	request takes is simulated, by keeping track of when each channel
+//	is next free.  See flash.h for details.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "flash.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// FlashCommand::FlashCommand
+// 	Describe a request the flash has been given.
+//
+//	"toCall" -- object to call when it is done
+//----------------------------------------------------------------------
+
+FlashCommand::FlashCommand(FlashDisk *device, CallBackObj *toCall)
+{
+    flash = device;
+    callWhenDone = toCall;
+}
+
+//----------------------------------------------------------------------
+// FlashCommand::CallBack
+// 	Called by the machine simulation when the interrupt for the
+//	request occurs.  The flash can take another request, then the
+//	caller is told; the command is no longer needed.
+//----------------------------------------------------------------------
+
+void FlashCommand::CallBack()
+{
+    CallBackObj *toCall = callWhenDone;
+
+    flash->Done();
+    delete this;
+    toCall->CallBack();
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::FlashDisk
+// 	Initialize a simulated flash disk, on the UNIX file of the
+//	physical disk.
+//
+//	"channels" -- how many pages may be worked on at once
+//	"depth" -- how many requests may be outstanding at once
+//----------------------------------------------------------------------
+
+FlashDisk::FlashDisk(int channels, int depth)
+{
+    ASSERT((channels > 0) && (depth > 0));
+
+    DEBUG(dbgDisk, "Initializing the flash, " << channels << " channels.");
+    store = new Disk(NULL); // its requests are never used
+    numChannels = channels;
+    queueDepth = depth;
+    numActive = 0;
+    busyUntil = new int[numChannels];
+    pagesProgrammed = new int[numChannels];
+    for (int i = 0; i < numChannels; i++)
+    {
+        busyUntil[i] = 0;
+        pagesProgrammed[i] = 0;
+    }
+    lastSector = 0;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::~FlashDisk
+// 	Clean up the simulation.
+//----------------------------------------------------------------------
+
+FlashDisk::~FlashDisk()
+{
+    delete store;
+    delete[] busyUntil;
+    delete[] pagesProgrammed;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive sectors.
+//	Do the transfer at once, in the UNIX file, and set up an interrupt
+//	for when the simulation says the request is done.  Other requests
+//	may be made before then, until the queue is full.
+//
+//	"firstSector" -- the first sector to read/write
+//	"count" -- how many sectors
+//	"data" -- data[i] is the buffer for sector firstSector + i
+//	"toCall" -- object to call when the request is done
+//----------------------------------------------------------------------
+
+void FlashDisk::ReadRequest(int firstSector, int count, char **data,
+                            CallBackObj *toCall)
+{
+    int ticks = Latency(firstSector, FALSE, count, TRUE);
+
+    ASSERT(!IsFull());
+    store->ReadSectors(firstSector, count, data);
+    kernel->stats->numDiskReads++;
+    lastSector = firstSector + count - 1;
+    Start(ticks, toCall);
+}
+
+void FlashDisk::WriteRequest(int firstSector, int count, char **data,
+                             CallBackObj *toCall)
+{
+    int ticks = Latency(firstSector, TRUE, count, TRUE);
+
+    ASSERT(!IsFull());
+    store->WriteSectors(firstSector, count, data);
+    kernel->stats->numDiskWrites++;
+    lastSector = firstSector + count - 1;
+    Start(ticks, toCall);
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Discard
+// 	The file system no longer needs the contents of a run of sectors;
+//	give the host storage behind them back.  Done at once.
+//----------------------------------------------------------------------
+
+void FlashDisk::Discard(int firstSector, int count)
+{
+    store->Discard(firstSector, count);
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Start
+// 	A request has been made that will take "ticks": count it as
+//	outstanding, and have "toCall" told when it is done.
+//----------------------------------------------------------------------
+
+void FlashDisk::Start(int ticks, CallBackObj *toCall)
+{
+    numActive++;
+    kernel->interrupt->Schedule(new FlashCommand(this, toCall), ticks,
+                                DiskInt);
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Done
+// 	A request is over; there is room for another.
+//----------------------------------------------------------------------
+
+void FlashDisk::Done()
+{
+    ASSERT(numActive > 0);
+    numActive--;
+}
+
+//----------------------------------------------------------------------
+// FlashDisk::Latency
+// 	Return how long it will take to read/write "count" consecutive
+//	sectors, if the request is made now.
+//
+//	The request is split into pages, each done on the channel it is
+//	on once that channel is free.  Reading a page takes FlashReadTime
+//	to load it, then FlashTransferTime for each sector wanted; writing
+//	one takes the transfer, then FlashProgramTime, after reading the
+//	page first if only part of it is written, and erasing a block
+//	first if the channel's current one is full.  The request is done
+//	when its last page is.
+//
+//	If "record" is set, this is the request the flash is about to
+//	carry out (not an estimate for the I/O scheduler), so the channels
+//	are kept busy until then, and the programs and erases are counted.
+//----------------------------------------------------------------------
+
+int FlashDisk::Latency(int firstSector, bool writing, int count,
+                       bool record)
+{
+    int now = kernel->stats->totalTicks;
+    int done = now + 1; // an interrupt must come later
+    int sector, end = firstSector + count;
+
+    for (sector = firstSector; sector < end; )
+    {
+        int page = sector / FlashPageSectors;
+        int channel = page % numChannels;
+        int pageEnd = min((page + 1) * FlashPageSectors, end);
+        int start = max(now, busyUntil[channel]);
+        int ticks = (pageEnd - sector) * FlashTransferTime;
+
+        if (!writing)
+            ticks += FlashReadTime;
+        else
+        {
+            if (pageEnd - sector < FlashPageSectors)
+                ticks += FlashReadTime; // read the rest of the page
+            ticks += FlashProgramTime;
+            if (pagesProgrammed[channel] == FlashBlockPages)
+            {
+                ticks += FlashEraseTime;
+                if (record)
+                {
+                    pagesProgrammed[channel] = 0;
+                    kernel->stats->numFlashErases++;
+                }
+            }
+            if (record)
+            {
+                pagesProgrammed[channel]++;
+                kernel->stats->numFlashPrograms++;
+            }
+        }
+        if (record)
+            busyUntil[channel] = start + ticks;
+        done = max(done, start + ticks);
+        sector = pageEnd;
+    }
+
+    DEBUG(dbgDisk, "Flash request latency = " << (done - now));
+    return done - now;
+}
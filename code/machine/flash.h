@@ -0,0 +1,115 @@
+// flash.h
+//	Data structures to emulate a flash (solid state) disk.  Like the
+//	physical disk, it accepts requests to read/write runs of sectors,
+//	and the CPU gets an interrupt when each one is satisfied; but it
+//	has no head to move, and it takes several requests at once.
+//
+//	The flash is split into "channels", each able to work on one page
+//	at a time, all of them at once.  Consecutive pages are spread over
+//	the channels in turn, so a long request keeps several busy, and so
+//	do several short requests for different pages.  Up to "queue
+//	depth" requests may be outstanding; each finishes once the last of
+//	its pages is done, perhaps before requests made earlier.
+//
+//	Flash is read and programmed a page at a time, and only erased
+//	(made programmable again) a block of pages at a time.  As in a
+//	flash translation layer, each channel programs the pages written
+//	to it into its current block, in order, rather than in place, and
+//	erases another block when that one is full.  Writing part of a
+//	page reads the rest of it first, to program the whole page.
+//
+//	The sectors are kept in the physical disk's UNIX file (see
+//	disk.h), which holds the same number of them, so that formatting,
+//	-dm, -base and snapshots work the same on either device.
+//
+//	Requests to the flash are not traced, since they overlap.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FLASH_H
+#define FLASH_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "disk.h"
+#include "queued.h"
+
+const int FlashPageSectors = 16;	// sectors per flash page
+const int FlashBlockPages = 64;		// pages per erase block
+
+class FlashDisk;
+
+// The following class defines a request the flash is working on.
+
+class FlashCommand : public CallBackObj {
+  public:
+    FlashCommand(FlashDisk *device, CallBackObj *toCall);
+
+    void CallBack();			// the request is done
+
+  private:
+    FlashDisk *flash;
+    CallBackObj *callWhenDone;		// told when the request is done
+};
+
+// The following class defines a flash disk I/O device.
+
+class FlashDisk : public QueuedDevice {
+  public:
+    FlashDisk(int channels, int depth);	// Create a simulated flash disk,
+					// with "channels" channels, taking
+					// up to "depth" requests at once
+    ~FlashDisk();			// Deallocate the flash disk.
+
+    void ReadRequest(int firstSector, int count, char **data,
+		     CallBackObj *toCall);
+    void WriteRequest(int firstSector, int count, char **data,
+		      CallBackObj *toCall);
+					// Read/write "count" consecutive
+					// sectors.  These routines send a
+					// request to the flash and return
+					// immediately; toCall->CallBack()
+					// is invoked once it is done.
+					// data[i] is the buffer for sector
+					// firstSector + i.
+
+    void Discard(int firstSector, int count);
+					// The contents of these sectors
+					// are no longer needed; see Disk
+
+    bool IsFull() { return (numActive == queueDepth); }
+					// Must a new request wait?
+    bool IsIdle() { return (numActive == 0); }
+    int LastSector() { return lastSector; }
+					// The end of the last request
+
+    int ComputeLatency(int firstSector, bool writing, int count) {
+	return Latency(firstSector, writing, count, FALSE); }
+					// Return how long a request to
+					// "count" sectors from firstSector
+					// would take, made now: waiting
+					// for busy channels included
+
+  private:
+    friend class FlashCommand;
+
+    Disk *store;			// the sectors, in the disk's file
+    int numChannels;
+    int queueDepth;			// most requests outstanding
+    int numActive;			// how many are
+    int *busyUntil;			// when each channel is next free
+    int *pagesProgrammed;		// in each channel's current block
+    int lastSector;
+
+    int Latency(int firstSector, bool writing, int count, bool record);
+    void Start(int ticks, CallBackObj *toCall);
+					// the request takes "ticks"
+    void Done();			// a request is over
+};
+
+#endif // FLASH_H
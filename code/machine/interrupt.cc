@@ -23,13 +23,16 @@
 #include "copyright.h"
 #include "interrupt.h"
 #include "main.h"
+#include "trace.h"
+#include "metrics.h"
 
 // String definitions for debugging messages
 
 static char *intLevelNames[] = {"off", "on"};
 static char *intTypeNames[] = {"timer", "disk", "console write",
                                "console read", "network send",
-                               "network recv"};
+                               "network recv", "alarm", "disk queue",
+                               "metrics"};
 
 //----------------------------------------------------------------------
 // PendingInterrupt::PendingInterrupt
@@ -47,11 +50,16 @@ PendingInterrupt::PendingInterrupt(CallBackObj *callOnInt,
     callOnInterrupt = callOnInt;
     when = time;
     type = kind;
+    order = 0;
+    nextFree = NULL;
+    polledFile = -1;
 }
 
 //----------------------------------------------------------------------
 // PendingCompare
-//	Compare to interrupts based on which should occur first.
+//	Compare to interrupts based on which should occur first.  Of two
+//	due at the same time, the one scheduled first goes first, as it
+//	did when they were kept on a sorted list.
 //----------------------------------------------------------------------
 
 static int
@@ -65,6 +73,10 @@ PendingCompare(PendingInterrupt *x, PendingInterrupt *y)
     {
         return 1;
     }
+    else if (x->order != y->order)
+    {
+        return ((int)(x->order - y->order) < 0) ? -1 : 1; // may wrap
+    }
     else
     {
         return 0;
@@ -81,10 +93,18 @@ PendingCompare(PendingInterrupt *x, PendingInterrupt *y)
 Interrupt::Interrupt()
 {
     level = IntOff;
-    pending = new SortedList<PendingInterrupt *>(PendingCompare);
+    pending = new Heap<PendingInterrupt *>(PendingCompare);
+    freeList = NULL;
+    numScheduled = 0;
+    numQuiet = 0;
+    numPolledFiles = 0;
     inHandler = FALSE;
     yieldOnReturn = FALSE;
     status = SystemMode;
+
+    ASSERT(sizeof(intTypeNames) / sizeof(char *) <= MaxIntTypes);
+    for (unsigned i = 0; i < sizeof(intTypeNames) / sizeof(char *); i++)
+        kernel->stats->intTypeName[i] = intTypeNames[i];
 }
 
 //----------------------------------------------------------------------
@@ -99,6 +119,13 @@ Interrupt::~Interrupt()
         delete pending->RemoveFront();
     }
     delete pending;
+    while (freeList != NULL)
+    {
+        PendingInterrupt *next = freeList->nextFree;
+
+        delete freeList;
+        freeList = next;
+    }
 }
 
 //----------------------------------------------------------------------
@@ -164,11 +191,13 @@ void Interrupt::OneTick()
     {
         stats->totalTicks += SystemTick;
         stats->systemTicks += SystemTick;
+        kernel->currentThread->Account(UsageSystemTicks, SystemTick);
     }
     else
     {
         stats->totalTicks += UserTick;
         stats->userTicks += UserTick;
+        kernel->currentThread->Account(UsageUserTicks, UserTick);
     }
     DEBUG(dbgInt, "== Tick " << stats->totalTicks << " ==");
 
@@ -178,16 +207,54 @@ void Interrupt::OneTick()
         // interrupts disabled)
     CheckIfDue(FALSE);          // check for pending interrupts
     ChangeLevel(IntOff, IntOn); // re-enable interrupts
+    if (Metrics::requested)
+    {   // the host asked for a snapshot
+        kernel->metrics->Snapshot();
+    }
     if (yieldOnReturn)
     {   // if the timer device handler asked
         // for a context switch, ok to do it now
         yieldOnReturn = FALSE;
         status = SystemMode; // yield is a kernel routine
+        kernel->currentThread->preempted = TRUE;
         kernel->currentThread->Yield();
+        kernel->currentThread->preempted = FALSE; // if it kept the CPU
         status = oldStatus;
     }
 }
 
+//----------------------------------------------------------------------
+// Interrupt::TicksUntilDue
+// 	Return how many more user instructions can run, each followed by
+//	OneTick, until OneTick finds the next pending interrupt due; at
+//	least one.  Used to run several instructions and charge their
+//	ticks at once, with interrupts still delivered on the same tick.
+//----------------------------------------------------------------------
+
+int Interrupt::TicksUntilDue()
+{
+    int ticks;
+
+    if (pending->IsEmpty())
+        return 0x7fffffff;
+    ticks = (pending->Front()->when - kernel->stats->totalTicks) / UserTick;
+    return (ticks < 1) ? 1 : ticks;
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SkipTicks
+// 	Charge "count" user ticks without checking for interrupts, as
+//	OneTick would have if no interrupt fell due; the caller keeps
+//	"count" below TicksUntilDue.
+//----------------------------------------------------------------------
+
+void Interrupt::SkipTicks(int count)
+{
+    kernel->stats->totalTicks += count * UserTick;
+    kernel->stats->userTicks += count * UserTick;
+    kernel->currentThread->Account(UsageUserTicks, count * UserTick);
+}
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
@@ -214,12 +281,33 @@ void Interrupt::YieldOnReturn()
 //	simulated time until the next scheduled hardware interrupt.
 //
 //	If there are no pending interrupts, stop.  There's nothing
-//	more for us to do.
+//	more for us to do.  The same goes if only timer interrupts are
+//	pending: the alarm does nothing while the machine is idle.
+//
+//	Simulated time always jumps straight to the next interrupt; the
+//	host is only made to wait when nothing but polls for input (and
+//	timer interrupts) are pending, until there is input to be had.
 //----------------------------------------------------------------------
 void Interrupt::Idle()
 {
     DEBUG(dbgInt, "Machine idling; checking for interrupts.");
     status = IdleMode;
+    if (!pending->IsEmpty() && (numQuiet == pending->NumInHeap()))
+    {
+        // Nothing but polls and timer ticks is pending, and none of
+        // them can give a thread anything to do until some input
+        // arrives.  Rather than spin through polls that will fail,
+        // sleep on the host until there is input; simulated time
+        // goes on as if it had been there all along.  With nothing
+        // even to poll, no thread will ever run again.
+        if (numPolledFiles == 0)
+        {
+            DEBUG(dbgInt, "Machine idle.  Only timer interrupts to do.");
+            Halt();
+        }
+        DEBUG(dbgInt, "Machine idle; waiting for input on the host.");
+        WaitForFiles(polledFiles, numPolledFiles);
+    }
     if (CheckIfDue(TRUE))
     { // check for any pending interrupts
         status = SystemMode;
@@ -243,18 +331,26 @@ void Interrupt::Idle()
 
 //----------------------------------------------------------------------
 // Interrupt::Halt
-// 	Shut down Nachos cleanly, printing out performance statistics.
+// 	Shut down Nachos cleanly, printing out performance statistics
+//	if asked to (-ps), writing the latency histograms out (-hist),
+//	and sending them to the batch runner, if this is one of its jobs
+//	(see threads/batch.h).
 //----------------------------------------------------------------------
 void Interrupt::Halt()
 {
+    if (kernel->printStats)
+        kernel->stats->Print();
+    if (kernel->histogramFile != NULL)
+        kernel->stats->ExportHistograms(kernel->histogramFile);
+    if (kernel->resultFile >= 0)
+        WriteFile(kernel->resultFile, (char *)kernel->stats,
+                  sizeof(Statistics));
     // MP4 mod tag
     /*
     cout << "Machine halting!\n\n";
     cout << "This is halt\n";
     kernel->stats->Print();
 	*/
-    delete debug;
-
     delete kernel; // Never returns.
 }
 
@@ -263,7 +359,9 @@ void Interrupt::Halt()
 // 	Arrange for the CPU to be interrupted when simulated time
 //	reaches "now + when".
 //
-//	Implementation: just put it on a sorted list.
+//	Implementation: put it in a heap, so that the soonest is always
+//	at the front, whatever the number pending.  The PendingInterrupt
+//	is one that has fired before, off the free list, if there is one.
 //
 //	NOTE: the Nachos kernel should not call this routine directly.
 //	Instead, it is only called by the hardware device simulators.
@@ -274,9 +372,46 @@ void Interrupt::Halt()
 //	"type" is the hardware device that generated the interrupt
 //----------------------------------------------------------------------
 void Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
+{
+    SchedulePoll(toCall, fromNow, type, -1);
+}
+
+//----------------------------------------------------------------------
+// Interrupt::SchedulePoll
+// 	Like Schedule, for an interrupt whose handler polls a host file
+//	(the keyboard, a socket) for input.  While the machine is idle
+//	with nothing but polls and timer interrupts pending, it can only
+//	be woken by input, so it waits on the host for input on one of
+//	the polled files, instead of spinning (see Idle).
+//
+//	"fd" -- the host file the handler will poll, or -1 if none
+//----------------------------------------------------------------------
+
+void Interrupt::SchedulePoll(CallBackObj *toCall, int fromNow, IntType type, int fd)
 {
     int when = kernel->stats->totalTicks + fromNow;
-    PendingInterrupt *toOccur = new PendingInterrupt(toCall, when, type);
+    PendingInterrupt *toOccur;
+
+    if (freeList != NULL)
+    {
+        toOccur = freeList;
+        freeList = toOccur->nextFree;
+        toOccur->callOnInterrupt = toCall;
+        toOccur->when = when;
+        toOccur->type = type;
+    }
+    else
+        toOccur = new PendingInterrupt(toCall, when, type);
+    toOccur->order = numScheduled++;
+    toOccur->polledFile = fd;
+    if (fd >= 0)
+    {
+        ASSERT(numPolledFiles < MaxPolledFiles);
+        polledFiles[numPolledFiles++] = fd;
+    }
+    if ((fd >= 0) || (type == TimerInt) || (type == MetricsInt))
+        numQuiet++; // the alarm and snapshots do nothing while the
+                    // machine is idle
 
     DEBUG(dbgInt, "Scheduling interrupt handler the " << intTypeNames[type] << " at time = " << when);
     ASSERT(fromNow > 0);
@@ -299,6 +434,7 @@ void Interrupt::Schedule(CallBackObj *toCall, int fromNow, IntType type)
 bool Interrupt::CheckIfDue(bool advanceClock)
 {
     PendingInterrupt *next;
+    CallBackObj *handler;
     Statistics *stats = kernel->stats;
 
     ASSERT(level == IntOff); // interrupts need to be disabled,
@@ -339,13 +475,45 @@ bool Interrupt::CheckIfDue(bool advanceClock)
     do
     {
         next = pending->RemoveFront();     // pull interrupt off list
-        next->callOnInterrupt->CallBack(); // call the interrupt handler
-        delete next;
+        handler = next->callOnInterrupt;
+        stats->numInterrupts[next->type]++;
+        TRACE(TraceInterrupt, 0, intTypeNames[next->type], 0);
+        Retire(next);                      // before the handler, which
+                                           // may schedule the next poll
+        handler->CallBack();               // call the interrupt handler
     } while (!pending->IsEmpty() && (pending->Front()->when <= stats->totalTicks));
     inHandler = FALSE;
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Interrupt::Retire
+// 	Forget an interrupt that is about to fire, and put it on the free
+//	list, for SchedulePoll to use again.
+//
+//	"fired" -- the interrupt, just taken out of "pending"
+//----------------------------------------------------------------------
+
+void Interrupt::Retire(PendingInterrupt *fired)
+{
+    if (fired->polledFile >= 0)
+    {
+        for (int i = 0; i < numPolledFiles; i++)
+        {
+            if (polledFiles[i] == fired->polledFile)
+            {
+                polledFiles[i] = polledFiles[--numPolledFiles];
+                break;
+            }
+        }
+    }
+    if ((fired->polledFile >= 0) || (fired->type == TimerInt) ||
+        (fired->type == MetricsInt))
+        numQuiet--;
+    fired->nextFree = freeList;
+    freeList = fired;
+}
+
 //----------------------------------------------------------------------
 // PrintPending
 // 	Print information about an interrupt that is scheduled to occur.
@@ -362,7 +530,8 @@ PrintPending(PendingInterrupt *pending)
 //----------------------------------------------------------------------
 // DumpState
 // 	Print the complete interrupt state - the status, and all interrupts
-//	that are scheduled to occur in the future.
+//	that are scheduled to occur in the future (the soonest first,
+//	the rest in no particular order).
 //----------------------------------------------------------------------
 
 void Interrupt::DumpState()
@@ -35,6 +35,7 @@
 
 #include "copyright.h"
 #include "list.h"
+#include "heap.h"
 #include "callback.h"
 
 // Interrupts can be disabled (IntOff) or enabled (IntOn)
@@ -49,7 +50,8 @@ enum MachineStatus {IdleMode, SystemMode, UserMode};
 // In Nachos, we support a hardware timer device, a disk, a console
 // display and keyboard, and a network.
 enum IntType { TimerInt, DiskInt, ConsoleWriteInt, ConsoleReadInt, 
-			NetworkSendInt, NetworkRecvInt};
+			NetworkSendInt, NetworkRecvInt, AlarmInt, DiskQueueInt,
+			MetricsInt};
 
 // The following class defines an interrupt that is scheduled
 // to occur in the future.  The internal data structures are
@@ -66,8 +68,17 @@ class PendingInterrupt {
     
     int when;			// When the interrupt is supposed to fire
     IntType type;		// for debugging
+    unsigned int order;		// how many were scheduled before it;
+				// of those due at the same time, the
+				// first scheduled fires first
+    PendingInterrupt *nextFree;	// next unused one, while on the
+				// free list
+    int polledFile;		// the host file this interrupt will
+				// poll for input, or -1
 };
 
+#define MaxPolledFiles 8	// most polls pending at once
+
 // The following class defines the data structures for the simulation
 // of hardware interrupts.  We record whether interrupts are enabled
 // or disabled, and any hardware interrupts that are scheduled to occur
@@ -102,6 +113,9 @@ class Interrupt {
     void YieldOnReturn();	// cause a context switch on return 
 				// from an interrupt handler
 
+    bool InHandler() { return inHandler; }
+				// Is an interrupt handler running?
+
     MachineStatus getStatus() { return status; } 
     void setStatus(MachineStatus st) { status = st; }
         			// idle, kernel, user
@@ -118,14 +132,29 @@ class Interrupt {
     				// Schedule an interrupt to occur
 				// at time "when".  This is called
     				// by the hardware device simulators.
+    void SchedulePoll(CallBackObj *callTo, int when, IntType type,
+		int fd);	// Schedule an interrupt that polls
+				// host file "fd" for input
     
     void OneTick();       	// Advance simulated time
 
+    int TicksUntilDue();	// user ticks that can pass before the
+				// next pending interrupt is due
+    void SkipTicks(int count);	// advance time by "count" user ticks,
+				// none of which makes an interrupt due
+
   private:
     IntStatus level;		// are interrupts enabled or disabled?
-    SortedList<PendingInterrupt *> *pending;		
-    				// the list of interrupts scheduled
-				// to occur in the future
+    Heap<PendingInterrupt *> *pending;
+    				// the interrupts scheduled to occur
+				// in the future, soonest first
+    PendingInterrupt *freeList;	// ones that have fired, to be reused
+    unsigned int numScheduled;	// interrupts scheduled so far
+    int numQuiet;		// pending timer interrupts and polls,
+				// which cannot wake an idle machine
+				// unless input arrives
+    int polledFiles[MaxPolledFiles]; // files the pending polls are for
+    int numPolledFiles;
     //int writeFileNo;            //UNIX file emulating the display
     bool inHandler;		// TRUE if we are running an interrupt handler
     //bool putBusy;               // Is a PrintInt operation in progress
@@ -139,6 +168,9 @@ class Interrupt {
     bool CheckIfDue(bool advanceClock); 
     				// Check if any interrupts are supposed
 				// to occur now, and if so, do them
+    void Retire(PendingInterrupt *fired);
+				// Put an interrupt that has fired
+				// on the free list
 
     void ChangeLevel(IntStatus old, 	// SetLevel, without advancing the
 			IntStatus now); // simulated time
@@ -50,9 +50,18 @@ static void CheckEndian()
 //
 //	"debug" -- if TRUE, drop into the debugger after each user instruction
 //		is executed.
+//	"blocks" -- if TRUE, run user code a basic block at a time (see
+//		Machine::RunBlock)
+//	"threads" -- if TRUE, dispatch the instructions of a block threaded
+//		(see Machine::RunThreaded)
+//	"batch" -- if TRUE, only check for interrupts when one is due (see
+//		Machine::RunBatch)
+//	"tlbEntries" -- if not 0, translate through a TLB of this many
+//		entries, loaded by the kernel, instead of a page table
 //----------------------------------------------------------------------
 
-Machine::Machine(bool debug)
+Machine::Machine(bool debug, bool blocks, bool threads, bool batch,
+		 int tlbEntries)
 {
     int i;
 
@@ -61,17 +70,33 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
         mainMemory[i] = 0;
-#ifdef USE_TLB
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-        tlb[i].valid = FALSE;
-    pageTable = NULL;
-#else // use linear page table
-    tlb = NULL;
+    if (tlbEntries > 0)
+    {
+        tlb = new TranslationEntry[tlbEntries];
+        for (i = 0; i < tlbEntries; i++)
+        {
+            tlb[i].valid = FALSE;
+            tlb[i].numPages = 1;
+        }
+    }
+    else
+        tlb = NULL; // use linear page table
+    tlbSize = tlbEntries;
+    asid = 0;
     pageTable = NULL;
-#endif
+    FlushTranslations();
 
+    decodeCache = NULL; // allocated by the first Run
+    blockLength = NULL;
+    runBlocks = blocks;
+    threaded = threads;
+    batchTicks = batch;
+    unchargedTicks = runLength = 0;
+    sampleInterval = untilSample = 0;
     singleStep = debug;
+    numBreakpoints = numWatchpoints = 0;
+    stopped = FALSE;
+    resumeFrom = -1;
     CheckEndian();
 }
 
@@ -85,6 +110,19 @@ Machine::~Machine()
     delete[] mainMemory;
     if (tlb != NULL)
         delete[] tlb;
+    DeleteDecodeCache();
+}
+
+//----------------------------------------------------------------------
+// Machine::SetSampling
+// 	Have the profiler sample the user registers every "interval"
+//	instructions (see Machine::ExecuteInstruction); 0 to stop.
+//----------------------------------------------------------------------
+
+void Machine::SetSampling(int interval)
+{
+    sampleInterval = interval;
+    untilSample = interval;
 }
 
 //----------------------------------------------------------------------
@@ -101,6 +139,12 @@ void Machine::RaiseException(ExceptionType which, int badVAddr)
 {
     DEBUG(dbgMach, "Exception: " << exceptionNames[which]);
     registers[BadVAddrReg] = badVAddr;
+    if (unchargedTicks > 0)
+    {
+        // the handler must see the time the interpreter would show
+        kernel->interrupt->SkipTicks(unchargedTicks);
+        unchargedTicks = 0;
+    }
     DelayedLoad(0, 0); // finish anything in progress
     kernel->interrupt->setStatus(SystemMode);
     ExceptionHandler(which); // interrupts are enabled at this point
@@ -114,13 +158,47 @@ void Machine::RaiseException(ExceptionType which, int badVAddr)
 //	It could, but you'd have to implement *a lot* more system calls
 //	to get it to work!
 //
-//	So just allow single-stepping, and printing the contents of memory.
+//	So just allow single-stepping, and printing the contents of memory,
+//	and running on at full speed until a breakpoint or watchpoint is
+//	hit (see Machine::UntilBreakpoint, Machine::Watched).
+//----------------------------------------------------------------------
+
+//----------------------------------------------------------------------
+// AddAddress, RemoveAddress
+// 	Helper functions for the lists of breakpoints and watchpoints:
+//	add "addr" to the "count" addresses in "list", unless it is there
+//	already or the list is full, or take it out.  Return FALSE if
+//	nothing changed.
 //----------------------------------------------------------------------
 
+static bool
+AddAddress(int *list, int *count, int max, int addr)
+{
+    for (int i = 0; i < *count; i++)
+        if (list[i] == addr)
+            return FALSE;
+    if (*count == max)
+        return FALSE;
+    list[(*count)++] = addr;
+    return TRUE;
+}
+
+static bool
+RemoveAddress(int *list, int *count, int addr)
+{
+    for (int i = 0; i < *count; i++)
+        if (list[i] == addr)
+        {
+            list[i] = list[--(*count)];
+            return TRUE;
+        }
+    return FALSE;
+}
+
 void Machine::Debugger()
 {
     char *buf = new char[80];
-    int num;
+    int num, addr;
     bool done = FALSE;
 
     kernel->interrupt->DumpState();
@@ -135,6 +213,7 @@ void Machine::Debugger()
         if (sscanf(buf, "%d", &num) == 1)
         {
             runUntilTime = num;
+            singleStep = TRUE;
             done = TRUE;
         }
         else
@@ -143,17 +222,53 @@ void Machine::Debugger()
             switch (*buf)
             {
             case '\0':
+                singleStep = TRUE;
                 done = TRUE;
                 break;
             case 'c':
                 singleStep = FALSE;
                 done = TRUE;
                 break;
+            case 'b':
+            case 'w':
+            case 'd':
+                if (sscanf(buf + 1, "%i", &addr) != 1)
+                    cout << "Give an address: " << buf << "\n";
+                else if (*buf == 'b')
+                {
+                    if (!AddAddress(breakpoints, &numBreakpoints,
+                                    MaxBreakpoints, addr & ~0x3))
+                        cout << "Already set, or too many breakpoints\n";
+                }
+                else if (*buf == 'w')
+                {
+                    if (!AddAddress(watchpoints, &numWatchpoints,
+                                    MaxWatchpoints, addr & ~0x3))
+                        cout << "Already set, or too many watchpoints\n";
+                    FlushTranslations(); // stores to its page must be seen
+                }
+                else if (!RemoveAddress(breakpoints, &numBreakpoints, addr & ~0x3) &&
+                         !RemoveAddress(watchpoints, &numWatchpoints, addr & ~0x3))
+                    cout << "No breakpoint or watchpoint at " << addr << "\n";
+                else
+                    FlushTranslations();
+                break;
+            case 'l':
+                for (int i = 0; i < numBreakpoints; i++)
+                    cout << "Breakpoint at " << breakpoints[i] << "\n";
+                for (int i = 0; i < numWatchpoints; i++)
+                    cout << "Watchpoint at " << watchpoints[i] << "\n";
+                break;
             case '?':
                 cout << "Machine commands:\n";
                 cout << "    <return>  execute one instruction\n";
                 cout << "    <number>  run until the given timer tick\n";
-                cout << "    c         run until completion\n";
+                cout << "    c         run until a breakpoint or watchpoint is hit,\n";
+                cout << "              or completion\n";
+                cout << "    b <addr>  stop before the instruction at the address\n";
+                cout << "    w <addr>  stop after a store to the word at the address\n";
+                cout << "    d <addr>  delete the breakpoint or watchpoint there\n";
+                cout << "    l         list breakpoints and watchpoints\n";
                 cout << "    ?         print help message\n";
                 break;
             default:
@@ -166,6 +281,57 @@ void Machine::Debugger()
         buf[0] = cin.get();
     }
     delete[] buf;
+    stopped = FALSE;
+    resumeFrom = registers[PCReg];
+}
+
+//----------------------------------------------------------------------
+// Machine::UntilBreakpoint
+// 	Return how many of the next "length" instructions, straight on
+//	from the PC, can run before one with a breakpoint; if none can,
+//	note that the debugger is to be entered.  The breakpoint the
+//	debugger just returned at is let through, once.
+//
+//	Only called while there are breakpoints, once a block by the
+//	block engine, so code runs at full speed between them.
+//----------------------------------------------------------------------
+
+int Machine::UntilBreakpoint(int length)
+{
+    int pc = registers[PCReg];
+    int until = length;
+
+    if (pc != resumeFrom)
+        resumeFrom = -1;
+    for (int i = 0; i < numBreakpoints; i++)
+    {
+        int ahead = breakpoints[i] - pc;
+
+        if ((ahead >= 0) && (ahead / 4 < until) && (breakpoints[i] != resumeFrom))
+            until = ahead / 4;
+    }
+    if (until == 0)
+    {
+        cout << "Breakpoint at " << pc << "\n";
+        stopped = TRUE;
+    }
+    return until;
+}
+
+//----------------------------------------------------------------------
+// Machine::Watched
+// 	Return TRUE if any of the "size" bytes at "virtAddr" is in a
+//	watched word.  Translate asks for every store, while there are
+//	watchpoints, and keeps no fast translation for storing to a page
+//	with one, so stores to other pages run at full speed.
+//----------------------------------------------------------------------
+
+bool Machine::Watched(int virtAddr, int size)
+{
+    for (int i = 0; i < numWatchpoints; i++)
+        if ((watchpoints[i] < virtAddr + size) && (virtAddr < watchpoints[i] + 4))
+            return TRUE;
+    return FALSE;
 }
 
 //----------------------------------------------------------------------
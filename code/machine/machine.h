@@ -38,7 +38,14 @@ const int PageSize = 128; // set the page size equal to
 const int NumPhysPages = 128;
 
 const int MemorySize = (NumPhysPages * PageSize);
-const int TLBSize = 4; // if there is a TLB, make it small
+const int NumFastTranslations = 64; // recent translations kept by the
+			// simulator; a power of 2
+const int TLBSize = 4; // if there is a TLB, make it small (the
+			// size with USE_TLB, unless -tlb says otherwise)
+const int MaxSuperPage = 16; // most pages one TLB entry can map; a
+			// power of 2
+const int MaxBreakpoints = 8; // code addresses the debugger can stop at
+const int MaxWatchpoints = 8; // words it can watch for stores to
 
 enum ExceptionType
 {
@@ -96,8 +103,13 @@ class Interrupt;
 class Machine
 {
 public:
-	Machine(bool debug); // Initialize the simulation of the hardware
-		// for running user programs
+	Machine(bool debug, bool blocks, bool threads, bool batch,
+			int tlbEntries);
+		// Initialize the simulation of the hardware for running
+		// user programs; "blocks" selects the basic block engine
+		// over the reference interpreter, and "threads" threaded
+		// dispatch in it; with "tlbEntries" > 0,
+		// addresses are translated through a TLB that big
 	~Machine(); // De-allocate the data structures
 
 	// Routines callable by the Nachos kernel
@@ -137,6 +149,9 @@ public:
 
 	TranslationEntry *tlb; // this pointer should be considered
 						   // "read-only" to Nachos kernel code
+	int tlbSize;		   // number of entries in the TLB
+	int asid;			   // only TLB entries with this address space
+						   // id are used
 
 	TranslationEntry *pageTable;
 	unsigned int pageTableSize;
@@ -146,13 +161,50 @@ public:
 	// Read or write 1, 2, or 4 bytes of virtual
 	// memory (at addr).  Return FALSE if a
 	// correct translation couldn't be found.
+	inline bool ReadWord(int addr, int *value);
+	inline bool WriteWord(int addr, int value);
+	// The same for 4 bytes, with a fast path
+	// for a page translated just before
+
+	void FlushTranslations();
+	// Forget the translations cached by
+	// Translate; call whenever the page
+	// table in use, or any entry in it,
+	// is changed (use and dirty bits too)
+
+	void SetSampling(int interval);
+	// Pass the registers to the profiler
+	// every "interval" instructions run
 private:
 	// Routines internal to the machine simulation -- DO NOT call these directly
 	void DelayedLoad(int nextReg, int nextVal);
 	// Do a pending delayed load (modifying a reg)
 
-	void OneInstruction(Instruction *instr);
-	// Run one instruction of a user program.
+	bool OneInstruction(Instruction *instr);
+	// Run one instruction of a user program;
+	// FALSE if it raised an exception
+	void RunBatch(Instruction *instr);
+	// Run instructions up to the next
+	// interrupt, charging their ticks at once
+	bool ExecuteInstruction(Instruction *instr);
+	// Carry out a decoded instruction; FALSE
+	// if it raised an exception
+
+	void RunBlock();
+	// Run the basic block at the PC (or as
+	// much of it as can run before the next
+	// interrupt), charging its ticks at once
+	bool RunDecoded(int physAddr);
+	bool RunThreaded(int physAddr);
+	// Run the first runLength instructions
+	// of a block, by
+	// switch or by threaded dispatch; FALSE
+	// if one raised an exception
+	void Retire(Instruction *instr, int nextLoadReg, int nextLoadValue,
+				int pcAfter);
+	// Finish an instruction that ran
+	int BlockLength(int physAddr);
+	// Instructions in the block starting there
 
 	ExceptionType Translate(int virtAddr, int *physAddr, int size, bool writing);
 	// Translate an address, and check for
@@ -166,16 +218,52 @@ private:
 	// system call or other exception.
 
 	void Debugger();  // invoke the user program debugger
+	int UntilBreakpoint(int length);
+	// How many of the next "length"
+	// instructions can run before one
+	// at a breakpoint
+	bool Watched(int virtAddr, int size);
+	// Is a watched word among these bytes?
 	void DumpState(); // print the user CPU and memory state
 
+	void DeleteDecodeCache(); // free "decodeCache"
+
 	// Internal data structures
 
 	int registers[NumTotalRegs]; // CPU registers, for executing user programs
 
+	Instruction *decodeCache; // the last instruction decoded from each
+		// word of physical memory, so that code run
+		// over and over is decoded only once
+	int *blockLength; // for the block engine: instructions in the
+		// basic block starting at each word, or 0 if unknown
+	bool runBlocks;	  // use the block engine
+	bool threaded;	  // and dispatch its instructions threaded
+	bool batchTicks;  // check for interrupts only when one is due
+	int unchargedTicks; // instructions RunBlock or RunBatch has run
+		// but not yet charged for
+	int runLength; // instructions they are to run; cut short to
+		// stop after the one running
+	FastTranslation fastTranslations[NumFastTranslations];
+		// page table translations just done, by virtual page
+
+	int sampleInterval; // instructions between profiler samples,
+		// 0 if not profiling
+	int untilSample; // instructions left before the next sample
+
 	bool singleStep; // drop back into the debugger after each
 		// simulated instruction
 	int runUntilTime; // drop back into the debugger when simulated
 		// time reaches this value
+	int breakpoints[MaxBreakpoints]; // stop before running the
+		// instruction at one of these addresses
+	int numBreakpoints;
+	int watchpoints[MaxWatchpoints]; // stop after a store to the
+		// word at one of these addresses
+	int numWatchpoints;
+	bool stopped; // one of them was hit: drop into the debugger
+	int resumeFrom; // the breakpoint the debugger last returned
+		// at, which does not stop us again straight away
 
 	friend class Interrupt; // calls DelayedLoad()
 };
@@ -187,7 +275,9 @@ extern void ExceptionHandler(ExceptionType which);
 
 // Routines for converting Words and Short Words to and from the
 // simulated machine's format of little endian.  If the host machine
-// is little endian (DEC and Intel), these end up being NOPs.
+// is little endian (DEC and Intel), these end up being NOPs -- which
+// is chosen at compile time, so that they cost nothing inline, on
+// every instruction fetched and every word loaded or stored.
 //
 // What is stored in each format:
 //	host byte ordering:
@@ -196,9 +286,69 @@ extern void ExceptionHandler(ExceptionType which);
 //	simulated machine byte ordering:
 //	   contents of main memory
 
-unsigned int WordToHost(unsigned int word);
-unsigned short ShortToHost(unsigned short shortword);
-unsigned int WordToMachine(unsigned int word);
-unsigned short ShortToMachine(unsigned short shortword);
+inline unsigned int
+WordToHost(unsigned int word)
+{
+#ifdef HOST_IS_BIG_ENDIAN
+	return ((word >> 24) & 0x000000ff) | ((word >> 8) & 0x0000ff00) |
+		   ((word << 8) & 0x00ff0000) | ((word << 24) & 0xff000000);
+#else
+	return word;
+#endif /* HOST_IS_BIG_ENDIAN */
+}
+
+inline unsigned short
+ShortToHost(unsigned short shortword)
+{
+#ifdef HOST_IS_BIG_ENDIAN
+	return ((shortword << 8) & 0xff00) | ((shortword >> 8) & 0x00ff);
+#else
+	return shortword;
+#endif /* HOST_IS_BIG_ENDIAN */
+}
+
+inline unsigned int
+WordToMachine(unsigned int word) { return WordToHost(word); }
+
+inline unsigned short
+ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
+
+//----------------------------------------------------------------------
+// Machine::ReadWord
+// Machine::WriteWord
+// 	Read or write the 4 bytes of virtual memory at "addr", as ReadMem
+//	and WriteMem do with "size" 4.  When the address is aligned, and
+//	its page was translated just before (see Machine::Translate), with
+//	nothing to check or change in its entry, the word is simply loaded
+//	from or stored to mainMemory -- on a little endian host, a single
+//	32-bit load or store.  Everything else, exceptions included, goes
+//	through ReadMem and WriteMem.
+//----------------------------------------------------------------------
+
+inline bool
+Machine::ReadWord(int addr, int *value)
+{
+	unsigned int vpn = (unsigned)addr / PageSize;
+	FastTranslation *fast = &fastTranslations[vpn & (NumFastTranslations - 1)];
+
+	if ((fast->virtualPage != (int)vpn) || (addr & 0x3))
+		return ReadMem(addr, 4, value);
+	*value = (int)WordToHost(*(unsigned int *)
+			&mainMemory[fast->frameAddress + (unsigned)addr % PageSize]);
+	return TRUE;
+}
+
+inline bool
+Machine::WriteWord(int addr, int value)
+{
+	unsigned int vpn = (unsigned)addr / PageSize;
+	FastTranslation *fast = &fastTranslations[vpn & (NumFastTranslations - 1)];
+
+	if ((fast->virtualPage != (int)vpn) || !fast->writable || (addr & 0x3))
+		return WriteMem(addr, 4, value);
+	*(unsigned int *)&mainMemory[fast->frameAddress + (unsigned)addr % PageSize] =
+		WordToMachine((unsigned int)value);
+	return TRUE;
+}
 
 #endif // MACHINE_H
@@ -20,6 +20,7 @@
 #include "machine.h"
 #include "mipssim.h"
 #include "main.h"
+#include "profiler.h"
 
 static void Mult(int a, int b, bool signedArith, int *hiPtr, int *loPtr);
 
@@ -40,6 +41,7 @@ public:
 	char opCode;	 // Type of instruction.  This is NOT the same as the
 					 // opcode field from the instruction: see defs in mips.h
 	char rs, rt, rd; // Three registers from instruction.
+	char opClass;	 // Kind of instruction, for statistics (InstrClass)
 	int extra;		 // Immediate or target or shamt field or offset.
 					 // Immediates are sign-extended.
 };
@@ -57,6 +59,19 @@ void Machine::Run()
 {
 	Instruction *instr = new Instruction; // storage for decoded instruction
 
+	if (decodeCache == NULL)
+	{
+		decodeCache = new Instruction[MemorySize / 4];
+		for (int i = 0; i < MemorySize / 4; i++)
+		{
+			decodeCache[i].value = 0; // what memory holds after a reset
+			decodeCache[i].Decode();
+		}
+		blockLength = new int[MemorySize / 4];
+		for (int i = 0; i < MemorySize / 4; i++)
+			blockLength[i] = 0;
+	}
+
 	if (debug->IsEnabled('m'))
 	{
 		cout << "Starting program in thread: " << kernel->currentThread->getName();
@@ -65,13 +80,217 @@ void Machine::Run()
 	kernel->interrupt->setStatus(UserMode);
 	for (;;)
 	{
-		OneInstruction(instr);
-		kernel->interrupt->OneTick();
-		if (singleStep && (runUntilTime <= kernel->stats->totalTicks))
+		if (runBlocks && !singleStep && !debug->IsEnabled('m'))
+			RunBlock();
+		else if (batchTicks && !singleStep)
+			RunBatch(instr);
+		else if ((numBreakpoints == 0) || (UntilBreakpoint(1) > 0))
+		{
+			OneInstruction(instr);
+			kernel->interrupt->OneTick();
+		}
+		if (stopped || (singleStep && (runUntilTime <= kernel->stats->totalTicks)))
 			Debugger();
 	}
 }
 
+//----------------------------------------------------------------------
+// Machine::DeleteDecodeCache
+// 	Free the decoded instructions; here, where class Instruction is
+//	known.
+//----------------------------------------------------------------------
+
+void Machine::DeleteDecodeCache()
+{
+	delete[] decodeCache;
+	decodeCache = NULL;
+	delete[] blockLength;
+	blockLength = NULL;
+}
+
+//----------------------------------------------------------------------
+// HasDelaySlot
+// 	Return TRUE for a branch or jump: the instruction after it still
+//	runs, and then the PC may go anywhere.
+//----------------------------------------------------------------------
+
+static bool
+HasDelaySlot(int opCode)
+{
+	return (opCode >= OP_BEQ && opCode <= OP_BNE) ||
+		   (opCode >= OP_J && opCode <= OP_JR);
+}
+
+//----------------------------------------------------------------------
+// Machine::BlockLength
+// 	Return the number of instructions in the basic block starting at
+//	physical address "physAddr", finding it the first time: it runs to
+//	the first branch or jump and its delay slot, but never past the
+//	end of the page, since the next virtual page may be anywhere.  The
+//	instructions are decoded into decodeCache on the way.
+//----------------------------------------------------------------------
+
+int Machine::BlockLength(int physAddr)
+{
+	int length = blockLength[physAddr / 4];
+	int pageEnd = (physAddr / PageSize + 1) * PageSize;
+
+	if (length > 0)
+		return length;
+	for (int at = physAddr; at < pageEnd; at += 4)
+	{
+		Instruction *decoded = &decodeCache[at / 4];
+		unsigned int raw = WordToHost(*(unsigned int *)&mainMemory[at]);
+
+		if (decoded->value != raw)
+		{
+			decoded->value = raw;
+			decoded->Decode();
+			kernel->stats->cpuDecodes[kernel->currentThread->cpu]++;
+		}
+		length++;
+		if (HasDelaySlot(decoded->opCode))
+		{
+			if (at + 4 < pageEnd)
+				length++;
+			break;
+		}
+		if (decoded->opCode == OP_SYSCALL || decoded->opCode == OP_RES ||
+			decoded->opCode == OP_UNIMP)
+			break; // always traps
+	}
+	blockLength[physAddr / 4] = length;
+	return length;
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBatch
+// 	Run instructions one at a time, as OneInstruction followed by
+//	OneTick would, but only look for interrupts when the next one is
+//	due: every instruction before it is just counted, and its ticks
+//	charged in one go.
+//
+//	An instruction that traps ends the batch, because the kernel may
+//	schedule new interrupts, or switch to another thread; the ticks of
+//	those before it are charged by RaiseException, so the kernel sees
+//	the same clock as without batching.  So does reaching a breakpoint,
+//	or a store to a watched word.
+//----------------------------------------------------------------------
+
+void Machine::RunBatch(Instruction *instr)
+{
+	runLength = kernel->interrupt->TicksUntilDue();
+	unchargedTicks = 0;
+	for (int done = 0; done < runLength; done++)
+	{
+		if ((numBreakpoints > 0) && (UntilBreakpoint(1) == 0))
+			break;
+		if (!OneInstruction(instr))
+		{
+			kernel->interrupt->OneTick();
+			return;
+		}
+		unchargedTicks++;
+	}
+	if (unchargedTicks > 0)
+	{
+		kernel->interrupt->SkipTicks(unchargedTicks - 1);
+		unchargedTicks = 0;
+		kernel->interrupt->OneTick();
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::RunBlock
+// 	The block engine: run the basic block at the PC straight through,
+//	out of decodeCache, translating the PC only once, and charge the
+//	ticks of all its instructions in one go.
+//
+//	Results are exactly those of OneInstruction followed by OneTick,
+//	instruction by instruction:
+//	   the block is cut short where the next interrupt falls due, so
+//		it still happens after the same instruction;
+//	   an instruction that traps ends the block, and the ticks of those
+//		before it are charged (by RaiseException) before the kernel
+//		sees the clock;
+//	   each word is checked against memory before it is run, so code
+//		that was changed is decoded again, and the block found anew;
+//	   the block is cut short before a breakpoint, or just after a
+//		store to a watched word, for the debugger.
+//
+//	The instructions are dispatched either one by one through the
+//	reference interpreter's switch (RunDecoded), or with "threaded",
+//	each straight to the next (RunThreaded); the results are the same.
+//----------------------------------------------------------------------
+
+void Machine::RunBlock()
+{
+	int start = registers[PCReg];
+	int physicalAddress, length;
+	ExceptionType exception;
+
+	DEBUG(dbgAddr, "Running block at VA " << start);
+	exception = Translate(start, &physicalAddress, 4, FALSE);
+	if (exception != NoException)
+	{
+		RaiseException(exception, start);
+		kernel->interrupt->OneTick();
+		return;
+	}
+	length = min(BlockLength(physicalAddress), kernel->interrupt->TicksUntilDue());
+	if ((numBreakpoints > 0) && ((length = UntilBreakpoint(length)) == 0))
+		return; // Run enters the debugger
+
+	runLength = length;
+	unchargedTicks = 0;
+	if (!(threaded ? RunThreaded(physicalAddress)
+				   : RunDecoded(physicalAddress)))
+	{
+		// RaiseException charged the instructions before the one
+		// that trapped
+		kernel->interrupt->OneTick();
+		return;
+	}
+	if (unchargedTicks > 0)
+	{
+		kernel->interrupt->SkipTicks(unchargedTicks - 1);
+		unchargedTicks = 0;
+		kernel->interrupt->OneTick();
+	}
+}
+
+//----------------------------------------------------------------------
+// Machine::RunDecoded
+// 	Run up to runLength instructions of the block at "physAddr", which
+//	starts at the PC, through ExecuteInstruction, counting each in
+//	unchargedTicks.  Stop early where a branch was taken, or the code
+//	was changed, or runLength was cut.  Return FALSE if an instruction
+//	raised an exception.
+//----------------------------------------------------------------------
+
+bool Machine::RunDecoded(int physAddr)
+{
+	int start = registers[PCReg];
+
+	for (int done = 0; done < runLength; done++)
+	{
+		int at = physAddr + 4 * done;
+		Instruction *decoded = &decodeCache[at / 4];
+
+		if (registers[PCReg] != start + 4 * done)
+			break; // a branch was taken
+		if (decoded->value != WordToHost(*(unsigned int *)&mainMemory[at]))
+		{
+			blockLength[physAddr / 4] = 0; // code was changed
+			break;
+		}
+		if (!ExecuteInstruction(decoded))
+			return FALSE;
+		unchargedTicks++;
+	}
+	return TRUE;
+}
+
 //----------------------------------------------------------------------
 // TypeToReg
 // 	Retrieve the register # referred to in an instruction.
@@ -97,7 +316,8 @@ TypeToReg(RegType reg, Instruction *instr)
 
 //----------------------------------------------------------------------
 // Machine::OneInstruction
-// 	Execute one instruction from a user-level program
+// 	Execute one instruction from a user-level program.  Return FALSE
+//	if it raised an exception.
 //
 // 	If there is any kind of exception or interrupt, we invoke the
 //	exception handler, and when it returns, we return to Run(), which
@@ -116,25 +336,88 @@ TypeToReg(RegType reg, Instruction *instr)
 //	leaving.  This allows the Nachos kernel to control our behavior
 //	by controlling the contents of memory, the translation table,
 //	and the register set.
+//
+//	The one exception is the decoded instruction cache, which only
+//	saves work: the instruction fetched is still translated (so page
+//	faults and use bits are as before), but it is decoded again only
+//	if the word in memory differs from the one decoded last time from
+//	that physical address.  Comparing the word itself, instead of
+//	watching for stores, also catches code the kernel writes straight
+//	into mainMemory, such as a newly loaded program.
+//----------------------------------------------------------------------
+
+bool Machine::OneInstruction(Instruction *instr)
+{
+	unsigned int raw;
+	int physicalAddress;
+	ExceptionType exception;
+	Instruction *decoded;
+
+	// Fetch instruction, decoding it unless memory still holds the
+	// word decoded from there last time
+	DEBUG(dbgAddr, "Fetching instruction at VA " << registers[PCReg]);
+	exception = Translate(registers[PCReg], &physicalAddress, 4, FALSE);
+	if (exception != NoException)
+	{
+		RaiseException(exception, registers[PCReg]);
+		return FALSE;
+	}
+	raw = WordToHost(*(unsigned int *)&mainMemory[physicalAddress]);
+	decoded = &decodeCache[physicalAddress / 4];
+	if (decoded->value != raw)
+	{
+		decoded->value = raw;
+		decoded->Decode();
+		kernel->stats->cpuDecodes[kernel->currentThread->cpu]++;
+	}
+	*instr = *decoded;
+	return ExecuteInstruction(instr);
+}
+
+//----------------------------------------------------------------------
+// Machine::Retire
+// 	Finish an instruction that ran without an exception: count it,
+//	pass the registers to the profiler if a sample is due, do any
+//	delayed load, and advance the program counters.
 //----------------------------------------------------------------------
 
-void Machine::OneInstruction(Instruction *instr)
+inline void Machine::Retire(Instruction *instr, int nextLoadReg,
+							int nextLoadValue, int pcAfter)
+{
+	kernel->stats->numInstrs[instr->opClass]++;
+	if ((sampleInterval > 0) && (--untilSample == 0))
+	{
+		untilSample = sampleInterval;
+		kernel->profiler->Sample(registers);
+	}
+
+	// Do any delayed load operation
+	DelayedLoad(nextLoadReg, nextLoadValue);
+
+	// Advance program counters.
+	registers[PrevPCReg] = registers[PCReg]; // for debugging, in case we
+											 // are jumping into lala-land
+	registers[PCReg] = registers[NextPCReg];
+	registers[NextPCReg] = pcAfter;
+}
+
+//----------------------------------------------------------------------
+// Machine::ExecuteInstruction
+// 	Carry out one decoded instruction, found at registers[PCReg].
+//	Return FALSE if it raised an exception, in which case the kernel's
+//	handler has already run and the PC may be anywhere.
+//----------------------------------------------------------------------
+
+bool Machine::ExecuteInstruction(Instruction *instr)
 {
 #ifdef SIM_FIX
 	int byte; // described in Kane for LWL,LWR,...
 #endif
 
-	int raw;
 	int nextLoadReg = 0;
 	int nextLoadValue = 0; // record delayed load operation, to apply
 		// in the future
 
-	// Fetch instruction
-	if (!ReadMem(registers[PCReg], 4, &raw))
-		return; // exception occurred
-	instr->value = raw;
-	instr->Decode();
-
 	if (debug->IsEnabled('m'))
 	{
 		struct OpString *str = &opStrings[instr->opCode];
@@ -155,572 +438,198 @@ void Machine::OneInstruction(Instruction *instr)
 	// Execute the instruction (cf. Kane's book)
 	switch (instr->opCode)
 	{
+#define OPCODE(op) case op:
+#define NEXT break
+#include "mipsops.cc"
+#undef OPCODE
+#undef NEXT
 
-	case OP_ADD:
-		sum = registers[instr->rs] + registers[instr->rt];
-		if (!((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
-			((registers[instr->rs] ^ sum) & SIGN_BIT))
-		{
-			RaiseException(OverflowException, 0);
-			return;
-		}
-		registers[instr->rd] = sum;
-		break;
-
-	case OP_ADDI:
-		sum = registers[instr->rs] + instr->extra;
-		if (!((registers[instr->rs] ^ instr->extra) & SIGN_BIT) &&
-			((instr->extra ^ sum) & SIGN_BIT))
-		{
-			RaiseException(OverflowException, 0);
-			return;
-		}
-		registers[instr->rt] = sum;
-		break;
+	default:
+		ASSERT(FALSE);
+	}
 
-	case OP_ADDIU:
-		registers[instr->rt] = registers[instr->rs] + instr->extra;
-		break;
+	// Now we have successfully executed the instruction.
+	Retire(instr, nextLoadReg, nextLoadValue, pcAfter);
+	return TRUE;
+}
 
-	case OP_ADDU:
-		registers[instr->rd] = registers[instr->rs] + registers[instr->rt];
-		break;
+#ifdef __GNUC__
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Run the block at "physAddr" as RunDecoded does, but with threaded
+//	dispatch: the code for each opcode (see mipsops.cc) is a label,
+//	found through a table of their addresses, and each jumps straight
+//	to the code for the next instruction, rather than back to one
+//	switch.  With an indirect jump at the end of every opcode's code,
+//	the host's branch predictor can learn which opcode tends to follow
+//	which.
+//
+//	Needs GCC's labels as values ("&&label", "goto *").
+//----------------------------------------------------------------------
 
-	case OP_AND:
-		registers[instr->rd] = registers[instr->rs] & registers[instr->rt];
-		break;
+#define HANDLER(op) handlers[op] = &&L_##op
 
-	case OP_ANDI:
-		registers[instr->rt] = registers[instr->rs] & (instr->extra & 0xffff);
-		break;
+bool Machine::RunThreaded(int physAddr)
+{
+	static void *handlers[MaxOpcode + 1];
+	static bool filled = FALSE;
+	int start = registers[PCReg];
+	Instruction *instr = &decodeCache[physAddr / 4];
+	int done = 0;
+#ifdef SIM_FIX
+	int byte;
+#endif
+	int nextLoadReg, nextLoadValue, pcAfter;
+	int sum, diff, tmp, value;
+	unsigned int rs, rt, imm;
 
-	case OP_BEQ:
-		if (registers[instr->rs] == registers[instr->rt])
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+	if (!filled)
+	{
+		for (int i = 0; i <= MaxOpcode; i++)
+			handlers[i] = &&Unknown;
+		HANDLER(OP_ADD); HANDLER(OP_ADDI); HANDLER(OP_ADDIU);
+		HANDLER(OP_ADDU); HANDLER(OP_AND); HANDLER(OP_ANDI);
+		HANDLER(OP_BEQ); HANDLER(OP_BGEZ); HANDLER(OP_BGEZAL);
+		HANDLER(OP_BGTZ); HANDLER(OP_BLEZ); HANDLER(OP_BLTZ);
+		HANDLER(OP_BLTZAL); HANDLER(OP_BNE); HANDLER(OP_DIV);
+		HANDLER(OP_DIVU); HANDLER(OP_J); HANDLER(OP_JAL);
+		HANDLER(OP_JALR); HANDLER(OP_JR); HANDLER(OP_LB);
+		HANDLER(OP_LBU); HANDLER(OP_LH); HANDLER(OP_LHU);
+		HANDLER(OP_LUI); HANDLER(OP_LW); HANDLER(OP_LWL);
+		HANDLER(OP_LWR); HANDLER(OP_MFHI); HANDLER(OP_MFLO);
+		HANDLER(OP_MTHI); HANDLER(OP_MTLO); HANDLER(OP_MULT);
+		HANDLER(OP_MULTU); HANDLER(OP_NOR); HANDLER(OP_OR);
+		HANDLER(OP_ORI); HANDLER(OP_SB); HANDLER(OP_SH);
+		HANDLER(OP_SLL); HANDLER(OP_SLLV); HANDLER(OP_SLT);
+		HANDLER(OP_SLTI); HANDLER(OP_SLTIU); HANDLER(OP_SLTU);
+		HANDLER(OP_SRA); HANDLER(OP_SRAV); HANDLER(OP_SRL);
+		HANDLER(OP_SRLV); HANDLER(OP_SUB); HANDLER(OP_SUBU);
+		HANDLER(OP_SW); HANDLER(OP_SWL); HANDLER(OP_SWR);
+		HANDLER(OP_SYSCALL); HANDLER(OP_XOR); HANDLER(OP_XORI);
+		HANDLER(OP_RES); HANDLER(OP_UNIMP);
+		filled = TRUE;
+	}
 
-	case OP_BGEZAL:
-		registers[R31] = registers[NextPCReg] + 4;
-	case OP_BGEZ:
-		if (!(registers[instr->rs] & SIGN_BIT))
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+// Go on to instruction "done" of the block, as RunDecoded would.
+#define DISPATCH                                                         \
+	if ((registers[PCReg] != start + 4 * done) ||                        \
+		(instr->value !=                                                 \
+		 WordToHost(*(unsigned int *)&mainMemory[physAddr + 4 * done]))) \
+		goto Stop;                                                       \
+	nextLoadReg = nextLoadValue = 0;                                     \
+	pcAfter = registers[NextPCReg] + 4;                                  \
+	goto *handlers[(int)instr->opCode]
+
+#define OPCODE(op) L_##op:
+#define NEXT                                                \
+	{                                                       \
+		Retire(instr, nextLoadReg, nextLoadValue, pcAfter); \
+		unchargedTicks++;                                   \
+		instr++;                                            \
+		if (++done >= runLength)                            \
+			return TRUE;                                    \
+		DISPATCH;                                           \
+	}
 
-	case OP_BGTZ:
-		if (registers[instr->rs] > 0)
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+	DISPATCH;
+#include "mipsops.cc"
+#undef OPCODE
+#undef NEXT
+#undef DISPATCH
 
-	case OP_BLEZ:
-		if (registers[instr->rs] <= 0)
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+Unknown:
+	ASSERT(FALSE);
+	return FALSE;
 
-	case OP_BLTZAL:
-		registers[R31] = registers[NextPCReg] + 4;
-	case OP_BLTZ:
-		if (registers[instr->rs] & SIGN_BIT)
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+Stop:
+	if (registers[PCReg] == start + 4 * done)
+		blockLength[physAddr / 4] = 0; // not a branch: code was changed
+	return TRUE;
+}
 
-	case OP_BNE:
-		if (registers[instr->rs] != registers[instr->rt])
-			pcAfter = registers[NextPCReg] + IndexToAddr(instr->extra);
-		break;
+#undef HANDLER
+#else
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Without GCC's labels as values, the same as RunDecoded.
+//----------------------------------------------------------------------
 
-	case OP_DIV:
-		if (registers[instr->rt] == 0)
-		{
-			registers[LoReg] = 0;
-			registers[HiReg] = 0;
-		}
-		else
-		{
-			registers[LoReg] = registers[instr->rs] / registers[instr->rt];
-			registers[HiReg] = registers[instr->rs] % registers[instr->rt];
-		}
-		break;
+bool Machine::RunThreaded(int physAddr)
+{
+	return RunDecoded(physAddr);
+}
+#endif
 
-	case OP_DIVU:
-		rs = (unsigned int)registers[instr->rs];
-		rt = (unsigned int)registers[instr->rt];
-		if (rt == 0)
-		{
-			registers[LoReg] = 0;
-			registers[HiReg] = 0;
-		}
-		else
-		{
-			tmp = rs / rt;
-			registers[LoReg] = (int)tmp;
-			tmp = rs % rt;
-			registers[HiReg] = (int)tmp;
-		}
-		break;
+//----------------------------------------------------------------------
+// Machine::DelayedLoad
+// 	Simulate effects of a delayed load.
+//
+// 	NOTE -- RaiseException/CheckInterrupts must also call DelayedLoad,
+//	since any delayed load must get applied before we trap to the kernel.
+//----------------------------------------------------------------------
 
-	case OP_JAL:
-		registers[R31] = registers[NextPCReg] + 4;
-	case OP_J:
-		pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(instr->extra);
-		break;
+void Machine::DelayedLoad(int nextReg, int nextValue)
+{
+	registers[registers[LoadReg]] = registers[LoadValueReg];
+	registers[LoadReg] = nextReg;
+	registers[LoadValueReg] = nextValue;
+	registers[0] = 0; // and always make sure R0 stays zero.
+}
 
-	case OP_JALR:
-		registers[instr->rd] = registers[NextPCReg] + 4;
-	case OP_JR:
-		pcAfter = registers[instr->rs];
-		break;
+//----------------------------------------------------------------------
+// ClassOf
+// 	Return the kind of instruction an opcode is, for statistics.
+//----------------------------------------------------------------------
 
+static InstrClass
+ClassOf(int opCode)
+{
+	switch (opCode)
+	{
 	case OP_LB:
 	case OP_LBU:
-		tmp = registers[instr->rs] + instr->extra;
-		if (!ReadMem(tmp, 1, &value))
-			return;
-
-		if ((value & 0x80) && (instr->opCode == OP_LB))
-			value |= 0xffffff00;
-		else
-			value &= 0xff;
-		nextLoadReg = instr->rt;
-		nextLoadValue = value;
-		break;
-
 	case OP_LH:
 	case OP_LHU:
-		tmp = registers[instr->rs] + instr->extra;
-		if (tmp & 0x1)
-		{
-			RaiseException(AddressErrorException, tmp);
-			return;
-		}
-		if (!ReadMem(tmp, 2, &value))
-			return;
-
-		if ((value & 0x8000) && (instr->opCode == OP_LH))
-			value |= 0xffff0000;
-		else
-			value &= 0xffff;
-		nextLoadReg = instr->rt;
-		nextLoadValue = value;
-		break;
-
-	case OP_LUI:
-		DEBUG(dbgMach, "Executing: LUI r" << instr->rt << ", " << instr->extra);
-		registers[instr->rt] = instr->extra << 16;
-		break;
-
 	case OP_LW:
-		tmp = registers[instr->rs] + instr->extra;
-		if (tmp & 0x3)
-		{
-			RaiseException(AddressErrorException, tmp);
-			return;
-		}
-		if (!ReadMem(tmp, 4, &value))
-			return;
-		nextLoadReg = instr->rt;
-		nextLoadValue = value;
-		break;
-
 	case OP_LWL:
-		tmp = registers[instr->rs] + instr->extra;
-
-#ifdef SIM_FIX
-		// The only difference between this code and the BIG ENDIAN code
-		// is that the ReadMem call is guaranteed an aligned access as it
-		// should be (Kane's book hides the fact that all memory access
-		// are done using aligned loads - what the instruction asks for
-		// is a arbitrary) This is the whole purpose of LWL and LWR etc.
-		// Then the switch uses  3 - (tmp & 0x3)  instead of (tmp & 0x3)
-
-		byte = tmp & 0x3;
-		// DEBUG('P', "Addr 0x%X\n",tmp-byte);
-
-		if (!ReadMem(tmp - byte, 4, &value))
-			return;
-#else
-		// ReadMem assumes all 4 byte requests are aligned on an even
-		// word boundary.  Also, the little endian/big endian swap code would
-		// fail (I think) if the other cases are ever exercised.
-		ASSERT((tmp & 0x3) == 0);
-
-		if (!ReadMem(tmp, 4, &value))
-			return;
-#endif
-
-		if (registers[LoadReg] == instr->rt)
-			nextLoadValue = registers[LoadValueReg];
-		else
-			nextLoadValue = registers[instr->rt];
-#ifdef SIM_FIX
-		switch (3 - byte)
-#else
-		switch (tmp & 0x3)
-#endif
-		{
-		case 0:
-			nextLoadValue = value;
-			break;
-		case 1:
-			nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
-			break;
-		case 2:
-			nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
-			break;
-		case 3:
-			nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
-			break;
-		}
-		nextLoadReg = instr->rt;
-		break;
-
 	case OP_LWR:
-		tmp = registers[instr->rs] + instr->extra;
-
-#ifdef SIM_FIX
-		// The only difference between this code and the BIG ENDIAN code
-		// is that the ReadMem call is guaranteed an aligned access as it
-		// should be (Kane's book hides the fact that all memory access
-		// are done using aligned loads - what the instruction asks
-		// for is a arbitrary) This is the whole purpose of LWL and LWR etc.
-		// Then the switch uses  3 - (tmp & 0x3)  instead of (tmp & 0x3)
-
-		byte = tmp & 0x3;
-		// DEBUG('P', "Addr 0x%X\n",tmp-byte);
-
-		if (!ReadMem(tmp - byte, 4, &value))
-			return;
-#else
-		// ReadMem assumes all 4 byte requests are aligned on an even
-		// word boundary.  Also, the little endian/big endian swap code would
-		// fail (I think) if the other cases are ever exercised.
-		ASSERT((tmp & 0x3) == 0);
-
-		if (!ReadMem(tmp, 4, &value))
-			return;
-#endif
-
-		if (registers[LoadReg] == instr->rt)
-			nextLoadValue = registers[LoadValueReg];
-		else
-			nextLoadValue = registers[instr->rt];
-
-#ifdef SIM_FIX
-		switch (3 - byte)
-#else
-		switch (tmp & 0x3)
-#endif
-		{
-		case 0:
-			nextLoadValue = (nextLoadValue & 0xffffff00) |
-							((value >> 24) & 0xff);
-			break;
-		case 1:
-			nextLoadValue = (nextLoadValue & 0xffff0000) |
-							((value >> 16) & 0xffff);
-			break;
-		case 2:
-			nextLoadValue = (nextLoadValue & 0xff000000) | ((value >> 8) & 0xffffff);
-			break;
-		case 3:
-			nextLoadValue = value;
-			break;
-		}
-		nextLoadReg = instr->rt;
-		break;
-
-	case OP_MFHI:
-		registers[instr->rd] = registers[HiReg];
-		break;
-
-	case OP_MFLO:
-		registers[instr->rd] = registers[LoReg];
-		break;
-
-	case OP_MTHI:
-		registers[HiReg] = registers[instr->rs];
-		break;
-
-	case OP_MTLO:
-		registers[LoReg] = registers[instr->rs];
-		break;
-
-	case OP_MULT:
-		Mult(registers[instr->rs], registers[instr->rt], TRUE,
-			 &registers[HiReg], &registers[LoReg]);
-		break;
-
-	case OP_MULTU:
-		Mult(registers[instr->rs], registers[instr->rt], FALSE,
-			 &registers[HiReg], &registers[LoReg]);
-		break;
-
-	case OP_NOR:
-		registers[instr->rd] = ~(registers[instr->rs] | registers[instr->rt]);
-		break;
-
-	case OP_OR:
-		registers[instr->rd] = registers[instr->rs] | registers[instr->rt];
-		break;
-
-	case OP_ORI:
-		registers[instr->rt] = registers[instr->rs] | (instr->extra & 0xffff);
-		break;
-
+		return LoadInstr;
 	case OP_SB:
-		if (!WriteMem((unsigned)(registers[instr->rs] + instr->extra), 1, registers[instr->rt]))
-			return;
-		break;
-
 	case OP_SH:
-		if (!WriteMem((unsigned)(registers[instr->rs] + instr->extra), 2, registers[instr->rt]))
-			return;
-		break;
-
-	case OP_SLL:
-		registers[instr->rd] = registers[instr->rt] << instr->extra;
-		break;
-
-	case OP_SLLV:
-		registers[instr->rd] = registers[instr->rt] << (registers[instr->rs] & 0x1f);
-		break;
-
-	case OP_SLT:
-		if (registers[instr->rs] < registers[instr->rt])
-			registers[instr->rd] = 1;
-		else
-			registers[instr->rd] = 0;
-		break;
-
-	case OP_SLTI:
-		if (registers[instr->rs] < instr->extra)
-			registers[instr->rt] = 1;
-		else
-			registers[instr->rt] = 0;
-		break;
-
-	case OP_SLTIU:
-		rs = registers[instr->rs];
-		imm = instr->extra;
-		if (rs < imm)
-			registers[instr->rt] = 1;
-		else
-			registers[instr->rt] = 0;
-		break;
-
-	case OP_SLTU:
-		rs = registers[instr->rs];
-		rt = registers[instr->rt];
-		if (rs < rt)
-			registers[instr->rd] = 1;
-		else
-			registers[instr->rd] = 0;
-		break;
-
-	case OP_SRA:
-		registers[instr->rd] = registers[instr->rt] >> instr->extra;
-		break;
-
-	case OP_SRAV:
-		registers[instr->rd] = registers[instr->rt] >>
-							   (registers[instr->rs] & 0x1f);
-		break;
-
-	case OP_SRL:
-		tmp = registers[instr->rt];
-		tmp >>= instr->extra;
-		registers[instr->rd] = tmp;
-		break;
-
-	case OP_SRLV:
-		tmp = registers[instr->rt];
-		tmp >>= (registers[instr->rs] & 0x1f);
-		registers[instr->rd] = tmp;
-		break;
-
-	case OP_SUB:
-		diff = registers[instr->rs] - registers[instr->rt];
-		if (((registers[instr->rs] ^ registers[instr->rt]) & SIGN_BIT) &&
-			((registers[instr->rs] ^ diff) & SIGN_BIT))
-		{
-			RaiseException(OverflowException, 0);
-			return;
-		}
-		registers[instr->rd] = diff;
-		break;
-
-	case OP_SUBU:
-		registers[instr->rd] = registers[instr->rs] - registers[instr->rt];
-		break;
-
 	case OP_SW:
-		if (!WriteMem((unsigned)(registers[instr->rs] + instr->extra), 4, registers[instr->rt]))
-			return;
-		break;
-
 	case OP_SWL:
-		tmp = registers[instr->rs] + instr->extra;
-
-#ifdef SIM_FIX
-		// The only difference between this code and the BIG ENDIAN code
-		// is that the ReadMem call is guaranteed an aligned access as it
-		// should be (Kane's book hides the fact that all memory access
-		// are done using aligned loads - what the instruction asks for
-		// is a arbitrary) This is the whole purpose of LWL and LWR etc.
-
-		byte = tmp & 0x3;
-		// DEBUG('P', "Addr 0x%X\n",tmp-byte);
-		if (!ReadMem(tmp - byte, 4, &value))
-			return;
-
-			// DEBUG('P', "Value 0x%X\n",value);
-#else
-
-		// The little endian/big endian swap code would
-		// fail (I think) if the other cases are ever exercised.
-		ASSERT((tmp & 0x3) == 0);
-
-		if (!ReadMem((tmp & ~0x3), 4, &value))
-			return;
-#endif
-
-#ifdef SIM_FIX
-		switch (3 - byte)
-#else
-		switch (tmp & 0x3)
-#endif // SIM_FIX
-		{
-		case 0:
-			value = registers[instr->rt];
-			break;
-		case 1:
-			value = (value & 0xff000000) | ((registers[instr->rt] >> 8) &
-											0xffffff);
-			break;
-		case 2:
-			value = (value & 0xffff0000) | ((registers[instr->rt] >> 16) &
-											0xffff);
-			break;
-		case 3:
-			value = (value & 0xffffff00) | ((registers[instr->rt] >> 24) &
-											0xff);
-			break;
-		}
-#ifndef SIM_FIX
-		if (!WriteMem((tmp & ~0x3), 4, value))
-			return;
-#else
-		// DEBUG('P', "Value 0x%X\n",value);
-
-		if (!WriteMem((tmp - byte), 4, value))
-			return;
-#endif // SIM_FIX
-		break;
-
 	case OP_SWR:
-		tmp = registers[instr->rs] + instr->extra;
-
-#ifndef SIM_FIX
-		// The little endian/big endian swap code would
-		// fail (I think) if the other cases are ever exercised.
-		ASSERT((tmp & 0x3) == 0);
-
-		if (!ReadMem((tmp & ~0x3), 4, &value))
-			return;
-#else
-		// The only difference between this code and the BIG ENDIAN code
-		// is that the ReadMem call is guaranteed an aligned access as
-		// it should be (Kane's book hides the fact that all memory
-		// access are done using aligned loads - what the instruction
-		// asks for is a arbitrary) This is the whole purpose of LWL
-		// and LWR etc.
-
-		byte = tmp & 0x3;
-		// DEBUG('P', "Addr 0x%X\n",tmp-byte);
-
-		if (!ReadMem(tmp - byte, 4, &value))
-			return;
-			// DEBUG('P', "Value 0x%X\n",value);
-#endif // SIM_FIX
-
-#ifndef SIM_FIX
-		switch (tmp & 0x3)
-#else
-		switch (3 - byte)
-#endif // SIM_FIX
-		{
-		case 0:
-			value = (value & 0xffffff) | (registers[instr->rt] << 24);
-			break;
-		case 1:
-			value = (value & 0xffff) | (registers[instr->rt] << 16);
-			break;
-		case 2:
-			value = (value & 0xff) | (registers[instr->rt] << 8);
-			break;
-		case 3:
-			value = registers[instr->rt];
-			break;
-		}
-
-#ifndef SIM_FIX
-		if (!WriteMem((tmp & ~0x3), 4, value))
-			return;
-#else
-		// DEBUG('P', "Value 0x%X\n",value);
-
-		if (!WriteMem((tmp - byte), 4, value))
-			return;
-#endif // SIM_FIX
-
-		break;
-
+		return StoreInstr;
+	case OP_BEQ:
+	case OP_BGEZ:
+	case OP_BGEZAL:
+	case OP_BGTZ:
+	case OP_BLEZ:
+	case OP_BLTZ:
+	case OP_BLTZAL:
+	case OP_BNE:
+	case OP_J:
+	case OP_JAL:
+	case OP_JALR:
+	case OP_JR:
+		return BranchInstr;
+	case OP_DIV:
+	case OP_DIVU:
+	case OP_MULT:
+	case OP_MULTU:
+	case OP_MFHI:
+	case OP_MFLO:
+	case OP_MTHI:
+	case OP_MTLO:
+		return MultDivInstr;
 	case OP_SYSCALL:
-		RaiseException(SyscallException, 0);
-		return;
-
-	case OP_XOR:
-		registers[instr->rd] = registers[instr->rs] ^ registers[instr->rt];
-		break;
-
-	case OP_XORI:
-		registers[instr->rt] = registers[instr->rs] ^ (instr->extra & 0xffff);
-		break;
-
-	case OP_RES:
+	case OP_RFE:
 	case OP_UNIMP:
-		RaiseException(IllegalInstrException, 0);
-		return;
-
+	case OP_RES:
+		return OtherInstr;
 	default:
-		ASSERT(FALSE);
+		return ArithInstr;
 	}
-
-	// Now we have successfully executed the instruction.
-
-	// Do any delayed load operation
-	DelayedLoad(nextLoadReg, nextLoadValue);
-
-	// Advance program counters.
-	registers[PrevPCReg] = registers[PCReg]; // for debugging, in case we
-											 // are jumping into lala-land
-	registers[PCReg] = registers[NextPCReg];
-	registers[NextPCReg] = pcAfter;
-}
-
-//----------------------------------------------------------------------
-// Machine::DelayedLoad
-// 	Simulate effects of a delayed load.
-//
-// 	NOTE -- RaiseException/CheckInterrupts must also call DelayedLoad,
-//	since any delayed load must get applied before we trap to the kernel.
-//----------------------------------------------------------------------
-
-void Machine::DelayedLoad(int nextReg, int nextValue)
-{
-	registers[registers[LoadReg]] = registers[LoadValueReg];
-	registers[LoadReg] = nextReg;
-	registers[LoadValueReg] = nextValue;
-	registers[0] = 0; // and always make sure R0 stays zero.
 }
 
 //----------------------------------------------------------------------
@@ -782,6 +691,7 @@ void Instruction::Decode()
 			opCode = OP_UNIMP;
 		}
 	}
+	opClass = ClassOf(opCode);
 }
 
 //----------------------------------------------------------------------
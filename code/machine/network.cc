@@ -2,6 +2,14 @@
 //	Routines to simulate a network interface, using UNIX sockets
 //	to deliver packets between multiple invocations of nachos.
 //
+//	Packets go between Nachos and the host in batches, to save
+//	system calls: each poll reads in every packet waiting, and
+//	packets sent are held back until several can go out together
+//	(but no longer than FlushTime).  The simulated timing is the
+//	same as one packet at a time: how long a packet takes to send,
+//	and when one that has come in is delivered, is up to the model
+//	of the network in fabric.h.
+//
 //  DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -10,6 +18,7 @@
 
 #include "copyright.h"
 #include "network.h"
+#include "fabric.h"
 #include "main.h"
 
 //-----------------------------------------------------------------------
@@ -24,7 +33,8 @@ NetworkInput::NetworkInput(CallBackObj *toCall)
     // set up the stuff to emulate asynchronous interrupts
     callWhenAvail = toCall;
     packetAvail = FALSE;
-    inHdr.length = 0;
+    inbox = new char[InboxSize * kernel->wireSize];
+    inFirst = inCount = 0;
 
     sock = OpenSocket();
     sprintf(sockName, "SOCKET_%d", kernel->hostName);
@@ -32,7 +42,7 @@ NetworkInput::NetworkInput(CallBackObj *toCall)
                                         // in the current directory.
 
     // start polling for incoming packets
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+    kernel->interrupt->SchedulePoll(this, NetworkTime, NetworkRecvInt, sock);
 }
 
 //-----------------------------------------------------------------------
@@ -45,6 +55,43 @@ NetworkInput::~NetworkInput()
 {
     CloseSocket(sock);
     DeAssignNameToSocket(sockName);
+    delete[] inbox;
+}
+
+//-----------------------------------------------------------------------
+// NetworkInput::ReadIn
+// 	Read in the packets waiting on the host, as many as there is room
+//	for in one go, and pass them through the model of the switch.
+//	Those it drops are forgotten.
+//-----------------------------------------------------------------------
+
+void NetworkInput::ReadIn()
+{
+    int last = (inFirst + inCount) % InboxSize;
+    int room = min(min(InboxSize - inCount, InboxSize - last), NetworkBatch);
+    int numRead;
+
+    if (room == 0)
+        return;
+    numRead = ReadFromSocketBatch(sock, inbox + last * kernel->wireSize,
+                                  kernel->wireSize, room);
+    for (int i = last; i < last + numRead; i++)
+    {
+        char *packet = inbox + i * kernel->wireSize;
+        PacketHeader *hdr = (PacketHeader *)packet;
+        int next = (inFirst + inCount) % InboxSize;
+        int due;
+
+        ASSERT(((hdr->to == kernel->hostName) || IsGroupAddress(hdr->to)) &&
+               (hdr->length <= kernel->wireSize - sizeof(PacketHeader)));
+        due = kernel->fabric->Arrive(hdr->from);
+        if (due < 0) // dropped at the switch
+            continue;
+        if (next != i) // close the gap left by one dropped
+            bcopy(packet, inbox + next * kernel->wireSize, kernel->wireSize);
+        inDue[next] = due;
+        inCount++;
+    }
 }
 
 //-----------------------------------------------------------------------
@@ -55,30 +102,42 @@ NetworkInput::~NetworkInput()
 //      First check to make sure packet is available & there's space to
 //	pull it in.  Then invoke the "callBack" registered by whoever
 //	wants the packet.
+//
+//	Every poll reads in what is waiting on the host, so the switch
+//	sees packets as they come.  While some are held, the next poll
+//	comes when the first is due, and need not wait for the host.
 //-----------------------------------------------------------------------
 
 void NetworkInput::CallBack()
 {
+    int now = kernel->stats->totalTicks;
+    bool arrived = FALSE;
+    int waiting;
+
+    ReadIn();
+    if (!packetAvail && (inCount > 0) && (inDue[inFirst] <= now))
+        arrived = packetAvail = TRUE;
+
     // schedule the next time to poll for a packet
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkRecvInt);
+    waiting = inCount - (packetAvail ? 1 : 0);
+    if (waiting > 0)
+    {
+        int due = inDue[(inFirst + inCount - waiting) % InboxSize] - now;
 
-    if (inHdr.length != 0) // do nothing if packet is already buffered
-        return;
-    if (!PollSocket(sock)) // do nothing if no packet to be read
-        return;
+        kernel->interrupt->SchedulePoll(this, max(min(due, NetworkTime), 1),
+                                        NetworkRecvInt, -1);
+    }
+    else
+        kernel->interrupt->SchedulePoll(this, NetworkTime, NetworkRecvInt, sock);
 
-    // otherwise, read packet in
-    char *buffer = new char[MaxWireSize];
-    ReadFromSocket(sock, buffer, MaxWireSize);
+    if (!arrived) // do nothing if no packet to be delivered
+        return;
 
-    // divide packet into header and data
-    inHdr = *(PacketHeader *)buffer;
-    ASSERT((inHdr.to == kernel->hostName) && (inHdr.length <= MaxPacketSize));
-    bcopy(buffer + sizeof(PacketHeader), inbox, inHdr.length);
-    delete[] buffer;
+    PacketHeader *hdr = (PacketHeader *)(inbox + inFirst * kernel->wireSize);
 
-    DEBUG(dbgNet, "Network received packet from " << inHdr.from << ", length " << inHdr.length);
+    DEBUG(dbgNet, "Network received packet from " << hdr->from << ", length " << hdr->length);
     kernel->stats->numPacketsRecvd++;
+    kernel->stats->hostPacketsRecvd[hdr->from]++;
 
     // tell post office that the packet has arrived
     callWhenAvail->CallBack();
@@ -92,13 +151,22 @@ void NetworkInput::CallBack()
 PacketHeader
 NetworkInput::Receive(char *data)
 {
-    PacketHeader hdr = inHdr;
+    PacketHeader hdr;
 
-    inHdr.length = 0;
-    if (hdr.length != 0)
+    if (!packetAvail)
     {
-        bcopy(inbox, data, hdr.length);
+        hdr.length = 0;
+        return hdr;
     }
+
+    // divide packet into header and data
+    char *packet = inbox + inFirst * kernel->wireSize;
+
+    hdr = *(PacketHeader *)packet;
+    bcopy(packet + sizeof(PacketHeader), data, hdr.length);
+    packetAvail = FALSE;
+    inFirst = (inFirst + 1) % InboxSize;
+    inCount--;
     return hdr;
 }
 
@@ -123,6 +191,11 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
     callWhenDone = toCall;
     sendBusy = FALSE;
     sock = OpenSocket();
+
+    outbox = new char[NetworkBatch * kernel->wireSize];
+    for (int i = 0; i < NetworkBatch; i++)
+        outNames[i] = new char[32];
+    outCount = 0;
 }
 
 //-----------------------------------------------------------------------
@@ -132,19 +205,47 @@ NetworkOutput::NetworkOutput(double reliability, CallBackObj *toCall)
 
 NetworkOutput::~NetworkOutput()
 {
+    Flush(); // don't lose what was held back
     CloseSocket(sock);
+    delete[] outbox;
+    for (int i = 0; i < NetworkBatch; i++)
+        delete[] outNames[i];
 }
 
 //-----------------------------------------------------------------------
 // NetworkOutput::CallBack
-// 	Called by simulator when another packet can be sent.
+// 	Called by simulator when another packet can be sent, or when the
+//	packets held back have waited long enough.  Both can be due at
+//	once; an interrupt for a flush that has already been done is
+//	ignored.
 //-----------------------------------------------------------------------
 
 void NetworkOutput::CallBack()
 {
-    sendBusy = FALSE;
-    kernel->stats->numPacketsSent++;
-    callWhenDone->CallBack();
+    int now = kernel->stats->totalTicks;
+
+    if ((outCount > 0) && (now >= flushAt))
+        Flush();
+    if (sendBusy && (now >= sendDone))
+    {
+        sendBusy = FALSE;
+        kernel->stats->numPacketsSent++;
+        callWhenDone->CallBack();
+    }
+}
+
+//-----------------------------------------------------------------------
+// NetworkOutput::Flush
+// 	Hand every packet held back to the host, in one go.
+//-----------------------------------------------------------------------
+
+void NetworkOutput::Flush()
+{
+    if (outCount == 0)
+        return;
+    DEBUG(dbgNet, "Handing " << outCount << " packets to the host");
+    SendToSocketBatch(sock, outbox, kernel->wireSize, outNames, outCount);
+    outCount = 0;
 }
 
 //-----------------------------------------------------------------------
@@ -153,21 +254,58 @@ void NetworkOutput::CallBack()
 // 	Concatenate hdr and data, and schedule an interrupt to tell the user
 // 	when the next packet can be sent
 //
-// 	Note we always pad out a packet to MaxWireSize before putting it into
-// 	the socket, because it's simpler at the receive end.
+// 	Note we always pad out a packet to the wire size before putting it
+// 	into the socket, because it's simpler at the receive end.
+//
+//	The packet is held back, to go to the host with the ones sent
+//	after it, until NetworkBatch are waiting or FlushTime has passed.
+//	The flush interrupt keeps the machine from going idle with
+//	packets still held back.
+//
+//	A packet for a group goes up the link once: it takes as long to
+//	send, with one interrupt when it has been, as any other.  The
+//	switch's copies, one per member, are each handed to the host on
+//	their own, and each may be lost on its own.
 //-----------------------------------------------------------------------
 
 void NetworkOutput::Send(PacketHeader hdr, char *data)
 {
-    char toName[32];
-
-    sprintf(toName, "SOCKET_%d", (int)hdr.to);
-
     ASSERT((sendBusy == FALSE) && (hdr.length > 0) &&
-           (hdr.length <= MaxPacketSize) && (hdr.from == kernel->hostName));
+           (((hdr.to >= 0) && (hdr.to < MaxHosts)) || IsGroupAddress(hdr.to)) &&
+           (hdr.length <= kernel->wireSize - sizeof(PacketHeader)) &&
+           (hdr.from == kernel->hostName));
     DEBUG(dbgNet, "Sending to addr " << hdr.to << ", length " << hdr.length);
 
-    kernel->interrupt->Schedule(this, NetworkTime, NetworkSendInt);
+    int sendTime = kernel->fabric->SendTime();
+
+    kernel->interrupt->Schedule(this, sendTime, NetworkSendInt);
+    sendBusy = TRUE;
+    sendDone = kernel->stats->totalTicks + sendTime;
+
+    if (!IsGroupAddress(hdr.to))
+    {
+        Hold(hdr, data, hdr.to);
+        return;
+    }
+
+    NetworkAddress members[MaxHosts];
+    int count = kernel->fabric->Members(hdr.to, members);
+
+    kernel->stats->numGroupSends++;
+    for (int i = 0; i < count; i++)
+        Hold(hdr, data, members[i]);
+}
+
+//-----------------------------------------------------------------------
+// NetworkOutput::Hold
+// 	Put a packet, with its header, in the next place in the outbox,
+//	to be handed to the host for machine "to" -- unless it is to be
+//	lost -- and hand the outbox over if it is now full.
+//-----------------------------------------------------------------------
+
+void NetworkOutput::Hold(PacketHeader hdr, char *data, NetworkAddress to)
+{
+    kernel->stats->hostPacketsSent[to]++;
 
     if (RandomNumber() % 100 >= chanceToWork * 100)
     { // emulate a lost packet
@@ -175,10 +313,17 @@ void NetworkOutput::Send(PacketHeader hdr, char *data)
         return;
     }
 
-    // concatenate hdr and data into a single buffer, and send it out
-    char *buffer = new char[MaxWireSize];
-    *(PacketHeader *)buffer = hdr;
-    bcopy(data, buffer + sizeof(PacketHeader), hdr.length);
-    SendToSocket(sock, buffer, MaxWireSize, toName);
-    delete[] buffer;
+    // concatenate hdr and data into the next place in the outbox
+    char *packet = outbox + outCount * kernel->wireSize;
+    *(PacketHeader *)packet = hdr;
+    bcopy(data, packet + sizeof(PacketHeader), hdr.length);
+    sprintf(outNames[outCount], "SOCKET_%d", (int)to);
+
+    if (outCount++ == 0)
+    { // the first to be held back: it goes by FlushTime
+        flushAt = kernel->stats->totalTicks + FlushTime;
+        kernel->interrupt->Schedule(this, FlushTime, NetworkSendInt);
+    }
+    if (outCount == NetworkBatch)
+        Flush();
 }
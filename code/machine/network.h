@@ -39,13 +39,25 @@ public:
                          // MailHeader prepended by the post office)
 };
 
-#define MaxWireSize 64 // largest packet that can go out on the wire
+#define DefaultWireSize 64 // size of each packet on the wire, unless
+                           // -mtu says otherwise
+#define MaxWireSize 1024   // largest packet -mtu can ask for
 #define MaxPacketSize (MaxWireSize - sizeof(struct PacketHeader))
 // data "payload" of the largest packet
 
+#define NetworkBatch 16 // most packets moved between Nachos and the
+                        // host in one go, each way
+#define InboxSize 64    // most packets that can have come in and not
+                        // yet been pulled off (see fabric.h)
+#define FlushTime (4 * NetworkTime) // longest a sent packet is held
+                                    // back, waiting for others to
+                                    // go to the host with it
+
 // The following two classes defines a physical network device.  The network
 // is capable of delivering fixed sized packets, in order but unreliably,
-// to other machines connected to the network.
+// to other machines connected to the network.  Every packet on the wire
+// is kernel->wireSize bytes, header included, so every machine on the
+// network must be given the same -mtu.
 //
 // The "reliability" of the network can be specified to the constructor.
 // This number, between 0 and 1, is the chance that the network will lose
@@ -67,7 +79,7 @@ public:
     // If no packet is waiting, return a header
     // with length 0.
 
-    void CallBack(); // A packet may have arrived.
+    void CallBack(); // A packet may have arrived, or may be due.
 
 private:
     int sock;          // UNIX socket number for incoming packets
@@ -77,8 +89,14 @@ private:
         // 	arrived.
     bool packetAvail; // Packet has arrived, can be pulled off of
         //   network
-    PacketHeader inHdr;        // Information about arrived packet
-    char inbox[MaxPacketSize]; // Data for arrived packet
+    char *inbox;           // Packets read from the host, a circular
+                           // queue; the first is the arrived packet
+                           // if "packetAvail"
+    int inDue[InboxSize];  // When each is delivered (see fabric.h)
+    int inFirst;           // Index in "inbox" of the next packet
+    int inCount;           // Packets in "inbox" not yet pulled off
+
+    void ReadIn();         // Read in the packets waiting on the host
 };
 
 class NetworkOutput : public CallBackObj
@@ -90,6 +108,7 @@ public:
 
     void Send(PacketHeader hdr, char *data);
     // Send the packet data to a remote machine,
+    // or a group of them (see fabric.h),
     // specified by "hdr".  Returns immediately.
     // "callWhenDone" is invoked once the next
     // packet can be sent.  Note that callWhenDone
@@ -99,7 +118,7 @@ public:
     // by Send().
 
     void CallBack(); // Interrupt handler, called when message is
-                     // sent
+                     // sent, or packets held back must go out
 
 private:
     int sock;                  // UNIX socket number for outgoing packets
@@ -107,6 +126,17 @@ private:
     CallBackObj *callWhenDone; // Interrupt handler, signalling next packet
         //      can be sent.
     bool sendBusy; // Packet is being sent.
+    int sendDone;  // When it will have been
+
+    char *outbox;  // Packets sent but not yet handed to the host,
+                   // one after another
+    char *outNames[NetworkBatch]; // Where each is going
+    int outCount;  // How many there are
+    int flushAt;   // When they must be handed over
+
+    void Flush();  // Hand the held back packets to the host
+    void Hold(PacketHeader hdr, char *data, NetworkAddress to);
+                   // Put a copy of a packet for "to" among them
 };
 
 #endif // NETWORK_H
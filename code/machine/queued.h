@@ -0,0 +1,50 @@
+// queued.h
+//	The interface of a disk device that takes several requests at
+//	once, rather than one at a time as the physical disk does: the
+//	flash disk (see flash.h), and a volume of several disks (see
+//	raid.h).  Each request says whom to call back when it is done,
+//	since requests may finish in any order.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef QUEUED_H
+#define QUEUED_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+
+class QueuedDevice {
+  public:
+    virtual ~QueuedDevice() {}
+
+    virtual void ReadRequest(int firstSector, int count, char **data,
+			     CallBackObj *toCall) = 0;
+    virtual void WriteRequest(int firstSector, int count, char **data,
+			      CallBackObj *toCall) = 0;
+					// Read/write "count" consecutive
+					// sectors; return immediately, and
+					// invoke toCall->CallBack() once
+					// the request is done.  data[i] is
+					// the buffer for sector
+					// firstSector + i.
+
+    virtual void Discard(int firstSector, int count) = 0;
+					// The contents of these sectors
+					// are no longer needed; see Disk
+
+    virtual bool IsFull() = 0;		// Must a new request wait?
+    virtual int LastSector() = 0;	// The end of the last request
+
+    virtual int ComputeLatency(int firstSector, bool writing,
+			       int count) = 0;
+					// Return about how long a request
+					// to "count" sectors from
+					// firstSector would take, made now
+};
+
+#endif // QUEUED_H
@@ -0,0 +1,378 @@
+// raid.cc
+//	Routines to simulate a volume of several physical disks, striped
+//	(RAID-0) or mirrored (RAID-1).  A request to the volume is split
+//	into requests to its disks, queued for each disk, and done once
+//	they all are.  See raid.h for details.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "raid.h"
+#include "debug.h"
+#include "main.h"
+
+//----------------------------------------------------------------------
+// RaidMember::RaidMember
+// 	Initialize disk "which" of a volume, with nothing to do.
+//----------------------------------------------------------------------
+
+RaidMember::RaidMember(RaidVolume *owner, int which)
+{
+    volume = owner;
+    disk = new Disk(this, which);
+    queue = new List<MemberRequest *>;
+    active = NULL;
+}
+
+RaidMember::~RaidMember()
+{
+    delete disk;
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// RaidMember::Submit
+// 	Give the disk its part of a request: at once if it is idle,
+//	otherwise once those before it are done.
+//----------------------------------------------------------------------
+
+void RaidMember::Submit(MemberRequest *part)
+{
+    queue->Append(part);
+    if (active == NULL)
+        Start();
+}
+
+//----------------------------------------------------------------------
+// RaidMember::NumWaiting
+// 	Return how many parts the disk has still to do.
+//----------------------------------------------------------------------
+
+int RaidMember::NumWaiting()
+{
+    return queue->NumInList() + ((active != NULL) ? 1 : 0);
+}
+
+//----------------------------------------------------------------------
+// RaidMember::Start
+// 	Hand the disk the next part waiting for it.
+//----------------------------------------------------------------------
+
+void RaidMember::Start()
+{
+    active = queue->RemoveFront();
+    if (active->writing)
+        disk->WriteRequest(active->firstSector, active->count, active->data);
+    else
+        disk->ReadRequest(active->firstSector, active->count, active->data);
+}
+
+//----------------------------------------------------------------------
+// RaidMember::CallBack
+// 	Called when the disk's interrupt occurs: start its next part, and
+//	tell the volume this one is done.
+//----------------------------------------------------------------------
+
+void RaidMember::CallBack()
+{
+    MemberRequest *done = active;
+
+    active = NULL;
+    if (!queue->IsEmpty())
+        Start();
+    volume->PartDone(done);
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::RaidVolume
+// 	Initialize a volume of several simulated disks.
+//
+//	"raidLevel" -- striped or mirrored
+//	"numDisks" -- how many disks
+//	"stripe" -- sectors in each stripe unit, when striped
+//----------------------------------------------------------------------
+
+RaidVolume::RaidVolume(RaidLevel raidLevel, int numDisks, int stripe)
+{
+    ASSERT(numDisks > 0);
+    ASSERT((raidLevel == Raid1) || (stripe > 0));
+    ASSERT(kernel->diskBase == NULL);		// each disk is one file
+    ASSERT(kernel->writeCacheSectors == 0);	// nothing would flush it
+
+    DEBUG(dbgDisk, "Initializing a RAID-" << raidLevel << " volume of " << numDisks << " disks.");
+    level = raidLevel;
+    numMembers = numDisks;
+    stripeSectors = stripe;
+    members = new RaidMember *[numMembers];
+    for (int i = 0; i < numMembers; i++)
+        members[i] = new RaidMember(this, i);
+    numActive = 0;
+    lastSector = 0;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::~RaidVolume
+// 	Clean up the simulation of each disk.
+//----------------------------------------------------------------------
+
+RaidVolume::~RaidVolume()
+{
+    for (int i = 0; i < numMembers; i++)
+        delete members[i];
+    delete[] members;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::ReadRequest/WriteRequest
+// 	Simulate a request to read/write a run of consecutive sectors of
+//	the volume.  Return at once; toCall->CallBack() is invoked once
+//	every disk has done its part.
+//
+//	"firstSector" -- the first sector to read/write
+//	"count" -- how many sectors
+//	"data" -- data[i] is the buffer for sector firstSector + i
+//	"toCall" -- object to call when the request is done
+//----------------------------------------------------------------------
+
+void RaidVolume::ReadRequest(int firstSector, int count, char **data,
+                             CallBackObj *toCall)
+{
+    kernel->stats->numDiskReads++;
+    Request(firstSector, count, data, FALSE, toCall);
+}
+
+void RaidVolume::WriteRequest(int firstSector, int count, char **data,
+                              CallBackObj *toCall)
+{
+    kernel->stats->numDiskWrites++;
+    Request(firstSector, count, data, TRUE, toCall);
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::Request
+// 	Split a request into parts, one for each disk that holds some of
+//	its sectors (striped), for every disk (a mirrored write), or for
+//	the disk chosen to read from (a mirrored read), and queue them.
+//----------------------------------------------------------------------
+
+void RaidVolume::Request(int firstSector, int count, char **data,
+                         bool writing, CallBackObj *toCall)
+{
+    VolumeRequest *whole = new VolumeRequest;
+    int *first = new int[numMembers];
+    int *num = new int[numMembers];
+    int i;
+
+    ASSERT(!IsFull());
+    ASSERT(count > 0);
+    ASSERT((firstSector >= 0) && (firstSector + count <= NumSectors));
+
+    whole->callWhenDone = toCall;
+    whole->numPending = 0;
+    numActive++;
+    lastSector = firstSector + count - 1;
+
+    for (i = 0; i < numMembers; i++)
+    {
+        first[i] = firstSector;
+        num[i] = 0;
+    }
+    if (level == Raid0)
+        Split(firstSector, count, first, num);
+    else if (writing)
+        for (i = 0; i < numMembers; i++)
+            num[i] = count;
+    else
+        num[ChooseMirror(firstSector, count)] = count;
+
+    // a part's sectors come in the order of the volume's, so the
+    // buffers are dealt out in turn (each to a disk that has them)
+    for (i = 0; i < numMembers; i++)
+    {
+        MemberRequest *part;
+        int n = 0;
+
+        if (num[i] == 0)
+            continue;
+        part = new MemberRequest;
+        part->whole = whole;
+        part->firstSector = first[i];
+        part->count = num[i];
+        part->data = new char *[num[i]];
+        part->writing = writing;
+        for (int j = 0; j < count; j++)
+        {
+            int which = i;
+
+            if (level == Raid0)
+                (void)MemberSector(firstSector + j, &which);
+            if (which == i)
+                part->data[n++] = data[j];
+        }
+        ASSERT(n == num[i]);
+        whole->numPending++;
+        kernel->stats->numRaidParts++;
+        members[i]->Submit(part);
+    }
+    delete[] first;
+    delete[] num;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::MemberSector
+// 	Return where a sector of a striped volume is on its disk, and
+//	set "which" to the disk.  Stripe unit "u" is on disk u % members,
+//	at stripe u / members of it.
+//----------------------------------------------------------------------
+
+int RaidVolume::MemberSector(int sector, int *which)
+{
+    int unit = sector / stripeSectors;
+
+    *which = unit % numMembers;
+    return (unit / numMembers) * stripeSectors + sector % stripeSectors;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::Split
+// 	Find the part of a run of sectors of a striped volume on each
+//	disk.  The stripe units of a disk follow each other on it, so the
+//	part is a single run of the disk's sectors: set first[i] and
+//	num[i] to where it starts and how long it is (0 if disk "i" has
+//	none of it).
+//----------------------------------------------------------------------
+
+void RaidVolume::Split(int firstSector, int count, int *first, int *num)
+{
+    for (int i = 0; i < numMembers; i++)
+        num[i] = 0;
+    for (int sector = firstSector; sector < firstSector + count; sector++)
+    {
+        int which;
+        int memberSector = MemberSector(sector, &which);
+
+        if (num[which] == 0)
+            first[which] = memberSector;
+        ASSERT(memberSector == first[which] + num[which]);
+        num[which]++;
+    }
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::ChooseMirror
+// 	Return the disk of a mirrored volume to read a run of sectors from:
+//	the one with the fewest requests to do, or of those, the one that
+//	would take the least time if it started now.
+//----------------------------------------------------------------------
+
+int RaidVolume::ChooseMirror(int firstSector, int count)
+{
+    int best = 0;
+    int bestWaiting = members[0]->NumWaiting();
+    int bestLatency = members[0]->disk->ComputeLatency(firstSector, FALSE, count);
+
+    for (int i = 1; i < numMembers; i++)
+    {
+        int waiting = members[i]->NumWaiting();
+        int latency;
+
+        if (waiting > bestWaiting)
+            continue;
+        latency = members[i]->disk->ComputeLatency(firstSector, FALSE, count);
+        if ((waiting < bestWaiting) || (latency < bestLatency))
+        {
+            best = i;
+            bestWaiting = waiting;
+            bestLatency = latency;
+        }
+    }
+    return best;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::PartDone
+// 	A disk has done its part of a request; once every part is done,
+//	so is the request, and there is room for another.
+//----------------------------------------------------------------------
+
+void RaidVolume::PartDone(MemberRequest *part)
+{
+    VolumeRequest *whole = part->whole;
+    CallBackObj *toCall;
+
+    delete[] part->data;
+    delete part;
+    whole->numPending--;
+    if (whole->numPending > 0)
+        return;
+    toCall = whole->callWhenDone;
+    delete whole;
+    numActive--;
+    toCall->CallBack();
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::Discard
+// 	The file system no longer needs the contents of a run of sectors;
+//	tell each disk that holds some of them.
+//----------------------------------------------------------------------
+
+void RaidVolume::Discard(int firstSector, int count)
+{
+    int *first = new int[numMembers];
+    int *num = new int[numMembers];
+
+    for (int i = 0; i < numMembers; i++)
+    {
+        first[i] = firstSector;
+        num[i] = count;
+    }
+    if (level == Raid0)
+        Split(firstSector, count, first, num);
+    for (int i = 0; i < numMembers; i++)
+        if (num[i] > 0)
+            members[i]->disk->Discard(first[i], num[i]);
+    delete[] first;
+    delete[] num;
+}
+
+//----------------------------------------------------------------------
+// RaidVolume::ComputeLatency
+// 	Return about how long a request would take: its longest part,
+//	each from where the head of its disk is now (the queues of the
+//	disks are not counted).  A mirrored read takes as long as the
+//	quickest disk.
+//----------------------------------------------------------------------
+
+int RaidVolume::ComputeLatency(int firstSector, bool writing, int count)
+{
+    int *first = new int[numMembers];
+    int *num = new int[numMembers];
+    bool quickest = (level == Raid1) && !writing;
+    int latency = -1;
+
+    for (int i = 0; i < numMembers; i++)
+    {
+        first[i] = firstSector;
+        num[i] = count;
+    }
+    if (level == Raid0)
+        Split(firstSector, count, first, num);
+    for (int i = 0; i < numMembers; i++)
+    {
+        int ticks;
+
+        if (num[i] == 0)
+            continue;
+        ticks = members[i]->disk->ComputeLatency(first[i], writing, num[i]);
+        if ((latency < 0) || (quickest ? (ticks < latency) : (ticks > latency)))
+            latency = ticks;
+    }
+    delete[] first;
+    delete[] num;
+    return latency;
+}
@@ -0,0 +1,133 @@
+// raid.h
+//	Data structures to emulate a volume of several physical disks,
+//	combined so that the file system sees one disk of NumSectors
+//	sectors, as a RAID controller does.
+//
+//	With RAID-0 (striping), the volume is split into stripe units of
+//	"stripe" sectors, dealt out to the disks in turn; a long request
+//	is split into one request per disk, and they all work on it at
+//	once.  Only the first NumSectors / members sectors of each disk
+//	are used.  With RAID-1 (mirroring), every disk holds all of the
+//	volume: a write goes to all of them, and a read to the one with
+//	the fewest requests waiting, or of those, the one whose head can
+//	get there soonest.
+//
+//	Each disk has its own queue, served in order.  The volume takes
+//	as many requests at once as it has disks, and a request is done
+//	once every disk has done its part.
+//
+//	Disk "i" is kept in the UNIX file DISK_<host>.<i>.
+//
+//  DO NOT CHANGE -- part of the machine emulation
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef RAID_H
+#define RAID_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "disk.h"
+#include "queued.h"
+#include "list.h"
+
+// Sectors per stripe unit, unless -stripe says otherwise.
+const int DefaultStripeSectors = 32;
+
+// How the disks of a volume are combined.
+
+enum RaidLevel {
+    Raid0,			// striped
+    Raid1			// mirrored
+};
+
+class RaidVolume;
+
+// The following class defines a request made to the volume.
+
+class VolumeRequest {
+  public:
+    CallBackObj *callWhenDone;		// told when it is done
+    int numPending;			// parts not yet done
+};
+
+// The following class defines one disk's part of a volume request:
+// a run of consecutive sectors of that disk.
+
+class MemberRequest {
+  public:
+    VolumeRequest *whole;		// what it is part of
+    int firstSector;			// sectors of the disk
+    int count;
+    char **data;			// a buffer per sector
+    bool writing;
+};
+
+// The following class defines a disk of the volume, and the queue of
+// requests waiting for it.
+
+class RaidMember : public CallBackObj {
+  public:
+    RaidMember(RaidVolume *owner, int which);
+    ~RaidMember();
+
+    void Submit(MemberRequest *part);	// do a part, when its turn comes
+    int NumWaiting();			// parts waiting or being done
+    void CallBack();			// the disk is done with one
+
+    Disk *disk;
+
+  private:
+    void Start();			// start the next one waiting
+
+    RaidVolume *volume;
+    List<MemberRequest *> *queue;	// parts waiting for the disk
+    MemberRequest *active;		// the one it is working on
+};
+
+// The following class defines the volume.
+
+class RaidVolume : public QueuedDevice {
+  public:
+    RaidVolume(RaidLevel raidLevel, int members, int stripe);
+					// Combine "members" disks; "stripe"
+					// sectors per stripe unit (RAID-0)
+    ~RaidVolume();
+
+    void ReadRequest(int firstSector, int count, char **data,
+		     CallBackObj *toCall);
+    void WriteRequest(int firstSector, int count, char **data,
+		      CallBackObj *toCall);
+    void Discard(int firstSector, int count);
+
+    bool IsFull() { return (numActive == numMembers); }
+    int LastSector() { return lastSector; }
+    int ComputeLatency(int firstSector, bool writing, int count);
+					// the longest part, for the disk
+					// doing it, if it were idle
+
+  private:
+    friend class RaidMember;
+
+    RaidLevel level;
+    int numMembers;
+    int stripeSectors;			// sectors per stripe unit
+    RaidMember **members;
+    int numActive;			// requests not yet done
+    int lastSector;
+
+    void Request(int firstSector, int count, char **data, bool writing,
+		 CallBackObj *toCall);
+    void Split(int firstSector, int count, int *first, int *num);
+					// the part of a run on each disk
+    int MemberSector(int sector, int *which);
+					// where a sector is, striped
+    int ChooseMirror(int firstSector, int count);
+					// the disk to read a run from
+    void PartDone(MemberRequest *part);
+};
+
+#endif // RAID_H
@@ -10,6 +10,19 @@
 #include "copyright.h"
 #include "debug.h"
 #include "stats.h"
+#include "slab.h"
+
+// Names of the kinds of user instruction, by InstrClass
+
+static const char *instrClassNames[] = { "arithmetic", "load", "store",
+					 "branch", "multiply/divide", "other" };
+
+// Names of the resources charged to programs, by UsageKind
+
+static const char *usageNames[] = { "user ticks", "system ticks",
+				    "sectors read", "sectors written",
+				    "page faults", "system calls",
+				    "switches voluntary", "involuntary" };
 
 //----------------------------------------------------------------------
 // Statistics::Statistics
@@ -19,27 +32,482 @@
 Statistics::Statistics()
 {
     totalTicks = idleTicks = systemTicks = userTicks = 0;
+    for (int i = 0; i < NumInstrClasses; i++)
+	numInstrs[i] = 0;
+    numContextSwitches = numLockWaits = 0;
+    numDeadlineJobs = numDeadlineMisses = maxLateness = 0;
+    numBudgetOverruns = 0;
+    for (int i = 0; i < MaxIntTypes; i++) {
+	numInterrupts[i] = 0;
+	intTypeName[i] = NULL;
+    }
     numDiskReads = numDiskWrites = 0;
+    diskPolicy = "FCFS";
+    diskLatencyTicks = maxDiskLatency = 0;
+    diskSeekTracks = diskRotationTicks = numTrackBufferHits = 0;
+    numDiskCacheHits = numDiskWritesCached = numDiskSectorsDestaged = 0;
+    numDiskFlushes = numFlashPrograms = numFlashErases = 0;
+    numRaidParts = numDedupHits = numDedupBlocks = 0;
+    numCacheHits = numCacheMisses = numReadAheads = 0;
+    numFlushBehinds = numSectorsFlushed = numSyncs = 0;
+    numJournalCommits = numJournalBlocks = numJournalReplays = 0;
+    numChecksumsVerified = numChecksumErrors = 0;
+    numFilesCompressed = numSectorsSaved = numChunksExpanded = 0;
+    numFilesCloned = numClustersShared = numClustersCopied = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPagesPrefetched = numPrefetchHits = 0;
+    for (int i = 0; i < MaxSpaces; i++)
+	spaceFaults[i] = spaceMaxResident[i] = spaceCpuTicks[i] = 0;
+    for (int i = 0; i < MaxSpaces; i++)
+	for (int j = 0; j < NumUsageKinds; j++)
+	    spaceUsage[i][j] = 0;
+    numRetransmits = numGroupSends = 0;
+    numRpcRequests = numRpcBatches = numRpcRetries = 0;
+    numRemoteHits = numRemoteMisses = numRemoteAttrFetches = 0;
+    numRemoteWrites = numLeaseWaits = 0;
+    for (int i = 0; i < MaxHosts; i++)
+	hostPacketsSent[i] = hostPacketsRecvd[i] = hostPacketsDropped[i] = 0;
+    linkQueueTicks = maxLinkQueue = 0;
+    pagePolicy = "FIFO";
+    numPageOuts = numPageCopies = 0;
+    numPageEntries = maxPageEntries = 0;
+    numExecCacheHits = numExecCacheMisses = 0;
+    tlbSize = 0;
+    tlbPolicy = "FIFO";
+    numTLBHits = numTLBMisses = numSuperPages = 0;
+    numCpus = 1;
+    for (int i = 0; i < MaxCpus; i++) {
+	cpuBusyTicks[i] = cpuDispatches[i] = cpuSteals[i] = 0;
+	cpuTLBHits[i] = cpuTLBMisses[i] = cpuDecodes[i] = 0;
+    }
+    numStackAllocs = numStackReuses = numTasks = numPoolTasks = 0;
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	syscallName[i] = NULL;
+	numSyscalls[i] = syscallTicks[i] = 0;
+	syscallLatency[i] = NULL;
+	syscallHostTime[i] = 0;
+    }
+    hostStartTime = HostTime();
 }
 
 //----------------------------------------------------------------------
 // Statistics::Print
 // 	Print performance metrics, when we've finished everything
-//	at system shutdown.
+//	at system shutdown.  The host time, and the simulated
+//	instructions run per host microsecond, are printed last, so that
+//	runs can be compared without them.
 //----------------------------------------------------------------------
 
 void
 Statistics::Print()
 {
+    double instrs = 0, hostTime;
+
+    for (int i = 0; i < NumInstrClasses; i++)
+	instrs += numInstrs[i];
     cout << "Ticks: total " << totalTicks << ", idle " << idleTicks;
 		cout << ", system " << systemTicks << ", user " << userTicks <<"\n";
+    if (userTicks > 0) {
+	cout << "User instructions:";
+	for (int i = 0; i < NumInstrClasses; i++) {
+	    cout << (i == 0 ? " " : ", ") << instrClassNames[i] << " ";
+		cout << numInstrs[i];
+	}
+	cout << "\n";
+    }
+    cout << "Context switches " << numContextSwitches;
+		cout << "; lock waits " << numLockWaits;
+    if (readyWait.Count() > 0) {
+	cout << "; ready waits " << readyWait.Count();
+		readyWait.Print();
+    }
+    cout << "\n";
+    if (numDeadlineJobs + numBudgetOverruns > 0) {
+	cout << "Real time: jobs " << numDeadlineJobs;
+		cout << ", deadlines missed " << numDeadlineMisses;
+		cout << " (latest by " << maxLateness << ")";
+		cout << ", budgets used up " << numBudgetOverruns << "\n";
+    }
+    cout << "Interrupts:";
+    for (int i = 0; (i < MaxIntTypes) && (intTypeName[i] != NULL); i++) {
+	cout << (i == 0 ? " " : ", ") << intTypeName[i] << " ";
+		cout << numInterrupts[i];
+    }
+    cout << "\n";
     cout << "Disk I/O: reads " << numDiskReads;
 		cout << ", writes " << numDiskWrites << "\n";
+    if (numDiskReads + numDiskWrites > 0) {
+        cout << "Disk latency (" << diskPolicy << "): average ";
+		cout << diskLatencyTicks /
+		    (numDiskReads + numDiskWrites + numDiskFlushes);
+		cout << ", max " << maxDiskLatency;
+		diskLatency.Print();
+		cout << "\n";
+	cout << "Disk head: tracks sought " << diskSeekTracks;
+		cout << ", rotational delay " << diskRotationTicks;
+		cout << ", track buffer hits " << numTrackBufferHits << "\n";
+    }
+    if (numDiskCacheHits + numDiskWritesCached + numDiskFlushes > 0) {
+	cout << "Disk cache: read hits " << numDiskCacheHits;
+		cout << ", writes cached " << numDiskWritesCached;
+		cout << ", sectors destaged " << numDiskSectorsDestaged;
+		cout << ", flushes " << numDiskFlushes << "\n";
+    }
+    if (numFlashPrograms > 0) {
+	cout << "Flash: pages programmed " << numFlashPrograms;
+		cout << ", blocks erased " << numFlashErases << "\n";
+    }
+    if (numRaidParts > 0)
+	cout << "RAID: requests to its disks " << numRaidParts << "\n";
+    if (numDedupHits + numDedupBlocks > 0) {
+	cout << "Dedup: sectors shared " << numDedupHits;
+		cout << ", copies stored " << numDedupBlocks << "\n";
+    }
+    cout << "Buffer cache: hits " << numCacheHits;
+		cout << ", misses " << numCacheMisses;
+		cout << ", read ahead " << numReadAheads;
+		cout << ", flushed behind " << numFlushBehinds;
+		cout << " (" << numSectorsFlushed << " sectors)";
+		cout << ", syncs " << numSyncs << "\n";
+    cout << "Journal: commits " << numJournalCommits;
+		cout << ", blocks logged " << numJournalBlocks;
+		cout << ", replayed " << numJournalReplays << "\n";
+    if (numChecksumsVerified > 0) {
+	cout << "Checksums: sectors verified " << numChecksumsVerified;
+		cout << ", damaged " << numChecksumErrors << "\n";
+    }
+    if (numFilesCompressed + numChunksExpanded > 0) {
+	cout << "Compression: files " << numFilesCompressed;
+		cout << ", sectors saved " << numSectorsSaved;
+		cout << ", chunks expanded " << numChunksExpanded << "\n";
+    }
+    if (numFilesCloned + numClustersCopied > 0) {
+	cout << "Clones: files " << numFilesCloned;
+		cout << ", clusters shared " << numClustersShared;
+		cout << ", copied on write " << numClustersCopied << "\n";
+    }
 		cout << "Console I/O: reads " << numConsoleCharsRead;
     cout << ", writes " << numConsoleCharsWritten << "\n";
-    cout << "Paging: faults " << numPageFaults << "\n";
+    cout << "Paging (" << pagePolicy << "): faults " << numPageFaults;
+		cout << ", written to swap " << numPageOuts;
+		cout << ", copied on write " << numPageCopies << "\n";
+    for (int i = 0; i < MaxSpaces; i++) {
+	if (spaceFaults[i] > 0) {
+	    cout << "Program " << i << ": page faults " << spaceFaults[i];
+		cout << ", most frames " << spaceMaxResident[i] << "\n";
+	}
+    }
+    if (numPagesPrefetched > 0) {
+	cout << "Fault-around: pages brought in ahead " << numPagesPrefetched;
+		cout << ", touched " << numPrefetchHits << "\n";
+    }
+    if (maxPageEntries > 0) {
+	cout << "Hashed page tables: most entries at once " << maxPageEntries
+	     << "\n";
+    }
+    if (numExecCacheHits + numExecCacheMisses > 0) {
+	cout << "Program images: cached " << numExecCacheHits;
+		cout << ", read " << numExecCacheMisses << "\n";
+    }
+    if (tlbSize > 0) {
+        cout << "TLB (" << tlbSize << " entries, " << tlbPolicy << "): hits ";
+		cout << numTLBHits << ", misses " << numTLBMisses;
+		cout << ", superpages loaded " << numSuperPages << "\n";
+    }
+    for (int i = 0; i < MaxSpaces; i++) {
+	if (spaceCpuTicks[i] > 0)
+	    cout << "Program " << i << ": CPU ticks " << spaceCpuTicks[i] << "\n";
+    }
+    for (int i = 0; i < MaxSpaces; i++) {
+	if (spaceUsage[i][UsageUserTicks] + spaceUsage[i][UsageSystemTicks] > 0) {
+	    cout << "Program " << i << ":";
+	    for (int j = 0; j < NumUsageKinds; j++)
+		cout << ((j > 0) ? ", " : " ") << usageNames[j] << " "
+		     << spaceUsage[i][j];
+	    cout << "\n";
+	}
+    }
+    if (numCpus > 1) {
+	int longest = 0;
+	for (int i = 0; i < numCpus; i++) {
+	    cout << "CPU " << i << ": busy " << cpuBusyTicks[i];
+		cout << ", dispatches " << cpuDispatches[i];
+		cout << ", stolen " << cpuSteals[i];
+	    if (tlbSize > 0)
+		cout << ", TLB hits " << cpuTLBHits[i] << ", misses "
+		     << cpuTLBMisses[i];
+	    cout << ", decodes " << cpuDecodes[i] << "\n";
+	    if (cpuBusyTicks[i] > longest)
+		longest = cpuBusyTicks[i];
+	}
+	cout << "Elapsed on " << numCpus << " CPUs in parallel: about ";
+		cout << longest + idleTicks << " ticks\n";
+    }
+    cout << "Thread stacks: allocated " << numStackAllocs;
+		cout << ", reused " << numStackReuses;
+		cout << "; tasks run without a thread " << numTasks;
+		cout << ", by the thread pool " << numPoolTasks << "\n";
+    SlabCache::PrintAll();
     cout << "Network I/O: packets received " << numPacketsRecvd;
-		cout << ", sent " << numPacketsSent << "\n";
+		cout << ", sent " << numPacketsSent;
+		cout << " (to groups " << numGroupSends << ")";
+		cout << "; messages retransmitted " << numRetransmits << "\n";
+    if (numRpcRequests + numRpcRetries > 0) {
+	cout << "RPC: requests served " << numRpcRequests;
+		cout << " in " << numRpcBatches << " batches";
+		cout << "; calls sent again " << numRpcRetries << "\n";
+    }
+    if (numRemoteHits + numRemoteMisses + numRemoteWrites + numLeaseWaits
+								> 0) {
+	cout << "Remote files: blocks read from the cache " << numRemoteHits;
+		cout << ", from the server " << numRemoteMisses;
+		cout << "; leases renewed " << numRemoteAttrFetches;
+		cout << "; writes " << numRemoteWrites;
+		cout << ", put off for leases " << numLeaseWaits << "\n";
+    }
+    for (int i = 0; i < MaxHosts; i++) {
+	if (hostPacketsSent[i] + hostPacketsRecvd[i] + hostPacketsDropped[i]
+								> 0) {
+	    cout << "Host " << i << ": packets sent " << hostPacketsSent[i];
+		cout << ", received " << hostPacketsRecvd[i];
+		cout << ", dropped " << hostPacketsDropped[i] << "\n";
+	}
+    }
+    if (numPacketsRecvd > 0) {
+	cout << "Link down from the switch: queued " << linkQueueTicks;
+		cout << " ticks, at most " << maxLinkQueue << " packets\n";
+    }
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	if (numSyscalls[i] > 0) {
+	    cout << "System call " << syscallName[i] << ": calls ";
+		cout << numSyscalls[i] << ", ticks " << syscallTicks[i];
+		cout << ", host usec " << (int) syscallHostTime[i];
+	    if (syscallLatency[i] != NULL)
+		syscallLatency[i]->Print();
+	    cout << "\n";
+	}
+    }
+    hostTime = HostTime() - hostStartTime;
+    cout << "Host time: usec " << (int) hostTime;
+    if ((instrs > 0) && (hostTime > 0))
+	cout << ", user instructions per usec (MIPS) " << instrs / hostTime;
+    cout << "\n";
+}
+
+//----------------------------------------------------------------------
+// Statistics::ExportHistograms/WriteHistograms
+// 	Write the histograms to "fileName", a line for each of their
+//	percentiles and buckets used, in a form easy for other programs
+//	to read:
+//
+//		disk p99 12799
+//		disk bucket 12288 12799 3
+//
+//	the last giving the values a bucket counts and how many there
+//	were.  System calls are named "syscall.<name>".
+//----------------------------------------------------------------------
+
+void
+Statistics::ExportHistograms(char *fileName)
+{
+    FILE *file = fopen(fileName, "w");
+
+    if (file == NULL) {
+	cerr << "Cannot write histograms " << fileName << "\n";
+	return;
+    }
+    WriteHistograms(file);
+    fclose(file);
+}
+
+void
+Statistics::WriteHistograms(FILE *file)
+{
+    char name[64];
+
+    diskLatency.Export(file, "disk");
+    readyWait.Export(file, "ready");
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	if (syscallLatency[i] != NULL) {
+	    snprintf(name, sizeof(name), "syscall.%s", syscallName[i]);
+	    syscallLatency[i]->Export(file, name);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// Statistics::WriteCounters
+// 	Write the main counters to "file", in the form of the histograms
+//	(see ExportHistograms), a line each:
+//
+//		disk reads 118
+//		syscall.Read calls 40
+//
+//	for snapshots taken while Nachos runs (see threads/metrics.h).
+//----------------------------------------------------------------------
+
+void
+Statistics::WriteCounters(FILE *file)
+{
+    int instrs = 0, interrupts = 0;
+
+    for (int i = 0; i < NumInstrClasses; i++)
+	instrs += numInstrs[i];
+    for (int i = 0; i < MaxIntTypes; i++)
+	interrupts += numInterrupts[i];
+    fprintf(file, "ticks total %d\n", totalTicks);
+    fprintf(file, "ticks idle %d\n", idleTicks);
+    fprintf(file, "ticks system %d\n", systemTicks);
+    fprintf(file, "ticks user %d\n", userTicks);
+    fprintf(file, "host usec %.0f\n", HostTime() - hostStartTime);
+    fprintf(file, "instructions user %d\n", instrs);
+    fprintf(file, "threads switches %d\n", numContextSwitches);
+    fprintf(file, "threads lockwaits %d\n", numLockWaits);
+    fprintf(file, "interrupts total %d\n", interrupts);
+    fprintf(file, "disk reads %d\n", numDiskReads);
+    fprintf(file, "disk writes %d\n", numDiskWrites);
+    fprintf(file, "cache hits %d\n", numCacheHits);
+    fprintf(file, "cache misses %d\n", numCacheMisses);
+    fprintf(file, "paging faults %d\n", numPageFaults);
+    fprintf(file, "paging pageouts %d\n", numPageOuts);
+    fprintf(file, "tlb hits %d\n", numTLBHits);
+    fprintf(file, "tlb misses %d\n", numTLBMisses);
+    fprintf(file, "console read %d\n", numConsoleCharsRead);
+    fprintf(file, "console written %d\n", numConsoleCharsWritten);
+    fprintf(file, "network sent %d\n", numPacketsSent);
+    fprintf(file, "network received %d\n", numPacketsRecvd);
+    fprintf(file, "rpc requests %d\n", numRpcRequests);
+    for (int i = 0; i < MaxSyscallCodes; i++) {
+	if (numSyscalls[i] > 0)
+	    fprintf(file, "syscall.%s calls %d\n", syscallName[i],
+		    numSyscalls[i]);
+    }
+}
+
+//----------------------------------------------------------------------
+// Histogram::Histogram
+// 	Initialize an empty histogram.
+//----------------------------------------------------------------------
+
+Histogram::Histogram()
+{
+    for (int i = 0; i < HistBuckets; i++)
+	buckets[i] = 0;
+    count = max = 0;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Bucket
+// 	Return the bucket "value" is counted in: the value itself below
+//	2 * HistSubBuckets; above, shifted right until it is below that,
+//	which puts it in one of the top HistSubBuckets, then moved up
+//	HistSubBuckets buckets for each shift.
+//----------------------------------------------------------------------
+
+int
+Histogram::Bucket(int value)
+{
+    int shift = 0;
+
+    while ((value >> shift) >= 2 * HistSubBuckets)
+	shift++;
+    return shift * HistSubBuckets + (value >> shift);
+}
+
+//----------------------------------------------------------------------
+// Histogram::Low/High
+// 	Return the least and the most value counted in "bucket".
+//----------------------------------------------------------------------
+
+int
+Histogram::Low(int bucket)
+{
+    int shift = (bucket < 2 * HistSubBuckets) ? 0 :
+			bucket / HistSubBuckets - 1;
+
+    return (bucket - shift * HistSubBuckets) << shift;
+}
+
+int
+Histogram::High(int bucket)
+{
+    return (bucket + 1 < HistBuckets) ? Low(bucket + 1) - 1 : 0x7fffffff;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Record
+// 	Count one more "value"; negative values count as 0.
+//----------------------------------------------------------------------
+
+void
+Histogram::Record(int value)
+{
+    if (value < 0)
+	value = 0;
+    buckets[Bucket(value)]++;
+    count++;
+    if (value > max)
+	max = value;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Percentile
+// 	Return the most value counted in the bucket where the values
+//	recorded, in order, pass "fraction" of them -- no more than the
+//	largest value recorded.  0 if none has been.
+//----------------------------------------------------------------------
+
+int
+Histogram::Percentile(double fraction)
+{
+    int rank = (int)(fraction * count + 0.999999);	// rounded up
+    int seen = 0;
+
+    if (rank < 1)
+	rank = 1;
+    for (int i = 0; i < HistBuckets; i++) {
+	seen += buckets[i];
+	if (seen >= rank)
+	    return (High(i) < max) ? High(i) : max;
+    }
+    return max;
+}
+
+//----------------------------------------------------------------------
+// Histogram::Print
+// 	Print the 50th, 99th and 99.9th percentiles, following on from
+//	the rest of a line of the statistics.
+//----------------------------------------------------------------------
+
+void
+Histogram::Print()
+{
+    if (count == 0)
+	return;
+    cout << ", p50 " << Percentile(0.5) << ", p99 " << Percentile(0.99);
+	cout << ", p99.9 " << Percentile(0.999);
+}
+
+//----------------------------------------------------------------------
+// Histogram::Export
+// 	Write the count, percentiles and largest value, and then each
+//	bucket used, to "file", a line each, starting with "name".
+//----------------------------------------------------------------------
+
+void
+Histogram::Export(FILE *file, const char *name)
+{
+    if (count == 0)
+	return;
+    fprintf(file, "%s count %d\n", name, count);
+    fprintf(file, "%s p50 %d\n", name, Percentile(0.5));
+    fprintf(file, "%s p99 %d\n", name, Percentile(0.99));
+    fprintf(file, "%s p999 %d\n", name, Percentile(0.999));
+    fprintf(file, "%s max %d\n", name, max);
+    for (int i = 0; i < HistBuckets; i++) {
+	if (buckets[i] > 0)
+	    fprintf(file, "%s bucket %d %d %d\n", name, Low(i), High(i),
+		    buckets[i]);
+    }
 }
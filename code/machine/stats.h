@@ -12,6 +12,64 @@
 #define STATS_H
 
 #include "copyright.h"
+#include <stdio.h>
+
+#define MaxSyscallCodes	128	// system call codes counted (see
+					// userprog/syscall.h)
+#define MaxCpus		8	// simulated CPUs there can be (see
+					// threads/scheduler.h)
+#define MaxHosts	64	// machines there can be on the network
+					// (see machine/fabric.h)
+#define MaxIntTypes	16	// kinds of interrupt counted (see
+					// machine/interrupt.h)
+#define MaxSpaces	64	// programs whose paging is counted, by
+					// SpaceId (see threads/kernel.h)
+
+// The kinds of user instruction counted (see machine/mipssim.cc)
+enum InstrClass { ArithInstr, LoadInstr, StoreInstr, BranchInstr,
+		  MultDivInstr, OtherInstr, NumInstrClasses };
+
+// The resources each thread, and each program, is charged for (see
+// Thread::Account); in the order GetStats gives them (see
+// userprog/syscall.h)
+enum UsageKind { UsageUserTicks, UsageSystemTicks, UsageSectorsRead,
+		 UsageSectorsWritten, UsagePageFaults, UsageSyscalls,
+		 UsageVoluntarySwitches, UsageInvoluntarySwitches,
+		 NumUsageKinds };
+
+#define HistSubBuckets	16	// buckets per doubling of a histogram
+#define HistBuckets	(28 * HistSubBuckets)	// enough for any int
+
+// The following class defines a histogram of times, in ticks.  Each
+// value up to 2 * HistSubBuckets has a bucket of its own; above that,
+// each doubling of the value is split into HistSubBuckets buckets of
+// equal width, so a value is known to within 1/HistSubBuckets of
+// itself however large it is.  Recording a value costs a few shifts.
+
+class Histogram {
+  public:
+    Histogram();		// empty
+
+    void Record(int value);	// count one more time of "value"
+    int Count() { return count; }
+    int Percentile(double fraction);
+				// the value no more than "fraction" of
+				// those recorded lie above (to within
+				// its bucket)
+    void Print();		// p50, p99 and p99.9, on cout
+    void Export(FILE *file, const char *name);
+				// the same, and every bucket used, one
+				// line each, starting with "name"
+
+  private:
+    int buckets[HistBuckets];	// values recorded in each
+    int count;			// and in all
+    int max;			// the largest
+
+    static int Bucket(int value);	// where "value" is counted
+    static int Low(int bucket);		// the least value counted there
+    static int High(int bucket);	// and the most
+};
 
 // The following class defines the statistics that are to be kept
 // about Nachos behavior -- how much time (ticks) elapsed, how
@@ -27,18 +85,128 @@ class Statistics {
     int userTicks;       	// Time spent executing user code
 				// (this is also equal to # of
 				// user instructions executed)
+    int numInstrs[NumInstrClasses];	// user instructions of each kind
+    int numContextSwitches;	// times one thread gave the CPU to another
+    Histogram readyWait;	// time each thread dispatched had waited
+				// on a ready list
+    int numInterrupts[MaxIntTypes];	// interrupts handled, by IntType
+    const char *intTypeName[MaxIntTypes];	// name of each IntType
+    int numLockWaits;		// times a thread found a lock busy
+    int numDeadlineJobs;	// jobs real-time threads finished
+    int numDeadlineMisses;	// finished after their deadline
+    int maxLateness;		// the latest, by how long
+    int numBudgetOverruns;	// jobs that used up their budget
 
     int numDiskReads;		// number of disk read requests
     int numDiskWrites;		// number of disk write requests
+    const char *diskPolicy;	// how queued disk requests are scheduled
+    int diskLatencyTicks;	// total time from making a disk request
+				// to its completion, waiting included
+    Histogram diskLatency;	// and the time for each
+    int maxDiskLatency;		// longest time for one disk request
+    int diskSeekTracks;		// tracks the head moved, in all
+    int diskRotationTicks;	// time waiting for sectors to come round
+    int numTrackBufferHits;	// reads served from the track buffer
+    int numDiskCacheHits;	// reads served from the disk's own cache
+    int numDiskWritesCached;	// writes taken into its write cache
+    int numDiskSectorsDestaged;	// sectors written from it to the platter
+    int numDiskFlushes;		// number of disk flush requests
+    int numFlashPrograms;	// flash pages programmed
+    int numFlashErases;		// flash blocks erased
+    int numRaidParts;		// requests to the disks of a RAID volume
+    int numDedupHits;		// sectors written that shared a stored copy
+    int numDedupBlocks;		// copies stored in a deduplicated disk
+    int numCacheHits;		// number of sectors found in the buffer cache
+    int numCacheMisses;		// number of sectors not found there
+    int numReadAheads;		// number of sectors read ahead into the cache
+    int numFlushBehinds;	// number of times it was flushed in the
+				// background
+    int numSectorsFlushed;	// sectors written back then
+    int numSyncs;		// Fsync and Sync calls
+    int numJournalCommits;	// number of transactions written to the log
+    int numJournalBlocks;	// number of sectors logged in them
+    int numJournalReplays;	// number of transactions replayed at mount
+    int numChecksumsVerified;	// sectors read checked against their checksum
+    int numChecksumErrors;	// and found not to match it
+    int numFilesCompressed;	// files packed into compressed chunks
+    int numSectorsSaved;	// data sectors that freed
+    int numChunksExpanded;	// compressed chunks expanded to be read
+    int numFilesCloned;		// files cloned, sharing their data
+    int numClustersShared;	// data clusters they shared
+    int numClustersCopied;	// shared clusters copied to be written
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int spaceFaults[MaxSpaces];	// page faults of each program
+    int spaceMaxResident[MaxSpaces];	// most frames it had at once,
+					// with demand paging
+    int spaceCpuTicks[MaxSpaces];	// CPU time its threads had
+    int spaceUsage[MaxSpaces][NumUsageKinds];	// what its threads were
+						// charged for, by UsageKind
+    int numPagesPrefetched;	// pages brought in ahead of a fault
+    int numPrefetchHits;	// and touched before the next one
+    const char *pagePolicy;	// how pages are replaced
+    int numPageOuts;		// number of changed pages written to swap
+    int numPageCopies;		// number of pages copied on write
+    int numPageEntries;		// entries in hashed page tables now
+    int maxPageEntries;		// and the most there were at once
+    int numExecCacheHits;	// programs run from a cached image
+    int numExecCacheMisses;	// programs whose image was read
+    int tlbSize;		// entries in the TLB, 0 if there is none
+    const char *tlbPolicy;	// how TLB entries are replaced
+    int numTLBHits;		// number of translations found in the TLB
+    int numTLBMisses;		// number that had to be loaded into it
+    int numSuperPages;		// entries loaded that map a run of pages
+    int numCpus;		// simulated CPUs threads are run on
+    int cpuBusyTicks[MaxCpus];	// time each spent running threads
+    int cpuDispatches[MaxCpus];	// number of threads it was given
+    int cpuSteals[MaxCpus];	// number it took from another's list
+    int cpuTLBHits[MaxCpus];	// translations found in its TLB
+    int cpuTLBMisses[MaxCpus];	// and not
+    int cpuDecodes[MaxCpus];	// instructions it had to decode
+    int numStackAllocs;		// number of thread stacks allocated
+    int numStackReuses;		// number taken from the pool instead
+    int numTasks;		// number of tasks posted (see taskqueue.h)
+    int numPoolTasks;		// number run by the thread pool
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
+    int numGroupSends;		// packets sent to a group of machines
+    int numRetransmits;		// messages a Connection sent again
+    int numRpcRequests;		// requests RPC servers here took
+    int numRpcBatches;		// in how many goes
+    int numRpcRetries;		// requests RPC clients here sent again
+    int numRemoteHits;		// remote file blocks read from the cache
+    int numRemoteMisses;	// and from the server
+    int numRemoteAttrFetches;	// times a lease was renewed to read
+    int numRemoteWrites;	// writes sent to the server
+    int numLeaseWaits;		// times the server put a write off
+    int hostPacketsSent[MaxHosts];	// packets sent to each machine
+    int hostPacketsRecvd[MaxHosts];	// packets received from each
+    int hostPacketsDropped[MaxHosts];	// and dropped by the switch
+    int linkQueueTicks;		// total time packets waited at the switch
+				// for the link down to this machine
+    int maxLinkQueue;		// most packets ever waiting there
+    const char *syscallName[MaxSyscallCodes];
+				// name of each system call made
+    int numSyscalls[MaxSyscallCodes];	// number of times each was made
+    int syscallTicks[MaxSyscallCodes];	// simulated time spent in them
+    double syscallHostTime[MaxSyscallCodes];
+				// and host microseconds
+    Histogram *syscallLatency[MaxSyscallCodes];
+				// and the time for each, NULL until one
+				// is made (kept apart, to keep the
+				// statistics small for the batch runner)
+    double hostStartTime;	// host time Nachos started, in
+				// microseconds
 
     Statistics(); 		// initialize everything to zero
 
     void Print();		// print collected statistics
+    void ExportHistograms(char *fileName);
+				// write the histograms to "fileName", to
+				// be read by other programs
+    void WriteHistograms(FILE *file);	// the same, to an open file
+    void WriteCounters(FILE *file);	// and the main counters
 };
 
 // Constants used to reflect the relative time an operation would
@@ -53,8 +221,14 @@ const int UserTick = 	   1;	// advance for each user-level instruction
 const int SystemTick =	  10; 	// advance each time interrupts are enabled
 const int RotationTime = 500; 	// time disk takes to rotate one sector
 const int SeekTime =	 500;  	// time disk takes to seek past one track
+const int FlashReadTime = 50;	// time flash takes to read a page
+const int FlashTransferTime = 10; // to move a sector on a flash channel
+const int FlashProgramTime = 500; // to program a page
+const int FlashEraseTime = 3000; // to erase a block of pages
 const int ConsoleTime =	 100;	// time to read or write one character
 const int NetworkTime =	 100;  	// time to send or receive one packet
 const int TimerTicks = 	 100;  	// (average) time between timer interrupts
+const int MemWordTime =	   2;	// to move a word in MemCopy or MemSet (a
+					// load and a store, in a user loop)
 
 #endif // STATS_H
@@ -40,6 +40,8 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
     randomize = doRandom;
     callPeriodically = toCall;
     disable = FALSE;
+    stopped = FALSE;
+    scheduled = FALSE;
     SetInterrupt();
 }
 
@@ -51,6 +53,10 @@ Timer::Timer(bool doRandom, CallBackObj *toCall)
 //----------------------------------------------------------------------
 void Timer::CallBack()
 {
+    scheduled = FALSE;
+    if (stopped)
+        return; // stopped since this one was scheduled
+
     // invoke the Nachos interrupt handler for this device
     callPeriodically->CallBack();
 
@@ -58,16 +64,31 @@ void Timer::CallBack()
                     // decide if it wants to disable future interrupts
 }
 
+//----------------------------------------------------------------------
+// Timer::Start
+//      Start generating interrupts again after Stop.  An interrupt
+//	scheduled before the timer was stopped may not have happened
+//	yet; it then carries on from there, rather than a second one
+//	being scheduled.
+//----------------------------------------------------------------------
+
+void Timer::Start()
+{
+    stopped = FALSE;
+    if (!scheduled)
+        SetInterrupt();
+}
+
 //----------------------------------------------------------------------
 // Timer::SetInterrupt
 //      Cause a timer interrupt to occur in the future, unless
-//	future interrupts have been disabled.  The delay is either
-//	fixed or random.
+//	future interrupts have been disabled or stopped.  The delay is
+//	either fixed or random.
 //----------------------------------------------------------------------
 
 void Timer::SetInterrupt()
 {
-    if (!disable)
+    if (!disable && !stopped)
     {
         int delay = TimerTicks;
 
@@ -77,5 +98,6 @@ void Timer::SetInterrupt()
         }
         // schedule the next timer device interrupt
         kernel->interrupt->Schedule(this, delay, TimerInt);
+        scheduled = TRUE;
     }
 }
@@ -35,12 +35,18 @@ class Timer : public CallBackObj {
     void Disable() { disable = TRUE; }
     				// Turn timer device off, so it doesn't
 				// generate any more interrupts.
+    void Stop() { stopped = TRUE; }
+    				// Generate none after the next one,
+				// until started again
+    void Start();		// Generate them again, if stopped
 
   private:
     bool randomize;		// set if we need to use a random timeout delay
     CallBackObj *callPeriodically; // call this every TimerTicks time units 
     bool disable;		// turn off the timer device after next
     				// interrupt.
+    bool stopped;		// off until Start
+    bool scheduled;		// is an interrupt on its way?
     
     void CallBack();		// called internally when the hardware
 				// timer generates an interrupt
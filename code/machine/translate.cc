@@ -12,7 +12,9 @@
 //	Translation lookaside buffer -- associative lookup in the table
 //	to find an entry with the same virtual page #.  If found,
 //	this entry is used for the translation.
-//	If not, it traps to software with an exception.
+//	If not, it traps to software with an exception.  An entry may
+//	map a superpage: an aligned run of numPages pages, contiguous in
+//	physical memory, so that a few entries reach far more memory.
 //
 //	In practice, the TLB is much smaller than the amount of physical
 //	memory (16 entries is common on a machine that has 1000's of
@@ -23,6 +25,11 @@
 //	Note that the contents of the TLB are specific to an address space.
 //	If the address space changes, so does the contents of the TLB!
 //
+//	With a page table, the simulator also keeps the last translation
+//	of each of a few virtual pages, so that most references need no
+//	table lookup at all.  This is not simulated hardware; only the
+//	simulation gets faster.
+//
 // DO NOT CHANGE -- part of the machine emulation
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
@@ -32,43 +39,8 @@
 #include "copyright.h"
 #include "main.h"
 
-// Routines for converting Words and Short Words to and from the
-// simulated machine's format of little endian.  These end up
-// being NOPs when the host machine is also little endian (DEC and Intel).
-
-unsigned int
-WordToHost(unsigned int word)
-{
-#ifdef HOST_IS_BIG_ENDIAN
-	register unsigned long result;
-	result = (word >> 24) & 0x000000ff;
-	result |= (word >> 8) & 0x0000ff00;
-	result |= (word << 8) & 0x00ff0000;
-	result |= (word << 24) & 0xff000000;
-	return result;
-#else
-	return word;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned short
-ShortToHost(unsigned short shortword)
-{
-#ifdef HOST_IS_BIG_ENDIAN
-	register unsigned short result;
-	result = (shortword << 8) & 0xff00;
-	result |= (shortword >> 8) & 0x00ff;
-	return result;
-#else
-	return shortword;
-#endif /* HOST_IS_BIG_ENDIAN */
-}
-
-unsigned int
-WordToMachine(unsigned int word) { return WordToHost(word); }
-
-unsigned short
-ShortToMachine(unsigned short shortword) { return ShortToHost(shortword); }
+// The routines for converting Words and Short Words to and from the
+// simulated machine's format of little endian are inline, in machine.h.
 
 //----------------------------------------------------------------------
 // Machine::ReadMem
@@ -191,6 +163,19 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 	unsigned int vpn, offset;
 	TranslationEntry *entry;
 	unsigned int pageFrame;
+	FastTranslation *fast;
+
+	// the common case: a page translated just before, with nothing to
+	// check or change in its entry this time, and a properly aligned
+	// address (sizes are 1, 2 or 4)
+	vpn = (unsigned)virtAddr / PageSize;
+	fast = &fastTranslations[vpn & (NumFastTranslations - 1)];
+	if ((fast->virtualPage == (int)vpn) && (!writing || fast->writable) &&
+		((virtAddr & (size - 1)) == 0))
+	{
+		*physAddr = fast->frameAddress + (unsigned)virtAddr % PageSize;
+		return NoException;
+	}
 
 	DEBUG(dbgAddr, "\tTranslate " << virtAddr << (writing ? " , write" : " , read"));
 
@@ -222,11 +207,14 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 			return PageFaultException;
 		}
 		entry = &pageTable[vpn];
+		pageFrame = entry->physicalPage;
 	}
 	else
 	{
-		for (entry = NULL, i = 0; i < TLBSize; i++)
-			if (tlb[i].valid && (tlb[i].virtualPage == ((int)vpn)))
+		for (entry = NULL, i = 0; i < tlbSize; i++)
+			if (tlb[i].valid && (tlb[i].asid == asid) &&
+				((vpn - (unsigned)tlb[i].virtualPage) <
+				 (unsigned)tlb[i].numPages))
 			{
 				entry = &tlb[i]; // FOUND!
 				break;
@@ -234,10 +222,16 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 		if (entry == NULL)
 		{ // not found
 			DEBUG(dbgAddr, "Invalid TLB entry for this virtual page!");
+			kernel->stats->numTLBMisses++;
+			kernel->stats->cpuTLBMisses[kernel->currentThread->cpu]++;
 			return PageFaultException; // really, this is a TLB fault,
 									   // the page may be in memory,
 									   // but not in the TLB
 		}
+		kernel->stats->numTLBHits++;
+		kernel->stats->cpuTLBHits[kernel->currentThread->cpu]++;
+		entry->lastUse = kernel->stats->numTLBHits;
+		pageFrame = entry->physicalPage + (vpn - entry->virtualPage);
 	}
 
 	if (entry->readOnly && writing)
@@ -245,7 +239,6 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 		DEBUG(dbgAddr, "Write to read-only page at " << virtAddr);
 		return ReadOnlyException;
 	}
-	pageFrame = entry->physicalPage;
 
 	// if the pageFrame is too big, there is something really wrong!
 	// An invalid translation was loaded into the page table or TLB.
@@ -258,7 +251,41 @@ Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
 	if (writing)
 		entry->dirty = TRUE;
 	*physAddr = pageFrame * PageSize + offset;
+	if (writing && (numWatchpoints > 0) && Watched(virtAddr, size))
+	{
+		// stop once the store is done (see Machine::Debugger)
+		cout << "Watchpoint: store to " << virtAddr << " at PC "
+			 << registers[PCReg] << "\n";
+		stopped = TRUE;
+		runLength = 0;
+	}
+
+	// Until the page table changes, further references to this page
+	// will find the use bit (and, if set, the dirty bit) as they are
+	// now.  Not when debugging, so that every reference is printed,
+	// nor for stores to a page with a watchpoint.
+	if ((tlb == NULL) && !debug->IsEnabled(dbgAddr))
+	{
+		fast->virtualPage = vpn;
+		fast->frameAddress = pageFrame * PageSize;
+		fast->writable = !entry->readOnly && entry->dirty &&
+						 !((numWatchpoints > 0) &&
+						   Watched(vpn * PageSize, PageSize));
+	}
 	ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
 	DEBUG(dbgAddr, "phys addr = " << *physAddr);
 	return NoException;
 }
+
+//----------------------------------------------------------------------
+// Machine::FlushTranslations
+// 	Forget every translation Translate has kept, because the page
+//	table, or an entry in it, may have changed.  The next reference
+//	to each page goes through the page table again.
+//----------------------------------------------------------------------
+
+void Machine::FlushTranslations()
+{
+	for (int i = 0; i < NumFastTranslations; i++)
+		fastTranslations[i].virtualPage = -1;
+}
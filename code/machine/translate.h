@@ -40,6 +40,25 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// TLB only: the address space the entry
+			// belongs to; see Machine::asid
+    int numPages;	// TLB only: how many pages the entry maps,
+			// from virtualPage and physicalPage on: 1,
+			// or a superpage -- a power of 2, up to
+			// MaxSuperPage, that both are multiples of
+    unsigned int lastUse; // TLB only: set by the hardware every time
+			// the entry is used, from the count of TLB hits
+};
+
+// The following class defines an entry in the simulator's own cache of
+// recent page table translations (see Machine::Translate).  It is not
+// part of the simulated hardware: the kernel never sees it.
+
+class FastTranslation {
+  public:
+    int virtualPage;	// the page translated, or -1 if none
+    int frameAddress;	// where in "mainMemory" the page starts
+    bool writable;	// a write needs no checks or bit changes
 };
 
 #endif
@@ -18,24 +18,26 @@
 
 #include "copyright.h"
 #include "post.h"
+#include "slab.h"
+
+static SlabCache mailCache("mail", sizeof(Mail));
 
 //----------------------------------------------------------------------
-// Mail::Mail
-//      Initialize a single mail message, by concatenating the headers to
-//	the data.
-//
-//	"pktH" -- source, destination machine ID's
-//	"mailH" -- source, destination mailbox ID's
-//	"data" -- payload data
+// Mail::operator new, Mail::operator delete
+// 	Take a message from its slab cache, and give it back.
 //----------------------------------------------------------------------
 
-Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
+void *
+Mail::operator new(size_t size)
 {
-    ASSERT(mailH.length <= MaxMailSize);
+    ASSERT(size == sizeof(Mail));
+    return mailCache.Alloc();
+}
 
-    pktHdr = pktH;
-    mailHdr = mailH;
-    bcopy(msgData, data, mailHdr.length);
+void
+Mail::operator delete(void *p)
+{
+    mailCache.Free(p);
 }
 
 //----------------------------------------------------------------------
@@ -50,6 +52,7 @@ Mail::Mail(PacketHeader pktH, MailHeader mailH, char *msgData)
 MailBox::MailBox()
 { 
     messages = new SynchList<Mail *>(); 
+    partial = new List<Mail *>;
 }
 
 //----------------------------------------------------------------------
@@ -63,6 +66,9 @@ MailBox::MailBox()
 MailBox::~MailBox()
 { 
     delete messages; 
+    while (!partial->IsEmpty())
+	delete partial->RemoveFront();
+    delete partial;
 }
 
 //----------------------------------------------------------------------
@@ -86,54 +92,125 @@ PrintHeader(PacketHeader pktHdr, MailHeader mailHdr)
 // 	Add a message to the mailbox.  If anyone is waiting for message
 //	arrival, wake them up!
 //
-//	We need to reconstruct the Mail message (by concatenating the headers
-//	to the data), to simplify queueing the message on the SynchList.
-//
-//	"pktHdr" -- source, destination machine ID's
-//	"mailHdr" -- source, destination mailbox ID's
-//	"data" -- payload message data
+//	"mail" -- the message; the mailbox owns it from now on
 //----------------------------------------------------------------------
 
 void 
-MailBox::Put(PacketHeader pktHdr, MailHeader mailHdr, char *data)
+MailBox::Put(Mail *mail)
 { 
-    Mail *mail = new Mail(pktHdr, mailHdr, data); 
-
     messages->Append(mail);		// put on the end of the list of 
 					// arrived messages, and wake up 
 					// any waiters
 }
 
+//----------------------------------------------------------------------
+// MailBox::PutFragment
+// 	Add a fragment of a message to what has arrived of the message,
+//	and put the message into the mailbox once all of it has.  The
+//	first fragment becomes the Mail for the whole message.
+//
+//	The network delivers packets in order, so a fragment that is not
+//	the next one expected -- or that belongs to a later message from
+//	the same sender -- means one was lost; the incomplete message is
+//	thrown away.  So is a fragment whose message's start was lost.
+//
+//	"fragment" -- one packet of a message; the mailbox owns it from
+//		now on
+//----------------------------------------------------------------------
+
+void
+MailBox::PutFragment(Mail *fragment)
+{
+    MailHeader *hdr = &fragment->mailHdr;
+    Mail *mail = NULL;
+    ListIterator<Mail *> iter(partial);
+
+    for (; !iter.IsDone(); iter.Next()) {
+	if ((iter.Item()->pktHdr.from == fragment->pktHdr.from) &&
+		(iter.Item()->mailHdr.from == hdr->from)) {
+	    mail = iter.Item();
+	    break;
+	}
+    }
+    if ((mail != NULL) && ((mail->mailHdr.msgId != hdr->msgId) ||
+			    (mail->received != hdr->offset))) {
+	DEBUG(dbgNet, "Fragment lost, dropping message " <<
+	      mail->mailHdr.msgId << " from " << mail->pktHdr.from);
+	partial->Remove(mail);
+	delete mail;
+	mail = NULL;
+    }
+
+    if (mail == NULL) {
+	if (hdr->offset != 0) {		// start of its message was lost
+	    delete fragment;
+	    return;
+	}
+	mail = fragment;
+	mail->message = new char[hdr->msgLength];
+	bcopy(mail->packet + sizeof(MailHeader), mail->message, hdr->length);
+	mail->received = hdr->length;
+	mail->mailHdr.length = hdr->msgLength;
+	partial->Append(mail);
+    } else {
+	bcopy(fragment->Data(), mail->message + hdr->offset, hdr->length);
+	mail->received += hdr->length;
+	delete fragment;
+    }
+
+    if (mail->received == mail->mailHdr.msgLength) {
+	partial->Remove(mail);
+	Put(mail);
+    }
+}
+
 //----------------------------------------------------------------------
 // MailBox::Get
-// 	Get a message from a mailbox, parsing it into the packet header,
-//	mailbox header, and data. 
+// 	Get a message from a mailbox.  The caller owns it from now on,
+//	and must delete it when done with it.
 //
 //	The calling thread waits if there are no messages in the mailbox.
-//
-//	"pktHdr" -- address to put: source, destination machine ID's
-//	"mailHdr" -- address to put: source, destination mailbox ID's
-//	"data" -- address to put: payload message data
 //----------------------------------------------------------------------
 
-void 
-MailBox::Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data) 
+Mail *
+MailBox::Get() 
 { 
     DEBUG(dbgNet, "Waiting for mail in mailbox");
     Mail *mail = messages->RemoveFront();	// remove message from list;
 						// will wait if list is empty
 
-    *pktHdr = mail->pktHdr;
-    *mailHdr = mail->mailHdr;
     if (debug->IsEnabled('n')) {
 	cout << "Got mail from mailbox: ";
-	PrintHeader(*pktHdr, *mailHdr);
+	PrintHeader(mail->pktHdr, mail->mailHdr);
     }
-    bcopy(mail->data, data, mail->mailHdr.length);
-					// copy the message data into
-					// the caller's buffer
-    delete mail;			// we've copied out the stuff we
-					// need, we can now discard the message
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// MailBox::Get
+// 	Get every message in a mailbox, up to "max", waiting if there
+//	are none.  The caller owns them from now on.
+//
+//	"mail" -- where to put them
+//	"max" -- how many there is room for
+//
+// Returns:
+//	How many there were.
+//----------------------------------------------------------------------
+
+int
+MailBox::Get(Mail **mail, int max)
+{
+    DEBUG(dbgNet, "Waiting for mail in mailbox");
+    int count = messages->RemoveFront(mail, max);
+
+    if (debug->IsEnabled('n')) {
+	for (int i = 0; i < count; i++) {
+	    cout << "Got mail from mailbox: ";
+	    PrintHeader(mail[i]->pktHdr, mail[i]->mailHdr);
+	}
+    }
+    return count;
 }
 
 //----------------------------------------------------------------------
@@ -185,33 +262,37 @@ PostOfficeInput::~PostOfficeInput()
 //
 //      Incoming messages have had the PacketHeader stripped off,
 //	but the MailHeader is still tacked on the front of the data.
+//	Each is read straight into the Mail that goes in the mailbox.
 //----------------------------------------------------------------------
 
 void
 PostOfficeInput::PostalDelivery(void* data)
 {
     PostOfficeInput* _this = (PostOfficeInput*)data;
-    PacketHeader pktHdr;
-    MailHeader mailHdr;
-    char *buffer = new char[MaxPacketSize];
 
     for (;;) {
+	Mail *mail = new Mail;
+
         // first, wait for a message
         _this->messageAvailable->P();	
-        pktHdr = _this->network->Receive(buffer);
+        mail->pktHdr = _this->network->Receive(mail->packet);
 
-        mailHdr = *(MailHeader *)buffer;
+        bcopy(mail->packet, (char *)&mail->mailHdr, sizeof(MailHeader));
         if (debug->IsEnabled('n')) {
 	    cout << "Putting mail into mailbox: ";
-	    PrintHeader(pktHdr, mailHdr);
+	    PrintHeader(mail->pktHdr, mail->mailHdr);
         }
 
 	// check that arriving message is legal!
-	ASSERT(0 <= mailHdr.to && mailHdr.to < _this->numBoxes);
-	ASSERT(mailHdr.length <= MaxMailSize);
-
-	// put into mailbox
-        _this->boxes[mailHdr.to].Put(pktHdr, mailHdr, buffer + sizeof(MailHeader));
+	ASSERT(0 <= mail->mailHdr.to && mail->mailHdr.to < _this->numBoxes);
+	ASSERT(mail->mailHdr.length <= MaxMailSize);
+	ASSERT(mail->mailHdr.msgLength <= MaxMessageSize);
+
+	// put into mailbox, or with the rest of its message
+	if (mail->mailHdr.length == mail->mailHdr.msgLength)
+	    _this->boxes[mail->mailHdr.to].Put(mail);
+	else
+	    _this->boxes[mail->mailHdr.to].PutFragment(mail);
     }
 }
 
@@ -234,10 +315,64 @@ void
 PostOfficeInput::Receive(int box, PacketHeader *pktHdr, 
 				MailHeader *mailHdr, char* data)
 {
+    Mail *mail = Receive(box);
+
+    *pktHdr = mail->pktHdr;
+    *mailHdr = mail->mailHdr;
+    bcopy(mail->Data(), data, mail->mailHdr.length);
+					// copy the message data into
+					// the caller's buffer
+    delete mail;			// we've copied out the stuff we
+					// need, we can now discard the message
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Receive
+// 	Retrieve a message from a specific box, as above, but without
+//	copying it: the message itself is returned, and the caller reads
+//	the headers and data (mail->Data()) in place.  The caller must
+//	delete the message when it is done with it.
+//
+//	"box" -- mailbox ID in which to look for message
+//----------------------------------------------------------------------
+
+Mail *
+PostOfficeInput::Receive(int box)
+{
+    Mail *mail;
+
+    ASSERT((box >= 0) && (box < numBoxes));
+
+    mail = boxes[box].Get();
+    ASSERT(mail->mailHdr.length <= MaxMessageSize);
+    return mail;
+}
+
+//----------------------------------------------------------------------
+// PostOfficeInput::Receive
+// 	Retrieve every message waiting in a box, up to "max", without
+//	copying them, waiting if there are none.  Each must be deleted
+//	once the caller is done with it.
+//
+//	"box" -- mailbox ID in which to look for messages
+//	"mail" -- where to put them
+//	"max" -- how many there is room for
+//
+// Returns:
+//	How many there were.
+//----------------------------------------------------------------------
+
+int
+PostOfficeInput::Receive(int box, Mail **mail, int max)
+{
+    int count;
+
     ASSERT((box >= 0) && (box < numBoxes));
 
-    boxes[box].Get(pktHdr, mailHdr, data);
-    ASSERT(mailHdr->length <= MaxMailSize);
+    count = boxes[box].Get(mail, max);
+    for (int i = 0; i < count; i++)
+	ASSERT(mail[i]->mailHdr.length <= MaxMessageSize);
+    return count;
 }
 
 //----------------------------------------------------------------------
@@ -267,6 +402,7 @@ PostOfficeOutput::PostOfficeOutput(double reliability)
 {
     messageSent = new Semaphore("message sent", 0);
     sendLock = new Lock("message send lock");
+    nextMsgId = 0;
 
     network = new NetworkOutput(reliability, this);
 }
@@ -283,11 +419,29 @@ PostOfficeOutput::~PostOfficeOutput()
     delete sendLock;
 }
 
+//----------------------------------------------------------------------
+// PostOfficeOutput::FragmentSize
+// 	Return how many bytes of message data fit in one packet, with
+//	the wire size in use.
+//----------------------------------------------------------------------
+
+int
+PostOfficeOutput::FragmentSize()
+{
+    return kernel->wireSize - sizeof(PacketHeader) - sizeof(MailHeader);
+}
+
 //----------------------------------------------------------------------
 // PostOfficeOutput::Send
 // 	Concatenate the MailHeader to the front of the data, and pass 
 //	the result to the Network for delivery to the destination machine.
 //
+//	A message too big for one packet goes as a train of fragments,
+//	each with a MailHeader saying where it goes in the message.  The
+//	fragments go out back to back: each is put together while the
+//	one before it is on the wire, and other threads' messages wait
+//	until the whole train has been sent.
+//
 //	Note that the MailHeader + data looks just like normal payload
 //	data to the Network.
 //
@@ -301,27 +455,41 @@ PostOfficeOutput::Send(PacketHeader pktHdr, MailHeader mailHdr, char* data)
 {
     char* buffer = new char[MaxPacketSize];	// space to hold concatenated
 						// mailHdr + data
+    unsigned fragSize = FragmentSize();
+    unsigned offset = 0;
 
     if (debug->IsEnabled('n')) {
 	cout << "Post send: ";
 	PrintHeader(pktHdr, mailHdr);
     }
-    ASSERT(mailHdr.length <= MaxMailSize);
+    ASSERT(mailHdr.length <= MaxMessageSize);
     ASSERT(0 <= mailHdr.to);
     
     // fill in pktHdr, for the Network layer
     pktHdr.from = kernel->hostName;
-    pktHdr.length = mailHdr.length + sizeof(MailHeader);
-
-    // concatenate MailHeader and data
-    bcopy((char *)&mailHdr, buffer, sizeof(MailHeader));
-    bcopy(data, buffer + sizeof(MailHeader), mailHdr.length);
+    mailHdr.msgLength = mailHdr.length;
 
     sendLock->Acquire();   		// only one message can be sent
 					// to the network at any one time
-    network->Send(pktHdr, buffer);
-    messageSent->P();			// wait for interrupt to tell us
-					// ok to send the next message
+    mailHdr.msgId = nextMsgId++;
+    for (bool first = TRUE; ; first = FALSE) {
+	// concatenate MailHeader and the next fragment of data, while
+	// the one before, if any, is still on the wire
+	mailHdr.offset = offset;
+	mailHdr.length = min(fragSize, mailHdr.msgLength - offset);
+	pktHdr.length = mailHdr.length + sizeof(MailHeader);
+	bcopy((char *)&mailHdr, buffer, sizeof(MailHeader));
+	bcopy(data + offset, buffer + sizeof(MailHeader), mailHdr.length);
+	offset += mailHdr.length;
+
+	if (!first)
+	    messageSent->P();		// wait for interrupt to tell us
+					// ok to send the next packet
+	network->Send(pktHdr, buffer);
+	if (offset >= mailHdr.msgLength)
+	    break;
+    }
+    messageSent->P();
     sendLock->Release();
 
     delete [] buffer;			// we've sent the message, so
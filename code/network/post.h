@@ -1,8 +1,13 @@
 // post.h 
 //	Data structures for providing the abstraction of unreliable,
-//	ordered, fixed-size message delivery to mailboxes on other 
-//	(directly connected) machines.  Messages can be dropped by
-//	the network, but they are never corrupted.
+//	ordered message delivery to mailboxes on other (directly
+//	connected) machines.  Messages can be dropped by the network,
+//	but they are never corrupted.
+//
+//	A message too big for one packet is sent as a train of packets
+//	(fragments), one right after another, and put back together by
+//	the post office of the machine it is sent to before it goes in
+//	the mailbox.  If any fragment is lost, the whole message is.
 //
 // 	The US Post Office (and Canada Post! -KMS)
 //      delivers mail to the addressed mailbox. 
@@ -48,29 +53,56 @@ class MailHeader {
     MailBoxAddress from;	// Mail box to reply to
     unsigned length;		// Bytes of message data (excluding the 
 				// mail header)
+
+    // Filled in by the PostOffice, to put fragments back together.
+    unsigned msgId;		// which message, of those this machine sent
+    unsigned msgLength;		// bytes in the whole message
+    unsigned offset;		// where this packet's data goes in it
 };
 
-// Maximum "payload" -- real data -- that can included in a single message
-// Excluding the MailHeader and the PacketHeader
+// Maximum "payload" -- real data -- that can included in a single packet
+// Excluding the MailHeader and the PacketHeader; with the default wire
+// size, less still (see FragmentSize)
 
 #define MaxMailSize 	(MaxPacketSize - sizeof(MailHeader))
 
+// Maximum size of a message, split into as many packets as it takes
+
+#define MaxMessageSize	8192
+
 
 // The following class defines the format of an incoming/outgoing 
 // "Mail" message.  The message format is layered: 
 //	network header (PacketHeader) 
 //	post office header (MailHeader) 
 //	data
+//
+// An incoming message is read straight off the network into a Mail,
+// which is then queued in its mailbox as it is; the data is never
+// copied again unless the thread receiving it asks for a copy.  A
+// message sent in fragments is put together in a buffer of its own.
+// Mail messages are allocated from a slab cache of their own (see
+// slab.h), so receiving does no heap allocation once enough have been
+// in use at once.
 
 class Mail {
   public:
-     Mail(PacketHeader pktH, MailHeader mailH, char *msgData);
-				// Initialize a mail message by
-				// concatenating the headers to the data
+     Mail() { message = NULL; received = 0; }
+     ~Mail() { delete [] message; }
 
      PacketHeader pktHdr;	// Header appended by Network
      MailHeader mailHdr;	// Header appended by PostOffice
-     char data[MaxMailSize];	// Payload -- message data
+     char packet[MaxPacketSize];// The message as it arrived: the
+				// MailHeader, then the data
+     char *message;		// A message put together from fragments,
+				// or NULL
+     unsigned received;		// Bytes of "message" that have arrived
+     char *Data() { return (message != NULL) ? message
+					     : packet + sizeof(MailHeader); }
+				// Payload -- message data
+
+     void *operator new(size_t size);	// take one from the slab cache
+     void operator delete(void *p);	// give one back to it
 };
 
 // The following class defines a single mailbox, or temporary storage
@@ -83,14 +115,23 @@ class MailBox {
     MailBox();			// Allocate and initialize mail box
     ~MailBox();			// De-allocate mail box
 
-    void Put(PacketHeader pktHdr, MailHeader mailHdr, char *data);
-   				// Atomically put a message into the mailbox
-    void Get(PacketHeader *pktHdr, MailHeader *mailHdr, char *data); 
-   				// Atomically get a message out of the 
-				// mailbox (and wait if there is no message 
-				// to get!)
+    void Put(Mail *mail);	// Atomically put a message into the
+				// mailbox, which now owns it
+    void PutFragment(Mail *fragment);
+				// Add a fragment to the message it is
+				// part of; put the message into the
+				// mailbox once it is complete
+    Mail *Get();		// Atomically get a message out of the
+				// mailbox (and wait if there is no message
+				// to get!); the caller now owns it
+    int Get(Mail **mail, int max);
+				// The same, but get every message there
+				// is, up to "max"
   private:
     SynchList<Mail *> *messages; // A mailbox is just a list of arrived messages
+    List<Mail *> *partial;	// Messages whose fragments are still
+				// arriving, at most one per sender;
+				// only the postal worker touches it
 };
 
 // The following two classes defines a "Post Office", or a collection of 
@@ -111,6 +152,13 @@ class PostOfficeInput : public CallBackObj {
 		MailHeader *mailHdr, char *data);
     				// Retrieve a message from "box".  Wait if
 				// there is no message in the box.
+    Mail *Receive(int box);	// The same, without copying: return
+				// the message itself, to be deleted
+				// once the caller is done with it
+    int Receive(int box, Mail **mail, int max);
+				// The same, for every message waiting
+				// in "box", up to "max"; return how
+				// many
 
     static void PostalDelivery(void* data);
 				// Wait for incoming messages, 
@@ -137,8 +185,10 @@ class PostOfficeOutput : public CallBackObj {
 
     void Send(PacketHeader pktHdr, MailHeader mailHdr, char *data);
     				// Send a message to a mailbox on a remote 
-				// machine.  The fromBox in the MailHeader is 
-				// the return box for ack's.
+				// machine, or on each machine of a group
+				// (see machine/fabric.h).  The fromBox in
+				// the MailHeader is the return box for ack's.
+    static int FragmentSize();	// Bytes of message data in each packet
 
     void CallBack();		// Called when outgoing packet has been 
 				// put on network; next packet can now be sent
@@ -147,5 +197,6 @@ class PostOfficeOutput : public CallBackObj {
     NetworkOutput *network;	// Physical network connection
     Semaphore *messageSent;	// V'ed when next message can be sent to network
     Lock *sendLock;		// Only one outgoing message at a time
+    unsigned nextMsgId;		// Identifies the next message sent
 };
 #endif
@@ -0,0 +1,423 @@
+// rpc.cc
+//	Routines for remote procedure calls: the server, which takes
+//	requests in batches and has a pool of workers serve them, and
+//	the client, which matches replies to calls by number and sends
+//	again requests that got none.
+//
+//	Replies arriving for a client are handled by a thread of its
+//	own.  As for a connection (see transport.cc), the retransmission
+//	timer goes off in an interrupt handler, which cannot send, so it
+//	posts a task to do so, and no lock is held while sending.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "rpc.h"
+#include "main.h"
+#include "taskqueue.h"
+
+// A request handed to a worker: the server, and the message.
+
+class RpcRequest {
+  public:
+    RpcServer *server;
+    Mail *mail;
+};
+
+//----------------------------------------------------------------------
+// RpcServer::RpcServer
+// 	Set up a server with no procedures yet, and fork the thread that
+//	takes its requests.  The workers are forked with the first batch.
+//
+//	"box" -- the mailbox requests arrive at
+//	"batch" -- most requests taken from it at once
+//	"numWorkers" -- threads running the handlers
+//----------------------------------------------------------------------
+
+RpcServer::RpcServer(MailBoxAddress box, int batch, int numWorkers)
+{
+    ASSERT(batch > 0);
+    this->box = box;
+    this->batch = batch;
+    for (int i = 0; i < MaxRpcProcs; i++) {
+	handlers[i] = NULL;
+	handlerArgs[i] = NULL;
+    }
+    workers = new ThreadPool("rpc worker", numWorkers);
+
+    Thread *t = new Thread("rpc server", 1);
+
+    t->Fork(RpcServer::Dispatch, this);
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Register
+// 	Serve procedure "proc" with "handler".  A request for it that
+//	arrived before is answered as for no such procedure.
+//
+//	"proc" -- the procedure's number
+//	"handler", "arg" -- what to call, and its first argument
+//----------------------------------------------------------------------
+
+void
+RpcServer::Register(int proc, RpcHandler handler, void *arg)
+{
+    ASSERT((proc >= 0) && (proc < MaxRpcProcs));
+    handlers[proc] = handler;
+    handlerArgs[proc] = arg;
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Dispatch
+// 	Body of the thread that takes a server's requests: wait for one,
+//	take it with every other already waiting, up to "batch", and
+//	queue them for the workers all at once.
+//
+//	"data" -- the server
+//----------------------------------------------------------------------
+
+void
+RpcServer::Dispatch(void *data)
+{
+    RpcServer *server = (RpcServer *)data;
+    Mail **mail = new Mail *[server->batch];
+    void **args = new void *[server->batch];
+
+    for (;;) {
+	int count = kernel->postOfficeIn->Receive(server->box, mail,
+						  server->batch);
+
+	for (int i = 0; i < count; i++) {
+	    RpcRequest *request = new RpcRequest;
+
+	    ASSERT(mail[i]->mailHdr.length >= sizeof(RpcHeader));
+	    request->server = server;
+	    request->mail = mail[i];
+	    args[i] = request;
+	}
+	DEBUG(dbgNet, "RPC server at box " << server->box << " took "
+	      << count << " requests");
+	kernel->stats->numRpcRequests += count;
+	kernel->stats->numRpcBatches++;
+	server->workers->SubmitBatch(RpcServer::Serve, args, count);
+    }
+}
+
+//----------------------------------------------------------------------
+// RpcServer::Serve
+// 	Task run by a worker: call the handler for one request, and send
+//	the reply back to the mailbox it came from.
+//
+//	"data" -- the request
+//----------------------------------------------------------------------
+
+void
+RpcServer::Serve(void *data)
+{
+    RpcRequest *request = (RpcRequest *)data;
+    RpcServer *server = request->server;
+    Mail *mail = request->mail;
+    char *buffer = new char[MaxMessageSize];
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    RpcHeader hdr;
+    int length = -1;
+
+    bcopy(mail->Data(), (char *)&hdr, sizeof(RpcHeader));
+    if ((hdr.proc >= 0) && (hdr.proc < MaxRpcProcs) &&
+	    (server->handlers[hdr.proc] != NULL))
+	length = (*server->handlers[hdr.proc])(server->handlerArgs[hdr.proc],
+				mail->Data() + sizeof(RpcHeader),
+				mail->mailHdr.length - sizeof(RpcHeader),
+				buffer + sizeof(RpcHeader));
+    ASSERT(length <= (int)MaxRpcSize);
+    if (length < 0) {
+	hdr.proc = -1;
+	length = 0;
+    }
+    bcopy((char *)&hdr, buffer, sizeof(RpcHeader));
+
+    pktHdr.to = mail->pktHdr.from;
+    mailHdr.to = mail->mailHdr.from;
+    mailHdr.from = server->box;
+    mailHdr.length = sizeof(RpcHeader) + length;
+    kernel->postOfficeOut->Send(pktHdr, mailHdr, buffer);
+    delete [] buffer;
+    delete mail;
+    delete request;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::RpcClient
+// 	Set up a client with no calls yet, and fork the thread that
+//	handles its replies.
+//
+//	"localBox" -- the mailbox replies arrive at
+//	"serverHost", "serverBox" -- the server's mailbox
+//	"window" -- most calls with no reply yet
+//----------------------------------------------------------------------
+
+RpcClient::RpcClient(MailBoxAddress localBox, NetworkAddress serverHost,
+		     MailBoxAddress serverBox, int window)
+{
+    ASSERT(window > 0);
+    this->localBox = localBox;
+    this->serverHost = serverHost;
+    this->serverBox = serverBox;
+    this->window = window;
+
+    lock = new Lock("rpc client");
+    windowOpen = new Condition("window open");
+    replyReady = new Condition("reply ready");
+
+    calls = new List<RpcCall *>;
+    numWaiting = 0;
+    nextId = 0;
+    timerSet = FALSE;
+
+    Thread *t = new Thread("rpc client", 1);
+
+    t->Fork(RpcClient::Deliver, this);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Send
+// 	Send a request, its header already in front, to the server.  The
+//	caller must not hold "lock".
+//
+//	"request", "length" -- the request
+//----------------------------------------------------------------------
+
+void
+RpcClient::Send(char *request, int length)
+{
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+
+    pktHdr.to = serverHost;
+    mailHdr.to = serverBox;
+    mailHdr.from = localBox;
+    mailHdr.length = length;
+    kernel->postOfficeOut->Send(pktHdr, mailHdr, request);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Start
+// 	Start a call: number it, keep a copy of the request until the
+//	reply arrives, and send it.  Wait first while "window" calls
+//	have no reply.  Returns once the request is on the network; the
+//	caller then waits for the reply with Wait, and may start other
+//	calls meanwhile.
+//
+//	"proc" -- the procedure to call
+//	"request", "length" -- its argument, at most MaxRpcSize bytes
+//----------------------------------------------------------------------
+
+RpcCall *
+RpcClient::Start(int proc, char *request, int length)
+{
+    RpcCall *call = new RpcCall;
+    RpcHeader hdr;
+
+    ASSERT((length >= 0) && (length <= (int)MaxRpcSize));
+    call->proc = hdr.proc = proc;
+    call->length = sizeof(RpcHeader) + length;
+    call->request = new char[call->length];
+    call->replied = FALSE;
+    call->reply = NULL;
+    call->replyLength = 0;
+
+    lock->Acquire();
+    while (numWaiting >= window)
+	windowOpen->Wait(lock);
+    call->id = hdr.id = nextId++;
+    bcopy((char *)&hdr, call->request, sizeof(RpcHeader));
+    if (length > 0)
+	bcopy(request, call->request + sizeof(RpcHeader), length);
+    call->sentAt = kernel->stats->totalTicks;
+    calls->Append(call);
+    numWaiting++;
+    SetTimer();
+    lock->Release();
+
+    Send(call->request, call->length);
+    return call;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Wait
+// 	Wait for the reply to a call, copy it out, and forget the call.
+//
+//	"call" -- what Start returned
+//	"reply" -- where to put the reply; must hold MaxRpcSize bytes
+//
+// Returns:
+//	The length of the reply, or -1 if the server has no such
+//	procedure.
+//----------------------------------------------------------------------
+
+int
+RpcClient::Wait(RpcCall *call, char *reply)
+{
+    int length;
+
+    lock->Acquire();
+    while (!call->replied)
+	replyReady->Wait(lock);
+    calls->Remove(call);
+    lock->Release();
+
+    length = call->replyLength;
+    if (length > 0)
+	bcopy(call->reply, reply, length);
+    delete [] call->reply;
+    delete [] call->request;
+    delete call;
+    return length;
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Call
+// 	Call a procedure, and wait for the reply.
+//
+//	"proc" -- the procedure to call
+//	"request", "length" -- its argument
+//	"reply" -- where to put the reply, as for Wait
+//----------------------------------------------------------------------
+
+int
+RpcClient::Call(int proc, char *request, int length, char *reply)
+{
+    return Wait(Start(proc, request, length), reply);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::SetTimer
+// 	Arrange for the retransmission timer to go off RpcTimeout from
+//	now, unless it is already set.  "lock" is held.
+//----------------------------------------------------------------------
+
+void
+RpcClient::SetTimer()
+{
+    if (timerSet)
+	return;
+    timerSet = TRUE;
+    kernel->alarm->CallAfter(RpcTimeout, this);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Deliver
+// 	Body of the thread that handles the replies arriving for a
+//	client: find the call each is for, by its number, and wake up
+//	whoever is waiting for it.  A reply for a call that already has
+//	one -- the request was sent again -- is thrown away.
+//
+//	"data" -- the client
+//----------------------------------------------------------------------
+
+void
+RpcClient::Deliver(void *data)
+{
+    RpcClient *client = (RpcClient *)data;
+
+    for (;;) {
+	Mail *mail = kernel->postOfficeIn->Receive(client->localBox);
+	RpcHeader hdr;
+	int length = mail->mailHdr.length - sizeof(RpcHeader);
+
+	ASSERT(mail->mailHdr.length >= sizeof(RpcHeader));
+	bcopy(mail->Data(), (char *)&hdr, sizeof(RpcHeader));
+
+	client->lock->Acquire();
+	ListIterator<RpcCall *> iter(client->calls);
+
+	for (; !iter.IsDone(); iter.Next()) {
+	    RpcCall *call = iter.Item();
+
+	    if ((call->id != hdr.id) || call->replied)
+		continue;
+	    call->replied = TRUE;
+	    if (hdr.proc < 0)
+		call->replyLength = -1;
+	    else {
+		call->replyLength = length;
+		call->reply = new char[length + 1];
+		bcopy(mail->Data() + sizeof(RpcHeader), call->reply, length);
+	    }
+	    client->numWaiting--;
+	    client->windowOpen->Broadcast(client->lock);
+	    client->replyReady->Broadcast(client->lock);
+	    break;
+	}
+	client->lock->Release();
+	delete mail;
+    }
+}
+
+//----------------------------------------------------------------------
+// RpcClient::CallBack
+// 	Interrupt handler for the retransmission timer.  Sending cannot
+//	be done here, since it waits; leave it to a task.
+//----------------------------------------------------------------------
+
+void
+RpcClient::CallBack()
+{
+    kernel->taskQueue->Post(RpcClient::Retransmit, this);
+}
+
+//----------------------------------------------------------------------
+// RpcClient::Retransmit
+// 	The retransmission timer has gone off.  Send again each request
+//	that has gone RpcTimeout without a reply, and set the timer again
+//	while any call has none.
+//
+//	Tasks have small stacks, so the copy of a request is not kept on
+//	the stack.
+//
+//	"data" -- the client
+//----------------------------------------------------------------------
+
+void
+RpcClient::Retransmit(void *data)
+{
+    RpcClient *client = (RpcClient *)data;
+    int now = kernel->stats->totalTicks;
+
+    client->lock->Acquire();
+    client->timerSet = FALSE;
+    for (;;) {
+	ListIterator<RpcCall *> iter(client->calls);
+	RpcCall *late = NULL;
+	char *buffer;
+	int length;
+
+	for (; !iter.IsDone(); iter.Next()) {
+	    if (!iter.Item()->replied &&
+		    (now - iter.Item()->sentAt >= RpcTimeout)) {
+		late = iter.Item();
+		break;
+	    }
+	}
+	if (late == NULL)
+	    break;
+	late->sentAt = now;
+	length = late->length;
+	buffer = new char[length];
+	bcopy(late->request, buffer, length);
+	kernel->stats->numRpcRetries++;
+	DEBUG(dbgNet, "Sending call " << late->id << " again to "
+	      << client->serverHost << ", box " << client->serverBox);
+
+	client->lock->Release();
+	client->Send(buffer, length);
+	delete [] buffer;
+	client->lock->Acquire();
+    }
+    if (client->numWaiting > 0)
+	client->SetTimer();
+    client->lock->Release();
+}
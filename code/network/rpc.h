@@ -0,0 +1,154 @@
+// rpc.h
+//	Data structures for remote procedure calls between machines, on
+//	top of the post office (see post.h).
+//
+//	A server serves the procedures registered with it, by number,
+//	at one mailbox.  A client calls them from a mailbox of its own.
+//	Each call gets a number, which the reply carries back, so a
+//	client can have several calls on their way at once -- up to its
+//	"window" -- and wait for each when it needs the result.
+//
+//	The server takes every request waiting in its mailbox at once,
+//	up to "batch" of them, and hands them together to a pool of
+//	worker threads, which run the handlers and send the replies.
+//	Requests from different calls may so be served in any order.
+//
+//	The post office may drop messages.  A client sends a request
+//	again if no reply has come within RpcTimeout, so a handler may
+//	be run more than once for one call, and should do no harm if it
+//	is (storing the same value again, say).  Requests and replies
+//	may be up to MaxRpcSize bytes.  Servers and clients last until
+//	Nachos halts, and each must have a mailbox to itself.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef RPC_H
+#define RPC_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "post.h"
+#include "synch.h"
+#include "threadpool.h"
+
+#define MaxRpcProcs	16	// procedures a server can have
+#define RpcWindow	8	// calls a client has on their way, by default
+#define RpcBatch	8	// requests a server takes at once, by default
+#define NumRpcWorkers	4	// threads running a server's handlers
+
+#define RpcTimeout	(40 * NetworkTime)
+				// how long a client waits for a reply
+				// before sending the request again
+
+// The following class defines the header in front of each request
+// and reply, inside the mail data.
+
+class RpcHeader {
+  public:
+    unsigned id;		// the call, numbered by the client
+    int proc;			// the procedure called; in a reply,
+				// -1 if the server has no such procedure
+};
+
+#define MaxRpcSize	(MaxMessageSize - sizeof(RpcHeader))
+
+// A procedure a server serves: given the request, put the reply in
+// "reply" (MaxRpcSize bytes) and return its length.
+
+typedef int (*RpcHandler)(void *arg, char *request, int length,
+			  char *reply);
+
+// The following class defines a server.
+
+class RpcServer {
+  public:
+    RpcServer(MailBoxAddress box, int batch = RpcBatch,
+	      int numWorkers = NumRpcWorkers);
+				// Serve requests arriving at "box"
+
+    void Register(int proc, RpcHandler handler, void *arg);
+				// Serve procedure "proc" by calling
+				// (*handler)(arg, ...)
+
+  private:
+    MailBoxAddress box;		// where requests arrive
+    int batch;			// most requests taken at once
+    RpcHandler handlers[MaxRpcProcs];	// NULL if not registered
+    void *handlerArgs[MaxRpcProcs];
+    ThreadPool *workers;	// run the handlers
+
+    static void Dispatch(void *data);
+				// body of the thread taking requests
+				// from "box"
+    static void Serve(void *data);
+				// task run by a worker: serve one
+};
+
+// The following class defines one call made by a client, from the
+// time it is started until the caller has its reply.
+
+class RpcCall {
+  public:
+    unsigned id;		// its number
+    int proc;			// the procedure called
+    char *request;		// kept to be sent again, with its header
+    int length;			// bytes of it, the header included
+    int sentAt;			// when it was last sent
+    bool replied;		// has the reply arrived?
+    char *reply;		// the reply, once it has
+    int replyLength;		// bytes of it, or -1 if there is no such
+				// procedure
+};
+
+// The following class defines a client, calling one server.
+
+class RpcClient : public CallBackObj {
+  public:
+    RpcClient(MailBoxAddress localBox, NetworkAddress serverHost,
+	      MailBoxAddress serverBox, int window = RpcWindow);
+				// Call the server at "serverBox" on
+				// machine "serverHost", from "localBox"
+
+    RpcCall *Start(int proc, char *request, int length);
+				// Send a request; wait first if "window"
+				// calls have no reply yet
+    int Wait(RpcCall *call, char *reply);
+				// Wait for the reply to a call started,
+				// copy it into "reply" (MaxRpcSize
+				// bytes), and return its length, or -1
+				// if there is no such procedure
+    int Call(int proc, char *request, int length, char *reply);
+				// Start a call and wait for it
+
+    void CallBack();		// Retransmission timer went off
+
+  private:
+    MailBoxAddress localBox;	// where replies arrive
+    NetworkAddress serverHost;	// the server
+    MailBoxAddress serverBox;
+    int window;			// calls on their way, at most
+
+    Lock *lock;			// protects everything below
+    Condition *windowOpen;	// signalled when a reply makes room
+    Condition *replyReady;	// signalled when any reply arrives
+
+    List<RpcCall *> *calls;	// started and not yet waited for
+    int numWaiting;		// how many of them have no reply
+    unsigned nextId;		// number for the next call
+    bool timerSet;		// is a retransmission timer pending?
+
+    void Send(char *request, int length);
+				// put a request on the network
+    void SetTimer();		// arm the timer, unless it is already
+
+    static void Deliver(void *data);
+				// body of the thread handling replies
+				// that arrive for "localBox"
+    static void Retransmit(void *data);
+				// task run when the timer goes off
+};
+
+#endif // RPC_H
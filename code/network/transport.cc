@@ -0,0 +1,348 @@
+// transport.cc
+//	Routines for reliable, ordered delivery of messages over the
+//	post office: sending with a window of unacknowledged messages,
+//	acknowledging and reordering what arrives, and sending again
+//	what was lost.
+//
+//	Packets arriving for a connection are handled by a thread of
+//	its own.  The retransmission timer goes off in an interrupt
+//	handler, which cannot send, so it posts a task to do so.  No
+//	lock is held while a packet is being sent: sending waits for
+//	the network.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "transport.h"
+#include "main.h"
+#include "taskqueue.h"
+
+//----------------------------------------------------------------------
+// Connection::Connection
+// 	Initialize one end of a connection, with nothing sent or
+//	received yet, and fork the thread that handles its packets.
+//
+//	"localBox" -- the mailbox on this machine
+//	"farHost", "farBox" -- the mailbox at the other end
+//	"window" -- most messages in flight, or kept out of order
+//----------------------------------------------------------------------
+
+Connection::Connection(MailBoxAddress localBox, NetworkAddress farHost,
+		       MailBoxAddress farBox, int window)
+{
+    ASSERT(window > 0);
+    this->localBox = localBox;
+    this->farHost = farHost;
+    this->farBox = farBox;
+    this->window = window;
+
+    lock = new Lock("connection");
+    windowOpen = new Condition("window open");
+    dataReady = new Condition("data ready");
+
+    sent = new TransportSegment[window];
+    received = new TransportSegment[window];
+    for (int i = 0; i < window; i++) {
+	sent[i].present = FALSE;
+	received[i].present = FALSE;
+    }
+    sendBase = nextSeq = 0;
+    lastProgress = 0;
+    timerSet = FALSE;
+    readSeq = expected = 0;
+
+    Thread *t = new Thread("transport", 1);
+
+    t->Fork(Connection::Deliver, this);
+}
+
+//----------------------------------------------------------------------
+// Connection::SegmentSize
+// 	Return the size of the largest message that can be sent: what
+//	fits in one packet after the mail and transport headers.
+//----------------------------------------------------------------------
+
+int
+Connection::SegmentSize()
+{
+    return PostOfficeOutput::FragmentSize() - sizeof(TransportHeader);
+}
+
+//----------------------------------------------------------------------
+// Connection::SendSegment
+// 	Put the transport header in front of a message, or make an ACK,
+//	and send it to the other end.  The caller must not hold "lock".
+//
+//	"isAck" -- is this an ACK?
+//	"seq" -- the number of the message, or of the next one expected
+//	"data", "length" -- the message (NULL, 0 for an ACK)
+//----------------------------------------------------------------------
+
+void
+Connection::SendSegment(unsigned isAck, unsigned seq, char *data, int length)
+{
+    char *buffer = new char[sizeof(TransportHeader) + length];
+    PacketHeader pktHdr;
+    MailHeader mailHdr;
+    TransportHeader hdr;
+
+    hdr.isAck = isAck;
+    hdr.seq = seq;
+    bcopy((char *)&hdr, buffer, sizeof(TransportHeader));
+    if (length > 0)
+	bcopy(data, buffer + sizeof(TransportHeader), length);
+
+    pktHdr.to = farHost;
+    mailHdr.to = farBox;
+    mailHdr.from = localBox;
+    mailHdr.length = sizeof(TransportHeader) + length;
+    kernel->postOfficeOut->Send(pktHdr, mailHdr, buffer);
+    delete [] buffer;
+}
+
+//----------------------------------------------------------------------
+// Connection::Send
+// 	Send a message, keeping a copy until it is acknowledged.  Wait
+//	first while the window is full.  Returns once the message is on
+//	the network, not once it has arrived (see Flush).
+//
+//	"data", "length" -- the message, at most SegmentSize() bytes
+//----------------------------------------------------------------------
+
+void
+Connection::Send(char *data, int length)
+{
+    TransportSegment *segment;
+    unsigned seq;
+
+    ASSERT((length >= 0) && (length <= SegmentSize()));
+    lock->Acquire();
+    while (nextSeq - sendBase >= (unsigned)window)
+	windowOpen->Wait(lock);
+    seq = nextSeq++;
+    segment = &sent[seq % window];
+    segment->present = TRUE;
+    segment->length = length;
+    bcopy(data, segment->data, length);
+    if (seq == sendBase)		// the timer runs from here
+	lastProgress = kernel->stats->totalTicks;
+    SetTimer();
+    lock->Release();
+
+    SendSegment(FALSE, seq, data, length);
+}
+
+//----------------------------------------------------------------------
+// Connection::Flush
+// 	Wait until the other end has acknowledged every message sent.
+//----------------------------------------------------------------------
+
+void
+Connection::Flush()
+{
+    lock->Acquire();
+    while (sendBase != nextSeq)
+	windowOpen->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// Connection::Receive
+// 	Wait for the next message, in the order they were sent, and
+//	copy it out.  This frees its place in the window.
+//
+//	"data" -- where to put the message; must hold SegmentSize() bytes
+//
+// Returns:
+//	The length of the message.
+//----------------------------------------------------------------------
+
+int
+Connection::Receive(char *data)
+{
+    TransportSegment *segment;
+    int length;
+
+    lock->Acquire();
+    while (readSeq == expected)
+	dataReady->Wait(lock);
+    segment = &received[readSeq % window];
+    ASSERT(segment->present);
+    length = segment->length;
+    bcopy(segment->data, data, length);
+    segment->present = FALSE;
+    readSeq++;
+    lock->Release();
+    return length;
+}
+
+//----------------------------------------------------------------------
+// Connection::SetTimer
+// 	Arrange for the retransmission timer to go off RetransmitTime
+//	after the last progress, unless it is already set.  "lock" is
+//	held.
+//----------------------------------------------------------------------
+
+void
+Connection::SetTimer()
+{
+    int when;
+
+    if (timerSet)
+	return;
+    when = lastProgress + RetransmitTime - kernel->stats->totalTicks;
+    timerSet = TRUE;
+    kernel->alarm->CallAfter(max(when, 1), this);
+}
+
+//----------------------------------------------------------------------
+// Connection::GotAck
+// 	The other end has received every message before "next": forget
+//	them, and let waiting senders go on.  An ACK for nothing new --
+//	a duplicate, or one overtaken by a later ACK -- is ignored.
+//	"lock" is held.
+//----------------------------------------------------------------------
+
+void
+Connection::GotAck(unsigned next)
+{
+    if ((next - sendBase == 0) || (next - sendBase > nextSeq - sendBase))
+	return;
+    for (; sendBase != next; sendBase++)
+	sent[sendBase % window].present = FALSE;
+    lastProgress = kernel->stats->totalTicks;
+    windowOpen->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// Connection::GotData
+// 	A message has arrived.  Keep it if it is one we do not have, and
+//	there is room for it: it must be within "window" of the next one
+//	to be read.  Then move "expected" past every message now here in
+//	order.  "lock" is held.
+//
+//	"seq" -- the message's number
+//	"data", "length" -- the message
+//----------------------------------------------------------------------
+
+void
+Connection::GotData(unsigned seq, char *data, int length)
+{
+    TransportSegment *segment = &received[seq % window];
+    unsigned old = expected;
+
+    if ((seq - expected) >= (readSeq + window - expected))
+	return;				// a duplicate, or no room for it
+    if (!segment->present) {
+	segment->present = TRUE;
+	segment->length = length;
+	bcopy(data, segment->data, length);
+    }
+    while ((expected - readSeq < (unsigned)window) &&
+	   received[expected % window].present)
+	expected++;
+    if (expected != old)
+	dataReady->Broadcast(lock);
+}
+
+//----------------------------------------------------------------------
+// Connection::Deliver
+// 	Body of the thread that handles the packets arriving for a
+//	connection: ACKs for what we sent, and messages, which are
+//	acknowledged -- all of them, even duplicates, in case the ACK
+//	for one was lost.
+//
+//	"data" -- the connection
+//----------------------------------------------------------------------
+
+void
+Connection::Deliver(void *data)
+{
+    Connection *conn = (Connection *)data;
+
+    for (;;) {
+	Mail *mail = kernel->postOfficeIn->Receive(conn->localBox);
+	TransportHeader hdr;
+	unsigned ack;
+
+	ASSERT(mail->mailHdr.length >= sizeof(TransportHeader));
+	bcopy(mail->Data(), (char *)&hdr, sizeof(TransportHeader));
+
+	conn->lock->Acquire();
+	if (hdr.isAck) {
+	    conn->GotAck(hdr.seq);
+	    conn->lock->Release();
+	} else {
+	    conn->GotData(hdr.seq, mail->Data() + sizeof(TransportHeader),
+			  mail->mailHdr.length - sizeof(TransportHeader));
+	    ack = conn->expected;
+	    conn->lock->Release();
+	    conn->SendSegment(TRUE, ack, NULL, 0);
+	}
+	delete mail;
+    }
+}
+
+//----------------------------------------------------------------------
+// Connection::CallBack
+// 	Interrupt handler for the retransmission timer.  Sending cannot
+//	be done here, since it waits; leave it to a task.
+//----------------------------------------------------------------------
+
+void
+Connection::CallBack()
+{
+    kernel->taskQueue->Post(Connection::Retransmit, this);
+}
+
+//----------------------------------------------------------------------
+// Connection::Retransmit
+// 	The retransmission timer has gone off.  If the first message not
+//	acknowledged has gone RetransmitTime without progress, send it
+//	again; the other end keeps those after it that arrived, so one
+//	ACK may then cover all of them.  Set the timer again while any
+//	message is unacknowledged.
+//
+//	Tasks have small stacks, so the copy of the message is not kept
+//	on the stack.
+//
+//	"data" -- the connection
+//----------------------------------------------------------------------
+
+void
+Connection::Retransmit(void *data)
+{
+    Connection *conn = (Connection *)data;
+    int now = kernel->stats->totalTicks;
+    char *buffer = NULL;
+    int length = 0;
+    unsigned seq = 0;
+
+    conn->lock->Acquire();
+    conn->timerSet = FALSE;
+    if (conn->sendBase != conn->nextSeq) {
+	if (now - conn->lastProgress >= RetransmitTime) {
+	    TransportSegment *segment =
+		&conn->sent[conn->sendBase % conn->window];
+
+	    ASSERT(segment->present);
+	    seq = conn->sendBase;
+	    length = segment->length;
+	    buffer = new char[length + 1];
+	    bcopy(segment->data, buffer, length);
+	    conn->lastProgress = now;
+	    kernel->stats->numRetransmits++;
+	    DEBUG(dbgNet, "Retransmitting message " << seq << " to "
+		  << conn->farHost << ", box " << conn->farBox);
+	}
+	conn->SetTimer();
+    }
+    conn->lock->Release();
+
+    if (buffer != NULL) {
+	conn->SendSegment(FALSE, seq, buffer, length);
+	delete [] buffer;
+    }
+}
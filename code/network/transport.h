@@ -0,0 +1,120 @@
+// transport.h
+//	Data structures for reliable, ordered delivery of messages
+//	between a mailbox on this machine and one on another, on top of
+//	the unreliable post office (see post.h).
+//
+//	Each end of a connection numbers the messages it sends, and
+//	keeps up to "window" of them that have not been acknowledged,
+//	so that several are on their way at once instead of one.  The
+//	other end acknowledges what it has received in order -- every
+//	message up to some number (a cumulative ACK) -- and keeps any
+//	that arrive out of order, within its window, until the gap is
+//	filled.  If no ACK arrives for a while, the first message not
+//	acknowledged is sent again.
+//
+//	A message must fit in one packet, with the transport's header
+//	(see SegmentSize).  Both ends must make a Connection between the
+//	same two mailboxes, with the same window; the mailbox at this end
+//	must be used for nothing else.  Connections last until Nachos
+//	halts.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include "post.h"
+#include "synch.h"
+
+#define TransportWindow	8	// messages in flight, by default
+
+#define RetransmitTime	((2 * TransportWindow + 2) * NetworkTime)
+				// how long to wait for an ACK before
+				// sending a message again
+
+// The following class defines the header the transport puts in front
+// of each message, inside the mail data.
+
+class TransportHeader {
+  public:
+    unsigned isAck;		// an ACK, with no data, or a message?
+    unsigned seq;		// a message: its number; an ACK: the
+				// number of the next message expected,
+				// all before it having been received
+};
+
+// A message kept by either end: sent and not yet acknowledged, or
+// received and not yet read.
+
+class TransportSegment {
+  public:
+    bool present;		// does the slot hold a message?
+    int length;			// bytes of data
+    char data[MaxMailSize];
+};
+
+// The following class defines one end of a connection.
+
+class Connection : public CallBackObj {
+  public:
+    Connection(MailBoxAddress localBox, NetworkAddress farHost,
+	       MailBoxAddress farBox, int window = TransportWindow);
+				// Connect "localBox" to "farBox" on
+				// machine "farHost"
+
+    void Send(char *data, int length);
+				// Send a message; wait first if "window"
+				// messages are unacknowledged
+    void Flush();		// Wait until every message sent has
+				// been acknowledged
+    int Receive(char *data);	// Wait for the next message in order,
+				// copy it into "data" (SegmentSize()
+				// bytes), and return its length
+
+    static int SegmentSize();	// Largest message that can be sent
+
+    void CallBack();		// Retransmission timer went off
+
+  private:
+    MailBoxAddress localBox;	// where messages and ACKs for us arrive
+    NetworkAddress farHost;	// the other end
+    MailBoxAddress farBox;
+    int window;			// messages in flight, and kept out of
+				// order, at most
+
+    Lock *lock;			// protects everything below
+    Condition *windowOpen;	// signalled when ACKs make room to send
+    Condition *dataReady;	// signalled when the next message arrives
+
+    TransportSegment *sent;	// sent and unacknowledged, by seq % window
+    unsigned sendBase;		// first message not acknowledged
+    unsigned nextSeq;		// number for the next message sent
+    int lastProgress;		// when "sendBase" last moved on
+    bool timerSet;		// is a retransmission timer pending?
+
+    TransportSegment *received;	// received and not read, by seq % window
+    unsigned readSeq;		// next message Receive returns
+    unsigned expected;		// first message not yet received
+
+    void SendSegment(unsigned isAck, unsigned seq, char *data, int length);
+				// put one packet on the network
+    void SetTimer();		// arm the timer, unless it is already,
+				// to go off RetransmitTime after
+				// "lastProgress"
+    void GotAck(unsigned next);	// the other end has up to "next"
+    void GotData(unsigned seq, char *data, int length);
+				// a message has arrived
+
+    static void Deliver(void *data);
+				// body of the thread handling packets
+				// that arrive for "localBox"
+    static void Retransmit(void *data);
+				// task run when the timer goes off
+};
+
+#endif // TRANSPORT_H
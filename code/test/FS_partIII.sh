@@ -1,9 +1,10 @@
-../build.linux/nachos -f
-../build.linux/nachos -mkdir /t0
-../build.linux/nachos -mkdir /t1
-../build.linux/nachos -cp num_100.txt /t0/f1
-../build.linux/nachos -mkdir /t0/aa
-../build.linux/nachos -cp num_100.txt /t0/aa/f1
-../build.linux/nachos -l /
+../build.linux/nachos -f -script - <<END
+mkdir /t0
+mkdir /t1
+cp num_100.txt /t0/f1
+mkdir /t0/aa
+cp num_100.txt /t0/aa/f1
+l /
 echo ===================
-../build.linux/nachos -lr /
+lr /
+END
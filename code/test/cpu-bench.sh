@@ -0,0 +1,67 @@
+#!/bin/bash
+# cpu-bench.sh
+#	Run the compute-bound test programs (matmult, sort, hashloop)
+#	under each way Nachos has of simulating user code, and report
+#	how fast each goes, in user instructions simulated per host
+#	microsecond (MIPS).
+#
+#	The faster engines must be cycle-exact: every statistic but the
+#	host time must come out as under the reference interpreter.  A
+#	run whose statistics differ is reported, and the script fails.
+#	Each run's statistics are kept in cpu-bench/<program>.<engine>.txt.
+#
+#	Usage, from code/test after "make": ./cpu-bench.sh [program ...]
+
+NACHOS=../build.linux/nachos
+OUT=cpu-bench
+
+programs=("$@")
+if [ ${#programs[@]} -eq 0 ]; then
+    programs=("matmult" "sort" "hashloop")
+fi
+engines=("interp:" "batch:-bi" "blocks:-bb")
+
+mkdir -p $OUT
+status=0
+
+printf "%-10s %-8s %12s %10s %8s  %s\n" program engine instructions \
+    "host usec" MIPS same
+for program in "${programs[@]}"; do
+    reference=""
+    for engine in "${engines[@]}"; do
+        name=${engine%%:*}
+        flags=${engine#*:}
+        stats="$OUT/$program.$name.txt"
+
+        $NACHOS -ps $flags -e $program > "$stats"
+
+        # everything but the host time must match the interpreter
+        sed -e '/^Host time/d' -e 's/, host usec [0-9]*//' "$stats" \
+            > "$stats.exact"
+        if [ -z "$reference" ]; then
+            reference="$stats.exact"
+            same="reference"
+        elif cmp -s "$reference" "$stats.exact"; then
+            same="yes"
+        else
+            same="NO"
+            status=1
+        fi
+
+        instrs=$(awk '/^User instructions/ {
+                        for (i = 1; i <= NF; i++) {
+                            n = $i; sub(/,$/, "", n);
+                            if (n ~ /^[0-9]+$/) sum += n;
+                        }
+                      } END { print sum + 0 }' "$stats")
+        usec=$(awk '/^Host time/ { n = $4; sub(/,$/, "", n); print n }' \
+            "$stats")
+        mips=$(awk '/^Host time/ && /MIPS/ { m = $NF } END { print m + 0 }' \
+            "$stats")
+        printf "%-10s %-8s %12s %10s %8.2f  %s\n" $program $name $instrs \
+            $usec $mips $same
+    done
+done
+
+rm -f $OUT/*.exact
+exit $status
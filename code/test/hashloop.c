@@ -0,0 +1,42 @@
+/* hashloop.c
+ *    Test program to hash a buffer over and over.
+ *
+ *    Intended to stress the simulated CPU: byte loads, shifts,
+ *    exclusive or and multiplies in a tight loop, and a table
+ *    updated at scattered addresses.
+ */
+
+#include "syscall.h"
+
+#define BufSize		1024
+#define TableSize	256
+#define Rounds		200
+
+char buf[BufSize];
+int table[TableSize];
+
+int
+main()
+{
+    unsigned int hash;
+    int i, r;
+
+    for (i = 0; i < BufSize; i++)
+	buf[i] = i * 7;
+
+    hash = 2166136261u;			/* FNV-1a */
+    for (r = 0; r < Rounds; r++) {
+	for (i = 0; i < BufSize; i++) {
+	    hash ^= (unsigned char) buf[i];
+	    hash *= 16777619;
+	}
+	table[hash % TableSize]++;
+	buf[r % BufSize] = hash;
+    }
+
+    for (i = 0, r = 0; i < TableSize; i++)
+	r += table[i];
+    if (r != Rounds)
+	MSG("hashloop: wrong result");
+    Halt();
+}
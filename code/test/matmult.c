@@ -0,0 +1,37 @@
+/* matmult.c 
+ *    Test program to do matrix multiplication on large arrays.
+ *
+ *    Intended to stress the simulated CPU: the arrays are small
+ *    enough to stay in memory, and the loops run several million
+ *    instructions, with no system calls until the end.
+ */
+
+#include "syscall.h"
+
+#define Dim 	32	/* about 33 million instructions */
+
+int A[Dim][Dim];
+int B[Dim][Dim];
+int C[Dim][Dim];
+
+int
+main()
+{
+    int i, j, k;
+
+    for (i = 0; i < Dim; i++)		/* first initialize the matrices */
+	for (j = 0; j < Dim; j++) {
+	     A[i][j] = i;
+	     B[i][j] = j;
+	     C[i][j] = 0;
+	}
+
+    for (i = 0; i < Dim; i++)		/* then multiply them together */
+	for (j = 0; j < Dim; j++)
+            for (k = 0; k < Dim; k++)
+		 C[i][j] += A[i][k] * B[k][j];
+
+    if (C[Dim-1][Dim-1] != (Dim-1) * (Dim-1) * Dim)
+	MSG("matmult: wrong result");
+    Halt();
+}
@@ -0,0 +1,36 @@
+/* sort.c 
+ *    Test program to sort a large number of integers.
+ *
+ *    Intended to stress the simulated CPU: a bubble sort of an array
+ *    in reverse order, the worst case, with loads, stores and
+ *    branches in the inner loop.
+ */
+
+#include "syscall.h"
+
+#define Size	1024
+
+int A[Size];
+
+int
+main()
+{
+    int i, j, tmp;
+
+    /* first initialize the array, in reverse sorted order */
+    for (i = 0; i < Size; i++)		
+        A[i] = Size - i - 1;
+
+    /* then sort! */
+    for (i = 0; i < (Size - 1); i++)
+        for (j = 0; j < (Size - 1 - i); j++)
+	   if (A[j] > A[j + 1]) {	/* out of order -> need to swap ! */
+	      tmp = A[j];
+	      A[j] = A[j + 1];
+	      A[j + 1] = tmp;
+    	   }
+
+    if (A[0] != 0 || A[Size - 1] != Size - 1)
+	MSG("sort: wrong result");
+    Halt();
+}
@@ -1,8 +1,7 @@
 // alarm.cc
 //	Routines to use a hardware timer device to provide a
-//	software alarm clock.  For now, we just provide time-slicing.
-//
-//	Not completely implemented.
+//	software alarm clock: time-slicing, and threads sleeping until
+//	a given time.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -11,6 +10,23 @@
 #include "copyright.h"
 #include "alarm.h"
 #include "main.h"
+#include "frametable.h"
+
+//----------------------------------------------------------------------
+// SleeperCompare
+//	Order sleeping threads by when they are due, and those due at
+//	the same time by when they went to sleep.
+//----------------------------------------------------------------------
+
+static int
+SleeperCompare(SleepingThread *x, SleepingThread *y)
+{
+    if (x->when != y->when)
+	return (x->when < y->when) ? -1 : 1;
+    if (x->order != y->order)
+	return (x->order < y->order) ? -1 : 1;
+    return 0;
+}
 
 //----------------------------------------------------------------------
 // Alarm::Alarm
@@ -23,6 +39,100 @@
 Alarm::Alarm(bool doRandom)
 {
     timer = new Timer(doRandom, this);
+    sleepers = new Heap<SleepingThread *>(SleeperCompare);
+    numSlept = 0;
+    wakeAt = -1;
+    wakeup = new AlarmWakeup(this);
+}
+
+//----------------------------------------------------------------------
+// Alarm::~Alarm
+//	De-allocate the alarm clock.  A wakeup may still be scheduled;
+//	it is only left behind when Nachos is shutting down.
+//----------------------------------------------------------------------
+
+Alarm::~Alarm()
+{
+    delete timer;
+    delete sleepers;
+}
+
+//----------------------------------------------------------------------
+// Alarm::WaitUntil
+//	Put the current thread to sleep until more than "x" ticks from
+//	now.  If it is due before any other sleeping thread, the wakeup
+//	interrupt is set for it.  A wakeup set earlier for a later time
+//	cannot be taken back; when it goes off it finds no one due, and
+//	does nothing.
+//----------------------------------------------------------------------
+
+void
+Alarm::WaitUntil(int x)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    int now = kernel->stats->totalTicks;
+    SleepingThread sleeper;
+
+    sleeper.thread = kernel->currentThread;
+    sleeper.when = now + max(x, 0) + 1;
+    sleeper.order = numSlept++;
+    sleepers->Insert(&sleeper);
+    if (wakeAt == -1 || sleeper.when < wakeAt) {
+	wakeAt = sleeper.when;
+	CallAfter(wakeAt - now, wakeup);
+    }
+    DEBUG(dbgThread, "Thread " << sleeper.thread->getName() << " sleeps until "
+	  << sleeper.when);
+    sleeper.thread->Sleep(FALSE);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// Alarm::WakeSleepers
+//	Called by the wakeup interrupt, with interrupts disabled: make
+//	every sleeping thread that is due ready to run, and set the
+//	wakeup for the next one.
+//----------------------------------------------------------------------
+
+void
+Alarm::WakeSleepers()
+{
+    int now = kernel->stats->totalTicks;
+
+    if (wakeAt <= now)
+	wakeAt = -1;		// this is it going off
+    while (!sleepers->IsEmpty() && sleepers->Front()->when <= now) {
+	Thread *thread = sleepers->RemoveFront()->thread;
+
+	DEBUG(dbgThread, "Waking thread " << thread->getName());
+	kernel->scheduler->ReadyToRun(thread);
+	kernel->scheduler->CheckPreempt(thread);
+    }
+    if (!sleepers->IsEmpty() && wakeAt == -1) {
+	wakeAt = sleepers->Front()->when;
+	CallAfter(wakeAt - now, wakeup);
+    }
+}
+
+void
+AlarmWakeup::CallBack()
+{
+    alarm->WakeSleepers();
+}
+
+//----------------------------------------------------------------------
+// Alarm::CallAfter
+//	Set a one-shot software timer: have "toCall" called back, with
+//	interrupts disabled, once "ticks" more ticks have gone by.  Unlike
+//	the time-slicing timer, it keeps an idle machine from halting
+//	until it has gone off.  A timer cannot be cancelled; the object
+//	called must check whether it is still wanted.
+//----------------------------------------------------------------------
+
+void
+Alarm::CallAfter(int ticks, CallBackObj *toCall)
+{
+    kernel->interrupt->Schedule(toCall, ticks, AlarmInt);
 }
 
 //----------------------------------------------------------------------
@@ -39,8 +149,12 @@ Alarm::Alarm(bool doRandom)
 //	if the interrupted thread called Yield at the point it is 
 //	was interrupted.
 //
-//	For now, just provide time-slicing.  Only need to time slice 
-//      if we're currently running something (in other words, not idle).
+//	The frame table samples the use bits of user pages from here.
+//
+//	Only need to time slice if we're currently running something,
+//	and the scheduler says its time is up.  If the machine is idle,
+//	there is nothing to slice: the timer is stopped, until Restart
+//	when a thread runs again.
 //----------------------------------------------------------------------
 
 void 
@@ -49,7 +163,12 @@ Alarm::CallBack()
     Interrupt *interrupt = kernel->interrupt;
     MachineStatus status = interrupt->getStatus();
     
-    if (status != IdleMode) {
+    if (status == IdleMode) {
+	timer->Stop();
+	return;
+    }
+    kernel->frameTable->Sample();
+    if (kernel->scheduler->QuantumExpired()) {
 	interrupt->YieldOnReturn();
     }
 }
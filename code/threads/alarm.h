@@ -8,7 +8,13 @@
 //	From this, we provide the ability for a thread to be
 //	woken up after a delay; we also provide time-slicing.
 //
-//	NOTE: this abstraction is not completely implemented.
+//	Sleeping threads are kept in a heap, the one due first at the
+//	front, and are woken by a one-shot interrupt set for the first
+//	deadline, not by polling them on every timer interrupt.  The
+//	timer itself only runs while a thread does: it is stopped when
+//	the machine goes idle, and started again once a thread is
+//	dispatched, so an idle machine takes no interrupts but those
+//	that give it something to do.
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -21,21 +27,55 @@
 #include "utility.h"
 #include "callback.h"
 #include "timer.h"
+#include "heap.h"
+
+class Thread;
+class Alarm;
+
+// A thread in WaitUntil, on the stack of that thread.
+struct SleepingThread {
+    Thread *thread;
+    int when;			// time to wake it
+    int order;			// which went to sleep first, for a tie
+};
+
+// What the wakeup interrupt calls: Alarm::CallBack is taken by the
+// timer.
+class AlarmWakeup : public CallBackObj {
+  public:
+    AlarmWakeup(Alarm *alarm) { this->alarm = alarm; }
+
+  private:
+    Alarm *alarm;
+
+    void CallBack();
+};
 
 // The following class defines a software alarm clock. 
 class Alarm : public CallBackObj {
   public:
     Alarm(bool doRandomYield);	// Initialize the timer, and callback 
 				// to "toCall" every time slice.
-    ~Alarm() { delete timer; }
+    ~Alarm();
     
     void WaitUntil(int x);	// suspend execution until time > now + x
-                                // this method is not yet implemented
+    void CallAfter(int ticks, CallBackObj *toCall);
+				// call toCall->CallBack() once, as an
+				// interrupt handler, "ticks" from now
 	
 	void Disable() { timer->Disable(); } //2015.11.25
+    void Restart() { timer->Start(); }
+				// a thread runs after the machine idled
+
+    void WakeSleepers();	// wake the threads that are due
 
   private:
     Timer *timer;		// the hardware timer device
+    Heap<SleepingThread *> *sleepers;
+				// threads in WaitUntil, first due first
+    int numSlept;		// calls to WaitUntil so far
+    int wakeAt;			// when the next wakeup is set for, or -1
+    AlarmWakeup *wakeup;
 
     void CallBack();		// called when the hardware
 				// timer generates an interrupt
@@ -0,0 +1,229 @@
+// batch.cc
+//	Routines to run a batch of Nachos jobs, each in a worker process
+//	of its own, and collect their statistics.  See batch.h.
+//
+//	A worker sends its Statistics back as they are in memory.  That
+//	is safe only because it is a fork of this process, with the same
+//	names (string constants) at the same addresses; and the pipe
+//	holds them all, so a worker never waits for them to be read.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "batch.h"
+#include "debug.h"
+#include "sysdep.h"
+#include <stdio.h>
+
+//----------------------------------------------------------------------
+// BatchRunner::BatchRunner
+// 	Get ready to run a batch of jobs.
+//
+//	"jobFileName" -- the flags of each job, one per line
+//	"workers" -- the most jobs to run at once, or 0 for one per CPU
+//	"boot" -- what a worker calls to run a job, with its flags
+//----------------------------------------------------------------------
+
+BatchRunner::BatchRunner(char *jobFileName, int workers,
+			 int (*boot)(int argc, char **argv))
+{
+    this->jobFileName = jobFileName;
+    numWorkers = (workers > 0) ? workers : NumHostCpus();
+    this->boot = boot;
+    jobs = NULL;
+    numJobs = 0;
+}
+
+BatchRunner::~BatchRunner()
+{
+    delete [] jobs;
+}
+
+//----------------------------------------------------------------------
+// BatchRunner::Run
+// 	Run every job, keeping up to numWorkers of them running, then
+//	print the summary.  Return how many jobs failed: exited with an
+//	error, or without halting.
+//----------------------------------------------------------------------
+
+int
+BatchRunner::Run()
+{
+    int next = 0, running = 0, failed = 0;
+    int pid, exitCode;
+    double start = HostTime();
+
+    ReadJobs();
+    while ((next < numJobs) || (running > 0)) {
+	while ((running < numWorkers) && (next < numJobs)) {
+	    Start(next++);
+	    running++;
+	}
+	pid = WaitForProcess(&exitCode);
+	Finish(pid, exitCode);
+	running--;
+    }
+
+    Summarize();
+    for (int i = 0; i < numJobs; i++)
+	if ((jobs[i].exitCode != 0) || !jobs[i].halted)
+	    failed++;
+    printf("%d jobs, %d failed, %d workers, host usec %.0f\n", numJobs,
+	   failed, numWorkers, HostTime() - start);
+    return failed;
+}
+
+//----------------------------------------------------------------------
+// BatchRunner::ReadJobs
+// 	Read the job file, skipping blank lines and comments.
+//----------------------------------------------------------------------
+
+void
+BatchRunner::ReadJobs()
+{
+    FILE *jobFile = fopen(jobFileName, "r");
+    char line[MaxJobLine];
+    int lines = 0;
+
+    if (jobFile == NULL) {
+	cerr << "Batch: couldn't open job file " << jobFileName << "\n";
+	Abort();
+    }
+    while (fgets(line, MaxJobLine, jobFile) != NULL)
+	lines++;
+    jobs = new BatchJob[lines];
+
+    rewind(jobFile);
+    while (fgets(line, MaxJobLine, jobFile) != NULL) {
+	char *flags = line + strspn(line, " \t");
+
+	flags[strcspn(flags, "\r\n")] = '\0';
+	if ((*flags == '\0') || (*flags == '#'))
+	    continue;
+	strcpy(jobs[numJobs].line, flags);
+	jobs[numJobs].pid = 0;
+	jobs[numJobs].halted = FALSE;
+	numJobs++;
+    }
+    fclose(jobFile);
+}
+
+//----------------------------------------------------------------------
+// BatchRunner::Start
+// 	Fork a worker to run a job.  The worker sends its output to the
+//	job's output file, and boots Nachos with the job's flags, plus
+//	"-result" to have its Statistics sent back when it halts.
+//
+//	"job" -- which one, counting from 0
+//----------------------------------------------------------------------
+
+void
+BatchRunner::Start(int job)
+{
+    BatchJob *j = &jobs[job];
+    int fds[2];
+
+    MakePipe(fds);
+    j->hostTime = HostTime();
+    j->pid = ForkProcess();
+    if (j->pid == 0) {		// the worker
+	char outputName[MaxJobLine];
+	char resultArg[16];
+	char *argv[MaxJobArgs + 3];
+	int argc = 0;
+	int output;
+
+	Close(fds[0]);
+	sprintf(outputName, "%s.%d.out", jobFileName, job + 1);
+	output = OpenForWrite(outputName);
+	RedirectOutput(output);
+	Close(output);
+
+	argv[argc++] = (char *)"nachos";
+	for (char *arg = strtok(j->line, " \t"); arg != NULL;
+	     arg = strtok(NULL, " \t")) {
+	    ASSERT(argc < MaxJobArgs);
+	    argv[argc++] = arg;
+	}
+	sprintf(resultArg, "%d", fds[1]);
+	argv[argc++] = (char *)"-result";
+	argv[argc++] = resultArg;
+	argv[argc] = NULL;
+	Exit((*boot)(argc, argv));
+    }
+    Close(fds[1]);
+    j->results = fds[0];
+}
+
+//----------------------------------------------------------------------
+// BatchRunner::Finish
+// 	A worker has exited: note how, and read the Statistics it sent,
+//	if it halted.
+//
+//	"pid" -- the worker
+//	"exitCode" -- what it passed to Exit, or -1 if it was killed
+//----------------------------------------------------------------------
+
+void
+BatchRunner::Finish(int pid, int exitCode)
+{
+    for (int i = 0; i < numJobs; i++) {
+	BatchJob *j = &jobs[i];
+
+	if (j->pid == pid) {
+	    j->hostTime = HostTime() - j->hostTime;
+	    j->exitCode = exitCode;
+	    j->halted = (ReadPartial(j->results, (char *)&j->stats,
+				     sizeof(Statistics)) == sizeof(Statistics));
+	    Close(j->results);
+	    j->pid = 0;
+	    return;
+	}
+    }
+    ASSERTNOTREACHED();		// not one of ours
+}
+
+//----------------------------------------------------------------------
+// BatchRunner::Summarize
+// 	Print a line for each job, in order, with the main statistics of
+//	its run, then their totals.
+//----------------------------------------------------------------------
+
+void
+BatchRunner::Summarize()
+{
+    Statistics total;		// starts all zeroes
+    double totalInstrs = 0;
+
+    printf("job,exit,halted,ticks,idle,system,user,instructions,switches,"
+	   "disk_reads,disk_writes,page_faults,host_us\n");
+    for (int i = 0; i < numJobs; i++) {
+	Statistics *s = &jobs[i].stats;
+	double instrs = 0;
+
+	for (int k = 0; k < NumInstrClasses; k++)
+	    instrs += s->numInstrs[k];
+	printf("%d,%d,%s,%d,%d,%d,%d,%.0f,%d,%d,%d,%d,%.0f\n", i + 1,
+	       jobs[i].exitCode, jobs[i].halted ? "yes" : "no",
+	       s->totalTicks, s->idleTicks, s->systemTicks, s->userTicks,
+	       instrs, s->numContextSwitches, s->numDiskReads,
+	       s->numDiskWrites, s->numPageFaults, jobs[i].hostTime);
+	if (!jobs[i].halted)
+	    continue;
+	total.totalTicks += s->totalTicks;
+	total.idleTicks += s->idleTicks;
+	total.systemTicks += s->systemTicks;
+	total.userTicks += s->userTicks;
+	totalInstrs += instrs;
+	total.numContextSwitches += s->numContextSwitches;
+	total.numDiskReads += s->numDiskReads;
+	total.numDiskWrites += s->numDiskWrites;
+	total.numPageFaults += s->numPageFaults;
+    }
+    printf("total,,,%d,%d,%d,%d,%.0f,%d,%d,%d,%d,\n", total.totalTicks,
+	   total.idleTicks, total.systemTicks, total.userTicks, totalInstrs,
+	   total.numContextSwitches, total.numDiskReads, total.numDiskWrites,
+	   total.numPageFaults);
+}
@@ -0,0 +1,78 @@
+// batch.h
+//	Data structures for running many copies of Nachos at once, from
+//	one command, for test suites: "nachos -batch jobFile -j workers".
+//
+//	Each line of the job file holds the flags of one run, as they
+//	would be typed after "nachos" (blank lines, and lines starting
+//	with '#', are skipped).  Each job is run by a worker: a copy of
+//	this host process, forked before any kernel is made, which boots
+//	a kernel of its own from the job's flags.  Up to "workers" jobs
+//	run at once, one per host CPU by default.
+//
+//	A job's output goes to "jobFile.N.out", N counting from 1.  When
+//	it halts, its Statistics are sent back over a pipe, and once all
+//	the jobs are done, a summary is printed: a CSV line per job, in
+//	the order of the job file whatever order they finished in, and
+//	their totals.  Each job is simulated just as it would be alone,
+//	so its results do not depend on how many run at once.
+//
+//	Jobs share the files they only read (user programs, a "-base"
+//	disk image); any that write a disk must each have their own
+//	("-m", or an overlay of their own).
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "stats.h"
+
+#define MaxJobArgs	64	// flags on one line of the job file
+#define MaxJobLine	1024	// characters on one line
+
+// The following class defines one job: a run of Nachos.
+
+class BatchJob {
+  public:
+    char line[MaxJobLine];	// its flags
+    int pid;			// the worker running it, or 0
+    int results;		// where its Statistics come back
+    int exitCode;		// as it exited; -1 if it was killed
+    bool halted;		// did it send its Statistics?
+    double hostTime;		// microseconds it took
+    Statistics stats;		// as it halted
+};
+
+// The following class defines a batch of jobs.
+
+class BatchRunner {
+  public:
+    BatchRunner(char *jobFileName, int workers,
+		int (*boot)(int argc, char **argv));
+				// Run the jobs in "jobFileName", up to
+				// "workers" at once (0: one per CPU),
+				// each by calling "boot" with its flags
+    ~BatchRunner();
+
+    int Run();			// Run every job and print the summary;
+				// return how many failed
+
+  private:
+    char *jobFileName;
+    int numWorkers;
+    int (*boot)(int argc, char **argv);
+    BatchJob *jobs;
+    int numJobs;
+
+    void ReadJobs();		// read the job file
+    void Start(int job);	// fork a worker to run a job
+    void Finish(int pid, int exitCode);
+				// collect what a worker sent
+    void Summarize();		// print the summary
+};
+
+#endif // BATCH_H
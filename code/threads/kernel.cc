@@ -15,7 +15,27 @@
 #include "libtest.h"
 #include "string.h"
 #include "synchdisk.h"
+#include "taskqueue.h"
+#include "threadpool.h"
+#include "buffercache.h"
+#include "inodetable.h"
+#include "journal.h"
+#include "tlbmanager.h"
+#include "frametable.h"
+#include "swapspace.h"
+#include "sharedtext.h"
+#include "futex.h"
+#include "execcache.h"
 #include "post.h"
+#include "fabric.h"
+#include "trace.h"
+#include "profiler.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "threadbench.h"
+#include "transport.h"
+#include "rpc.h"
+#include "remotefs.h"
 #include "synchconsole.h"
 
 //----------------------------------------------------------------------
@@ -28,18 +48,74 @@ Kernel::Kernel(int argc, char **argv)
 {
     randomSlice = FALSE; 
     debugUserProg = FALSE;
+    traceFile = NULL;
+    metricsFd = -1;
+    metricsInterval = 0;
+    profileFile = NULL;
+    profileInterval = ProfileInterval;
+    snapshotFile = NULL;
+    restoreFile = NULL;
+    runBlocks = FALSE;
+    threadedDispatch = FALSE;
+    batchTicks = FALSE;
+#ifdef USE_TLB
+    tlbSize = TLBSize;
+#else
+    tlbSize = 0;               // default is a linear page table
+#endif
+    tlbPolicy = NULL;          // default is fifo
+    superPages = FALSE;
+    demandPaging = FALSE;
+    hashedPageTables = FALSE;
+    pagePolicy = NULL;         // default is fifo
+    numFrames = NumPhysPages;
     consoleIn = NULL;          // default is stdin
+    interactive = FALSE;
     consoleOut = NULL;         // default is stdout
+    cacheSize = NumCacheSectors;
+    flushInterval = FlushInterval;
+    dirtyPercent = DirtyPercent;
+    diskPolicy = NULL;         // default is fcfs
+    schedPolicy = NULL;        // default is fifo
+    numCpus = 1;
+    mapDisk = FALSE;
+    dedupDisk = FALSE;
+    diskSegments = segmentSectors = 0;
+    writeCacheSectors = 0;
+    diskCoalesceCount = diskCoalesceTicks = 0;
+    flashChannels = flashQueueDepth = 0; // default is the disk
+    raidLevel = raidMembers = 0;
+    stripeSectors = DefaultStripeSectors;
+    diskBase = NULL;           // default is a disk of its own
+    diskOverlay = NULL;
+    printStats = FALSE;
+    resultFile = -1;
+    histogramFile = NULL;
+    stackPoolSize = StackPoolSize;
 #ifndef FILESYS_STUB
     formatFlag = FALSE;
+    clusterSectors = 1;		// default is one sector at a time
+    checksumDisk = FALSE;
 #endif
     reliability = 1;            // network reliability, default is 1.0
+    wireSize = DefaultWireSize;
+    topologyFile = NULL;        // every link the default
+    fileServerHost = -1;        // no remote file system mounted
+    exportFiles = FALSE;
     hostName = 0;               // machine id, also UNIX socket name
                                 // 0 is the default machine id
 								
 	// MP4 mod tag
 	execfileNum = 0; // dummy operation to keep valgrind happy
+    threadNum = 0;
+    for (int i = 0; i < MaxPrograms; i++) {
+	programName[i] = NULL;
+	programDone[i] = NULL;
+	joining[i] = FALSE;
+    }
 								
+    bool scriptOnStdin = FALSE;
+
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "-rs") == 0) {
  	    	ASSERT(i + 1 < argc);
@@ -49,6 +125,62 @@ Kernel::Kernel(int argc, char **argv)
 	    	i++;
         } else if (strcmp(argv[i], "-s") == 0) {
             debugUserProg = TRUE;
+        } else if (strcmp(argv[i], "-trace") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file name
+            traceFile = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-metrics") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are a file descriptor
+                                    // and a number of ticks
+            metricsFd = atoi(argv[i + 1]);
+            metricsInterval = atoi(argv[i + 2]);
+            ASSERT(metricsInterval >= 0);
+            i += 2;
+        } else if (strcmp(argv[i], "-prof") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file name
+            profileFile = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-pi") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            profileInterval = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-snap") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file name
+            snapshotFile = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-restore") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file name
+            restoreFile = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-bb") == 0) {
+            runBlocks = TRUE;
+        } else if (strcmp(argv[i], "-td") == 0) {
+            runBlocks = TRUE;
+            threadedDispatch = TRUE;
+        } else if (strcmp(argv[i], "-bi") == 0) {
+            batchTicks = TRUE;
+        } else if (strcmp(argv[i], "-tlb") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            tlbSize = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-tp") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a policy name
+            tlbPolicy = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-tsp") == 0) {
+            superPages = TRUE;
+        } else if (strcmp(argv[i], "-vm") == 0) {
+            demandPaging = TRUE;
+        } else if (strcmp(argv[i], "-hpt") == 0) {
+            hashedPageTables = TRUE;
+        } else if (strcmp(argv[i], "-vp") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a policy name
+            pagePolicy = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-vf") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            numFrames = atoi(argv[i + 1]);
+            i++;
 		} else if (strcmp(argv[i], "-e") == 0) {
         	execfile[++execfileNum]= argv[++i];
 			cout << execfile[execfileNum] << "\n";
@@ -56,6 +188,8 @@ Kernel::Kernel(int argc, char **argv)
 	    	ASSERT(i + 1 < argc);
 	    	consoleIn = argv[i + 1];
 	    	i++;
+		} else if (strcmp(argv[i], "-it") == 0) {
+	    	interactive = TRUE;
 		} else if (strcmp(argv[i], "-co") == 0) {
 	    	ASSERT(i + 1 < argc);
 	    	consoleOut = argv[i + 1];
@@ -63,7 +197,89 @@ Kernel::Kernel(int argc, char **argv)
 #ifndef FILESYS_STUB
 		} else if (strcmp(argv[i], "-f") == 0) {
 	    	formatFlag = TRUE;
+		} else if (strcmp(argv[i], "-cluster") == 0) {
+	    	ASSERT(i + 1 < argc);   // next argument is int
+	    	clusterSectors = atoi(argv[i + 1]);
+	    	i++;
+		} else if (strcmp(argv[i], "-ck") == 0) {
+	    	checksumDisk = TRUE;
 #endif
+        } else if (strcmp(argv[i], "-bc") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            cacheSize = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-bf") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are ints
+            flushInterval = atoi(argv[i + 1]);
+            dirtyPercent = atoi(argv[i + 2]);
+            i += 2;
+        } else if (strcmp(argv[i], "-ds") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a policy name
+            diskPolicy = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-sp") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a policy name
+            schedPolicy = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-cpus") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            numCpus = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-ks") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            stackPoolSize = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-dm") == 0) {
+            mapDisk = TRUE;
+        } else if (strcmp(argv[i], "-dd") == 0) {
+            dedupDisk = TRUE;
+        } else if (strcmp(argv[i], "-dc") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are ints
+            diskSegments = atoi(argv[i + 1]);
+            segmentSectors = atoi(argv[i + 2]);
+            i += 2;
+        } else if (strcmp(argv[i], "-dwc") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            writeCacheSectors = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-dco") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are ints
+            diskCoalesceCount = atoi(argv[i + 1]);
+            diskCoalesceTicks = atoi(argv[i + 2]);
+            i += 2;
+        } else if (strcmp(argv[i], "-flash") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are ints
+            flashChannels = atoi(argv[i + 1]);
+            flashQueueDepth = atoi(argv[i + 2]);
+            i += 2;
+        } else if (strcmp(argv[i], "-raid") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are ints
+            raidLevel = atoi(argv[i + 1]);
+            raidMembers = atoi(argv[i + 2]);
+            ASSERT((raidLevel == 0) || (raidLevel == 1));
+            i += 2;
+        } else if (strcmp(argv[i], "-stripe") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            stripeSectors = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-base") == 0) {
+            ASSERT(i + 2 < argc);   // next arguments are file names
+            diskBase = argv[i + 1];
+            diskOverlay = argv[i + 2];
+            i += 2;
+        } else if (strcmp(argv[i], "-ps") == 0) {
+            printStats = TRUE;
+        } else if ((strcmp(argv[i], "-script") == 0) && (i + 1 < argc)) {
+            scriptOnStdin = (strcmp(argv[i + 1], "-") == 0);
+            i++;                    // run by main
+        } else if (strcmp(argv[i], "-result") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file descriptor
+            resultFile = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-hist") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is a file name
+            histogramFile = argv[i + 1];
+            i++;
         } else if (strcmp(argv[i], "-n") == 0) {
             ASSERT(i + 1 < argc);   // next argument is float
             reliability = atof(argv[i + 1]);
@@ -72,16 +288,52 @@ Kernel::Kernel(int argc, char **argv)
             ASSERT(i + 1 < argc);   // next argument is int
             hostName = atoi(argv[i + 1]);
             i++;
+        } else if (strcmp(argv[i], "-mtu") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            wireSize = atoi(argv[i + 1]);
+            ASSERT(wireSize > (int)(sizeof(PacketHeader) + sizeof(MailHeader))
+                   && wireSize <= MaxWireSize);
+            i++;
+        } else if (strcmp(argv[i], "-topo") == 0) {
+            ASSERT(i + 1 < argc);
+            topologyFile = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-nfs") == 0) {
+            ASSERT(i + 1 < argc);   // next argument is int
+            fileServerHost = atoi(argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-nfsd") == 0) {
+            exportFiles = TRUE;
         } else if (strcmp(argv[i], "-u") == 0) {
             cout << "Partial usage: nachos [-rs randomSeed]\n";
-	   		cout << "Partial usage: nachos [-s]\n";
-            cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut]\n";
+	   		cout << "Partial usage: nachos [-s] [-bb] [-td] [-bi] [-trace file] [-ps]\n";
+            cout << "Partial usage: nachos [-result fd]\n";
+            cout << "Partial usage: nachos [-hist file]\n";
+            cout << "Partial usage: nachos [-metrics fd ticks]\n";
+            cout << "Partial usage: nachos [-prof file] [-pi instructions]\n";
+            cout << "Partial usage: nachos [-snap file] [-restore file]\n";
+            cout << "Partial usage: nachos [-tlb entries] [-tp fifo|lru|random] [-tsp]\n";
+            cout << "Partial usage: nachos [-vm] [-vp fifo|clock|lru] [-vf frames] [-hpt]\n";
+            cout << "Partial usage: nachos [-ci consoleIn] [-co consoleOut] [-it]\n";
 #ifndef FILESYS_STUB
-	    	cout << "Partial usage: nachos [-nf]\n";
+	    	cout << "Partial usage: nachos [-nf] [-f [-cluster sectors] [-ck]]\n";
 #endif
-            cout << "Partial usage: nachos [-n #] [-m #]\n";
+            cout << "Partial usage: nachos [-n #] [-m #] [-mtu bytes] [-topo file]\n";
+            cout << "Partial usage: nachos [-nfs host] [-nfsd]\n";
+            cout << "Partial usage: nachos [-bc cacheSectors] [-bf ticks dirtyPercent]\n";
+            cout << "Partial usage: nachos [-ds fcfs|sstf|scan|clook] [-dm] [-dd]\n";
+            cout << "Partial usage: nachos [-dc segments sectors] [-dwc sectors]\n";
+            cout << "Partial usage: nachos [-dco requests ticks]\n";
+            cout << "Partial usage: nachos [-flash channels depth]\n";
+            cout << "Partial usage: nachos [-raid 0|1 disks [-stripe sectors]]\n";
+            cout << "Partial usage: nachos [-base baseImage overlay]\n";
+            cout << "Partial usage: nachos [-sp fifo|mlfq|priority|stride] [-cpus n]\n";
+            cout << "Partial usage: nachos [-ks stacks]\n";
 		}
     }
+    if (scriptOnStdin && (consoleIn == NULL))
+        consoleIn = (char *)"/dev/null";	// stdin is the script, not
+						// the keyboard
 }
 
 //----------------------------------------------------------------------
@@ -99,28 +351,79 @@ Kernel::Initialize()
     // object to save its state. 
 
 	
+    stackPool = new List<int *>;	// before any thread is deleted
     currentThread = new Thread("main", threadNum++);		
     currentThread->setStatus(RUNNING);
 
     stats = new Statistics();		// collect statistics
+    Snapshot *snapshot = (restoreFile != NULL) ?
+	new Snapshot(restoreFile) : NULL;
+    if (snapshot != NULL)
+	snapshot->RestoreClock();	// before the timer and disk start
+    trace = (traceFile != NULL) ? new Trace(traceFile) : NULL;
     interrupt = new Interrupt;		// start up interrupt handling
-    scheduler = new Scheduler();	// initialize the ready queue
+    scheduler = new Scheduler(schedPolicy, numCpus);	// initialize the ready queue
     alarm = new Alarm(randomSlice);	// start up time slicing
-    machine = new Machine(debugUserProg);
-    synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
-    synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
-    synchDisk = new SynchDisk();    //
+    metrics = (metricsFd >= 0) ? new Metrics(metricsFd, metricsInterval) : NULL;
+    machine = new Machine(debugUserProg, runBlocks, threadedDispatch,
+			  batchTicks, tlbSize);
+    profiler = (profileFile != NULL) ?
+	new Profiler(profileFile, profileInterval) : NULL;
+    if (profiler != NULL)
+	machine->SetSampling(profileInterval);
+    if (snapshot != NULL) {
+	snapshot->RestoreMachine();
+	delete snapshot;
+    }
+    tlbManager = (tlbSize > 0) ?
+		new TLBManager(tlbPolicy, superPages, numCpus) : NULL;
+    ASSERT(!hashedPageTables || ((tlbSize > 0) && demandPaging));
+				// the machine walks only linear page
+				// tables, and only with demand paging
+				// are pages out of memory
+    frameTable = new FrameTable(pagePolicy, numFrames);
+    swapSpace = demandPaging ? new SwapSpace() : NULL;
+    textTable = new TextTable();
+    futexTable = new FutexTable();
+    execCache = new ExecCache(ExecCacheBytes);
+    synchConsoleIn = NULL;		// started when first used, so that
+    synchConsoleOut = NULL;		// runs without user programs don't
+    if (interactive)			// poll the keyboard
+	ConsoleIn();
+    taskQueue = new TaskQueue("task worker");
+    threadPool = new ThreadPool("pool worker", NumPoolWorkers);
 #ifdef FILESYS_STUB
+    // files are the host's: the disk is only needed to swap to
+    synchDisk = demandPaging ? new SynchDisk(diskPolicy) : NULL;
+    bufferCache = NULL;
+    inodeTable = NULL;
+    journal = NULL;
     fileSystem = new FileSystem();
 #else
+    synchDisk = new SynchDisk(diskPolicy);
+    bufferCache = new BufferCache(synchDisk, cacheSize, flushInterval,
+                                  dirtyPercent);
+    inodeTable = new InodeTable(NumCachedInodes);
+    journal = new Journal(cacheSize / 2);
+    bufferCache->SetJournal(journal);
     fileSystem = new FileSystem(formatFlag);
 #endif // FILESYS_STUB
 
 	// MP4 mod tag
-    /*
-	postOfficeIn = new PostOfficeInput(10);
-    postOfficeOut = new PostOfficeOutput(reliability);
-	*/
+    fabric = NULL;		// the network is started by what uses it
+    postOfficeIn = NULL;	// (see StartNetwork), so that other runs
+    postOfficeOut = NULL;	// can halt
+    fileServer = NULL;
+#ifndef FILESYS_STUB
+    if (exportFiles) {
+	StartNetwork();
+	fileServer = new FileServer();
+    }
+    if (fileServerHost >= 0) {
+	StartNetwork();
+	fileSystem->Mount(new RemoteFileSystem(fileServerHost));
+    }
+#endif // FILESYS_STUB
 
     interrupt->Enable();
 }
@@ -131,12 +434,62 @@ Kernel::Initialize()
 // 	Since Nachos does not disable Timer, Console after all threads complete,
 //	which will result in generating infinite interrupts. We manually disable timer,
 //	console, etc. after all threads complete.
+//
+//	Not when interactive (-it): the console then stays on, as in the
+//	original Nachos, so the idle machine waits on the host for typing
+//	(see Interrupt::Idle), and a user program must Halt.
+//
+//	This is called whenever no thread is ready, not only at the end,
+//	so the timer is left alone: it stops by itself while the machine
+//	is idle, and starts again when a thread runs (see Alarm::CallBack).
 //----------------------------------------------------------------------
 void
 Kernel::PrepareToEnd()
 {
-	alarm->Disable();
-	synchConsoleIn->Disable();
+	if (interactive)
+		return;
+	if (synchConsoleIn != NULL)
+		synchConsoleIn->Disable();
+}
+
+//----------------------------------------------------------------------
+// Kernel::StartNetwork
+// 	Connect this machine to the network, the first time something
+//	needs it.  Once it is, the machine polls for packets, and does
+//	not halt by itself when its threads are done.
+//----------------------------------------------------------------------
+
+void
+Kernel::StartNetwork()
+{
+    if (postOfficeIn != NULL)
+	return;
+    fabric = new Fabric(topologyFile);
+    postOfficeIn = new PostOfficeInput(10);
+    postOfficeOut = new PostOfficeOutput(reliability);
+}
+
+//----------------------------------------------------------------------
+// Kernel::ConsoleIn, Kernel::ConsoleOut
+// 	Return the console, starting it the first time.  Until something
+//	reads the keyboard, it is not polled, and a run that never does
+//	(a file system command, say) has no console interrupts at all.
+//----------------------------------------------------------------------
+
+SynchConsoleInput *
+Kernel::ConsoleIn()
+{
+    if (synchConsoleIn == NULL)
+	synchConsoleIn = new SynchConsoleInput(consoleIn); // input from stdin
+    return synchConsoleIn;
+}
+
+SynchConsoleOutput *
+Kernel::ConsoleOut()
+{
+    if (synchConsoleOut == NULL)
+	synchConsoleOut = new SynchConsoleOutput(consoleOut); // output to stdout
+    return synchConsoleOut;
 }
 
 //----------------------------------------------------------------------
@@ -146,22 +499,53 @@ Kernel::PrepareToEnd()
 
 Kernel::~Kernel()
 {
+#ifndef FILESYS_STUB
+    if (journal != NULL) {
+	fileSystem->Unmount();	// appends still in memory get space,
+				// changed file headers and dirty sectors
+				// reach the disk, the log is emptied, and
+				// the superblock is marked clean
+    }
+#endif
+
+    delete metrics;		// the last snapshot, and
+    delete trace;		// written out while the clock is still there
+    delete profiler;
     delete stats;
     delete interrupt;
     delete scheduler;
     delete alarm;
+    delete tlbManager;
+    delete frameTable;
+    delete swapSpace;
+    delete textTable;
+    delete futexTable;
+    for (int i = 0; i < MaxPrograms; i++) {
+	delete [] programName[i];
+	delete programDone[i];
+    }
     delete machine;
     delete synchConsoleIn;
     delete synchConsoleOut;
+    delete execCache;		// its images may hold files open
+    delete bufferCache;
     delete synchDisk;
+    delete taskQueue;
+    delete threadPool;
     delete fileSystem;
+    delete inodeTable;
+    delete journal;
+    while (!stackPool->IsEmpty())
+	DeallocBoundedArray((char *) stackPool->RemoveFront(),
+			    StackSize * sizeof(int));
+    delete stackPool;
 	
 	// Mp4 mod tag
-	/*
     delete postOfficeIn;
     delete postOfficeOut;
-    */
-	
+    delete fabric;
+
+    delete debug;	// last, so the shutdown above can still use it
     Exit(0);
 }
 
@@ -192,6 +576,39 @@ Kernel::ThreadSelfTest() {
 
 }
 
+//----------------------------------------------------------------------
+// Kernel::SaveSnapshot
+//      If asked to (-snap), save the state of the machine, so that
+//      Nachos can be started from here again (-restore).  Called once
+//      the file system commands are done, before any user program
+//      runs (see snapshot.h).
+//----------------------------------------------------------------------
+
+void
+Kernel::SaveSnapshot()
+{
+    if (snapshotFile != NULL) {
+	Snapshot *snapshot = new Snapshot(snapshotFile);
+
+	snapshot->Save();
+	delete snapshot;
+    }
+}
+
+//----------------------------------------------------------------------
+// Kernel::ThreadBenchmark
+//      Time semaphore ping-pong, yielding, lock contention and fork
+//      churn (see threadbench.h)
+//----------------------------------------------------------------------
+
+void
+Kernel::ThreadBenchmark() {
+    ThreadBench *bench = new ThreadBench();
+
+    bench->Run();
+    delete bench;
+}
+
 //----------------------------------------------------------------------
 // Kernel::ConsoleTest
 //      Test the synchconsole
@@ -207,8 +624,8 @@ Kernel::ConsoleTest() {
     cout.flush();
 
     do {
-        ch = synchConsoleIn->GetChar();
-        if(ch != EOF) synchConsoleOut->PutChar(ch);   // echo it!
+        ch = ConsoleIn()->GetChar();
+        if(ch != EOF) ConsoleOut()->PutChar(ch);   // echo it!
     } while (ch != EOF);
 
     cout << "\n";
@@ -224,6 +641,9 @@ Kernel::ConsoleTest() {
 //      3. send an acknowledgment for the other machine's message
 //      4. wait for an acknowledgement from the other machine to our 
 //          original message
+//      5. over a reliable connection between mail boxes #2, machine #0
+//          sends a stream of numbers, and machine #1 checks they all
+//          arrive, in order
 //
 //  This test works best if each Nachos machine has its own window
 //----------------------------------------------------------------------
@@ -231,6 +651,7 @@ Kernel::ConsoleTest() {
 void
 Kernel::NetworkTest() {
 
+    StartNetwork();
     if (hostName == 0 || hostName == 1) {
         // if we're machine 1, send to 0 and vice versa
         int farHost = (hostName == 0 ? 1 : 0); 
@@ -264,19 +685,179 @@ Kernel::NetworkTest() {
         outMailHdr.length = strlen(ack) + 1;
         postOfficeOut->Send(outPktHdr, outMailHdr, ack); 
 
-        // Wait for the ack from the other machine to the first message we sent
-	postOfficeIn->Receive(1, &inPktHdr, &inMailHdr, buffer);
-        cout << "Got: " << buffer << " : from " << inPktHdr.from << ", box " 
-                                                << inMailHdr.from << "\n";
+        // Wait for the ack from the other machine to the first message we
+        // sent; this time, read it where it arrived rather than copying it
+	Mail *mail = postOfficeIn->Receive(1);
+        cout << "Got: " << mail->Data() << " : from " << mail->pktHdr.from
+                                << ", box " << mail->mailHdr.from << "\n";
+        cout.flush();
+        delete mail;
+
+        // Stream numbers through the window, several at a time
+        Connection *conn = new Connection(2, farHost, 2);
+        int count = 4 * TransportWindow;
+
+        if (hostName == 0) {
+            for (int i = 0; i < count; i++)
+                conn->Send((char *)&i, sizeof(int));
+            conn->Flush();
+            cout << "Sent " << count << " messages reliably\n";
+        } else {
+            for (int i = 0; i < count; i++) {
+                int n, length = conn->Receive(buffer);
+
+                ASSERT(length == sizeof(int));
+                bcopy(buffer, (char *)&n, sizeof(int));
+                ASSERT(n == i);
+            }
+            cout << "Got " << count << " messages in order\n";
+        }
         cout.flush();
     }
 
     // Then we're done!
 }
 
+// The key-value service of Kernel::RpcTest: its procedures, and the
+// table of values it serves, on machine 0.
+
+enum { KvGet, KvPut };
+
+const int KvKeys = 1024;	// keys in the table
+const int NumKvClients = 4;	// client threads on each other machine
+const int KvCalls = 16;		// keys each of them stores and reads back
+const MailBoxAddress KvBox = 3;	// the server's mailbox; the clients
+				// use those after it
+
+static int kvTable[KvKeys];
+static Semaphore *kvClientsDone;
+
+static int KvValue(int key) { return 7 * key + 1; }
+
+//----------------------------------------------------------------------
+// KvGetHandler, KvPutHandler
+// 	Serve a request to read the value of a key (the reply is the
+//	value, or nothing for no such key), or to store a value (the
+//	reply is empty).
+//
+//	"arg" -- the table
+//	"request", "length" -- the key, or the key and the value
+//	"reply" -- where to put the reply
+//----------------------------------------------------------------------
+
+static int
+KvGetHandler(void *arg, char *request, int length, char *reply)
+{
+    int *table = (int *)arg;
+    int key;
+
+    ASSERT(length == sizeof(int));
+    bcopy(request, (char *)&key, sizeof(int));
+    if ((key < 0) || (key >= KvKeys))
+        return 0;
+    bcopy((char *)&table[key], reply, sizeof(int));
+    return sizeof(int);
+}
+
+static int
+KvPutHandler(void *arg, char *request, int length, char *reply)
+{
+    int *table = (int *)arg;
+    int pair[2];
+
+    ASSERT(length == sizeof(pair));
+    bcopy(request, (char *)pair, sizeof(pair));
+    if ((pair[0] >= 0) && (pair[0] < KvKeys))
+        table[pair[0]] = pair[1];
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// KvClient
+// 	Body of a client thread of Kernel::RpcTest: store values for its
+//	own keys, then read them back, with every call of each round on
+//	its way at once, as far as the window allows.
+//
+//	"which" -- the client on this machine, from 0
+//----------------------------------------------------------------------
+
+static void
+KvClient(int which)
+{
+    RpcClient *client = new RpcClient(KvBox + 1 + which, 0, KvBox);
+    RpcCall *calls[KvCalls];
+    char *reply = new char[MaxRpcSize];
+    int first = ((kernel->hostName - 1) * NumKvClients + which) * KvCalls;
+
+    for (int i = 0; i < KvCalls; i++) {
+        int key = (first + i) % KvKeys;
+        int pair[2] = { key, KvValue(key) };
+
+        calls[i] = client->Start(KvPut, (char *)pair, sizeof(pair));
+    }
+    for (int i = 0; i < KvCalls; i++)
+        ASSERT(client->Wait(calls[i], reply) == 0);
+
+    for (int i = 0; i < KvCalls; i++) {
+        int key = (first + i) % KvKeys;
+
+        calls[i] = client->Start(KvGet, (char *)&key, sizeof(int));
+    }
+    for (int i = 0; i < KvCalls; i++) {
+        int key = (first + i) % KvKeys, value;
+
+        ASSERT(client->Wait(calls[i], reply) == sizeof(int));
+        bcopy(reply, (char *)&value, sizeof(int));
+        ASSERT(value == KvValue(key));
+    }
+    cout << "Client " << which << ": " << 2 * KvCalls << " calls answered\n";
+    delete [] reply;
+    kvClientsDone->V();
+}
+
+//----------------------------------------------------------------------
+// Kernel::RpcTest
+//      Test remote procedure calls with a small key-value service.
+//	Machine 0 serves it, at mail box #3; on every other machine,
+//	several client threads store values and read them back, each
+//	from a mail box of its own, with many calls on their way at
+//	once.  The server takes the requests waiting for it together,
+//	and has a pool of workers serve them.
+//
+//  The server runs until Nachos is killed.
+//----------------------------------------------------------------------
+
+void
+Kernel::RpcTest()
+{
+    StartNetwork();
+    if (hostName == 0) {
+        RpcServer *server = new RpcServer(KvBox);
+
+        server->Register(KvGet, KvGetHandler, kvTable);
+        server->Register(KvPut, KvPutHandler, kvTable);
+        cout << "Serving keys at box " << KvBox << "\n";
+        return;
+    }
+
+    kvClientsDone = new Semaphore("kv clients", 0);
+    for (int i = 0; i < NumKvClients; i++) {
+        Thread *t = new Thread("kv client", 1);
+
+        t->Fork((VoidFunctionPtr) KvClient, (void *) i);
+    }
+    for (int i = 0; i < NumKvClients; i++)
+        kvClientsDone->P();
+    cout << "All " << NumKvClients << " clients done\n";
+    delete kvClientsDone;
+}
+
 void ForkExecute(Thread *t)
 {
 	if ( !t->space->Load(t->getName()) ) {
+	delete t->space;
+	t->space = NULL;
+	kernel->ProgramEnded(t->getID(), -1);
     	return;             // executable not found
     }
 	
@@ -284,6 +865,16 @@ void ForkExecute(Thread *t)
 
 }
 
+//----------------------------------------------------------------------
+// RunLoaded
+// 	Start the program Kernel::Exec was given, already loaded.
+//----------------------------------------------------------------------
+
+static void RunLoaded(Thread *t)
+{
+    t->space->Execute(t->getName());
+}
+
 void Kernel::ExecAll()
 {
 	for (int i=1;i<=execfileNum;i++) {
@@ -296,6 +887,9 @@ void Kernel::ExecAll()
 
 int Kernel::Exec(char* name)
 {
+	if (threadNum == MaxPrograms)
+		return -1;
+	programDone[threadNum] = new Semaphore("program exit", 0);
 	t[threadNum] = new Thread(name, threadNum);
 	t[threadNum]->space = new AddrSpace();
 	t[threadNum]->Fork((VoidFunctionPtr) &ForkExecute, (void *)t[threadNum]);
@@ -329,6 +923,157 @@ int Kernel::Exec(char* name)
 //  cout << "after ThreadedKernel:Run();" << endl;  // unreachable
 }
 
+//----------------------------------------------------------------------
+// ForkReturn
+// 	Start the child made by Kernel::Fork: carry on running its user
+//	program from the registers it was given.
+//----------------------------------------------------------------------
+
+static void ForkReturn(Thread *t)
+{
+    kernel->scheduler->LoadUserState(t);
+    kernel->machine->Run();
+    ASSERTNOTREACHED();
+}
+
+//----------------------------------------------------------------------
+// Kernel::Fork
+// 	Run a copy of the user program of the current thread, in a new
+//	thread with a copy-on-write copy of its address space (see
+//	AddrSpace::Fork), from the system call that asked for it.  The
+//	parent is given the child's thread number, the child 0.
+//
+//	Return -1 if there is no room for the child.
+//----------------------------------------------------------------------
+
+int Kernel::Fork()
+{
+#ifdef FILESYS_STUB
+    return -1;
+#else
+    AddrSpace *space;
+    Thread *child;
+
+    if (threadNum == MaxPrograms) {
+	return -1;			// no room in t[]
+    }
+    space = currentThread->space->Fork();
+    if (space == NULL) {
+	return -1;
+    }
+    child = new Thread(currentThread->getName(), threadNum);
+    child->space = space;
+    (void) space->AddThread(child);	// its first thread
+    child->SaveUserState();		// the parent's registers, but it
+    child->SetUserRegister(2, 0);	// gets 0, and is past the syscall
+    child->SetUserRegister(PrevPCReg, machine->ReadRegister(PCReg));
+    child->SetUserRegister(PCReg, machine->ReadRegister(NextPCReg));
+    child->SetUserRegister(NextPCReg, machine->ReadRegister(NextPCReg) + 4);
+    t[threadNum] = child;
+    programDone[threadNum] = new Semaphore("program exit", 0);
+    child->Fork((VoidFunctionPtr) &ForkReturn, (void *)child);
+    return threadNum++;
+#endif
+}
+
+//----------------------------------------------------------------------
+// Kernel::Exec
+// 	Run the program "name", loaded into "space" by the caller (for
+//	ExecV, so that a program that cannot be loaded is an error the
+//	caller sees), in a new thread.  Return its SpaceId, or -1 if
+//	there is no room for it.
+//----------------------------------------------------------------------
+
+int Kernel::Exec(char *name, AddrSpace *space)
+{
+    Thread *thread;
+    int id = threadNum;
+
+    if (id == MaxPrograms) {
+	return -1;
+    }
+    programName[id] = new char[strlen(name) + 1];
+    strcpy(programName[id], name);
+    programDone[id] = new Semaphore("program exit", 0);
+    thread = new Thread(programName[id], id);
+    thread->space = space;
+    t[id] = thread;
+    threadNum++;
+    thread->Fork((VoidFunctionPtr) &RunLoaded, (void *)thread);
+    return id;
+}
+
+//----------------------------------------------------------------------
+// Kernel::ProgramEnded
+// 	Note that the last thread of program "id" exited with "status",
+//	and wake the thread joining it, if any.
+//----------------------------------------------------------------------
+
+void Kernel::ProgramEnded(int id, int status)
+{
+    if (programDone[id] == NULL) {	// the kernel's own
+	return;
+    }
+    exitStatus[id] = status;
+    programDone[id]->V();
+}
+
+//----------------------------------------------------------------------
+// Kernel::Join
+// 	Wait for program "id" to end, and return what it gave Exit.  A
+//	program can be joined once, and not by itself.
+//
+//	Return -1 if there is no such program, or it cannot be joined.
+//----------------------------------------------------------------------
+
+int Kernel::Join(int id)
+{
+    int status;
+
+    if ((id < 0) || (id >= threadNum) || (programDone[id] == NULL) ||
+		joining[id] || (id == currentThread->getID())) {
+	return -1;
+    }
+    joining[id] = TRUE;
+    programDone[id]->P();
+    status = exitStatus[id];
+    delete programDone[id];
+    programDone[id] = NULL;
+    return status;
+}
+
+//----------------------------------------------------------------------
+// Kernel::ThreadFork
+// 	Run another thread of the user program of the current thread, in
+//	the same address space, on a stack of its own: from "func", with
+//	the registers it has when it makes the system call asking for
+//	it, so that it shares the program's global pointer, and
+//	returning to "returnAddr".  Return its ThreadId, or -1 if the
+//	program has as many threads as it can have.
+//----------------------------------------------------------------------
+
+int Kernel::ThreadFork(int func, int returnAddr)
+{
+    AddrSpace *space = currentThread->space;
+    Thread *thread = new Thread(currentThread->getName(), currentThread->getID());
+    int id = space->AddThread(thread);
+
+    if (id == -1) {
+	delete thread;
+	return -1;
+    }
+    thread->space = space;
+    thread->SaveUserState();
+    thread->SetUserRegister(2, 0);
+    thread->SetUserRegister(StackReg, space->StackTop(id));
+    thread->SetUserRegister(RetAddrReg, returnAddr);
+    thread->SetUserRegister(PrevPCReg, func);
+    thread->SetUserRegister(PCReg, func);
+    thread->SetUserRegister(NextPCReg, func + 4);
+    thread->Fork((VoidFunctionPtr) &ForkReturn, (void *)thread);
+    return id;
+}
+
 #ifdef FILESYS_STUB
 int Kernel::CreateFile(char *filename)
 {
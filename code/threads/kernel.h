@@ -21,11 +21,33 @@
 
 class PostOfficeInput;
 class PostOfficeOutput;
+class Fabric;
+class FileServer;
+class Trace;
+class Profiler;
+class Metrics;
 class SynchConsoleInput;
 class SynchConsoleOutput;
 class SynchDisk;
-
-
+class BufferCache;
+class InodeTable;
+class Journal;
+class TLBManager;
+class FrameTable;
+class SwapSpace;
+class TextTable;
+class FutexTable;
+class ExecCache;
+class AddrSpace;
+class Semaphore;
+class TaskQueue;
+class ThreadPool;
+
+
+
+#define MaxPrograms	MaxSpaces	// programs that can be run, counting
+				// the kernel's own thread; SpaceIds
+				// are not reused
 
 class Kernel {
   public:
@@ -42,10 +64,26 @@ class Kernel {
 	
 	void ExecAll();
 	int Exec(char* name);
+	int Exec(char *name, AddrSpace *space);
+				// run a loaded program; its SpaceId
+	int Join(int id);	// wait for it to end, and return its
+				// exit status; -1 if it cannot be
+	void ProgramEnded(int id, int status);
+				// its last thread has exited
+	int Fork();		// run a copy of the current program
+	int ThreadFork(int func, int returnAddr);
+				// run another thread of it
+    void SaveSnapshot();	// save the machine for -restore (-snap)
+    SynchConsoleInput *ConsoleIn();	// the console, started when
+    SynchConsoleOutput *ConsoleOut();	// first used
     void ThreadSelfTest();	// self test of threads and synchronization
+    void ThreadBenchmark();	// time thread switching and scheduling
 	
     void ConsoleTest();         // interactive console self test
+    void StartNetwork();	// connect to the network, if not yet
     void NetworkTest();         // interactive 2-machine network test
+    void RpcTest();		// key-value service over RPC, with
+				// machine 0 serving the others
 	Thread* getThread(int threadID){return t[threadID];}    
 
 	#ifdef FILESYS_STUB	
@@ -61,26 +99,109 @@ class Kernel {
     Statistics *stats;		// performance metrics
     Alarm *alarm;		// the software alarm clock    
     Machine *machine;           // the simulated CPU
-    SynchConsoleInput *synchConsoleIn;
+    TLBManager *tlbManager;	// loads the machine's TLB, if it has one
+    FrameTable *frameTable;	// what is in each frame of memory
+    SwapSpace *swapSpace;	// demand paging: where pages are kept
+    bool hashedPageTables;	// do address spaces keep page table
+				// entries only for pages in memory?
+    TextTable *textTable;	// code shared by address spaces
+    FutexTable *futexTable;	// user threads waiting on futexes
+    ExecCache *execCache;	// images of programs recently run
+    SynchConsoleInput *synchConsoleIn;	// NULL until used; see ConsoleIn
     SynchConsoleOutput *synchConsoleOut;
     SynchDisk *synchDisk;
+    TaskQueue *taskQueue;	// short work done in the background
+    ThreadPool *threadPool;	// workers for longer background jobs
+    BufferCache *bufferCache;	// cache of disk sectors for the file system
+    InodeTable *inodeTable;	// file headers of the files in use
+    Journal *journal;		// log of file system metadata changes
     FileSystem *fileSystem;     
     PostOfficeInput *postOfficeIn;
     PostOfficeOutput *postOfficeOut;
+    Fabric *fabric;		// model of the links between machines
+    FileServer *fileServer;	// exports the file system, or NULL
+    Trace *trace;		// events traced, or NULL (-trace)
+    Profiler *profiler;		// samples user programs, or NULL (-prof)
+    Metrics *metrics;		// snapshots of the statistics taken while
+				// running, or NULL (-metrics)
 
     int hostName;               // machine identifier
+    int wireSize;		// bytes in each network packet (-mtu)
+    bool mapDisk;               // map the disk's UNIX file into memory
+    bool dedupDisk;		// keep it deduplicated (-dd)
+    int diskSegments;		// segments in the disk's read cache, 0
+				// for a track buffer only (-dc)
+    int segmentSectors;		// and sectors in each
+    int writeCacheSectors;	// sectors in its write cache (-dwc)
+    int diskCoalesceCount;	// disk requests done to tell the CPU
+				// about at once, 0 for each (-dco)
+    int diskCoalesceTicks;	// or how long the first may wait
+    int flashChannels;		// channels of the flash disk used
+				// instead, or 0 (-flash)
+    int flashQueueDepth;	// and requests it takes at once
+    int raidLevel;		// how a volume of disks is combined
+    int raidMembers;		// and how many, or 0 (-raid)
+    int stripeSectors;		// sectors per stripe unit (-stripe)
+    char *diskBase;		// base image of a layered disk, or NULL
+    char *diskOverlay;		// and the overlay on it (-base)
+    bool printStats;		// print the statistics at halt (-ps)
+    int resultFile;		// send them here at halt, or -1 (-result)
+    char *histogramFile;	// write the latency histograms here at
+				// halt, or NULL (-hist)
+    List<int *> *stackPool;	// stacks of deleted threads, for Fork
+    int stackPoolSize;		// most stacks it keeps
+#ifndef FILESYS_STUB
+    int clusterSectors;		// sectors per cluster of file data, when
+				// formatting (-cluster)
+    bool checksumDisk;		// keep a checksum of every sector, when
+				// formatting (-ck)
+#endif
 
   private:
 
-	Thread* t[10];
+	Thread* t[MaxPrograms];
+	char *programName[MaxPrograms];	// names given Exec by programs
+	int exitStatus[MaxPrograms];	// what each program gave Exit
+	Semaphore *programDone[MaxPrograms];
+				// signalled when it ends; NULL once
+				// it has been joined
+	bool joining[MaxPrograms];	// is a thread waiting in Join?
 	char*   execfile[10];
 	int execfileNum;
 	int threadNum;
     bool randomSlice;		// enable pseudo-random time slicing
     bool debugUserProg;         // single step user program
+    bool runBlocks;		// simulate user code a basic block at a time
+    bool threadedDispatch;	// with threaded dispatch
+    bool batchTicks;		// check for interrupts only when one is due
+    int tlbSize;		// entries in the TLB; 0 for a page table
+    char *tlbPolicy;		// how to replace TLB entries
+    bool superPages;		// let a TLB entry map a run of pages
+    bool demandPaging;		// page user programs in from swap space
+    char *pagePolicy;		// how to replace pages
+    int numFrames;		// frames user pages may have
     double reliability;         // likelihood messages are dropped
+    char *topologyFile;		// links between machines (-topo)
+    int fileServerHost;		// whose file system to mount (-nfs),
+				// or -1
+    bool exportFiles;		// serve ours to others (-nfsd)
     char *consoleIn;            // file to read console input from
+    bool interactive;		// keep the console on while idle
     char *consoleOut;           // file to send console output to
+    char *traceFile;		// file to write the trace to, or NULL
+    int metricsFd;		// host file to write snapshots to, or -1
+    int metricsInterval;	// ticks between them, or 0 for on SIGUSR1
+				// only
+    char *profileFile;		// file to write the profile to, or NULL
+    int profileInterval;	// instructions between samples
+    char *snapshotFile;		// file to save a snapshot to, or NULL
+    char *restoreFile;		// snapshot to start from, or NULL
+    int cacheSize;		// number of sectors in the buffer cache
+    int flushInterval;		// ticks before it is flushed behind
+    int dirtyPercent;		// or the percentage of it dirty
+    char *diskPolicy;		// how to schedule disk requests
+    char *schedPolicy;		// how to choose the next thread to run
+    int numCpus;		// simulated CPUs to run threads on
 #ifndef FILESYS_STUB
     bool formatFlag;          // format the disk if this is true
 #endif
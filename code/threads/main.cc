@@ -3,32 +3,176 @@
 //	operating system kernel.
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//              -s -x <nachos file> -ci <consoleIn> -co <consoleOut>
-//              -f -cp <unix file> <nachos file>
-//              -p <nachos file> -r <nachos file> -l -D
-//              -n <network reliability> -m <machine id>
-//              -z -K -C -N
+//              -s -bb -td -bi -tlb <entries> -tp <policy> -tsp -vm -vp <policy> -vf <frames> -hpt
+//              -sp <policy> -cpus <n> -ks <stacks>
+//              -x <nachos file> -ci <consoleIn> -co <consoleOut> -it
+//              -f -cp <unix file> <nachos file> -cpr <unix dir> <nachos dir>
+//              -p <nachos file> -r <nachos file> -cz <nachos file>
+//              -mv <nachos file> <nachos file>
+//              -clone <nachos file> <nachos file>
+//              -l -lr <nachos dir> -lrd <depth> -lrf <pattern>
+//              -D -fsck -fsckr
+//              -bench <report file> -script <script file>
+//              -hist <histogram file> -metrics <fd> <ticks>
+//              -n <network reliability> -m <machine id> -mtu <bytes>
+//              -topo <topology file> -nfs <machine id> -nfsd
+//              -snap <snapshot file> -restore <snapshot file>
+//              -base <base image> <overlay file> -dd
+//              -dc <segments> <sectors> -dwc <sectors>
+//              -dco <requests> <ticks>
+//              -flash <channels> <queue depth>
+//              -raid <level> <disks> -stripe <sectors>
+//              -z -K -KB -C -N -NR
+//       nachos -batch <job file> -j <workers>
 //
-//    -d causes certain debugging messages to be printed (see debug.h)
+//    -d causes certain debugging messages to be printed (see debug.h);
+//	 a release build has none to print
 //    -rs causes Yield to occur at random (but repeatable) spots
 //    -z prints the copyright message
 //    -s causes user programs to be executed in single-step mode
+//    -bb simulates user programs a basic block at a time, instead of
+//        one instruction at a time; the results are the same
+//    -td is -bb, with the instructions of a block dispatched threaded,
+//        each straight to the next, instead of through one switch
+//    -bi checks for interrupts only when the next one is due, instead
+//        of after every user instruction; the results are the same
+//    -tlb translates user addresses through a software-loaded TLB with
+//        this many entries, instead of the page table
+//    -tp sets how TLB entries are replaced: fifo (the default), lru
+//        or random
+//    -tsp lets one TLB entry map an aligned run of up to MaxSuperPage
+//        pages in consecutive frames (a superpage)
+//    -vm pages user programs in from a swap area on the disk, on
+//        demand, so that they need not fit in memory
+//    -vp sets how pages are replaced: fifo (the default), clock or lru
+//    -vf limits user programs to this many frames of memory
+//    -hpt keeps each program's page table in a hash table, with
+//        entries only for its pages in memory (needs -tlb and -vm)
+//    -sp sets how the next thread to run is chosen: fifo (the
+//        default), mlfq, a multi-level feedback queue, priority,
+//        the highest priority thread first, or stride, each thread
+//        in proportion to its tickets (see SetTickets)
+//    -cpus runs threads on this many simulated CPUs, in turn, each
+//        with its own ready list (fifo only)
+//    -ks keeps up to this many stacks of finished threads for new
+//        threads to reuse (StackPoolSize by default)
 //    -x runs a user program
 //    -ci specify file for console input (stdin is the default)
 //    -co specify file for console output (stdout is the default)
+//    -it keeps the console on while Nachos is idle, waiting for input
+//        without using the host CPU; otherwise, as soon as no thread
+//        is ready, the console and timer are turned off, and
+//        simulated time jumps from one disk interrupt to the next
 //    -n sets the network reliability
 //    -m sets this machine's host id (needed for the network)
+//    -mtu sets the size of each packet on the network, header included
+//        (DefaultWireSize by default); every machine must use the same
+//    -topo reads the latency, bandwidth and queue of each machine's
+//        link to the network switch from a file (see machine/fabric.h);
+//        every machine must read the same one
+//    -nfs mounts the file system of another machine under /net, to be
+//        read and written over the network, with the blocks read kept
+//        in a cache on leases (see filesys/remotefs.h)
+//    -nfsd serves this machine's file system to those that mount it
+//    -trace records thread switches, interrupts, disk requests and
+//        system calls, and writes them to a file when Nachos halts, for
+//        chrome://tracing or Perfetto (see threads/trace.h)
+//    -prof samples the stacks of user programs every -pi instructions
+//        (default 1000), and writes a flat profile to a file when Nachos
+//        halts, and the stacks, for flame graphs, to the file ".folded";
+//        program "foo" is symbolized from "foo.coff" (see
+//        userprog/profiler.h)
+//    -snap saves the simulated machine -- clock, registers, memory and
+//        disk -- to a file once the file system flags below are done,
+//        before any user program runs
+//    -restore starts from a snapshot instead, skipping the formatting
+//        and copying it was made after (see threads/snapshot.h)
+//    -base runs on a layered disk: a disk file prepared by an earlier
+//        run is only read, and the sectors written go to an overlay
+//        file, so that many runs can share one base (see
+//        machine/disk.h); not with -snap or -restore
+//    -dd keeps the disk's UNIX file deduplicated: sectors with the same
+//        contents are stored once (see machine/dedup.h); not with
+//        -base, -dm, -snap or -restore
+//    -dc gives the disk a read cache of this many segments, of this
+//        many sectors each, filled by read-ahead, instead of a track
+//        buffer; -dwc a write cache of this many sectors, written to
+//        the platter when it overflows or is flushed (see machine/disk.h)
+//    -dco batches disk completions: the CPU is interrupted once this
+//        many requests are done, or the first has waited this many
+//        ticks (0 for no limit), or the disk has nothing left to do,
+//        and all their threads are woken at once (see
+//        filesys/synchdisk.h)
+//    -flash runs on a flash disk of this many channels instead, taking
+//        up to this many requests at once (see machine/flash.h)
+//    -raid runs on a volume of this many disks, striped (level 0) or
+//        mirrored (level 1), each in a file DISK_<host>.<i>; -stripe
+//        gives the sectors per stripe unit (see machine/raid.h); not
+//        with -base, -snap or -restore
+//    -ps prints performance statistics when Nachos halts, ending with
+//        the host time taken and the user instructions simulated per
+//        host microsecond (see test/cpu-bench.sh); the times taken by
+//        disk requests, by each system call, and by threads waiting to
+//        run are given as percentiles (p50, p99, p99.9)
+//    -hist writes those times to a file when Nachos halts, with every
+//        bucket of their histograms, a line each (see
+//        Statistics::ExportHistograms)
+//    -metrics writes snapshots of the statistics to an open file
+//        descriptor while Nachos runs: every so many ticks (0 for never),
+//        each time it gets SIGUSR1, and at halt (see threads/metrics.h)
 //    -K run a simple self test of kernel threads and synchronization
+//    -KB time thread switches: semaphore ping-pong, yield storms, lock
+//        contention and fork churn (see threads/threadbench.h)
 //    -C run an interactive console test
 //    -N run a two-machine network test (see Kernel::NetworkTest)
+//    -NR run a key-value service over RPC, served by machine 0 to the
+//        others (see Kernel::RpcTest)
+//    -result sends the statistics, in binary, to an open file
+//        descriptor when Nachos halts; the batch runner passes it
+//
+//    -batch runs each line of a file as the flags of a separate Nachos,
+//        in worker processes, up to -j at once (one per host CPU by
+//        default), and prints a summary of their statistics (see
+//        threads/batch.h)
 //
 //    Filesystem-related flags:
 //    -f forces the Nachos disk to be formatted
+//    -cluster gives the sectors in a cluster of file data, when formatting
+//        (a power of two, 1 by default; see filesys/pbitmap.h)
+//    -ck keeps a CRC-32C of every sector the file system writes, checked
+//        each time it is read back, when formatting (see filesys/checksum.h)
 //    -cp copies a file from UNIX to Nachos
+//    -cpr copies a UNIX directory, and everything under it, to Nachos,
+//        reading the UNIX files on the kernel's thread pool while the
+//        ones before are written, and creating them a directory's worth
+//        at a time (see filesys/hostimport.h)
 //    -p prints a Nachos file to stdout
 //    -r removes a Nachos file from the file system
+//    -rr removes a Nachos directory and everything under it
+//    -mv renames a Nachos file or directory, replacing any file that
+//        already has the new name
+//    -clone makes a copy-on-write clone of a Nachos file or directory:
+//        the data is shared, and copied a cluster at a time as either
+//        copy is written (see filesys/filehdr.h); so a big tree is
+//        copied in the time it takes to write its headers
+//    -cz compresses a Nachos file in place, in chunks expanded as they
+//        are read; writing to it expands it back (see filesys/filehdr.h)
 //    -l lists the contents of the Nachos directory
+//    -lr lists a Nachos directory and everything under it, as a tree,
+//        reading a level of the tree at a time (see
+//        FileSystem::ListRecursively)
+//    -lrd opens no more than this many levels of directories under it
+//    -lrf lists only the files whose names match a pattern, with '*'
+//        and '?' as wildcards (quote it from the shell)
 //    -D prints the contents of the entire file system
+//    -fsck checks the free map against the files and directories
+//    -fsckr does the same, and repairs the free map
+//    -bench times file system operations, and writes a CSV report to
+//        a file, or to stdout for "-" (see filesys/fsbench.h); use a
+//        freshly formatted disk
+//    -script runs many of the commands above, one per line of a file
+//        (or of stdin, for "-"), in one kernel, with the disk mounted
+//        once and the caches kept warm: "cp a /a", "mkdir /d", ...
 //
 //  Note: the file system flags are not used if the stub filesystem
 //        is being used
@@ -44,6 +188,9 @@
 #include "main.h"
 #include "filesys.h"
 #include "openfile.h"
+#include "fsbench.h"
+#include "hostimport.h"
+#include "batch.h"
 #include "sysdep.h"
 
 // global variables
@@ -69,10 +216,22 @@ Cleanup(int x)
 //-------------------------------------------------------------------
 static const int TransferSize = 128;
 
+//-------------------------------------------------------------------
+// Constant used by "Copy" for each write to the Nachos file
+//   Big enough that the file is written whole disk runs at a time
+//-------------------------------------------------------------------
+static const int BulkTransferSize = 64 * 128;
+
 #ifndef FILESYS_STUB
 //----------------------------------------------------------------------
 // Copy
 //      Copy the contents of the UNIX file "from" to the Nachos file "to"
+//
+//	The Nachos file is created at its final size, so its sectors
+//	are allocated (contiguously, if there is room) and the bitmap and
+//	directory written back just once.  The data is then streamed in
+//	BulkTransferSize pieces, which the file system writes whole
+//	sectors at a time, straight to disk.
 //----------------------------------------------------------------------
 
 static void Copy(char *from, char *to)
@@ -109,9 +268,9 @@ static void Copy(char *from, char *to)
     
     DEBUG('f', "Successfully opened file.");
 
-    // Copy the data in TransferSize chunks
-    buffer = new char[TransferSize];
-    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * TransferSize)) > 0)
+    // Copy the data in BulkTransferSize chunks
+    buffer = new char[BulkTransferSize];
+    while ((amountRead = ReadPartial(fd, buffer, sizeof(char) * BulkTransferSize)) > 0)
         openFile->Write(buffer, amountRead);
     delete[] buffer;
 
@@ -120,6 +279,20 @@ static void Copy(char *from, char *to)
     Close(fd);
 }
 
+//----------------------------------------------------------------------
+// CopyTree
+//      Copy the UNIX directory "from", and everything under it, to the
+//	Nachos directory "to".
+//----------------------------------------------------------------------
+
+static void CopyTree(char *from, char *to)
+{
+    HostImport *import = new HostImport(from, to);
+
+    import->Run();
+    delete import;
+}
+
 #endif // FILESYS_STUB
 
 //----------------------------------------------------------------------
@@ -159,8 +332,93 @@ static void CreateDirectory(char *name)
     kernel->fileSystem->TraverseDirectory(name);
 }
 
+#ifndef FILESYS_STUB
 //----------------------------------------------------------------------
-// main
+// RunScript
+//      Run the file system commands in the file "name" ("-" for
+//	stdin), one per line, in this one kernel: the disk is mounted
+//	once, and the buffer cache and open file headers stay warm from
+//	one command to the next.
+//
+//	Each line is a file system flag, with or without its "-", and its
+//	arguments: "cp unixFile nachosFile", "cpr unixDir nachosDir",
+//	"mkdir dir", "p file",
+//	"r file", "rr dir", "mv from to", "clone from to", "l dir",
+//	"lr dir [pattern]", "D",
+//	"fsck", "fsckr"; or
+//	"echo text", to print the text.  Blank lines, and lines starting
+//	with '#', are skipped.
+//----------------------------------------------------------------------
+
+#define MaxScriptLine 1024
+
+static void RunScript(char *name)
+{
+    FILE *script = (strcmp(name, "-") == 0) ? stdin : fopen(name, "r");
+    char line[MaxScriptLine];
+
+    if (script == NULL)
+    {
+        printf("Script: couldn't open %s\n", name);
+        return;
+    }
+    while (fgets(line, MaxScriptLine, script) != NULL)
+    {
+        char *command = strtok(line, " \t\r\n");
+        char *arg1, *arg2;
+
+        if ((command == NULL) || (*command == '#'))
+            continue;
+        if (*command == '-')
+            command++;
+        if (strcmp(command, "echo") == 0)
+        {
+            char *text = strtok(NULL, "\r\n");
+
+            printf("%s\n", (text != NULL) ? text : "");
+            continue;
+        }
+        arg1 = strtok(NULL, " \t\r\n");
+        arg2 = strtok(NULL, " \t\r\n");
+        DEBUG('f', "Script: " << command);
+        if ((strcmp(command, "cp") == 0) && (arg2 != NULL))
+            Copy(arg1, arg2);
+        else if ((strcmp(command, "cpr") == 0) && (arg2 != NULL))
+            CopyTree(arg1, arg2);
+        else if ((strcmp(command, "mkdir") == 0) && (arg1 != NULL))
+            CreateDirectory(arg1);
+        else if ((strcmp(command, "p") == 0) && (arg1 != NULL))
+            Print(arg1);
+        else if ((strcmp(command, "r") == 0) && (arg1 != NULL))
+            kernel->fileSystem->Remove(arg1);
+        else if ((strcmp(command, "rr") == 0) && (arg1 != NULL))
+            kernel->fileSystem->Remove(arg1, TRUE);
+        else if ((strcmp(command, "mv") == 0) && (arg2 != NULL))
+            kernel->fileSystem->Rename(arg1, arg2);
+        else if ((strcmp(command, "clone") == 0) && (arg2 != NULL))
+            kernel->fileSystem->Clone(arg1, arg2);
+        else if ((strcmp(command, "cz") == 0) && (arg1 != NULL))
+            kernel->fileSystem->Compress(arg1);
+        else if ((strcmp(command, "l") == 0) && (arg1 != NULL))
+            kernel->fileSystem->List();
+        else if ((strcmp(command, "lr") == 0) && (arg1 != NULL))
+            kernel->fileSystem->ListRecursively(arg1, -1, arg2);
+        else if (strcmp(command, "D") == 0)
+            kernel->fileSystem->Print();
+        else if (strcmp(command, "fsck") == 0)
+            kernel->fileSystem->Check(FALSE);
+        else if (strcmp(command, "fsckr") == 0)
+            kernel->fileSystem->Check(TRUE);
+        else
+            printf("Script: bad command %s\n", command);
+    }
+    if (script != stdin)
+        fclose(script);
+}
+#endif // FILESYS_STUB
+
+//----------------------------------------------------------------------
+// Boot
 // 	Bootstrap the operating system kernel.
 //
 //	Initialize kernel data structures
@@ -173,19 +431,26 @@ static void CreateDirectory(char *name)
 //		ex: "nachos -d +" -> argv = {"nachos", "-d", "+"}
 //----------------------------------------------------------------------
 
-int main(int argc, char **argv)
+static int Boot(int argc, char **argv)
 {
     int i;
     char *debugArg = "";
     char *userProgName = NULL; // default is not to execute a user prog
     bool threadTestFlag = false;
+    bool threadBenchFlag = false;
     bool consoleTestFlag = false;
     bool networkTestFlag = false;
+    bool rpcTestFlag = false;
 #ifndef FILESYS_STUB
     char *copyUnixFileName = NULL;   // UNIX file to be copied into Nachos
     char *copyNachosFileName = NULL; // name of copied file in Nachos
+    char *copyUnixDirName = NULL;    // UNIX directory to copy from
+    char *copyNachosDirName = NULL;  // and Nachos directory to copy to
     char *printFileName = NULL;
     char *removeFileName = NULL;
+    char *compressFileName = NULL;
+    char *renameFrom = NULL, *renameTo = NULL;
+    char *cloneFrom = NULL, *cloneTo = NULL;
     bool dirListFlag = false;
     bool dumpFlag = false;
     // MP4 mod tag
@@ -193,7 +458,13 @@ int main(int argc, char **argv)
     char *listDirectoryName = NULL;
     bool mkdirFlag = false;
     bool recursiveListFlag = false;
+    int recursiveListDepth = -1;
+    char *recursiveListFilter = NULL;
     bool recursiveRemoveFlag = false;
+    bool checkFlag = false;
+    bool repairFlag = false;
+    char *benchReportName = NULL;
+    char *scriptName = NULL;
 #endif //FILESYS_STUB
 
     // some command line arguments are handled here.
@@ -221,6 +492,10 @@ int main(int argc, char **argv)
         {
             threadTestFlag = TRUE;
         }
+        else if (strcmp(argv[i], "-KB") == 0)
+        {
+            threadBenchFlag = TRUE;
+        }
         else if (strcmp(argv[i], "-C") == 0)
         {
             consoleTestFlag = TRUE;
@@ -229,6 +504,10 @@ int main(int argc, char **argv)
         {
             networkTestFlag = TRUE;
         }
+        else if (strcmp(argv[i], "-NR") == 0)
+        {
+            rpcTestFlag = TRUE;
+        }
 #ifndef FILESYS_STUB
         else if (strcmp(argv[i], "-cp") == 0)
         {
@@ -237,6 +516,13 @@ int main(int argc, char **argv)
             copyNachosFileName = argv[i + 2];
             i += 2;
         }
+        else if (strcmp(argv[i], "-cpr") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            copyUnixDirName = argv[i + 1];
+            copyNachosDirName = argv[i + 2];
+            i += 2;
+        }
         else if (strcmp(argv[i], "-p") == 0)
         {
             ASSERT(i + 1 < argc);
@@ -257,6 +543,26 @@ int main(int argc, char **argv)
             recursiveRemoveFlag = true;
             i++;
         }
+        else if (strcmp(argv[i], "-mv") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            renameFrom = argv[i + 1];
+            renameTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-clone") == 0)
+        {
+            ASSERT(i + 2 < argc);
+            cloneFrom = argv[i + 1];
+            cloneTo = argv[i + 2];
+            i += 2;
+        }
+        else if (strcmp(argv[i], "-cz") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            compressFileName = argv[i + 1];
+            i++;
+        }
         else if (strcmp(argv[i], "-l") == 0)
         {
             // MP4 mod tag
@@ -274,6 +580,18 @@ int main(int argc, char **argv)
             recursiveListFlag = true;
             i++;
         }
+        else if (strcmp(argv[i], "-lrd") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            recursiveListDepth = atoi(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "-lrf") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            recursiveListFilter = argv[i + 1];
+            i++;
+        }
         else if (strcmp(argv[i], "-mkdir") == 0)
         {
             // MP4 mod tag
@@ -286,16 +604,45 @@ int main(int argc, char **argv)
         {
             dumpFlag = true;
         }
+        else if (strcmp(argv[i], "-fsck") == 0)
+        {
+            checkFlag = true;
+        }
+        else if (strcmp(argv[i], "-fsckr") == 0)
+        {
+            checkFlag = true;
+            repairFlag = true;
+        }
+        else if (strcmp(argv[i], "-bench") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            benchReportName = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-script") == 0)
+        {
+            ASSERT(i + 1 < argc);
+            scriptName = argv[i + 1];
+            i++;
+        }
 #endif //FILESYS_STUB
         else if (strcmp(argv[i], "-u") == 0)
         {
             cout << "Partial usage: nachos [-z -d debugFlags]\n";
             cout << "Partial usage: nachos [-x programName]\n";
-            cout << "Partial usage: nachos [-K] [-C] [-N]\n";
+            cout << "Partial usage: nachos [-K] [-KB] [-C] [-N]\n";
+            cout << "Partial usage: nachos -batch jobFile [-j workers]\n";
 #ifndef FILESYS_STUB
             cout << "Partial usage: nachos [-cp UnixFile NachosFile]\n";
-            cout << "Partial usage: nachos [-p fileName] [-r fileName]\n";
+            cout << "Partial usage: nachos [-cpr UnixDir NachosDir]\n";
+            cout << "Partial usage: nachos [-p fileName] [-r fileName] [-cz fileName]\n";
+            cout << "Partial usage: nachos [-mv fromName toName]\n";
+            cout << "Partial usage: nachos [-clone fromName toName]\n";
             cout << "Partial usage: nachos [-l] [-D]\n";
+            cout << "Partial usage: nachos [-lr dir [-lrd depth] [-lrf pattern]]\n";
+            cout << "Partial usage: nachos [-fsck] [-fsckr]\n";
+            cout << "Partial usage: nachos [-bench reportFile]\n";
+            cout << "Partial usage: nachos [-script scriptFile]\n";
 #endif //FILESYS_STUB
         }
     }
@@ -315,6 +662,10 @@ int main(int argc, char **argv)
     {
         kernel->ThreadSelfTest(); // test threads and synchronization
     }
+    if (threadBenchFlag)
+    {
+        kernel->ThreadBenchmark(); // time thread switching
+    }
     if (consoleTestFlag)
     {
         kernel->ConsoleTest(); // interactive test of the synchronized console
@@ -323,16 +674,24 @@ int main(int argc, char **argv)
     {
         kernel->NetworkTest(); // two-machine test of the network
     }
+    if (rpcTestFlag)
+    {
+        kernel->RpcTest(); // key-value service over RPC
+    }
 
 #ifndef FILESYS_STUB
     if (removeFileName != NULL)
     {
-        kernel->fileSystem->Remove(removeFileName);
+        kernel->fileSystem->Remove(removeFileName, recursiveRemoveFlag);
     }
     if (copyUnixFileName != NULL && copyNachosFileName != NULL)
     {
         Copy(copyUnixFileName, copyNachosFileName);
     }
+    if (copyUnixDirName != NULL)
+    {
+        CopyTree(copyUnixDirName, copyNachosDirName);
+    }
     if (dumpFlag)
     {
         kernel->fileSystem->Print();
@@ -342,19 +701,50 @@ int main(int argc, char **argv)
         kernel->fileSystem->List();
     }
     if (recursiveListFlag) {
-        kernel->fileSystem->ListRecursively();
+        kernel->fileSystem->ListRecursively(listDirectoryName,
+                                            recursiveListDepth,
+                                            recursiveListFilter);
     }
     if (mkdirFlag)
     {
         // MP4 mod tag
         CreateDirectory(createDirectoryName);
     }
+    if (renameFrom != NULL)
+    {
+        kernel->fileSystem->Rename(renameFrom, renameTo);
+    }
+    if (cloneFrom != NULL)
+    {
+        kernel->fileSystem->Clone(cloneFrom, cloneTo);
+    }
+    if (compressFileName != NULL)
+    {
+        kernel->fileSystem->Compress(compressFileName);
+    }
     if (printFileName != NULL)
     {
         Print(printFileName);
     }
+    if (checkFlag)
+    {
+        kernel->fileSystem->Check(repairFlag);
+    }
+    if (scriptName != NULL)
+    {
+        RunScript(scriptName);
+    }
+    if (benchReportName != NULL)
+    {
+        FileSystemBench *bench = new FileSystemBench(benchReportName);
+
+        bench->Run();
+        delete bench;
+    }
 #endif // FILESYS_STUB
 
+    kernel->SaveSnapshot(); // if requested, for runs to start from here
+
     // finally, run an initial user program if requested to do so
 
     kernel->ExecAll();
@@ -366,3 +756,33 @@ int main(int argc, char **argv)
 
     ASSERTNOTREACHED();
 }
+
+//----------------------------------------------------------------------
+// main
+// 	Boot Nachos with the flags given; or, with "-batch", run a batch
+//	of jobs, each booting a Nachos of its own in a worker process.
+//	The batch exits with the number of jobs that failed.
+//----------------------------------------------------------------------
+
+int main(int argc, char **argv)
+{
+    char *jobFileName = NULL;
+    int workers = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-batch") == 0) && (i + 1 < argc))
+            jobFileName = argv[++i];
+        else if ((strcmp(argv[i], "-j") == 0) && (i + 1 < argc))
+            workers = atoi(argv[++i]);
+    }
+    if (jobFileName != NULL)
+    {
+        BatchRunner *batch = new BatchRunner(jobFileName, workers, Boot);
+        int failed = batch->Run();
+
+        delete batch;
+        return (failed > 0) ? 1 : 0;
+    }
+    return Boot(argc, argv);
+}
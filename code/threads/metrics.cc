@@ -0,0 +1,85 @@
+// metrics.cc
+//	Routines for writing snapshots of the statistics while Nachos
+//	runs, at intervals and on a signal from the host.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "metrics.h"
+#include "main.h"
+
+volatile bool Metrics::requested = FALSE;
+
+//----------------------------------------------------------------------
+// Metrics::Metrics
+// 	Write snapshots to the host file descriptor "fd": one every
+//	"interval" ticks, unless that is 0, and one each time SIGUSR1
+//	arrives.
+//----------------------------------------------------------------------
+
+Metrics::Metrics(int fd, int interval)
+{
+    file = fdopen(fd, "w");
+    if (file == NULL) {
+	cerr << "Cannot write metrics to file descriptor " << fd << "\n";
+	Abort();
+    }
+    this->interval = interval;
+    if (interval > 0)
+	kernel->interrupt->Schedule(this, interval, MetricsInt);
+    CallOnDumpRequest(Request);
+}
+
+//----------------------------------------------------------------------
+// Metrics::~Metrics
+// 	Take a last snapshot, as Nachos halts.
+//----------------------------------------------------------------------
+
+Metrics::~Metrics()
+{
+    Snapshot();
+    fclose(file);
+}
+
+//----------------------------------------------------------------------
+// Metrics::Request
+// 	Signal handler: ask for a snapshot, to be taken on the next tick
+//	(see Interrupt::OneTick).  Nothing more is safe here.
+//----------------------------------------------------------------------
+
+void
+Metrics::Request(int sig)
+{
+    requested = TRUE;
+}
+
+//----------------------------------------------------------------------
+// Metrics::CallBack
+// 	The interval is up: take a snapshot, and set up the next one.
+//----------------------------------------------------------------------
+
+void
+Metrics::CallBack()
+{
+    Snapshot();
+    kernel->interrupt->Schedule(this, interval, MetricsInt);
+}
+
+//----------------------------------------------------------------------
+// Metrics::Snapshot
+// 	Write the counters and histograms out now, between a line giving
+//	the time and a line "end", and flush them.
+//----------------------------------------------------------------------
+
+void
+Metrics::Snapshot()
+{
+    requested = FALSE;
+    fprintf(file, "snapshot %d\n", kernel->stats->totalTicks);
+    kernel->stats->WriteCounters(file);
+    kernel->stats->WriteHistograms(file);
+    fprintf(file, "end\n");
+    fflush(file);
+}
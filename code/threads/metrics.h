@@ -0,0 +1,62 @@
+// metrics.h
+//	Data structures for watching a long run of Nachos as it goes:
+//	snapshots of the statistics, written while it runs.
+//
+//	A snapshot is taken every so many ticks of simulated time, by an
+//	interrupt of its own, and whenever the host sends Nachos SIGUSR1
+//	("kill -USR1 <pid>").  Each goes to a host file descriptor, as
+//	lines of text for other programs to read, and is flushed at once:
+//
+//		snapshot 200000
+//		ticks total 200000
+//		disk reads 118
+//		...
+//		disk p99 12799
+//		...
+//		end
+//
+//	The counters are totals since Nachos started; rates come from the
+//	difference between snapshots.  The histograms are written as
+//	Statistics::ExportHistograms writes them.  A last snapshot is
+//	taken when Nachos halts.
+//
+//	The interrupt does not keep an idle machine from halting, and
+//	taking a snapshot takes no simulated time.  A snapshot asked for
+//	by a signal is taken on the next tick -- while the machine waits
+//	on the host for input, once some arrives.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "callback.h"
+#include <stdio.h>
+
+// The following class defines the snapshots of one run of Nachos.
+
+class Metrics : public CallBackObj {
+  public:
+    Metrics(int fd, int interval);
+				// Write snapshots to host file "fd",
+				// every "interval" ticks (if not 0) and
+				// on SIGUSR1
+    ~Metrics();			// Take the last one
+
+    void Snapshot();		// Write one now
+    void CallBack();		// Interrupt handler: the interval is up
+
+    static volatile bool requested;	// has a signal asked for one?
+
+  private:
+    FILE *file;			// where they go
+    int interval;		// ticks between them, or 0
+
+    static void Request(int sig);	// signal handler: ask for one
+};
+
+#endif // METRICS_H
@@ -11,8 +11,9 @@
 //	end up calling FindNextToRun(), and that would put us in an 
 //	infinite loop.
 //
-// 	Very simple implementation -- no priorities, straight FIFO.
-//	Might need to be improved in later assignments.
+// 	Very simple implementation -- no priorities, straight FIFO --
+//	unless a multi-level feedback queue, priorities or stride
+//	scheduling are asked for (see scheduler.h).
 //
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
@@ -22,17 +23,88 @@
 #include "debug.h"
 #include "scheduler.h"
 #include "main.h"
+#include "trace.h"
+#include "tlbmanager.h"
+
+//----------------------------------------------------------------------
+// PassCompare
+// 	Helper function for the stride heap: the lowest pass first, and
+//	of equal passes, the thread that has been ready longest.
+//----------------------------------------------------------------------
+
+static int
+PassCompare(Thread *x, Thread *y)
+{
+    if (x->pass != y->pass)
+	return (x->pass < y->pass) ? -1 : 1;
+    if (x->readySince != y->readySince)
+	return (x->readySince < y->readySince) ? -1 : 1;
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// DeadlineCompare
+// 	Helper function for the EDF heap: the earliest deadline first,
+//	and of equal deadlines, the thread that has been ready longest.
+//----------------------------------------------------------------------
+
+static int
+DeadlineCompare(Thread *x, Thread *y)
+{
+    if (x->absDeadline != y->absDeadline)
+	return (x->absDeadline < y->absDeadline) ? -1 : 1;
+    if (x->readySince != y->readySince)
+	return (x->readySince < y->readySince) ? -1 : 1;
+    return 0;
+}
 
 //----------------------------------------------------------------------
 // Scheduler::Scheduler
 // 	Initialize the list of ready but not running threads.
 //	Initially, no ready threads.
+//
+//	"policyName" -- how to choose the next thread: "fifo", "mlfq",
+//		"priority" or "stride"; NULL for the default, fifo
+//	"numCpus" -- how many simulated CPUs to run threads on
 //----------------------------------------------------------------------
 
-Scheduler::Scheduler()
+Scheduler::Scheduler(char *policyName, int numCpus)
 { 
-    readyList = new List<Thread *>; 
+    if (policyName == NULL || strcmp(policyName, "fifo") == 0)
+	policy = SchedFIFO;
+    else if (strcmp(policyName, "mlfq") == 0)
+	policy = SchedMLFQ;
+    else if (strcmp(policyName, "priority") == 0)
+	policy = SchedPriority;
+    else if (strcmp(policyName, "stride") == 0)
+	policy = SchedStride;
+    else
+	ASSERTNOTREACHED();	// unknown scheduling policy
+
+    for (int i = 0; i < NumReadyLists; i++)
+	readyList[i] = new DList<Thread *>(Thread::QueueLink);
+    readyLevels = 0;
+    readyHeap = new Heap<Thread *>(PassCompare);
+    globalPass = 0;
+    edfHeap = new Heap<Thread *>(DeadlineCompare);
+    rtLoad = 0;
+    lastBoost = 0;
+    boostEpoch = 0;
+
+    ASSERT(numCpus >= 1 && numCpus <= MaxCpus);
+    ASSERT(numCpus == 1 || policy == SchedFIFO);
+    this->numCpus = numCpus;
+    for (int i = 0; i < numCpus; i++)
+	cpuList[i] = new DList<Thread *>(Thread::QueueLink);
+    cursor = 0;
+    dispatchedAt = 0;
+    kernel->stats->numCpus = numCpus;
     toBeDestroyed = NULL;
+    userThread = NULL;
+    userSpace = NULL;
+    timing = FALSE;
+    runHostTime = switchHostTime = 0;
+    timedSwitches = 0;
 } 
 
 //----------------------------------------------------------------------
@@ -42,13 +114,29 @@ Scheduler::Scheduler()
 
 Scheduler::~Scheduler()
 { 
-    delete readyList; 
+    for (int i = 0; i < NumReadyLists; i++)
+	delete readyList[i]; 
+    delete readyHeap;
+    delete edfHeap;
+    for (int i = 0; i < numCpus; i++)
+	delete cpuList[i];
 } 
 
 //----------------------------------------------------------------------
 // Scheduler::ReadyToRun
 // 	Mark a thread as ready, but not running.
-//	Put it on the ready list, for later scheduling onto the CPU.
+//	Put it on the ready list, for later scheduling onto the CPU: with
+//	MLFQ, that of its level, or of the top level if every thread has
+//	been put back there since it was last ready; with priorities,
+//	that of its priority; with more than one CPU, that of the CPU
+//	it is to run on.  With stride scheduling, it goes into the heap,
+//	at its pass: that of the running thread, which is yielding, with
+//	the time it has just had; that of another, no lower than the
+//	pass of the last thread dispatched.
+//
+//	A real-time thread with budget left, whatever the policy, goes
+//	into the EDF heap instead, by deadline, starting a new job first
+//	if one is due.
 //
 //	"thread" is the thread to be put on the ready list.
 //----------------------------------------------------------------------
@@ -56,16 +144,58 @@ Scheduler::~Scheduler()
 void
 Scheduler::ReadyToRun (Thread *thread)
 {
+    int level = 0;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
     DEBUG(dbgThread, "Putting thread on ready list: " << thread->getName());
 	//cout << "Putting thread on ready list: " << thread->getName() << endl ;
     thread->setStatus(READY);
-    readyList->Append(thread);
+    if (thread == kernel->currentThread)
+	Charge(thread);		// it is yielding
+    Release(thread);
+    if (policy == SchedMLFQ) {
+	if (thread->boostEpoch != boostEpoch) {
+	    thread->schedLevel = 0;
+	    thread->levelTicks = 0;
+	    thread->boostEpoch = boostEpoch;
+	}
+	level = thread->schedLevel;
+    } else if (policy == SchedPriority) {
+	level = MaxPriority - thread->getPriority();
+	thread->schedLevel = level;
+    }
+    thread->readySince = thread->readyAt = kernel->stats->totalTicks;
+    if (InRealTime(thread)) {
+	edfHeap->Insert(thread);
+	return;
+    }
+    if (policy == SchedStride) {
+	if ((thread != kernel->currentThread) && (thread->pass < globalPass))
+	    thread->pass = globalPass;
+	readyHeap->Insert(thread);
+	return;
+    }
+    if (numCpus > 1) {
+	cpuList[thread->cpu]->Append(thread);
+	return;
+    }
+    readyList[level]->Append(thread);
+    readyLevels |= 1 << level;
 }
 
 //----------------------------------------------------------------------
 // Scheduler::FindNextToRun
-// 	Return the next thread to be scheduled onto the CPU.
+// 	Return the next thread to be scheduled onto the CPU: the first
+//	one of the highest level that has any, found from the bits of
+//	"readyLevels" without looking at the lists themselves.
+//
+//	With more than one CPU, the first thread on the list of the CPU
+//	whose turn it is, or one it steals; if it has none and can steal
+//	none, it is idle, and the turn goes to the next CPU.
+//
+//	With stride scheduling, the thread with the lowest pass.  Any
+//	real-time thread comes first, the earliest deadline first.
+//
 //	If there are no ready threads, return NULL.
 // Side effect:
 //	Thread is removed from the ready list.
@@ -74,12 +204,515 @@ Scheduler::ReadyToRun (Thread *thread)
 Thread *
 Scheduler::FindNextToRun ()
 {
+    Thread *thread;
+    int level;
+
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
-    if (readyList->IsEmpty()) {
+    if (!edfHeap->IsEmpty())
+	return edfHeap->RemoveFront();
+    if (numCpus > 1) {
+	for (int i = 0; i < numCpus; i++) {
+	    int cpu = (cursor + i) % numCpus;
+
+	    if (!cpuList[cpu]->IsEmpty())
+		thread = cpuList[cpu]->RemoveFront();
+	    else
+		thread = Steal(cpu);
+	    if (thread != NULL) {
+		cursor = cpu;
+		kernel->stats->cpuDispatches[cpu]++;
+		return thread;
+	    }
+	}
+	return NULL;
+    }
+
+    if (policy == SchedStride) {
+	if (readyHeap->IsEmpty())
+	    return NULL;
+	thread = readyHeap->RemoveFront();
+	globalPass = thread->pass;
+	return thread;
+    }
+    if (readyLevels == 0) {
 		return NULL;
-    } else {
-    	return readyList->RemoveFront();
+    }
+    for (level = 0; (readyLevels & (1 << level)) == 0; level++)
+	;
+    thread = readyList[level]->RemoveFront();
+    if (readyList[level]->IsEmpty())
+	readyLevels &= ~(1 << level);
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Steal
+// 	Return a thread waiting on the ready list of the CPU with the
+//	most threads waiting, for idle CPU "cpu" to run: the one that
+//	has been off that CPU longest, if it is not cache-hot there; or
+//	else, if StealImbalance threads or more are waiting, the last.
+//	Return NULL if no thread is waiting, or none is worth moving.
+//
+//	The first thread of another CPU's list is the one that CPU is
+//	running, so it is not taken.  The running thread is on no list,
+//	so all of the threads on the list of its CPU are waiting.
+//----------------------------------------------------------------------
+
+Thread *
+Scheduler::Steal(int cpu)
+{
+    int victim = -1, most = 0;
+    Thread *thread = NULL;
+
+    for (int i = 0; i < numCpus; i++) {
+	int waiting = cpuList[i]->NumInList();
+
+	if (i != kernel->currentThread->cpu)
+	    waiting--;
+	if (waiting > most) {
+	    victim = i;
+	    most = waiting;
+	}
+    }
+    if (victim < 0)
+	return NULL;
+
+    DListIterator<Thread *> iter(cpuList[victim]);
+
+    if (victim != kernel->currentThread->cpu)
+	iter.Next();			// that CPU is running it
+    for (; !iter.IsDone(); iter.Next()) {
+	Thread *waiting = iter.Item();
+
+	if (!CacheHot(waiting) &&
+		((thread == NULL) || (waiting->leftCpuAt < thread->leftCpuAt)))
+	    thread = waiting;
+    }
+    if (thread == NULL) {
+	if (most < StealImbalance)
+	    return NULL;		// better to wait for its own CPU
+	thread = cpuList[victim]->Back();
+    }
+    cpuList[victim]->Remove(thread);
+    DEBUG(dbgThread, "CPU " << cpu << " steals " << thread->getName()
+	  << " from CPU " << victim);
+    thread->cpu = cpu;
+    kernel->stats->cpuSteals[cpu]++;
+    return thread;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CacheHot
+// 	Return TRUE if "thread" came off its CPU less than MigrationCost
+//	ago, so that moving it would cost it the TLB entries it has left
+//	there.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::CacheHot(Thread *thread)
+{
+    return kernel->stats->totalTicks - thread->leftCpuAt < MigrationCost;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Reprioritize
+// 	The priority of "thread" has changed; if it is on a ready list,
+//	move it to the one for its new priority.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Reprioritize(Thread *thread)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if ((policy != SchedPriority) || (thread->getStatus() != READY) ||
+	    InRealTime(thread))
+	return;
+
+    readyList[thread->schedLevel]->Remove(thread);
+    if (readyList[thread->schedLevel]->IsEmpty())
+	readyLevels &= ~(1 << thread->schedLevel);
+    ReadyToRun(thread);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::CheckPreempt
+// 	If "thread", which was just made ready, is to run before the
+//	running thread -- a real-time thread, with an earlier deadline
+//	than the running thread if that is one too, or with priorities, a
+//	thread of higher priority -- let it run: now, or if this is an
+//	interrupt handler, once the handler is done.  Nothing needs doing
+//	if the machine is idle; it will run soon enough.
+//----------------------------------------------------------------------
+
+void
+Scheduler::CheckPreempt(Thread *thread)
+{
+    Interrupt *interrupt = kernel->interrupt;
+    Thread *running = kernel->currentThread;
+    bool first;
+
+    ASSERT(interrupt->getLevel() == IntOff);
+    if (interrupt->getStatus() == IdleMode)
+	return;
+    if (InRealTime(thread))
+	first = !InRealTime(running) || (thread->absDeadline < running->absDeadline);
+    else
+	first = (policy == SchedPriority) && !InRealTime(running) &&
+		(thread->getPriority() > running->getPriority());
+    if (!first)
+	return;
+
+    if (interrupt->InHandler())
+	interrupt->YieldOnReturn();
+    else
+	kernel->currentThread->Yield();
+}
+
+//----------------------------------------------------------------------
+// Scheduler::ReadyToYieldTo
+// 	Return TRUE if "thread", the running thread, should let another
+//	run if it yields: if any is ready, or with priorities, any with
+//	the same priority as "thread" or higher.  A real-time thread with
+//	budget left yields only to one with an earlier deadline, and any
+//	other thread to any real-time thread.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::ReadyToYieldTo(Thread *thread)
+{
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (InRealTime(thread))
+	return !edfHeap->IsEmpty() && (edfHeap->Front()->absDeadline < thread->absDeadline);
+    if (!edfHeap->IsEmpty())
+	return TRUE;
+    if (policy == SchedPriority)
+	return (readyLevels & ((2 << (MaxPriority - thread->getPriority())) - 1)) != 0;
+    if (policy == SchedStride)
+	return !readyHeap->IsEmpty();
+    if (numCpus > 1) {
+	for (int i = 0; i < numCpus; i++) {
+	    if (!cpuList[i]->IsEmpty())
+		return TRUE;
+	}
+	return FALSE;
+    }
+    return readyLevels != 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::QuantumExpired
+// 	Called on each timer interrupt, with interrupts disabled: return
+//	TRUE if the running thread is to give up the CPU when the
+//	interrupt handler is done.
+//
+//	With FIFO, it always is: each thread gets a timer interrupt's
+//	worth of time in turn, and with more than one CPU, the turn goes
+//	to the next CPU.  With priorities, it is if another thread
+//	of the same priority or higher is ready.  With stride scheduling,
+//	it is if a ready thread's pass is now below its own.  With MLFQ,
+//	this is also when threads are boosted and aged; the running thread
+//	gives up the CPU to a thread at a higher level, or once it has
+//	used up its quantum -- going down a level -- to one at the same
+//	level.
+//
+//	Real-time threads come before all of these: the running thread
+//	gives way to one with an earlier deadline, and a real-time thread
+//	that has used up its budget gives way, to run on with the normal
+//	class until its next job is released.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::QuantumExpired()
+{
+    Thread *thread = kernel->currentThread;
+    int now = kernel->stats->totalTicks;
+
+    ASSERT(kernel->interrupt->getLevel() == IntOff);
+    if (InRealTime(thread))
+	return ReadyToYieldTo(thread);
+    if ((thread->period > 0) && (thread->budgetLeft > 0))
+	return TRUE;		// its budget just ran out
+    if (!edfHeap->IsEmpty())
+	return TRUE;
+    if (policy == SchedFIFO) {
+	cursor = (thread->cpu + 1) % numCpus;
+	return TRUE;
+    }
+    if (policy == SchedPriority)
+	return ReadyToYieldTo(thread);
+    if (policy == SchedStride)
+	return !readyHeap->IsEmpty() && (readyHeap->Front()->pass < PassAfter(thread));
+
+    if (now - lastBoost >= BoostTicks)
+	Boost();
+    Age();
+    if (thread->levelTicks + (now - thread->runningSince) <
+	    Quantum(thread->schedLevel))
+	return (readyLevels & ((1 << thread->schedLevel) - 1)) != 0;
+
+    if (thread->schedLevel < NumSchedLevels - 1) {
+	thread->schedLevel++;
+	DEBUG(dbgThread, "Thread " << thread->getName() << " goes down to level "
+	      << thread->schedLevel);
+    }
+    thread->levelTicks = 0;		// a new quantum
+    thread->runningSince = now;
+    return (readyLevels & ((2 << thread->schedLevel) - 1)) != 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Quantum
+// 	Return how much CPU time a thread has at "level" before it goes
+//	down a level: a timer interrupt's worth at the top, twice as much
+//	at each level below.
+//----------------------------------------------------------------------
+
+int
+Scheduler::Quantum(int level)
+{
+    return TimerTicks << level;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Charge
+// 	Count the CPU time "thread", the running thread, has had since it
+//	was dispatched or last charged: towards its quantum (MLFQ), its
+//	pass (stride) and against its budget (real time), and in the
+//	statistics.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Charge(Thread *thread)
+{
+    int now = kernel->stats->totalTicks;
+    int ran = now - thread->runningSince;
+
+    thread->levelTicks += ran;
+    thread->cpuTicks += ran;
+    if (policy == SchedStride)
+	thread->pass = PassAfter(thread);
+    if (thread->period > 0) {
+	if ((thread->budgetLeft > 0) && (thread->budgetLeft <= ran))
+	    kernel->stats->numBudgetOverruns++;
+	thread->budgetLeft -= ran;
+    }
+    if ((thread->space != NULL) && (thread->space->SpaceId() >= 0) &&
+	    (thread->space->SpaceId() < MaxSpaces))
+	kernel->stats->spaceCpuTicks[thread->space->SpaceId()] += ran;
+    thread->runningSince = now;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::InRealTime
+// 	Return TRUE if "thread" is a real-time thread with budget left
+//	for its job -- for the running thread, with the time it has had
+//	since it was last charged counted.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::InRealTime(Thread *thread)
+{
+    int left = thread->budgetLeft;
+
+    if (thread->period == 0)
+	return FALSE;
+    if (thread == kernel->currentThread)
+	left -= kernel->stats->totalTicks - thread->runningSince;
+    return left > 0;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Release
+// 	If a new job of real-time thread "thread" is due, start it: it is
+//	released at the start of the latest period that has begun, due
+//	"deadline" after that, with a fresh budget.  Jobs of periods that
+//	went by meanwhile are skipped.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Release(Thread *thread)
+{
+    int now = kernel->stats->totalTicks;
+
+    if ((thread->period == 0) || (now < thread->releasedAt + thread->period))
+	return;
+    thread->releasedAt += (now - thread->releasedAt) / thread->period * thread->period;
+    thread->absDeadline = thread->releasedAt + thread->relDeadline;
+    thread->budgetLeft = thread->budget;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Density
+// 	Return the share of the CPU real-time thread "thread" may need:
+//	its budget, over its period or its deadline, whichever is
+//	shorter; 0 for a thread of the normal class.
+//----------------------------------------------------------------------
+
+double
+Scheduler::Density(Thread *thread)
+{
+    if (thread->period == 0)
+	return 0;
+    return (double)thread->budget / min(thread->period, thread->relDeadline);
+}
+
+//----------------------------------------------------------------------
+// Scheduler::SetRealTime
+// 	Make "thread", the running thread, a real-time thread: a job
+//	released every "period" ticks, starting now, each due "deadline"
+//	after its release and allowed "budget" of CPU time.  A "period"
+//	of 0 puts it back in the normal class.
+//
+//	Admission test: the thread is only taken if, with it, the
+//	densities of all real-time threads add up to no more than the
+//	whole CPU, so that EDF can meet every deadline.  Return FALSE if
+//	it was not, or the parameters make no sense; the thread then
+//	stays as it was.
+//----------------------------------------------------------------------
+
+bool
+Scheduler::SetRealTime(Thread *thread, int period, int deadline, int budget)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    double load = rtLoad - Density(thread);
+    bool ok = TRUE;
+
+    ASSERT(thread == kernel->currentThread);
+    if (period > 0) {
+	if ((numCpus > 1) || (deadline <= 0) || (budget <= 0) ||
+		(budget > min(period, deadline)))
+	    ok = FALSE;
+	else
+	    load += (double)budget / min(period, deadline);
+    } else if (period < 0)
+	ok = FALSE;
+    if (ok && (load > 1.0)) {
+	DEBUG(dbgThread, "Real-time thread " << thread->getName() << " not admitted");
+	ok = FALSE;
+    }
+    if (ok) {
+	Charge(thread);
+	rtLoad = load;
+	thread->period = max(period, 0);
+	thread->relDeadline = deadline;
+	thread->budget = thread->budgetLeft = budget;
+	thread->releasedAt = kernel->stats->totalTicks;
+	thread->absDeadline = thread->releasedAt + deadline;
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return ok;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::JobDone
+// 	Real-time thread "thread", the running thread, has finished its
+//	job: count it, and whether it missed its deadline, and by how
+//	much.  Return how long until its next job is released, for it to
+//	wait; if that is now, the next job starts at once.  Return -1 if
+//	it is not a real-time thread.
+//----------------------------------------------------------------------
+
+int
+Scheduler::JobDone(Thread *thread)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    Statistics *stats = kernel->stats;
+    int late = stats->totalTicks - thread->absDeadline;
+    int wait;
+
+    ASSERT(thread == kernel->currentThread);
+    if (thread->period == 0) {
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	return -1;
+    }
+    stats->numDeadlineJobs++;
+    if (late > 0) {
+	DEBUG(dbgThread, "Thread " << thread->getName() << " missed its deadline by "
+	      << late);
+	stats->numDeadlineMisses++;
+	stats->maxLateness = max(stats->maxLateness, late);
+    }
+    Charge(thread);
+    thread->budgetLeft = 0;		// nothing more to do until released
+    Release(thread);
+    wait = max(thread->releasedAt + thread->period - stats->totalTicks, 0);
+    if (thread->budgetLeft > 0)
+	wait = 0;			// released already
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return wait;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::PassAfter
+// 	Return the pass of "thread", the running thread, once charged for
+//	the CPU time it has had since it was dispatched, over its tickets.
+//----------------------------------------------------------------------
+
+double
+Scheduler::PassAfter(Thread *thread)
+{
+    return thread->pass +
+	   (double)(kernel->stats->totalTicks - thread->runningSince) / thread->tickets;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Boost
+// 	Put every thread back at the top level: those that are ready
+//	now, in the order of their levels, and the running one.  A thread
+//	that is blocked goes there next time it is ready.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Boost()
+{
+    Thread *thread = kernel->currentThread;
+
+    boostEpoch++;
+    lastBoost = kernel->stats->totalTicks;
+    DEBUG(dbgThread, "Boosting every thread to the top level");
+    for (int level = 1; level < NumSchedLevels; level++) {
+	while (!readyList[level]->IsEmpty())
+	    readyList[0]->Append(readyList[level]->RemoveFront());
+    }
+    readyLevels = readyList[0]->IsEmpty() ? 0 : 1;
+
+    DListIterator<Thread *> iter(readyList[0]);
+    for (; !iter.IsDone(); iter.Next()) {
+	iter.Item()->schedLevel = 0;
+	iter.Item()->levelTicks = 0;
+	iter.Item()->boostEpoch = boostEpoch;
+    }
+    thread->schedLevel = 0;
+    thread->levelTicks = 0;
+    thread->boostEpoch = boostEpoch;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Age
+// 	Move each thread that has been ready for AgingTicks, below the
+//	top level, up a level.  The first thread of a list is the one
+//	that has waited longest, so only the first few are looked at.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Age()
+{
+    int now = kernel->stats->totalTicks;
+
+    for (int level = 1; level < NumSchedLevels; level++) {
+	while (!readyList[level]->IsEmpty() &&
+		(now - readyList[level]->Front()->readySince >= AgingTicks)) {
+	    Thread *thread = readyList[level]->RemoveFront();
+
+	    thread->schedLevel = level - 1;
+	    thread->levelTicks = 0;
+	    thread->readySince = now;
+	    readyList[level - 1]->Append(thread);
+	    readyLevels |= 1 << (level - 1);
+	}
+	if (readyList[level]->IsEmpty())
+	    readyLevels &= ~(1 << level);
     }
 }
 
@@ -104,19 +737,29 @@ void
 Scheduler::Run (Thread *nextThread, bool finishing)
 {
     Thread *oldThread = kernel->currentThread;
+    double enteredAt = timing ? HostTime() : 0;
+    int busy;
     
     ASSERT(kernel->interrupt->getLevel() == IntOff);
 
+    if (oldThread->getStatus() != READY)
+	Charge(oldThread);	// blocking or finishing; one that yields
+				// was charged by ReadyToRun
+    if (finishing)
+	rtLoad -= Density(oldThread);
+    nextThread->runningSince = kernel->stats->totalTicks;
+    kernel->stats->readyWait.Record(kernel->stats->totalTicks -
+				    nextThread->readyAt);
+    busy = kernel->stats->totalTicks - kernel->stats->idleTicks;
+    kernel->stats->cpuBusyTicks[oldThread->cpu] += busy - dispatchedAt;
+    dispatchedAt = busy;
+    oldThread->leftCpuAt = kernel->stats->totalTicks;
+
     if (finishing) {	// mark that we need to delete current thread
          ASSERT(toBeDestroyed == NULL);
 	 toBeDestroyed = oldThread;
     }
     
-    if (oldThread->space != NULL) {	// if this thread is a user program,
-        oldThread->SaveUserState(); 	// save the user's CPU registers
-	oldThread->space->SaveState();
-    }
-    
     oldThread->CheckOverflow();		    // check if the old thread
 					    // had an undetected stack overflow
 
@@ -124,6 +767,17 @@ Scheduler::Run (Thread *nextThread, bool finishing)
     nextThread->setStatus(RUNNING);      // nextThread is now running
     
     DEBUG(dbgThread, "Switching from: " << oldThread->getName() << " to: " << nextThread->getName());
+    kernel->stats->numContextSwitches++;
+    if (oldThread->preempted)
+	oldThread->Account(UsageInvoluntarySwitches);
+    else if (!finishing)
+	oldThread->Account(UsageVoluntarySwitches);
+    oldThread->preempted = FALSE;
+    TRACE(TraceSwitch, nextThread->cpu, nextThread->getName(), 0);
+    if (timing) {
+	switchStart = HostTime();
+	runHostTime += switchStart - enteredAt;
+    }
     
     // This is a machine-dependent assembly language routine defined 
     // in switch.s.  You may have to think
@@ -133,6 +787,11 @@ Scheduler::Run (Thread *nextThread, bool finishing)
     SWITCH(oldThread, nextThread);
 
     // we're back, running oldThread
+    if (timing) {
+	enteredAt = HostTime();
+	switchHostTime += enteredAt - switchStart;
+	timedSwitches++;
+    }
       
     // interrupts are off when we return from switch!
     ASSERT(kernel->interrupt->getLevel() == IntOff);
@@ -143,10 +802,28 @@ Scheduler::Run (Thread *nextThread, bool finishing)
 					// before this one has finished
 					// and needs to be cleaned up
     
-    if (oldThread->space != NULL) {	    // if there is an address space
-        oldThread->RestoreUserState();     // to restore, do it.
-	oldThread->space->RestoreState();
-    }
+    if (oldThread->space != NULL)	// if this thread is a user program,
+	LoadUserState(oldThread);	// get its registers back, unless
+					// the machine still has them
+    if (timing)
+	runHostTime += HostTime() - enteredAt;
+}
+
+//----------------------------------------------------------------------
+// Scheduler::TimeSwitches
+// 	Start or stop measuring the host time switches take: in Run,
+//	saving and restoring state, and in SWITCH itself -- from just
+//	before it is called to its return in the thread switched to.  A
+//	thread's first SWITCH returns into ThreadRoot, not into Run, so
+//	it is not measured.  Off by default: reading the host clock
+//	costs more than a switch does.
+//----------------------------------------------------------------------
+
+void
+Scheduler::TimeSwitches(bool on)
+{
+    timing = on;
+    switchStart = HostTime();
 }
 
 //----------------------------------------------------------------------
@@ -166,6 +843,58 @@ Scheduler::CheckToBeDestroyed()
     }
 }
  
+//----------------------------------------------------------------------
+// Scheduler::LoadUserState
+// 	Make the machine hold the user registers of "thread", and the
+//	translations of its address space, for it to run its program.
+//	The registers of the thread whose registers the machine held are
+//	saved to its Thread object first.  Nothing is copied if the
+//	machine holds the registers of "thread" already, and the page
+//	table is not installed again (nor the translations flushed) if
+//	it holds those of its address space.
+//----------------------------------------------------------------------
+
+void
+Scheduler::LoadUserState(Thread *thread)
+{
+    ASSERT(thread->space != NULL);
+    if (kernel->tlbManager != NULL)
+	kernel->tlbManager->UseCpu(thread->cpu);	// the TLB of its CPU
+    if (userThread != thread) {
+	if (userThread != NULL)
+	    userThread->SaveUserState();	// save the user's CPU registers
+	thread->RestoreUserState();
+	userThread = thread;
+    }
+    if (userSpace != thread->space) {
+	if (userSpace != NULL)
+	    userSpace->SaveState();
+	thread->space->RestoreState();
+	userSpace = thread->space;
+    }
+}
+
+//----------------------------------------------------------------------
+// Scheduler::Forget
+// 	A thread, or an address space, is being deleted: if the machine
+//	holds its state, nothing need be saved to it any more, and a new
+//	one made in its place must not be taken to be loaded.
+//----------------------------------------------------------------------
+
+void
+Scheduler::Forget(Thread *thread)
+{
+    if (userThread == thread)
+	userThread = NULL;
+}
+
+void
+Scheduler::Forget(AddrSpace *space)
+{
+    if (userSpace == space)
+	userSpace = NULL;
+}
+
 //----------------------------------------------------------------------
 // Scheduler::Print
 // 	Print the scheduler state -- in other words, the contents of
@@ -175,5 +904,35 @@ void
 Scheduler::Print()
 {
     cout << "Ready list contents:\n";
-    readyList->Apply(ThreadPrint);
+    if (numCpus > 1) {
+	for (int cpu = 0; cpu < numCpus; cpu++) {
+	    cout << "CPU " << cpu << ": ";
+	    cpuList[cpu]->Apply(ThreadPrint);
+	    cout << "\n";
+	}
+	return;
+    }
+    if (policy == SchedFIFO) {
+	readyList[0]->Apply(ThreadPrint);
+	return;
+    }
+    if (!edfHeap->IsEmpty()) {
+	cout << "Real time: ";
+	edfHeap->Apply(ThreadPrint);	// in no particular order
+	cout << "\n";
+    }
+    if (policy == SchedStride) {
+	readyHeap->Apply(ThreadPrint);	// in no particular order
+	return;
+    }
+    for (int level = 0; level < NumReadyLists; level++) {
+	if (policy == SchedPriority)
+	    cout << "Priority " << MaxPriority - level << ": ";
+	else if (level < NumSchedLevels)
+	    cout << "Level " << level << ": ";
+	else
+	    break;
+	readyList[level]->Apply(ThreadPrint);
+	cout << "\n";
+    }
 }
@@ -2,6 +2,75 @@
 //	Data structures for the thread dispatcher and scheduler.
 //	Primarily, the list of threads that are ready to run.
 //
+//	Normally the threads run in turn, in the order they became ready,
+//	each for a timer interrupt's worth of time.  With a multi-level
+//	feedback queue (MLFQ) there is a list of ready threads for each
+//	of NumSchedLevels levels, and the first thread of the highest
+//	level that has any runs next:
+//
+//	   - a thread starts at the top level, and goes down a level each
+//		time it has used up its quantum there, which doubles from
+//		one level to the next; a thread that keeps blocking, on the
+//		console or the disk, say, stays up and is run right away
+//	   - a thread that has waited AgingTicks on its list goes up a
+//		level, and every BoostTicks every thread goes back to the
+//		top, so that long computations are not starved
+//	   - when a timer interrupt finds a thread waiting at a higher
+//		level than the running one, the running one gives way
+//
+//	With priorities, there is a list for each thread priority, and
+//	the highest priority thread that is ready always runs, those of
+//	the same priority in turn.  One that becomes ready while a lower
+//	priority thread runs takes the CPU right away; a thread holding a
+//	lock inherits the priority of the threads waiting for it (see
+//	Lock::Acquire), so that the waiters are not held up by everything
+//	else that is running at a priority in between.
+//
+//	With stride scheduling, each thread has tickets (see SetTickets
+//	in syscall.h), and gets a share of the CPU in proportion to them.
+//	Its "pass" goes up by the CPU time it has had over its tickets,
+//	and the ready thread with the lowest pass runs next, taken from
+//	a heap in O(log n); the running thread gives way on a timer
+//	interrupt once a ready thread's pass is below its own.  A thread
+//	that was blocked starts again from the pass of the last thread
+//	dispatched, so that it cannot save up CPU time by sleeping.
+//
+//	Whatever the policy, real-time threads (see SetRealTime) come
+//	before all others, the one whose job is due first running first
+//	(earliest deadline first, EDF).  Each job of such a thread may
+//	use its budget of CPU time; the timer interrupt stops one that
+//	has used it up, and it runs on in the normal class until its
+//	next job is released.  A thread is only made real-time if EDF
+//	can still meet every deadline with it (the admission test).
+//
+//	With more than one simulated CPU (fifo only), each CPU has a ready
+//	list of its own.  The CPUs take turns on the one real machine, a
+//	timer interrupt's worth of time each, in order; a CPU whose turn
+//	it is runs the first thread of its list, and one that has none
+//	takes a thread waiting on the longest list of another (work
+//	stealing).  A thread that is forked goes on the list of the CPU
+//	forking it, and one that is woken up on that of the CPU it last
+//	ran on.  The first thread of the list of a CPU whose turn it is
+//	not is the thread that CPU is running; the rest are waiting.
+//	The one Machine serves every CPU, but each CPU has a TLB of its
+//	own (see tlbmanager.h).
+//
+//	Moving a thread to another CPU leaves its TLB entries behind, so
+//	threads keep to their CPU where they can (affinity).  A thread
+//	that left its CPU less than MigrationCost ago is taken to still
+//	have warm entries there (cache-hot).  An idle CPU steals the
+//	waiting thread that has been off its CPU longest, if it is cold;
+//	a hot one only when its CPU has StealImbalance or more threads
+//	waiting, so that short waits are not traded for refilling a TLB.
+//
+//	The machine keeps the user registers, and the translations, of
+//	the last user program thread to run until another such thread is
+//	dispatched: only then are they saved to the old thread's Thread
+//	object and the new thread's loaded (see LoadUserState).  Switching
+//	to a kernel thread -- one waiting on the disk or the console, say
+//	-- and back to the same user thread costs no copying at all, and
+//	switching between threads of one program keeps its translations.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
@@ -11,34 +80,129 @@
 
 #include "copyright.h"
 #include "list.h"
+#include "heap.h"
+#include "stats.h"
 #include "thread.h"
 
+// How the next thread to run is chosen.
+enum SchedPolicy { SchedFIFO, SchedMLFQ, SchedPriority, SchedStride };
+
+const int NumSchedLevels = 4;		// MLFQ: number of ready lists
+const int NumReadyLists = NumPriorities;	// enough for either policy
+const int BoostTicks = 100 * TimerTicks;	// how often every thread goes
+					// back to the top level
+const int MigrationCost = 5 * TimerTicks;	// how long a thread's TLB
+					// entries are taken to stay warm on
+					// its CPU after it leaves it
+const int StealImbalance = 2;		// threads waiting on a CPU before an
+					// idle one steals a cache-hot thread
+const int AgingTicks = 20 * TimerTicks;	// how long a ready thread waits
+					// before going up a level
+
 // The following class defines the scheduler/dispatcher abstraction -- 
 // the data structures and operations needed to keep track of which 
 // thread is running, and which threads are ready but not running.
 
 class Scheduler {
   public:
-    Scheduler();		// Initialize list of ready threads 
+    Scheduler(char *policyName, int numCpus);
+				// Initialize list of ready threads;
+				// "policyName" is fifo, mlfq,
+				// priority or stride, NULL meaning fifo
     ~Scheduler();		// De-allocate ready list
 
     void ReadyToRun(Thread* thread);	
     				// Thread can be dispatched.
     Thread* FindNextToRun();	// Dequeue first thread on the ready 
 				// list, if any, and return thread.
+    bool ReadyToYieldTo(Thread *thread);
+				// Is there a thread "thread" should
+				// give the CPU to, if it yields?
+    bool QuantumExpired();	// On a timer interrupt: should the
+				// running thread give up the CPU?
+    bool SetRealTime(Thread *thread, int period, int deadline, int budget);
+				// Make the running thread real-time,
+				// if it passes the admission test
+    int JobDone(Thread *thread);
+				// Its job is done: how long until the
+				// next is released
+    void Reprioritize(Thread *thread);
+				// Its priority changed
+    void CheckPreempt(Thread *thread);
+				// It was just made ready: should it
+				// take the CPU now?
     void Run(Thread* nextThread, bool finishing);
     				// Cause nextThread to start running
     void CheckToBeDestroyed();// Check if thread that had been
     				// running needs to be deleted
+    void LoadUserState(Thread *thread);
+				// Make the machine hold the user
+				// registers and translations of
+				// "thread", saving the last thread's
+    void Forget(Thread *thread);	// It is being deleted: the machine
+    void Forget(AddrSpace *space);	// no longer holds its state
     void Print();		// Print contents of ready list
+
+    void TimeSwitches(bool on);	// Measure the host time switches take,
+				// from now on, or no longer
+    double RunHostTime() { return runHostTime; }
+				// usec spent in Run, but for SWITCH
+    double SwitchHostTime() { return switchHostTime; }
+    int TimedSwitches() { return timedSwitches; }
+				// usec spent in SWITCH, by so many
+				// switches
     
     // SelfTest for scheduler is implemented in class Thread
     
   private:
-    List<Thread *> *readyList;  // queue of threads that are ready to run,
-				// but not running
+    SchedPolicy policy;
+    DList<Thread *> *readyList[NumReadyLists];
+				// queue of threads that are ready to run,
+				// but not running, at each level or
+				// priority, highest first (only the
+				// first with FIFO)
+    unsigned int readyLevels;	// bit i is set if readyList[i] has any
+    Heap<Thread *> *readyHeap;	// stride: ready threads, by pass
+    double globalPass;		// pass of the thread last dispatched
+    Heap<Thread *> *edfHeap;	// ready real-time threads, by deadline
+    double rtLoad;		// densities of the real-time threads
+    int lastBoost;		// when every thread last went to the top
+    int boostEpoch;		// how many times that has happened
+
+    int numCpus;		// simulated CPUs, 1 unless -cpus says
+    DList<Thread *> *cpuList[MaxCpus];
+				// with more than one, the ready list of
+				// each, used instead of readyList
+    int cursor;			// CPU whose turn it is
+    int dispatchedAt;		// time the machine had been busy when
+				// the running thread was dispatched
+
+    int Quantum(int level);	// MLFQ: time a thread has at a level
+    void Boost();		// put every thread back at the top level
+    void Age();			// move threads that waited long up a level
+    void Charge(Thread *thread);	// count the CPU time the running
+				// thread has had
+    bool InRealTime(Thread *thread);
+				// real-time, with budget left?
+    void Release(Thread *thread);	// start its next job, if due
+    double Density(Thread *thread);	// share of the CPU it may need
+    double PassAfter(Thread *thread);
+				// stride: its pass, with the CPU time
+				// it has had since it was dispatched
+    Thread *Steal(int cpu);	// a waiting thread of another CPU, for
+				// "cpu" to run, or NULL
+    bool CacheHot(Thread *thread);	// has it left its CPU recently?
     Thread *toBeDestroyed;	// finishing thread to be destroyed
     				// by the next thread that runs
+    Thread *userThread;		// whose user registers the machine
+				// holds, or NULL
+    AddrSpace *userSpace;	// whose translations it holds, or NULL
+
+    bool timing;		// measure the host time of switches?
+    double runHostTime;		// measured so far, in usec
+    double switchHostTime;
+    int timedSwitches;		// switches whose SWITCH was measured
+    double switchStart;		// host time the last SWITCH began
 };
 
 #endif // SCHEDULER_H
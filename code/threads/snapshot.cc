@@ -0,0 +1,245 @@
+// snapshot.cc
+//	Routines to save the state of the simulated machine to a file,
+//	and to restore it as Nachos starts.  See snapshot.h.
+//
+//	Restoring is done in two steps, as the kernel is initialized:
+//	the clock and the disk right after the statistics are made,
+//	before the timer and the disk are started, and the registers and
+//	main memory once the machine is made.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "snapshot.h"
+#include "main.h"
+#include "disk.h"
+#include "journal.h"
+#include "sysdep.h"
+
+#define SnapshotMagic	0x4e534e50	// "NSNP"
+#define NoMoreSectors	-1		// ends the disk's sectors
+
+//----------------------------------------------------------------------
+// Snapshot::Snapshot
+// 	Get ready to save the machine to "fileName", or to restore it
+//	from there.
+//----------------------------------------------------------------------
+
+Snapshot::Snapshot(char *fileName)
+{
+    this->fileName = fileName;
+    file = -1;
+    ASSERT(kernel->diskBase == NULL);	// the disk is one file
+    ASSERT(kernel->raidMembers == 0);
+    ASSERT(!kernel->dedupDisk);		// and a plain one
+}
+
+Snapshot::~Snapshot()
+{
+    if (file >= 0)
+	Close(file);
+}
+
+//----------------------------------------------------------------------
+// DiskName
+// 	The UNIX file the simulated disk is kept in (see Disk::Disk).
+//----------------------------------------------------------------------
+
+static void
+DiskName(char *name)
+{
+    sprintf(name, "DISK_%d", kernel->hostName);
+}
+
+//----------------------------------------------------------------------
+// IsZeroSector
+// 	Return TRUE if a sector's worth of data is all zeroes.
+//----------------------------------------------------------------------
+
+static bool
+IsZeroSector(char *data)
+{
+    int *p = (int *)data;
+
+    for (unsigned int i = 0; i < (SectorSize / sizeof(int)); i++)
+	if (p[i] != 0)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Snapshot::Save
+// 	Write the state of the machine to the file.  Changes still in
+//	the buffer cache or the log are written home first, so that the
+//	disk holds the whole file system.
+//----------------------------------------------------------------------
+
+void
+Snapshot::Save()
+{
+    SnapshotHeader saved;
+    int registers[NumTotalRegs];
+    char diskName[32];
+    int diskFile;
+
+    if (kernel->journal != NULL)
+	kernel->journal->Checkpoint();
+
+    DiskName(diskName);
+    diskFile = OpenForReadWrite(diskName, TRUE);
+    Read(diskFile, (char *)&saved.diskMagic, sizeof(int));
+    Close(diskFile);
+
+    saved.magic = SnapshotMagic;
+    saved.memorySize = MemorySize;
+    saved.numRegs = NumTotalRegs;
+    saved.numSectors = NumSectors;
+    saved.sectorSize = SectorSize;
+    saved.totalTicks = kernel->stats->totalTicks;
+    saved.idleTicks = kernel->stats->idleTicks;
+    saved.systemTicks = kernel->stats->systemTicks;
+    saved.userTicks = kernel->stats->userTicks;
+
+    for (int i = 0; i < NumTotalRegs; i++)
+	registers[i] = kernel->machine->ReadRegister(i);
+
+    file = OpenForWrite(fileName);
+    WriteFile(file, (char *)&saved, sizeof(SnapshotHeader));
+    WriteFile(file, (char *)registers, NumTotalRegs * sizeof(int));
+    WriteFile(file, kernel->machine->mainMemory, MemorySize);
+    SaveDisk();
+    Close(file);
+    file = -1;
+
+    DEBUG(dbgDisk, "Saved a snapshot to " << fileName << " at tick " <<
+	  saved.totalTicks);
+}
+
+//----------------------------------------------------------------------
+// Snapshot::SaveDisk
+// 	Write out the disk's sectors that are not all zeroes, each after
+//	its number, a track of the disk's file at a time; then
+//	NoMoreSectors.
+//----------------------------------------------------------------------
+
+void
+Snapshot::SaveDisk()
+{
+    char diskName[32];
+    int diskFile;
+    int end = NoMoreSectors;
+    char *track = new char[SectorsPerTrack * SectorSize];
+
+    DiskName(diskName);
+    diskFile = OpenForReadWrite(diskName, TRUE);
+    Lseek(diskFile, sizeof(int), 0);		// past the magic number
+    for (int t = 0; t < NumTracks; t++) {
+	Read(diskFile, track, SectorsPerTrack * SectorSize);
+	for (int s = 0; s < SectorsPerTrack; s++) {
+	    char *data = &track[s * SectorSize];
+	    int sector = t * SectorsPerTrack + s;
+
+	    if (!IsZeroSector(data)) {
+		WriteFile(file, (char *)&sector, sizeof(int));
+		WriteFile(file, data, SectorSize);
+	    }
+	}
+    }
+    WriteFile(file, (char *)&end, sizeof(int));
+    Close(diskFile);
+    delete [] track;
+}
+
+//----------------------------------------------------------------------
+// Snapshot::RestoreClock
+// 	Read the snapshot's header, checking that it was taken on a
+//	machine like this one, set the clock to what it was, and put the
+//	disk back as it was.  Must be called before the disk is opened.
+//----------------------------------------------------------------------
+
+void
+Snapshot::RestoreClock()
+{
+    file = OpenForReadWrite(fileName, FALSE);
+    if (file < 0) {
+	cerr << "Snapshot: couldn't open " << fileName << "\n";
+	Abort();
+    }
+    Read(file, (char *)&header, sizeof(SnapshotHeader));
+    if (header.magic != SnapshotMagic || header.memorySize != MemorySize ||
+	header.numRegs != NumTotalRegs || header.numSectors != NumSectors ||
+	header.sectorSize != SectorSize) {
+	cerr << "Snapshot: " << fileName << " is not a snapshot of "
+	     << "this machine\n";
+	Abort();
+    }
+
+    kernel->stats->totalTicks = header.totalTicks;
+    kernel->stats->idleTicks = header.idleTicks;
+    kernel->stats->systemTicks = header.systemTicks;
+    kernel->stats->userTicks = header.userTicks;
+
+    // the disk's sectors are after the registers and memory
+    Lseek(file, sizeof(SnapshotHeader) + NumTotalRegs * sizeof(int) +
+	  MemorySize, 0);
+    RestoreDisk();
+}
+
+//----------------------------------------------------------------------
+// Snapshot::RestoreDisk
+// 	Make the disk's file anew, all zeroes (sparse, like Disk::Disk
+//	makes it), with the saved sectors written back into it.
+//----------------------------------------------------------------------
+
+void
+Snapshot::RestoreDisk()
+{
+    char diskName[32];
+    int diskFile;
+    int sector, zero = 0;
+    char data[SectorSize];
+
+    DiskName(diskName);
+    diskFile = OpenForWrite(diskName);
+    WriteFile(diskFile, (char *)&header.diskMagic, sizeof(int));
+    Lseek(diskFile, sizeof(int) + NumSectors * SectorSize - sizeof(int), 0);
+    WriteFile(diskFile, (char *)&zero, sizeof(int));
+
+    for (;;) {
+	Read(file, (char *)&sector, sizeof(int));
+	if (sector == NoMoreSectors)
+	    break;
+	ASSERT(sector >= 0 && sector < NumSectors);
+	Read(file, data, SectorSize);
+	Lseek(diskFile, sizeof(int) + sector * SectorSize, 0);
+	WriteFile(diskFile, data, SectorSize);
+    }
+    Close(diskFile);
+}
+
+//----------------------------------------------------------------------
+// Snapshot::RestoreMachine
+// 	Load the saved registers and main memory into the machine, and
+//	close the snapshot.
+//----------------------------------------------------------------------
+
+void
+Snapshot::RestoreMachine()
+{
+    int registers[NumTotalRegs];
+
+    ASSERT(file >= 0);		// RestoreClock read the header
+
+    Lseek(file, sizeof(SnapshotHeader), 0);
+    Read(file, (char *)registers, NumTotalRegs * sizeof(int));
+    for (int i = 0; i < NumTotalRegs; i++)
+	kernel->machine->WriteRegister(i, registers[i]);
+    Read(file, kernel->machine->mainMemory, MemorySize);
+    Close(file);
+    file = -1;
+
+    DEBUG(dbgDisk, "Restored a snapshot from " << fileName << " at tick " <<
+	  header.totalTicks);
+}
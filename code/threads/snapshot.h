@@ -0,0 +1,69 @@
+// snapshot.h
+//	Data structures for saving the state of the simulated machine to
+//	a file, and starting Nachos again from it, so that tests need not
+//	format the disk and copy their programs onto it every run.
+//
+//	A snapshot is taken once the file system commands (-f, -cp,
+//	-mkdir, ...) are done, just before the user programs start: the
+//	only thread then is "main", with the task queue and thread pool
+//	workers waiting for work, no disk request is outstanding, and the
+//	only interrupts pending are the timer's and the console's.  Those
+//	are just what a new kernel starts with, so what is saved is what
+//	differs from one boot to the next: the simulated clock, the CPU
+//	registers, main memory, and the disk.  The disk image is saved
+//	sparsely: only the sectors that are not all zeroes.
+//
+//	The snapshot does not include the statistics counted before it
+//	was taken, other than the clock, so that those printed (-ps) are
+//	for the programs run after it.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "copyright.h"
+#include "utility.h"
+
+// The following class defines the header of a snapshot file.  The
+// registers, main memory and the disk's sectors follow it.
+
+class SnapshotHeader {
+  public:
+    int magic;			// SnapshotMagic, to check the file is one
+    int memorySize;		// the machine it was taken on
+    int numRegs;
+    int numSectors;
+    int sectorSize;
+    int diskMagic;		// the first word of the disk
+    int totalTicks;		// the clock
+    int idleTicks;
+    int systemTicks;
+    int userTicks;
+};
+
+// The following class defines a snapshot file.
+
+class Snapshot {
+  public:
+    Snapshot(char *fileName);	// Save to, or restore from, this file
+    ~Snapshot();
+
+    void Save();		// Write the machine's state to the file
+
+    void RestoreClock();	// Start the clock where it was saved,
+				// and the disk as it was
+    void RestoreMachine();	// Load the registers and main memory
+
+  private:
+    char *fileName;
+    int file;			// UNIX file, while restoring
+    SnapshotHeader header;	// of the file being restored
+
+    void SaveDisk();		// the disk's non-zero sectors
+    void RestoreDisk();
+};
+
+#endif // SNAPSHOT_H
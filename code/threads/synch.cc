@@ -24,6 +24,8 @@
 // Locks are implemented using a semaphore to keep track of
 // whether the lock is held or not -- a semaphore value of 0 means
 // the lock is busy; a semaphore value of 1 means the lock is free.
+// The thread holding a lock inherits the priority of those waiting
+// for it, and of those waiting for locks they hold, and so on.
 //
 // The implementation of condition variables using semaphores is
 // a bit trickier, as explained below under Condition::Wait.
@@ -35,6 +37,11 @@
 #include "copyright.h"
 #include "synch.h"
 #include "main.h"
+#include "slab.h"
+
+// Semaphores, made and freed for each disk request, console
+// operation and thread that is waited for.
+static SlabCache semaphoreCache("semaphores", sizeof(Semaphore));
 
 //----------------------------------------------------------------------
 // Semaphore::Semaphore
@@ -48,7 +55,7 @@ Semaphore::Semaphore(char* debugName, int initialValue)
 {
     name = debugName;
     value = initialValue;
-    queue = new List<Thread *>;
+    queue = new DList<Thread *>(Thread::QueueLink);
 }
 
 //----------------------------------------------------------------------
@@ -62,6 +69,24 @@ Semaphore::~Semaphore()
     delete queue;
 }
 
+//----------------------------------------------------------------------
+// Semaphore::operator new, Semaphore::operator delete
+// 	Take a semaphore from its slab cache, and give it back.
+//----------------------------------------------------------------------
+
+void *
+Semaphore::operator new(size_t size)
+{
+    ASSERT(size == sizeof(Semaphore));
+    return semaphoreCache.Alloc();
+}
+
+void
+Semaphore::operator delete(void *p)
+{
+    semaphoreCache.Free(p);
+}
+
 //----------------------------------------------------------------------
 // Semaphore::P
 // 	Wait until semaphore value > 0, then decrement.  Checking the
@@ -93,7 +118,9 @@ Semaphore::P()
 
 //----------------------------------------------------------------------
 // Semaphore::V
-// 	Increment semaphore value, waking up a waiter if necessary.
+// 	Increment semaphore value, waking up a waiter if necessary: the
+//	one with the highest priority, or of those, the one that has
+//	waited longest.  With priorities, it may run right away.
 //	As with P(), this operation must be atomic, so we need to disable
 //	interrupts.  Scheduler::ReadyToRun() assumes that interrupts
 //	are disabled when it is called.
@@ -103,19 +130,47 @@ void
 Semaphore::V()
 {
     Interrupt *interrupt = kernel->interrupt;
+    Thread *thread = NULL;
     
     // disable interrupts
     IntStatus oldLevel = interrupt->SetLevel(IntOff);	
     
     if (!queue->IsEmpty()) {  // make thread ready.
-	kernel->scheduler->ReadyToRun(queue->RemoveFront());
+	DListIterator<Thread *> iter(queue);
+
+	for (; !iter.IsDone(); iter.Next()) {
+	    if ((thread == NULL) ||
+		    (iter.Item()->getPriority() > thread->getPriority()))
+		thread = iter.Item();
+	}
+	queue->Remove(thread);
+	kernel->scheduler->ReadyToRun(thread);
     }
     value++;
+    if (thread != NULL)
+	kernel->scheduler->CheckPreempt(thread);
     
     // re-enable interrupts
     (void) interrupt->SetLevel(oldLevel);
 }
 
+//----------------------------------------------------------------------
+// Semaphore::MaxWaiterPriority
+// 	Return the highest priority of the threads waiting in P(), or
+//	MinPriority if there are none.  Interrupts are disabled.
+//----------------------------------------------------------------------
+
+int
+Semaphore::MaxWaiterPriority()
+{
+    DListIterator<Thread *> iter(queue);
+    int maxPriority = MinPriority;
+
+    for (; !iter.IsDone(); iter.Next())
+	maxPriority = max(maxPriority, iter.Item()->getPriority());
+    return maxPriority;
+}
+
 //----------------------------------------------------------------------
 // Semaphore::SelfTest, SelfTestHelper
 // 	Test the semaphore implementation, by using a semaphore
@@ -176,12 +231,37 @@ Lock::~Lock()
 //	Atomically wait until the lock is free, then set it to busy.
 //	Equivalent to Semaphore::P(), with the semaphore value of 0
 //	equal to busy, and semaphore value of 1 equal to free.
+//
+//	While we wait, the holder runs with our priority if that is
+//	higher than its own, and so does the holder of the lock it is
+//	waiting for, if any, and so on down the chain.
 //----------------------------------------------------------------------
 
 void Lock::Acquire()
 {
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    if (lockHolder != NULL) {
+	kernel->stats->numLockWaits++;
+	currentThread->waitingFor = this;
+	for (Lock *lock = this; (lock != NULL) && (lock->lockHolder != NULL);
+		lock = lock->lockHolder->waitingFor) {
+	    Thread *holder = lock->lockHolder;
+
+	    if (holder->priority >= currentThread->priority)
+		break;
+	    DEBUG(dbgThread, "Thread " << holder->getName() << " inherits priority "
+		  << currentThread->priority << " through lock " << lock->name);
+	    holder->priority = currentThread->priority;
+	    kernel->scheduler->Reprioritize(holder);
+	}
+    }
     semaphore->P();
-    lockHolder = kernel->currentThread;
+    currentThread->waitingFor = NULL;
+    lockHolder = currentThread;
+    currentThread->locksHeld->Append(this);
+    (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -193,13 +273,29 @@ void Lock::Acquire()
 //
 //	By convention, only the thread that acquired the lock
 // 	may release it.
+//
+//	What we inherited through this lock is given up: our priority
+//	goes back to our own, or to the highest of the threads still
+//	waiting for other locks we hold.
 //---------------------------------------------------------------------
 
 void Lock::Release()
 {
+    Thread *currentThread = kernel->currentThread;
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
     ASSERT(IsHeldByCurrentThread());
     lockHolder = NULL;
+    currentThread->locksHeld->Remove(this);
+
+    ListIterator<Lock *> iter(currentThread->locksHeld);
+    currentThread->priority = currentThread->basePriority;
+    for (; !iter.IsDone(); iter.Next()) {
+	currentThread->priority = max(currentThread->priority,
+				      iter.Item()->semaphore->MaxWaiterPriority());
+    }
     semaphore->V();
+    (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -213,7 +309,7 @@ void Lock::Release()
 Condition::Condition(char* debugName)
 {
     name = debugName;
-    waitQueue = new List<Semaphore *>;
+    waitQueue = new DList<Thread *>(Thread::WaitLink);
 }
 
 //----------------------------------------------------------------------
@@ -229,11 +325,12 @@ Condition::~Condition()
 //----------------------------------------------------------------------
 // Condition::Wait
 // 	Atomically release monitor lock and go to sleep.
-//	Our implementation uses semaphores to implement this, by
-//	allocating a semaphore for each waiting thread.  The signaller
-//	will V() this semaphore, so there is no chance the waiter
-//	will miss the signal, even though the lock is released before
-//	calling P().
+//	Our implementation uses semaphores to implement this: each
+//	thread has one of its own to wait on, kept for its lifetime,
+//	and is queued through a link in the thread itself, so waiting
+//	allocates nothing.  The signaller will V() this semaphore, so
+//	there is no chance the waiter will miss the signal, even though
+//	the lock is released before calling P().
 //
 //	Note: we assume Mesa-style semantics, which means that the
 //	waiter must re-acquire the monitor lock when waking up.
@@ -243,16 +340,14 @@ Condition::~Condition()
 
 void Condition::Wait(Lock* conditionLock) 
 {
-     Semaphore *waiter;
+     Thread *waiter = kernel->currentThread;
     
      ASSERT(conditionLock->IsHeldByCurrentThread());
 
-     waiter = new Semaphore("condition", 0);
      waitQueue->Append(waiter);
      conditionLock->Release();
-     waiter->P();
+     waiter->waitSemaphore->P();
      conditionLock->Acquire();
-     delete waiter;
 }
 
 //----------------------------------------------------------------------
@@ -272,13 +367,13 @@ void Condition::Wait(Lock* conditionLock)
 
 void Condition::Signal(Lock* conditionLock)
 {
-    Semaphore *waiter;
+    Thread *waiter;
     
     ASSERT(conditionLock->IsHeldByCurrentThread());
     
     if (!waitQueue->IsEmpty()) {
         waiter = waitQueue->RemoveFront();
-	waiter->V();
+	waiter->waitSemaphore->V();
     }
 }
 
@@ -295,3 +390,130 @@ void Condition::Broadcast(Lock* conditionLock)
         Signal(conditionLock);
     }
 }
+
+//----------------------------------------------------------------------
+// RWLock::RWLock
+// 	Initialize a reader-writer lock, so that it can be used for
+//	synchronization.  Initially, no thread holds it.
+//
+//	"debugName" is an arbitrary name, useful for debugging.
+//----------------------------------------------------------------------
+
+RWLock::RWLock(char* debugName)
+{
+    name = debugName;
+    lock = new Lock(debugName);
+    readersOk = new Condition(debugName);
+    writersOk = new Condition(debugName);
+    numReaders = 0;
+    numWaitingWriters = 0;
+    writer = NULL;
+    upgrading = FALSE;
+}
+
+//----------------------------------------------------------------------
+// RWLock::~RWLock
+// 	Deallocate a reader-writer lock, which no thread may hold.
+//----------------------------------------------------------------------
+
+RWLock::~RWLock()
+{
+    ASSERT((numReaders == 0) && (writer == NULL));
+    delete writersOk;
+    delete readersOk;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireRead
+// 	Wait until no thread holds the lock exclusive, is waiting to, or
+//	is upgrading to, then hold it shared.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireRead()
+{
+    lock->Acquire();
+    while ((writer != NULL) || (numWaitingWriters > 0) || upgrading)
+	readersOk->Wait(lock);
+    numReaders++;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseRead
+// 	Stop holding the lock shared.  The last reader out lets a writer
+//	in; the last but one lets in a reader waiting to upgrade.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseRead()
+{
+    lock->Acquire();
+    ASSERT(numReaders > 0);
+    numReaders--;
+    if (numReaders <= 1)
+	writersOk->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::AcquireWrite
+// 	Wait until no thread holds the lock, or is upgrading it, then
+//	hold it exclusive.  Readers arriving meanwhile wait behind us.
+//----------------------------------------------------------------------
+
+void RWLock::AcquireWrite()
+{
+    lock->Acquire();
+    numWaitingWriters++;
+    while ((writer != NULL) || (numReaders > 0) || upgrading)
+	writersOk->Wait(lock);
+    numWaitingWriters--;
+    writer = kernel->currentThread;
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::ReleaseWrite
+// 	Stop holding the lock exclusive.  A waiting writer goes next if
+//	there is one; otherwise every waiting reader does.
+//----------------------------------------------------------------------
+
+void RWLock::ReleaseWrite()
+{
+    lock->Acquire();
+    ASSERT(writer == kernel->currentThread);
+    writer = NULL;
+    if (numWaitingWriters > 0)
+	writersOk->Broadcast(lock);
+    else
+	readersOk->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// RWLock::Upgrade
+// 	Turn our shared hold on the lock into an exclusive one, waiting
+//	for the other readers to release it.  New readers and writers
+//	wait meanwhile, so that nothing changes under us.
+//
+//	Return FALSE, still holding the lock shared, if another reader is
+//	already upgrading; TRUE once we hold it exclusive.
+//----------------------------------------------------------------------
+
+bool RWLock::Upgrade()
+{
+    lock->Acquire();
+    ASSERT(numReaders > 0);
+    if (upgrading) {
+	lock->Release();
+	return FALSE;
+    }
+    upgrading = TRUE;
+    while (numReaders > 1)
+	writersOk->Wait(lock);
+    numReaders--;
+    upgrading = FALSE;
+    writer = kernel->currentThread;
+    lock->Release();
+    return TRUE;
+}
@@ -5,7 +5,8 @@
 //	locks, and condition variables.  The implementation for
 //	semaphores is given; for the latter two, only the procedure
 //	interface is given -- they are to be implemented as part of 
-//	the first assignment.
+//	the first assignment.  Reader-writer locks are built from the
+//	other three.
 //
 //	Note that all the synchronization objects take a "name" as
 //	part of the initialization.  This is solely for debugging purposes.
@@ -41,16 +42,19 @@ class Semaphore {
   public:
     Semaphore(char* debugName, int initialValue);	// set initial value
     ~Semaphore();   					// de-allocate semaphore
+    void *operator new(size_t size);	// from a slab cache (see slab.h)
+    void operator delete(void *p);
     char* getName() { return name;}			// debugging assist
     
     void P();	 	// these are the only operations on a semaphore
     void V();	 	// they are both *atomic*
+    int MaxWaiterPriority();	// of the threads waiting in P()
     void SelfTest();	// test routine for semaphore implementation
     
   private:
     char* name;        // useful for debugging
     int value;         // semaphore value, always >= 0
-    List<Thread *> *queue;     
+    DList<Thread *> *queue;
 		  	// threads waiting in P() for the value to be > 0
    };
 
@@ -139,6 +143,51 @@ class Condition {
 
   private:
     char* name;
-    List<Semaphore *> *waitQueue;	// list of waiting threads
+    DList<Thread *> *waitQueue;	// list of waiting threads
+};
+
+// The following class defines a "reader-writer lock".  Any number of
+// threads may hold it shared (readers), or one thread exclusive (a
+// writer):
+//
+//	AcquireRead/ReleaseRead -- wait until no thread holds it
+//		exclusive or is waiting to, then hold it shared
+//
+//	AcquireWrite/ReleaseWrite -- wait until no thread holds it at
+//		all, then hold it exclusive
+//
+//	Upgrade -- from shared, wait until the other readers are gone,
+//		then hold it exclusive
+//
+// Writers are preferred: once one is waiting, new readers wait behind
+// it, so a steady stream of readers cannot keep it out.  Only one
+// reader can be upgrading at a time, since two waiting for each other
+// to leave would wait forever; Upgrade returns FALSE, still holding
+// the lock shared, if another reader already is.  The caller must then
+// release it and acquire it exclusive, knowing that another writer may
+// have changed things in between.
+
+class RWLock {
+  public:
+    RWLock(char* debugName);		// initialize lock to be FREE
+    ~RWLock();				// deallocate lock
+    char* getName() { return name; }	// debugging assist
+
+    void AcquireRead();
+    void ReleaseRead();
+    void AcquireWrite();
+    void ReleaseWrite();
+    bool Upgrade();			// shared to exclusive, if no
+					// other reader is upgrading
+
+  private:
+    char *name;			// debugging assist
+    Lock *lock;			// protects the fields below
+    Condition *readersOk;	// signalled when readers may go on
+    Condition *writersOk;	// and when a writer may
+    int numReaders;		// threads holding it shared
+    int numWaitingWriters;	// threads waiting to hold it exclusive
+    Thread *writer;		// thread holding it exclusive, or NULL
+    bool upgrading;		// a reader is waiting in Upgrade
 };
 #endif // SYNCH_H
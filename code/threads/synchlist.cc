@@ -58,6 +58,27 @@ SynchList<T>::Append(T item)
     lock->Release();
 }
 
+//----------------------------------------------------------------------
+// SynchList<T>::Append
+//      Append "count" items to the end of the list, in order, taking
+//	the lock only once.  Wake up everyone waiting for an element,
+//	since there may be one for each of them.
+//
+//	"items" are the things to put on the list.
+//	"count" is how many there are.
+//----------------------------------------------------------------------
+
+template <class T>
+void
+SynchList<T>::Append(T *items, int count)
+{
+    lock->Acquire();
+    for (int i = 0; i < count; i++)
+	list->Append(items[i]);
+    listEmpty->Broadcast(lock);
+    lock->Release();
+}
+
 //----------------------------------------------------------------------
 // SynchList<T>::RemoveFront
 //      Remove an "item" from the beginning of the list.  Wait if
@@ -80,6 +101,34 @@ SynchList<T>::RemoveFront()
     return item;
 }
 
+//----------------------------------------------------------------------
+// SynchList<T>::RemoveFront
+//      Remove items from the beginning of the list, taking the lock
+//	only once: wait until there is at least one, then take every
+//	one there is, up to "max".
+//
+//	"items" is where to put them.
+//	"max" is how many there is room for.
+// Returns:
+//	How many were removed.
+//----------------------------------------------------------------------
+
+template <class T>
+int
+SynchList<T>::RemoveFront(T *items, int max)
+{
+    int count = 0;
+
+    ASSERT(max > 0);
+    lock->Acquire();
+    while (list->IsEmpty())
+	listEmpty->Wait(lock);
+    while ((count < max) && !list->IsEmpty())
+	items[count++] = list->RemoveFront();
+    lock->Release();
+    return count;
+}
+
 //----------------------------------------------------------------------
 // SynchList<T>::Apply
 //      Apply function to every item on a list.
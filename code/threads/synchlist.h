@@ -28,9 +28,14 @@ class SynchList {
 
     void Append(T item);	// append item to the end of the list,
 				// and wake up any thread waiting in remove
+    void Append(T *items, int count);
+				// append several, all at once
 
     T RemoveFront();		// remove the first item from the front of
 				// the list, waiting if the list is empty
+    int RemoveFront(T *items, int max);
+				// wait the same way, then remove as many
+				// as there are, up to "max"
 
     void Apply(void (*f)(T)); // apply function to all elements in list
 
@@ -0,0 +1,96 @@
+// taskqueue.cc
+//	Routines to post tasks, and the worker thread that runs them.
+//
+//	The queue is only touched with interrupts off, so that an
+//	interrupt handler can post a task without taking a lock.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "taskqueue.h"
+
+//----------------------------------------------------------------------
+// TaskQueue::TaskQueue
+// 	Set up an empty queue of tasks.  The worker thread is only forked
+//	when the first task is posted.
+//
+//	"debugName" -- name of the worker thread, for debugging
+//----------------------------------------------------------------------
+
+TaskQueue::TaskQueue(char *debugName)
+{
+    name = debugName;
+    tasks = new List<Task *>;
+    posted = new Semaphore("tasks posted", 0);
+    worker = NULL;
+}
+
+//----------------------------------------------------------------------
+// TaskQueue::~TaskQueue
+// 	De-allocate the queue, and any tasks that never ran.  The worker
+//	is left waiting; this is only done when Nachos halts.
+//----------------------------------------------------------------------
+
+TaskQueue::~TaskQueue()
+{
+    while (!tasks->IsEmpty())
+	delete tasks->RemoveFront();
+    delete tasks;
+    delete posted;
+}
+
+//----------------------------------------------------------------------
+// TaskQueue::Post
+// 	Queue (*func)(arg) for the worker to run, and return without
+//	waiting for it.  The worker runs at the highest priority, since
+//	tasks are short and others are often waiting on what they do.
+//
+//	"func" -- the procedure to run
+//	"arg" -- its argument
+//----------------------------------------------------------------------
+
+void
+TaskQueue::Post(VoidFunctionPtr func, void *arg)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    tasks->Append(new Task(func, arg));
+    kernel->stats->numTasks++;
+    if (worker == NULL) {
+	worker = new Thread(name, 1, SmallStackSize);
+	worker->setPriority(MaxPriority);
+	worker->Fork(TaskQueue::WorkerLoop, this);
+    }
+    posted->V();
+    (void) kernel->interrupt->SetLevel(oldLevel);
+}
+
+//----------------------------------------------------------------------
+// TaskQueue::WorkerLoop
+// 	Body of the worker thread: forever take the first task posted,
+//	and run it.
+//
+//	"data" -- the task queue
+//----------------------------------------------------------------------
+
+void
+TaskQueue::WorkerLoop(void *data)
+{
+    TaskQueue *queue = (TaskQueue *)data;
+
+    for (;;) {
+	IntStatus oldLevel;
+	Task *task;
+
+	queue->posted->P();
+	oldLevel = kernel->interrupt->SetLevel(IntOff);
+	task = queue->tasks->RemoveFront();
+	(void) kernel->interrupt->SetLevel(oldLevel);
+
+	(*task->func)(task->arg);
+	delete task;
+    }
+}
@@ -0,0 +1,65 @@
+// taskqueue.h
+//	Data structures for running short pieces of kernel work -- tasks
+//	-- without a thread of their own.
+//
+//	A task is just a procedure and its argument.  Posting one puts it
+//	on a queue and returns right away; a single worker thread, with a
+//	small stack, runs the tasks one after another, in the order they
+//	were posted.  This suits the work that follows an I/O completion:
+//	it is short, and forking a thread for each would cost a stack
+//	apiece.
+//
+//	Tasks can be posted from an interrupt handler, since Post never
+//	waits.  A task may block (on a lock or the disk, say), but the
+//	tasks behind it wait meanwhile, so long waits belong elsewhere.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "list.h"
+#include "synch.h"
+
+class TaskGroup;
+
+// A procedure waiting to be run, with its argument.
+
+class Task {
+  public:
+    Task(VoidFunctionPtr f, void *a, TaskGroup *g = NULL)
+	{ func = f; arg = a; group = g; }
+
+    VoidFunctionPtr func;	// procedure to run
+    void *arg;			// and what to pass it
+    TaskGroup *group;		// told when it has run, if not NULL
+				// (see threadpool.h)
+};
+
+// The following class defines the queue of tasks, and the worker that
+// runs them.
+
+class TaskQueue {
+  public:
+    TaskQueue(char *debugName);	// no worker until the first task
+    ~TaskQueue();
+
+    void Post(VoidFunctionPtr func, void *arg);
+				// have (*func)(arg) run soon, by the
+				// worker; does not wait
+
+  private:
+    char *name;			// of the worker thread
+    List<Task *> *tasks;	// posted and not yet started
+    Semaphore *posted;		// one count per task in "tasks"
+    Thread *worker;		// runs the tasks; NULL until needed
+
+    static void WorkerLoop(void *data);
+				// body of the worker thread
+};
+
+#endif // TASKQUEUE_H
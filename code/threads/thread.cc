@@ -31,14 +31,18 @@ const int STACK_FENCEPOST = 0xdedbeef;
 //	Thread::Fork.
 //
 //	"threadName" is an arbitrary string, useful for debugging.
+//	"stackWords" is the size of the stack Fork will give it, in words;
+//		StackSize unless it is known to need less (or more)
 //----------------------------------------------------------------------
 
-Thread::Thread(char* threadName, int threadID)
+Thread::Thread(char* threadName, int threadID, int stackWords)
 {
 	ID = threadID;
     name = threadName;
     stackTop = NULL;
     stack = NULL;
+    ASSERT(stackWords >= SmallStackSize);
+    stackSize = stackWords;
     status = JUST_CREATED;
     for (int i = 0; i < MachineStateSize; i++) {
 	machineState[i] = NULL;		// not strictly necessary, since
@@ -46,6 +50,26 @@ Thread::Thread(char* threadName, int threadID)
 					// of machine registers
     }
     space = NULL;
+    basePriority = DefaultPriority;
+    priority = DefaultPriority;
+    waitingFor = NULL;
+    locksHeld = new List<Lock *>;
+    waitSemaphore = new Semaphore("condition", 0);
+    schedLevel = 0;
+    levelTicks = 0;
+    runningSince = 0;
+    readySince = readyAt = 0;
+    boostEpoch = 0;
+    cpu = 0;
+    leftCpuAt = -MigrationCost;		// nothing warm anywhere
+    tickets = DefaultTickets;
+    pass = 0;
+    cpuTicks = 0;
+    period = relDeadline = budget = 0;
+    releasedAt = absDeadline = budgetLeft = 0;
+    for (int i = 0; i < NumUsageKinds; i++)
+	usage[i] = 0;
+    preempted = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -58,14 +82,50 @@ Thread::Thread(char* threadName, int threadID)
 //      NOTE: if this is the main thread, we can't delete the stack
 //      because we didn't allocate it -- we got it automatically
 //      as part of starting up Nachos.
+//
+//	A stack of the default size goes back to the kernel's pool,
+//	unless that is full, for the next thread forked to reuse; it
+//	keeps its guard pages.
 //----------------------------------------------------------------------
 
 Thread::~Thread()
 {
     DEBUG(dbgThread, "Deleting thread: " << name);
     ASSERT(this != kernel->currentThread);
-    if (stack != NULL)
-	DeallocBoundedArray((char *) stack, StackSize * sizeof(int));
+    kernel->scheduler->Forget(this);
+    if (stack != NULL) {
+	CheckOverflow();	// a stack that overflowed is not reused
+	if ((stackSize == StackSize) &&
+		(kernel->stackPool->NumInList() < kernel->stackPoolSize))
+	    kernel->stackPool->Prepend(stack);
+	else
+	    DeallocBoundedArray((char *) stack, stackSize * sizeof(int));
+    }
+    delete waitSemaphore;
+    delete locksHeld;
+}
+
+//----------------------------------------------------------------------
+// Thread::setPriority
+// 	Set the base priority of the thread to "newPriority", between
+//	MinPriority and MaxPriority.  A priority it has inherited through a
+//	lock it holds is kept until it releases the lock (see Lock::Release).
+//	If the thread is on the ready list, it moves to its new place.
+//----------------------------------------------------------------------
+
+void
+Thread::setPriority(int newPriority)
+{
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+    ASSERT((newPriority >= MinPriority) && (newPriority <= MaxPriority));
+    DEBUG(dbgThread, "Setting the priority of " << name << " to " << newPriority);
+    basePriority = newPriority;
+    if (locksHeld->IsEmpty() || (newPriority > priority)) {
+	priority = newPriority;
+	kernel->scheduler->Reprioritize(this);
+    }
+    (void) kernel->interrupt->SetLevel(oldLevel);
 }
 
 //----------------------------------------------------------------------
@@ -82,7 +142,8 @@ Thread::~Thread()
 //		1. Allocate a stack
 //		2. Initialize the stack so that a call to SWITCH will
 //		cause it to run the procedure
-//		3. Put the thread on the ready queue
+//		3. Put the thread on the ready queue, that of the
+//		CPU the caller is on
 // 	
 //	"func" is the procedure to run concurrently.
 //	"arg" is a single argument to be passed to the procedure.
@@ -99,6 +160,7 @@ Thread::Fork(VoidFunctionPtr func, void *arg)
     StackAllocate(func, arg);
 
     oldLevel = interrupt->SetLevel(IntOff);
+    cpu = kernel->currentThread->cpu;
     scheduler->ReadyToRun(this);	// ReadyToRun assumes that interrupts 
 					// are disabled!
     (void) interrupt->SetLevel(oldLevel);
@@ -124,7 +186,7 @@ Thread::CheckOverflow()
 {
     if (stack != NULL) {
 #ifdef HPUX			// Stacks grow upward on the Snakes
-	ASSERT(stack[StackSize - 1] == STACK_FENCEPOST);
+	ASSERT(stack[stackSize - 1] == STACK_FENCEPOST);
 #else
 	ASSERT(*stack == STACK_FENCEPOST);
 #endif
@@ -173,15 +235,36 @@ Thread::Finish ()
     (void) kernel->interrupt->SetLevel(IntOff);		
     ASSERT(this == kernel->currentThread);
     
-    DEBUG(dbgThread, "Finishing thread: " << name);
+    DEBUG(dbgThread, "Finishing thread: " << name << ", user ticks "
+	  << usage[UsageUserTicks] << ", system ticks " << usage[UsageSystemTicks]
+	  << ", sectors read " << usage[UsageSectorsRead] << ", written "
+	  << usage[UsageSectorsWritten] << ", page faults "
+	  << usage[UsagePageFaults] << ", system calls " << usage[UsageSyscalls]
+	  << ", switches voluntary " << usage[UsageVoluntarySwitches]
+	  << ", involuntary " << usage[UsageInvoluntarySwitches]);
     Sleep(TRUE);				// invokes SWITCH
     // not reached
 }
 
+//----------------------------------------------------------------------
+// Thread::Account
+// 	Charge the thread for "amount" more of resource "kind", and the
+//	program it belongs to, if any, in the statistics.
+//----------------------------------------------------------------------
+
+void
+Thread::Account(UsageKind kind, int amount)
+{
+    usage[kind] += amount;
+    if ((space != NULL) && (space->SpaceId() >= 0) &&
+	    (space->SpaceId() < MaxSpaces))
+	kernel->stats->spaceUsage[space->SpaceId()][kind] += amount;
+}
 
 //----------------------------------------------------------------------
 // Thread::Yield
-// 	Relinquish the CPU if any other thread is ready to run.
+// 	Relinquish the CPU if any other thread is ready to run (with
+//	priorities, any of the same priority or higher).
 //	If so, put the thread on the end of the ready list, so that
 //	it will eventually be re-scheduled.
 //
@@ -207,7 +290,9 @@ Thread::Yield ()
     
     DEBUG(dbgThread, "Yielding thread: " << name);
     
-    nextThread = kernel->scheduler->FindNextToRun();
+    nextThread = NULL;
+    if (kernel->scheduler->ReadyToYieldTo(this))
+	nextThread = kernel->scheduler->FindNextToRun();
     if (nextThread != NULL) {
 	kernel->scheduler->ReadyToRun(this);
 	kernel->scheduler->Run(nextThread, FALSE);
@@ -247,10 +332,14 @@ Thread::Sleep (bool finishing)
 
     status = BLOCKED;
 	//cout << "debug Thread::Sleep " << name << "wait for Idle\n";
+    bool idled = FALSE;
     while ((nextThread = kernel->scheduler->FindNextToRun()) == NULL) {
 		kernel->PrepareToEnd();
 		kernel->interrupt->Idle();	// no one to run, wait for an interrupt
+		idled = TRUE;
 	}    
+    if (idled)
+	kernel->alarm->Restart();	// the timer stops while idle
     // returns when it's time for us to run
     kernel->scheduler->Run(nextThread, finishing); 
 }
@@ -299,6 +388,9 @@ PLabelToAddr(void *plabel)
 //		calls (*func)(arg)
 //		calls Thread::Finish
 //
+//	A stack of the default size is taken from the kernel's pool if
+//	there is one there; the fence post is written again either way.
+//
 //	"func" is the procedure to be forked
 //	"arg" is the parameter to be passed to the procedure
 //----------------------------------------------------------------------
@@ -306,34 +398,40 @@ PLabelToAddr(void *plabel)
 void
 Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 {
-    stack = (int *) AllocBoundedArray(StackSize * sizeof(int));
+    if ((stackSize == StackSize) && !kernel->stackPool->IsEmpty()) {
+	stack = kernel->stackPool->RemoveFront();
+	kernel->stats->numStackReuses++;
+    } else {
+	stack = (int *) AllocBoundedArray(stackSize * sizeof(int));
+	kernel->stats->numStackAllocs++;
+    }
 
 #ifdef PARISC
     // HP stack works from low addresses to high addresses
     // everyone else works the other way: from high addresses to low addresses
     stackTop = stack + 16;	// HP requires 64-byte frame marker
-    stack[StackSize - 1] = STACK_FENCEPOST;
+    stack[stackSize - 1] = STACK_FENCEPOST;
 #endif
 
 #ifdef SPARC
-    stackTop = stack + StackSize - 96; 	// SPARC stack must contains at 
+    stackTop = stack + stackSize - 96; 	// SPARC stack must contains at 
 					// least 1 activation record 
 					// to start with.
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef PowerPC // RS6000
-    stackTop = stack + StackSize - 16; 	// RS6000 requires 64-byte frame marker
+    stackTop = stack + stackSize - 16; 	// RS6000 requires 64-byte frame marker
     *stack = STACK_FENCEPOST;
 #endif 
 
 #ifdef DECMIPS
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
 #ifdef ALPHA
-    stackTop = stack + StackSize - 8;	// -8 to be on the safe side!
+    stackTop = stack + stackSize - 8;	// -8 to be on the safe side!
     *stack = STACK_FENCEPOST;
 #endif
 
@@ -342,7 +440,7 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
     // the x86 passes the return address on the stack.  In order for SWITCH() 
     // to go to ThreadRoot when we switch to this thread, the return addres 
     // used in SWITCH() must be the starting address of ThreadRoot.
-    stackTop = stack + StackSize - 4;	// -4 to be on the safe side!
+    stackTop = stack + stackSize - 4;	// -4 to be on the safe side!
     // *(--stackTop) = (int) ThreadRoot;
     *stack = STACK_FENCEPOST;
 #endif
@@ -371,6 +469,9 @@ Thread::StackAllocate (VoidFunctionPtr func, void *arg)
 //	Note that a user program thread has *two* sets of CPU registers -- 
 //	one for its state while executing user code, one for its state 
 //	while executing kernel code.  This routine saves the former.
+//
+//	Called by Scheduler::LoadUserState, only when another thread's
+//	registers are to be loaded.
 //----------------------------------------------------------------------
 
 void
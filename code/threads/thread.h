@@ -41,7 +41,13 @@
 #include "utility.h"
 #include "sysdep.h"
 #include "machine.h"
+#include "stats.h"
 #include "addrspace.h"
+#include "list.h"
+#include "dlist.h"
+
+class Lock;
+class Semaphore;
 
 // CPU register state to be saved on context switch.  
 // The x86 needs to save only a few registers, 
@@ -53,14 +59,35 @@
 #define MachineStateSize 75 
 
 
-// Size of the thread's private execution stack.
+// Size of the thread's private execution stack, unless it is given
+// another when created.
 // WATCH OUT IF THIS ISN'T BIG ENOUGH!!!!!
 const int StackSize = (8 * 1024);	// in words
 
+// Stack of a thread that only runs short callbacks that go no deeper
+// than a few calls, such as the task queue worker (see taskqueue.h).
+const int SmallStackSize = 1024;	// in words
+
+// How many StackSize stacks of deleted threads are kept, by default,
+// for new threads to reuse instead of allocating their own (see -ks).
+const int StackPoolSize = 16;
+
 
 // Thread state
 enum ThreadStatus { JUST_CREATED, RUNNING, READY, BLOCKED, ZOMBIE };
 
+// Thread priorities, used when the scheduler runs the highest first
+// (see scheduler.h); the higher the number, the sooner a thread runs.
+const int NumPriorities = 8;
+const int MinPriority = 0;
+const int MaxPriority = NumPriorities - 1;
+const int DefaultPriority = MinPriority;
+
+// Tickets, used when the scheduler gives each thread a share of the
+// CPU in proportion to its tickets (see scheduler.h).
+const int DefaultTickets = 100;
+const int MaxTickets = 10000;
+
 
 // The following class defines a "thread control block" -- which
 // represents a single thread of execution.
@@ -81,7 +108,9 @@ class Thread {
     void *machineState[MachineStateSize];  // all registers except for stackTop
 
   public:
-    Thread(char* debugName, int threadID);		// initialize a Thread 
+    Thread(char* debugName, int threadID, int stackWords = StackSize);
+					// initialize a Thread, which will
+					// have a stack of "stackWords" words
     ~Thread(); 				// deallocate a Thread
 					// NOTE -- thread being deleted
 					// must not be running when delete 
@@ -107,12 +136,74 @@ class Thread {
     void Print() { cout << name; }
     void SelfTest();		// test whether thread impl is working
 
+    void setPriority(int newPriority);	// Change the base priority
+    int getPriority() { return priority; }
+				// as it runs: the base priority, or
+				// higher, inherited from the threads
+				// waiting for a lock it holds
+
+    // Kept by Lock, for priority inheritance.
+    int basePriority;		// as last set
+    int priority;		// with what it inherits
+    Lock *waitingFor;		// lock it is waiting to acquire, or NULL
+    List<Lock *> *locksHeld;	// locks it has acquired
+
+    // Kept by the scheduler, for the multi-level feedback queue.
+    int schedLevel;		// ready list it goes on, 0 the highest
+    int levelTicks;		// CPU time it has had at that level
+    int runningSince;		// when it last went on the CPU
+    int readySince;		// when it last went on a ready list
+				// (or up one, by aging)
+    int readyAt;		// when it was last made ready to run
+    int boostEpoch;		// the last boost it was at the top for
+
+    int cpu;			// simulated CPU it last ran on, or is
+				// to run on
+    int leftCpuAt;		// when it last came off that CPU
+
+    // Kept by the scheduler, for stride scheduling.
+    int tickets;		// its share of the CPU, against others'
+    double pass;		// CPU time it has had, over its tickets;
+				// the lowest runs next
+    int cpuTicks;		// CPU time it has had, in all (any policy)
+
+    // Kept by the scheduler, for real-time threads (earliest deadline
+    // first).
+    int period;			// a job released every so many ticks;
+				// 0 for a thread of the normal class
+    int relDeadline;		// each due so long after its release
+    int budget;			// and allowed so much CPU time
+    int releasedAt;		// when the current job was released
+    int absDeadline;		// and when it is due
+    int budgetLeft;		// CPU time it has left
+
+    // Kept for accounting, as the thread uses resources.
+    int usage[NumUsageKinds];	// what it has been charged for
+    bool preempted;		// is it being made to give up the CPU?
+    void Account(UsageKind kind, int amount = 1);
+				// charge it, and its program, for
+				// "amount" more of "kind"
+
+    // Kept by the scheduler and by Semaphore: a thread is on at most
+    // one ready list or semaphore queue at a time.
+    DListLink<Thread *> queueLink;
+    static DListLink<Thread *> *QueueLink(Thread *thread)
+	{ return &thread->queueLink; }
+
+    // Kept by Condition: the thread is on the queue of the condition
+    // it waits on, and sleeps on its own semaphore until signalled.
+    DListLink<Thread *> waitLink;
+    static DListLink<Thread *> *WaitLink(Thread *thread)
+	{ return &thread->waitLink; }
+    Semaphore *waitSemaphore;
+
   private:
     // some of the private data for this class is listed above
     
     int *stack; 	 	// Bottom of the stack 
 				// NULL if this is the main thread
 				// (If NULL, don't deallocate stack)
+    int stackSize;		// in words
     ThreadStatus status;	// ready, running or blocked
     char* name;
 	int   ID;
@@ -129,6 +220,8 @@ class Thread {
   public:
     void SaveUserState();		// save user-level register state
     void RestoreUserState();		// restore user-level register state
+    void SetUserRegister(int num, int value)
+	{ userRegisters[num] = value; }	// change the saved state
 
     AddrSpace *space;			// User code this thread is running.
 };
@@ -0,0 +1,222 @@
+// threadbench.cc
+//	Routines to time thread switching and the scheduler.  See
+//	threadbench.h.
+//
+//	Each test forks its threads, then waits on "done" until every
+//	one has finished, so the main thread takes part in the switching
+//	as well.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "threadbench.h"
+#include "main.h"
+#include <stdio.h>
+
+//----------------------------------------------------------------------
+// ThreadBench::ThreadBench
+// 	Make the semaphores and lock the tests share.
+//----------------------------------------------------------------------
+
+ThreadBench::ThreadBench()
+{
+    done = new Semaphore("bench done", 0);
+    ping = new Semaphore("bench ping", 0);
+    pong = new Semaphore("bench pong", 0);
+    lock = new Lock("bench lock");
+}
+
+ThreadBench::~ThreadBench()
+{
+    delete done;
+    delete ping;
+    delete pong;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Run
+// 	Run every test, with the scheduler measuring the host time of
+//	each switch.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Run()
+{
+    printf("%-10s %7s %9s %9s %10s %12s %9s %9s %9s\n", "test", "ops",
+	   "switches", "ticks", "host usec", "switches/s", "usec/sw",
+	   "Run usec", "SWITCH");
+    kernel->scheduler->TimeSwitches(TRUE);
+    PingPong();
+    YieldStorm();
+    LockContention();
+    ForkChurn();
+    kernel->scheduler->TimeSwitches(FALSE);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::Start, ThreadBench::Finish
+// 	Measure a test: note the counters as it starts, then print its
+//	line -- the switches it made, the simulated and host time it
+//	took, and per switch, the host time in all, in Scheduler::Run and
+//	in SWITCH.
+//
+//	"test" -- the name of the test
+//	"ops" -- how many times it did what it does
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Start()
+{
+    startSwitches = kernel->stats->numContextSwitches;
+    startTicks = kernel->stats->totalTicks;
+    startRunHost = kernel->scheduler->RunHostTime();
+    startSwitchHost = kernel->scheduler->SwitchHostTime();
+    startTimed = kernel->scheduler->TimedSwitches();
+    startHost = HostTime();
+}
+
+void
+ThreadBench::Finish(const char *test, int ops)
+{
+    double host = HostTime() - startHost;
+    int switches = kernel->stats->numContextSwitches - startSwitches;
+    int timed = kernel->scheduler->TimedSwitches() - startTimed;
+    double runHost = kernel->scheduler->RunHostTime() - startRunHost;
+    double switchHost = kernel->scheduler->SwitchHostTime() -
+							startSwitchHost;
+
+    switches = max(switches, 1);
+    timed = max(timed, 1);
+    printf("%-10s %7d %9d %9d %10.0f %12.0f %9.3f %9.3f %9.3f\n", test, ops,
+	   switches, kernel->stats->totalTicks - startTicks, host,
+	   switches * 1e6 / max(host, 1.0), host / switches,
+	   runHost / switches, switchHost / timed);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::PingPong
+// 	Two threads hand the CPU back and forth: each V wakes the other,
+//	each P puts this one to sleep.  Two switches a round trip.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Ponger(void *data)
+{
+    ThreadBench *bench = (ThreadBench *)data;
+
+    for (int i = 0; i < BenchPingPongs; i++) {
+	bench->ping->P();
+	bench->pong->V();
+    }
+    bench->done->V();
+}
+
+void
+ThreadBench::PingPong()
+{
+    Thread *t = new Thread("ponger", 1);
+
+    Start();
+    t->Fork(ThreadBench::Ponger, this);
+    for (int i = 0; i < BenchPingPongs; i++) {
+	ping->V();
+	pong->P();
+    }
+    done->P();
+    Finish("pingpong", BenchPingPongs);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::YieldStorm
+// 	BenchYielders threads yield to each other, over and over: every
+//	Yield is a switch through the ready list.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Yielder(void *data)
+{
+    ThreadBench *bench = (ThreadBench *)data;
+
+    for (int i = 0; i < BenchYields; i++)
+	kernel->currentThread->Yield();
+    bench->done->V();
+}
+
+void
+ThreadBench::YieldStorm()
+{
+    Start();
+    for (int i = 0; i < BenchYielders; i++) {
+	Thread *t = new Thread("yielder", 1);
+
+	t->Fork(ThreadBench::Yielder, this);
+    }
+    for (int i = 0; i < BenchYielders; i++)
+	done->P();
+    Finish("yield", BenchYielders * BenchYields);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::LockContention
+// 	BenchContenders threads take a lock, yield while holding it, and
+//	let it go: the others that run in the meantime block on it, and
+//	are woken in turn.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Contender(void *data)
+{
+    ThreadBench *bench = (ThreadBench *)data;
+
+    for (int i = 0; i < BenchAcquires; i++) {
+	bench->lock->Acquire();
+	kernel->currentThread->Yield();
+	bench->lock->Release();
+    }
+    bench->done->V();
+}
+
+void
+ThreadBench::LockContention()
+{
+    Start();
+    for (int i = 0; i < BenchContenders; i++) {
+	Thread *t = new Thread("contender", 1);
+
+	t->Fork(ThreadBench::Contender, this);
+    }
+    for (int i = 0; i < BenchContenders; i++)
+	done->P();
+    Finish("lock", BenchContenders * BenchAcquires);
+}
+
+//----------------------------------------------------------------------
+// ThreadBench::ForkChurn
+// 	Fork a thread that finishes at once, wait for it, and do it
+//	again: each costs a stack (from the pool, once there is one), a
+//	switch to the thread, and one back.
+//----------------------------------------------------------------------
+
+void
+ThreadBench::Churner(void *data)
+{
+    ThreadBench *bench = (ThreadBench *)data;
+
+    bench->done->V();
+}
+
+void
+ThreadBench::ForkChurn()
+{
+    Start();
+    for (int i = 0; i < BenchForks; i++) {
+	Thread *t = new Thread("churner", 1);
+
+	t->Fork(ThreadBench::Churner, this);
+	done->P();
+    }
+    Finish("fork", BenchForks);
+}
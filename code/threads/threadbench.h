@@ -0,0 +1,68 @@
+// threadbench.h
+//	Data structures for a benchmark of threads and the scheduler:
+//	how fast threads switch when they hand the CPU to each other
+//	through semaphores, yield to each other, fight over a lock, and
+//	are forked and finish.
+//
+//	Each test reports the context switches it made, per host second,
+//	and the host time each switch took -- in all, in Scheduler::Run
+//	(saving and restoring state, picking the next thread) and in
+//	SWITCH itself -- so that changes to the scheduler or the ready
+//	list can be measured against a baseline.  Run it (-KB) with the
+//	same flags on both builds.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADBENCH_H
+#define THREADBENCH_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "synch.h"
+
+#define BenchPingPongs	2000	// round trips between two threads
+#define BenchYielders	8	// threads yielding to each other
+#define BenchYields	500	// times each one yields
+#define BenchContenders	4	// threads sharing a lock
+#define BenchAcquires	500	// times each one takes it
+#define BenchForks	500	// threads forked, one after the other
+
+// The following class defines one run of the benchmark.
+
+class ThreadBench {
+  public:
+    ThreadBench();
+    ~ThreadBench();
+
+    void Run();			// Run every test
+
+  private:
+    Semaphore *done;		// each thread forked says it finished
+    Semaphore *ping, *pong;	// for the ping-pong
+    Lock *lock;			// for the lock contention
+
+    int startSwitches;		// when the test running started
+    int startTicks;
+    double startHost;
+    double startRunHost;
+    double startSwitchHost;
+    int startTimed;
+
+    void Start();		// start measuring a test
+    void Finish(const char *test, int ops);
+				// and print its line
+
+    void PingPong();		// two threads, through semaphores
+    void YieldStorm();		// many threads yielding
+    void LockContention();	// threads yielding with a lock held
+    void ForkChurn();		// fork a thread, wait for it, again
+
+    static void Ponger(void *data);
+    static void Yielder(void *data);
+    static void Contender(void *data);
+    static void Churner(void *data);
+};
+
+#endif // THREADBENCH_H
@@ -0,0 +1,194 @@
+// threadpool.cc
+//	Routines to submit tasks to the pool of worker threads, the
+//	workers themselves, and groups of tasks to wait for.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "threadpool.h"
+
+//----------------------------------------------------------------------
+// TaskGroup::TaskGroup
+// 	Set up a group with no tasks in it yet.
+//
+//	"debugName" -- an arbitrary name, useful for debugging
+//----------------------------------------------------------------------
+
+TaskGroup::TaskGroup(char *debugName)
+{
+    outstanding = 0;
+    lock = new Lock(debugName);
+    allDone = new Condition(debugName);
+}
+
+TaskGroup::~TaskGroup()
+{
+    ASSERT(outstanding == 0);
+    delete allDone;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// TaskGroup::Add, TaskGroup::Done
+// 	Count tasks submitted as part of the group, before they are
+//	queued, and as they finish, waking anyone waiting once the last
+//	one has.
+//
+//	"count" -- how many tasks are being submitted
+//----------------------------------------------------------------------
+
+void
+TaskGroup::Add(int count)
+{
+    lock->Acquire();
+    outstanding += count;
+    lock->Release();
+}
+
+void
+TaskGroup::Done()
+{
+    lock->Acquire();
+    ASSERT(outstanding > 0);
+    outstanding--;
+    if (outstanding == 0)
+	allDone->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// TaskGroup::Wait
+// 	Wait until every task submitted as part of the group so far has
+//	finished.  Returns right away if there are none.
+//----------------------------------------------------------------------
+
+void
+TaskGroup::Wait()
+{
+    lock->Acquire();
+    while (outstanding > 0)
+	allDone->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::ThreadPool
+// 	Set up a pool with an empty queue.  The workers are only forked
+//	when the first task is submitted.
+//
+//	"debugName" -- name of the worker threads, for debugging
+//	"numWorkers" -- how many there are to be
+//----------------------------------------------------------------------
+
+ThreadPool::ThreadPool(char *debugName, int numWorkers)
+{
+    ASSERT(numWorkers > 0);
+    name = debugName;
+    this->numWorkers = numWorkers;
+    workers = NULL;
+    queue = new SynchList<Task *>;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::~ThreadPool
+// 	De-allocate the pool.  The workers are left waiting for tasks;
+//	this is only done when Nachos halts.
+//----------------------------------------------------------------------
+
+ThreadPool::~ThreadPool()
+{
+    delete [] workers;
+    delete queue;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::Submit
+// 	Queue (*func)(arg) for the first free worker to run, and return
+//	without waiting for it.
+//
+//	"func" -- the procedure to run
+//	"arg" -- its argument
+//	"group" -- the group it belongs to, or NULL
+//----------------------------------------------------------------------
+
+void
+ThreadPool::Submit(VoidFunctionPtr func, void *arg, TaskGroup *group)
+{
+    StartWorkers();
+    if (group != NULL)
+	group->Add(1);
+    queue->Append(new Task(func, arg, group));
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::SubmitBatch
+// 	Queue (*func)(args[i]) for each of "count" arguments, all at once,
+//	so that no worker starts on one before the rest are queued.
+//
+//	"func" -- the procedure to run
+//	"args" -- the argument for each task
+//	"count" -- how many tasks
+//	"group" -- the group they belong to, or NULL
+//----------------------------------------------------------------------
+
+void
+ThreadPool::SubmitBatch(VoidFunctionPtr func, void **args, int count,
+			TaskGroup *group)
+{
+    Task **tasks = new Task *[count];
+
+    StartWorkers();
+    if (group != NULL)
+	group->Add(count);
+    for (int i = 0; i < count; i++)
+	tasks[i] = new Task(func, args[i], group);
+    queue->Append(tasks, count);
+    delete [] tasks;
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::StartWorkers
+// 	Fork the workers, the first time a task is submitted.  They run
+//	at the highest priority, since others are usually waiting on
+//	what they do.
+//----------------------------------------------------------------------
+
+void
+ThreadPool::StartWorkers()
+{
+    if (workers != NULL)
+	return;
+    workers = new Thread *[numWorkers];
+    for (int i = 0; i < numWorkers; i++) {
+	workers[i] = new Thread(name, 1);
+	workers[i]->setPriority(MaxPriority);
+	workers[i]->Fork(ThreadPool::WorkerLoop, this);
+    }
+}
+
+//----------------------------------------------------------------------
+// ThreadPool::WorkerLoop
+// 	Body of each worker thread: forever take the first task queued,
+//	run it, and tell its group it is done.
+//
+//	"data" -- the pool
+//----------------------------------------------------------------------
+
+void
+ThreadPool::WorkerLoop(void *data)
+{
+    ThreadPool *pool = (ThreadPool *)data;
+
+    for (;;) {
+	Task *task = pool->queue->RemoveFront();
+
+	(*task->func)(task->arg);
+	kernel->stats->numPoolTasks++;
+	if (task->group != NULL)
+	    task->group->Done();
+	delete task;
+    }
+}
@@ -0,0 +1,82 @@
+// threadpool.h
+//	Data structures for a pool of kernel worker threads, which run
+//	background jobs handed to them instead of each job forking a
+//	thread of its own.
+//
+//	Jobs are tasks, as for the task queue (see taskqueue.h): a
+//	procedure and its argument.  Submitted tasks wait on a SynchList,
+//	and each of a fixed number of workers takes the first one, runs
+//	it, and comes back for the next.  Unlike the task queue, tasks
+//	here may wait for the disk for as long as they need: the other
+//	workers go on meanwhile, so several of them can have a disk
+//	request queued at once.  Submit takes a lock, so it must not be
+//	called from an interrupt handler.
+//
+//	Tasks can be submitted as members of a TaskGroup, and a thread
+//	can then wait until every task in the group has finished.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "synch.h"
+#include "synchlist.h"
+#include "taskqueue.h"
+
+const int NumPoolWorkers = 4;	// worker threads in the kernel's pool
+
+// The following class defines a set of submitted tasks that can be
+// waited for together.
+
+class TaskGroup {
+  public:
+    TaskGroup(char *debugName);	// a group with no tasks
+    ~TaskGroup();		// must have none unfinished
+
+    void Wait();		// until every task added has finished
+
+  private:
+    friend class ThreadPool;
+
+    void Add(int count);	// "count" more tasks submitted
+    void Done();		// and one of them has finished
+
+    int outstanding;		// submitted and not yet finished
+    Lock *lock;			// protects "outstanding"
+    Condition *allDone;		// signalled when it drops to 0
+};
+
+// The following class defines the pool: the queue of tasks, and the
+// workers that run them.
+
+class ThreadPool {
+  public:
+    ThreadPool(char *debugName, int numWorkers);
+				// no workers until the first task
+    ~ThreadPool();
+
+    void Submit(VoidFunctionPtr func, void *arg, TaskGroup *group = NULL);
+				// have a worker run (*func)(arg), as
+				// part of "group" if not NULL
+    void SubmitBatch(VoidFunctionPtr func, void **args, int count,
+		     TaskGroup *group = NULL);
+				// the same for each of "count" args,
+				// queued together
+
+  private:
+    char *name;			// of the worker threads
+    int numWorkers;		// how many there are to be
+    Thread **workers;		// NULL until forked
+    SynchList<Task *> *queue;	// submitted and not yet started
+
+    void StartWorkers();	// fork them, if not done yet
+    static void WorkerLoop(void *data);
+				// body of each worker thread
+};
+
+#endif // THREADPOOL_H
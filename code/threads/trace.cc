@@ -0,0 +1,157 @@
+// trace.cc
+//	Routines to write out the trace of a run of Nachos, in the Chrome
+//	trace event format: one "track" per simulated CPU showing which
+//	thread ran when, one for interrupts, one for the disk, and one per
+//	thread for its system calls.  Time stamps are simulated ticks,
+//	shown as microseconds.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "trace.h"
+#include "main.h"
+#include <stdio.h>
+
+// Tracks other than the CPUs'
+
+#define InterruptTrack	100
+#define DiskTrack	101
+#define SyscallTrack	1000	// plus the thread's ID
+
+//----------------------------------------------------------------------
+// Trace::Trace
+// 	Start a trace, with nothing in it yet.
+//
+//	"fileName" -- where to write it when Nachos halts
+//----------------------------------------------------------------------
+
+Trace::Trace(char *fileName)
+{
+    this->fileName = fileName;
+    events = new TraceEvent[TraceSize];
+    next = numEvents = 0;
+}
+
+//----------------------------------------------------------------------
+// Trace::~Trace
+// 	Write out the trace, and de-allocate it.
+//----------------------------------------------------------------------
+
+Trace::~Trace()
+{
+    Export();
+    delete [] events;
+}
+
+//----------------------------------------------------------------------
+// PrintName
+// 	Write a name as a JSON string.
+//----------------------------------------------------------------------
+
+static void
+PrintName(FILE *file, const char *name)
+{
+    putc('"', file);
+    for (; (name != NULL) && (*name != '\0'); name++) {
+	if ((*name == '"') || (*name == '\\'))
+	    putc('\\', file);
+	if ((unsigned char)*name >= ' ')
+	    putc(*name, file);
+    }
+    putc('"', file);
+}
+
+//----------------------------------------------------------------------
+// PrintTrackName
+// 	Write the event that names a track.
+//----------------------------------------------------------------------
+
+static void
+PrintTrackName(FILE *file, int track, const char *name, int number)
+{
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+	    "\"tid\":%d,\"args\":{\"name\":\"%s", kernel->hostName, track,
+	    name);
+    if (number >= 0)
+	fprintf(file, " %d", number);
+    fprintf(file, "\"}},\n");
+}
+
+//----------------------------------------------------------------------
+// Trace::Export
+// 	Write the events kept out to the trace file, oldest first.  A
+//	thread switch ends the slice of the thread that was running on
+//	that CPU, and begins one for the thread now running.  If the
+//	oldest events were overwritten, some slices have no beginning;
+//	the viewers ignore their ends.
+//----------------------------------------------------------------------
+
+void
+Trace::Export()
+{
+    FILE *file = fopen(fileName, "w");
+    int count = min(numEvents, TraceSize);
+    int pid = kernel->hostName;
+
+    if (file == NULL) {
+	cerr << "Cannot write trace " << fileName << "\n";
+	return;
+    }
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (int i = 0; i < kernel->stats->numCpus; i++)
+	PrintTrackName(file, i, "CPU", i);
+    PrintTrackName(file, InterruptTrack, "interrupts", -1);
+    PrintTrackName(file, DiskTrack, "disk", -1);
+
+    for (int i = 0; i < count; i++) {
+	TraceEvent *event = &events[(next - count + i) & (TraceSize - 1)];
+	int when = event->when;
+
+	switch (event->kind) {
+	  case TraceSwitch:
+	    fprintf(file, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%d},\n",
+		    pid, event->track, when);
+	    fprintf(file, "{\"name\":");
+	    PrintName(file, event->name);
+	    fprintf(file, ",\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%d},\n",
+		    pid, event->track, when);
+	    break;
+	  case TraceInterrupt:
+	    fprintf(file, "{\"name\":");
+	    PrintName(file, event->name);
+	    fprintf(file, ",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,"
+		    "\"ts\":%d},\n", pid, InterruptTrack, when);
+	    break;
+	  case TraceDiskStart:
+	    fprintf(file, "{\"name\":");
+	    PrintName(file, event->name);
+	    fprintf(file, ",\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%d,"
+		    "\"args\":{\"sector\":%d}},\n", pid, DiskTrack, when,
+		    event->arg);
+	    break;
+	  case TraceDiskDone:
+	    fprintf(file, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%d},\n",
+		    pid, DiskTrack, when);
+	    break;
+	  case TraceSyscallEnter:
+	    fprintf(file, "{\"name\":");
+	    PrintName(file, event->name);
+	    fprintf(file, ",\"ph\":\"B\",\"pid\":%d,\"tid\":%d,\"ts\":%d},\n",
+		    pid, SyscallTrack + event->track, when);
+	    break;
+	  case TraceSyscallExit:
+	    fprintf(file, "{\"ph\":\"E\",\"pid\":%d,\"tid\":%d,\"ts\":%d},\n",
+		    pid, SyscallTrack + event->track, when);
+	    break;
+	}
+    }
+    // a last event, so that no comma is left dangling
+    fprintf(file, "{\"name\":\"halt\",\"ph\":\"i\",\"s\":\"g\",\"pid\":%d,"
+	    "\"tid\":0,\"ts\":%d}\n]}\n", pid, kernel->stats->totalTicks);
+    fclose(file);
+    if (numEvents > TraceSize)
+	cerr << "Trace kept the last " << TraceSize << " of " << numEvents
+	     << " events\n";
+}
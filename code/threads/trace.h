@@ -0,0 +1,87 @@
+// trace.h
+//	Data structures for tracing what the kernel does, cheaply enough
+//	to leave on: thread switches, interrupts, disk requests and
+//	system calls are recorded, with the simulated time, in a
+//	fixed-size circular buffer, and written out when Nachos halts, as
+//	a Chrome trace (JSON) that chrome://tracing or Perfetto can show
+//	as a timeline.
+//
+//	Recording an event costs a few stores: no formatting and no
+//	output, so tracing does not change the timing being traced.  When
+//	the buffer fills, the oldest events are overwritten.
+//
+//	Names recorded must outlive the trace: string constants, and the
+//	names of threads.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "copyright.h"
+#include "utility.h"
+
+#define TraceSize	65536	// events kept; a power of 2
+
+// The kinds of event traced
+
+enum TraceKind { TraceSwitch,		// a thread starts running on a CPU
+		 TraceInterrupt,	// an interrupt handler is called
+		 TraceDiskStart,	// the disk starts a request
+		 TraceDiskDone,		// and finishes it
+		 TraceSyscallEnter,	// a thread makes a system call
+		 TraceSyscallExit };	// and it returns
+
+// The following class defines one event traced.
+
+class TraceEvent {
+  public:
+    int when;			// simulated time
+    TraceKind kind;
+    int track;			// where it is shown: the CPU, or the
+				// thread making a system call
+    const char *name;		// thread, interrupt or system call
+    int arg;			// first sector, for the disk
+};
+
+// The following class defines the trace of one run of Nachos.
+
+class Trace {
+  public:
+    Trace(char *fileName);	// Trace into a buffer, to be written to
+				// "fileName"
+    ~Trace();			// Write the trace out
+
+    void Record(int when, TraceKind kind, int track, const char *name,
+		int arg) {
+	TraceEvent *event = &events[next];
+
+	event->when = when;
+	event->kind = kind;
+	event->track = track;
+	event->name = name;
+	event->arg = arg;
+	next = (next + 1) & (TraceSize - 1);
+	numEvents++;
+    }				// Record an event
+
+  private:
+    char *fileName;		// where to write the trace
+    TraceEvent *events;		// circular buffer of events
+    int next;			// where the next event goes
+    int numEvents;		// events recorded, some maybe overwritten
+
+    void Export();		// write the events out, oldest first
+};
+
+// TRACE records an event, if tracing is on (-trace).
+
+#define TRACE(kind, track, name, arg)					\
+    if (kernel->trace != NULL) {					\
+	kernel->trace->Record(kernel->stats->totalTicks, kind, track,	\
+			      name, arg);				\
+    }
+
+#endif // TRACE_H
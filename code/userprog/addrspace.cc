@@ -20,65 +20,82 @@
 #include "addrspace.h"
 #include "machine.h"
 #include "noff.h"
+#include "tlbmanager.h"
+#include "frametable.h"
+#include "swapspace.h"
+#include "sharedtext.h"
+#include "execcache.h"
+#include "profiler.h"
+#include "synch.h"
+
+static int nextAsid = 1;		// address space ids given out so far
 
 //----------------------------------------------------------------------
-// SwapHeader
-// 	Do little endian to big endian conversion on the bytes in the 
-//	object file header, in case the file was generated on a little
-//	endian machine, and we're now running on a big endian machine.
+// EntryPage, HashPage, DeleteEntry
+// 	Helper functions for hashed page tables, from virtual pages to
+//	page table entries.
 //----------------------------------------------------------------------
 
-static void 
-SwapHeader (NoffHeader *noffH)
+static int
+EntryPage(TranslationEntry *pte)
 {
-    noffH->noffMagic = WordToHost(noffH->noffMagic);
-    noffH->code.size = WordToHost(noffH->code.size);
-    noffH->code.virtualAddr = WordToHost(noffH->code.virtualAddr);
-    noffH->code.inFileAddr = WordToHost(noffH->code.inFileAddr);
-#ifdef RDATA
-    noffH->readonlyData.size = WordToHost(noffH->readonlyData.size);
-    noffH->readonlyData.virtualAddr = 
-           WordToHost(noffH->readonlyData.virtualAddr);
-    noffH->readonlyData.inFileAddr = 
-           WordToHost(noffH->readonlyData.inFileAddr);
-#endif 
-    noffH->initData.size = WordToHost(noffH->initData.size);
-    noffH->initData.virtualAddr = WordToHost(noffH->initData.virtualAddr);
-    noffH->initData.inFileAddr = WordToHost(noffH->initData.inFileAddr);
-    noffH->uninitData.size = WordToHost(noffH->uninitData.size);
-    noffH->uninitData.virtualAddr = WordToHost(noffH->uninitData.virtualAddr);
-    noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
+    return pte->virtualPage;
+}
 
-#ifdef RDATA
-    DEBUG(dbgAddr, "code = " << noffH->code.size <<  
-                   " readonly = " << noffH->readonlyData.size <<
-                   " init = " << noffH->initData.size <<
-                   " uninit = " << noffH->uninitData.size << "\n");
-#endif
+static unsigned
+HashPage(int vpn)
+{
+    return (unsigned)vpn;
+}
+
+static void
+DeleteEntry(TranslationEntry *pte)
+{
+    delete pte;
+    kernel->stats->numPageEntries--;
 }
 
 //----------------------------------------------------------------------
 // AddrSpace::AddrSpace
 // 	Create an address space to run a user program.
-//	Set up the translation from program memory to physical 
-//	memory.  For now, this is really simple (1:1), since we are
-//	only uniprogramming, and we have a single unsegmented page table
+//	It has no memory yet: the page table is made by Load, once
+//	the size of the program is known, and each page gets a frame
+//	of its own, so that several programs can be in memory at once.
 //----------------------------------------------------------------------
 
 AddrSpace::AddrSpace()
 {
-    pageTable = new TranslationEntry[NumPhysPages];
-    for (int i = 0; i < NumPhysPages; i++) {
-	pageTable[i].virtualPage = i;	// for now, virt page # = phys page #
-	pageTable[i].physicalPage = i;
-	pageTable[i].valid = TRUE;
-	pageTable[i].use = FALSE;
-	pageTable[i].dirty = FALSE;
-	pageTable[i].readOnly = FALSE;  
+    image = NULL;
+    argc = 0;
+    argvAddr = 0;
+    argBytes = 0;
+    pageTable = NULL;
+    hashedTable = NULL;
+    swapSlot = NULL;
+    inSwap = NULL;
+    text = NULL;
+    for (int i = 0; i < MaxProcessFiles; i++) {
+	openFiles[i] = -1;
+    }
+    for (int i = 0; i < MaxMappedFiles; i++) {
+	mapped[i].file = NULL;
+    }
+    for (int i = 0; i < MaxUserThreads; i++) {
+	threads[i].thread = NULL;
+	threads[i].done = new Semaphore("thread exit", 0);
+	threads[i].stackPage = 0;
     }
-    
-    // zero out the entire address space
-    bzero(kernel->machine->mainMemory, MemorySize);
+    numThreads = 0;
+    numPages = 0;
+    imagePages = 0;
+    asid = nextAsid++;
+    spaceId = -1;
+    residentSet.resident = 0;
+    residentSet.quota = MinQuota;
+    residentSet.faults = 0;
+    residentSet.workingSet = 0;
+    residentSet.listed = FALSE;
+    profileId = -1;
 }
 
 //----------------------------------------------------------------------
@@ -88,7 +105,205 @@ AddrSpace::AddrSpace()
 
 AddrSpace::~AddrSpace()
 {
-   delete pageTable;
+   for (int i = 0; i < MaxMappedFiles; i++) {	// write back what changed
+	if (mapped[i].file != NULL) {
+	    Unmap(mapped[i].firstPage * PageSize);
+	}
+   }
+   if (kernel->tlbManager != NULL) {	// its entries would outlive it
+	kernel->tlbManager->Forget(asid);
+   }
+   kernel->scheduler->Forget(this);
+   kernel->frameTable->Release(this);
+   if (text != NULL) {
+	kernel->textTable->Put(text);
+   }
+   if (swapSlot != NULL) {
+	for (unsigned int i = 0; i < imagePages + MaxMappedPages; i++) {
+	    if (swapSlot[i] != -1) {
+		kernel->swapSpace->Free(swapSlot[i]);
+	    }
+	}
+	delete [] swapSlot;
+	delete [] inSwap;
+   }
+   delete [] pageTable;
+   if (hashedTable != NULL) {
+	hashedTable->Apply(DeleteEntry);
+	delete hashedTable;
+   }
+   if (image != NULL) {
+	kernel->execCache->Put(image);
+   }
+   for (int i = 0; i < MaxUserThreads; i++) {
+	delete threads[i].done;
+   }
+
+#ifndef FILESYS_STUB
+   for (int i = 0; i < MaxProcessFiles; i++) {	// close what is still open
+	if (openFiles[i] != -1) {
+	    kernel->fileSystem->Close(openFiles[i]);
+	}
+   }
+#endif
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddFile
+// 	Give the program a descriptor for entry "fileIndex" of the file
+//	system's open file table: the lowest one not in use.  Descriptors
+//	0 and 1 are the console (SysConsoleInput and SysConsoleOutput),
+//	so files start at 2.  Return -1 if all are in use.
+//----------------------------------------------------------------------
+
+OpenFileId
+AddrSpace::AddFile(int fileIndex)
+{
+    for (int i = 2; i < MaxProcessFiles; i++) {
+	if (openFiles[i] == -1) {
+	    openFiles[i] = fileIndex;
+	    return i;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FileIndex
+// 	Return the open file table entry named by descriptor "id", or -1
+//	if "id" is not an open file.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::FileIndex(OpenFileId id)
+{
+    if (id < 0 || id >= MaxProcessFiles) {
+	return -1;
+    }
+    return openFiles[id];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RemoveFile
+// 	Free descriptor "id", returning the open file table entry it
+//	named (for the caller to close), or -1 if it was not open.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::RemoveFile(OpenFileId id)
+{
+    int fileIndex = FileIndex(id);
+
+    if (fileIndex != -1) {
+	openFiles[id] = -1;
+    }
+    return fileIndex;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddThread
+// 	Give "thread", about to run the program, the lowest free slot,
+//	and return it, its ThreadId.  The first slot uses the stack the
+//	program was loaded with; any other gets a stack of its own the
+//	first time it is used.  Return -1 if all the slots are taken, or
+//	there is no room for a stack.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::AddThread(Thread *thread)
+{
+    for (int id = 0; id < MaxUserThreads; id++) {
+	if (threads[id].thread == NULL) {
+	    if ((id > 0) && (threads[id].stackPage == 0) && !AllocateStack(id)) {
+		return -1;
+	    }
+	    if (id == 0) {
+		spaceId = thread->getID();	// the program's first
+	    }
+	    threads[id].thread = thread;
+	    threads[id].exited = FALSE;
+	    threads[id].joined = FALSE;
+	    numThreads++;
+	    return id;
+	}
+    }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::StackTop
+// 	Return the initial stack pointer of a thread in slot "id": the
+//	end of its stack, less a bit, as InitRegisters does it.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::StackTop(int id)
+{
+    if (threads[id].stackPage == 0) {
+	return imagePages * PageSize - 16;
+    }
+    return (threads[id].stackPage + divRoundUp(UserStackSize, PageSize)) *
+	PageSize - 16;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::RemoveThread
+// 	Note that "thread" exited, with "exitCode", waking a thread
+//	waiting to join it.  Its slot is kept for the exit code until it
+//	is joined.  Return TRUE if it was the last thread running the
+//	program, which is over: the caller deletes the address space.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::RemoveThread(Thread *thread, int exitCode)
+{
+    int id = SlotOf(thread);
+
+    ASSERT(id != -1);
+    threads[id].exited = TRUE;
+    threads[id].exitCode = exitCode;
+    threads[id].done->V();
+    return --numThreads == 0;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::JoinThread
+// 	Wait for the thread in slot "id" to exit, then free the slot and
+//	put its exit code in "exitCode".  Return FALSE if there is no
+//	thread in the slot, another thread is joining it already, or it
+//	is the caller.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::JoinThread(int id, int *exitCode)
+{
+    if ((id < 0) || (id >= MaxUserThreads) || (threads[id].thread == NULL) ||
+	    threads[id].joined ||
+	    (!threads[id].exited && (threads[id].thread == kernel->currentThread))) {
+	return FALSE;
+    }
+    threads[id].joined = TRUE;
+    threads[id].done->P();
+    *exitCode = threads[id].exitCode;
+    threads[id].thread = NULL;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::SlotOf
+// 	Return the slot of "thread", which has not exited, or -1 if it
+//	is not running the program.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::SlotOf(Thread *thread)
+{
+    for (int id = 0; id < MaxUserThreads; id++) {
+	if ((threads[id].thread == thread) && !threads[id].exited) {
+	    return id;
+	}
+    }
+    return -1;
 }
 
 
@@ -96,8 +311,7 @@ AddrSpace::~AddrSpace()
 // AddrSpace::Load
 // 	Load a user program into memory from a file.
 //
-//	Assumes that the page table has been initialized, and that
-//	the object code file is in NOFF format.
+//	Assumes that the object code file is in NOFF format.
 //
 //	"fileName" is the file containing the object code to load into memory
 //----------------------------------------------------------------------
@@ -105,20 +319,18 @@ AddrSpace::~AddrSpace()
 bool 
 AddrSpace::Load(char *fileName) 
 {
-    OpenFile *executable = kernel->fileSystem->Open(fileName);
-    NoffHeader noffH;
     unsigned int size;
+    OpenFile *executable = kernel->fileSystem->Open(fileName);
 
     if (executable == NULL) {
 	cerr << "Unable to open file " << fileName << "\n";
 	return FALSE;
     }
-
-    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
-    if ((noffH.noffMagic != NOFFMAGIC) && 
-		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
-    	SwapHeader(&noffH);
-    ASSERT(noffH.noffMagic == NOFFMAGIC);
+    image = kernel->execCache->Get(executable);	// read, unless cached
+    delete executable;
+    noffH = image->noffH;
+    if (kernel->profiler != NULL)
+	profileId = kernel->profiler->AddProgram(fileName);
 
 #ifdef RDATA
 // how big is address space?
@@ -133,44 +345,394 @@ AddrSpace::Load(char *fileName)
 						// to leave room for the stack
 #endif
     numPages = divRoundUp(size, PageSize);
+    imagePages = numPages;
     size = numPages * PageSize;
 
-    ASSERT(numPages <= NumPhysPages);		// check we're not trying
-						// to run anything too big --
-						// at least until we have
-						// virtual memory
-
     DEBUG(dbgAddr, "Initializing address space: " << numPages << ", " << size);
+    if (kernel->hashedPageTables) {
+	hashedTable = new OpenHashTable<int, TranslationEntry *>(EntryPage,
+								 HashPage);
+    } else {
+	pageTable = new TranslationEntry[numPages + MaxMappedPages];
+					// with room for mapped files
+    }
+    ClearEntries(0, numPages);
 
-// then, copy in the code and data segments into memory
-// Note: this code assumes that virtual address = physical address
-    if (noffH.code.size > 0) {
-        DEBUG(dbgAddr, "Initializing code segment.");
-	DEBUG(dbgAddr, noffH.code.virtualAddr << ", " << noffH.code.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.code.virtualAddr]), 
-			noffH.code.size, noffH.code.inFileAddr);
+// then, make room for the pages: frames for all of them, the code
+// shared with other address spaces running the same program, or with
+// demand paging, swap slots.  Nothing is copied in yet; each page is
+// filled from the program's image, or zeroed, on its first reference.
+    if (kernel->swapSpace != NULL) {
+	if (!AllocateSwap()) {
+	    cerr << "Not enough swap space for " << fileName << "\n";
+	    return FALSE;
+	}
+	return TRUE;
     }
-    if (noffH.initData.size > 0) {
-        DEBUG(dbgAddr, "Initializing data segment.");
-	DEBUG(dbgAddr, noffH.initData.virtualAddr << ", " << noffH.initData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.initData.virtualAddr]),
-			noffH.initData.size, noffH.initData.inFileAddr);
+#ifndef FILESYS_STUB
+    ShareText();
+#endif
+    if (!kernel->frameTable->Allocate(this, numPages)) {
+	cerr << "Not enough memory for " << fileName << "\n";
+	return FALSE;
     }
+    return TRUE;			// success
+}
 
-#ifdef RDATA
-    if (noffH.readonlyData.size > 0) {
-        DEBUG(dbgAddr, "Initializing read only data segment.");
-	DEBUG(dbgAddr, noffH.readonlyData.virtualAddr << ", " << noffH.readonlyData.size);
-        executable->ReadAt(
-		&(kernel->machine->mainMemory[noffH.readonlyData.virtualAddr]),
-			noffH.readonlyData.size, noffH.readonlyData.inFileAddr);
+//----------------------------------------------------------------------
+// AddrSpace::SetArguments
+// 	Copy the "argc" strings of "argv" to the top of the stack of the
+//	loaded program, followed by the array of their addresses, for
+//	InitRegisters to pass to main() -- the stack starts below them.
+//
+//	Return FALSE if they take more than half the stack, or cannot be
+//	written.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::SetArguments(int argc, char **argv)
+{
+    int top = numPages * PageSize - 16;
+    int sp = top;
+    int addr[MaxExecArguments];
+
+    ASSERT(argc <= MaxExecArguments);
+    for (int i = argc - 1; i >= 0; i--) {
+	int length = strlen(argv[i]) + 1;
+
+	sp -= length;
+	if ((top - sp > UserStackSize / 2) || !CopyOut(sp, argv[i], length)) {
+	    return FALSE;
+	}
+	addr[i] = WordToMachine(sp);
+    }
+    sp -= sp % 4;			// word aligned
+    sp -= argc * 4;
+    if ((top - sp > UserStackSize / 2) ||
+		!CopyOut(sp, (char *)addr, argc * 4)) {
+	return FALSE;
     }
+    this->argc = argc;
+    argvAddr = sp;
+    argBytes = top - sp;
+    return TRUE;
+}
+
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// AddrSpace::ShareText
+// 	Map the pages that are only code -- not the last one, say, if
+//	the data segment starts in it -- to the frames shared by every
+//	address space running the same executable, read-only.  If there
+//	are no frames for them, they are left to get frames of their own.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ShareText()
+{
+    int firstPage = divRoundUp(noffH.code.virtualAddr, PageSize);
+    int endPage = (noffH.code.virtualAddr + noffH.code.size) / PageSize;
+
+    if (endPage <= firstPage) {
+	return;
+    }
+    text = kernel->textTable->Get(image->sector, firstPage,
+				  endPage - firstPage);
+    if (text == NULL) {
+	return;
+    }
+    for (int i = 0; i < text->numPages; i++) {
+	pageTable[firstPage + i].physicalPage = text->frames[i];
+	pageTable[firstPage + i].readOnly = TRUE;
+    }
+}
 #endif
 
-    delete executable;			// close file
-    return TRUE;			// success
+#ifndef FILESYS_STUB
+//----------------------------------------------------------------------
+// AddrSpace::Fork
+// 	Return a new address space that is a copy of this one, for a
+//	child program that goes on from where this one is.  Its memory is
+//	this one's, copy-on-write (see FrameTable::Duplicate): only the
+//	page table is copied now.  It has the same open files, shares the
+//	program's image, to fill the pages neither has touched yet from,
+//	and has its own copy of the files mapped: what it changes in them is
+//	written back to the file by it alone.  The thread forking goes on
+//	in the child's first slot, on the stack it was using.
+//
+//	Return NULL if there are not enough free frames, or with demand
+//	paging, where frames are not shared.
+//----------------------------------------------------------------------
+
+AddrSpace *
+AddrSpace::Fork()
+{
+    AddrSpace *child;
+    int self;
+
+    if (kernel->swapSpace != NULL) {
+	return NULL;
+    }
+    child = new AddrSpace();
+    child->numPages = numPages;
+    child->imagePages = imagePages;
+    child->noffH = noffH;
+    child->profileId = profileId;
+    child->image = kernel->execCache->Share(image);
+    child->pageTable = new TranslationEntry[imagePages + MaxMappedPages];
+    for (unsigned int i = 0; i < numPages; i++) {
+	child->pageTable[i] = pageTable[i];
+    }
+    for (int i = 0; i < MaxMappedFiles; i++) {
+	child->mapped[i] = mapped[i];
+	if (mapped[i].file != NULL) {
+	    child->mapped[i].file = new OpenFile(mapped[i].file->HeaderSector());
+	}
+    }
+    for (int id = 0; id < MaxUserThreads; id++) {
+	child->threads[id].stackPage = threads[id].stackPage;
+    }
+    self = SlotOf(kernel->currentThread);	// runs in the child's first
+    if (self > 0) {				// slot, on the same stack
+	child->threads[0].stackPage = threads[self].stackPage;
+	child->threads[self].stackPage = 0;
+    }
+    if (text != NULL) {
+	child->text = kernel->textTable->Get(text->sector, text->firstPage,
+					     text->numPages);
+    }
+    if (!kernel->frameTable->Duplicate(this, child, numPages)) {
+	for (unsigned int i = 0; i < numPages; i++) {
+	    child->pageTable[i].physicalPage = -1;	// not the child's
+	    child->pageTable[i].valid = FALSE;
+	}
+	delete child;
+	return NULL;
+    }
+    for (int i = 0; i < MaxProcessFiles; i++) {
+	if (openFiles[i] != -1) {
+	    child->openFiles[i] = kernel->fileSystem->Duplicate(openFiles[i]);
+	}
+    }
+    return child;
+}
+#endif
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateSwap
+// 	For demand paging, give every page of the program a slot in the
+//	swap area, to be written if the page is replaced once changed.
+//
+//	Return FALSE if the swap area is too full.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::AllocateSwap()
+{
+    swapSlot = new int[imagePages + MaxMappedPages];	// with room for
+    inSwap = new bool[imagePages + MaxMappedPages];	// thread stacks
+    for (unsigned int i = 0; i < imagePages + MaxMappedPages; i++) {
+	swapSlot[i] = -1;
+	inSwap[i] = FALSE;
+    }
+    for (unsigned int i = 0; i < numPages; i++) {
+	swapSlot[i] = kernel->swapSpace->Allocate();
+	if (swapSlot[i] == -1) {
+	    return FALSE;		// the destructor frees the others
+	}
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPage
+// 	Bring virtual page "vpn" into frame "frame", and make it valid.
+//	Called by the frame table on a page fault.
+//
+//	A page of a mapped file is read from the file, zeroes past its
+//	end.  A page that was written to swap comes back from there;
+//	otherwise this is its first reference, and it starts out as the
+//	executable says: code and data from its image, zeroes
+//	elsewhere (the uninitialized data and the stack).  Shared code may
+//	have been read already, by another address space.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadPage(unsigned int vpn, int frame)
+{
+    TranslationEntry *pte = PageEntry(vpn);
+    char *into = &kernel->machine->mainMemory[frame * PageSize];
+    int textPage = (text != NULL) ? (int)vpn - text->firstPage : -1;
+    MappedFile *mapping = MappingOf(vpn);
+
+    ASSERT((pte == NULL) || !pte->valid);
+    if (mapping != NULL) {
+	bzero(into, PageSize);
+	mapping->file->ReadAt(into, PageSize,
+			      (vpn - mapping->firstPage) * PageSize);
+    } else if ((swapSlot != NULL) && inSwap[vpn]) {
+	kernel->swapSpace->ReadPage(swapSlot[vpn], into);
+    } else if ((textPage >= 0) && (textPage < text->numPages)) {
+	if (!text->loaded[textPage]) {
+	    image->ReadPage(vpn, into);
+	    text->loaded[textPage] = TRUE;
+	}
+    } else {
+	image->ReadPage(vpn, into);
+    }
+    PageLoaded(vpn, frame);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageLoaded
+// 	Page "vpn" has been copied into "frame": make it valid.  With a
+//	hashed page table, this is when it gets an entry.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::PageLoaded(unsigned int vpn, int frame)
+{
+    TranslationEntry *pte = MakeEntry(vpn);
+
+    pte->physicalPage = frame;
+    pte->use = TRUE;		// it is about to be
+    pte->dirty = FALSE;		// same as where it came from
+    pte->valid = TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ClusterPages
+// 	Return how many pages, from "vpn" -- which is not in memory --
+//	on, and at most "maxPages", are not in memory and come from the
+//	same place, so that they can be brought in along with it: pages
+//	of the same mapped file, pages in consecutive swap slots, which
+//	are one disk request, or pages of the program's code and data.
+//	Pages that start out as zeroes are not worth bringing in ahead.
+//
+//	Only with demand paging, where pages get frames on a fault.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::ClusterPages(unsigned int vpn, int maxPages)
+{
+    MappedFile *mapping = MappingOf(vpn);
+    int imageEnd = max(noffH.code.virtualAddr + noffH.code.size,
+		       noffH.initData.virtualAddr + noffH.initData.size);
+    int n;
+
+#ifdef RDATA
+    imageEnd = max(imageEnd,
+		   noffH.readonlyData.virtualAddr + noffH.readonlyData.size);
+#endif
+    if (swapSlot == NULL) {
+	return 1;
+    }
+    for (n = 1; n < maxPages; n++) {
+	unsigned int next = vpn + n;
+	TranslationEntry *pte = PageEntry(next);
+
+	if (!HasPage(next) ||
+		((pte != NULL) && (pte->valid || (pte->physicalPage != -1))) ||
+		(MappingOf(next) != mapping)) {
+	    break;
+	}
+	if (mapping != NULL) {
+	    continue;
+	}
+	if (inSwap[vpn]) {
+	    if (!inSwap[next] || (swapSlot[next] != swapSlot[vpn] + n)) {
+		break;
+	    }
+	} else if (inSwap[next] || ((int)(next * PageSize) >= imageEnd)) {
+	    break;
+	}
+    }
+    return n;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::LoadPages
+// 	Bring the "count" pages from "vpn" on, as ClusterPages allows,
+//	into "frames", and make them valid: pages of a mapped file with
+//	one read of the file, pages from swap with one disk request, and
+//	code and data a page at a time, from the program's image.
+//	Called by the frame table on a page fault.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::LoadPages(unsigned int vpn, int count, int *frames)
+{
+    MappedFile *mapping = MappingOf(vpn);
+    char *memory = kernel->machine->mainMemory;
+
+    if ((count > 1) && (mapping != NULL)) {
+	char *buffer = new char[count * PageSize];
+
+	bzero(buffer, count * PageSize);
+	mapping->file->ReadAt(buffer, count * PageSize,
+			      (vpn - mapping->firstPage) * PageSize);
+	for (int i = 0; i < count; i++) {
+	    memcpy(&memory[frames[i] * PageSize], &buffer[i * PageSize],
+		   PageSize);
+	    PageLoaded(vpn + i, frames[i]);
+	}
+	delete [] buffer;
+    } else if ((count > 1) && inSwap[vpn]) {
+	char **into = new char *[count];
+
+	for (int i = 0; i < count; i++) {
+	    into[i] = &memory[frames[i] * PageSize];
+	}
+	kernel->swapSpace->ReadPages(swapSlot[vpn], count, into);
+	for (int i = 0; i < count; i++) {
+	    PageLoaded(vpn + i, frames[i]);
+	}
+	delete [] into;
+    } else {
+	for (int i = 0; i < count; i++) {
+	    LoadPage(vpn + i, frames[i]);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::EvictPage
+// 	Take virtual page "vpn" out of its frame, which is to be given
+//	to another page, writing it to its swap slot if it has been
+//	changed, or if it is a page of a mapped file, back to the file.
+//	Called by the frame table.
+//
+//	The page is made invalid before it is written, so that, should
+//	it be touched meanwhile, the fault waits until it is safe in swap.
+//	With a hashed page table, its entry then goes.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::EvictPage(unsigned int vpn)
+{
+    TranslationEntry *pte = PageEntry(vpn);
+
+    ASSERT(pte->valid);
+    if (kernel->tlbManager != NULL) {	// brings its dirty bit back
+	kernel->tlbManager->Drop(asid, vpn);
+    }
+    pte->valid = FALSE;
+    kernel->machine->FlushTranslations();
+    if (pte->dirty) {
+	char *from = &kernel->machine->mainMemory[pte->physicalPage * PageSize];
+	MappedFile *mapping = MappingOf(vpn);
+
+	if (mapping != NULL) {
+	    mapping->file->WriteAt(from, PageSize,
+				   (vpn - mapping->firstPage) * PageSize);
+	} else {
+	    kernel->swapSpace->WritePage(swapSlot[vpn], from);
+	    inSwap[vpn] = TRUE;
+	    kernel->stats->numPageOuts++;
+	}
+    }
+    pte->physicalPage = -1;
+    DropEntry(vpn);
 }
 
 //----------------------------------------------------------------------
@@ -187,9 +749,11 @@ AddrSpace::Execute(char* fileName)
 {
 
     kernel->currentThread->space = this;
+    (void) AddThread(kernel->currentThread);	// the first, in slot 0
 
+    kernel->scheduler->LoadUserState(kernel->currentThread);
+					// load page table register
     this->InitRegisters();		// set the initial register values
-    this->RestoreState();		// load page table register
 
     kernel->machine->Run();		// jump to the user progam
 
@@ -205,8 +769,8 @@ AddrSpace::Execute(char* fileName)
 //
 // 	We write these directly into the "machine" registers, so
 //	that we can immediately jump to user code.  Note that these
-//	will be saved/restored into the currentThread->userRegisters
-//	when this thread is context switched out.
+//	will be saved into the currentThread->userRegisters when another
+//	user thread is switched to (see Scheduler::LoadUserState).
 //----------------------------------------------------------------------
 
 void
@@ -229,10 +793,14 @@ AddrSpace::InitRegisters()
     machine->WriteRegister(NextPCReg, 4);
 
    // Set the stack register to the end of the address space, where we
-   // allocated the stack; but subtract off a bit, to make sure we don't
-   // accidentally reference off the end!
-    machine->WriteRegister(StackReg, numPages * PageSize - 16);
-    DEBUG(dbgAddr, "Initializing stack pointer: " << numPages * PageSize - 16);
+   // allocated the stack, below any arguments put there; but subtract
+   // off a bit, to make sure we don't accidentally reference off the end!
+    machine->WriteRegister(StackReg, numPages * PageSize - argBytes - 16);
+    DEBUG(dbgAddr, "Initializing stack pointer: " << numPages * PageSize - argBytes - 16);
+
+    // main(argc, argv)
+    machine->WriteRegister(4, argc);
+    machine->WriteRegister(5, argvAddr);
 }
 
 //----------------------------------------------------------------------
@@ -251,13 +819,327 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine where to find the page table (so it
+//	must forget what it knows of the last one); or, with a TLB,
+//	which of its entries are ours.  The TLB is not flushed: it may
+//	still hold our entries from last time.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState() 
 {
-    kernel->machine->pageTable = pageTable;
-    kernel->machine->pageTableSize = numPages;
+    if (kernel->machine->tlb != NULL) {
+	kernel->machine->asid = asid;
+    } else {
+	kernel->machine->pageTable = pageTable;
+	kernel->machine->pageTableSize = numPages;
+	kernel->machine->FlushTranslations();
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PageEntry
+// 	Return the page table entry for virtual page "vpn", or NULL if
+//	the page is not in the address space (see HasPage).  Used to load
+//	the TLB.
+//
+//	A hashed page table has entries only for the pages in memory, or
+//	being brought in or written out; it is NULL for the rest too, and
+//	a miss in the TLB for one of them is a page fault.  The memory
+//	the table takes thus goes with how much of the program is in
+//	memory, rather than with how big its address space is.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+AddrSpace::PageEntry(unsigned int vpn)
+{
+    TranslationEntry *pte;
+
+    if (!HasPage(vpn)) {
+	return NULL;
+    }
+    if (hashedTable != NULL) {
+	return hashedTable->Find(vpn, &pte) ? pte : NULL;
+    }
+    return &pageTable[vpn];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::HasPage
+// 	Return TRUE if virtual page "vpn" is in the address space: not
+//	beyond its end, nor between mapped files, where one was unmapped.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::HasPage(unsigned int vpn)
+{
+    return (vpn < numPages) &&
+	((vpn < imagePages) || (MappingOf(vpn) != NULL) || IsStackPage(vpn));
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MakeEntry
+// 	Return the page table entry for virtual page "vpn", which is in
+//	the address space, first adding one to a hashed page table if it
+//	has none: not in memory, with no frame.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+AddrSpace::MakeEntry(unsigned int vpn)
+{
+    TranslationEntry *pte = PageEntry(vpn);
+
+    if (pte == NULL) {
+	ASSERT((hashedTable != NULL) && HasPage(vpn));
+	pte = new TranslationEntry;
+	pte->virtualPage = vpn;
+	pte->physicalPage = -1;
+	pte->valid = FALSE;
+	pte->use = FALSE;
+	pte->dirty = FALSE;
+	pte->readOnly = FALSE;
+	hashedTable->Insert(pte);
+	kernel->stats->numPageEntries++;
+	kernel->stats->maxPageEntries = max(kernel->stats->maxPageEntries,
+					    kernel->stats->numPageEntries);
+    }
+    return pte;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::DropEntry
+// 	Virtual page "vpn" is no longer in memory, nor has a frame: drop
+//	its entry from a hashed page table.  Nothing may still point to
+//	it -- the TLB entry loaded from it has been dropped already.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::DropEntry(unsigned int vpn)
+{
+    TranslationEntry *pte;
+
+    if ((hashedTable == NULL) || !hashedTable->Find(vpn, &pte)) {
+	return;
+    }
+    ASSERT(!pte->valid && (pte->physicalPage == -1));
+    hashedTable->Remove(vpn);
+    DeleteEntry(pte);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ClearEntries
+// 	Make the "count" pages from "firstPage" on, new to the address
+//	space, not in memory, with no frame yet.  A hashed page table
+//	has no entries for them already.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::ClearEntries(unsigned int firstPage, unsigned int count)
+{
+    if (pageTable == NULL) {
+	return;
+    }
+    for (unsigned int vpn = firstPage; vpn < firstPage + count; vpn++) {
+	pageTable[vpn].virtualPage = vpn;
+	pageTable[vpn].physicalPage = -1;
+	pageTable[vpn].valid = FALSE;
+	pageTable[vpn].use = FALSE;
+	pageTable[vpn].dirty = FALSE;
+	pageTable[vpn].readOnly = FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MappingOf
+// 	Return the mapped file whose bytes virtual page "vpn" holds, or
+//	NULL if it is not a page of one.
+//----------------------------------------------------------------------
+
+MappedFile *
+AddrSpace::MappingOf(unsigned int vpn)
+{
+    for (int i = 0; i < MaxMappedFiles; i++) {
+	MappedFile *mapping = &mapped[i];
+
+	if ((mapping->file != NULL) && (vpn >= mapping->firstPage) &&
+		(vpn < mapping->firstPage + mapping->numPages)) {
+	    return mapping;
+	}
+    }
+    return NULL;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsStackPage
+// 	Return TRUE if virtual page "vpn" is in a stack given to a thread
+//	slot, beyond the end of the program.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::IsStackPage(unsigned int vpn)
+{
+    int stackPages = divRoundUp(UserStackSize, PageSize);
+
+    for (int id = 0; id < MaxUserThreads; id++) {
+	if ((threads[id].stackPage != 0) && (vpn >= threads[id].stackPage) &&
+		(vpn < threads[id].stackPage + stackPages)) {
+	    return TRUE;
+	}
+    }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateStack
+// 	Give slot "id" a stack, in the pages after the last ones in use,
+//	as Map does for a file.  Its pages start out zero, like those of
+//	the program's own stack: with demand paging each gets a swap
+//	slot, to be paged in from the first time it is written out;
+//	otherwise they get frames now.
+//
+//	Return FALSE if there is no room for it in the address space, in
+//	memory, or in the swap area.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::AllocateStack(int id)
+{
+    unsigned int firstPage = numPages;
+    unsigned int count = divRoundUp(UserStackSize, PageSize);
+
+    if (firstPage + count > imagePages + MaxMappedPages) {
+	return FALSE;
+    }
+    ClearEntries(firstPage, count);
+    for (unsigned int vpn = firstPage; vpn < firstPage + count; vpn++) {
+	if (swapSlot != NULL) {
+	    swapSlot[vpn] = kernel->swapSpace->Allocate();
+	    inSwap[vpn] = FALSE;
+	    if (swapSlot[vpn] == -1) {
+		for (unsigned int i = firstPage; i < vpn; i++) {
+		    kernel->swapSpace->Free(swapSlot[i]);
+		    swapSlot[i] = -1;
+		}
+		return FALSE;
+	    }
+	}
+    }
+    numPages = firstPage + count;
+    if ((swapSlot == NULL) && !kernel->frameTable->Allocate(this, numPages)) {
+	numPages = firstPage;
+	return FALSE;
+    }
+    threads[id].stackPage = firstPage;
+    DEBUG(dbgAddr, "Thread stack of " << count << " pages at page " << firstPage);
+    RestoreState();			// the page table is longer
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Map
+// 	Map "file" into the address space, in the pages after the last
+//	ones in use, and return the address of its first byte.  The file
+//	is the address space's from now on, until Unmap.
+//
+//	Its pages are read from the file on first touch, like those of
+//	the program are from the executable, and written back to it if
+//	they were changed: when they are replaced, with demand paging,
+//	and when the file is unmapped.  Without demand paging they get
+//	frames now, as the program's own pages did.
+//
+//	Return -1 if the file is empty, too many files are mapped, or
+//	there is no room for it in the address space or in memory.
+//----------------------------------------------------------------------
+
+int
+AddrSpace::Map(OpenFile *file)
+{
+    unsigned int firstPage = numPages;
+    unsigned int count = divRoundUp(file->Length(), PageSize);
+    MappedFile *mapping = NULL;
+
+    for (int i = 0; (i < MaxMappedFiles) && (mapping == NULL); i++) {
+	if (mapped[i].file == NULL) {
+	    mapping = &mapped[i];
+	}
+    }
+    if ((mapping == NULL) || (count == 0) ||
+	    (firstPage + count > imagePages + MaxMappedPages)) {
+	return -1;
+    }
+
+    ClearEntries(firstPage, count);
+    mapping->file = file;
+    mapping->firstPage = firstPage;
+    mapping->numPages = count;
+    numPages = firstPage + count;
+    if ((kernel->swapSpace == NULL) &&
+	    !kernel->frameTable->Allocate(this, numPages)) {
+	mapping->file = NULL;
+	numPages = firstPage;
+	return -1;
+    }
+    DEBUG(dbgAddr, "Mapping a file of " << count << " pages at page " << firstPage);
+    RestoreState();			// the page table is longer
+    return firstPage * PageSize;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Unmap
+// 	Unmap the file mapped at "virtAddr" by Map: write the pages of it
+//	that were changed back to the file, free their frames, and close
+//	it.  The address space ends after the last file still mapped.
+//
+//	Return FALSE if there is no file mapped there.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::Unmap(int virtAddr)
+{
+    MappedFile *mapping = NULL;
+
+    for (int i = 0; i < MaxMappedFiles; i++) {
+	if ((mapped[i].file != NULL) &&
+		(mapped[i].firstPage * PageSize == (unsigned) virtAddr)) {
+	    mapping = &mapped[i];
+	}
+    }
+    if (mapping == NULL) {
+	return FALSE;
+    }
+
+    for (unsigned int vpn = mapping->firstPage;
+	    vpn < mapping->firstPage + mapping->numPages; vpn++) {
+	TranslationEntry *pte = PageEntry(vpn);
+
+	if (kernel->tlbManager != NULL) {	// brings its dirty bit back
+	    kernel->tlbManager->Drop(asid, vpn);
+	}
+	if ((pte != NULL) && pte->valid && pte->dirty) {
+	    int frame = kernel->frameTable->Pin(this, vpn, FALSE);
+
+	    mapping->file->WriteAt(&kernel->machine->mainMemory[frame * PageSize],
+				   PageSize, (vpn - mapping->firstPage) * PageSize);
+	    kernel->frameTable->Unpin(frame);
+	}
+	kernel->frameTable->Free(this, vpn);
+    }
+    DEBUG(dbgAddr, "Unmapping the file at page " << mapping->firstPage);
+    delete mapping->file;
+    mapping->file = NULL;
+
+    numPages = imagePages;
+    for (int i = 0; i < MaxMappedFiles; i++) {
+	if (mapped[i].file != NULL) {
+	    numPages = max(numPages, mapped[i].firstPage + mapped[i].numPages);
+	}
+    }
+    for (int id = 0; id < MaxUserThreads; id++) {
+	if (threads[id].stackPage != 0) {
+	    numPages = max(numPages, threads[id].stackPage +
+			   divRoundUp(UserStackSize, PageSize));
+	}
+    }
+    return TRUE;
 }
 
 
@@ -277,11 +1159,15 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     unsigned int      vpn    = vaddr / PageSize;
     unsigned int      offset = vaddr % PageSize;
 
-    if(vpn >= numPages) {
+    if(!HasPage(vpn)) {
         return AddressErrorException;
     }
 
-    pte = &pageTable[vpn];
+    pte = PageEntry(vpn);
+
+    if(pte == NULL || !pte->valid) {
+        return PageFaultException;
+    }
 
     if(isReadWrite && pte->readOnly) {
         return ReadOnlyException;
@@ -311,6 +1197,157 @@ AddrSpace::Translate(unsigned int vaddr, unsigned int *paddr, int isReadWrite)
     return NoException;
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::UserAddress
+// 	Return where user address "virtAddr" is in the machine's memory,
+//	for the kernel to copy to or from, bringing its page in if need
+//	be, or if "writing" to a page shared copy-on-write, copying it.
+//	The pointer is good up to the end of the page, until the page is
+//	next brought in.
+//
+//	Return NULL if the address is not in the address space, or
+//	"writing" and it is read-only.
+//----------------------------------------------------------------------
 
+char *
+AddrSpace::UserAddress(int virtAddr, bool writing)
+{
+    unsigned int physAddr;
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    ExceptionType result;
+    bool retry;
 
+    for (;;) {
+	result = Translate(virtAddr, &physAddr, writing);
+	if (result == NoException) {
+	    return &kernel->machine->mainMemory[physAddr];
+	}
+	if (result == PageFaultException) {
+	    retry = kernel->frameTable->PageIn(this, vpn);
+	} else if (result == ReadOnlyException) {
+	    retry = kernel->frameTable->CopyOnWrite(this, vpn);
+	} else {
+	    retry = FALSE;
+	}
+	if (!retry) {
+	    return NULL;
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::PinPage
+// 	Return where user address "virtAddr" is in the machine's memory,
+//	as UserAddress does, for the kernel to read or write the rest of
+//	its page in place, even while it waits for the disk: the page is
+//	kept in its frame until UnpinPage.
+//
+//	Return NULL if the address is not in the address space, or
+//	"writing" and it is read-only.
+//----------------------------------------------------------------------
+
+char *
+AddrSpace::PinPage(int virtAddr, bool writing)
+{
+    int frame = kernel->frameTable->Pin(this, (unsigned) virtAddr / PageSize,
+					writing);
+
+    if (frame == -1) {
+	return NULL;
+    }
+    return &kernel->machine->mainMemory[frame * PageSize +
+					(unsigned) virtAddr % PageSize];
+}
 
+//----------------------------------------------------------------------
+// AddrSpace::UnpinPage
+// 	The kernel is done with the page of "virtAddr", pinned by PinPage.
+//----------------------------------------------------------------------
+
+void
+AddrSpace::UnpinPage(int virtAddr)
+{
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+
+    kernel->frameTable->Unpin(PageEntry(vpn)->physicalPage);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyIn
+// AddrSpace::CopyOut
+// 	Copy "size" bytes between user address "virtAddr" and the kernel
+//	buffer "into" or "from", a page at a time.  Used for the buffers
+//	of system calls.
+//
+//	Return FALSE if some of the user bytes are not in the address
+//	space.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyIn(int virtAddr, char *into, int size)
+{
+    while (size > 0) {
+	int chunk = min(size, PageSize - (int)((unsigned) virtAddr % PageSize));
+	char *from = UserAddress(virtAddr, FALSE);
+
+	if (from == NULL) {
+	    return FALSE;
+	}
+	memcpy(into, from, chunk);
+	virtAddr += chunk;
+	into += chunk;
+	size -= chunk;
+    }
+    return TRUE;
+}
+
+bool
+AddrSpace::CopyOut(int virtAddr, char *from, int size)
+{
+    while (size > 0) {
+	int chunk = min(size, PageSize - (int)((unsigned) virtAddr % PageSize));
+	char *into = UserAddress(virtAddr, TRUE);
+
+	if (into == NULL) {
+	    return FALSE;
+	}
+	memcpy(into, from, chunk);
+	virtAddr += chunk;
+	from += chunk;
+	size -= chunk;
+    }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CopyInString
+// 	Copy the null-terminated string at user address "virtAddr" into
+//	the kernel buffer "into", of "maxSize" bytes.
+//
+//	Return FALSE if the string is not in the address space, or does
+//	not fit; "into" then holds, null-terminated, as much of it as
+//	could be copied.
+//----------------------------------------------------------------------
+
+bool
+AddrSpace::CopyInString(int virtAddr, char *into, int maxSize)
+{
+    char *from = NULL;
+
+    ASSERT(maxSize > 0);
+    for (int i = 0; i < maxSize - 1; i++, virtAddr++) {
+	if ((from == NULL) || ((unsigned) virtAddr % PageSize == 0)) {
+	    from = UserAddress(virtAddr, FALSE);	// a new page
+	    if (from == NULL) {
+		into[i] = '\0';
+		return FALSE;
+	    }
+	}
+	into[i] = *from++;
+	if (into[i] == '\0') {
+	    return TRUE;
+	}
+    }
+    into[maxSize - 1] = '\0';
+    return FALSE;
+}
@@ -15,8 +15,64 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
+#include "openhash.h"
+
+class SharedText;
+class ExecImage;
+class Thread;
+class Semaphore;
 
 #define UserStackSize		1024 	// increase this as necessary!
+#define MaxProcessFiles		16	// open file descriptors per address
+					// space, counting the console
+#define MaxStringArgument	256	// longest string a system call
+					// takes, such as a path, counting
+					// its null
+#define MaxMappedFiles		4	// files mapped at once, by Mmap
+#define MaxMappedPages		1024	// pages there are for them, beyond
+					// the end of the program, and for
+					// the stacks of user threads
+#define MaxUserThreads		8	// threads a program can have at
+					// once, counting its first
+#define MaxExecArguments	16	// arguments ExecV passes a program
+
+// A file mapped into an address space: its bytes are those of
+// "numPages" virtual pages, from "firstPage" on.
+
+struct MappedFile {
+    OpenFile *file;			// NULL if the entry is not in use
+    unsigned int firstPage;
+    unsigned int numPages;
+};
+
+// A thread running in an address space.  Its slot is its ThreadId,
+// and is kept after it exits until another thread joins it.  All but
+// the first thread have a stack of their own after the rest of the
+// address space, given to the slot the first time it is used and kept
+// for the next thread to use it.
+
+struct UserThread {
+    Thread *thread;			// NULL if the slot is free
+    bool exited;			// has it called ThreadExit?
+    int exitCode;			// what it gave ThreadExit
+    bool joined;			// is a thread waiting to join it?
+    Semaphore *done;			// signalled when it exits
+    unsigned int stackPage;		// first page of its stack, or 0
+					// for the program's own
+};
+
+// The frames an address space has, and may have, with demand paging
+// (see frametable.h).
+
+struct ResidentSet {
+    int resident;			// frames its pages are in
+    int quota;				// frames it may have before it
+					// replaces its own pages
+    int faults;				// page faults since the last sample
+    int workingSet;			// pages it used lately
+    bool listed;			// in the frame table's list?
+};
 
 class AddrSpace {
   public:
@@ -27,6 +83,14 @@ class AddrSpace {
                                         // a file
 					// return false if not found
 
+    bool SetArguments(int argc, char **argv);
+					// Put the arguments of main() at
+					// the top of the stack; FALSE if
+					// they do not fit
+    AddrSpace *Fork();			// A copy of this address space,
+					// copy-on-write; NULL if there is
+					// no room for it
+
     void Execute(char *fileName);             	// Run a program
 					// assumes the program has already
                                         // been loaded
@@ -39,14 +103,131 @@ class AddrSpace {
     // is 0 for Read, 1 for Write.
     ExceptionType Translate(unsigned int vaddr, unsigned int *paddr, int mode);
 
+    TranslationEntry *PageEntry(unsigned int vpn);
+					// Page table entry of virtual page
+					// "vpn", or NULL if there is none
+					// -- with a hashed page table, if
+					// it is not in memory
+    bool HasPage(unsigned int vpn);	// Is "vpn" in the address space?
+    unsigned int NumPages() { return numPages; }
+    void DropEntry(unsigned int vpn);	// Page "vpn" has left memory
+    int Asid() { return asid; }		// Tags this space's TLB entries
+    int SpaceId() { return spaceId; }	// Its program's SpaceId, or -1
+    ResidentSet *Resident() { return &residentSet; }
+					// The frames it has, to the frame
+					// table
+    int ProfileId() { return profileId; }
+					// Its program, to the profiler;
+					// -1 if not profiled
+
+    // Demand paging: called by the frame table, which decides which
+    // page goes in which frame.
+    void LoadPage(unsigned int vpn, int frame);
+					// Bring page "vpn" into "frame"
+    int ClusterPages(unsigned int vpn, int maxPages);
+					// How many pages from "vpn" on can
+					// be brought in together
+    void LoadPages(unsigned int vpn, int count, int *frames);
+					// Bring them into "frames"
+    void EvictPage(unsigned int vpn);	// Take page "vpn" out of its frame,
+					// saving it if it was changed
+
+    // Copy system call buffers between the address space and the
+    // kernel, faulting pages in as need be; FALSE if the user
+    // address is bad.
+    bool CopyIn(int virtAddr, char *into, int size);
+    bool CopyOut(int virtAddr, char *from, int size);
+    bool CopyInString(int virtAddr, char *into, int maxSize);
+					// FALSE too if it does not fit
+
+    // Use a system call buffer where it is, a page at a time, without
+    // copying it through the kernel; NULL if the user address is bad.
+    char *PinPage(int virtAddr, bool writing);
+					// The page of "virtAddr" stays in
+    void UnpinPage(int virtAddr);	// memory until unpinned
+
+    int Map(OpenFile *file);		// Map a file in after the rest of
+					// the address space; its address,
+					// or -1 if there is no room
+    bool Unmap(int virtAddr);		// Write back and unmap the file
+					// mapped there; FALSE if none is
+
+    // Descriptor table: each open file descriptor of the program
+    // names an entry of the file system's open file table.
+    OpenFileId AddFile(int fileIndex);	// New descriptor for an entry;
+					// -1 if the table is full
+    int FileIndex(OpenFileId id);	// Entry behind a descriptor, or -1
+    int RemoveFile(OpenFileId id);	// Free a descriptor, returning
+					// its entry, or -1
+
+    // User threads: each thread running the program has a slot.
+    int AddThread(Thread *thread);	// Slot for a thread, with a stack;
+					// -1 if there is no room
+    int StackTop(int id);		// Where the stack of slot "id" starts
+    bool RemoveThread(Thread *thread, int exitCode);
+					// It exits; TRUE if it was the last
+    bool JoinThread(int id, int *exitCode);
+					// Wait for slot "id" to exit, and
+					// free it; FALSE if it cannot be
+
   private:
     TranslationEntry *pageTable;	// Assume linear page table translation
 					// for now!
+    OpenHashTable<int, TranslationEntry *> *hashedTable;
+					// or with -hpt, the entries of the
+					// pages in memory only, by virtual
+					// page; pageTable is then NULL
     unsigned int numPages;		// Number of pages in the virtual 
 					// address space
+    unsigned int imagePages;		// how many of them are the program's
+					// own, the rest being mapped files
+    int asid;				// Address space id, unique to this
+					// address space
+    int spaceId;			// SpaceId of its program, once its
+					// first thread runs
+    ResidentSet residentSet;		// its frames, with demand paging
+    int profileId;			// its program's number in the
+					// profiler, or -1
+    ExecImage *image;			// the program's object code, from
+					// which pages are filled when first
+					// touched
+    NoffHeader noffH;			// its header, giving its segments
+    int argc;				// arguments given main()
+    int argvAddr;			// where they are, or 0
+    int argBytes;			// bytes they take at the stack top
+    int *swapSlot;			// Demand paging: where in the swap
+					// area each page is kept
+    bool *inSwap;			// and whether it has been written
+					// there
+    SharedText *text;			// code pages shared with other
+					// address spaces, or NULL
+
+    MappedFile mapped[MaxMappedFiles];	// files mapped by Mmap
+    int openFiles[MaxProcessFiles];	// open file table entry of each
+					// descriptor, -1 if not in use
+    UserThread threads[MaxUserThreads];	// threads running the program
+    int numThreads;			// how many have not exited
 
     void InitRegisters();		// Initialize user-level CPU registers,
 					// before jumping to user code
+    bool AllocateSwap();		// Give each page a swap slot
+    void ShareText();			// Map the code to shared frames
+    TranslationEntry *MakeEntry(unsigned int vpn);
+					// Entry of "vpn", added if need be
+    void ClearEntries(unsigned int firstPage, unsigned int count);
+					// Pages not in memory yet
+    void PageLoaded(unsigned int vpn, int frame);
+					// Page "vpn" is now in "frame"
+    MappedFile *MappingOf(unsigned int vpn);
+					// The mapped file page "vpn" is in,
+					// or NULL
+    bool IsStackPage(unsigned int vpn);	// Is it in a thread's stack?
+    bool AllocateStack(int id);		// Give slot "id" a stack
+    int SlotOf(Thread *thread);		// Slot of a running thread, or -1
+    char *UserAddress(int virtAddr, bool writing);
+					// Where a user byte is in memory,
+					// copying it first if it is
+					// copy-on-write
 
 };
 
@@ -4,8 +4,8 @@
 //	transfer back to here from user code:
 //
 //	syscall -- The user code explicitly requests to call a procedure
-//	in the Nachos kernel.  Right now, the only function we support is
-//	"Halt".
+//	in the Nachos kernel.  Each one is looked up in a table, which
+//	says how many arguments it takes and which routine does it.
 //
 //	exceptions -- The user code does something that the CPU can't handle.
 //	For instance, accessing memory that doesn't exist, arithmetic errors,
@@ -14,9 +14,6 @@
 //	Interrupts (which can also cause control to transfer from user
 //	code into the Nachos kernel) are handled elsewhere.
 //
-// For now, this only handles the Halt() system call.
-// Everything else core dumps.
-//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation
 // of liability and disclaimer of warranty provisions.
@@ -25,6 +22,354 @@
 #include "main.h"
 #include "syscall.h"
 #include "ksyscall.h"
+#include "tlbmanager.h"
+#include "frametable.h"
+#include "trace.h"
+
+//----------------------------------------------------------------------
+// The system calls.  Each routine takes the arguments of its system
+// call, from r4 on, and returns its result, to be put in r2; those
+// for Halt, MSG and Exit never return.
+//----------------------------------------------------------------------
+
+static int
+DoHalt(int *arg)
+{
+	DEBUG(dbgSys, "Shutdown, initiated by user program.\n");
+	SysHalt();
+	cout << "in exception\n";
+	ASSERTNOTREACHED();
+	return 0;
+}
+
+static int
+DoMSG(int *arg)
+{
+	char msg[MaxStringArgument];
+
+	DEBUG(dbgSys, "Message received.\n");
+	kernel->currentThread->space->CopyInString(arg[0], msg, MaxStringArgument);
+	cout << msg << endl;
+	SysHalt();
+	ASSERTNOTREACHED();
+	return 0;
+}
+
+static int
+DoExit(int *arg)
+{
+	DEBUG(dbgAddr, "Program exit\n");
+	cout << "return value:" << arg[0] << endl;
+	SysThreadExit(arg[0]);
+	ASSERTNOTREACHED();
+	return 0;
+}
+
+static int
+DoThreadExit(int *arg)
+{
+	DEBUG(dbgSys, "Thread exit\n");
+	SysThreadExit(arg[0]);
+	ASSERTNOTREACHED();
+	return 0;
+}
+
+static int
+DoThreadYield(int *arg)
+{
+	SysThreadYield();
+	return 0;
+}
+
+static int DoThreadFork(int *arg) { return SysThreadFork(arg[0], arg[1]); }
+static int DoThreadJoin(int *arg) { return SysThreadJoin(arg[0]); }
+
+static int
+DoAdd(int *arg)
+{
+	int result;
+
+	DEBUG(dbgSys, "Add " << arg[0] << " + " << arg[1] << "\n");
+	result = SysAdd(arg[0], arg[1]);
+	DEBUG(dbgSys, "Add returning with " << result << "\n");
+	cout << "result is " << result << "\n";
+	return result;
+}
+
+// MP4 mod tag
+#ifdef FILESYS_STUB
+static int
+DoCreate(int *arg)
+{
+	char filename[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], filename, MaxStringArgument))
+		return 0;
+	return SysCreate(filename);
+}
+#else
+static int
+DoCreate(int *arg)
+{
+	char filename[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], filename, MaxStringArgument))
+		return 0;
+	return SysCreate(filename, arg[1]);
+}
+#endif
+
+static int
+DoOpen(int *arg)
+{
+	char filename[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], filename, MaxStringArgument))
+		return -1;
+	return SysOpen(filename);
+}
+
+static int
+DoRename(int *arg)
+{
+	char from[MaxStringArgument];
+	char to[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], from, MaxStringArgument) ||
+		!kernel->currentThread->space->CopyInString(arg[1], to, MaxStringArgument))
+		return 0;
+	return SysRename(from, to);
+}
+
+static int
+DoStat(int *arg)
+{
+	char filename[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], filename, MaxStringArgument))
+		return -1;
+	return SysStat(filename, arg[1]);
+}
+
+// the buffers of these are used in place, in the program's memory
+static int DoRead(int *arg) { return SysRead(arg[0], arg[1], arg[2]); }
+static int DoWrite(int *arg) { return SysWrite(arg[0], arg[1], arg[2]); }
+static int DoReadV(int *arg) { return SysReadV(arg[0], arg[1], arg[2]); }
+static int DoWriteV(int *arg) { return SysWriteV(arg[0], arg[1], arg[2]); }
+static int DoPRead(int *arg) { return SysPRead(arg[0], arg[1], arg[2], arg[3]); }
+static int DoPWrite(int *arg) { return SysPWrite(arg[0], arg[1], arg[2], arg[3]); }
+static int DoReserve(int *arg) { return SysReserve(arg[0], arg[1]); }
+static int DoReadDir(int *arg) { return SysReadDir(arg[0], arg[1], arg[2]); }
+static int DoFstat(int *arg) { return SysFstat(arg[0], arg[1]); }
+static int DoFsync(int *arg) { return SysFsync(arg[0]); }
+static int DoSync(int *arg) { return SysSync(); }
+static int DoFadvise(int *arg) { return SysFadvise(arg[0], arg[1], arg[2], arg[3]); }
+static int DoFutexWait(int *arg) { return SysFutexWait(arg[0], arg[1]); }
+static int DoFutexWake(int *arg) { return SysFutexWake(arg[0], arg[1]); }
+static int DoMemCopy(int *arg) { return SysMemCopy(arg[0], arg[1], arg[2]); }
+static int DoMemSet(int *arg) { return SysMemSet(arg[0], arg[1], arg[2]); }
+static int DoZeroPage(int *arg) { return SysZeroPage(arg[0]); }
+static int DoGetStats(int *arg) { return SysGetStats(arg[0], arg[1]); }
+static int DoSetTickets(int *arg) { return SysSetTickets(arg[0]); }
+static int DoSetRealTime(int *arg) { return SysSetRealTime(arg[0], arg[1], arg[2]); }
+static int DoWaitPeriod(int *arg) { return SysWaitPeriod(); }
+static int DoClose(int *arg) { return SysClose(arg[0]); }
+static int DoSubmit(int *arg) { return SysSubmit(arg[0]); }
+
+static int
+DoMmap(int *arg)
+{
+	char filename[MaxStringArgument];
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], filename, MaxStringArgument))
+		return -1;
+	return SysMmap(filename);
+}
+
+static int DoMunmap(int *arg) { return SysMunmap(arg[0]); }
+
+static int
+DoFork(int *arg)
+{
+	DEBUG(dbgSys, "Fork\n");
+	return kernel->Fork();
+}
+
+static int
+DoExecV(int *arg)
+{
+	AddrSpace *space = kernel->currentThread->space;
+	int argc = arg[0];
+	char *argv[MaxExecArguments];
+	int result = -1;
+	bool ok = TRUE;
+	int copied;
+
+	if ((argc < 1) || (argc > MaxExecArguments))
+		return -1;
+	for (copied = 0; ok && (copied < argc); copied++) {
+		int addr;
+
+		argv[copied] = new char[MaxStringArgument];
+		ok = space->CopyIn(arg[1] + copied * 4, (char *)&addr, 4) &&
+		     space->CopyInString(WordToHost(addr), argv[copied], MaxStringArgument);
+	}
+	if (ok) {
+		DEBUG(dbgSys, "ExecV " << argv[0] << "\n");
+		result = SysExecV(argc, argv);
+	}
+	while (--copied >= 0)
+		delete [] argv[copied];
+	return result;
+}
+
+static int
+DoExec(int *arg)
+{
+	char name[MaxStringArgument];
+	char *argv[1] = { name };
+
+	if (!kernel->currentThread->space->CopyInString(arg[0], name, MaxStringArgument))
+		return -1;
+	DEBUG(dbgSys, "Exec " << name << "\n");
+	return SysExecV(1, argv);
+}
+
+static int DoJoin(int *arg) { return SysJoin(arg[0]); }
+
+// What the kernel does for a system call.
+struct SyscallDesc {
+	int type;		  // its code, in r2
+	const char *name; // for statistics and debugging
+	int numArgs;	  // how many of r4..r7 it takes
+	int (*handler)(int *arg);
+	bool returns; // FALSE if it never comes back, so it neither puts
+				  // a result in r2 nor goes on to the next instruction
+};
+
+static SyscallDesc syscalls[] = {
+	{SC_Halt, "Halt", 0, DoHalt, FALSE},
+	{SC_MSG, "MSG", 1, DoMSG, FALSE},
+	{SC_Exit, "Exit", 1, DoExit, FALSE},
+	{SC_Add, "Add", 2, DoAdd, TRUE},
+	{SC_Create, "Create", 2, DoCreate, TRUE},
+	{SC_Open, "Open", 1, DoOpen, TRUE},
+	{SC_Rename, "Rename", 2, DoRename, TRUE},
+	{SC_Read, "Read", 3, DoRead, TRUE},
+	{SC_Write, "Write", 3, DoWrite, TRUE},
+	{SC_ReadV, "ReadV", 3, DoReadV, TRUE},
+	{SC_WriteV, "WriteV", 3, DoWriteV, TRUE},
+	{SC_PRead, "PRead", 4, DoPRead, TRUE},
+	{SC_PWrite, "PWrite", 4, DoPWrite, TRUE},
+	{SC_Reserve, "Reserve", 2, DoReserve, TRUE},
+	{SC_ReadDir, "ReadDir", 3, DoReadDir, TRUE},
+	{SC_Stat, "Stat", 2, DoStat, TRUE},
+	{SC_Fstat, "Fstat", 2, DoFstat, TRUE},
+	{SC_Fsync, "Fsync", 1, DoFsync, TRUE},
+	{SC_Sync, "Sync", 0, DoSync, TRUE},
+	{SC_Fadvise, "Fadvise", 4, DoFadvise, TRUE},
+	{SC_FutexWait, "FutexWait", 2, DoFutexWait, TRUE},
+	{SC_FutexWake, "FutexWake", 2, DoFutexWake, TRUE},
+	{SC_MemCopy, "MemCopy", 3, DoMemCopy, TRUE},
+	{SC_MemSet, "MemSet", 3, DoMemSet, TRUE},
+	{SC_ZeroPage, "ZeroPage", 1, DoZeroPage, TRUE},
+	{SC_GetStats, "GetStats", 2, DoGetStats, TRUE},
+	{SC_SetTickets, "SetTickets", 1, DoSetTickets, TRUE},
+	{SC_SetRealTime, "SetRealTime", 3, DoSetRealTime, TRUE},
+	{SC_WaitPeriod, "WaitPeriod", 0, DoWaitPeriod, TRUE},
+	{SC_Close, "Close", 1, DoClose, TRUE},
+	{SC_Submit, "Submit", 1, DoSubmit, TRUE},
+	{SC_Mmap, "Mmap", 1, DoMmap, TRUE},
+	{SC_Munmap, "Munmap", 1, DoMunmap, TRUE},
+	{SC_Fork, "Fork", 0, DoFork, TRUE},
+	{SC_Exec, "Exec", 1, DoExec, TRUE},
+	{SC_ExecV, "ExecV", 2, DoExecV, TRUE},
+	{SC_Join, "Join", 1, DoJoin, TRUE},
+	{SC_ThreadFork, "ThreadFork", 2, DoThreadFork, TRUE},
+	{SC_ThreadYield, "ThreadYield", 0, DoThreadYield, TRUE},
+	{SC_ThreadJoin, "ThreadJoin", 1, DoThreadJoin, TRUE},
+	{SC_ThreadExit, "ThreadExit", 1, DoThreadExit, FALSE},
+};
+
+static SyscallDesc *syscallTable[MaxSyscallCodes]; // by code, NULL if
+												  // there is no such call
+
+//----------------------------------------------------------------------
+// LookUpSyscall
+// 	Return what to do for system call "type", or NULL if there is no
+//	such system call.  The table is filled in the first time.
+//----------------------------------------------------------------------
+
+static SyscallDesc *
+LookUpSyscall(int type)
+{
+	static bool filled = FALSE;
+
+	if (!filled)
+	{
+		for (unsigned int i = 0; i < sizeof(syscalls) / sizeof(syscalls[0]); i++)
+		{
+			ASSERT(syscalls[i].type >= 0 && syscalls[i].type < MaxSyscallCodes);
+			syscallTable[syscalls[i].type] = &syscalls[i];
+		}
+		filled = TRUE;
+	}
+	if (type < 0 || type >= MaxSyscallCodes)
+		return NULL;
+	return syscallTable[type];
+}
+
+//----------------------------------------------------------------------
+// DoSyscall
+// 	Run the system call whose code is in r2 for the current user
+//	program, counting it, and the simulated and host time it takes, in
+//	the statistics.  If it returns, its result goes in r2, and the
+//	program goes on from the next instruction.
+//
+//	Return FALSE if there is no such system call.
+//----------------------------------------------------------------------
+
+static bool
+DoSyscall(int type)
+{
+	Machine *machine = kernel->machine;
+	Statistics *stats = kernel->stats;
+	SyscallDesc *call = LookUpSyscall(type);
+	int arg[4] = {0, 0, 0, 0};
+	int startTicks, result;
+	double startTime;
+
+	if (call == NULL)
+		return FALSE;
+	for (int i = 0; i < call->numArgs; i++)
+		arg[i] = machine->ReadRegister(4 + i);
+	DEBUG(dbgSys, "System call " << call->name << "(" << arg[0] << ", " << arg[1]
+								  << ", " << arg[2] << ", " << arg[3] << ")\n");
+
+	stats->syscallName[type] = call->name;
+	stats->numSyscalls[type]++;
+	kernel->currentThread->Account(UsageSyscalls);
+	startTicks = stats->totalTicks;
+	startTime = HostTime();
+	TRACE(TraceSyscallEnter, kernel->currentThread->getID(), call->name, 0);
+
+	result = call->handler(arg);
+
+	ASSERT(call->returns);
+	stats->syscallTicks[type] += stats->totalTicks - startTicks;
+	if (stats->syscallLatency[type] == NULL)
+		stats->syscallLatency[type] = new Histogram;
+	stats->syscallLatency[type]->Record(stats->totalTicks - startTicks);
+	stats->syscallHostTime[type] += HostTime() - startTime;
+	TRACE(TraceSyscallExit, kernel->currentThread->getID(), NULL, 0);
+
+	machine->WriteRegister(2, result);
+	machine->WriteRegister(PrevPCReg, machine->ReadRegister(PCReg));
+	machine->WriteRegister(PCReg, machine->ReadRegister(PCReg) + 4);
+	machine->WriteRegister(NextPCReg, machine->ReadRegister(PCReg) + 4);
+	return TRUE;
+}
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -52,150 +397,33 @@ void ExceptionHandler(ExceptionType which)
 {
 	int type = kernel->machine->ReadRegister(2);
 	int val;
-	int status, exit, threadID, programID;
 	DEBUG(dbgSys, "Received Exception " << which << " type: " << type << "\n");
 	switch (which)
 	{
 	case SyscallException:
-		switch (type)
-		{
-		case SC_Halt:
-			DEBUG(dbgSys, "Shutdown, initiated by user program.\n");
-			SysHalt();
-			cout << "in exception\n";
-			ASSERTNOTREACHED();
-			break;
-		case SC_MSG:
-			DEBUG(dbgSys, "Message received.\n");
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *msg = &(kernel->machine->mainMemory[val]);
-				cout << msg << endl;
-			}
-			SysHalt();
-			ASSERTNOTREACHED();
-			break;
-		// MP4 mod tag
-#ifdef FILESYS_STUB
-		case SC_Create:
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				//cout << filename << endl;
-				status = SysCreate(filename);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			return;
-			ASSERTNOTREACHED();
-			break;
-#else
-		case SC_Create:
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				int initialSize = kernel->machine->ReadRegister(5);
-				status = SysCreate(filename, initialSize);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			return;
-			ASSERTNOTREACHED();
-			break;
-#endif
-		case SC_Open:
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *filename = &(kernel->machine->mainMemory[val]);
-				status = SysOpen(filename);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			return;
-			ASSERTNOTREACHED();
-			break;
-		case SC_Read:
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *buf = &(kernel->machine->mainMemory[val]);
-				int size = kernel->machine->ReadRegister(5);
-				int id = kernel->machine->ReadRegister(6);
-				status = SysRead(buf, size, id);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			return;
-			ASSERTNOTREACHED();
-			break;
-		case SC_Write:
-			val = kernel->machine->ReadRegister(4);
-			{
-				char *buf = &(kernel->machine->mainMemory[val]);
-				int size = kernel->machine->ReadRegister(5);
-				int id = kernel->machine->ReadRegister(6);
-				status = SysWrite(buf, size, id);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
+		if (DoSyscall(type))
 			return;
-			ASSERTNOTREACHED();
-			break;
-		case SC_Close:
-			val = kernel->machine->ReadRegister(4);
-			{
-				status = SysClose(val);
-				kernel->machine->WriteRegister(2, (int)status);
-			}
-			kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-			kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			return;
-			ASSERTNOTREACHED();
-			break;
-		case SC_Add:
-			DEBUG(dbgSys, "Add " << kernel->machine->ReadRegister(4) << " + " << kernel->machine->ReadRegister(5) << "\n");
-			/* Process SysAdd Systemcall*/
-			int result;
-			result = SysAdd(/* int op1 */ (int)kernel->machine->ReadRegister(4),
-							/* int op2 */ (int)kernel->machine->ReadRegister(5));
-			DEBUG(dbgSys, "Add returning with " << result << "\n");
-			/* Prepare Result */
-			kernel->machine->WriteRegister(2, (int)result);
-			/* Modify return point */
-			{
-				/* set previous programm counter (debugging only)*/
-				kernel->machine->WriteRegister(PrevPCReg, kernel->machine->ReadRegister(PCReg));
-
-				/* set programm counter to next instruction (all Instructions are 4 byte wide)*/
-				kernel->machine->WriteRegister(PCReg, kernel->machine->ReadRegister(PCReg) + 4);
-
-				/* set next programm counter for brach execution */
-				kernel->machine->WriteRegister(NextPCReg, kernel->machine->ReadRegister(PCReg) + 4);
-			}
-			cout << "result is " << result << "\n";
-			return;
-			ASSERTNOTREACHED();
-			break;
-		case SC_Exit:
-			DEBUG(dbgAddr, "Program exit\n");
-			val = kernel->machine->ReadRegister(4);
-			cout << "return value:" << val << endl;
-			kernel->currentThread->Finish();
-			break;
-		default:
-			cerr << "Unexpected system call " << type << "\n";
-			break;
-		}
+		cerr << "Unexpected system call " << type << "\n";
+		break;
+	case PageFaultException:
+		// with a TLB, this is a TLB miss, unless the page is not
+		// in memory, or not in the address space at all
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		if ((kernel->tlbManager != NULL) && kernel->tlbManager->Refill(val))
+			return; // the instruction is run again
+		// otherwise the page is not in memory: not touched yet,
+		// or with demand paging, replaced; it is brought in
+		if (kernel->frameTable->PageIn(kernel->currentThread->space, (unsigned)val / PageSize))
+			return; // and the instruction is run again
+		cerr << "Unexpected user mode exception " << (int)which << "\n";
+		break;
+	case ReadOnlyException:
+		// a page shared with a Fork'd copy is written; it gets a
+		// copy of its own
+		val = kernel->machine->ReadRegister(BadVAddrReg);
+		if (kernel->frameTable->CopyOnWrite(kernel->currentThread->space, (unsigned)val / PageSize))
+			return; // the instruction is run again
+		cerr << "Unexpected user mode exception " << (int)which << "\n";
 		break;
 	default:
 		cerr << "Unexpected user mode exception " << (int)which << "\n";
@@ -0,0 +1,374 @@
+// execcache.cc
+//	Routines to read program images, and to keep them for the next
+//	time the programs are run.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "execcache.h"
+#include "main.h"
+#include "disk.h"
+
+//----------------------------------------------------------------------
+// SwapHeader
+// 	Do little endian to big endian conversion on the bytes in the 
+//	object file header, in case the file was generated on a little
+//	endian machine, and we're now running on a big endian machine.
+//----------------------------------------------------------------------
+
+static void 
+SwapHeader (NoffHeader *noffH)
+{
+    noffH->noffMagic = WordToHost(noffH->noffMagic);
+    noffH->code.size = WordToHost(noffH->code.size);
+    noffH->code.virtualAddr = WordToHost(noffH->code.virtualAddr);
+    noffH->code.inFileAddr = WordToHost(noffH->code.inFileAddr);
+#ifdef RDATA
+    noffH->readonlyData.size = WordToHost(noffH->readonlyData.size);
+    noffH->readonlyData.virtualAddr = 
+           WordToHost(noffH->readonlyData.virtualAddr);
+    noffH->readonlyData.inFileAddr = 
+           WordToHost(noffH->readonlyData.inFileAddr);
+#endif 
+    noffH->initData.size = WordToHost(noffH->initData.size);
+    noffH->initData.virtualAddr = WordToHost(noffH->initData.virtualAddr);
+    noffH->initData.inFileAddr = WordToHost(noffH->initData.inFileAddr);
+    noffH->uninitData.size = WordToHost(noffH->uninitData.size);
+    noffH->uninitData.virtualAddr = WordToHost(noffH->uninitData.virtualAddr);
+    noffH->uninitData.inFileAddr = WordToHost(noffH->uninitData.inFileAddr);
+
+#ifdef RDATA
+    DEBUG(dbgAddr, "code = " << noffH->code.size <<  
+                   " readonly = " << noffH->readonlyData.size <<
+                   " init = " << noffH->initData.size <<
+                   " uninit = " << noffH->uninitData.size << "\n");
+#endif
+}
+
+//----------------------------------------------------------------------
+// IsPageAligned
+// 	Does segment "seg" start on a page in the file and in memory, so
+//	that each of its pages can be read straight from whole sectors?
+//----------------------------------------------------------------------
+
+static bool
+IsPageAligned(Segment *seg)
+{
+    return (seg->inFileAddr % PageSize == 0) &&
+		(seg->virtualAddr % PageSize == 0) &&
+		(PageSize % SectorSize == 0);
+}
+
+//----------------------------------------------------------------------
+// ExecImage::ExecImage
+// 	Read the header of "executable", and what the address spaces
+//	running it need of the segments that come from the file: the
+//	page-aligned ones are read later, a page at a time, from a file
+//	of the image's own.  Only the file system proper names a file by
+//	sector; with the stub, an image is never cached, and is read in
+//	full.
+//----------------------------------------------------------------------
+
+ExecImage::ExecImage(OpenFile *executable)
+{
+    executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
+    if ((noffH.noffMagic != NOFFMAGIC) && 
+		(WordToHost(noffH.noffMagic) == NOFFMAGIC))
+    	SwapHeader(&noffH);
+    ASSERT(noffH.noffMagic == NOFFMAGIC);
+
+    numSegments = 0;
+    numBytes = 0;
+    pagesLeft = 0;
+    AddSegment(&noffH.code, executable);
+    AddSegment(&noffH.initData, executable);
+#ifdef RDATA
+    AddSegment(&noffH.readonlyData, executable);
+#endif
+#ifdef FILESYS_STUB
+    sector = -1;
+    file = NULL;
+#else
+    sector = executable->HeaderSector();
+    file = (pagesLeft > 0) ? new OpenFile(sector) : NULL;
+#endif
+    lock = new Lock("program image");
+    refCount = 0;
+    stale = FALSE;
+}
+
+ExecImage::~ExecImage()
+{
+    for (int i = 0; i < numSegments; i++) {
+	delete [] segments[i].contents;
+	delete [] segments[i].pageRead;
+    }
+    delete file;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// ExecImage::AddSegment
+// 	Make room in the image for segment "seg" of "executable", if it
+//	is not empty, reading it now unless it is page-aligned.
+//----------------------------------------------------------------------
+
+void
+ExecImage::AddSegment(Segment *seg, OpenFile *executable)
+{
+    ImageSegment *s = &segments[numSegments];
+    int numPages = divRoundUp(seg->size, PageSize);
+
+    if (seg->size <= 0) {
+	return;
+    }
+    s->where = *seg;
+    s->contents = new char[numPages * PageSize];
+    s->pageRead = NULL;
+    numBytes += numPages * PageSize;
+    numSegments++;
+#ifndef FILESYS_STUB
+    if (IsPageAligned(seg)) {
+	s->pageRead = new bool[numPages];
+	for (int i = 0; i < numPages; i++) {
+	    s->pageRead[i] = FALSE;
+	}
+	pagesLeft += numPages;
+	return;
+    }
+#endif
+    executable->ReadAt(s->contents, seg->size, seg->inFileAddr);
+}
+
+//----------------------------------------------------------------------
+// ExecImage::ReadImagePage
+// 	Read page "page" of the page-aligned segment "s" from the file,
+//	if no one has yet: a whole page, which is whole sectors -- past
+//	the end of the segment, that is the padding before the next one.
+//	The file is closed once every page has been read.
+//----------------------------------------------------------------------
+
+void
+ExecImage::ReadImagePage(ImageSegment *s, int page)
+{
+    lock->Acquire();
+    if (!s->pageRead[page]) {
+	file->ReadAt(s->contents + page * PageSize, PageSize,
+		     s->where.inFileAddr + page * PageSize);
+	s->pageRead[page] = TRUE;
+	if (--pagesLeft == 0) {
+	    delete file;
+	    file = NULL;
+	}
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// ExecImage::ReadPage
+// 	Fill "into" with what virtual page "vpn" of the program holds
+//	when it starts: what its code and data segments put there, and
+//	zeroes elsewhere.  A page of a page-aligned segment is the same
+//	page of the image, read first if need be.
+//----------------------------------------------------------------------
+
+void
+ExecImage::ReadPage(unsigned int vpn, char *into)
+{
+    int pageAddr = vpn * PageSize;
+
+    bzero(into, PageSize);
+    for (int i = 0; i < numSegments; i++) {
+	ImageSegment *s = &segments[i];
+	int start = max(s->where.virtualAddr, pageAddr);
+	int end = min(s->where.virtualAddr + s->where.size, pageAddr + PageSize);
+
+	if (start >= end) {
+	    continue;
+	}
+	if (s->pageRead != NULL) {
+	    ReadImagePage(s, (pageAddr - s->where.virtualAddr) / PageSize);
+	}
+	memcpy(into + (start - pageAddr),
+	       s->contents + (start - s->where.virtualAddr), end - start);
+    }
+}
+
+//----------------------------------------------------------------------
+// ExecImage::ReadAll
+// 	Read every page not read yet, before the file changes under the
+//	address spaces still using the image.
+//----------------------------------------------------------------------
+
+void
+ExecImage::ReadAll()
+{
+    for (int i = 0; i < numSegments; i++) {
+	ImageSegment *s = &segments[i];
+
+	if (s->pageRead == NULL) {
+	    continue;
+	}
+	for (int page = 0; page < divRoundUp(s->where.size, PageSize); page++) {
+	    ReadImagePage(s, page);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// ExecCache::ExecCache/~ExecCache
+// 	Initialize an empty cache, keeping up to "maxBytes" of images no
+//	one uses; de-allocate it.
+//----------------------------------------------------------------------
+
+ExecCache::ExecCache(int maxBytes)
+{
+    images = new List<ExecImage *>;
+    numBytes = 0;
+    this->maxBytes = maxBytes;
+}
+
+ExecCache::~ExecCache()
+{
+    while (!images->IsEmpty()) {
+	ExecImage *image = images->RemoveFront();
+
+	if (image->refCount == 0) {
+	    delete image;
+	} else {
+	    image->stale = TRUE;	// its users delete it
+	}
+    }
+    delete images;
+}
+
+//----------------------------------------------------------------------
+// ExecCache::Get
+// 	Return the image of the program in "executable", for an address
+//	space to run it, reading it if it is not cached.  The caller must
+//	give it back with Put.
+//----------------------------------------------------------------------
+
+ExecImage *
+ExecCache::Get(OpenFile *executable)
+{
+    ExecImage *image = NULL;
+
+#ifndef FILESYS_STUB
+    ListIterator<ExecImage *> iter(images);
+
+    for (; !iter.IsDone(); iter.Next()) {
+	if (iter.Item()->sector == executable->HeaderSector()) {
+	    image = iter.Item();
+	    break;
+	}
+    }
+#endif
+    if (image != NULL) {
+	DEBUG(dbgAddr, "Program image of sector " << image->sector << " cached");
+	kernel->stats->numExecCacheHits++;
+	images->Remove(image);
+    } else {
+	image = new ExecImage(executable);
+	kernel->stats->numExecCacheMisses++;
+	numBytes += image->numBytes;
+    }
+    images->Append(image);		// the most recently run
+    image->refCount++;
+    if (image->sector == -1) {		// not for keeping
+	images->Remove(image);
+	numBytes -= image->numBytes;
+	image->stale = TRUE;
+    }
+    Trim();
+    return image;
+}
+
+//----------------------------------------------------------------------
+// ExecCache::Share
+// 	Return "image" for another address space to use, such as a copy
+//	of one using it; stale or not, they run the same program.
+//----------------------------------------------------------------------
+
+ExecImage *
+ExecCache::Share(ExecImage *image)
+{
+    image->refCount++;
+    return image;
+}
+
+//----------------------------------------------------------------------
+// ExecCache::Put
+// 	An address space is done with "image".  A stale one goes when
+//	its last user does; one still cached stays, if there is room.
+//----------------------------------------------------------------------
+
+void
+ExecCache::Put(ExecImage *image)
+{
+    ASSERT(image->refCount > 0);
+    if (--image->refCount > 0) {
+	return;
+    }
+    if (image->stale) {
+	delete image;
+    } else {
+	Trim();
+    }
+}
+
+//----------------------------------------------------------------------
+// ExecCache::Invalidate
+// 	The file whose header is in "sector" is about to be written or
+//	removed: drop its image, if cached.  Programs using it keep it
+//	until they end, so what they have not read of it is read now,
+//	holding a reference meanwhile.
+//----------------------------------------------------------------------
+
+void
+ExecCache::Invalidate(int sector)
+{
+    ListIterator<ExecImage *> iter(images);
+
+    while (!iter.IsDone()) {
+	ExecImage *image = iter.Item();
+
+	iter.Next();			// before it goes from the list
+	if (image->sector != sector) {
+	    continue;
+	}
+	DEBUG(dbgAddr, "Program image of sector " << sector << " is stale");
+	images->Remove(image);
+	numBytes -= image->numBytes;
+	image->refCount++;
+	image->ReadAll();
+	image->stale = TRUE;
+	Put(image);
+	iter = ListIterator<ExecImage *>(images);	// it may have changed
+    }
+}
+
+//----------------------------------------------------------------------
+// ExecCache::Trim
+// 	Drop the least recently run images no one uses, until the cached
+//	images take up no more than "maxBytes", or all left are in use.
+//----------------------------------------------------------------------
+
+void
+ExecCache::Trim()
+{
+    ListIterator<ExecImage *> iter(images);
+
+    while ((numBytes > maxBytes) && !iter.IsDone()) {
+	ExecImage *image = iter.Item();
+
+	iter.Next();			// before it goes from the list
+	if (image->refCount == 0) {
+	    images->Remove(image);
+	    numBytes -= image->numBytes;
+	    delete image;
+	}
+    }
+}
@@ -0,0 +1,109 @@
+// execcache.h
+//	Data structures for keeping the images of recently run programs
+//	in memory.
+//
+//	Running a program reads its NOFF header, and then, one page at a
+//	time, its code and initialized data.  A program run again and
+//	again -- by a shell, say -- would read them again every time.
+//	Instead, the header and the segments read from the file are kept
+//	in an ExecImage, by the sector of the file's header, and shared
+//	by every address space running the program; those no longer in
+//	use stay cached, the least recently run dropped first when the
+//	cache is full.
+//
+//	A segment laid out page-aligned in the file, as well as in memory,
+//	is not read when the image is made, but a page at a time, the
+//	first time some address space touches the page: each page is
+//	whole sectors of the file, read straight into the image.  Other
+//	segments are read in full up front.
+//
+//	Writing to the file, or removing it, makes its image stale: it is
+//	dropped from the cache, so that the next run reads the file anew,
+//	but programs already running on it go on with it -- what of it
+//	was not read yet is read first.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef EXECCACHE_H
+#define EXECCACHE_H
+
+#include "copyright.h"
+#include "list.h"
+#include "noff.h"
+#include "openfile.h"
+#include "synch.h"
+
+// Bytes of program images kept once no program uses them.
+#define ExecCacheBytes	(64 * 1024)
+
+// A segment of an executable that comes from the file, and its
+// contents, in whole pages.
+
+struct ImageSegment {
+    Segment where;			// in memory and in the file
+    char *contents;
+    bool *pageRead;			// has each page been read? NULL if
+					// the segment was read in full
+};
+
+// The image of an executable: its header, and the contents of the
+// segments read from the file.
+
+class ExecImage {
+  public:
+    ExecImage(OpenFile *executable);	// Read the image of "executable"
+    ~ExecImage();
+
+    void ReadPage(unsigned int vpn, char *into);
+					// Fill "into" with what page "vpn"
+					// of the program starts out as
+    void ReadAll();			// Read the pages not read yet, so
+					// that the file is not needed
+
+    int sector;			// header sector of the file, or -1
+    NoffHeader noffH;		// in host byte order
+    int numBytes;		// bytes of segments kept
+    int refCount;		// address spaces using it
+    bool stale;			// not in the cache any more
+
+  private:
+    ImageSegment segments[3];	// code, data and read-only data
+    int numSegments;
+    OpenFile *file;		// to read pages from, NULL once all are
+    int pagesLeft;		// how many are still to be read
+    Lock *lock;			// one page read at a time
+
+    void AddSegment(Segment *seg, OpenFile *executable);
+    void ReadImagePage(ImageSegment *s, int page);
+					// Read page "page" of segment "s",
+					// if it has not been read yet
+};
+
+// The following class defines the cache of program images.
+
+class ExecCache {
+  public:
+    ExecCache(int maxBytes);		// Initialize an empty cache
+    ~ExecCache();
+
+    ExecImage *Get(OpenFile *executable);
+					// The image of "executable", read
+					// if it is not cached
+    ExecImage *Share(ExecImage *image);	// Another user of an image
+    void Put(ExecImage *image);		// Done with it
+    void Invalidate(int sector);	// The file whose header is at
+					// "sector" changed
+
+  private:
+    List<ExecImage *> *images;		// cached, the most recently run
+					// last
+    int numBytes;			// their segments
+    int maxBytes;			// most to keep of those not in use
+
+    void Trim();			// drop images not in use, until
+					// under "maxBytes"
+};
+
+#endif // EXECCACHE_H
@@ -0,0 +1,861 @@
+// frametable.cc
+//	Routines to give frames of physical memory to the pages of user
+//	programs: when they are loaded, or with demand paging, on page
+//	faults, replacing some other page if need be.
+//
+//	The address space of a page does the copying, between the frame
+//	and wherever the page is kept (see AddrSpace::LoadPage and
+//	AddrSpace::EvictPage); the frame table only decides which frame.
+//
+//	A frame can be mapped by more than one address space after a
+//	Fork; it is only free once none maps it.
+//
+//	The kernel reads and writes the buffers of system calls right in
+//	the frames of the user pages; each such frame is pinned while it
+//	is in use, so that it is not given to some other page meanwhile.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "frametable.h"
+#include "addrspace.h"
+#include "machine.h"
+#include "tlbmanager.h"
+
+static const char *policyNames[] = {"FIFO", "CLOCK", "LRU"};
+
+//----------------------------------------------------------------------
+// FrameTable::FrameTable
+// 	Get ready to give out the frames of physical memory, which
+//	starts out with every frame free.
+//
+//	"policyName" -- how to choose the page to replace: "fifo",
+//		"clock" or "lru"; NULL for the default, fifo
+//	"numFrames" -- how many frames user pages may have
+//----------------------------------------------------------------------
+
+FrameTable::FrameTable(char *policyName, int numFrames)
+{
+    ASSERT(numFrames >= 2 && numFrames <= NumPhysPages);
+				// an instruction may need two pages at
+				// once: its own, and the one it loads
+				// from or stores to
+    policy = PageFIFO;
+    if (policyName == NULL || strcmp(policyName, "fifo") == 0)
+	policy = PageFIFO;
+    else if (strcmp(policyName, "clock") == 0)
+	policy = PageClock;
+    else if (strcmp(policyName, "lru") == 0)
+	policy = PageLRU;
+    else
+	ASSERTNOTREACHED();	// unknown page replacement policy
+
+    kernel->stats->pagePolicy = policyNames[policy];
+    this->numFrames = numFrames;
+    owner = new AddrSpace *[numFrames];
+    refCount = new int[numFrames];
+    pinCount = new int[numFrames];
+    page = new unsigned int[numFrames];
+    loadTime = new unsigned int[numFrames];
+    history = new unsigned int[numFrames];
+    shared = new bool[numFrames];
+    prefetched = new bool[numFrames];
+    lastUsed = new int[numFrames];
+    sampledUse = new bool[numFrames];
+    for (int i = 0; i < numFrames; i++) {
+	owner[i] = NULL;
+	refCount[i] = 0;
+	pinCount[i] = 0;
+	shared[i] = FALSE;
+	prefetched[i] = FALSE;
+	sampledUse[i] = FALSE;
+    }
+    spaces = new List<AddrSpace *>;
+    nextSample = 0;
+    numLoads = 0;
+    hand = 0;
+    faultAround = 2;
+    numLastAhead = 0;
+    lock = new Lock("frame table");
+    unpinned = new Condition("frame unpinned");
+}
+
+FrameTable::~FrameTable()
+{
+    delete [] owner;
+    delete [] refCount;
+    delete [] pinCount;
+    delete [] page;
+    delete [] loadTime;
+    delete [] history;
+    delete [] shared;
+    delete [] prefetched;
+    delete [] lastUsed;
+    delete [] sampledUse;
+    delete spaces;
+    delete unpinned;
+    delete lock;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Allocate
+// 	Give each of the "numPages" pages of "space" a free frame, for
+//	as long as the address space lasts, and put it in the page's
+//	page table entry; the page is still invalid until first touched.
+//	Pages that already have a frame, in shared code, or that are not
+//	in the address space, between mapped files, are skipped.
+//	Either every page gets one, or none does: two programs being
+//	loaded at once must not each get half the frames they need.
+//
+//	Return FALSE if there are not enough free frames.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::Allocate(AddrSpace *space, unsigned int numPages)
+{
+    unsigned int numNeeded = 0;
+
+    lock->Acquire();
+    for (unsigned int vpn = 0; vpn < numPages; vpn++) {
+	TranslationEntry *pte = space->PageEntry(vpn);
+
+	if ((pte != NULL) && (pte->physicalPage == -1))
+	    numNeeded++;
+    }
+    if ((unsigned int) NumFree() < numNeeded) {
+	lock->Release();
+	return FALSE;
+    }
+    for (unsigned int vpn = 0; vpn < numPages; vpn++) {
+	TranslationEntry *pte = space->PageEntry(vpn);
+
+	if ((pte != NULL) && (pte->physicalPage == -1)) {
+	    int frame = FreeFrame(FrameBefore(space, vpn), vpn);
+
+	    owner[frame] = space;
+	    refCount[frame] = 1;
+	    page[frame] = vpn;
+	    pte->physicalPage = frame;
+	}
+    }
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Duplicate
+// 	Give "child", a copy of "parent" whose page table is the same as
+//	the parent's, the parent's memory, without copying it: each page
+//	the parent has in memory stays in its frame, now mapped by both,
+//	and read-only in both, until one of them writes it (see
+//	CopyOnWrite).  A page the parent has not touched yet gets a free
+//	frame of its own, to be filled on first touch like the parent's
+//	would be.  Shared code is left as it is.
+//
+//	The parent's translations change, so its TLB entries are dropped
+//	-- their use and dirty bits only matter with demand paging -- and
+//	the machine forgets the ones it has kept.
+//
+//	Return FALSE if there are not enough free frames.
+//
+//	"numPages" -- the number of pages of both
+//----------------------------------------------------------------------
+
+bool
+FrameTable::Duplicate(AddrSpace *parent, AddrSpace *child,
+		      unsigned int numPages)
+{
+    unsigned int numNeeded = 0;
+
+    lock->Acquire();
+    for (unsigned int vpn = 0; vpn < numPages; vpn++) {
+	TranslationEntry *pte = parent->PageEntry(vpn);
+
+	if ((pte != NULL) && !pte->valid && !shared[pte->physicalPage])
+	    numNeeded++;
+    }
+    if ((unsigned int) NumFree() < numNeeded) {
+	lock->Release();
+	return FALSE;
+    }
+    for (unsigned int vpn = 0; vpn < numPages; vpn++) {
+	TranslationEntry *from = parent->PageEntry(vpn);
+	TranslationEntry *to = child->PageEntry(vpn);
+	int frame;
+
+	if (from == NULL)		// between mapped files
+	    continue;
+	frame = from->physicalPage;
+	if (shared[frame])
+	    continue;
+	if (from->valid) {
+	    refCount[frame]++;
+	    from->readOnly = TRUE;
+	    to->readOnly = TRUE;
+	} else {
+	    frame = FreeFrame(FrameBefore(child, vpn), vpn);
+	    owner[frame] = child;
+	    refCount[frame] = 1;
+	    page[frame] = vpn;
+	    to->physicalPage = frame;
+	}
+    }
+    if (kernel->tlbManager != NULL) {
+	kernel->tlbManager->Forget(parent->Asid());
+    }
+    kernel->machine->FlushTranslations();
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::CopyOnWrite
+// 	Handle a write to page "vpn" of "space" that is read-only because
+//	its frame is mapped by other address spaces as well: copy it into
+//	a free frame of its own, or if the others have all since copied
+//	it or gone, simply take the frame over.  The page is then
+//	writable, and the user instruction is run again.
+//
+//	Return FALSE if the page is really read-only (shared code), or
+//	there is no free frame to copy it to.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::CopyOnWrite(AddrSpace *space, unsigned int vpn)
+{
+    TranslationEntry *pte = space->PageEntry(vpn);
+    char *memory = kernel->machine->mainMemory;
+    int frame, copy;
+
+    if ((pte == NULL) || !pte->valid || !pte->readOnly)
+	return FALSE;
+
+    lock->Acquire();
+    frame = pte->physicalPage;
+    if (shared[frame]) {
+	lock->Release();
+	return FALSE;
+    }
+    if (refCount[frame] > 1) {
+	copy = FreeFrame(FrameBefore(space, vpn), vpn);
+	if (copy == -1) {
+	    lock->Release();
+	    return FALSE;
+	}
+	DEBUG(dbgAddr, "Copying page " << vpn << " of address space "
+	      << space->Asid() << " from frame " << frame << " to " << copy);
+	bcopy(&memory[frame * PageSize], &memory[copy * PageSize], PageSize);
+	refCount[frame]--;
+	owner[copy] = space;
+	refCount[copy] = 1;
+	page[copy] = vpn;
+	pte->physicalPage = copy;
+	kernel->stats->numPageCopies++;
+    } else {
+	owner[frame] = space;
+    }
+    if (kernel->tlbManager != NULL) {	// it has the old translation
+	kernel->tlbManager->Drop(space->Asid(), vpn);
+    }
+    pte->readOnly = FALSE;
+    kernel->machine->FlushTranslations();
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::AllocateShared
+// 	Find "numPages" free frames for code that several address spaces
+//	share, and put their numbers in "frames".  They belong to none
+//	of the address spaces, and stay in use until FreeShared.
+//
+//	Return FALSE if there are not enough free frames.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::AllocateShared(int numPages, int *frames)
+{
+    lock->Acquire();
+    if (NumFree() < numPages) {
+	lock->Release();
+	return FALSE;
+    }
+    for (int i = 0; i < numPages; i++) {
+	frames[i] = FreeFrame((i > 0) ? frames[i - 1] : -1, i);
+	shared[frames[i]] = TRUE;
+    }
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::FreeShared
+// 	Free the "numPages" frames in "frames", given out by
+//	AllocateShared, now that no address space uses them.
+//----------------------------------------------------------------------
+
+void
+FrameTable::FreeShared(int numPages, int *frames)
+{
+    lock->Acquire();
+    for (int i = 0; i < numPages; i++) {
+	ASSERT(shared[frames[i]]);
+	shared[frames[i]] = FALSE;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::PageIn
+// 	Handle a page fault: bring page "vpn" of "space" into a frame,
+//	the one given to it when the program was loaded, or without one,
+//	any frame.  The user instruction that faulted is then simply run
+//	again.
+//
+//	The page may already be in memory, if it was brought in while
+//	we waited for another fault to be handled.
+//
+//	Return FALSE if the address space has no such page, so that the
+//	fault is a real error.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::PageIn(AddrSpace *space, unsigned int vpn)
+{
+    TranslationEntry *pte;
+
+    if (!space->HasPage(vpn))
+	return FALSE;
+
+    lock->Acquire();
+    pte = space->PageEntry(vpn);	// none in a hashed page table
+    if ((pte == NULL) || !pte->valid)	// if it is not in memory
+	Fault(space, vpn);
+    lock->Release();
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Fault
+// 	Bring page "vpn" of "space", which is not in memory, into a frame,
+//	for PageIn or Pin.  The lock is held.
+//
+//	With demand paging, the pages after it that can come in with it
+//	(see AddrSpace::ClusterPages) are brought in too, as many as the
+//	window allows and there are frames for without waiting.  The
+//	frames are pinned until all are filled, so that finding a frame
+//	for one does not replace another; the pages brought in ahead are
+//	counted as not used yet.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Fault(AddrSpace *space, unsigned int vpn)
+{
+    TranslationEntry *pte = space->PageEntry(vpn);
+    int frames[1 + MaxFaultAround];
+    int count = 1;
+
+    kernel->stats->numPageFaults++;
+    if ((space->SpaceId() >= 0) && (space->SpaceId() < MaxSpaces))
+	kernel->stats->spaceFaults[space->SpaceId()]++;
+    kernel->currentThread->Account(UsagePageFaults);
+    frames[0] = (pte != NULL) ? pte->physicalPage : -1;
+    if (frames[0] != -1) {			// given it at load time
+	DEBUG(dbgAddr, "Page " << vpn << " of address space " << space->Asid()
+	      << " goes in frame " << frames[0]);
+	space->LoadPage(vpn, frames[0]);
+	return;
+    }
+
+    space->Resident()->faults++;
+    AdaptFaultAround();
+    frames[0] = TakeFrame(space, vpn, TRUE);
+    pinCount[frames[0]]++;
+    for (int wanted = space->ClusterPages(vpn, 1 + faultAround);
+	 count < wanted; count++) {
+	frames[count] = TakeFrame(space, vpn + count, FALSE);
+	if (frames[count] == -1)
+	    break;
+	pinCount[frames[count]]++;
+    }
+    DEBUG(dbgAddr, "Page " << vpn << " of address space " << space->Asid()
+	  << " goes in frame " << frames[0] << ", with " << count - 1
+	  << " after it");
+    space->LoadPages(vpn, count, frames);
+
+    numLastAhead = 0;
+    for (int i = 0; i < count; i++) {
+	if (i > 0) {
+	    space->PageEntry(vpn + i)->use = FALSE;	// not touched yet
+	    prefetched[frames[i]] = TRUE;
+	    lastAhead[numLastAhead++] = frames[i];
+	}
+	if (--pinCount[frames[i]] == 0)
+	    unpinned->Broadcast(lock);
+    }
+    kernel->stats->numPagesPrefetched += count - 1;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::TakeFrame
+// 	Return a frame for page "vpn" of "space", now its owner: a free
+//	one, or one whose page is replaced, written out first if need be
+//	-- one of its own pages if it has all its quota allows, or else
+//	preferably a page of a program over its quota.  If too many
+//	frames are pinned to replace one, wait for one to be unpinned,
+//	or if not "wait", return -1.
+//----------------------------------------------------------------------
+
+int
+FrameTable::TakeFrame(AddrSpace *space, unsigned int vpn, bool wait)
+{
+    ResidentSet *set = space->Resident();
+    int frame = FreeFrame(FrameBefore(space, vpn), vpn);
+
+    if (frame == -1) {
+	if (set->resident >= set->quota)
+	    frame = Victim(space, OwnFrames);
+	if (frame == -1)
+	    frame = Victim(space, OverQuotaFrames);
+	while ((frame == -1) && ((frame = Victim(space, AnyFrames)) == -1)) {
+	    if (!wait)
+		return -1;
+	    unpinned->Wait(lock);	// too many frames are pinned
+	}
+	DEBUG(dbgAddr, "Replacing page " << page[frame] << " of address space "
+	      << owner[frame]->Asid() << " in frame " << frame);
+	Taken(frame);
+	owner[frame]->EvictPage(page[frame]);
+    }
+    owner[frame] = space;
+    refCount[frame] = 1;
+    page[frame] = vpn;
+    loadTime[frame] = numLoads++;
+    history[frame] = ~(~0u >> 1);	// as if just used
+    lastUsed[frame] = kernel->stats->totalTicks;
+    sampledUse[frame] = FALSE;
+    prefetched[frame] = FALSE;
+
+    if (!set->listed) {			// a fair share, to start with
+	spaces->Append(space);
+	set->listed = TRUE;
+	set->quota = max(numFrames / (int) spaces->NumInList(), MinQuota);
+    }
+    set->resident++;
+    if ((space->SpaceId() >= 0) && (space->SpaceId() < MaxSpaces))
+	kernel->stats->spaceMaxResident[space->SpaceId()] =
+	    max(kernel->stats->spaceMaxResident[space->SpaceId()], set->resident);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Taken
+// 	The page in "frame" is being replaced, or freed: it no longer
+//	counts against its program's frames.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Taken(int frame)
+{
+    owner[frame]->Resident()->resident--;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::AdaptFaultAround
+// 	Before the next pages are brought in ahead, see how many of those
+//	brought in ahead last time were touched since -- those still in
+//	their frames: grow the window if every one was, shrink it if
+//	none was.  It never shrinks to nothing, so that a program that
+//	starts reading sequentially is noticed.
+//----------------------------------------------------------------------
+
+void
+FrameTable::AdaptFaultAround()
+{
+    int seen = 0, used = 0;
+
+    for (int i = 0; i < numLastAhead; i++) {
+	int frame = lastAhead[i];
+
+	if (!prefetched[frame])
+	    continue;			// replaced or freed since
+	prefetched[frame] = FALSE;
+	seen++;
+	if (owner[frame]->PageEntry(page[frame])->use || sampledUse[frame])
+	    used++;
+    }
+    numLastAhead = 0;
+    kernel->stats->numPrefetchHits += used;
+    if (seen == 0)
+	return;
+    if (used == seen)
+	faultAround = min(2 * faultAround, MaxFaultAround);
+    else if (used == 0)
+	faultAround = max(faultAround / 2, 1);
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Pin
+// 	Bring page "vpn" of "space" into memory if it is not there, and
+//	keep its frame from being given to some other page until Unpin,
+//	while the kernel reads or writes it.  If "writing", a page shared
+//	copy-on-write is copied first, and the page is counted as
+//	changed.
+//
+//	The page is brought in and pinned with the lock held throughout:
+//	were it let go in between, other faults could replace the page
+//	again each time, when there are few frames.
+//
+//	Return the frame, or -1 if the address space has no such page,
+//	or "writing" and it is read-only.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Pin(AddrSpace *space, unsigned int vpn, bool writing)
+{
+    TranslationEntry *pte;
+    int frame;
+
+    if (!space->HasPage(vpn))
+	return -1;
+
+    for (;;) {
+	lock->Acquire();
+	pte = space->PageEntry(vpn);
+	if ((pte == NULL) || !pte->valid) {
+	    Fault(space, vpn);
+	    pte = space->PageEntry(vpn);	// made by Fault, if hashed
+	}
+	if (!writing || !pte->readOnly)
+	    break;
+	lock->Release();
+	if (!CopyOnWrite(space, vpn))
+	    return -1;
+    }
+    frame = pte->physicalPage;
+    pinCount[frame]++;
+    pte->use = TRUE;
+    if (writing)
+	pte->dirty = TRUE;
+    lock->Release();
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Unpin
+// 	The kernel is done with "frame", pinned by Pin; once no one has it
+//	pinned, it may be replaced again.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Unpin(int frame)
+{
+    lock->Acquire();
+    ASSERT(pinCount[frame] > 0);
+    if (--pinCount[frame] == 0)
+	unpinned->Broadcast(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Release
+// 	Free every frame holding a page of "space", which is being
+//	deleted, unless another address space still maps it.  Its pages
+//	are not written back.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Release(AddrSpace *space)
+{
+    lock->Acquire();
+    for (unsigned int vpn = 0; vpn < space->NumPages(); vpn++) {
+	TranslationEntry *pte = space->PageEntry(vpn);
+	int frame = (pte != NULL) ? pte->physicalPage : -1;
+
+	if ((frame == -1) || shared[frame])
+	    continue;
+	ASSERT(refCount[frame] > 0);
+	if (--refCount[frame] == 0) {
+	    owner[frame] = NULL;
+	    prefetched[frame] = FALSE;
+	}
+    }
+    if (space->Resident()->listed) {
+	spaces->Remove(space);
+	space->Resident()->listed = FALSE;
+    }
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Free
+// 	Take page "vpn" of "space", which is being unmapped, out of its
+//	frame, and free the frame unless another address space still maps
+//	it.  The page is not written back; the caller has done that.
+//	With a hashed page table, it may have no entry: nothing to free.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Free(AddrSpace *space, unsigned int vpn)
+{
+    TranslationEntry *pte;
+    int frame;
+
+    lock->Acquire();
+    pte = space->PageEntry(vpn);
+    if (pte == NULL) {
+	lock->Release();
+	return;
+    }
+    frame = pte->physicalPage;
+    if (frame != -1) {
+	ASSERT(!shared[frame] && (refCount[frame] > 0));
+	if (--refCount[frame] == 0) {
+	    if (space->Resident()->listed)	// demand paging
+		Taken(frame);
+	    owner[frame] = NULL;
+	    prefetched[frame] = FALSE;
+	}
+    }
+    pte->valid = FALSE;
+    pte->physicalPage = -1;
+    space->DropEntry(vpn);
+    kernel->machine->FlushTranslations();
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// FrameTable::FreeFrame
+// 	Return a frame that no page is in, for virtual page "vpn", or -1
+//	if there is none.  So that the TLB can map runs of pages with one
+//	entry (see tlbmanager.h), pages next to each other are put in
+//	frames next to each other, aligned alike: the frame after that of
+//	the page before is taken if it is free and in line; failing that,
+//	the lowest numbered frame in line with "vpn" -- at the same place
+//	within a MaxSuperPage run of frames -- so that a run can start
+//	there; failing that, the lowest numbered.
+//
+//	"previous" -- the frame of page vpn - 1, or -1
+//	"vpn" -- the page the frame is for
+//----------------------------------------------------------------------
+
+int
+FrameTable::FreeFrame(int previous, unsigned int vpn)
+{
+    int first = -1;
+    int next = previous + 1;
+
+    if ((previous >= 0) && (next < numFrames) && (refCount[next] == 0) &&
+	    !shared[next] && ((unsigned) next % MaxSuperPage == vpn % MaxSuperPage))
+	return next;
+    for (int i = 0; i < numFrames; i++) {
+	if ((refCount[i] == 0) && !shared[i]) {
+	    if ((unsigned) i % MaxSuperPage == vpn % MaxSuperPage)
+		return i;
+	    if (first == -1)
+		first = i;
+	}
+    }
+    return first;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::FrameBefore
+// 	Return the frame of the page before "vpn" in "space", or -1 if
+//	there is no such page, or it has no frame.  Only a hint, for
+//	FreeFrame.
+//----------------------------------------------------------------------
+
+int
+FrameTable::FrameBefore(AddrSpace *space, unsigned int vpn)
+{
+    TranslationEntry *pte = (vpn > 0) ? space->PageEntry(vpn - 1) : NULL;
+
+    if ((pte == NULL) || (pte->physicalPage < 0) ||
+	    (pte->physicalPage >= numFrames))
+	return -1;
+    return pte->physicalPage;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::NumFree
+// 	Return the number of frames that no page is in.
+//----------------------------------------------------------------------
+
+int
+FrameTable::NumFree()
+{
+    int numFree = 0;
+
+    for (int i = 0; i < numFrames; i++) {
+	if ((refCount[i] == 0) && !shared[i])
+	    numFree++;
+    }
+    return numFree;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Victim
+// 	Return the frame whose page the policy picks to be replaced on a
+//	fault of "space", among those not pinned, and within "scope": its
+//	own frames, those of programs over their quota, or any.  Return
+//	-1 if there is none, or fewer than two frames are not pinned, or
+//	the program's own that are not: the faulting instruction may need
+//	two pages at once, and with one frame would replace each with the
+//	other forever.  Every frame is in use.
+//
+//	CLOCK and LRU clear use bits in page tables, so the machine must
+//	forget the translations it has kept, or it would not set them
+//	again.
+//----------------------------------------------------------------------
+
+int
+FrameTable::Victim(AddrSpace *space, VictimScope scope)
+{
+    int i, victim, numUnpinned = 0, numEligible = 0;
+
+    for (i = 0; i < numFrames; i++) {
+	if (pinCount[i] == 0)
+	    numUnpinned++;
+	if (Eligible(i, space, scope))
+	    numEligible++;
+    }
+    if ((numUnpinned < 2) || (numEligible == 0) ||
+	    ((scope == OwnFrames) && (numEligible < 2)))
+	return -1;
+
+    switch (policy) {
+      case PageClock:
+	for (;;) {
+	    victim = hand;
+	    hand = (hand + 1) % numFrames;
+	    if (!Eligible(victim, space, scope))
+		continue;
+	    if (!Referenced(victim))
+		break;			// cleared: a second chance
+	}
+	kernel->machine->FlushTranslations();
+	break;
+      case PageLRU:
+	victim = -1;
+	for (i = 0; i < numFrames; i++) {
+	    history[i] = (history[i] >> 1) | (Referenced(i) ? ~(~0u >> 1) : 0);
+	    if (Eligible(i, space, scope) &&
+		    ((victim == -1) || (history[i] < history[victim])))
+		victim = i;
+	}
+	kernel->machine->FlushTranslations();
+	break;
+      default:
+	victim = -1;
+	for (i = 0; i < numFrames; i++) {
+	    if (Eligible(i, space, scope) &&
+		    ((victim == -1) || (loadTime[i] < loadTime[victim])))
+		victim = i;
+	}
+	break;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Eligible
+// 	Return TRUE if the page in "frame" may be replaced on a fault of
+//	"space", within "scope".
+//----------------------------------------------------------------------
+
+bool
+FrameTable::Eligible(int frame, AddrSpace *space, VictimScope scope)
+{
+    ResidentSet *set;
+
+    if (pinCount[frame] > 0)
+	return FALSE;
+    switch (scope) {
+      case OwnFrames:
+	return owner[frame] == space;
+      case OverQuotaFrames:
+	set = owner[frame]->Resident();
+	return (owner[frame] != space) && (set->resident > set->quota);
+      default:
+	return TRUE;
+    }
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Referenced
+// 	Return TRUE if the page in "frame" was used since this was last
+//	asked, by its use bit, or the use bit sampled by Sample, and
+//	clear both.
+//----------------------------------------------------------------------
+
+bool
+FrameTable::Referenced(int frame)
+{
+    TranslationEntry *pte = owner[frame]->PageEntry(page[frame]);
+    bool used = pte->use || sampledUse[frame];
+
+    pte->use = FALSE;
+    sampledUse[frame] = FALSE;
+    return used;
+}
+
+//----------------------------------------------------------------------
+// FrameTable::Sample
+// 	Called on each timer interrupt, with demand paging.  Every
+//	SampleTicks: note which pages were used since the last sample,
+//	by their use bits -- keeping the bits for Referenced -- and count
+//	each program's working set; then set its quota by how often it
+//	faulted meanwhile: more than it has if too often, its working
+//	set if seldom.
+//
+//	Interrupts are off, so nothing changes meanwhile; a page being
+//	brought in or written out is invalid, or with a hashed page
+//	table may have no entry, and is skipped.
+//----------------------------------------------------------------------
+
+void
+FrameTable::Sample()
+{
+    int now = kernel->stats->totalTicks;
+    ListIterator<AddrSpace *> iter(spaces);
+
+    if ((kernel->swapSpace == NULL) || (now < nextSample))
+	return;
+    nextSample = now + SampleTicks;
+
+    for (; !iter.IsDone(); iter.Next())
+	iter.Item()->Resident()->workingSet = 0;
+    for (int i = 0; i < numFrames; i++) {
+	TranslationEntry *pte;
+
+	if ((owner[i] == NULL) || shared[i])
+	    continue;
+	pte = owner[i]->PageEntry(page[i]);
+	if ((pte != NULL) && pte->valid && pte->use) {
+	    lastUsed[i] = now;
+	    sampledUse[i] = TRUE;
+	    pte->use = FALSE;
+	}
+	if (now - lastUsed[i] <= WorkingSetTicks)
+	    owner[i]->Resident()->workingSet++;
+    }
+    kernel->machine->FlushTranslations();
+
+    for (iter = ListIterator<AddrSpace *>(spaces); !iter.IsDone(); iter.Next()) {
+	ResidentSet *set = iter.Item()->Resident();
+
+	if (set->faults > PFFHigh)
+	    set->quota = max(set->quota, set->resident) + set->faults;
+	else if (set->faults < PFFLow)
+	    set->quota = set->workingSet;
+	set->quota = max(min(set->quota, numFrames), MinQuota);
+	DEBUG(dbgAddr, "Address space " << iter.Item()->Asid() << ": "
+	      << set->resident << " frames, working set " << set->workingSet
+	      << ", " << set->faults << " faults, quota " << set->quota);
+	set->faults = 0;
+    }
+}
@@ -0,0 +1,206 @@
+// frametable.h
+//	Data structures for sharing physical memory among user programs:
+//	which page of which address space is in each frame.
+//
+//	No page is in memory when a program starts: the first reference
+//	to a page raises a PageFaultException, and only then is the page
+//	read from the executable, or zeroed.
+//
+//	Normally every page of a program gets a free frame when the
+//	program is loaded, to be filled on that first reference, and
+//	keeps it until the program exits; a program that does not fit in
+//	the frames left is not run.  Frames holding code can be shared
+//	by several address spaces (see sharedtext.h).
+//
+//	An address space made by Fork starts out sharing its parent's
+//	frames, copy-on-write: each is read-only in both until one
+//	writes to it, and that one then gets a copy of its own.  This is
+//	not done with demand paging, where a frame could hold a page of
+//	only one address space.
+//
+//	When Nachos is run with demand paging (-vm), a page is only given
+//	a frame on a fault: a free frame, or, if there is none, the frame
+//	of a page chosen by the replacement policy, after writing that
+//	page to the swap area if it was changed, to be read back from
+//	there next time:
+//
+//	   FIFO -- the page brought in longest ago
+//	   CLOCK -- second chance: the next page, in frame order, that
+//		has not been used since the hand last passed it
+//	   LRU -- an approximation of the page used longest ago: each
+//		time a page is to be replaced, every page's history is
+//		aged by one step, and whether it was used since the last
+//		step shifted in
+//
+//	With demand paging, a fault also brings in the pages after the
+//	faulting one that come from the same place -- consecutive swap
+//	slots, the same mapped file, or the program's code and data --
+//	with one disk request where it can (fault-around).  How many is
+//	adapted to how the program uses them: the window doubles when
+//	every page brought in ahead was touched by the next fault, and
+//	halves when none was.  Pages are only brought in ahead into free
+//	frames, or frames the policy would replace anyway.
+//
+//	Which page is replaced also depends on whose it is.  Each program
+//	has a quota of frames, set by its page fault frequency (PFF):
+//	every SampleTicks, the use bits of the pages in memory are
+//	sampled, which gives each program's working set -- the pages it
+//	used in the last WorkingSetTicks -- and its faults since the last
+//	sample are counted.  A program faulting more than PFFHigh times
+//	has its quota raised past what it has; one faulting fewer than
+//	PFFLow times has it cut to its working set.  On a fault, a
+//	program at its quota replaces one of its own pages; one under it
+//	takes a frame from a program over its quota, if there is one, or
+//	else from anyone.  So a program that thrashes gets frames from
+//	those that have more than they use, not from every program.
+//
+//	Page faults are handled one at a time.  A page being replaced is
+//	made invalid first, so that its owner faults, and waits its turn,
+//	if it touches the page while it is being written out.
+//
+//	A frame the kernel is copying a system call's buffer to or from
+//	is pinned meanwhile, and not replaced; a fault that finds fewer
+//	than two frames it could replace waits for one to be unpinned.
+//
+//	With a TLB, a page's use bit only reaches its page table entry
+//	when its TLB entry is replaced, so CLOCK and LRU see it late.
+//
+//	Pages next to each other are given frames next to each other
+//	where they can be, aligned alike, so that with superpages (-tsp)
+//	the TLB can map an aligned run of them with one entry.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FRAMETABLE_H
+#define FRAMETABLE_H
+
+#include "copyright.h"
+#include "synch.h"
+#include "list.h"
+
+class AddrSpace;
+
+#define MaxFaultAround	8	// most pages brought in ahead of a fault
+
+#define SampleTicks	1000	// how often use bits are sampled
+#define WorkingSetTicks	(4 * SampleTicks)
+				// a page used this recently is in its
+				// program's working set
+#define PFFHigh		8	// faults between samples over which a
+				// program is given more frames
+#define PFFLow		2	// and under which it is cut down to its
+				// working set
+#define MinQuota	4	// frames a program may always have
+
+
+// How the page to be replaced on a page fault is chosen.
+enum PagePolicy { PageFIFO, PageClock, PageLRU };
+
+// Whose frames a page may be put in on a fault.
+enum VictimScope { OwnFrames, OverQuotaFrames, AnyFrames };
+
+// The following class defines the frames of physical memory given to
+// the pages of user programs.
+
+class FrameTable {
+  public:
+    FrameTable(char *policyName, int numFrames);
+					// "policyName" is fifo, clock or lru;
+					// NULL means fifo.  Only the first
+					// "numFrames" frames are used
+    ~FrameTable();
+
+    bool Allocate(AddrSpace *space, unsigned int numPages);
+					// A free frame for each of the
+					// "numPages" pages of "space", or
+					// FALSE if there are not enough
+    bool AllocateShared(int numPages, int *frames);
+					// Free frames for code to be shared,
+					// or FALSE if there are not enough
+    void FreeShared(int numPages, int *frames);
+					// The code is no longer shared
+    bool Duplicate(AddrSpace *parent, AddrSpace *child,
+		   unsigned int numPages);
+					// Share the parent's frames with a
+					// copy of it, copy-on-write; FALSE
+					// if there are not enough free ones
+    bool CopyOnWrite(AddrSpace *space, unsigned int vpn);
+					// Handle a write to a page whose
+					// frame is shared that way; FALSE if
+					// it is really read-only
+    bool PageIn(AddrSpace *space, unsigned int vpn);
+					// Handle a fault on page "vpn" of
+					// "space"; FALSE if there is no
+					// such page
+    int Pin(AddrSpace *space, unsigned int vpn, bool writing);
+					// Bring page "vpn" in and keep it in
+					// its frame; -1 if there is no such
+					// page
+    void Unpin(int frame);		// It may be replaced again
+    void Free(AddrSpace *space, unsigned int vpn);
+					// Free the frame of a page that is
+					// being unmapped
+    void Release(AddrSpace *space);	// Free the frames of an address
+					// space that is going away
+    void Sample();			// Sample use bits and set quotas,
+					// if it is time; called on each
+					// timer interrupt
+
+  private:
+    void Fault(AddrSpace *space, unsigned int vpn);
+					// bring a page into a frame, and
+					// maybe some after it
+    int TakeFrame(AddrSpace *space, unsigned int vpn, bool wait);
+					// a frame for a page, replacing
+					// another if need be; -1 if there
+					// is none and not "wait"
+    void AdaptFaultAround();		// resize the window, by how many
+					// of the last pages brought in
+					// ahead were touched
+    int FreeFrame(int previous, unsigned int vpn);
+					// a frame no page is in, for page
+					// "vpn", next to "previous" if it
+					// can be; or -1
+    int FrameBefore(AddrSpace *space, unsigned int vpn);
+					// the frame of the page before, or -1
+    int NumFree();			// how many there are
+    int Victim(AddrSpace *space, VictimScope scope);
+					// frame whose page is to be replaced
+    bool Eligible(int frame, AddrSpace *space, VictimScope scope);
+					// may it be, for a fault of "space"?
+    bool Referenced(int frame);		// used since last looked at? And
+					// forget that it was
+    void Taken(int frame);		// its page no longer counts as
+					// its owner's
+
+    PagePolicy policy;
+    int numFrames;
+    AddrSpace **owner;			// address space whose page is in
+					// each frame (one of them, after
+					// Fork), or NULL if it is free
+    int *refCount;			// how many address spaces map it
+    int *pinCount;			// how many system calls are using it
+    bool *shared;			// or TRUE if it holds shared code
+    unsigned int *page;			// which of its pages
+    unsigned int *loadTime;		// FIFO: when the page was brought in
+    unsigned int *history;		// LRU: use bits of the last steps,
+					// the most recent in the top bit
+    unsigned int numLoads;		// pages brought in so far
+    int hand;				// CLOCK: next frame to look at
+    bool *prefetched;			// brought in ahead of a fault, and
+					// not yet looked at by AdaptFaultAround
+    int faultAround;			// pages to bring in ahead
+    int lastAhead[MaxFaultAround];	// frames they went in last time
+    int numLastAhead;
+    int *lastUsed;			// when each page was last seen used
+    bool *sampledUse;			// its use bit, as sampled
+    List<AddrSpace *> *spaces;		// those with frames, demand paging
+    int nextSample;			// when to sample next
+    Lock *lock;				// one page fault or allocation
+					// at a time
+    Condition *unpinned;		// a frame is no longer pinned
+};
+
+#endif // FRAMETABLE_H
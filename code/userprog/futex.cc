@@ -0,0 +1,162 @@
+// futex.cc
+//	Routines to put user threads to sleep on words of their memory,
+//	and to wake them up.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "futex.h"
+#include "main.h"
+#include "errno.h"
+
+//----------------------------------------------------------------------
+// QueueAddress, HashAddress
+// 	Helper functions for the hash table from physical addresses to
+//	wait queues.
+//----------------------------------------------------------------------
+
+static int
+QueueAddress(FutexQueue *queue)
+{
+    return queue->physAddr;
+}
+
+static unsigned
+HashAddress(int physAddr)
+{
+    return (unsigned)physAddr / sizeof(int);
+}
+
+//----------------------------------------------------------------------
+// FutexQueue::FutexQueue/~FutexQueue
+// 	Initialize the empty queue of the word at "physAddr"; de-allocate
+//	it, once no one waits on it.
+//----------------------------------------------------------------------
+
+FutexQueue::FutexQueue(int physAddr)
+{
+    this->physAddr = physAddr;
+    waiters = new DList<Thread *>(Thread::QueueLink);
+}
+
+FutexQueue::~FutexQueue()
+{
+    ASSERT(waiters->IsEmpty());
+    delete waiters;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::FutexTable/~FutexTable
+// 	Initialize an empty table; de-allocate it.  Threads still
+//	waiting are never woken; they go when Nachos does.
+//----------------------------------------------------------------------
+
+FutexTable::FutexTable()
+{
+    queues = new OpenHashTable<int, FutexQueue *>(QueueAddress, HashAddress);
+}
+
+FutexTable::~FutexTable()
+{
+    delete queues;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wait
+// 	Put the current thread to sleep on the word at user address
+//	"virtAddr", if it holds "expected", until FutexWake wakes it.
+//	The page is pinned first, which may wait for the disk; checking
+//	the word and going on the queue are then done with interrupts
+//	off, so that no wakeup comes in between.
+//
+//	Return 0 once woken, EAGAIN if the word did not hold "expected",
+//	EINVAL if "virtAddr" is not word aligned, or EFAULT if it is not
+//	a writable address of the program.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wait(int virtAddr, int expected)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    char *word;
+    FutexQueue *queue;
+    int physAddr;
+
+    if (virtAddr % sizeof(int) != 0)
+	return EINVAL;
+    word = space->PinPage(virtAddr, TRUE);
+    if (word == NULL)
+	return EFAULT;
+    physAddr = word - kernel->machine->mainMemory;
+
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    if ((int) WordToHost(*(unsigned int *) word) != expected) {
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	space->UnpinPage(virtAddr);
+	return EAGAIN;
+    }
+    if (!queues->Find(physAddr, &queue)) {
+	queue = new FutexQueue(physAddr);
+	queues->Insert(queue);
+    }
+    queue->waiters->Append(kernel->currentThread);
+    DEBUG(dbgThread, "Thread " << kernel->currentThread->getName()
+	  << " waits on futex at " << physAddr);
+    kernel->currentThread->Sleep(FALSE);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+
+    space->UnpinPage(virtAddr);
+    return 0;
+}
+
+//----------------------------------------------------------------------
+// FutexTable::Wake
+// 	Wake up to "count" of the threads waiting on the word at user
+//	address "virtAddr", those that have waited longest first.  The
+//	page of a word anyone waits on is pinned, so if it is not in
+//	memory, no one does.
+//
+//	Return how many were woken, EINVAL if "virtAddr" is not word
+//	aligned, or EFAULT if it is not an address of the program.  With
+//	priorities, the highest priority thread woken may run at once.
+//----------------------------------------------------------------------
+
+int
+FutexTable::Wake(int virtAddr, int count)
+{
+    unsigned int physAddr;
+    ExceptionType result;
+    FutexQueue *queue;
+    Thread *first = NULL;
+    int woken = 0;
+
+    if (virtAddr % sizeof(int) != 0)
+	return EINVAL;
+
+    IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+    result = kernel->currentThread->space->Translate(virtAddr, &physAddr, FALSE);
+    if (result == AddressErrorException) {
+	(void) kernel->interrupt->SetLevel(oldLevel);
+	return EFAULT;
+    }
+    if (result == NoException && queues->Find(physAddr, &queue)) {
+	while (woken < count && !queue->waiters->IsEmpty()) {
+	    Thread *thread = queue->waiters->RemoveFront();
+
+	    kernel->scheduler->ReadyToRun(thread);
+	    if (first == NULL || thread->getPriority() > first->getPriority())
+		first = thread;
+	    woken++;
+	}
+	if (queue->waiters->IsEmpty()) {
+	    queues->Remove(physAddr);
+	    delete queue;
+	}
+    }
+    if (first != NULL)
+	kernel->scheduler->CheckPreempt(first);
+    (void) kernel->interrupt->SetLevel(oldLevel);
+    return woken;
+}
@@ -0,0 +1,65 @@
+// futex.h
+//	Data structures for the futexes of user programs: wait queues
+//	keyed by the word in memory user threads wait on to change.
+//
+//	A user-level lock or semaphore is a word of memory the threads
+//	of a program update themselves, with no system call, as long as
+//	no thread has to wait.  One that has to calls FutexWait, which
+//	puts it to sleep only if the word still holds what it saw; the
+//	thread that changes the word calls FutexWake, which wakes some
+//	of those waiting on it.  The check and the going to sleep are
+//	atomic, so a wakeup between them cannot be missed.
+//
+//	The queues are keyed by the physical address of the word, so
+//	that every thread of a program -- using the same page table --
+//	finds the same queue.  The page of a waiting thread's word stays
+//	pinned in its frame while the thread waits, so the address holds
+//	still; a page shared copy-on-write is copied first, as if it were
+//	being written.  A queue exists only while someone waits on it.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include "copyright.h"
+#include "dlist.h"
+#include "openhash.h"
+#include "thread.h"
+
+// The threads waiting on one word.
+
+class FutexQueue {
+  public:
+    FutexQueue(int physAddr);
+    ~FutexQueue();
+
+    int physAddr;			// where the word is in memory
+    DList<Thread *> *waiters;		// first to wait first
+};
+
+// The following class defines the table of the futexes user threads
+// are waiting on.
+
+class FutexTable {
+  public:
+    FutexTable();			// Initialize an empty table
+    ~FutexTable();
+
+    int Wait(int virtAddr, int expected);
+					// Sleep until woken, if the current
+					// thread's word at "virtAddr" holds
+					// "expected"; 0, or a negative
+					// error code (see errno.h)
+    int Wake(int virtAddr, int count);	// Wake up to "count" threads
+					// waiting on the word at "virtAddr";
+					// how many, or a negative error code
+
+  private:
+    OpenHashTable<int, FutexQueue *> *queues;
+					// by physical address
+};
+
+#endif // FUTEX_H
@@ -1,58 +1,490 @@
-/**************************************************************
- *
- * userprog/ksyscall.h
- *
- * Kernel interface for systemcalls 
- *
- * by Marcus Voelp  (c) Universitaet Karlsruhe
- *
- **************************************************************/
-
-#ifndef __USERPROG_KSYSCALL_H__
-#define __USERPROG_KSYSCALL_H__
-
-#include "kernel.h"
-
-#include "synchconsole.h"
-
-void SysHalt()
-{
-	kernel->interrupt->Halt();
-}
-
-int SysAdd(int op1, int op2)
-{
-	return op1 + op2;
-}
-
-#ifdef FILESYS_STUB
-int SysCreate(char *filename)
-{
-	// return value
-	// 1: success
-	// 0: failed
-	return kernel->interrupt->CreateFile(filename);
-}
-#else
-int SysCreate(char *filename, int initialSize) {
-	return kernel->fileSystem->Create(filename, initialSize);
-}
-#endif
-
-int SysOpen(char *name) {
-	return kernel->fileSystem->OpenAndStore(name);
-}
-
-int SysRead(char *buf, int size, OpenFileId id) {
-	return kernel->fileSystem->Read(buf, size, id);
-}
-
-int SysWrite(char *buf, int size, OpenFileId id) {
-	return kernel->fileSystem->Write(buf, size, id);
-}
-
-int SysClose(OpenFileId id) {
-	return kernel->fileSystem->Close(id);
-}
-
-#endif /* ! __USERPROG_KSYSCALL_H__ */
+/**************************************************************
+ *
+ * userprog/ksyscall.h
+ *
+ * Kernel interface for systemcalls 
+ *
+ * by Marcus Voelp  (c) Universitaet Karlsruhe
+ *
+ **************************************************************/
+
+#ifndef __USERPROG_KSYSCALL_H__
+#define __USERPROG_KSYSCALL_H__
+
+#include "kernel.h"
+
+#include "synchconsole.h"
+#include "futex.h"
+
+void SysHalt()
+{
+	kernel->interrupt->Halt();
+}
+
+int SysAdd(int op1, int op2)
+{
+	return op1 + op2;
+}
+
+#ifdef FILESYS_STUB
+int SysCreate(char *filename)
+{
+	// return value
+	// 1: success
+	// 0: failed
+	return kernel->interrupt->CreateFile(filename);
+}
+#else
+int SysCreate(char *filename, int initialSize) {
+	return kernel->fileSystem->Create(filename, initialSize);
+}
+#endif
+
+int SysRename(char *from, char *to) {
+	return kernel->fileSystem->Rename(from, to);
+}
+
+int SysOpen(char *name) {
+	int fileIndex = kernel->fileSystem->OpenAndStore(name);
+	if (fileIndex == -1)
+		return -1;
+
+	OpenFileId id = kernel->currentThread->space->AddFile(fileIndex);
+	if (id == -1) // too many files open in this program
+		kernel->fileSystem->Close(fileIndex);
+	return id;
+}
+
+// Read and Write, and their vectored and positional forms, move the
+// bytes between the file and the program's own frames, one page of
+// its buffer at a time, each pinned while the file system fills or
+// empties it; nothing is copied through a kernel buffer.  Return -1
+// if part of the buffer is not in the program.
+
+// Move "size" bytes between the buffer at "buffer" and open file
+// table entry "fileIndex", at byte "position" of the file, or at its
+// seek position if "position" is -1.
+int UserTransfer(int buffer, int size, int fileIndex, int position, bool reading) {
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size) {
+		int chunk = min(size - done, PageSize - (int)((unsigned)(buffer + done) % PageSize));
+		char *frame = space->PinPage(buffer + done, reading);
+		if (frame == NULL)
+			return -1;
+		int moved;
+		if (position == -1)
+			moved = reading ? kernel->fileSystem->Read(frame, chunk, fileIndex)
+							: kernel->fileSystem->Write(frame, chunk, fileIndex);
+		else
+			moved = reading ? kernel->fileSystem->ReadAt(frame, chunk, position + done, fileIndex)
+							: kernel->fileSystem->WriteAt(frame, chunk, position + done, fileIndex);
+		space->UnpinPage(buffer + done);
+		done += moved;
+		if (moved < chunk) // end of file
+			break;
+	}
+	return done;
+}
+
+// Move "size" bytes between the buffer at "buffer" and the console,
+// straight into or out of the program's frames.  A read stops at the
+// end of a line, having waited for the whole line (see
+// SynchConsoleInput::Read), and moves it all at once.
+int ConsoleTransfer(int buffer, int size, bool reading) {
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+
+	while (done < size) {
+		int chunk = min(size - done, PageSize - (int)((unsigned)(buffer + done) % PageSize));
+		char *frame = space->PinPage(buffer + done, reading);
+		if (frame == NULL)
+			return -1;
+		int moved = chunk;
+		if (reading)
+			moved = kernel->ConsoleIn()->Read(frame, chunk);
+		else
+			kernel->ConsoleOut()->Write(frame, chunk);
+		space->UnpinPage(buffer + done);
+		done += moved;
+		if (reading && (moved < chunk || frame[moved - 1] == '\n'))
+			break; // end of the line, or of the input
+	}
+	return done;
+}
+
+// Move the "count" pieces of the IoVec array at "iov" in turn, at the
+// seek position, stopping at the end of the file.
+int UserTransferV(int iov, int count, OpenFileId id, bool reading) {
+	AddrSpace *space = kernel->currentThread->space;
+	int fileIndex = space->FileIndex(id);
+	int vec[2 * MaxIoVec]; // base and length of each piece
+	int done = 0;
+	if (fileIndex == -1 || count < 0 || count > MaxIoVec)
+		return -1;
+	if (!space->CopyIn(iov, (char *)vec, count * 2 * sizeof(int)))
+		return -1;
+
+	for (int i = 0; i < count; i++) {
+		int base = WordToHost(vec[2 * i]);
+		int length = WordToHost(vec[2 * i + 1]);
+		if (length < 0)
+			return -1;
+		int moved = UserTransfer(base, length, fileIndex, -1, reading);
+		if (moved == -1)
+			return -1;
+		done += moved;
+		if (moved < length)
+			break;
+	}
+	return done;
+}
+
+int SysRead(int buffer, int size, OpenFileId id) {
+	if (id == SysConsoleInput)
+		return (size < 0) ? -1 : ConsoleTransfer(buffer, size, TRUE);
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0)
+		return -1;
+	return UserTransfer(buffer, size, fileIndex, -1, TRUE);
+}
+
+int SysWrite(int buffer, int size, OpenFileId id) {
+	if (id == SysConsoleOutput)
+		return (size < 0) ? -1 : ConsoleTransfer(buffer, size, FALSE);
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0)
+		return -1;
+	return UserTransfer(buffer, size, fileIndex, -1, FALSE);
+}
+
+int SysReadV(int iov, int count, OpenFileId id) {
+	return UserTransferV(iov, count, id, TRUE);
+}
+
+int SysWriteV(int iov, int count, OpenFileId id) {
+	return UserTransferV(iov, count, id, FALSE);
+}
+
+int SysPRead(int buffer, int size, int position, OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0 || position < 0)
+		return -1;
+	return UserTransfer(buffer, size, fileIndex, position, TRUE);
+}
+
+int SysPWrite(int buffer, int size, int position, OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0 || position < 0)
+		return -1;
+	return UserTransfer(buffer, size, fileIndex, position, FALSE);
+}
+
+int SysReserve(int size, OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0)
+		return -1;
+	return kernel->fileSystem->Reserve(size, fileIndex);
+}
+
+// ReadDir packs the entries in a kernel buffer, at most a page of
+// them a call, and copies them out.
+int SysReadDir(int buffer, int size, OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	if (fileIndex == -1 || size < 0)
+		return -1;
+
+	size = min(size, PageSize);
+	char *entries = new char[size];
+	int filled = kernel->fileSystem->ReadDir(entries, size, fileIndex);
+	if (filled > 0 &&
+	    !kernel->currentThread->space->CopyOut(buffer, entries, filled))
+		filled = -1;
+	delete [] entries;
+	return filled;
+}
+
+// Stat and Fstat fill in a FileStat in the kernel and copy it out.
+int SysStat(char *name, int stat) {
+	FileStat fileStat;
+
+	if (!kernel->fileSystem->Stat(name, &fileStat) ||
+	    !kernel->currentThread->space->CopyOut(stat, (char *)&fileStat, sizeof(FileStat)))
+		return -1;
+	return 1;
+}
+
+int SysFstat(OpenFileId id, int stat) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+	FileStat fileStat;
+
+	if (fileIndex == -1 || !kernel->fileSystem->Fstat(fileIndex, &fileStat) ||
+	    !kernel->currentThread->space->CopyOut(stat, (char *)&fileStat, sizeof(FileStat)))
+		return -1;
+	return 1;
+}
+
+int SysFsync(OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+
+	if (fileIndex == -1)
+		return -1;
+	return kernel->fileSystem->Fsync(fileIndex);
+}
+
+int SysFadvise(OpenFileId id, int offset, int length, int hint) {
+	int fileIndex = kernel->currentThread->space->FileIndex(id);
+
+	if (fileIndex == -1)
+		return -1;
+	return kernel->fileSystem->Advise(fileIndex, offset, length, hint);
+}
+
+int SysSync() {
+	kernel->fileSystem->Sync();
+	return 1;
+}
+
+// The program is loaded here, so that a name that is not a program is
+// an error; it runs in a thread of its own.
+SpaceId SysExecV(int argc, char **argv) {
+	AddrSpace *space = new AddrSpace();
+	SpaceId id = -1;
+
+	if (space->Load(argv[0]) && space->SetArguments(argc, argv))
+		id = kernel->Exec(argv[0], space);
+	if (id == -1)
+		delete space;
+	return id;
+}
+
+int SysJoin(SpaceId id) {
+	return kernel->Join(id);
+}
+
+int SysThreadFork(int func, int returnAddr) {
+	return kernel->ThreadFork(func, returnAddr);
+}
+
+void SysThreadYield() {
+	kernel->currentThread->Yield();
+}
+
+int SysThreadJoin(ThreadId id) {
+	int exitCode;
+
+	if (!kernel->currentThread->space->JoinThread(id, &exitCode))
+		return -1;
+	return exitCode;
+}
+
+// ThreadExit, and Exit, end the calling thread; the last thread of
+// the program to end frees its memory and closes its files, while it
+// can still wait.
+void SysThreadExit(int exitCode) {
+	Thread *thread = kernel->currentThread;
+
+	if (thread->space->RemoveThread(thread, exitCode)) {
+		delete thread->space;
+		kernel->ProgramEnded(thread->getID(), exitCode);
+	}
+	thread->space = NULL;
+	thread->Finish();
+}
+
+int SysFutexWait(int addr, int expected) {
+	return kernel->futexTable->Wait(addr, expected);
+}
+
+int SysFutexWake(int addr, int count) {
+	return kernel->futexTable->Wake(addr, count);
+}
+
+int SysSetTickets(int tickets) {
+	Thread *thread = kernel->currentThread;
+	int old = thread->tickets;
+	if (tickets < 1 || tickets > MaxTickets)
+		return -1;
+	thread->tickets = tickets;	// running, so in no ready heap
+	return old;
+}
+
+int SysSetRealTime(int period, int deadline, int budget) {
+	Thread *thread = kernel->currentThread;
+	return kernel->scheduler->SetRealTime(thread, period, deadline, budget) ? 0 : -1;
+}
+
+int SysWaitPeriod() {
+	int wait = kernel->scheduler->JobDone(kernel->currentThread);
+	if (wait == -1)
+		return -1;
+	if (wait > 0)
+		kernel->alarm->WaitUntil(wait);
+	return 0;
+}
+
+int SysClose(OpenFileId id) {
+	int fileIndex = kernel->currentThread->space->RemoveFile(id);
+	if (fileIndex == -1)
+		return -1;
+	return kernel->fileSystem->Close(fileIndex);
+}
+
+// Mmap opens the file for the address space alone, apart from the
+// open file table: it is closed by Munmap.
+int SysMmap(char *name) {
+	OpenFile *file = kernel->fileSystem->Open(name);
+	if (file == NULL)
+		return -1;
+
+	int addr = kernel->currentThread->space->Map(file);
+	if (addr == -1)
+		delete file;
+	return addr;
+}
+
+int SysMunmap(int addr) {
+	return kernel->currentThread->space->Unmap(addr) ? 1 : -1;
+}
+
+// Submit runs a batch of operations from a ring in the program's
+// memory (see SubmitRing in syscall.h) for the cost of one trap.  The
+// ring is two words, head and tail, then the entries, of five words
+// each: the operation, its three arguments and its result.
+
+#define SubmitEntryWords 5
+
+// Run one entry's operation, "op" with arguments "arg", as its system
+// call would.
+int SubmitOne(int op, int *arg) {
+	char name[MaxStringArgument];
+
+	switch (op) {
+	case SC_Create:
+		if (!kernel->currentThread->space->CopyInString(arg[0], name, MaxStringArgument))
+			return 0;
+		return SysCreate(name, arg[1]);
+	case SC_Open:
+		if (!kernel->currentThread->space->CopyInString(arg[0], name, MaxStringArgument))
+			return -1;
+		return SysOpen(name);
+	case SC_Read:
+		return SysRead(arg[0], arg[1], arg[2]);
+	case SC_Write:
+		return SysWrite(arg[0], arg[1], arg[2]);
+	case SC_Close:
+		return SysClose(arg[0]);
+	default:
+		return -1;
+	}
+}
+
+int SysSubmit(int ring) {
+	AddrSpace *space = kernel->currentThread->space;
+	int head, tail, count = 0;
+	int entry[SubmitEntryWords];
+
+	if (!space->CopyIn(ring, (char *)&head, sizeof(int)) ||
+		!space->CopyIn(ring + sizeof(int), (char *)&tail, sizeof(int)))
+		return -1;
+	head = WordToHost(head);
+	tail = WordToHost(tail);
+	if (head < 0 || tail - head < 0 || tail - head > SubmitRingSize)
+		return -1;
+
+	for (; head != tail; head++, count++) {
+		int at = ring + 2 * sizeof(int) + (head % SubmitRingSize) * sizeof(entry);
+		if (!space->CopyIn(at, (char *)entry, sizeof(entry)))
+			return -1;
+		for (int i = 0; i < SubmitEntryWords; i++)
+			entry[i] = WordToHost(entry[i]);
+		int result = WordToHost(SubmitOne(entry[0], &entry[1]));
+		int next = WordToHost(head + 1);
+		if (!space->CopyOut(at + 4 * sizeof(int), (char *)&result, sizeof(int)) ||
+			!space->CopyOut(ring, (char *)&next, sizeof(int)))
+			return -1;
+	}
+	return count;
+}
+
+// MemCopy, MemSet and ZeroPage work a page of the program's memory at
+// a time, pinned in place, in host code.  The simulated time charged
+// is what a word at a time loop in the program would take, in steps
+// of SystemTick, so that interrupts still happen on time.
+void ChargeMemTime(int bytes) {
+	for (int ticks = (bytes + 3) / 4 * MemWordTime; ticks > 0; ticks -= SystemTick)
+		kernel->interrupt->OneTick();
+}
+
+int SysMemCopy(int to, int from, int size) {
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+	if (size < 0)
+		return -1;
+
+	while (done < size) {
+		int chunk = min(size - done, PageSize - (int)((unsigned)(to + done) % PageSize));
+		chunk = min(chunk, PageSize - (int)((unsigned)(from + done) % PageSize));
+		char *source = space->PinPage(from + done, FALSE);
+		if (source == NULL)
+			return -1;
+		char *target = space->PinPage(to + done, TRUE);
+		if (target == NULL) {
+			space->UnpinPage(from + done);
+			return -1;
+		}
+		memmove(target, source, chunk);
+		space->UnpinPage(to + done);
+		space->UnpinPage(from + done);
+		done += chunk;
+		ChargeMemTime(chunk);
+	}
+	return done;
+}
+
+int SysMemSet(int to, int value, int size) {
+	AddrSpace *space = kernel->currentThread->space;
+	int done = 0;
+	if (size < 0)
+		return -1;
+
+	while (done < size) {
+		int chunk = min(size - done, PageSize - (int)((unsigned)(to + done) % PageSize));
+		char *target = space->PinPage(to + done, TRUE);
+		if (target == NULL)
+			return -1;
+		memset(target, value, chunk);
+		space->UnpinPage(to + done);
+		done += chunk;
+		ChargeMemTime(chunk);
+	}
+	return done;
+}
+
+int SysZeroPage(int addr) {
+	return SysMemSet(addr - (int)((unsigned)addr % PageSize), 0, PageSize);
+}
+
+// The kernel's counts are kept by UsageKind, in the order of the
+// fields of ResourceUsage.
+int SysGetStats(int thread, int program) {
+	Thread *t = kernel->currentThread;
+	int id = t->space->SpaceId();
+	int none[NumUsageKinds];
+
+	ASSERT(sizeof(ResourceUsage) == sizeof(t->usage));
+	for (int i = 0; i < NumUsageKinds; i++)
+		none[i] = 0;
+	if (thread != 0 &&
+	    !t->space->CopyOut(thread, (char *)t->usage, sizeof(ResourceUsage)))
+		return -1;
+	if (program != 0 &&
+	    !t->space->CopyOut(program, (id >= 0 && id < MaxSpaces) ?
+			       (char *)kernel->stats->spaceUsage[id] : (char *)none,
+			       sizeof(ResourceUsage)))
+		return -1;
+	return 1;
+}
+
+#endif /* ! __USERPROG_KSYSCALL_H__ */
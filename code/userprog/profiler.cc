@@ -0,0 +1,481 @@
+// profiler.cc
+//	Routines to sample the stacks of user programs, symbolize them
+//	against the programs' COFF files, and write out the profile.
+//	See profiler.h.
+//
+//	The COFF files are MIPS ECOFF, little-endian: a file header
+//	pointing to a "symbolic header", which gives where the tables
+//	are -- the file descriptors, one per source file; the procedure
+//	descriptors of each; the symbols, through which a procedure
+//	descriptor gives the procedure's address and name; and the
+//	strings.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "profiler.h"
+#include "main.h"
+#include "addrspace.h"
+#include "machine.h"
+#include <stdio.h>
+
+// Offsets into the ECOFF structures used (see coff2noff/coff.h, and
+// the MIPS "sym.h")
+
+#define SymHeaderMagic	0x7009	// the symbolic header's magic number
+#define SymHeaderAt	8	// file header: offset of symbolic header
+#define NumPdsAt	24	// symbolic header: procedure descriptors
+#define PdsAt		28
+#define SymsAt		36	//  symbols
+#define StringsAt	60	//  strings
+#define NumFdsAt	72	//  file descriptors
+#define FdsAt		76
+#define FdSize		72	// file descriptor:
+#define FdStringsAt	8	//  its strings, in the strings
+#define FdSymsAt	16	//  its symbols, in the symbols
+#define FdFirstPdAt	40	//  its procedure descriptors (short)
+#define FdNumPdsAt	42	//  (short)
+#define PdSize		52	// procedure descriptor:
+#define PdSymAt		4	//  its symbol, in the file's symbols
+#define PdRegMaskAt	12
+#define PdRegOffsetAt	16
+#define PdFrameOffsetAt	32
+#define PdFrameRegAt	36	//  (short)
+#define SymSize		12	// symbol:
+#define SymStringAt	0	//  its name, in the file's strings
+#define SymValueAt	4	//  its address
+
+#define FramePtrReg	30	// the frame pointer, when one is used
+#define PrologueSize	12	// a procedure's return address is saved
+				// in its frame, and the frame pointer
+				// set, by the end of this many bytes
+
+static unsigned int
+StackKey(ProfileStack *stack)
+{
+    return stack->key;
+}
+
+static unsigned int
+HashKey(unsigned int key)
+{
+    return key;
+}
+
+static void
+DeleteStack(ProfileStack *stack)
+{
+    delete stack;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Profiler
+// 	Initialize a profiler, with no programs or samples yet.
+//
+//	"fileName" -- where to write the profile when Nachos halts
+//	"interval" -- instructions between samples
+//----------------------------------------------------------------------
+
+Profiler::Profiler(char *fileName, int interval)
+{
+    ASSERT(interval > 0);
+    this->fileName = fileName;
+    this->interval = interval;
+    numPrograms = 0;
+    stacks = new OpenHashTable<unsigned int, ProfileStack *>(StackKey,
+							      HashKey);
+    numSamples = numLost = 0;
+}
+
+//----------------------------------------------------------------------
+// Profiler::~Profiler
+// 	Write out the profile, and de-allocate it.
+//----------------------------------------------------------------------
+
+Profiler::~Profiler()
+{
+    Export();
+    stacks->Apply(DeleteStack);
+    delete stacks;
+    for (int i = 0; i < numPrograms; i++) {
+	for (int j = 0; j < programs[i].numProcs; j++)
+	    delete [] programs[i].procs[j].name;
+	delete [] programs[i].procs;
+	delete [] programs[i].name;
+    }
+}
+
+//----------------------------------------------------------------------
+// Profiler::AddProgram
+// 	A program has been loaded.  The first time, read its procedures
+//	from its COFF file.
+//
+//	"fileName" -- the program's NOFF file
+//
+// Returns:
+//	The program's number, to be passed with its samples; -1 if too
+//	many programs are being profiled.
+//----------------------------------------------------------------------
+
+int
+Profiler::AddProgram(char *fileName)
+{
+    ProfileProgram *program;
+
+    for (int i = 0; i < numPrograms; i++) {
+	if (strcmp(programs[i].name, fileName) == 0)
+	    return i;
+    }
+    if (numPrograms == MaxProfilePrograms)
+	return -1;
+    program = &programs[numPrograms];
+    program->name = new char[strlen(fileName) + 1];
+    strcpy(program->name, fileName);
+    program->procs = NULL;
+    program->numProcs = 0;
+    program->samples = program->unknown = 0;
+    ReadSymbols(program);
+    return numPrograms++;
+}
+
+//----------------------------------------------------------------------
+// Word, Short
+// 	Return the word or short at "at" in a COFF file read into memory.
+//----------------------------------------------------------------------
+
+static int
+Word(char *coff, int at)
+{
+    unsigned int word;
+
+    bcopy(coff + at, (char *)&word, sizeof(word));
+    return (int)WordToHost(word);
+}
+
+static int
+Short(char *coff, int at)
+{
+    unsigned short half;
+
+    bcopy(coff + at, (char *)&half, sizeof(half));
+    return (short)ShortToHost(half);
+}
+
+//----------------------------------------------------------------------
+// Profiler::ReadSymbols
+// 	Read the procedures of a program from "<program>.coff", and sort
+//	them by address.  If there is no COFF file, or it has no symbols,
+//	say so; its samples are then all "unknown".
+//----------------------------------------------------------------------
+
+void
+Profiler::ReadSymbols(ProfileProgram *program)
+{
+    char *coffName = new char[strlen(program->name) + 6];
+    FILE *file;
+    char *coff;
+    int size, hdr, numFds, count;
+
+    sprintf(coffName, "%s.coff", program->name);
+    file = fopen(coffName, "r");
+    if (file == NULL) {
+	cerr << "Profiler: cannot read " << coffName << "\n";
+	delete [] coffName;
+	return;
+    }
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    coff = new char[size];
+    size = fread(coff, 1, size, file);
+    fclose(file);
+
+    hdr = (size >= SymHeaderAt + 4) ? Word(coff, SymHeaderAt) : 0;
+    if ((hdr <= 0) || (hdr + FdsAt + 4 > size) ||
+	    (Short(coff, hdr) != SymHeaderMagic)) {
+	cerr << "Profiler: no symbols in " << coffName << "\n";
+	delete [] coff;
+	delete [] coffName;
+	return;
+    }
+    numFds = Word(coff, hdr + NumFdsAt);
+    program->procs = new ProfileProc[Word(coff, hdr + NumPdsAt)];
+    count = 0;
+    for (int i = 0; i < numFds; i++) {
+	int fd = Word(coff, hdr + FdsAt) + i * FdSize;
+	int strings = Word(coff, hdr + StringsAt) + Word(coff, fd + FdStringsAt);
+	int syms = Word(coff, hdr + SymsAt) + Word(coff, fd + FdSymsAt) * SymSize;
+	int firstPd = Short(coff, fd + FdFirstPdAt);
+
+	for (int j = 0; j < Short(coff, fd + FdNumPdsAt); j++) {
+	    int pd = Word(coff, hdr + PdsAt) + (firstPd + j) * PdSize;
+	    int sym = syms + Word(coff, pd + PdSymAt) * SymSize;
+	    char *name = coff + strings + Word(coff, sym + SymStringAt);
+	    ProfileProc *proc = &program->procs[count++];
+
+	    proc->address = Word(coff, sym + SymValueAt);
+	    proc->name = new char[strlen(name) + 1];
+	    strcpy(proc->name, name);
+	    proc->regMask = Word(coff, pd + PdRegMaskAt);
+	    proc->regOffset = Word(coff, pd + PdRegOffsetAt);
+	    proc->frameOffset = Word(coff, pd + PdFrameOffsetAt);
+	    proc->frameReg = Short(coff, pd + PdFrameRegAt);
+	    proc->samples = proc->inclusive = 0;
+	}
+    }
+    program->numProcs = count;
+
+    // sort by address; programs have few procedures
+    for (int i = 1; i < count; i++) {
+	ProfileProc proc = program->procs[i];
+	int j;
+
+	for (j = i; (j > 0) && (program->procs[j - 1].address > proc.address);
+		j--)
+	    program->procs[j] = program->procs[j - 1];
+	program->procs[j] = proc;
+    }
+    DEBUG(dbgAddr, "Profiler: " << count << " procedures in " << coffName);
+    delete [] coff;
+    delete [] coffName;
+}
+
+//----------------------------------------------------------------------
+// Profiler::FindProc
+// 	Return the procedure "pc" is in -- the last one starting at or
+//	before it -- or -1 if it is before them all.
+//----------------------------------------------------------------------
+
+int
+Profiler::FindProc(ProfileProgram *program, int pc)
+{
+    int low = 0, high = program->numProcs - 1, found = -1;
+
+    while (low <= high) {
+	int middle = (low + high) / 2;
+
+	if (program->procs[middle].address <= pc) {
+	    found = middle;
+	    low = middle + 1;
+	} else {
+	    high = middle - 1;
+	}
+    }
+    return found;
+}
+
+//----------------------------------------------------------------------
+// Profiler::ReadWord
+// 	Read a word of a user program's memory, without going through
+//	the machine's translation: a sample must not fault pages in, or
+//	change the use bits.  Return FALSE if the word is not in memory.
+//----------------------------------------------------------------------
+
+bool
+Profiler::ReadWord(AddrSpace *space, int virtAddr, int *value)
+{
+    TranslationEntry *pte;
+    unsigned int word;
+
+    if ((virtAddr < 0) || (virtAddr % 4 != 0))
+	return FALSE;
+    pte = space->PageEntry((unsigned) virtAddr / PageSize);
+    if ((pte == NULL) || !pte->valid)
+	return FALSE;
+    bcopy(&kernel->machine->mainMemory[pte->physicalPage * PageSize +
+				      virtAddr % PageSize],
+	  (char *)&word, sizeof(word));
+    *value = (int)WordToHost(word);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Profiler::Sample
+// 	Count the stack of the program running: the procedure the PC is
+//	in, then each caller in turn.  A procedure whose descriptor saves
+//	the return address has it in its frame, at "regOffset" from the
+//	virtual frame pointer (the frame register plus the frame size),
+//	with the caller's frame pointer below it; the caller's stack
+//	pointer is the virtual frame pointer.  A procedure that saves
+//	none -- a leaf, or one still in its prologue -- still has it in
+//	the register, which only holds for the innermost.
+//
+//	"registers" -- the user registers; the PC is of the instruction
+//	just run
+//----------------------------------------------------------------------
+
+void
+Profiler::Sample(int *registers)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    int id = (space != NULL) ? space->ProfileId() : -1;
+    ProfileProgram *program;
+    short trail[MaxProfileDepth];
+    int pc, sp, fp, depth;
+    ProfileStack *stack;
+    unsigned int key;
+
+    numSamples++;
+    if (id < 0) {
+	numLost++;
+	return;
+    }
+    program = &programs[id];
+    program->samples++;
+
+    pc = registers[PCReg];
+    sp = registers[StackReg];
+    fp = registers[FramePtrReg];
+    for (depth = 0; depth < MaxProfileDepth; ) {
+	int i = FindProc(program, pc);
+	ProfileProc *proc;
+	int vfp;
+
+	trail[depth++] = i;
+	if (i < 0)
+	    break;
+	proc = &program->procs[i];
+	if (!(proc->regMask & (1 << RetAddrReg)) ||
+		((depth == 1) && (pc - proc->address < PrologueSize))) {
+	    if (depth > 1)
+		break;			// __start, or lost
+	    pc = registers[RetAddrReg];
+	    continue;
+	}
+	vfp = ((proc->frameReg == FramePtrReg) ? fp : sp) + proc->frameOffset;
+	if ((vfp <= sp) && (depth > 1))
+	    break;			// not going up the stack
+	if (!ReadWord(space, vfp + proc->regOffset, &pc))
+	    break;
+	if (proc->regMask & (1 << FramePtrReg))
+	    (void) ReadWord(space, vfp + proc->regOffset - 4, &fp);
+	sp = vfp;
+    }
+    if (trail[0] < 0)
+	program->unknown++;
+    else
+	program->procs[trail[0]].samples++;
+
+    // look the stack up, outermost first
+    key = id;
+    for (int i = 0; i < depth; i++)
+	key = key * 31 + trail[depth - 1 - i] + 1;
+    for (;; key++) {
+	bool same;
+
+	if (!stacks->Find(key, &stack))
+	    break;
+	same = (stack->program == id) && (stack->depth == depth);
+	for (int i = 0; same && (i < depth); i++)
+	    same = (stack->procs[i] == trail[depth - 1 - i]);
+	if (same) {
+	    stack->count++;
+	    return;
+	}
+    }
+    stack = new ProfileStack;
+    stack->key = key;
+    stack->program = id;
+    stack->depth = depth;
+    for (int i = 0; i < depth; i++)
+	stack->procs[i] = trail[depth - 1 - i];
+    stack->count = 1;
+    stacks->Insert(stack);
+}
+
+//----------------------------------------------------------------------
+// Profiler::Export
+// 	Write out the flat profile -- for each program, its procedures
+//	by the samples in them, with those with the procedure anywhere
+//	on the stack -- and the stacks, folded: the program and the
+//	procedures from the outermost in, separated by ';', then the
+//	samples.
+//----------------------------------------------------------------------
+
+void
+Profiler::Export()
+{
+    char *foldedName = new char[strlen(fileName) + 8];
+    FILE *flat, *folded;
+
+    sprintf(foldedName, "%s.folded", fileName);
+    flat = fopen(fileName, "w");
+    folded = fopen(foldedName, "w");
+    if ((flat == NULL) || (folded == NULL)) {
+	cerr << "Cannot write profile " << fileName << "\n";
+	if (flat != NULL)
+	    fclose(flat);
+	if (folded != NULL)
+	    fclose(folded);
+	delete [] foldedName;
+	return;
+    }
+
+    for (OpenHashIterator<unsigned int, ProfileStack *> iter(stacks);
+	    !iter.IsDone(); iter.Next()) {
+	ProfileStack *stack = iter.Item();
+	ProfileProgram *program = &programs[stack->program];
+
+	fprintf(folded, "%s", program->name);
+	for (int i = 0; i < stack->depth; i++) {
+	    int proc = stack->procs[i];
+	    bool seen = FALSE;
+
+	    fprintf(folded, ";%s",
+		    (proc < 0) ? "[unknown]" : program->procs[proc].name);
+	    for (int j = 0; j < i; j++)
+		seen = seen || (stack->procs[j] == proc);
+	    if ((proc >= 0) && !seen)	// recursion counts once
+		program->procs[proc].inclusive += stack->count;
+	}
+	fprintf(folded, " %d\n", stack->count);
+    }
+
+    fprintf(flat, "Samples: %d, every %d instructions", numSamples,
+	    interval);
+    if (numLost > 0)
+	fprintf(flat, " (%d in no program profiled)", numLost);
+    fprintf(flat, "\n");
+    for (int i = 0; i < numPrograms; i++) {
+	ProfileProgram *program = &programs[i];
+	int total = max(program->samples, 1);
+	bool *printed = new bool[program->numProcs];
+
+	fprintf(flat, "\n%s: %d samples\n", program->name, program->samples);
+	fprintf(flat, "  %%self    self  %%total   total  procedure\n");
+	for (int j = 0; j < program->numProcs; j++)
+	    printed[j] = FALSE;
+	for (;;) {			// most samples first
+	    ProfileProc *proc = NULL;
+	    int best = -1;
+
+	    for (int j = 0; j < program->numProcs; j++) {
+		ProfileProc *p = &program->procs[j];
+
+		if (!printed[j] && (p->inclusive > 0) && ((proc == NULL) ||
+			(p->samples > proc->samples) ||
+			((p->samples == proc->samples) &&
+			 (p->inclusive > proc->inclusive)))) {
+		    proc = p;
+		    best = j;
+		}
+	    }
+	    if (proc == NULL)
+		break;
+	    printed[best] = TRUE;
+	    fprintf(flat, "%6.1f %7d %6.1f %7d  %s\n",
+		    100.0 * proc->samples / total, proc->samples,
+		    100.0 * proc->inclusive / total, proc->inclusive,
+		    proc->name);
+	}
+	if (program->unknown > 0)
+	    fprintf(flat, "%6.1f %7d                 [unknown]\n",
+		    100.0 * program->unknown / total, program->unknown);
+	delete [] printed;
+    }
+    fclose(flat);
+    fclose(folded);
+    delete [] foldedName;
+}
@@ -0,0 +1,111 @@
+// profiler.h
+//	Data structures for a sampling profiler of user programs.  Every
+//	so many instructions, the simulator hands the profiler the user
+//	registers; it finds the procedure the PC is in, walks the stack
+//	back to the procedure that called it, and so on up to __start,
+//	and counts the call stack found.
+//
+//	Procedures are found from the symbol table of the program's COFF
+//	file, which coff2noff leaves out of the NOFF file Nachos runs: the
+//	profile of program "foo" is symbolized against "foo.coff", read
+//	from the host file system.  The COFF procedure descriptors also
+//	say where each procedure's frame keeps the return address, which
+//	is what lets the stack be walked.
+//
+//	When Nachos halts, a flat profile is written -- the samples in
+//	each procedure, and under it -- and the stacks, one per line in
+//	the "folded" format that flame graph tools read.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "openhash.h"
+
+#define ProfileInterval		1000	// default instructions between
+					// samples
+#define MaxProfileDepth		32	// frames kept of a stack
+#define MaxProfilePrograms	16	// different programs profiled
+
+class AddrSpace;
+
+// The following class defines a procedure of a user program, as the
+// COFF file describes it.
+
+class ProfileProc {
+  public:
+    int address;		// where its code starts
+    char *name;
+    unsigned int regMask;	// registers its frame saves
+    int regOffset;		// where the highest of them is saved,
+				// from the virtual frame pointer
+    int frameOffset;		// frame size
+    int frameReg;		// register the frame is addressed from
+    int samples;		// samples with the PC in it
+    int inclusive;		// samples with it anywhere on the stack
+};
+
+// The following class defines one of the programs profiled.
+
+class ProfileProgram {
+  public:
+    char *name;			// its NOFF file
+    ProfileProc *procs;		// its procedures, by address
+    int numProcs;		// 0 if there is no COFF file
+    int samples;		// samples taken in it
+    int unknown;		// of those, with the PC in no procedure
+};
+
+// The following class defines a distinct call stack sampled.
+
+class ProfileStack {
+  public:
+    unsigned int key;		// hash of program and procedures
+    int program;
+    int depth;
+    short procs[MaxProfileDepth]; // outermost first; -1 if unknown
+    int count;			// samples with this stack
+};
+
+// The following class defines the profiler.
+
+class Profiler {
+  public:
+    Profiler(char *fileName, int interval);
+				// Profile every "interval" instructions;
+				// write to "fileName" at the end
+    ~Profiler();		// Write the profile out
+
+    int Interval() { return interval; }
+
+    int AddProgram(char *fileName);
+				// A program was loaded: read its symbols
+				// if new; returns its number
+    void Sample(int *registers);
+				// Count the stack of the running program
+
+  private:
+    char *fileName;		// where to write the flat profile; the
+				// stacks go to "fileName".folded
+    int interval;
+    ProfileProgram programs[MaxProfilePrograms];
+    int numPrograms;
+    OpenHashTable<unsigned int, ProfileStack *> *stacks;
+    int numSamples;		// samples taken
+    int numLost;		// of those, in no program profiled
+
+    void ReadSymbols(ProfileProgram *program);
+				// Find its procedures in the COFF file
+    int FindProc(ProfileProgram *program, int pc);
+				// Procedure the PC is in, or -1
+    bool ReadWord(AddrSpace *space, int virtAddr, int *value);
+				// Read user memory, if in a frame
+    void Export();		// Write the profile out
+};
+
+#endif // PROFILER_H
@@ -0,0 +1,111 @@
+// sharedtext.cc
+//	Routines to manage the table of code pages shared by the address
+//	spaces running the same executable.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "sharedtext.h"
+#include "frametable.h"
+
+//----------------------------------------------------------------------
+// SharedText::SharedText/~SharedText
+// 	Describe the code pages "firstPage" .. "firstPage" + "numPages"
+//	- 1 of the executable whose header is at "sector", none of them
+//	loaded yet; de-allocate it.
+//----------------------------------------------------------------------
+
+SharedText::SharedText(int sector, int firstPage, int numPages)
+{
+    this->sector = sector;
+    this->firstPage = firstPage;
+    this->numPages = numPages;
+    frames = new int[numPages];
+    loaded = new bool[numPages];
+    for (int i = 0; i < numPages; i++)
+	loaded[i] = FALSE;
+    refCount = 0;
+}
+
+SharedText::~SharedText()
+{
+    delete [] frames;
+    delete [] loaded;
+}
+
+//----------------------------------------------------------------------
+// TextTable::TextTable/~TextTable
+// 	Initialize an empty table; de-allocate it.
+//----------------------------------------------------------------------
+
+TextTable::TextTable()
+{
+    texts = new List<SharedText *>;
+}
+
+TextTable::~TextTable()
+{
+    while (!texts->IsEmpty())
+	delete texts->RemoveFront();
+    delete texts;
+}
+
+//----------------------------------------------------------------------
+// TextTable::Get
+// 	Return the shared code of the executable whose header is in
+//	"sector", with frames for its pages, for a new address space to
+//	use.  The caller must give it back with Put.
+//
+//	Return NULL if it is not shared yet and there are not enough free
+//	frames for it.
+//
+//	"firstPage", "numPages" -- the pages of the executable that are
+//		only code
+//----------------------------------------------------------------------
+
+SharedText *
+TextTable::Get(int sector, int firstPage, int numPages)
+{
+    ListIterator<SharedText *> iter(texts);
+    SharedText *text;
+
+    for (; !iter.IsDone(); iter.Next()) {
+	text = iter.Item();
+	if (text->sector == sector) {
+	    ASSERT(text->firstPage == firstPage && text->numPages == numPages);
+	    DEBUG(dbgAddr, "Sharing the code of the executable at sector " << sector);
+	    text->refCount++;
+	    return text;
+	}
+    }
+
+    text = new SharedText(sector, firstPage, numPages);
+    if (!kernel->frameTable->AllocateShared(numPages, text->frames)) {
+	delete text;
+	return NULL;
+    }
+    text->refCount = 1;
+    texts->Append(text);
+    return text;
+}
+
+//----------------------------------------------------------------------
+// TextTable::Put
+// 	Give back shared code obtained with Get.  When the last address
+//	space using it is done, free its frames.
+//----------------------------------------------------------------------
+
+void
+TextTable::Put(SharedText *text)
+{
+    ASSERT(text->refCount > 0);
+    if (--text->refCount > 0)
+	return;
+
+    kernel->frameTable->FreeShared(text->numPages, text->frames);
+    texts->Remove(text);
+    delete text;
+}
@@ -0,0 +1,61 @@
+// sharedtext.h
+//	Data structures for sharing the code of a program among all the
+//	address spaces running it.
+//
+//	A page that holds nothing but code is never written -- it is
+//	mapped read-only -- so every address space loaded from the same
+//	executable can use the same frame for it.  The executable is
+//	known by the sector of its file header.  Each shared page is read
+//	from the executable only once, by the first address space to
+//	touch it, and its frame is freed when the last address space
+//	sharing it goes away.
+//
+//	With demand paging (-vm), code is not shared: each address space
+//	pages in its own, and replaces it like any other page.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SHAREDTEXT_H
+#define SHAREDTEXT_H
+
+#include "copyright.h"
+#include "list.h"
+
+// The code pages of one executable, in frames shared by the address
+// spaces running it.
+
+class SharedText {
+  public:
+    SharedText(int sector, int firstPage, int numPages);
+    ~SharedText();
+
+    int sector;			// header sector of the executable
+    int firstPage;		// first virtual page that is only code
+    int numPages;		// how many such pages there are
+    int *frames;		// frame of each page
+    bool *loaded;		// has it been read from the executable?
+    int refCount;		// number of address spaces sharing it
+};
+
+// The following class defines the table of the code shared by the
+// address spaces there are.
+
+class TextTable {
+  public:
+    TextTable();			// Initialize an empty table
+    ~TextTable();
+
+    SharedText *Get(int sector, int firstPage, int numPages);
+					// Share the code of the executable
+					// whose header is at "sector", giving
+					// it frames if it is not shared yet;
+					// NULL if there are not enough
+    void Put(SharedText *text);		// Done with it
+
+  private:
+    List<SharedText *> *texts;		// code in use
+};
+
+#endif // SHAREDTEXT_H
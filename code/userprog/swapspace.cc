@@ -0,0 +1,93 @@
+// swapspace.cc
+//	Routines to give out the slots of the swap area, and to move
+//	pages between memory and their slots.
+//
+//	Slot i is sector SwapStart + i.  Moving a page waits for the
+//	disk, so the calling thread sleeps meanwhile.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "swapspace.h"
+#include "synchdisk.h"
+#include "machine.h"
+
+//----------------------------------------------------------------------
+// SwapSpace::SwapSpace
+// 	Get ready to page to the swap area, with every slot free.
+//----------------------------------------------------------------------
+
+SwapSpace::SwapSpace()
+{
+    ASSERT(PageSize == SectorSize);	// a page is exactly one sector
+    slots = new Bitmap(SwapSectors);
+}
+
+SwapSpace::~SwapSpace()
+{
+    delete slots;
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Allocate
+// 	Return a free slot, now in use, or -1 if the swap area is full.
+//----------------------------------------------------------------------
+
+int
+SwapSpace::Allocate()
+{
+    return slots->FindAndSet();
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::Free
+// 	Give back a slot whose page is of no further use.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::Free(int slot)
+{
+    ASSERT(slots->Test(slot));
+    slots->Clear(slot);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::ReadPage
+// SwapSpace::WritePage
+// 	Copy a page between memory and its slot.
+//
+//	"slot" -- a slot in use
+//	"into", "from" -- the page, PageSize bytes
+//----------------------------------------------------------------------
+
+void
+SwapSpace::ReadPage(int slot, char *into)
+{
+    ASSERT(slots->Test(slot));
+    kernel->synchDisk->ReadSector(SwapStart + slot, into);
+}
+
+void
+SwapSpace::WritePage(int slot, char *from)
+{
+    ASSERT(slots->Test(slot));
+    kernel->synchDisk->WriteSector(SwapStart + slot, from);
+}
+
+//----------------------------------------------------------------------
+// SwapSpace::ReadPages
+// 	Copy the pages of the "count" slots from "firstSlot" on into
+//	memory, "into[i]" getting the i'th, with a single disk request.
+//----------------------------------------------------------------------
+
+void
+SwapSpace::ReadPages(int firstSlot, int count, char **into)
+{
+    for (int i = 0; i < count; i++) {
+	ASSERT(slots->Test(firstSlot + i));
+    }
+    kernel->synchDisk->ReadSectors(SwapStart + firstSlot, count, into);
+}
@@ -0,0 +1,50 @@
+// swapspace.h
+//	Data structures for the swap area: the part of the disk where
+//	demand paging keeps the pages of user programs.
+//
+//	The swap area is a fixed region of the disk, just before the
+//	journal's log, holding one page per sector (a page is as big as
+//	a sector).  The file system never gives these sectors out:
+//	formatting marks them in use, and the file system check claims
+//	them.  Pages go to and from the disk directly, not through the
+//	buffer cache, since no file system block ever lives there.
+//
+//	Which slots are in use is only kept in memory: swap space is
+//	empty each time Nachos starts.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SWAPSPACE_H
+#define SWAPSPACE_H
+
+#include "copyright.h"
+#include "bitmap.h"
+#include "journal.h"
+
+#define SwapSectors 8192	// size of the swap area, in pages
+#define SwapStart (JournalStart - SwapSectors)
+
+// The following class defines the slots of the swap area, each of
+// which can hold one page.
+
+class SwapSpace {
+  public:
+    SwapSpace();			// every slot starts out free
+    ~SwapSpace();
+
+    int Allocate();			// a free slot, or -1 if there is none
+    void Free(int slot);		// give a slot back
+
+    void ReadPage(int slot, char *into);	// copy a page in from its slot
+    void WritePage(int slot, char *from);	// and out to it
+    void ReadPages(int firstSlot, int count, char **into);
+					// copy in the pages of consecutive
+					// slots, with one disk request
+
+  private:
+    Bitmap *slots;			// slots in use
+};
+
+#endif // SWAPSPACE_H
@@ -2,12 +2,21 @@
 //	Routines providing synchronized access to the keyboard 
 //	and console display hardware devices.
 //
+//	Input is buffered too, and read a line at a time: the reader is
+//	only woken when a line, or as much as it asked for, is there.
+//
+//	Output is buffered: a writer only waits when the buffer is full.
+//	Whenever the display finishes, the interrupt handler hands it
+//	everything buffered since, so the host gets one write per batch
+//	rather than one per character.
+//
 // Copyright (c) 1992-1996 The Regents of the University of California.
 // All rights reserved.  See copyright.h for copyright notice and limitation 
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
 #include "synchconsole.h"
+#include "main.h"
 
 //----------------------------------------------------------------------
 // SynchConsoleInput::SynchConsoleInput
@@ -22,6 +31,8 @@ SynchConsoleInput::SynchConsoleInput(char *inputFile)
     consoleInput = new ConsoleInput(inputFile, this);
     lock = new Lock("console in");
     waitFor = new Semaphore("console in", 0);
+    first = count = lines = wanted = 0;
+    atEnd = keyPending = FALSE;
 }
 
 //----------------------------------------------------------------------
@@ -39,6 +50,7 @@ SynchConsoleInput::~SynchConsoleInput()
 //----------------------------------------------------------------------
 // SynchConsoleInput::GetChar
 //      Read a character typed at the keyboard, waiting if necessary.
+//	Returns EOF at end of file.
 //----------------------------------------------------------------------
 
 char
@@ -46,23 +58,113 @@ SynchConsoleInput::GetChar()
 {
     char ch;
 
+    if (Read(&ch, 1) == 0)
+	return EOF;
+    return ch;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::Ready
+//      Return TRUE if a read of "n" characters need not wait: that many
+//	have been typed, or a whole line, or no more ever will be.  A
+//	full buffer counts too, since nothing more can be typed into it.
+//	Interrupts are off.
+//----------------------------------------------------------------------
+
+bool
+SynchConsoleInput::Ready(int n)
+{
+    return (count >= n) || (lines > 0) || atEnd ||
+	   (count == ConsoleBufferSize);
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::Read
+//      Read what has been typed at the keyboard, a line at a time:
+//	wait until "n" characters, or a whole line, are there, and copy
+//	them out, up to and including the newline.  The reader is only
+//	woken once, however many keystrokes it waits for.
+//
+//	"buf" -- where to put the characters
+//	"n" -- the most to read
+//
+// Returns:
+//	The number read: 0 only at end of file.
+//----------------------------------------------------------------------
+
+int
+SynchConsoleInput::Read(char *buf, int n)
+{
+    IntStatus oldLevel;
+    int done = 0;
+
     lock->Acquire();
-    waitFor->P();	// wait for EOF or a char to be available.
-    ch = consoleInput->GetChar();
+    oldLevel = kernel->interrupt->SetLevel(IntOff);
+    while (!Ready(n)) {
+	wanted = n;
+	waitFor->P();			// CallBack wakes us when Ready
+    }
+    while ((done < n) && (count > 0)) {
+	char ch = buffer[first];
+
+	first = (first + 1) % ConsoleBufferSize;
+	count--;
+	buf[done++] = ch;
+	if (ch == '\n') {
+	    lines--;
+	    break;
+	}
+    }
+    if (keyPending)			// there is room for it now
+	TakeKey();
+    (void) kernel->interrupt->SetLevel(oldLevel);
     lock->Release();
-    return ch;
+    return done;
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleInput::TakeKey
+//      Take the keystroke the keyboard is holding into the buffer, if
+//	there is room; otherwise leave it there until a read makes some.
+//	Taking it lets the keyboard go on to the next.  Interrupts are
+//	off.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleInput::TakeKey()
+{
+    char ch;
+
+    if (count == ConsoleBufferSize) {
+	keyPending = TRUE;
+	return;
+    }
+    keyPending = FALSE;
+    ch = consoleInput->GetChar();
+    if (ch == EOF) {
+	atEnd = TRUE;
+	return;
+    }
+    buffer[(first + count) % ConsoleBufferSize] = ch;
+    count++;
+    if (ch == '\n')
+	lines++;
 }
 
 //----------------------------------------------------------------------
 // SynchConsoleInput::CallBack
-//      Interrupt handler called when keystroke is hit; wake up
-//	anyone waiting.
+//      Interrupt handler called when keystroke is hit; buffer it, and
+//	wake the reader once it has what it is waiting for.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleInput::CallBack()
 {
-    waitFor->V();
+    TakeKey();
+    if ((wanted > 0) && Ready(wanted)) {
+	wanted = 0;
+	waitFor->V();
+    }
 }
 
 //----------------------------------------------------------------------
@@ -78,15 +180,25 @@ SynchConsoleOutput::SynchConsoleOutput(char *outputFile)
     consoleOutput = new ConsoleOutput(outputFile, this);
     lock = new Lock("console out");
     waitFor = new Semaphore("console out", 0);
+    first = count = putting = 0;
+    writerWaiting = FALSE;
 }
 
 //----------------------------------------------------------------------
 // SynchConsoleOutput::~SynchConsoleOutput
 //      Deallocate data structures for synchronized access to the keyboard
+//	Anything still buffered is put out first, at once.
 //----------------------------------------------------------------------
 
 SynchConsoleOutput::~SynchConsoleOutput()
 { 
+    int rest = count - putting;		// those being put out are
+						// already on the host
+    int start = (first + putting) % ConsoleBufferSize;
+    int tail = min(rest, ConsoleBufferSize - start);
+
+    consoleOutput->PutNow(&buffer[start], tail);
+    consoleOutput->PutNow(buffer, rest - tail);
     delete consoleOutput; 
     delete lock; 
     delete waitFor;
@@ -99,21 +211,83 @@ SynchConsoleOutput::~SynchConsoleOutput()
 
 void
 SynchConsoleOutput::PutChar(char ch)
+{
+    Write(&ch, 1);
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::PutString
+//      Write a null-terminated string to the console display.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::PutString(char *s)
+{
+    Write(s, strlen(s));
+}
+
+//----------------------------------------------------------------------
+// SynchConsoleOutput::Write
+//      Write characters to the console display: put them in the
+//	buffer, starting the display if it is idle, and return.  Wait
+//	only while the buffer is full.
+//
+//	"buf" -- the characters
+//	"n" -- how many
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::Write(char *buf, int n)
 {
     lock->Acquire();
-    consoleOutput->PutChar(ch);
-    waitFor->P();
+    while (n > 0) {
+	IntStatus oldLevel = kernel->interrupt->SetLevel(IntOff);
+
+	if (count == ConsoleBufferSize) {
+	    writerWaiting = TRUE;
+	    waitFor->P();			// the display makes room
+	} else {
+	    for (; (n > 0) && (count < ConsoleBufferSize); n--, count++)
+		buffer[(first + count) % ConsoleBufferSize] = *buf++;
+	    if (putting == 0)
+		StartOutput();
+	}
+	(void) kernel->interrupt->SetLevel(oldLevel);
+    }
     lock->Release();
 }
 
+//----------------------------------------------------------------------
+// SynchConsoleOutput::StartOutput
+//      Hand the display every character buffered that is not yet being
+//	put out, as far as the end of the buffer.  Interrupts are off.
+//----------------------------------------------------------------------
+
+void
+SynchConsoleOutput::StartOutput()
+{
+    ASSERT(putting == 0);
+    putting = min(count, ConsoleBufferSize - first);
+    if (putting > 0)
+	consoleOutput->PutChars(&buffer[first], putting);
+}
+
 //----------------------------------------------------------------------
 // SynchConsoleOutput::CallBack
 //      Interrupt handler called when it's safe to send the next 
-//	character can be sent to the display.
+//	character can be sent to the display.  Free the room the
+//	characters just put out took, and start on the rest.
 //----------------------------------------------------------------------
 
 void
 SynchConsoleOutput::CallBack()
 {
-    waitFor->V();
+    first = (first + putting) % ConsoleBufferSize;
+    count -= putting;
+    putting = 0;
+    StartOutput();
+    if (writerWaiting) {
+	writerWaiting = FALSE;
+	waitFor->V();
+    }
 }
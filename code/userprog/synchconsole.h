@@ -17,6 +17,10 @@
 #include "console.h"
 #include "synch.h"
 
+#define ConsoleBufferSize	256	// characters written and not yet
+					// put out to the display, or typed
+					// and not yet read
+
 // The following two classes define synchronized input and output to
 // a console device
 
@@ -28,12 +32,30 @@ class SynchConsoleInput : public CallBackObj {
 	void Disable() { consoleInput->Disable(); }// 2015.11.25
 
     char GetChar();		// Read a character, waiting if necessary
+    int Read(char *buf, int n);	// Read up to "n" characters, up to and
+				// including the end of a line, waiting
+				// until there are that many or a whole
+				// line has been typed
     
   private:
     ConsoleInput *consoleInput;	// the hardware keyboard
     Lock *lock;			// only one reader at a time
     Semaphore *waitFor;		// wait for callBack
 
+    char buffer[ConsoleBufferSize];	// characters typed and not yet
+				// read, a circular queue; only touched
+				// with interrupts off
+    int first;			// where the oldest is
+    int count;			// how many there are
+    int lines;			// how many newlines among them
+    bool atEnd;			// has the keyboard reached end of file?
+    bool keyPending;		// is a keystroke left in the keyboard,
+				// for want of room?
+    int wanted;			// characters the waiting reader needs,
+				// or 0 if no reader is waiting
+
+    bool Ready(int n);		// can a read of "n" go ahead?
+    void TakeKey();		// move a keystroke into the buffer
     void CallBack();		// called when a keystroke is available
 };
 
@@ -42,13 +64,26 @@ class SynchConsoleOutput : public CallBackObj {
     SynchConsoleOutput(char *outputFile); // Initialize the console device
     ~SynchConsoleOutput();
 
-    void PutChar(char ch);	// Write a character, waiting if necessary
+    void PutChar(char ch);	// Write a character, waiting only if
+				// the buffer is full
+    void PutString(char *s);	// Write a null-terminated string
+    void Write(char *buf, int n);	// Write "n" characters
    
   private:
     ConsoleOutput *consoleOutput;// the hardware display
     Lock *lock;			// only one writer at a time
     Semaphore *waitFor;		// wait for callBack
 
+    char buffer[ConsoleBufferSize];	// characters waiting to go out,
+				// a circular queue; only touched with
+				// interrupts off
+    int first;			// where the oldest is
+    int count;			// how many there are
+    int putting;		// how many of the oldest the display
+				// is putting out now
+    bool writerWaiting;		// is the writer waiting for room?
+
+    void StartOutput();		// hand the display the next characters
     void CallBack();		// called when more data can be written
 };
 
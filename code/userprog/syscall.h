@@ -34,6 +34,31 @@
 #define SC_ExecV	13
 #define SC_ThreadExit   14
 #define SC_ThreadJoin   15
+#define SC_Fork		16
+#define SC_ReadV	17
+#define SC_WriteV	18
+#define SC_PRead	19
+#define SC_PWrite	20
+#define SC_Submit	21
+#define SC_Mmap		22
+#define SC_Munmap	23
+#define SC_Reserve	24
+#define SC_ReadDir	25
+#define SC_Rename	26
+#define SC_Stat		27
+#define SC_Fstat	28
+#define SC_FutexWait	29
+#define SC_FutexWake	30
+#define SC_MemCopy	31
+#define SC_MemSet	32
+#define SC_ZeroPage	33
+#define SC_SetTickets	34
+#define SC_SetRealTime	35
+#define SC_WaitPeriod	36
+#define SC_GetStats	37
+#define SC_Fsync	38
+#define SC_Sync		39
+#define SC_Fadvise	40
 #define SC_Add		42
 #define SC_MSG		100
 
@@ -80,14 +105,23 @@ SpaceId Exec(char* exec_name);
 
 /* Run the executable, stored in the Nachos file "argv[0]", with
  * parameters stored in argv[1..argc-1] and return the 
- * address space identifier
+ * address space identifier, or -1 if it cannot be run.  Its main()
+ * is passed argc and argv.
  */
 SpaceId ExecV(int argc, char* argv[]);
  
 /* Only return once the user program "id" has finished.  
- * Return the exit status.
+ * Return the exit status, or -1 if "id" is not a program that can
+ * be joined: each can be joined once.
  */
 int Join(SpaceId id); 	
+
+/* Run a copy of this user program, which goes on from the return of
+ * Fork: its memory, copy-on-write, and its open files.  Return the 
+ * child's SpaceId in the parent, 0 in the child, or a negative error 
+ * code if there is no room for the copy.
+ */
+SpaceId Fork();
  
 
 /* File system operations: Create, Remove, Open, Read, Write, Close
@@ -121,6 +155,14 @@ int Create(char *name, int size); // FILE_SYS
 /* Remove a Nachos file, with name "name" */
 int Remove(char *name);
 
+/* Give the Nachos file or directory "from" the name "to", which may be
+ * in another directory.  A file already called "to" is replaced, in
+ * one step: a program opening "to" finds either the old file or the
+ * new one.  Return 1 on success, 0 if "from" does not exist or "to"
+ * is a directory.
+ */
+int Rename(char *from, char *to);
+
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
  * be used to read and write to the file.
  */
@@ -145,6 +187,141 @@ int Read(char *buffer, int size, OpenFileId id);
  */
 int Seek(int position, OpenFileId id);
 
+/* A piece of a buffer, for ReadV and WriteV */
+typedef struct {
+    char *base;		/* where it starts */
+    int length;		/* how many bytes it has */
+} IoVec;
+
+#define MaxIoVec	16	/* most pieces ReadV and WriteV take */
+
+/* Read into, or write from, the "count" pieces of "iov" in turn, as
+ * one Read or Write of them all would, with a single system call.
+ * Return the number of bytes transferred, stopping short at the end 
+ * of the file, or a negative error code on failure.
+ */
+int ReadV(IoVec *iov, int count, OpenFileId id);
+int WriteV(IoVec *iov, int count, OpenFileId id);
+
+/* Read or write "size" bytes at byte "position" of the open file,
+ * without a Seek: its seek position is left where it is.
+ * Return as Read and Write do.
+ */
+int PRead(char *buffer, int size, int position, OpenFileId id);
+int PWrite(char *buffer, int size, int position, OpenFileId id);
+
+/* One operation for Submit: a Create, Open, Read, Write or Close, with
+ * the arguments that system call takes, in order (pointers as ints).
+ * The kernel fills in "result" with what the system call returns.
+ */
+typedef struct {
+    int op;		/* SC_Create, SC_Open, SC_Read, SC_Write or SC_Close */
+    int arg[3];		/* its arguments; those it does not take are unused */
+    int result;
+} SubmitEntry;
+
+#define SubmitRingSize	32
+
+/* A ring of operations shared with the kernel.  The program fills in
+ * the entry at "tail" (modulo SubmitRingSize) and advances "tail";
+ * Submit runs the entries from "head" up to "tail", in order, and
+ * advances "head" past each one as it completes; the program may then
+ * pick up its result.  Both only ever grow.
+ */
+typedef struct {
+    int head;		/* next entry for the kernel to run */
+    int tail;		/* next entry for the program to fill in */
+    SubmitEntry entries[SubmitRingSize];
+} SubmitRing;
+
+/* Run every operation submitted to "ring", with a single system call.
+ * Return how many were run, or a negative error code if the ring is 
+ * not in the address space, or holds more than SubmitRingSize entries.
+ */
+int Submit(SubmitRing *ring);
+
+/* Map the Nachos file "name" into the address space, after everything
+ * else in it, and return the address of its first byte; reading and
+ * writing there reads and writes the file.  Changes reach the file by
+ * Munmap, or when the program exits.  Return -1 if the file cannot be
+ * opened, is empty, or there is no room for it.
+ */
+int Mmap(char *name);
+
+/* Unmap the file mapped at "addr" by Mmap, writing back what was 
+ * changed.  Return 1 on success, -1 if no file is mapped there.
+ */
+int Munmap(int addr);
+
+/* Allocate disk space for the open file to grow to "size" bytes,
+ * without making it longer, so that appending to it later is cheap
+ * and its data ends up together on disk.  Writing past the end of a
+ * file makes it longer in any case.  Return 1, or -1 if there is no
+ * such file or not enough free space.
+ */
+int Reserve(int size, OpenFileId id);
+
+/* One entry of a directory, as ReadDir returns it.  The entries are
+ * packed one after another, each "length" bytes long: the name, with
+ * its '\0', padded to a multiple of 4 bytes.
+ */
+typedef struct {
+    int length;		/* bytes in this entry, the name included */
+    int isDirectory;	/* 1 for a subdirectory, 0 for a file */
+    char name[4];	/* really as long as it needs to be */
+} DirEnt;
+
+#define DirEntSize(nameLength)	((8 + (nameLength) + 1 + 3) & ~3)
+
+/* Read as many entries of the open directory as fit in "size" bytes
+ * of "buffer", carrying on from where the last ReadDir of it stopped.
+ * Open a directory by its path, like a file ("/" is the root).
+ * Return the number of bytes filled in, 0 once every entry has been
+ * read, or -1 if "id" is not a directory or "buffer" cannot hold the
+ * next entry.
+ */
+int ReadDir(char *buffer, int size, OpenFileId id);
+
+/* What Stat and Fstat say about a file or directory. */
+typedef struct FileStat {
+    int size;		/* bytes in it */
+    int isDirectory;	/* 1 for a directory, 0 for a file */
+    int numSectors;	/* data sectors allocated to it */
+} FileStat;
+
+/* Fill in "stat" for the file or directory "name", or for the open
+ * file "id", without opening or reading it.  Return 1, or -1 if
+ * there is no such file.
+ */
+int Stat(char *name, FileStat *stat);
+int Fstat(OpenFileId id, FileStat *stat);
+
+/* Writes are kept in the kernel's buffer cache, and reach the disk
+ * later.  Fsync returns once what has been written to the open file
+ * "id" is on disk, and would survive a crash: 1, or -1 if "id" is not
+ * open.  Sync does the same for every file, and returns 1.
+ */
+int Fsync(OpenFileId id);
+int Sync();
+
+/* How a program can say an open file will be used, for Fadvise. */
+#define AdviseNormal	 0	/* no idea: read ahead if read in order */
+#define AdviseSequential 1	/* read in order, once: read well ahead,
+				 * and keep little of it cached */
+#define AdviseRandom	 2	/* read out of order: do not read ahead */
+#define AdviseWillNeed	 3	/* the range will be read soon: start
+				 * reading it in now */
+#define AdviseDontNeed	 4	/* the range will not be read again soon:
+				 * it need not stay cached */
+
+/* Tell the kernel how the bytes of the open file "id" from "offset"
+ * on, "length" of them (0 for all the rest), will be used.  Only the
+ * last two hints are about the range; the others are about the whole
+ * file.  This is advice: what is read and written is the same either
+ * way.  Return 1, or -1 if "id" is not open or "hint" is unknown.
+ */
+int Fadvise(OpenFileId id, int offset, int length, int hint);
+
 /* Close the file, we're done reading and writing to it.
  * Return 1 on success, negative error code on failure
  */
@@ -158,8 +335,10 @@ int Close(OpenFileId id);
  */
 
 /* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+ * as the current thread, on a stack of its own.  If "func" returns,
+ * the thread exits with ThreadExit(0).
  * Return a positive ThreadId on success, negative error code on failure
+ * (the first thread of a program is 0)
  */
 ThreadId ThreadFork(void (*func)());
 
@@ -170,15 +349,89 @@ void ThreadYield();
 
 /*
  * Blocks current thread until lokal thread ThreadID exits with ThreadExit.
- * Function returns the ExitCode of ThreadExit() of the exiting thread.
+ * Function returns the ExitCode of ThreadExit() of the exiting thread,
+ * or -1 if there is no such thread, or another thread joins it already.
+ * A thread that exits keeps its ThreadId until it is joined.
  */
 int ThreadJoin(ThreadId id);
 
 /*
  * Deletes current thread and returns ExitCode to every waiting lokal thread.
+ * The program ends when its last thread exits, by ThreadExit or Exit:
+ * Exit ends the calling thread only.
  */
 void ThreadExit(int ExitCode);	
 
+/* Futexes, for locks and the like kept by the threads of a program
+ * in their own memory, that need the kernel only to wait.  FutexWait
+ * puts the thread to sleep if the word at "addr" still holds
+ * "expected", checking and sleeping in one step, and returns 0 once
+ * FutexWake wakes it, or EAGAIN at once if the word had changed.
+ * FutexWake wakes up to "count" of the threads waiting on the word at
+ * "addr", and returns how many.  Either returns EINVAL if "addr" is
+ * not word aligned, or EFAULT if it is not in the address space.
+ */
+int FutexWait(int *addr, int expected);
+int FutexWake(int *addr, int count);
+
+/* Give the calling thread "tickets" tickets, from 1 to 10000 (100 to
+ * begin with).  With stride scheduling (-sp stride), threads get the
+ * CPU in proportion to their tickets; otherwise they make no
+ * difference.  Return the tickets it had, or -1 if "tickets" is out
+ * of range.
+ */
+int SetTickets(int tickets);
+
+/* Make the calling thread real-time: from now on, a job is released
+ * every "period" ticks, due "deadline" ticks after its release, and
+ * allowed "budget" ticks of CPU time.  Real-time threads run before
+ * all others, the earliest deadline first; one that uses up its budget
+ * runs as an ordinary thread until its next job.  Return 0, or -1 if
+ * the CPU cannot take the thread on top of the real-time threads it
+ * has (or the numbers make no sense).  A "period" of 0 makes the
+ * thread ordinary again.
+ *
+ * WaitPeriod says the current job is done, and waits for the next one
+ * to be released.  Return 0, or -1 if the thread is not real-time.
+ */
+int SetRealTime(int period, int deadline, int budget);
+int WaitPeriod();
+
+/* Bulk memory operations, done by the kernel straight in the program's
+ * pages rather than a byte at a time by user code.  MemCopy copies
+ * "size" bytes from "from" to "to", which must not overlap, as with
+ * memcpy; MemSet sets "size" bytes at "to" to "value".  Either returns
+ * "size", or -1 if part of the memory is not in the address space (or
+ * "to" is read-only); some bytes may have been done by then.
+ * ZeroPage clears the whole page "addr" is in, and returns the page
+ * size, or -1.  Each is charged about a tick per word.
+ */
+int MemCopy(char *to, char *from, int size);
+int MemSet(char *to, int value, int size);
+int ZeroPage(char *addr);
+
+/* The resources a thread, or a whole program, has been charged for.
+ * A switch is voluntary if the thread gave up the CPU itself (by
+ * yielding, or waiting), involuntary if it was preempted.
+ */
+typedef struct {
+    int userTicks;		/* time running user code */
+    int systemTicks;		/* time in the kernel on its behalf */
+    int sectorsRead;		/* disk sectors read for it */
+    int sectorsWritten;		/* and written */
+    int pageFaults;
+    int syscalls;
+    int voluntarySwitches;
+    int involuntarySwitches;
+} ResourceUsage;
+
+/* Fill in "thread" with what the calling thread has been charged for,
+ * and "program" with what all the threads of its program have, those
+ * that have exited included; either may be 0 if not wanted.  Return
+ * 1, or -1 if either is not in the address space.
+ */
+int GetStats(ResourceUsage *thread, ResourceUsage *program);
+
 #endif /* IN_ASM */
 
 #endif /* SYSCALL_H */
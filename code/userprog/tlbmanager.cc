@@ -0,0 +1,316 @@
+// tlbmanager.cc
+//	Routines to load the TLB from the page tables of address spaces,
+//	on TLB misses.
+//
+//	The use and dirty bits the machine sets are in the TLB entry; they
+//	are copied back to the page table entries when the TLB entry is
+//	replaced.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "main.h"
+#include "tlbmanager.h"
+#include "addrspace.h"
+#include "machine.h"
+
+static const char *policyNames[] = {"FIFO", "LRU", "random"};
+
+//----------------------------------------------------------------------
+// TLBManager::TLBManager
+// 	Get ready to handle misses in the machine's TLB, which starts out
+//	with every entry invalid.
+//
+//	"policyName" -- how to choose the entry to replace: "fifo", "lru"
+//		or "random"; NULL for the default, fifo
+//	"superPages" -- map runs of pages with one entry, where they can
+//		be
+//	"numCpus" -- simulated CPUs, each with a TLB; CPU 0's is loaded
+//----------------------------------------------------------------------
+
+TLBManager::TLBManager(char *policyName, bool superPages, int numCpus)
+{
+    int size = kernel->machine->tlbSize;
+
+    ASSERT(kernel->machine->tlb != NULL);
+    ASSERT(size >= 2);		// an instruction may need two pages at
+				// once: its own, and the one it loads
+				// from or stores to
+    policy = TLBFIFO;
+    if (policyName == NULL || strcmp(policyName, "fifo") == 0)
+	policy = TLBFIFO;
+    else if (strcmp(policyName, "lru") == 0)
+	policy = TLBLRU;
+    else if (strcmp(policyName, "random") == 0)
+	policy = TLBRandom;
+    else
+	ASSERTNOTREACHED();	// unknown TLB replacement policy
+
+    kernel->stats->tlbPolicy = policyNames[policy];
+    kernel->stats->tlbSize = size;
+    this->superPages = superPages;
+    this->numCpus = numCpus;
+    loadedCpu = 0;
+    for (int cpu = 0; cpu < numCpus; cpu++) {
+	saved[cpu] = new TranslationEntry[size];
+	for (int i = 0; i < size; i++)
+	    saved[cpu][i].valid = FALSE;
+	next[cpu] = 0;
+	source[cpu] = new TranslationEntry *[size * MaxSuperPage];
+	for (int i = 0; i < size * MaxSuperPage; i++)
+	    source[cpu][i] = NULL;
+    }
+}
+
+TLBManager::~TLBManager()
+{
+    for (int cpu = 0; cpu < numCpus; cpu++) {
+	delete [] saved[cpu];
+	delete [] source[cpu];
+    }
+}
+
+//----------------------------------------------------------------------
+// TLBManager::UseCpu
+// 	Put the TLB of simulated CPU "cpu" in the machine, keeping the
+//	one that was there for its own CPU.  Called before a thread with
+//	an address space runs; nothing to do if it runs on the same CPU
+//	as the last one did.
+//----------------------------------------------------------------------
+
+void
+TLBManager::UseCpu(int cpu)
+{
+    TranslationEntry *tlb = kernel->machine->tlb;
+    int size = kernel->machine->tlbSize;
+
+    ASSERT(cpu >= 0 && cpu < numCpus);
+    if (cpu == loadedCpu)
+	return;
+    for (int i = 0; i < size; i++) {
+	saved[loadedCpu][i] = tlb[i];
+	tlb[i] = saved[cpu][i];
+    }
+    loadedCpu = cpu;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Entries
+// 	Return the TLB entries of CPU "cpu": the machine's, if its TLB is
+//	loaded, or else the copy kept of them.
+//----------------------------------------------------------------------
+
+TranslationEntry *
+TLBManager::Entries(int cpu)
+{
+    return (cpu == loadedCpu) ? kernel->machine->tlb : saved[cpu];
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Refill
+// 	Handle a TLB miss: load the translation of "virtAddr" in the
+//	current thread's address space into the TLB.  The user
+//	instruction that missed is then simply run again.
+//
+//	Return FALSE if the address space has no valid translation for
+//	it -- with a hashed page table, no entry -- so that the miss is a
+//	real fault.
+//
+//	With superpages, the entry may map a run of pages around it; any
+//	other entries for pages of the run are dropped, so that no page
+//	is in the TLB twice.
+//
+//	"virtAddr" -- the address that missed
+//----------------------------------------------------------------------
+
+bool
+TLBManager::Refill(int virtAddr)
+{
+    AddrSpace *space = kernel->currentThread->space;
+    TranslationEntry *tlb = kernel->machine->tlb;
+    unsigned int vpn = (unsigned) virtAddr / PageSize;
+    TranslationEntry *pte;
+    int i, numPages;
+
+    ASSERT(space != NULL);
+    pte = space->PageEntry(vpn);
+    if (pte == NULL || !pte->valid)
+	return FALSE;
+
+    numPages = superPages ? SuperPage(space, vpn) : 1;
+    if (numPages > 1) {
+	vpn &= ~(numPages - 1);
+	for (int k = 0; k < numPages; k++)
+	    Drop(space->Asid(), vpn + k);
+	pte = space->PageEntry(vpn);
+    }
+
+    i = Victim();
+    if (tlb[i].valid)
+	WriteBack(loadedCpu, i);
+    DEBUG(dbgAddr, "TLB entry " << i << " now maps virtual page "
+	  << pte->virtualPage << " of address space " << space->Asid()
+	  << ", " << numPages << " pages");
+    tlb[i] = *pte;
+    tlb[i].numPages = numPages;
+    tlb[i].asid = space->Asid();
+    tlb[i].lastUse = kernel->stats->numTLBHits;  // as if just used
+    for (int k = 0; k < numPages; k++)
+	source[loadedCpu][i * MaxSuperPage + k] = space->PageEntry(vpn + k);
+    if (numPages > 1)
+	kernel->stats->numSuperPages++;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::SuperPage
+// 	Return how many pages the TLB entry for page "vpn" of "space" can
+//	map: the length of the longest aligned run of pages around it,
+//	up to MaxSuperPage, that are valid, in consecutive frames starting
+//	at a multiple of the run's length, and all read-only, or all
+//	writable and dirty already; 1 if there is none.
+//----------------------------------------------------------------------
+
+int
+TLBManager::SuperPage(AddrSpace *space, unsigned int vpn)
+{
+    for (int size = MaxSuperPage; size > 1; size /= 2) {
+	unsigned int base = vpn & ~(size - 1);
+	TranslationEntry *first = space->PageEntry(base);
+	int k;
+
+	if ((first == NULL) || !first->valid ||
+		(first->physicalPage % size != 0))
+	    continue;
+	for (k = 0; k < size; k++) {
+	    TranslationEntry *pte = space->PageEntry(base + k);
+
+	    if ((pte == NULL) || !pte->valid ||
+		    (pte->physicalPage != first->physicalPage + k) ||
+		    (pte->readOnly != first->readOnly) ||
+		    !(pte->readOnly || pte->dirty))
+		break;
+	}
+	if (k == size)
+	    return size;
+    }
+    return 1;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Forget
+// 	Invalidate every entry of an address space that is being
+//	deleted, in the TLB of every CPU, so that nothing is copied back
+//	into its page table.
+//
+//	"asid" -- the address space id
+//----------------------------------------------------------------------
+
+void
+TLBManager::Forget(int asid)
+{
+    for (int cpu = 0; cpu < numCpus; cpu++) {
+	TranslationEntry *tlb = Entries(cpu);
+
+	for (int i = 0; i < kernel->machine->tlbSize; i++) {
+	    if (tlb[i].valid && (tlb[i].asid == asid)) {
+		tlb[i].valid = FALSE;
+		for (int k = 0; k < MaxSuperPage; k++)
+		    source[cpu][i * MaxSuperPage + k] = NULL;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Drop
+// 	Invalidate the TLB entries, if any, for virtual page "vpn" of an
+//	address space, in the TLB of every CPU, first copying their use
+//	and dirty bits back, since the page is leaving its frame.  An
+//	entry mapping a run of pages with "vpn" in it is dropped whole.
+//
+//	"asid" -- the address space id
+//	"vpn" -- the virtual page
+//----------------------------------------------------------------------
+
+void
+TLBManager::Drop(int asid, int vpn)
+{
+    for (int cpu = 0; cpu < numCpus; cpu++) {
+	TranslationEntry *tlb = Entries(cpu);
+
+	for (int i = 0; i < kernel->machine->tlbSize; i++) {
+	    if (tlb[i].valid && (tlb[i].asid == asid) &&
+		    (vpn >= tlb[i].virtualPage) &&
+		    (vpn < tlb[i].virtualPage + tlb[i].numPages)) {
+		WriteBack(cpu, i);
+		tlb[i].valid = FALSE;
+	    }
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// TLBManager::Victim
+// 	Return the entry of the loaded TLB to load a new translation
+//	into: an invalid one, if there is one, otherwise the one the
+//	policy picks.
+//----------------------------------------------------------------------
+
+int
+TLBManager::Victim()
+{
+    TranslationEntry *tlb = kernel->machine->tlb;
+    int size = kernel->machine->tlbSize;
+    int i, victim;
+
+    for (i = 0; i < size; i++) {
+	if (!tlb[i].valid)
+	    return i;
+    }
+    switch (policy) {
+      case TLBFIFO:
+	victim = next[loadedCpu];
+	next[loadedCpu] = (victim + 1) % size;
+	break;
+      case TLBLRU:
+	victim = 0;
+	for (i = 1; i < size; i++) {
+	    if (tlb[i].lastUse < tlb[victim].lastUse)
+		victim = i;
+	}
+	break;
+      default:
+	victim = RandomNumber() % size;
+	break;
+    }
+    return victim;
+}
+
+//----------------------------------------------------------------------
+// TLBManager::WriteBack
+// 	Copy the use and dirty bits the machine has set in entry "i" of
+//	the TLB of CPU "cpu" back to the page table entries it was loaded
+//	from, and forget them.  The pages of a run that is writable are
+//	dirty already.
+//----------------------------------------------------------------------
+
+void
+TLBManager::WriteBack(int cpu, int i)
+{
+    TranslationEntry *entry = &Entries(cpu)[i];
+
+    for (int k = 0; k < entry->numPages; k++) {
+	TranslationEntry *pte = source[cpu][i * MaxSuperPage + k];
+
+	if (pte == NULL)
+	    continue;
+	if (entry->use)
+	    pte->use = TRUE;
+	if (entry->dirty)
+	    pte->dirty = TRUE;
+	source[cpu][i * MaxSuperPage + k] = NULL;
+    }
+}
@@ -0,0 +1,95 @@
+// tlbmanager.h
+//	Data structures for managing a software-loaded TLB.
+//
+//	When Nachos is run with a TLB (-tlb), the machine translates
+//	user addresses only through the TLB; a virtual page that is not
+//	in it raises a PageFaultException.  The kernel then looks the
+//	page up in the address space's page table, and loads it into the
+//	TLB, in place of an invalid entry if there is one, or else of the
+//	one chosen by the replacement policy:
+//
+//	   FIFO -- the entry loaded longest ago
+//	   LRU -- the entry used longest ago
+//	   random -- any entry
+//
+//	Each TLB entry is tagged with the ASID (address space id) of its
+//	address space, and the machine only matches entries with the
+//	current ASID, so the TLB need not be flushed on a context switch.
+//
+//	With superpages (-tsp), a miss loads the largest aligned run of
+//	pages around the one that missed, up to MaxSuperPage, that can
+//	be mapped by one entry: every page valid, in consecutive frames
+//	starting at a multiple of the run's length (see
+//	FrameTable::FreeFrame), and all read-only or all writable.  A
+//	writable page must be dirty already, since the machine sets the
+//	dirty bit of the entry, not of the page written; until it is, the
+//	page is loaded on its own.  The entry's use bit is copied back to
+//	every page of the run.
+//
+//	With more than one simulated CPU (-cpus), each CPU has a TLB of
+//	its own.  The machine has the one TLB, so the kernel keeps the
+//	others, and swaps the TLB of the CPU a thread is to run on into
+//	the machine (UseCpu).  A thread that moves to another CPU thus
+//	misses on pages it had in the TLB of the last one, as on a real
+//	multiprocessor; the scheduler tries to keep it where it was.
+//
+// Copyright (c) 1992-1996 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef TLBMANAGER_H
+#define TLBMANAGER_H
+
+#include "copyright.h"
+#include "translate.h"
+#include "stats.h"
+
+class AddrSpace;
+
+// How the entry to be replaced on a TLB miss is chosen.
+enum TLBPolicy { TLBFIFO, TLBLRU, TLBRandom };
+
+// The following class defines the kernel's handling of TLB misses,
+// for the TLB of kernel->machine, and for those of the other CPUs.
+
+class TLBManager {
+  public:
+    TLBManager(char *policyName, bool superPages, int numCpus);
+					// "policyName" is fifo, lru or
+					// random; NULL means fifo.  Map runs
+					// of pages with one entry?  A TLB for
+					// each of "numCpus" CPUs
+    ~TLBManager();
+
+    bool Refill(int virtAddr);		// Load the translation of the
+					// current address space for
+					// "virtAddr"; FALSE if there is none
+    void Forget(int asid);		// Drop the entries of an address
+					// space that is going away
+    void Drop(int asid, int vpn);	// Drop the entry of a page whose
+					// translation is changing, from
+					// every CPU's TLB
+    void UseCpu(int cpu);		// Put the TLB of "cpu" in the machine
+
+  private:
+    int Victim();			// entry to load the next
+					// translation into
+    int SuperPage(AddrSpace *space, unsigned int vpn);
+					// pages the entry for "vpn" can map
+    TranslationEntry *Entries(int cpu);	// the TLB of "cpu", wherever it is
+    void WriteBack(int cpu, int i);	// copy entry i's use and dirty bits
+					// back to its page table
+
+    TLBPolicy policy;
+    bool superPages;			// load runs of pages into one entry?
+    int numCpus;			// how many TLBs there are
+    int loadedCpu;			// the CPU whose TLB the machine has
+    TranslationEntry *saved[MaxCpus];	// the TLBs of the others
+    int next[MaxCpus];			// FIFO: the entry each loaded
+					// longest ago
+    TranslationEntry **source[MaxCpus];	// page table entries each TLB entry
+					// was loaded from, MaxSuperPage
+					// for each
+};
+
+#endif // TLBMANAGER_H